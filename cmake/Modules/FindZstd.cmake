@@ -0,0 +1,21 @@
+#
+# Finds the zstd compression library, which the native WebSocket engine uses for
+# dictionary compression.
+#
+# Sets Zstd_FOUND, ZSTD_INCLUDE_DIRS and ZSTD_LIBRARIES. If zstd is somewhere
+# non standard, invoke cmake with "-DZSTD_INCLUDE_DIR=<dir with zstd.h>" and
+# "-DZSTD_LIBRARY=<path to libzstd>".
+#
+# Mark Grimes
+# 19/Oct/2026
+#
+
+find_path( ZSTD_INCLUDE_DIR NAMES zstd.h zdict.h )
+find_library( ZSTD_LIBRARY NAMES zstd )
+
+include( FindPackageHandleStandardArgs )
+find_package_handle_standard_args( Zstd DEFAULT_MSG ZSTD_LIBRARY ZSTD_INCLUDE_DIR )
+mark_as_advanced( ZSTD_INCLUDE_DIR ZSTD_LIBRARY )
+
+set( ZSTD_INCLUDE_DIRS ${ZSTD_INCLUDE_DIR} )
+set( ZSTD_LIBRARIES ${ZSTD_LIBRARY} )
@@ -0,0 +1,31 @@
+# Prints the size of each file in a build variant and the total, and writes the same to OUTPUT_FILE.
+#
+# Usage: cmake -D VARIANT=<name> -D FILES=<file>,<file>... [-D OUTPUT_FILE=<file> [-D APPEND=1]] -P ReportSizes.cmake
+#
+# Only uses commands from before file(SIZE) existed, so works with the same CMake as the rest of the build.
+
+string( REPLACE "," ";" FILES "${FILES}" )
+set( total 0 )
+set( report "" )
+foreach( FILE ${FILES} )
+	if( NOT EXISTS "${FILE}" )
+		message( FATAL_ERROR "Can't report the size of \"${FILE}\" because it doesn't exist" )
+	endif()
+	# Two hex digits for every byte
+	file( READ "${FILE}" contents HEX )
+	string( LENGTH "${contents}" length )
+	math( EXPR size "${length} / 2" )
+	math( EXPR total "${total} + ${size}" )
+	get_filename_component( name "${FILE}" NAME )
+	set( report "${report}${VARIANT} ${name} ${size} bytes\n" )
+endforeach( FILE )
+set( report "${report}${VARIANT} total ${total} bytes\n" )
+
+message( "${report}" )
+if( OUTPUT_FILE )
+	if( APPEND )
+		file( APPEND "${OUTPUT_FILE}" "${report}" )
+	else()
+		file( WRITE "${OUTPUT_FILE}" "${report}" )
+	endif()
+endif()
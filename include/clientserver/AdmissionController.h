@@ -0,0 +1,83 @@
+#ifndef INCLUDEGUARD_clientserver_AdmissionController_h
+#define INCLUDEGUARD_clientserver_AdmissionController_h
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+namespace clientserver
+{
+	/** @brief Sheds work when the handler queue has a standing backlog, so that what does get run isn't stuck behind it.
+	 *
+	 * Based on CoDel (Nichols and Jacobson, "Controlling Queue Delay"), applied to requests waiting for
+	 * a handler thread rather than packets waiting for a link. Each task is timestamped when it's queued,
+	 * and start() is told when it comes off the queue, which gives how long it waited. A burst can make
+	 * that long for a while without anything being wrong, so it's the smallest wait over each interval
+	 * that matters: if even that was over the target, the queue never emptied and it is just adding
+	 * latency. The controller is then overloaded until an interval goes by with a wait under target.
+	 *
+	 * While overloaded:
+	 *  - admit() turns away new low priority work, so it isn't queued at all.
+	 *  - start() sheds normal priority tasks that have waited more than twice the target, and low
+	 *    priority ones that waited more than the target. Their handlers aren't run, and the client is
+	 *    told to try again after retryAfter(), so it costs a lot less than running them late.
+	 * Everything else is run as normal, so the queue drains back to around the target instead of
+	 * growing while everything in it gets slower.
+	 *
+	 * Thread safe, and nothing locks, so one controller can be shared by several handler pools.
+	 *
+	 * @author Mark Grimes
+	 * @date 19/Oct/2026
+	 */
+	class AdmissionController
+	{
+	public:
+		enum class Priority { low=0, normal };
+		static const size_t numberOfPriorities=2;
+
+		struct Configuration
+		{
+			std::chrono::microseconds target;   ///< The queueing delay to keep to
+			std::chrono::microseconds interval; ///< How long the delay has to stay over target before shedding starts, roughly a worst case round trip
+		};
+
+		/** @brief CoDel's defaults, a target of 5ms and an interval of 100ms. */
+		AdmissionController();
+		/** @throw std::invalid_argument  If the target isn't positive, or the interval is shorter than it. */
+		explicit AdmissionController( const Configuration& configuration );
+
+		/** @brief The time to give to start(), in nanoseconds on the steady clock. */
+		static int64_t now();
+		/** @brief Whether to queue a new task, called before it's queued. Only ever false for low priority work, while overloaded. */
+		bool admit( Priority priority );
+		/** @brief Records how long the task waited, and returns whether to run it or shed it. Called as it comes off the queue.
+		 * @param queuedAt  What now() was when the task was queued.
+		 */
+		bool start( int64_t queuedAt, Priority priority );
+
+		/** @brief Whether the queue has had a standing backlog for the last interval. */
+		bool isOverloaded() const;
+		/** @brief The number of tasks of the priority that have been turned away or shed. */
+		uint64_t shed( Priority priority ) const;
+		/** @brief How long clients are told to wait before trying again, which is one interval. */
+		std::chrono::milliseconds retryAfter() const;
+		const Configuration& configuration() const;
+	protected:
+		AdmissionController( const AdmissionController& other ) = delete;
+		AdmissionController& operator=( const AdmissionController& other ) = delete;
+		bool isOverloaded( int64_t now ) const;
+		bool reject( Priority priority );
+
+		const Configuration configuration_;
+		const int64_t target_;   ///< In nanoseconds
+		const int64_t interval_; ///< In nanoseconds
+		std::atomic<int64_t> intervalEnd_; ///< When the current interval finishes, or zero before the first task
+		std::atomic<int64_t> minimumDelay_; ///< The shortest wait in the current interval
+		std::atomic<bool> overloaded_; ///< Whether the minimum was over target for the previous interval
+		std::atomic<uint64_t> shed_[numberOfPriorities];
+	};
+
+} // end of namespace clientserver
+
+#endif // end of "#ifndef INCLUDEGUARD_clientserver_AdmissionController_h"
@@ -0,0 +1,63 @@
+#ifndef INCLUDEGUARD_clientserver_ArenaBlockPool_h
+#define INCLUDEGUARD_clientserver_ArenaBlockPool_h
+
+#include <vector>
+#include <cstddef>
+#include <google/protobuf/arena.h>
+
+namespace clientserver
+{
+	/** @brief Keeps the memory blocks of finished protobuf Arenas so that new arenas don't have to allocate.
+	 *
+	 * RpcDispatcher creates an arena for every request, and frees it in one go once the response is
+	 * serialised. With arenaOptions() the arena gets its blocks from the pool of the thread it runs on,
+	 * so once a handler thread has warmed up, parsing requests and building responses doesn't need
+	 * malloc at all.
+	 *
+	 * Blocks are kept in power of two size classes from 4KiB to 1MiB, larger ones always go back to
+	 * the system. Not thread safe, each thread uses its own pool from threadPool().
+	 *
+	 * @author Mark Grimes
+	 * @date 19/Oct/2026
+	 */
+	class ArenaBlockPool
+	{
+	public:
+		/** @brief
+		 * @param maximumPooledBytes  Blocks given back when the pool already holds this much are freed.
+		 */
+		explicit ArenaBlockPool( size_t maximumPooledBytes );
+		~ArenaBlockPool();
+
+		/** @brief Returns a block of at least size bytes, which has to be given back with deallocate() using the same size. */
+		void* allocate( size_t size );
+		void deallocate( void* pBlock, size_t size );
+
+		size_t pooledBytes() const;
+		/** @brief How many times allocate() has been called, and how many of those needed a new block from the system. */
+		size_t allocations() const;
+		size_t systemAllocations() const;
+
+		/** @brief The pool for the calling thread, which holds at most 4MiB. */
+		static ArenaBlockPool& threadPool();
+		/** @brief Options for a google::protobuf::Arena that takes its blocks from threadPool(). */
+		static google::protobuf::ArenaOptions arenaOptions();
+	protected:
+		ArenaBlockPool( const ArenaBlockPool& other ) = delete;
+		ArenaBlockPool& operator=( const ArenaBlockPool& other ) = delete;
+
+		static const size_t minimumSizeShift=12;
+		static const size_t maximumSizeShift=20;
+		/** @brief The size class that can hold size bytes, or maximumSizeShift+1 if it's too large to pool. */
+		static size_t sizeShift( size_t size );
+
+		size_t maximumPooledBytes_;
+		size_t pooledBytes_;
+		size_t allocations_;
+		size_t systemAllocations_;
+		std::vector<void*> freeBlocks_[maximumSizeShift-minimumSizeShift+1];
+	};
+
+} // end of namespace clientserver
+
+#endif // end of "#ifndef INCLUDEGUARD_clientserver_ArenaBlockPool_h"
@@ -0,0 +1,46 @@
+#ifndef INCLUDEGUARD_clientserver_BatchEnvelope_h
+#define INCLUDEGUARD_clientserver_BatchEnvelope_h
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace clientserver
+{
+	/** @brief How the sub-requests of a batch, and their responses, are packed into one message.
+	 *
+	 * A batch goes inside a clientserver::MessageEnvelope with the batch types, and is just the entries
+	 * one after the other:
+	 *
+	 *     <id>:<length>:<payload>
+	 *
+	 * where <id> is chosen by the client to match responses to sub-requests and <length> is the number
+	 * of bytes in <payload>, both in decimal. The response to a batch uses the same layout, with each
+	 * response having the id of its sub-request. Like MessageEnvelope it is kept as text so that it
+	 * can go in text frames and be produced from javascript.
+	 *
+	 * @author Mark Grimes
+	 * @date 19/Oct/2026
+	 */
+	class BatchEnvelope
+	{
+	public:
+		struct Entry
+		{
+			uint32_t id;
+			std::string payload;
+		};
+
+		/** @brief Appends one entry to the end of output. */
+		static void encode( uint32_t id, const std::string& payload, std::string& output );
+
+		/** @brief Appends the entries in the batch to entries.
+		 *
+		 * @throw std::runtime_error  If the batch is not valid.
+		 */
+		static void decode( const std::string& batch, std::vector<Entry>& entries );
+	};
+
+} // end of namespace clientserver
+
+#endif // end of "#ifndef INCLUDEGUARD_clientserver_BatchEnvelope_h"
@@ -0,0 +1,65 @@
+#ifndef INCLUDEGUARD_clientserver_BinaryFramer_h
+#define INCLUDEGUARD_clientserver_BinaryFramer_h
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+namespace clientserver
+{
+	/** @brief Encodes and decodes the minimal length prefixed framing used by the raw TCP transport.
+	 *
+	 * Every frame is a 9 byte header followed by the payload:
+	 *
+	 *     uint32 payload length (network byte order)
+	 *     uint8  message type
+	 *     uint32 id (network byte order), used to match responses to requests
+	 *
+	 * Decoding is incremental. Bytes are added as they arrive from the socket, either with append()
+	 * or by writing directly into the buffer with reserve() and commit(), and complete frames are
+	 * taken out with next().
+	 *
+	 * @author Mark Grimes
+	 * @date 19/Oct/2026
+	 */
+	class BinaryFramer
+	{
+	public:
+		/** @brief The stream and batch types are only used by WebSocketServer at the moment, and the other transports ignore them.
+		 * The session, channel and go away types are only ever carried by clientserver::MessageEnvelope, and next() rejects them. */
+		enum class MessageType : uint8_t { request=1, response=2, info=3, streamRequest=4, streamChunk=5, streamEnd=6, batchRequest=7, streamingBatchRequest=8, session=9, acknowledgement=10,
+			channelOpen=11, channelCredit=12, channelMessage=13, channelFragment=14, goAway=15, overloaded=16 };
+		static const size_t headerSize=9;
+
+		/** @brief Appends the encoded frame to the end of output. */
+		static void encode( MessageType type, uint32_t id, const std::string& payload, std::string& output );
+
+		BinaryFramer();
+		/** @brief Frames with a payload larger than this cause next() to throw. Default is 64MiB. */
+		void setMaximumPayloadSize( size_t size );
+
+		void append( const char* pData, size_t size );
+		/** @brief Returns a pointer to at least size bytes that can be written to, which must then be committed. */
+		char* reserve( size_t size );
+		/** @brief Marks size bytes from the last reserve() as received. */
+		void commit( size_t size );
+
+		/** @brief Takes the next complete frame out of the buffer, or returns false if there isn't one yet.
+		 *
+		 * @throw std::length_error  If the frame is larger than the maximum payload size.
+		 * @throw std::runtime_error If the message type is not valid.
+		 */
+		bool next( MessageType& type, uint32_t& id, std::string& payload );
+
+		/** @brief The number of bytes received that haven't been taken out as frames yet. */
+		size_t bufferedSize() const;
+	protected:
+		std::string buffer_;
+		size_t readPosition_;  ///< Start of the first byte not yet taken out by next()
+		size_t writePosition_; ///< End of the received data. buffer_ can be larger than this.
+		size_t maximumPayloadSize_;
+	};
+
+} // end of namespace clientserver
+
+#endif // end of "#ifndef INCLUDEGUARD_clientserver_BinaryFramer_h"
@@ -0,0 +1,44 @@
+#ifndef INCLUDEGUARD_clientserver_BufferPool_h
+#define INCLUDEGUARD_clientserver_BufferPool_h
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+namespace clientserver
+{
+	/** @brief Keeps hold of buffers from finished connections so that new connections don't have to allocate.
+	 *
+	 * Buffers are std::strings so that they can be handed straight to clientserver::WebSocketFramer.
+	 * Not thread safe, the intention is that each event loop has its own pool.
+	 *
+	 * @author Mark Grimes
+	 * @date 19/Oct/2026
+	 */
+	class BufferPool
+	{
+	public:
+		/** @brief
+		 * @param initialCapacity     Capacity of newly allocated buffers.
+		 * @param maximumCapacity     Buffers that have grown larger than this are freed rather than kept, so that
+		 *                            one huge message doesn't pin memory forever.
+		 * @param maximumPooled       The most buffers to keep at once.
+		 */
+		BufferPool( size_t initialCapacity, size_t maximumCapacity, size_t maximumPooled );
+
+		/** @brief Returns an empty buffer, with at least the initial capacity. */
+		std::string acquire();
+		/** @brief Gives a buffer back to the pool. */
+		void release( std::string&& buffer );
+
+		size_t pooledBuffers() const;
+	protected:
+		size_t initialCapacity_;
+		size_t maximumCapacity_;
+		size_t maximumPooled_;
+		std::vector<std::string> buffers_;
+	};
+
+} // end of namespace clientserver
+
+#endif // end of "#ifndef INCLUDEGUARD_clientserver_BufferPool_h"
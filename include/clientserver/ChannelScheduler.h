@@ -0,0 +1,79 @@
+#ifndef INCLUDEGUARD_clientserver_ChannelScheduler_h
+#define INCLUDEGUARD_clientserver_ChannelScheduler_h
+
+#include <string>
+#include <deque>
+#include <map>
+#include <cstddef>
+#include <cstdint>
+#include "clientserver/WebSocketFramer.h"
+
+namespace clientserver
+{
+	/** @brief Decides what goes out next when several logical channels share one connection.
+	 *
+	 * Messages are cut into fragments of at most the fragment size, so that a large message on one
+	 * channel only holds up the others for one fragment at a time. next() gives the next fragment
+	 * from the highest priority channel that has something to send and credit left, taking turns
+	 * between channels of the same priority. Credit is in bytes of fragment, given when the channel
+	 * is opened and topped up with addCredit() as the receiver gets through what it has been sent,
+	 * so a receiver that falls behind only stops its own channel.
+	 *
+	 * Text messages are only cut between UTF-8 characters, so that each fragment can go in a text frame.
+	 *
+	 * Not thread safe, WebSocketServer keeps one for each connection behind a mutex.
+	 *
+	 * @author Mark Grimes
+	 * @date 19/Oct/2026
+	 */
+	class ChannelScheduler
+	{
+	public:
+		static const size_t defaultFragmentSize=16*1024;
+
+		explicit ChannelScheduler( size_t fragmentSize=defaultFragmentSize );
+
+		/** @brief Opens the channel, or if it's already open changes its priority and adds to its credit. Higher priorities go first. */
+		void open( uint32_t channel, uint32_t priority, uint32_t credit );
+		bool isOpen( uint32_t channel ) const;
+		size_t numberOfChannels() const;
+		/** @brief Lets the channel send this many more bytes. Returns false if the channel isn't open. */
+		bool addCredit( uint32_t channel, uint32_t credit );
+
+		/** @brief Queues a whole message to go out on the channel.
+		 * @throw std::invalid_argument  If the channel isn't open.
+		 */
+		void push( uint32_t channel, clientserver::WebSocketFramer::Opcode opcode, std::string message );
+		/** @brief Takes out the next fragment to send, or returns false if every channel is empty or out of credit.
+		 *
+		 * @param isLast  Set to whether the fragment is the end of its message.
+		 */
+		bool next( uint32_t& channel, clientserver::WebSocketFramer::Opcode& opcode, std::string& fragment, bool& isLast );
+		/** @brief The bytes pushed onto all of the channels that haven't come out of next() yet. */
+		size_t queuedBytes() const;
+	protected:
+		struct Message
+		{
+			clientserver::WebSocketFramer::Opcode opcode;
+			std::string data;
+			size_t position; ///< How much of data has already gone out in fragments
+		};
+		struct Channel
+		{
+			uint32_t priority;
+			uint64_t credit;
+			uint64_t lastTurn; ///< When the channel last sent, so that channels of the same priority take turns
+			std::deque<Message> messages;
+		};
+		/** @brief The size of the next fragment the channel can send, which is zero if it can't send anything. */
+		size_t nextFragmentSize( const Channel& channel ) const;
+
+		size_t fragmentSize_;
+		std::map<uint32_t,Channel> channels_;
+		uint64_t turns_;
+		size_t queuedBytes_;
+	};
+
+} // end of namespace clientserver
+
+#endif // end of "#ifndef INCLUDEGUARD_clientserver_ChannelScheduler_h"
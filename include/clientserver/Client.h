@@ -0,0 +1,205 @@
+#ifndef INCLUDEGUARD_clientserver_Client_h
+#define INCLUDEGUARD_clientserver_Client_h
+
+#include <string>
+#include <functional>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+#include <random>
+#include <chrono>
+#include <cstdint>
+#include "clientserver/IClientTransport.h"
+#include "clientserver/MessageEnvelope.h"
+
+namespace clientserver
+{
+	/** @brief Asynchronous client for clientserver::WebSocketServer, with the same interface as the javascript ClientServer.
+	 *
+	 * This is the client library for native services and load tests, and the engine behind the bench
+	 * command. The same code is compiled into the Emscripten client, where the connection is the
+	 * browser's WebSocket, so everything is non-blocking. Requests are pipelined, with at most the
+	 * request window of them waiting for responses at once and the rest queued in order. If the
+	 * connection drops it can be reopened automatically, with an exponential backoff, and with
+	 * setSessionResumption() carry on from where it left off. When a server that is shutting down
+	 * says to go away, new messages are queued until the connection has been reopened, presumably
+	 * to a different server, while the responses to the ones already sent still arrive.
+	 *
+	 * Handlers are called on the transport's thread, see clientserver::IClientTransport. Everything
+	 * else can be called from any thread.
+	 *
+	 * @author Mark Grimes
+	 * @date 19/Oct/2026
+	 */
+	class Client
+	{
+	public:
+		/** @brief Uses the transport from clientserver::createClientTransport(). */
+		Client();
+		explicit Client( std::unique_ptr<clientserver::IClientTransport> pTransport );
+		~Client();
+
+		void setDefaultInfoHandler( std::function<void(const std::string&)> infoHandler );
+		/** @brief Called with true each time the connection opens, and with false each time it closes. */
+		void setConnectionHandler( std::function<void(bool)> connectionHandler );
+		/** @brief Called when the server was too busy to run a request or batch, with how long it asked for before trying again.
+		 *
+		 * The request's own handler isn't called, the same as if the connection had dropped, and it can
+		 * safely be sent again since nothing was run. See WebSocketServer::setAdmissionController().
+		 * Streamed batches that are turned away end with an error instead.
+		 */
+		void setOverloadHandler( std::function<void(std::chrono::milliseconds)> overloadHandler );
+		/** @brief Whether to reopen the connection if it drops or can't be made. Off by default.
+		 *
+		 * The first retry is after roughly initialDelay, and the delay doubles for each retry after that up
+		 * to maximumDelay. Each delay is randomly shortened by up to half, so that clients dropped at the
+		 * same time don't all come back at once.
+		 */
+		void setReconnect( bool reconnect, std::chrono::milliseconds initialDelay=std::chrono::milliseconds(100), std::chrono::milliseconds maximumDelay=std::chrono::seconds(30) );
+		/** @brief Whether to ask the server for a session, so that reconnecting resumes rather than starting again. Off by default.
+		 *
+		 * Only makes a difference when reconnecting, and has to be set before connect(). Each message sent
+		 * is kept until the server acknowledges it, and the server does the same (see
+		 * WebSocketServer::setSessionResumption()). On reconnecting, each side sends again what the other
+		 * missed, so requests in flight get their responses and streams carry on instead of ending with an
+		 * error. This all happens in the upgrade, so costs no more round trips than a new connection.
+		 *
+		 * If the session can't be resumed, because it expired on the server or more than replayBufferSize
+		 * messages were waiting to be acknowledged, a new one is started and everything outstanding is
+		 * dropped the same as without a session. A server with sessions turned off is treated as if this
+		 * were off.
+		 */
+		void setSessionResumption( bool resume, size_t replayBufferSize=1024 );
+		/** @brief The most requests of any kind that can be waiting for their final response at once. Default is 64. */
+		void setRequestWindow( size_t requestWindow );
+		/** @brief The number of requests sent that haven't finished yet. */
+		size_t outstandingRequests();
+		/** @brief The number of requests waiting for room in the window, or for the connection to open, before they're sent. */
+		size_t queuedRequests();
+
+		/** @brief Starts connecting to the ws:// or wss:// url and returns straight away.
+		 *
+		 * Messages can be sent straight away, they're queued until the connection opens. If the connection
+		 * can't be made and reconnecting is off, the queued messages are dropped.
+		 * @throw std::invalid_argument  If the transport doesn't support the url.
+		 */
+		void connect( const std::string& url );
+#ifndef __EMSCRIPTEN__
+		/** @brief Blocks until the connection is open, returning false if it failed or the timeout passed first. Not available in Emscripten. */
+		bool waitUntilConnected( std::chrono::milliseconds timeout );
+#endif
+		/** @brief Closes the connection. Anything not sent yet is dropped, and streaming requests are ended with an error. */
+		void disconnect();
+		bool isConnected();
+
+		/** @brief Sends a message that does not expect a response.
+		 * @throw std::runtime_error  If connect() hasn't been called, or the connection failed and isn't being retried.
+		 */
+		void sendInfo( const std::string& message );
+		/** @brief Sends a request, calling responseHandler when the response arrives.
+		 *
+		 * If the connection drops before the response arrives, or the server is overloaded (see
+		 * setOverloadHandler()), the handler is never called.
+		 * @throw std::runtime_error  If connect() hasn't been called, or the connection failed and isn't being retried.
+		 */
+		void sendRequest( const std::string& message, std::function<void(const std::string&)> responseHandler );
+		/** @brief Versions that send the message in a binary frame, so it can contain any bytes. The response to a binary request is also binary. */
+		void sendBinaryInfo( const std::string& message );
+		void sendBinaryRequest( const std::string& message, std::function<void(const std::string&)> responseHandler );
+		/** @brief Sends a request that the server replies to in chunks, see clientserver::IResponseStream.
+		 *
+		 * chunkHandler is called for each chunk in order, then endHandler once with an empty string if the reply
+		 * finished successfully or the error message if not, which includes the connection dropping.
+		 */
+		void sendStreamingRequest( const std::string& message, std::function<void(const std::string&)> chunkHandler, std::function<void(const std::string&)> endHandler );
+		void sendBinaryStreamingRequest( const std::string& message, std::function<void(const std::string&)> chunkHandler, std::function<void(const std::string&)> endHandler );
+		/** @brief Sends several requests in one message, see clientserver::BatchEnvelope. The responses are in the same order as the requests. */
+		void sendBatch( const std::vector<std::string>& messages, std::function<void(const std::vector<std::string>&)> responsesHandler );
+		/** @brief Sends several requests in one message, calling responseHandler with the index and response of each as it finishes. */
+		void sendStreamingBatch( const std::vector<std::string>& messages, std::function<void(size_t,const std::string&)> responseHandler, std::function<void(const std::string&)> endHandler );
+		void sendBinaryBatch( const std::vector<std::string>& messages, std::function<void(const std::vector<std::string>&)> responsesHandler );
+		void sendBinaryStreamingBatch( const std::vector<std::string>& messages, std::function<void(size_t,const std::string&)> responseHandler, std::function<void(const std::string&)> endHandler );
+	protected:
+		typedef std::function<void(const std::string&)> MessageHandler;
+		struct OutgoingMessage
+		{
+			bool isBinary;
+			bool isRequest; ///< Whether it takes up a place in the request window
+			uint32_t id;    ///< Only meaningful for requests
+			std::string envelope;
+		};
+
+		Client( const Client& other ) = delete;
+		Client& operator=( const Client& other ) = delete;
+
+		void sendInfo( bool isBinary, const std::string& message );
+		void sendRequest( bool isBinary, const std::string& message, MessageHandler responseHandler );
+		void sendStreamingRequest( bool isBinary, const std::string& message, MessageHandler chunkHandler, MessageHandler endHandler );
+		void sendBatch( bool isBinary, const std::vector<std::string>& messages, std::function<void(const std::vector<std::string>&)> responsesHandler );
+		void sendStreamingBatch( bool isBinary, const std::vector<std::string>& messages, std::function<void(size_t,const std::string&)> responseHandler, MessageHandler endHandler );
+		/** @brief Puts the envelope and the messages, with their indices as the sub-request ids, into one payload. */
+		static std::string encodeBatch( clientserver::MessageEnvelope::MessageType type, uint32_t id, const std::vector<std::string>& messages );
+
+		/** @brief Throws if nothing can be sent. Requires mutex_ to be locked. */
+		void checkConnecting();
+		/** @brief Sends the message if it can go now, otherwise queues it. Requires mutex_ to be locked. */
+		void sendOrQueue( OutgoingMessage message );
+		/** @brief Sends as much of the queue as the window allows. Requires mutex_ to be locked. */
+		void sendQueued();
+		/** @brief Sends the message on the transport, keeping it if there's a session. Requires mutex_ to be locked. */
+		void transmit( OutgoingMessage message );
+		/** @brief Forgets the session and its counts. Requires mutex_ to be locked. */
+		void forgetSession();
+		/** @brief Opens the transport with handlers for the current attempt. Requires mutex_ to be locked. */
+		void openTransport();
+
+		void handleOpen( uint64_t attempt );
+		/** @brief Replies come back in the same kind of frame as their request, so whether it was binary doesn't matter here. */
+		void handleMessage( uint64_t attempt, std::string& message );
+		/** @brief The server's reply to asking for a session, which is the first message on the connection. */
+		void handleSession( uint64_t attempt, uint32_t serverReceived, const std::string& token );
+		void handleClose( uint64_t attempt, const std::string& reason );
+		/** @brief Forgets the outstanding requests, returning the end handlers of the streams so they can be told. Requires mutex_ to be locked. */
+		std::vector<MessageHandler> dropOutstanding();
+
+		std::mutex mutex_;
+		// Everything from here to the transport is protected by mutex_
+		std::string url_;
+		bool isConnecting_;   ///< Between connect() and either disconnect() or a failure that isn't being retried
+		bool isConnected_;
+		bool isGoingAway_; ///< The server is shutting down, so new messages are queued for the next connection
+		/** @brief Incremented by connect() and disconnect(), so that handlers and retries for older connections are ignored. */
+		uint64_t attempt_;
+		bool reconnect_;
+		std::chrono::milliseconds initialReconnectDelay_;
+		std::chrono::milliseconds maximumReconnectDelay_;
+		std::chrono::milliseconds reconnectDelay_;
+		std::mt19937 randomGenerator_;
+		uint32_t nextRequestId_;
+		size_t requestWindow_;
+		size_t outstandingRequests_;
+		std::deque<OutgoingMessage> queue_;
+		std::unordered_map<uint32_t,MessageHandler> responseHandlers_;
+		/** @brief The chunk and end handlers for each streaming request. */
+		std::unordered_map<uint32_t,std::pair<MessageHandler,MessageHandler> > streamHandlers_;
+		MessageHandler infoHandler_;
+		std::function<void(bool)> connectionHandler_;
+		std::function<void(std::chrono::milliseconds)> overloadHandler_;
+		std::condition_variable connectionChanged_;
+		bool resumeSessions_;
+		size_t replayBufferSize_;
+		std::string sessionToken_; ///< Empty if there's no session
+		uint32_t messagesSent_;     ///< In the session, which wraps around the same as on the server
+		uint32_t messagesReceived_; ///< In the session
+		uint32_t receivedSinceAcknowledgement_;
+		std::deque<OutgoingMessage> unacknowledged_; ///< The last unacknowledged_.size() messages sent in the session
+
+		std::unique_ptr<clientserver::IClientTransport> pTransport_;
+	};
+
+} // end of namespace clientserver
+
+#endif // end of "#ifndef INCLUDEGUARD_clientserver_Client_h"
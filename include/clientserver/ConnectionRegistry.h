@@ -0,0 +1,86 @@
+#ifndef INCLUDEGUARD_clientserver_ConnectionRegistry_h
+#define INCLUDEGUARD_clientserver_ConnectionRegistry_h
+
+#include <memory>
+#include <functional>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include "clientserver/IConnection.h"
+
+namespace clientserver
+{
+	/** @brief Every live connection of one or more servers, by an integer id, e.g. for broadcasts, statistics and admin commands.
+	 *
+	 * The servers add each connection as it's accepted and remove it once it has closed, and the id is
+	 * available from IConnection::connectionId(). Ids aren't reused while the registry exists (at least
+	 * until a slot has been reused 2^32 times), so a stale id finds nothing rather than someone else.
+	 *
+	 * find() and forEach() never lock, so enumerating a hundred thousand connections doesn't hold up
+	 * connections being accepted or closed, or any messages. The entries live in fixed slots, in chunks
+	 * that are never moved, and removed entries are freed using epoch based reclamation: readers
+	 * announce the epoch they started in, and an entry is only freed once the epoch has moved on
+	 * twice since it was removed, which can't happen while any reader that might have seen it is still
+	 * going. add() and remove() are serialised between themselves with a mutex, but never wait for
+	 * readers.
+	 *
+	 * The registry only holds weak pointers, so it never keeps a connection alive.
+	 *
+	 * @author Mark Grimes
+	 * @date 19/Oct/2026
+	 */
+	class ConnectionRegistry
+	{
+	public:
+		ConnectionRegistry();
+		/** @brief Must not be called while anything else is using the registry. */
+		~ConnectionRegistry();
+
+		/** @brief Adds the connection and returns its id, which is never zero.
+		 * @throw std::length_error  If the registry is full, which takes a few million connections.
+		 */
+		uint64_t add( std::weak_ptr<clientserver::IConnection> pConnection );
+		/** @brief Removes the connection with the id. Does nothing if it has already been removed. */
+		void remove( uint64_t id );
+
+		/** @brief The connection with the id, or null if it has been removed or already destroyed. Can be called from any thread without locking. */
+		std::shared_ptr<clientserver::IConnection> find( uint64_t id ) const;
+		/** @brief Calls the function for each connection that is still alive, from the calling thread and without locking.
+		 *
+		 * Connections added or removed while this is running may or may not be included. The function can
+		 * call anything on the registry, including add() and remove().
+		 * @return  The number of connections the function was called for.
+		 */
+		size_t forEach( const std::function<void(uint64_t,const std::shared_ptr<clientserver::IConnection>&)>& function ) const;
+		/** @brief Sends the message to every connection, returning how many it was sent to. */
+		size_t broadcastInfo( const std::string& message ) const;
+		/** @brief The number of connections that have been added and not yet removed. */
+		size_t size() const;
+	protected:
+		struct Entry;
+		struct Reader;
+		class ReadGuard;
+		ConnectionRegistry( const ConnectionRegistry& other ) = delete;
+		ConnectionRegistry& operator=( const ConnectionRegistry& other ) = delete;
+		/** @brief Moves the epoch on if every reader has caught up, then frees what nobody can still be reading. Requires writeMutex_ to be locked. */
+		void reclaim();
+
+		static const size_t slotsPerChunk=4096;
+		static const size_t maximumChunks=1024;
+
+		std::atomic<std::atomic<Entry*>*> chunks_[maximumChunks]; ///< Only ever added to, up to numberOfChunks_
+		std::atomic<size_t> numberOfChunks_;
+		std::atomic<size_t> size_;
+		std::atomic<uint64_t> epoch_; ///< Only moved on by writers, with writeMutex_ locked
+		mutable std::atomic<Reader*> pReaders_; ///< Records of the readers' epochs, only ever added to and reused
+		std::mutex writeMutex_;
+		std::vector<uint32_t> generations_; ///< The number of times each slot has been used, protected by writeMutex_
+		std::vector<uint32_t> freeSlots_; ///< Protected by writeMutex_
+		std::vector<std::pair<uint64_t,Entry*> > retired_; ///< Removed entries with the epoch they were removed in, protected by writeMutex_
+	};
+
+} // end of namespace clientserver
+
+#endif // end of "#ifndef INCLUDEGUARD_clientserver_ConnectionRegistry_h"
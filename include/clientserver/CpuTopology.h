@@ -0,0 +1,91 @@
+#ifndef INCLUDEGUARD_clientserver_CpuTopology_h
+#define INCLUDEGUARD_clientserver_CpuTopology_h
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+namespace clientserver
+{
+	/** @brief Which CPUs are on which NUMA node, and where to run a server's threads so that they use memory on their own node.
+	 *
+	 * On machines with more than one socket, memory on the other socket's node is slower to reach
+	 * and the traffic competes with that socket's own. Linux allocates a page on the node of the
+	 * thread that first touches it, so a thread that stays on one node keeps its memory there. The
+	 * placements here pin each event loop to a CPU, and give the loops on each node their own pool
+	 * of handler threads on the same node, so that a request is read, handled and answered without
+	 * its buffers crossing between nodes.
+	 *
+	 * The nodes are read from /sys/devices/system/node, which means libnuma isn't needed. Machines
+	 * without NUMA, or where sysfs can't be read, have all of their CPUs on one node.
+	 *
+	 * @author Mark Grimes
+	 * @date 19/Oct/2026
+	 */
+	class CpuTopology
+	{
+	public:
+		/** @brief Where a thread, or all of the threads in a pool, should run. */
+		struct Affinity
+		{
+			std::vector<int> cpus; ///< The thread is pinned to these, or not pinned at all if empty
+			int node;              ///< The NUMA node to allocate its memory on, or -1 to leave that to the kernel
+		};
+		/** @brief Where each of a server's event loops and handler threads should run. */
+		struct Placement
+		{
+			std::vector<Affinity> eventLoops;
+			std::vector<size_t> eventLoopPools; ///< For each event loop, the index of the handler pool it posts requests to
+			std::vector<Affinity> handlerPools;
+			std::vector<size_t> handlerPoolSizes; ///< The number of threads in each handler pool
+		};
+
+		/** @brief The nodes of this machine, with only the CPUs this process is allowed to run on. */
+		static CpuTopology detect();
+		/** @brief For machines that aren't this one, e.g. in tests.
+		 * @param nodeCpus  The CPUs on each node, indexed by node number. Nodes without any CPUs are ignored.
+		 */
+		explicit CpuTopology( std::vector<std::vector<int> > nodeCpus );
+
+		/** @brief Parses a list in the kernel's format, e.g. "0-3,8,10-11", which is also what taskset takes.
+		 * @throw std::invalid_argument  If the list is empty or can't be parsed.
+		 */
+		static std::vector<int> parseCpuList( const std::string& list );
+
+		/** @brief The node numbers that have CPUs, in order. */
+		const std::vector<int>& nodes() const;
+		const std::vector<int>& cpusOnNode( int node ) const;
+		/** @brief The node the CPU is on, or -1 if it isn't one of the known CPUs. */
+		int nodeOfCpu( int cpu ) const;
+
+		/** @brief Spreads the event loops over the nodes, each pinned to its own CPU, with the handler threads split between them.
+		 *
+		 * Each node with event loops gets a handler pool of its own, pinned to all of the node's CPUs so
+		 * that the scheduler can balance the pool within the node. Every pool has at least one thread.
+		 */
+		Placement placeByNode( size_t numberOfEventLoops, size_t numberOfHandlerThreads ) const;
+		/** @brief Pins the event loops and handler threads to the given CPUs, taking them in turn.
+		 *
+		 * Handler threads on the same node share a pool, pinned to all of the given handler CPUs on that
+		 * node, and event loops post to the pool on their own node if there is one. Either list can be
+		 * empty to leave those threads unpinned.
+		 * @throw std::invalid_argument  If any of the CPUs aren't known, e.g. because this process isn't allowed on them.
+		 */
+		Placement placeOnCpus( size_t numberOfEventLoops, const std::vector<int>& eventLoopCpus, size_t numberOfHandlerThreads, const std::vector<int>& handlerCpus ) const;
+		/** @brief Nothing pinned, with all of the event loops sharing one handler pool. */
+		static Placement unplaced( size_t numberOfEventLoops, size_t numberOfHandlerThreads );
+
+		/** @brief Pins the calling thread to the CPUs and prefers the node for its memory from now on.
+		 *
+		 * The memory policy only applies to pages touched for the first time after this is called.
+		 * @return  False if either couldn't be set, in which case the thread carries on where it was.
+		 */
+		static bool apply( const Affinity& affinity );
+	protected:
+		std::vector<int> nodes_;
+		std::vector<std::vector<int> > nodeCpus_; ///< Indexed by node number, and empty for nodes without CPUs
+	};
+
+} // end of namespace clientserver
+
+#endif // end of "#ifndef INCLUDEGUARD_clientserver_CpuTopology_h"
@@ -0,0 +1,80 @@
+#ifndef INCLUDEGUARD_clientserver_DeflateStreamPool_h
+#define INCLUDEGUARD_clientserver_DeflateStreamPool_h
+
+#include <vector>
+#include <cstddef>
+
+//
+// Forward declarations
+//
+struct z_stream_s;
+
+namespace clientserver
+{
+	/** @brief Keeps zlib streams that aren't needed between messages, so that connections can share them.
+	 *
+	 * A raw deflate stream with the default settings holds about 256KiB, and an inflate stream about
+	 * 40KiB. When a permessage-deflate connection has agreed "no context takeover" for a direction, it
+	 * only needs the stream while a message is being compressed or decompressed, so it takes one from
+	 * here and gives it straight back afterwards. Event loops handle one message at a time, so a pool
+	 * per loop means a few streams serve all of that loop's connections, however many are idle.
+	 *
+	 * Not thread safe, the intention is that each event loop has its own pool.
+	 *
+	 * @author Mark Grimes
+	 * @date 19/Oct/2026
+	 */
+	class DeflateStreamPool
+	{
+	public:
+		/** @brief
+		 * @param maximumPooled  The most streams to keep of each kind, extra ones given back are freed.
+		 */
+		explicit DeflateStreamPool( size_t maximumPooled );
+		~DeflateStreamPool();
+
+		/** @brief Returns a raw deflate stream with these settings, ready to start a new message.
+		 *
+		 * Has to be given back with releaseCompressor() using the same settings.
+		 * @throw std::runtime_error  If zlib couldn't create the stream.
+		 */
+		z_stream_s* acquireCompressor( int level, int windowBits, int memoryLevel );
+		void releaseCompressor( z_stream_s* pStream, int level, int windowBits, int memoryLevel );
+		/** @brief Returns a raw inflate stream that can handle windows up to the given size.
+		 *
+		 * Has to be given back with releaseDecompressor() using the same size.
+		 * @throw std::runtime_error  If zlib couldn't create the stream.
+		 */
+		z_stream_s* acquireDecompressor( int windowBits );
+		void releaseDecompressor( z_stream_s* pStream, int windowBits );
+
+		size_t pooledStreams() const;
+		/** @brief How many streams have been created because there wasn't a suitable one in the pool. */
+		size_t createdStreams() const;
+
+		/** @brief Create and destroy streams directly, for when there is no pool. */
+		static z_stream_s* createCompressor( int level, int windowBits, int memoryLevel );
+		static z_stream_s* createDecompressor( int windowBits );
+		static void destroyCompressor( z_stream_s* pStream );
+		static void destroyDecompressor( z_stream_s* pStream );
+	protected:
+		DeflateStreamPool( const DeflateStreamPool& other ) = delete;
+		DeflateStreamPool& operator=( const DeflateStreamPool& other ) = delete;
+
+		struct PooledStream
+		{
+			z_stream_s* pStream;
+			int level;
+			int windowBits;
+			int memoryLevel;
+		};
+
+		size_t maximumPooled_;
+		size_t createdStreams_;
+		std::vector<PooledStream> compressors_;
+		std::vector<PooledStream> decompressors_;
+	};
+
+} // end of namespace clientserver
+
+#endif // end of "#ifndef INCLUDEGUARD_clientserver_DeflateStreamPool_h"
@@ -0,0 +1,75 @@
+#ifndef INCLUDEGUARD_clientserver_DeltaApplier_h
+#define INCLUDEGUARD_clientserver_DeltaApplier_h
+
+#include <string>
+#include <map>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+//
+// Forward declarations
+//
+namespace google
+{
+	namespace protobuf
+	{
+		class Message;
+	}
+}
+
+namespace clientserver
+{
+	/** @brief Client side of DeltaPublisher, which rebuilds the full state from the snapshots and deltas the server sends.
+	 *
+	 * Deltas are from the last state the client acknowledged, which might not be the latest one if
+	 * acknowledgements are still on their way, so this keeps the recent states of each subscription
+	 * until an update shows the server no longer needs them. If an update is from a state that has
+	 * been dropped, the acknowledgement asks the server for a snapshot instead.
+	 *
+	 * Part of the Emscripten client code as well as the native code. Not thread safe.
+	 *
+	 * @author Mark Grimes
+	 * @date 19/Oct/2026
+	 */
+	class DeltaApplier
+	{
+	public:
+		/** @brief
+		 * @param maximumStates  The most states kept for each subscription. Should be more than the server's maximumUnacknowledged.
+		 */
+		DeltaApplier( size_t maximumStates=32 );
+		~DeltaApplier();
+
+		/** @brief Says which type of message the state for the subscription is. Must be called before its first update arrives. */
+		void addSubscription( const std::string& subscription, const google::protobuf::Message& prototype );
+
+		/** @brief Applies an update from the server.
+		 *
+		 * @param subscription     Set to the subscription the update was for.
+		 * @param acknowledgement  Set to what should be sent back to the server, which is empty if nothing should be.
+		 * @return                 The new state, or null if it couldn't be worked out because the update was from a state
+		 *                         that isn't kept. The state stays valid until the next call.
+		 * @throw std::runtime_error  If the update is not valid, or for a subscription that hasn't been added.
+		 */
+		const google::protobuf::Message* apply( const char* pData, size_t size, std::string& subscription, std::string& acknowledgement );
+		/** @brief The latest state for the subscription, or null if there isn't one yet. */
+		const google::protobuf::Message* state( const std::string& subscription ) const;
+	protected:
+		DeltaApplier( const DeltaApplier& other ) = delete;
+		DeltaApplier& operator=( const DeltaApplier& other ) = delete;
+
+		struct Subscription
+		{
+			Subscription();
+			bool isAwaitingSnapshot; ///< Whether the server has already been asked for a snapshot
+			std::unique_ptr<google::protobuf::Message> pPrototype;
+			std::map<uint64_t,std::unique_ptr<google::protobuf::Message> > states;
+		};
+		const size_t maximumStates_;
+		std::map<std::string,Subscription> subscriptions_;
+	};
+
+} // end of namespace clientserver
+
+#endif // end of "#ifndef INCLUDEGUARD_clientserver_DeltaApplier_h"
@@ -0,0 +1,105 @@
+#ifndef INCLUDEGUARD_clientserver_DeltaPublisher_h
+#define INCLUDEGUARD_clientserver_DeltaPublisher_h
+
+#include <string>
+#include <map>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "clientserver/IConnection.h"
+
+//
+// Forward declarations
+//
+namespace google
+{
+	namespace protobuf
+	{
+		class Message;
+	}
+}
+
+namespace clientserver
+{
+	/** @brief Server side of sending state to clients as deltas from what they last acknowledged.
+	 *
+	 * Handlers that send a whole state message every time something changes can instead give it to
+	 * encodeUpdate() and send the result. For each connection and subscription this keeps the last
+	 * state the client acknowledged, and the states sent since, so that the update only has the fields
+	 * that are different from the acknowledged state. The client (see DeltaApplier) sends an
+	 * acknowledgement back for every update, which goes to acknowledge().
+	 *
+	 * Because deltas are always from a state the client confirmed it has, a lost or reordered
+	 * update does no harm, and the client can drop anything older than the base of the latest
+	 * update. A full snapshot is sent instead when there is no acknowledged state yet, when the delta
+	 * would be no smaller, and every snapshotInterval updates so that any mistake in a client's copy
+	 * of the state can't last. See StateDelta for the message layout.
+	 *
+	 * Thread safe. Updates for different connections can be encoded at the same time.
+	 *
+	 * @author Mark Grimes
+	 * @date 19/Oct/2026
+	 */
+	class DeltaPublisher
+	{
+	public:
+		/** @brief
+		 * @param snapshotInterval         At least one in this many updates to each subscription is a full snapshot.
+		 * @param maximumUnacknowledged    The most states kept for each subscription that have been sent but not acknowledged.
+		 *                                 If the client falls further behind than this, older acknowledgements are ignored.
+		 */
+		DeltaPublisher( size_t snapshotInterval=100, size_t maximumUnacknowledged=16 );
+		~DeltaPublisher();
+
+		/** @brief Appends the update to send to this connection for the new state.
+		 *
+		 * The state has to be the same type every time for the same connection and subscription. Connections
+		 * that have closed are forgotten about automatically, but removeConnection() frees the memory sooner.
+		 */
+		void encodeUpdate( const std::weak_ptr<clientserver::IConnection>& pConnection, const std::string& subscription,
+				const google::protobuf::Message& state, std::string& output );
+		/** @brief Call with each acknowledgement received from the client.
+		 *
+		 * @throw std::runtime_error  If the acknowledgement is not valid.
+		 */
+		void acknowledge( const std::weak_ptr<clientserver::IConnection>& pConnection, const char* pData, size_t size );
+		void removeConnection( const std::weak_ptr<clientserver::IConnection>& pConnection );
+
+		size_t numberOfConnections() const;
+		uint64_t snapshotsSent() const;
+		uint64_t deltasSent() const;
+	protected:
+		DeltaPublisher( const DeltaPublisher& other ) = delete;
+		DeltaPublisher& operator=( const DeltaPublisher& other ) = delete;
+
+		struct Subscription
+		{
+			Subscription();
+			uint64_t nextSequence;
+			uint64_t acknowledgedSequence; ///< Zero if nothing has been acknowledged
+			std::unique_ptr<google::protobuf::Message> pAcknowledged;
+			std::deque<std::pair<uint64_t,std::unique_ptr<google::protobuf::Message> > > unacknowledged;
+			size_t updatesSinceSnapshot;
+		};
+		struct Connection
+		{
+			std::mutex mutex;
+			std::map<std::string,Subscription> subscriptions;
+		};
+		std::shared_ptr<Connection> findConnection( const std::weak_ptr<clientserver::IConnection>& pConnection, bool create );
+
+		const size_t snapshotInterval_;
+		const size_t maximumUnacknowledged_;
+		mutable std::mutex connectionsMutex_;
+		std::map<std::weak_ptr<clientserver::IConnection>,std::shared_ptr<Connection>,std::owner_less<std::weak_ptr<clientserver::IConnection> > > connections_;
+		size_t connectionsAfterLastPrune_; ///< Protected by connectionsMutex_
+		std::atomic<uint64_t> snapshotsSent_;
+		std::atomic<uint64_t> deltasSent_;
+	};
+
+} // end of namespace clientserver
+
+#endif // end of "#ifndef INCLUDEGUARD_clientserver_DeltaPublisher_h"
@@ -0,0 +1,97 @@
+#ifndef INCLUDEGUARD_clientserver_FramedSocket_h
+#define INCLUDEGUARD_clientserver_FramedSocket_h
+
+#include <string>
+#include <functional>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include "clientserver/BinaryFramer.h"
+
+//
+// Forward declarations
+//
+typedef struct ssl_st SSL;
+
+namespace clientserver
+{
+	/** @brief A non-blocking socket, optionally wrapped in TLS, that sends and receives clientserver::BinaryFramer frames.
+	 *
+	 * All reading and writing is done by whichever thread calls run(), so that an SSL session is
+	 * never used by two threads at once. Other threads can call send(), which queues the frame and
+	 * wakes the loop up with an eventfd. Frames sent from inside the frame handler are just queued,
+	 * and everything queued while handling one read is written with a single system call.
+	 *
+	 * Reading stops while more than outputLimit() bytes are waiting to be sent, so that a peer that
+	 * keeps sending requests without reading the responses can't make the output grow without limit.
+	 *
+	 * Used by both clientserver::TcpServer and clientserver::TcpClient.
+	 *
+	 * @author Mark Grimes
+	 * @date 19/Oct/2026
+	 */
+	class FramedSocket
+	{
+	public:
+		typedef clientserver::BinaryFramer::MessageType MessageType;
+		typedef std::function<void(MessageType,uint32_t,std::string&)> FrameHandler;
+		static const size_t defaultOutputLimit=256*1024;
+
+		/** @brief Takes ownership of the socket, and of pSession if it is not null. The socket is made non-blocking.
+		 *
+		 * @throw std::system_error  If the wakeup eventfd could not be created.
+		 */
+		FramedSocket( int socket, SSL* pSession );
+		~FramedSocket();
+
+		/** @brief How many unsent bytes there can be before reading stops until some have been sent. Must be called before run(). Default is defaultOutputLimit. */
+		void setOutputLimit( size_t outputLimit );
+		size_t outputLimit() const;
+
+		/** @brief Queues a frame to be sent by the I/O loop. Can be called from any thread. */
+		void send( MessageType type, uint32_t id, const std::string& payload );
+
+		/** @brief Tells the I/O loop to stop. Can be called from any thread. Anything still queued is discarded. */
+		void close();
+		bool isConnected() const;
+
+		/** @brief Runs the I/O loop until the peer disconnects, close() is called, or stopFd becomes readable.
+		 *
+		 * The TLS handshake, if there is one, is also done here. frameHandler is called on this thread
+		 * for every frame received.
+		 *
+		 * @param stopFd  Can be -1.
+		 */
+		void run( FrameHandler frameHandler, int stopFd );
+	protected:
+		enum class IoResult { ok, wouldBlock, closed };
+		FramedSocket( const FramedSocket& other ) = delete;
+		FramedSocket& operator=( const FramedSocket& other ) = delete;
+
+		IoResult handshake();
+		/** @brief Reads everything available and calls the handler for each complete frame, stopping early if the output is over the limit. */
+		IoResult readAndDispatch( FrameHandler& frameHandler );
+		/** @brief Whether there is more unsent output than the limit. Only from the I/O loop's thread. */
+		bool isOutputFull();
+		/** @brief Moves anything queued by send() into the output buffer. */
+		void collectQueuedOutput();
+		IoResult flush();
+
+		int socket_;
+		SSL* pSession_;
+		int wakeEventFd_;
+		std::atomic<bool> connected_;
+		std::atomic<bool> closeRequested_;
+		bool sessionWantsWrite_; ///< OpenSSL can need to write while reading (and vice versa), so the poll has to wait for that
+		clientserver::BinaryFramer framer_;
+		std::mutex queueMutex_;
+		std::string queuedOutput_; ///< Frames added by send(), protected by queueMutex_
+		std::string outputBuffer_; ///< Frames being written by the I/O loop, only touched by that thread
+		size_t outputPosition_;
+		size_t outputLimit_;
+		bool readPaused_; ///< readAndDispatch() stopped because the output was full, rather than because there was nothing to read
+	};
+
+} // end of namespace clientserver
+
+#endif // end of "#ifndef INCLUDEGUARD_clientserver_FramedSocket_h"
@@ -0,0 +1,53 @@
+#ifndef INCLUDEGUARD_clientserver_HandlerPool_h
+#define INCLUDEGUARD_clientserver_HandlerPool_h
+
+#include <functional>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstddef>
+#include "clientserver/CpuTopology.h"
+
+namespace clientserver
+{
+	/** @brief A fixed set of threads that run handlers off the event loops, e.g. for batches and concurrent requests.
+	 *
+	 * Tasks are run in the order they were posted, but with more than one thread they can finish in
+	 * any order. Exceptions thrown by tasks are printed and otherwise ignored.
+	 *
+	 * @author Mark Grimes
+	 * @date 19/Oct/2026
+	 */
+	class HandlerPool
+	{
+	public:
+		/** @brief
+		 * @param numberOfThreads  Zero means one for each core.
+		 */
+		HandlerPool( size_t numberOfThreads );
+		/** @brief Each thread applies the affinity before running anything, e.g. to keep the pool on one NUMA node. */
+		HandlerPool( size_t numberOfThreads, const clientserver::CpuTopology::Affinity& affinity );
+		/** @brief Runs everything that has already been posted, then stops the threads. */
+		~HandlerPool();
+
+		/** @brief Queues the task to run on one of the threads. Can be called from any thread, including the pool's own. */
+		void post( std::function<void()> task );
+		size_t numberOfThreads() const;
+	protected:
+		HandlerPool( const HandlerPool& other ) = delete;
+		HandlerPool& operator=( const HandlerPool& other ) = delete;
+		void run();
+
+		const clientserver::CpuTopology::Affinity affinity_;
+		std::mutex mutex_;
+		std::condition_variable condition_;
+		std::deque<std::function<void()> > tasks_; ///< Protected by mutex_
+		bool stopping_; ///< Protected by mutex_
+		std::vector<std::thread> threads_;
+	};
+
+} // end of namespace clientserver
+
+#endif // end of "#ifndef INCLUDEGUARD_clientserver_HandlerPool_h"
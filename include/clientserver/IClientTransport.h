@@ -0,0 +1,52 @@
+#ifndef INCLUDEGUARD_clientserver_IClientTransport_h
+#define INCLUDEGUARD_clientserver_IClientTransport_h
+
+#include <string>
+#include <functional>
+#include <memory>
+#include <chrono>
+
+namespace clientserver
+{
+	/** @brief Interface for the WebSocket connection that clientserver::Client sends its messages over.
+	 *
+	 * Natively this is clientserver::NativeClientTransport, which does the framing itself. In the
+	 * Emscripten build it's the browser's WebSocket, so only the envelopes are shared code. The
+	 * handlers, and anything given to schedule(), are all called on the same thread, which is the
+	 * transport's I/O thread natively and the browser's event loop in Emscripten.
+	 *
+	 * @author Mark Grimes
+	 * @date 19/Oct/2026
+	 */
+	class IClientTransport
+	{
+	public:
+		struct Handlers
+		{
+			std::function<void()> open;
+			/** @brief Called with each text or binary message. The string can be swapped out rather than copied. */
+			std::function<void(bool,std::string&)> message;
+			/** @brief Called once the connection has closed or failed to open, with the reason. Not called after close(). */
+			std::function<void(const std::string&)> close;
+		};
+
+		virtual ~IClientTransport() {}
+		/** @brief Starts connecting to the ws:// or wss:// url, closing any previous connection first. Returns straight away.
+		 *
+		 * @throw std::invalid_argument  If the url isn't one the transport can connect to.
+		 */
+		virtual void open( const std::string& url, Handlers handlers ) = 0;
+		/** @brief Queues a message to be sent. Dropped if the connection isn't open. Can be called from any thread. */
+		virtual void send( bool isBinary, const std::string& message ) = 0;
+		/** @brief Closes the connection, or stops one being opened. No more handlers are called afterwards. */
+		virtual void close() = 0;
+		/** @brief Calls the function once after the delay, on the same thread as the handlers. */
+		virtual void schedule( std::chrono::milliseconds delay, std::function<void()> function ) = 0;
+	};
+
+	/** @brief Creates the transport for the platform being compiled for. */
+	std::unique_ptr<IClientTransport> createClientTransport();
+
+} // end of namespace clientserver
+
+#endif // end of "#ifndef INCLUDEGUARD_clientserver_IClientTransport_h"
@@ -0,0 +1,33 @@
+#ifndef INCLUDEGUARD_clientserver_IConnection_h
+#define INCLUDEGUARD_clientserver_IConnection_h
+
+#include <string>
+#include <cstdint>
+
+namespace clientserver
+{
+	/** @brief Interface for connections handled by the in-tree transports.
+	 *
+	 * Handlers registered with the in-tree servers are given a std::weak_ptr to one of these,
+	 * in the same way that communique::Server hands out communique::IConnection. Only the
+	 * subset of the communique::IConnection interface that the handlers actually need is
+	 * reproduced here.
+	 *
+	 * @author Mark Grimes
+	 * @date 19/Oct/2026
+	 */
+	class IConnection
+	{
+	public:
+		virtual ~IConnection() {}
+		virtual bool isConnected() = 0;
+		virtual void close() = 0;
+		/** @brief Sends a message to the client that does not expect a response. */
+		virtual void sendInfo( const std::string& message ) = 0;
+		/** @brief The id of this connection in its server's clientserver::ConnectionRegistry, or zero before it has been added. */
+		virtual uint64_t connectionId() const = 0;
+	};
+
+} // end of namespace clientserver
+
+#endif // end of "#ifndef INCLUDEGUARD_clientserver_IConnection_h"
@@ -0,0 +1,41 @@
+#ifndef INCLUDEGUARD_clientserver_IMessageCompressor_h
+#define INCLUDEGUARD_clientserver_IMessageCompressor_h
+
+#include <string>
+#include <cstddef>
+
+namespace clientserver
+{
+	/** @brief Interface for the ways WebSocket messages can be compressed once an extension has been agreed.
+	 *
+	 * Compressed messages are marked with the RSV1 bit, so only one of these can be in use for a
+	 * connection. WebSocketFramer calls decompress() for received messages, and the sender decides
+	 * with shouldCompress() whether to call compress().
+	 *
+	 * @author Mark Grimes
+	 * @date 19/Oct/2026
+	 */
+	class IMessageCompressor
+	{
+	public:
+		virtual ~IMessageCompressor() {}
+
+		/** @brief Whether a message of this size should be compressed. */
+		virtual bool shouldCompress( size_t size ) const = 0;
+		/** @brief Appends the compressed message to output, ready to go in frames with the RSV1 bit set.
+		 *
+		 * A message can be given in pieces, by setting isLastPart to false for all but the last one.
+		 * @throw std::runtime_error  If the compression library fails.
+		 */
+		virtual void compress( const char* pData, size_t size, std::string& output, bool isLastPart ) = 0;
+		/** @brief Appends the decompressed version of a message received with the RSV1 bit set to output.
+		 *
+		 * @throw std::length_error   If the message would be larger than maximumSize once decompressed.
+		 * @throw std::runtime_error  If the data is not valid. The connection should be failed.
+		 */
+		virtual void decompress( const char* pData, size_t size, std::string& output, size_t maximumSize ) = 0;
+	};
+
+} // end of namespace clientserver
+
+#endif // end of "#ifndef INCLUDEGUARD_clientserver_IMessageCompressor_h"
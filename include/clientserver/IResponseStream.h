@@ -0,0 +1,52 @@
+#ifndef INCLUDEGUARD_clientserver_IResponseStream_h
+#define INCLUDEGUARD_clientserver_IResponseStream_h
+
+#include <string>
+#include <functional>
+
+namespace clientserver
+{
+	/** @brief Interface that streaming request handlers use to send the reply a chunk at a time.
+	 *
+	 * Each chunk is sent as soon as it is written, so the client can start on the first part of a
+	 * large result before the rest has been worked out, and the whole result never has to be held in
+	 * memory at once. The reply must end with a call to finish(). If the handler's copy of the stream
+	 * is dropped without that, the client is told the request failed.
+	 *
+	 * Flow control is by watermarks on the connection's unsent data. write() always queues the chunk,
+	 * but returns false once the data waiting to go out is above the server's stream buffer size.
+	 * The handler should then stop producing chunks until the writable handler is called, which is
+	 * when the unsent data has dropped to half of that. Handlers running on their own thread can
+	 * block in waitUntilWritable() instead.
+	 *
+	 * Can be used from any thread.
+	 *
+	 * @author Mark Grimes
+	 * @date 19/Oct/2026
+	 */
+	class IResponseStream
+	{
+	public:
+		virtual ~IResponseStream() {}
+		/** @brief Sends the next chunk. Returns false if the client is not keeping up or the stream is no longer open. */
+		virtual bool write( const std::string& chunk ) = 0;
+		/** @brief Ends the reply. An empty error means it succeeded. Nothing more can be written afterwards. */
+		virtual void finish( const std::string& error=std::string() ) = 0;
+		/** @brief False once finish() has been called or the connection has closed. */
+		virtual bool isOpen() = 0;
+		/** @brief Called on the connection's event loop thread once there's room for more chunks, or the connection has closed.
+		 *
+		 * Called when the connection drains after write() has returned false for any of its streams, so
+		 * the handler should just write what it can each time. Forgotten about once the stream finishes.
+		 */
+		virtual void setWritableHandler( std::function<void()> writableHandler ) = 0;
+		/** @brief Blocks until there's room for more chunks, returning false if the stream closed in the meantime.
+		 *
+		 * @throw std::logic_error  If called from the thread of the connection's event loop, which would deadlock.
+		 */
+		virtual bool waitUntilWritable() = 0;
+	};
+
+} // end of namespace clientserver
+
+#endif // end of "#ifndef INCLUDEGUARD_clientserver_IResponseStream_h"
@@ -0,0 +1,64 @@
+#ifndef INCLUDEGUARD_clientserver_MessageEnvelope_h
+#define INCLUDEGUARD_clientserver_MessageEnvelope_h
+
+#include <string>
+#include <cstdint>
+#include "clientserver/BinaryFramer.h"
+
+namespace clientserver
+{
+	/** @brief How the message type and request id are carried inside each WebSocket message by the native engine.
+	 *
+	 * WebSocket already gives the length, so only the type and id need adding. It is kept as plain
+	 * text so that it can go in text frames and is easy to produce from javascript:
+	 *
+	 *     q<id>:<payload>   a request, where <id> is a decimal number chosen by the client
+	 *     r<id>:<payload>   the response to request <id>
+	 *     i<payload>        an info message, which has no response
+	 *     s<id>:<payload>   a request that can have any number of chunks in reply
+	 *     c<id>:<payload>   one chunk of the reply to streaming request <id>
+	 *     e<id>:<error>     the end of the reply to streaming request <id>, where <error> is empty if it succeeded
+	 *     b<id>:<batch>     several requests at once, see clientserver::BatchEnvelope, with all of the responses in one r<id>: reply
+	 *     p<id>:<batch>     the same but the responses are streamed back as c<id>: chunks as each one finishes, then e<id>:
+	 *     t<count>:<token>  from the server first thing on a connection that asked for a session, with the number of
+	 *                       messages it has received from the client in that session (see WebSocketServer::setSessionResumption)
+	 *     a<count>:         acknowledges that <count> messages of the session have been received, in either direction
+	 *     o<channel>:<priority>:<credit>  from the client, opens a logical channel (see WebSocketServer) or changes its priority
+	 *     w<channel>:<credit>  from the client, lets the server send <credit> more bytes on the channel
+	 *     m<channel>:<message> a whole message, with its own envelope, on the channel. Either direction.
+	 *     f<channel>:<part>    from the server, the start or next part of a message on the channel that continues in
+	 *                          further f parts and ends with an m<channel>: one
+	 *     g0:               from the server when it's shutting down (see WebSocketServer::drain()). The client should send
+	 *                       nothing more on the connection and reconnect, but responses to what it has sent still arrive.
+	 *     x<id>:<milliseconds>  from the server instead of the r<id>: reply when it's too busy to run request or batch <id>
+	 *                       (see WebSocketServer::setAdmissionController()). Nothing was run, so it can be sent again after
+	 *                       waiting about <milliseconds>.
+	 *
+	 * Sessions count every message apart from the t, a, o, w, f and g ones, separately in each direction.
+	 *
+	 * Binary frames use exactly the same envelope, only the payload after it can be any bytes.
+	 *
+	 * @author Mark Grimes
+	 * @date 19/Oct/2026
+	 */
+	class MessageEnvelope
+	{
+	public:
+		typedef clientserver::BinaryFramer::MessageType MessageType;
+
+		/** @brief Appends the message with its envelope to the end of output. */
+		static void encode( MessageType type, uint32_t id, const std::string& payload, std::string& output );
+
+		/** @brief Just the part that goes before the payload, for when the payload is appended separately. */
+		static std::string header( MessageType type, uint32_t id );
+
+		/** @brief Reads the envelope and removes it from the front of message, leaving just the payload.
+		 *
+		 * @throw std::runtime_error  If the envelope is not valid.
+		 */
+		static void decode( std::string& message, MessageType& type, uint32_t& id );
+	};
+
+} // end of namespace clientserver
+
+#endif // end of "#ifndef INCLUDEGUARD_clientserver_MessageEnvelope_h"
@@ -0,0 +1,133 @@
+#ifndef INCLUDEGUARD_clientserver_NativeClientTransport_h
+#define INCLUDEGUARD_clientserver_NativeClientTransport_h
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <cstdint>
+#include "clientserver/IClientTransport.h"
+#include "clientserver/WebSocketFramer.h"
+#include "clientserver/PerMessageDeflate.h"
+#include "clientserver/ZstdDictionaryCompressor.h"
+
+//
+// Forward declarations
+//
+typedef struct ssl_st SSL;
+namespace clientserver
+{
+	class TlsContext;
+}
+
+namespace clientserver
+{
+	/** @brief The clientserver::IClientTransport for native code, which supports ws:// and wss:// urls.
+	 *
+	 * Everything is done on one I/O thread, started by the constructor, in the same way as
+	 * clientserver::FramedSocket. The TCP, TLS and WebSocket handshakes block that thread, but once
+	 * the connection is open the socket is non-blocking. send() masks and frames the message
+	 * straight away, then wakes the thread with an eventfd to write it out.
+	 *
+	 * @author Mark Grimes
+	 * @date 19/Oct/2026
+	 */
+	class NativeClientTransport : public clientserver::IClientTransport
+	{
+	public:
+		/** @throw std::system_error  If the wakeup eventfd could not be created. */
+		NativeClientTransport();
+		virtual ~NativeClientTransport();
+
+		/** @brief How to check the server's certificate for wss:// urls. Takes effect on the next open().
+		 *
+		 * @param verifyFile  PEM file of certificate authorities to verify the server with. If empty the system defaults are used.
+		 * @param verifyPeer  Set to false to skip verification altogether, e.g. for self signed test certificates.
+		 */
+		void setTlsVerification( const std::string& verifyFile, bool verifyPeer=true );
+		/** @brief Offer the permessage-deflate extension when connecting. Takes effect on the next open(). */
+		void setCompression( const clientserver::PerMessageDeflate::Configuration& configuration );
+		/** @brief Offer these zstd dictionaries when connecting, most preferred first. Takes effect on the next open(). */
+		void setCompressionDictionaries( std::vector<std::shared_ptr<const clientserver::ZstdDictionary> > dictionaries, size_t threshold=clientserver::ZstdDictionaryCompressor::defaultThreshold );
+		/** @brief Whether the server agreed to compression for the connection that's currently open. */
+		bool isCompressing();
+
+		/** @brief See clientserver::IClientTransport::open().
+		 *
+		 * @throw std::runtime_error  If the url is wss:// and the TLS context could not be created.
+		 */
+		virtual void open( const std::string& url, Handlers handlers ) override;
+		virtual void send( bool isBinary, const std::string& message ) override;
+		virtual void close() override;
+		virtual void schedule( std::chrono::milliseconds delay, std::function<void()> function ) override;
+	protected:
+		enum class IoResult { ok, wouldBlock, closed };
+		NativeClientTransport( const NativeClientTransport& other ) = delete;
+		NativeClientTransport& operator=( const NativeClientTransport& other ) = delete;
+
+		void run();
+		void wake();
+		/** @brief Makes the connection and does all the handshakes, blocking until they're finished.
+		 *
+		 * If open() or close() were called in the meantime the new connection is closed again.
+		 * @throw std::system_error   If the connection could not be made.
+		 * @throw std::runtime_error  If the TLS or WebSocket handshake failed.
+		 */
+		void openConnection( const std::string& url );
+		/** @brief Closes the socket, calling the close handler with the reason if it's not empty and the connection is still wanted. */
+		void closeConnection( const std::string& reason );
+		/** @brief Writes out anything queued followed by a close frame, waiting up to a second, then closes the socket. */
+		void closeGracefully();
+		/** @brief Masks, frames and compresses the message onto queuedOutput_. Requires mutex_ to be locked. */
+		void queueFrame( clientserver::WebSocketFramer::Opcode opcode, const std::string& payload );
+		IoResult readAndDispatch( std::string& closeReason );
+		/** @brief Passes any complete frames in the framer to the handlers, without reading any more. */
+		IoResult dispatchFrames( std::string& closeReason );
+		IoResult flush();
+
+		int wakeEventFd_;
+		std::mutex mutex_;
+		// Everything from here to the I/O thread only members is protected by mutex_
+		std::string verifyFile_;
+		bool verifyPeer_;
+		std::shared_ptr<clientserver::TlsContext> pTlsContext_; ///< Created by the first open() of a wss:// url
+		bool compressionEnabled_;
+		clientserver::PerMessageDeflate::Configuration compressionConfiguration_;
+		std::vector<std::shared_ptr<const clientserver::ZstdDictionary> > compressionDictionaries_;
+		size_t dictionaryThreshold_;
+		bool stopRequested_;
+		/** @brief Incremented by open() and close(), so the I/O thread can tell if what it's doing is still wanted. Only changed with mutex_ locked. */
+		std::atomic<uint64_t> generation_;
+		bool openRequested_;
+		std::string requestedUrl_;
+		Handlers requestedHandlers_;
+		bool closeRequested_;
+		bool isOpen_;
+		std::multimap<std::chrono::steady_clock::time_point,std::function<void()> > timers_;
+		std::string queuedOutput_;
+		/** @brief Compresses in send() with mutex_ locked, and decompresses on the I/O thread. There's no pool, so the two are independent. */
+		std::unique_ptr<clientserver::IMessageCompressor> pCompressor_;
+		std::mt19937 maskGenerator_;
+		std::string compressBuffer_;
+		int connectingSocket_;     ///< Set during the handshakes, so that close() can abort them
+
+		// Only used by the I/O thread
+		uint64_t connectionGeneration_;
+		Handlers handlers_;
+		int socket_;
+		SSL* pSession_;
+		bool sessionWantsWrite_;
+		std::unique_ptr<clientserver::WebSocketFramer> pFramer_;
+		std::string outputBuffer_;
+		size_t outputPosition_;
+
+		std::thread ioThread_;
+	};
+
+} // end of namespace clientserver
+
+#endif // end of "#ifndef INCLUDEGUARD_clientserver_NativeClientTransport_h"
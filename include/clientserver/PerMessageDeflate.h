@@ -0,0 +1,105 @@
+#ifndef INCLUDEGUARD_clientserver_PerMessageDeflate_h
+#define INCLUDEGUARD_clientserver_PerMessageDeflate_h
+
+#include <string>
+#include <cstddef>
+#include "clientserver/IMessageCompressor.h"
+
+//
+// Forward declarations
+//
+struct z_stream_s;
+namespace clientserver
+{
+	class DeflateStreamPool;
+}
+
+namespace clientserver
+{
+	/** @brief The permessage-deflate WebSocket extension (RFC 7692), for one end of one connection.
+	 *
+	 * The static methods do the negotiation in the HTTP upgrade, and an instance then compresses the
+	 * messages sent and decompresses the ones received. The two directions are independent, each with
+	 * its own deflate stream. "Context takeover" means the stream keeps its window from one message
+	 * to the next, which compresses similar messages much better but means the connection has to
+	 * hold the zlib state all the time. Without it the state is only needed while a message is being
+	 * processed, so if a DeflateStreamPool is given it's borrowed from there and idle connections
+	 * cost nothing. Streams are only created when the first message needs them either way.
+	 *
+	 * Not thread safe, although compress() and decompress() can be called from different threads
+	 * when there is no pool.
+	 *
+	 * @author Mark Grimes
+	 * @date 19/Oct/2026
+	 */
+	class PerMessageDeflate : public clientserver::IMessageCompressor
+	{
+	public:
+		/** @brief What one end would like, and the compression settings it uses. */
+		struct Configuration
+		{
+			Configuration();
+			size_t threshold;          ///< Messages smaller than this are sent uncompressed. Default 256 bytes.
+			int level;                 ///< zlib compression level, from 1 (fastest) to 9 (smallest). Default 6.
+			int memoryLevel;           ///< zlib memory level, from 1 to 9. Default 8, which takes 128KiB.
+			int windowBits;            ///< The most window bits for either direction, from 9 to 15. Default 15, i.e. 32KiB.
+			bool contextTakeover;      ///< Whether this end keeps its compression window between messages. Default true.
+			bool peerContextTakeover;  ///< Whether the other end is allowed to. If not the decompressor can be pooled. Default true.
+		};
+		/** @brief What was agreed in the handshake, from the point of view of one end. */
+		struct Parameters
+		{
+			Parameters();
+			bool compressNoContextTakeover;   ///< Each message sent has to start with an empty window
+			bool decompressNoContextTakeover; ///< The peer promised the same, so the decompressor doesn't need keeping between messages
+			int compressWindowBits;
+			int decompressWindowBits;
+		};
+
+		/** @brief Client side, the value for the Sec-WebSocket-Extensions header of the upgrade request. */
+		static std::string createOffer( const Configuration& configuration );
+		/** @brief Server side, picks the first permessage-deflate offer in the client's Sec-WebSocket-Extensions header that can be accepted.
+		 *
+		 * @param response  Set to the value for the Sec-WebSocket-Extensions header of the reply.
+		 * @return          False if there were no acceptable offers, in which case messages are sent uncompressed.
+		 */
+		static bool acceptOffer( const std::string& offers, const Configuration& configuration, Parameters& agreed, std::string& response );
+		/** @brief Client side, checks the server's Sec-WebSocket-Extensions header.
+		 *
+		 * @return  False if the server didn't agree to compression.
+		 * @throw std::runtime_error  If the server's reply was not a valid answer to createOffer(). The connection should be failed.
+		 */
+		static bool acceptResponse( const std::string& response, const Configuration& configuration, Parameters& agreed );
+
+		/** @brief
+		 * @param pPool  Where to borrow streams from when a direction has no context takeover. If null streams
+		 *               are kept for the lifetime of this instance and reset between messages instead.
+		 */
+		PerMessageDeflate( const Configuration& configuration, const Parameters& parameters, clientserver::DeflateStreamPool* pPool=nullptr );
+		virtual ~PerMessageDeflate();
+
+		virtual bool shouldCompress( size_t size ) const override;
+		virtual void compress( const char* pData, size_t size, std::string& output, bool isLastPart=true ) override;
+		virtual void decompress( const char* pData, size_t size, std::string& output, size_t maximumSize ) override;
+
+		/** @brief Whether this instance currently holds any zlib state, i.e. whether the connection costs memory while idle. */
+		bool holdsStreams() const;
+	protected:
+		PerMessageDeflate( const PerMessageDeflate& other ) = delete;
+		PerMessageDeflate& operator=( const PerMessageDeflate& other ) = delete;
+		/** @brief Called at the end of each message to reset the stream, or give it back to the pool. */
+		void finishCompressing();
+		void finishDecompressing();
+		void releaseCompressor();
+		void releaseDecompressor();
+
+		Configuration configuration_;
+		Parameters parameters_;
+		clientserver::DeflateStreamPool* pPool_;
+		z_stream_s* pCompressor_;
+		z_stream_s* pDecompressor_;
+	};
+
+} // end of namespace clientserver
+
+#endif // end of "#ifndef INCLUDEGUARD_clientserver_PerMessageDeflate_h"
@@ -0,0 +1,136 @@
+#ifndef INCLUDEGUARD_clientserver_RateLimiter_h
+#define INCLUDEGUARD_clientserver_RateLimiter_h
+
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+namespace clientserver
+{
+	/** @brief Token bucket limits on the messages and bytes a client can send, so that one client can't take the handlers from everyone else.
+	 *
+	 * There are four limits, each with a rate and a burst: messages and bytes for each connection, and
+	 * messages and bytes for each client address over all of its connections. A message is only let
+	 * through if every limit has room for it, and is then taken from all of them, so the servers check
+	 * with admit() before calling a handler. Rejected requests get an empty response, the same as when
+	 * a handler throws, and rejected info messages are dropped.
+	 *
+	 * Buckets aren't topped up on a timer. Each one keeps when it was last refilled, and works out what
+	 * it has gained whenever it's next checked. Connection buckets live in the connection and are only
+	 * touched by the thread handling it, so they don't need locking. Address buckets are in a hash map
+	 * split into shards, each with its own mutex, and addresses whose buckets have filled up again are
+	 * swept out as the shard grows, since a full bucket is the same as a new one. IPv6 clients are
+	 * limited by their /64 prefix, which is usually one host, so that they can't get round the limit by
+	 * changing address; IPv4 clients by their full address.
+	 *
+	 * The number of messages rejected by each limit is counted for metrics. The same limiter can be
+	 * given to several servers so that the address limits cover them all.
+	 *
+	 * @author Mark Grimes
+	 * @date 19/Oct/2026
+	 */
+	class RateLimiter
+	{
+	public:
+		struct Limit
+		{
+			double perSecond; ///< The rate tokens are added at, or zero for no limit
+			double burst;     ///< The most tokens the bucket can hold, or zero for one second's worth
+		};
+		struct Configuration
+		{
+			Limit connectionMessages;
+			Limit connectionBytes;
+			Limit addressMessages;
+			Limit addressBytes;
+		};
+		/** @brief Whether a message was let through, or otherwise the first limit it was over. */
+		enum class Verdict { allowed=0, connectionMessages, connectionBytes, addressMessages, addressBytes };
+		static const size_t numberOfLimits=4;
+
+		/** @brief A client address, as the 128 bits of an IPv6 address with IPv4 ones mapped into it. */
+		struct Address
+		{
+			uint64_t high;
+			uint64_t low;
+			bool operator==( const Address& other ) const { return high==other.high && low==other.low; }
+		};
+		/** @brief Tokens left, and when they were last topped up. */
+		struct Bucket
+		{
+			double tokens;
+			int64_t lastRefill; ///< Nanoseconds on the steady clock, or zero if the bucket hasn't been used yet and is full
+		};
+		/** @brief What the limiter keeps for one connection. Only the thread handling its messages should use it. */
+		class ConnectionState
+		{
+		public:
+			/** @brief For connections without an address, e.g. over shared memory, which only have the per connection limits. */
+			ConnectionState();
+			/** @brief Reads the client's address from the connected socket, so that the per address limits apply as well. */
+			explicit ConnectionState( int socket );
+		protected:
+			friend class RateLimiter;
+			Bucket messages_;
+			Bucket bytes_;
+			bool hasAddress_;
+			Address address_;
+		};
+
+		/** @throw std::invalid_argument  If any of the rates or bursts are negative. */
+		explicit RateLimiter( const Configuration& configuration );
+
+		/** @brief Takes a message of the given size from the buckets if they all have room for it. Thread safe, as long as each state is only used by one thread.
+		 *
+		 * Byte buckets let a message through if they're full, even if it's bigger than the burst, and
+		 * then go into debt. Nothing is taken from any bucket if the message is rejected.
+		 */
+		Verdict admit( ConnectionState& state, size_t messageSize );
+
+		/** @brief The number of messages that have been rejected by the limit, which can't be Verdict::allowed. */
+		uint64_t rejections( Verdict limit ) const;
+		/** @brief The number of client addresses that currently have buckets. */
+		size_t numberOfAddresses() const;
+		/** @brief A short description of the limit for logs, e.g. "connection messages". */
+		static const char* name( Verdict verdict );
+	protected:
+		struct AddressHash
+		{
+			size_t operator()( const Address& address ) const;
+		};
+		struct AddressBuckets
+		{
+			Bucket messages;
+			Bucket bytes;
+		};
+		/** @brief One part of the address map, chosen by the hash of the address. */
+		struct Shard
+		{
+			Shard() : nextSweepSize(minimumSweepSize) {}
+			std::mutex mutex;
+			std::unordered_map<Address,AddressBuckets,AddressHash> buckets; ///< Protected by mutex
+			size_t nextSweepSize; ///< Protected by mutex
+		};
+		RateLimiter( const RateLimiter& other ) = delete;
+		RateLimiter& operator=( const RateLimiter& other ) = delete;
+		/** @brief Removes addresses whose buckets would be full by now. Requires the shard's mutex to be locked. */
+		void sweep( Shard& shard, int64_t now );
+		Verdict reject( Verdict limit );
+
+		static const size_t numberOfShards=64;
+		static const size_t minimumSweepSize=1024;
+
+		Configuration configuration_;
+		bool hasConnectionLimits_;
+		bool hasAddressLimits_;
+		std::vector<std::unique_ptr<Shard> > shards_;
+		std::atomic<uint64_t> rejections_[numberOfLimits];
+	};
+
+} // end of namespace clientserver
+
+#endif // end of "#ifndef INCLUDEGUARD_clientserver_RateLimiter_h"
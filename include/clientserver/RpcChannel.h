@@ -0,0 +1,83 @@
+#ifndef INCLUDEGUARD_clientserver_RpcChannel_h
+#define INCLUDEGUARD_clientserver_RpcChannel_h
+
+#include <string>
+#include <functional>
+#include <future>
+#include "clientserver/RpcCodec.h"
+
+namespace clientserver
+{
+	/** @brief Makes RPC calls over any of the clients, for the client stubs that rpcgen generates.
+	 *
+	 * All the clients (communique::Client and the in-tree ones) have a sendRequest method taking
+	 * the request and a response handler, so the channel just needs a function that calls it, e.g.
+	 *
+	 *     clientserver::RpcChannel channel( [&](const std::string& request,std::function<void(const std::string&)> handler){ client.sendRequest(request,handler); } );
+	 *
+	 * @author Mark Grimes
+	 * @date 19/Oct/2026
+	 */
+	class RpcChannel
+	{
+	public:
+		typedef std::function<void(const std::string&,std::function<void(const std::string&)>)> SendRequestFunction;
+		typedef std::function<void(const clientserver::RpcError&)> ErrorHandler;
+
+		explicit RpcChannel( SendRequestFunction sendRequest );
+
+		/** @brief Sends the request, and calls one of the handlers when the response arrives.
+		 *
+		 * The handlers are called from the client's receive thread. If errorHandler is empty, errors are ignored.
+		 */
+		template<class T_Response>
+		void call( uint32_t methodId, const google::protobuf::MessageLite& request, std::function<void(const T_Response&)> responseHandler, ErrorHandler errorHandler );
+		/** @brief Sends the request and blocks until the response arrives. Must not be called from a response handler.
+		 *
+		 * @throw clientserver::RpcError  If the call fails on the server, or the response can't be parsed.
+		 */
+		template<class T_Response>
+		T_Response call( uint32_t methodId, const google::protobuf::MessageLite& request );
+	protected:
+		SendRequestFunction sendRequest_;
+	};
+
+} // end of namespace clientserver
+
+template<class T_Response>
+void clientserver::RpcChannel::call( uint32_t methodId, const google::protobuf::MessageLite& request, std::function<void(const T_Response&)> responseHandler, ErrorHandler errorHandler )
+{
+	std::string message;
+	clientserver::RpcCodec::encodeRequest( methodId, request, message );
+	sendRequest_( message, [responseHandler,errorHandler](const std::string& encodedResponse)
+		{
+			try
+			{
+				// Parsed straight out of the received message
+				const size_t headerSize=clientserver::RpcCodec::decodeResponseHeader( encodedResponse.data(), encodedResponse.size() );
+				T_Response response;
+				if( !response.ParseFromArray( encodedResponse.data()+headerSize, static_cast<int>(encodedResponse.size()-headerSize) ) )
+				{
+					throw clientserver::RpcError( RpcStatus::invalidResponse, "Couldn't parse the RPC response" );
+				}
+				responseHandler( response );
+			}
+			catch( clientserver::RpcError& error )
+			{
+				if( errorHandler ) errorHandler( error );
+			}
+		} );
+}
+
+template<class T_Response>
+T_Response clientserver::RpcChannel::call( uint32_t methodId, const google::protobuf::MessageLite& request )
+{
+	std::promise<T_Response> promise;
+	std::future<T_Response> future=promise.get_future();
+	call<T_Response>( methodId, request,
+		[&promise](const T_Response& response){ promise.set_value(response); },
+		[&promise](const clientserver::RpcError& error){ promise.set_exception( std::make_exception_ptr(error) ); } );
+	return future.get();
+}
+
+#endif // end of "#ifndef INCLUDEGUARD_clientserver_RpcChannel_h"
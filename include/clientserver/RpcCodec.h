@@ -0,0 +1,73 @@
+#ifndef INCLUDEGUARD_clientserver_RpcCodec_h
+#define INCLUDEGUARD_clientserver_RpcCodec_h
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+namespace google
+{
+	namespace protobuf
+	{
+		class MessageLite;
+	}
+}
+
+namespace clientserver
+{
+	/** @brief The first byte of every RPC response, saying whether the call worked.
+	 *
+	 * invalidResponse is never sent, it's what clients report if they can't parse the response.
+	 */
+	enum class RpcStatus : uint8_t { ok=0, unknownMethod=1, invalidRequest=2, handlerError=3, invalidResponse=4 };
+
+	/** @brief Thrown (or given to error handlers) when an RPC call fails on the server. */
+	class RpcError : public std::runtime_error
+	{
+	public:
+		RpcError( RpcStatus status, const std::string& message );
+		RpcStatus status() const;
+	protected:
+		RpcStatus status_;
+	};
+
+	/** @brief How RPC calls are laid out inside the request and response messages of any of the transports.
+	 *
+	 * Requests are the method id as a protobuf varint, followed directly by the serialised request
+	 * message. Responses are a single RpcStatus byte, followed by the serialised response message
+	 * if the status is "ok", or an error message otherwise. The transports already give the length
+	 * and match responses to requests, so nothing else is needed.
+	 *
+	 * The decode methods only read the header, and return where the message starts, so that the
+	 * message can be parsed straight out of the received buffer without copying.
+	 *
+	 * @author Mark Grimes
+	 * @date 19/Oct/2026
+	 */
+	class RpcCodec
+	{
+	public:
+		/** @brief The largest header, i.e. a 32 bit varint. */
+		static const size_t maximumRequestHeaderSize=5;
+
+		/** @brief Appends the method id and the serialised request to the end of output. */
+		static void encodeRequest( uint32_t methodId, const google::protobuf::MessageLite& request, std::string& output );
+		/** @brief Reads the method id and returns the offset of the serialised request.
+		 *
+		 * @throw std::runtime_error  If the method id is truncated or too large.
+		 */
+		static size_t decodeRequestHeader( const char* pData, size_t size, uint32_t& methodId );
+
+		static void encodeResponse( const google::protobuf::MessageLite& response, std::string& output );
+		static void encodeError( RpcStatus status, const std::string& message, std::string& output );
+		/** @brief Checks the status, and returns the offset of the serialised response.
+		 *
+		 * @throw clientserver::RpcError  If the status is not "ok", or the response is empty.
+		 */
+		static size_t decodeResponseHeader( const char* pData, size_t size );
+	};
+
+} // end of namespace clientserver
+
+#endif // end of "#ifndef INCLUDEGUARD_clientserver_RpcCodec_h"
@@ -0,0 +1,106 @@
+#ifndef INCLUDEGUARD_clientserver_RpcDispatcher_h
+#define INCLUDEGUARD_clientserver_RpcDispatcher_h
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <atomic>
+#include "clientserver/RpcCodec.h"
+#include "clientserver/IConnection.h"
+#include "clientserver/ArenaBlockPool.h"
+
+namespace clientserver
+{
+	/** @brief Calls the handler for an RPC request, picked by the method id at the start of the request.
+	 *
+	 * handleRequest() has the same signature as the request handlers of all the in-tree servers, so
+	 * can be given straight to setDefaultRequestHandler. Handlers are kept in a vector indexed by the
+	 * method id, so dispatch is a single bounds check and indirect call.
+	 *
+	 * Methods are normally added by the server stubs that rpcgen generates from the services in the
+	 * .proto files, rather than by calling addMethod directly. All methods have to be added before
+	 * the first request arrives, because handleRequest does no locking.
+	 *
+	 * By default the request and response messages for each call are created on their own
+	 * google::protobuf::Arena, using blocks from the ArenaBlockPool of the handler's thread. Messages
+	 * with lots of nested messages, strings or repeated fields then cost a handful of pointer bumps
+	 * rather than a malloc each, and everything is freed at once when the response has been
+	 * serialised. Handlers must not keep pointers into the messages after they return.
+	 *
+	 * @author Mark Grimes
+	 * @date 19/Oct/2026
+	 */
+	class RpcDispatcher
+	{
+	public:
+		/** @brief Handler given the serialised request, which has to append the serialised response and return the status. */
+		typedef std::function<RpcStatus(const char* pRequest,size_t requestSize,std::string& response,std::weak_ptr<clientserver::IConnection> pConnection)> RawHandler;
+		/** @brief Method ids are used as an index, so have to be kept small. */
+		static const uint32_t maximumMethodId=0xffff;
+
+		RpcDispatcher();
+
+		/** @brief Whether to create messages on a per request arena, which is the default. Must be set before any requests arrive. */
+		void setUseArenas( bool useArenas );
+
+		/** @brief Adds a handler for the method id.
+		 *
+		 * @throw std::invalid_argument  If the method id is already used or larger than maximumMethodId.
+		 */
+		void addMethod( uint32_t methodId, RawHandler handler );
+		/** @brief Adds a handler that takes the parsed request, and fills in the response. */
+		template<class T_Request,class T_Response>
+		void addMethod( uint32_t methodId, std::function<void(const T_Request&,T_Response&,std::weak_ptr<clientserver::IConnection>)> handler );
+
+		/** @brief Calls the handler for the request and returns the encoded response.
+		 *
+		 * Never throws. Unknown methods, requests that can't be parsed and exceptions from the handlers are all
+		 * returned to the client as errors.
+		 */
+		std::string handleRequest( const std::string& request, std::weak_ptr<clientserver::IConnection> pConnection );
+		/** @brief The number of requests given to handleRequest so far, whether they worked or not. */
+		uint64_t requestsHandled() const;
+	protected:
+		template<class T_Request,class T_Response>
+		static RpcStatus callHandler( const std::function<void(const T_Request&,T_Response&,std::weak_ptr<clientserver::IConnection>)>& handler,
+			T_Request& request, T_Response& response, const char* pRequest, size_t requestSize, std::string& encodedResponse,
+			std::weak_ptr<clientserver::IConnection> pConnection );
+
+		std::vector<RawHandler> methods_;
+		std::atomic<uint64_t> requestsHandled_;
+		bool useArenas_;
+	};
+
+} // end of namespace clientserver
+
+template<class T_Request,class T_Response>
+void clientserver::RpcDispatcher::addMethod( uint32_t methodId, std::function<void(const T_Request&,T_Response&,std::weak_ptr<clientserver::IConnection>)> handler )
+{
+	addMethod( methodId, [this,handler](const char* pRequest,size_t requestSize,std::string& response,std::weak_ptr<clientserver::IConnection> pConnection)->RpcStatus
+		{
+			if( useArenas_ )
+			{
+				google::protobuf::Arena arena( clientserver::ArenaBlockPool::arenaOptions() );
+				T_Request* pTypedRequest=google::protobuf::Arena::CreateMessage<T_Request>( &arena );
+				T_Response* pTypedResponse=google::protobuf::Arena::CreateMessage<T_Response>( &arena );
+				return callHandler( handler, *pTypedRequest, *pTypedResponse, pRequest, requestSize, response, pConnection );
+			}
+			T_Request typedRequest;
+			T_Response typedResponse;
+			return callHandler( handler, typedRequest, typedResponse, pRequest, requestSize, response, pConnection );
+		} );
+}
+
+template<class T_Request,class T_Response>
+clientserver::RpcStatus clientserver::RpcDispatcher::callHandler( const std::function<void(const T_Request&,T_Response&,std::weak_ptr<clientserver::IConnection>)>& handler,
+	T_Request& request, T_Response& response, const char* pRequest, size_t requestSize, std::string& encodedResponse,
+	std::weak_ptr<clientserver::IConnection> pConnection )
+{
+	if( !request.ParseFromArray( pRequest, static_cast<int>(requestSize) ) ) return RpcStatus::invalidRequest;
+	handler( request, response, pConnection );
+	clientserver::RpcCodec::encodeResponse( response, encodedResponse );
+	return RpcStatus::ok;
+}
+
+#endif // end of "#ifndef INCLUDEGUARD_clientserver_RpcDispatcher_h"
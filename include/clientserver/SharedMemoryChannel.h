@@ -0,0 +1,101 @@
+#ifndef INCLUDEGUARD_clientserver_SharedMemoryChannel_h
+#define INCLUDEGUARD_clientserver_SharedMemoryChannel_h
+
+#include <memory>
+#include <string>
+#include <mutex>
+#include <cstdint>
+#include "clientserver/SpscRing.h"
+
+namespace clientserver
+{
+	/** @brief A bidirectional message channel between two processes on the same machine, using shared memory.
+	 *
+	 * There is one clientserver::SpscRing in each direction, both living in a single memfd that is
+	 * mmap'd by both processes. A Unix domain socket is used to pass the memfd and four eventfds
+	 * from the client to the server (SCM_RIGHTS), after which the socket is only used to detect
+	 * when the other side goes away. The memfd is sealed so that it can't be resized, since the
+	 * server would fault on its next access if the client shrank it. The eventfds are used to wake
+	 * the other side up, but only when it has actually gone to sleep, so at high message rates there
+	 * are no system calls at all. If busy polling is enabled, the receiving side spins for a while
+	 * before sleeping.
+	 *
+	 * Each message carries a type and an id so that responses can be matched to requests.
+	 *
+	 * This class is used by clientserver::SharedMemoryServer and clientserver::SharedMemoryClient,
+	 * you probably want one of those rather than this.
+	 *
+	 * @author Mark Grimes
+	 * @date 19/Oct/2026
+	 */
+	class SharedMemoryChannel
+	{
+	public:
+		enum class MessageType : uint32_t { request=1, response=2, info=3 };
+
+		/** @brief Client side. Creates the shared memory, connects to the Unix socket and hands over the descriptors.
+		 *
+		 * @param ringCapacity  Size in bytes of the ring in each direction. Must be a power of two.
+		 * @throw std::system_error  If any of the system calls fail, e.g. nothing listening on the socket.
+		 */
+		static std::unique_ptr<SharedMemoryChannel> connect( const std::string& socketPath, size_t ringCapacity );
+
+		/** @brief Server side. Receives the descriptors from a newly accepted socket, and takes ownership of the socket.
+		 *
+		 * @throw std::system_error  If the client didn't send valid descriptors, e.g. memory that isn't sealed against resizing or
+		 *                           anything other than eventfds for the wakeups.
+		 */
+		static std::unique_ptr<SharedMemoryChannel> accept( int socket );
+
+		~SharedMemoryChannel();
+
+		/** @brief Number of times to check the ring before going to sleep on the eventfd. Zero means never spin. */
+		void setBusyPollIterations( size_t iterations );
+
+		/** @brief Sends a message, blocking if the ring is full. Can be called from any thread.
+		 *
+		 * @param interruptFd  If this file descriptor becomes readable while waiting for space the call
+		 *                     gives up. Can be -1.
+		 * @return False if the peer disconnected or interruptFd became readable before the message could be sent.
+		 */
+		bool send( MessageType type, uint32_t id, const std::string& payload, int interruptFd=-1 );
+
+		/** @brief Blocks until a message is received. Should only be called from one thread.
+		 *
+		 * @return False if the peer disconnected or interruptFd became readable.
+		 */
+		bool receive( MessageType& type, uint32_t& id, std::string& payload, int interruptFd=-1 );
+
+		/** @brief Shuts down the socket, so that both this side and the peer stop waiting on the channel. */
+		void shutdown();
+	protected:
+		struct RecordHeader
+		{
+			MessageType type;
+			uint32_t id;
+		};
+		SharedMemoryChannel( int socket, int memoryFd, size_t ringCapacity, const int eventFds[4], bool isClient );
+		SharedMemoryChannel( const SharedMemoryChannel& other ) = delete;
+		SharedMemoryChannel& operator=( const SharedMemoryChannel& other ) = delete;
+
+		/** @brief Waits until fd is readable. Returns false if the socket closes or interruptFd is readable first. */
+		bool waitFor( int fd, int interruptFd );
+
+		int socket_;
+		int memoryFd_;
+		int eventFds_[4]; ///< Data and space available for the client-to-server ring, then the same for server-to-client.
+		void* pMemory_;
+		size_t memorySize_;
+		std::unique_ptr<clientserver::SpscRing> pOutgoing_;
+		std::unique_ptr<clientserver::SpscRing> pIncoming_;
+		int outgoingDataFd_;
+		int outgoingSpaceFd_;
+		int incomingDataFd_;
+		int incomingSpaceFd_;
+		size_t busyPollIterations_;
+		std::mutex sendMutex_; ///< The ring only supports one producer, so sends from different threads have to be serialised
+	};
+
+} // end of namespace clientserver
+
+#endif // end of "#ifndef INCLUDEGUARD_clientserver_SharedMemoryChannel_h"
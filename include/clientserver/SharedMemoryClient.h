@@ -0,0 +1,79 @@
+#ifndef INCLUDEGUARD_clientserver_SharedMemoryClient_h
+#define INCLUDEGUARD_clientserver_SharedMemoryClient_h
+
+#include <string>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+
+//
+// Forward declarations
+//
+namespace clientserver
+{
+	class SharedMemoryChannel;
+}
+
+namespace clientserver
+{
+	/** @brief Client for clientserver::SharedMemoryServer, for processes on the same machine as the server.
+	 *
+	 * The interface is similar to communique::Client. Requests are asynchronous, so any number can be
+	 * in flight at once (limited only by the size of the ring) and the response handlers are called
+	 * from an internal thread as the responses arrive.
+	 *
+	 * @author Mark Grimes
+	 * @date 19/Oct/2026
+	 */
+	class SharedMemoryClient
+	{
+	public:
+		SharedMemoryClient();
+		~SharedMemoryClient();
+
+		/** @brief Number of times to check for responses before sleeping. Must be called before connect() to have any effect. */
+		void setBusyPollIterations( size_t iterations );
+		/** @brief Size in bytes of the ring in each direction. Must be a power of two. Default is 1MiB. Must be called before connect(). */
+		void setRingCapacity( size_t capacity );
+		void setDefaultInfoHandler( std::function<void(const std::string&)> infoHandler );
+
+		/** @brief Connects to a clientserver::SharedMemoryServer listening on the Unix socket at socketPath.
+		 *
+		 * @throw std::system_error  If the connection could not be made.
+		 */
+		void connect( const std::string& socketPath );
+		void disconnect();
+		bool isConnected();
+
+		/** @brief Sends a message that does not expect a response.
+		 * @throw std::runtime_error  If not connected.
+		 */
+		void sendInfo( const std::string& message );
+		/** @brief Sends a request, calling responseHandler from the receive thread when the response arrives.
+		 * @throw std::runtime_error  If not connected.
+		 */
+		void sendRequest( const std::string& message, std::function<void(const std::string&)> responseHandler );
+	protected:
+		SharedMemoryClient( const SharedMemoryClient& other ) = delete;
+		SharedMemoryClient& operator=( const SharedMemoryClient& other ) = delete;
+		void receiveLoop();
+
+		size_t busyPollIterations_;
+		size_t ringCapacity_;
+		std::unique_ptr<clientserver::SharedMemoryChannel> pChannel_;
+		int stopEventFd_;
+		std::atomic<bool> connected_;
+		std::atomic<uint32_t> nextRequestId_;
+		std::function<void(const std::string&)> infoHandler_;
+		std::mutex responseHandlersMutex_;
+		std::unordered_map<uint32_t,std::function<void(const std::string&)> > responseHandlers_;
+		std::thread receiveThread_;
+	};
+
+} // end of namespace clientserver
+
+#endif // end of "#ifndef INCLUDEGUARD_clientserver_SharedMemoryClient_h"
@@ -0,0 +1,88 @@
+#ifndef INCLUDEGUARD_clientserver_SharedMemoryServer_h
+#define INCLUDEGUARD_clientserver_SharedMemoryServer_h
+
+#include <string>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include "clientserver/IConnection.h"
+
+//
+// Forward declarations
+//
+namespace clientserver
+{
+	class ConnectionRegistry;
+	class RateLimiter;
+}
+
+namespace clientserver
+{
+	/** @brief Server for clients on the same machine that talk over shared memory rather than a network socket.
+	 *
+	 * The interface mirrors communique::Server so that the same handlers can be plugged into both.
+	 * Clients connect with clientserver::SharedMemoryClient to the Unix socket given to listen(),
+	 * after which all messages go through a clientserver::SharedMemoryChannel. Each connection is
+	 * serviced by its own thread, since the intended use is a small number of co-located
+	 * processes that send at a very high rate.
+	 *
+	 * @author Mark Grimes
+	 * @date 19/Oct/2026
+	 */
+	class SharedMemoryServer
+	{
+	public:
+		SharedMemoryServer();
+		~SharedMemoryServer();
+
+		/** @brief Number of times each connection checks for messages before sleeping. Only affects connections made after the call. */
+		void setBusyPollIterations( size_t iterations );
+		void setDefaultRequestHandler( std::function<std::string(const std::string&,std::weak_ptr<clientserver::IConnection>)> requestHandler );
+		void setDefaultInfoHandler( std::function<void(const std::string&,std::weak_ptr<clientserver::IConnection>)> infoHandler );
+		/** @brief Adds connections to this registry instead of the server's own, e.g. to share one between servers. Must be called before listen(). */
+		void setConnectionRegistry( std::shared_ptr<clientserver::ConnectionRegistry> pConnectionRegistry );
+		/** @brief Every connection that is currently open, see clientserver::ConnectionRegistry. */
+		const std::shared_ptr<clientserver::ConnectionRegistry>& connectionRegistry() const;
+		/** @brief Checks every message against the limiter before it goes to a handler, see clientserver::RateLimiter. Must be called before listen(). None by default.
+		 *
+		 * The same limiter can be given to other servers, so that the per address limits cover all of them.
+		 */
+		void setRateLimiter( std::shared_ptr<clientserver::RateLimiter> pRateLimiter );
+
+		/** @brief Starts accepting connections on the Unix socket at socketPath, and returns straight away.
+		 *
+		 * Any existing file at socketPath is removed first.
+		 * @throw std::system_error  If the socket could not be created.
+		 */
+		void listen( const std::string& socketPath );
+
+		/** @brief Closes all connections and stops listening. Blocks until all threads have finished. */
+		void stop();
+	protected:
+		class Connection;
+		SharedMemoryServer( const SharedMemoryServer& other ) = delete;
+		SharedMemoryServer& operator=( const SharedMemoryServer& other ) = delete;
+		void acceptLoop();
+		/** @brief Joins the threads of any connections that have finished and removes them. Requires connectionsMutex_ to be locked. */
+		void removeFinishedConnections();
+
+		std::string socketPath_;
+		int listenSocket_;
+		int stopEventFd_; ///< Written to when stop() is called, which everything waiting polls on
+		std::atomic<bool> stopping_; ///< Also set by stop(), so that busy connections can check without a system call
+		size_t busyPollIterations_;
+		std::shared_ptr<clientserver::ConnectionRegistry> pConnectionRegistry_;
+		std::shared_ptr<clientserver::RateLimiter> pRateLimiter_; ///< Null if messages aren't limited
+		std::function<std::string(const std::string&,std::weak_ptr<clientserver::IConnection>)> requestHandler_;
+		std::function<void(const std::string&,std::weak_ptr<clientserver::IConnection>)> infoHandler_;
+		std::thread acceptThread_;
+		std::mutex connectionsMutex_;
+		std::vector<std::shared_ptr<Connection> > connections_;
+	};
+
+} // end of namespace clientserver
+
+#endif // end of "#ifndef INCLUDEGUARD_clientserver_SharedMemoryServer_h"
@@ -0,0 +1,73 @@
+#ifndef INCLUDEGUARD_clientserver_SocketHandover_h
+#define INCLUDEGUARD_clientserver_SocketHandover_h
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <thread>
+#include <atomic>
+
+namespace clientserver
+{
+	/** @brief Passes listening sockets from a running process to the one replacing it, so that a restart never refuses connections.
+	 *
+	 * The running process offer()s its listening sockets on a Unix socket. The new process take()s them
+	 * over it with SCM_RIGHTS, starts accepting on them with e.g. WebSocketServer::listenOnSocket(),
+	 * and only then is the old process told to stop accepting. Both processes have the same sockets,
+	 * so connections waiting to be accepted stay queued through all of this, and the old process can
+	 * carry on serving the connections it already has until they finish.
+	 *
+	 * The new process then offer()s the sockets on the same path, ready for the next restart.
+	 *
+	 * @author Mark Grimes
+	 * @date 19/Oct/2026
+	 */
+	class SocketHandover
+	{
+	public:
+		SocketHandover();
+		~SocketHandover();
+
+		/** @brief Takes over the sockets another process is offering on socketPath, if there is one.
+		 *
+		 * The sockets are given to startHandler, which should start accepting on them before returning
+		 * and owns them from then on. Only after it returns is the other process told to stop accepting.
+		 * If startHandler throws the other process carries on as it was, and the exception is passed on.
+		 *
+		 * @return  False, without calling startHandler, if nothing is offering sockets on socketPath.
+		 * @throw std::system_error  If the handover fails part way through.
+		 */
+		static bool take( const std::string& socketPath, std::function<void(std::vector<int>)> startHandler );
+
+		/** @brief Offers the sockets to the next process that calls take() on socketPath, and returns straight away.
+		 *
+		 * Any existing file at socketPath is removed first. Once another process has taken the sockets and
+		 * is accepting on them, handedOverHandler is called from another thread to stop this one accepting.
+		 * The sockets still belong to the caller, and can only be handed over once.
+		 * @throw std::system_error  If the Unix socket could not be created.
+		 */
+		void offer( const std::string& socketPath, std::vector<int> sockets, std::function<void()> handedOverHandler );
+		/** @brief Whether another process has taken the sockets. */
+		bool hasHandedOver() const;
+
+		/** @brief Stops offering the sockets. Blocks until the thread has finished. */
+		void stop();
+	protected:
+		SocketHandover( const SocketHandover& other ) = delete;
+		SocketHandover& operator=( const SocketHandover& other ) = delete;
+		void offerLoop();
+		/** @brief Hands the sockets over to a process that has connected. Returns false if it went away before it was accepting on them. */
+		bool handOver( int connection );
+
+		std::string socketPath_;
+		int listenSocket_;
+		int stopEventFd_; ///< Written to when stop() is called, which the offer thread polls on
+		std::vector<int> sockets_;
+		std::function<void()> handedOverHandler_;
+		std::atomic<bool> hasHandedOver_;
+		std::thread offerThread_;
+	};
+
+} // end of namespace clientserver
+
+#endif // end of "#ifndef INCLUDEGUARD_clientserver_SocketHandover_h"
@@ -0,0 +1,97 @@
+#ifndef INCLUDEGUARD_clientserver_SpscRing_h
+#define INCLUDEGUARD_clientserver_SpscRing_h
+
+#include <atomic>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+namespace clientserver
+{
+	/** @brief Lock free, single producer single consumer queue of variable length records.
+	 *
+	 * All of the state lives in a block of memory supplied by the caller, so that the block
+	 * can be mmap'd into two different processes and each process can construct an SpscRing
+	 * on top of it. Only one of them should specify "initialise" in the constructor.
+	 *
+	 * Each record is stored as a 32 bit length followed by the data. Records wrap around the
+	 * end of the buffer, so the full capacity is usable regardless of record sizes.
+	 *
+	 * The ring does not do any blocking itself, but it keeps a "waiting" flag for each side
+	 * so that whatever wakeup mechanism is used (e.g. eventfd) only has to be signalled when
+	 * the other side has actually gone to sleep.
+	 *
+	 * @author Mark Grimes
+	 * @date 19/Oct/2026
+	 */
+	class SpscRing
+	{
+	public:
+		/** @brief The number of bytes of memory required to hold a ring with the given capacity. */
+		static size_t requiredMemory( size_t capacity );
+
+		/** @brief Construct on top of the given memory.
+		 *
+		 * @param pMemory     Must be at least requiredMemory(capacity) bytes and aligned to 64 bytes.
+		 * @param capacity    Must be a power of two.
+		 * @param initialise  If true the memory is zeroed and the header set up. If false the memory is
+		 *                    assumed to have already been initialised (e.g. by another process).
+		 * @throw std::invalid_argument  If the capacity is not a power of two, or doesn't match what is
+		 *                               in the memory when initialise is false.
+		 */
+		SpscRing( void* pMemory, size_t capacity, bool initialise );
+
+		size_t capacity() const;
+		/** @brief The largest record that can be pushed. */
+		size_t maximumRecordSize() const;
+
+		/** @brief Adds a record to the ring, or returns false if there is not enough space. Producer only.
+		 *
+		 * The record is the concatenation of pHead and pBody, so that a small header can be added
+		 * to a payload without copying the payload first.
+		 *
+		 * @throw std::length_error  If the record could never fit in the ring.
+		 */
+		bool push( const void* pHead, size_t headSize, const void* pBody, size_t bodySize );
+		bool push( const void* pData, size_t size );
+
+		/** @brief Removes the oldest record and copies it into output, or returns false if the ring is empty. Consumer only. */
+		bool pop( std::string& output );
+		/** @brief Same as pop(std::string&) but the first headSize bytes are copied into pHead instead of body.
+		 *
+		 * @throw std::length_error  If the record is shorter than headSize, or its length is more than the ring holds
+		 *                           (i.e. the memory has been corrupted). The ring is left as it was.
+		 */
+		bool pop( void* pHead, size_t headSize, std::string& body );
+
+		bool empty() const;
+
+		/** @brief Consumer calls this before sleeping. Returns false if data arrived in the mean time and it shouldn't sleep. */
+		bool prepareConsumerWait();
+		/** @brief Producer calls this after pushing. If true the consumer is asleep and needs waking up. */
+		bool consumerNeedsWaking();
+		/** @brief Producer calls this before sleeping on a full ring. Returns false if space was freed in the mean time. */
+		bool prepareProducerWait( size_t recordSize );
+		/** @brief Consumer calls this after popping. If true the producer is asleep and needs waking up. */
+		bool producerNeedsWaking();
+	protected:
+		/** @brief The layout of the start of the memory block. Head and tail are on separate cache lines to avoid false sharing. */
+		struct Header
+		{
+			alignas(64) std::atomic<uint64_t> head; ///< Total number of bytes ever written. Only modified by the producer.
+			std::atomic<uint32_t> producerWaiting;
+			uint64_t capacity;
+			alignas(64) std::atomic<uint64_t> tail; ///< Total number of bytes ever read. Only modified by the consumer.
+			std::atomic<uint32_t> consumerWaiting;
+		};
+		void copyIn( uint64_t position, const void* pData, size_t size );
+		void copyOut( uint64_t position, void* pData, size_t size ) const;
+
+		Header* pHeader_;
+		char* pData_;
+		uint64_t mask_;
+	};
+
+} // end of namespace clientserver
+
+#endif // end of "#ifndef INCLUDEGUARD_clientserver_SpscRing_h"
@@ -0,0 +1,98 @@
+#ifndef INCLUDEGUARD_clientserver_StateDelta_h
+#define INCLUDEGUARD_clientserver_StateDelta_h
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+//
+// Forward declarations
+//
+namespace google
+{
+	namespace protobuf
+	{
+		class Message;
+	}
+}
+
+namespace clientserver
+{
+	/** @brief Field level differences between two protobuf messages, and how state updates are laid out in messages.
+	 *
+	 * A state update is either a snapshot, which has the whole state, or a delta, which only has the
+	 * fields that changed since an earlier state that the client acknowledged. Both are sent to the
+	 * client as binary messages on any of the transports:
+	 *
+	 *     1 byte        UpdateType
+	 *     varint        sequence number of this state, counting from 1
+	 *     varint        length of the subscription name, then the name
+	 *     varint        (deltas only) sequence number of the state the delta is from
+	 *     varint        (deltas only) number of changed fields, then for each one the depth followed
+	 *                   by the field number at each depth
+	 *     remainder     the serialised state, or for deltas a message of the same type with only the
+	 *                   changed fields set
+	 *
+	 * Changed fields are given as a path of field numbers from the top level message, so that a field
+	 * inside a singular sub message can change without resending the rest of the sub message. Any
+	 * other kind of field, including repeated fields and sub messages that were added or removed, is
+	 * sent whole. Applying a delta clears each of the changed fields, then merges the changes in, so
+	 * fields that were cleared need no special handling.
+	 *
+	 * Acknowledgements go back to the server as the sequence number as a varint, followed by the
+	 * subscription name. Sequence number zero means the client has lost track and needs a snapshot.
+	 *
+	 * Only uses the parts of the protobuf API that are in the version compiled with Emscripten, so
+	 * can be part of the client code.
+	 *
+	 * @author Mark Grimes
+	 * @date 19/Oct/2026
+	 */
+	class StateDelta
+	{
+	public:
+		enum class UpdateType : uint8_t { snapshot=0, delta=1 };
+		typedef std::vector<uint32_t> FieldPath;
+
+		/** @brief Everything in an update except the serialised message. */
+		struct Header
+		{
+			UpdateType type;
+			uint64_t sequence;
+			uint64_t baseSequence; ///< Zero for snapshots
+			std::string subscription;
+			std::vector<FieldPath> changedFields;
+		};
+
+		/** @brief Finds the fields that differ between the two messages, which have to be the same type.
+		 *
+		 * @param changedFields  Set to the path of each field that was changed, added or cleared.
+		 * @param changes        Set to a copy of current with only the changed fields set.
+		 */
+		static void diff( const google::protobuf::Message& base, const google::protobuf::Message& current, std::vector<FieldPath>& changedFields, google::protobuf::Message& changes );
+		/** @brief Clears each changed field of state, then merges in the serialised changes.
+		 *
+		 * @throw std::runtime_error  If a path doesn't match the type of state, or the changes can't be parsed.
+		 */
+		static void apply( const std::vector<FieldPath>& changedFields, const char* pChanges, size_t changesSize, google::protobuf::Message& state );
+
+		/** @brief Appends a snapshot of the whole state to output. */
+		static void encodeSnapshot( const std::string& subscription, uint64_t sequence, const google::protobuf::Message& state, std::string& output );
+		/** @brief Appends a delta to output, with the results of diff(). */
+		static void encodeDelta( const std::string& subscription, uint64_t sequence, uint64_t baseSequence,
+				const std::vector<FieldPath>& changedFields, const google::protobuf::Message& changes, std::string& output );
+		/** @brief Reads everything up to the serialised message, and returns the offset where it starts.
+		 *
+		 * @throw std::runtime_error  If the update is truncated or not valid.
+		 */
+		static size_t decodeHeader( const char* pData, size_t size, Header& header );
+
+		static void encodeAcknowledgement( const std::string& subscription, uint64_t sequence, std::string& output );
+		/** @throw std::runtime_error  If the acknowledgement is not valid. */
+		static void decodeAcknowledgement( const char* pData, size_t size, std::string& subscription, uint64_t& sequence );
+	};
+
+} // end of namespace clientserver
+
+#endif // end of "#ifndef INCLUDEGUARD_clientserver_StateDelta_h"
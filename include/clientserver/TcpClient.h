@@ -0,0 +1,85 @@
+#ifndef INCLUDEGUARD_clientserver_TcpClient_h
+#define INCLUDEGUARD_clientserver_TcpClient_h
+
+#include <string>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+
+//
+// Forward declarations
+//
+namespace clientserver
+{
+	class FramedSocket;
+	class TlsContext;
+}
+
+namespace clientserver
+{
+	/** @brief Opens a blocking TCP connection to the host, trying each address it resolves to in turn.
+	 *
+	 * @throw std::runtime_error  If the host name can't be resolved.
+	 * @throw std::system_error   If none of the addresses could be connected to.
+	 */
+	int connectTcp( const std::string& host, size_t port );
+
+	/** @brief Native client for clientserver::TcpServer.
+	 *
+	 * The interface is similar to communique::Client. Requests are asynchronous and any number can be
+	 * in flight at once. Response and info handlers are called from an internal thread.
+	 *
+	 * @author Mark Grimes
+	 * @date 19/Oct/2026
+	 */
+	class TcpClient
+	{
+	public:
+		TcpClient();
+		~TcpClient();
+
+		/** @brief Use TLS for the connection. Must be called before connect().
+		 *
+		 * @param verifyFile  PEM file of certificate authorities to verify the server with. If empty the system defaults are used.
+		 * @param verifyPeer  Set to false to skip verification altogether, e.g. for self signed test certificates.
+		 */
+		void enableTls( const std::string& verifyFile=std::string(), bool verifyPeer=true );
+		void setDefaultInfoHandler( std::function<void(const std::string&)> infoHandler );
+
+		/** @brief Connects to the server, and returns once the TCP connection is made. The TLS handshake happens in the background.
+		 *
+		 * @throw std::system_error   If the connection could not be made.
+		 * @throw std::runtime_error  If TLS was enabled but could not be set up.
+		 */
+		void connect( const std::string& host, size_t port );
+		void disconnect();
+		bool isConnected();
+
+		/** @brief Sends a message that does not expect a response.
+		 * @throw std::runtime_error  If not connected.
+		 */
+		void sendInfo( const std::string& message );
+		/** @brief Sends a request, calling responseHandler from the receive thread when the response arrives.
+		 * @throw std::runtime_error  If not connected.
+		 */
+		void sendRequest( const std::string& message, std::function<void(const std::string&)> responseHandler );
+	protected:
+		TcpClient( const TcpClient& other ) = delete;
+		TcpClient& operator=( const TcpClient& other ) = delete;
+
+		std::shared_ptr<clientserver::TlsContext> pTlsContext_;
+		std::unique_ptr<clientserver::FramedSocket> pSocket_;
+		std::atomic<uint32_t> nextRequestId_;
+		std::function<void(const std::string&)> infoHandler_;
+		std::mutex responseHandlersMutex_;
+		std::unordered_map<uint32_t,std::function<void(const std::string&)> > responseHandlers_;
+		std::thread ioThread_;
+	};
+
+} // end of namespace clientserver
+
+#endif // end of "#ifndef INCLUDEGUARD_clientserver_TcpClient_h"
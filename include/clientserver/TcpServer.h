@@ -0,0 +1,109 @@
+#ifndef INCLUDEGUARD_clientserver_TcpServer_h
+#define INCLUDEGUARD_clientserver_TcpServer_h
+
+#include <string>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include "clientserver/IConnection.h"
+
+//
+// Forward declarations
+//
+namespace clientserver
+{
+	class TlsContext;
+	class ConnectionRegistry;
+	class RateLimiter;
+}
+
+namespace clientserver
+{
+	/** @brief Server for native clients that speak the clientserver::BinaryFramer protocol directly over TCP.
+	 *
+	 * Native clients don't need the HTTP upgrade or the WebSocket framing and masking, so this saves
+	 * both bytes and CPU. The interface mirrors communique::Server so that the same handlers can be
+	 * used. If a certificate and key are set the connections are wrapped in TLS.
+	 *
+	 * Each connection is serviced by its own thread running a clientserver::FramedSocket loop.
+	 *
+	 * @author Mark Grimes
+	 * @date 19/Oct/2026
+	 */
+	class TcpServer
+	{
+	public:
+		TcpServer();
+		~TcpServer();
+
+		void setCertificateChainFile( const std::string& filename );
+		void setPrivateKeyFile( const std::string& filename );
+		void setDefaultRequestHandler( std::function<std::string(const std::string&,std::weak_ptr<clientserver::IConnection>)> requestHandler );
+		void setDefaultInfoHandler( std::function<void(const std::string&,std::weak_ptr<clientserver::IConnection>)> infoHandler );
+		/** @brief Let other sockets listen on the same port with SO_REUSEPORT, see WebSocketServer::setReusePort(). Must be called before listen(). */
+		void setReusePort( bool reusePort );
+		/** @brief How much unsent output a connection can have before the server stops reading its requests, see FramedSocket::setOutputLimit(). Must be called before listen(). Default is 256KiB. */
+		void setOutputBufferSize( size_t outputBufferSize );
+		/** @brief Adds connections to this registry instead of the server's own, e.g. to share one between servers. Must be called before listen(). */
+		void setConnectionRegistry( std::shared_ptr<clientserver::ConnectionRegistry> pConnectionRegistry );
+		/** @brief Every connection that is currently open, see clientserver::ConnectionRegistry. */
+		const std::shared_ptr<clientserver::ConnectionRegistry>& connectionRegistry() const;
+		/** @brief Checks every message against the limiter before it goes to a handler, see clientserver::RateLimiter. Must be called before listen(). None by default.
+		 *
+		 * The same limiter can be given to other servers, so that the per address limits cover all of them.
+		 */
+		void setRateLimiter( std::shared_ptr<clientserver::RateLimiter> pRateLimiter );
+
+		/** @brief Starts accepting connections on the given port, and returns straight away.
+		 *
+		 * @param port  If zero, the operating system picks a free port which can be found with port().
+		 * @throw std::system_error   If the socket could not be created.
+		 * @throw std::runtime_error  If TLS was requested but the certificate or key could not be loaded.
+		 */
+		void listen( size_t port );
+		/** @brief Starts accepting connections on a socket that is already listening, see WebSocketServer::listenOnSocket(). Takes ownership of the socket. */
+		void listenOnSocket( int socket );
+		/** @brief The listening socket, e.g. to hand over to another process. Still owned by this server, and -1 if not listening. */
+		int listenSocket() const;
+		/** @brief The port being listened on. */
+		size_t port() const;
+		/** @brief Stops accepting new connections but carries on serving the existing ones. The socket stays open until stop(). */
+		void stopAccepting();
+		/** @brief The number of clients currently connected. */
+		size_t currentConnections() const;
+
+		/** @brief Closes all connections and stops listening. Blocks until all threads have finished. */
+		void stop();
+	protected:
+		class Connection;
+		TcpServer( const TcpServer& other ) = delete;
+		TcpServer& operator=( const TcpServer& other ) = delete;
+		void acceptLoop();
+		/** @brief Joins the threads of any connections that have finished and removes them. Requires connectionsMutex_ to be locked. */
+		void removeFinishedConnections();
+		/** @brief Starts the accept thread once listenSocket_ is set, closing it again if that fails. */
+		void startAcceptThread();
+
+		std::string certificateChainFile_;
+		std::string privateKeyFile_;
+		std::shared_ptr<clientserver::TlsContext> pTlsContext_;
+		int listenSocket_;
+		size_t port_;
+		bool reusePort_;
+		size_t outputBufferSize_;
+		std::shared_ptr<clientserver::ConnectionRegistry> pConnectionRegistry_;
+		std::shared_ptr<clientserver::RateLimiter> pRateLimiter_; ///< Null if messages aren't limited
+		int stopEventFd_; ///< Written to when stop() is called, which everything waiting polls on
+		int stopAcceptingEventFd_; ///< Written to when stopAccepting() is called, which only the accept thread polls on
+		std::function<std::string(const std::string&,std::weak_ptr<clientserver::IConnection>)> requestHandler_;
+		std::function<void(const std::string&,std::weak_ptr<clientserver::IConnection>)> infoHandler_;
+		std::thread acceptThread_;
+		mutable std::mutex connectionsMutex_;
+		std::vector<std::shared_ptr<Connection> > connections_;
+	};
+
+} // end of namespace clientserver
+
+#endif // end of "#ifndef INCLUDEGUARD_clientserver_TcpServer_h"
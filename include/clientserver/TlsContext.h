@@ -0,0 +1,57 @@
+#ifndef INCLUDEGUARD_clientserver_TlsContext_h
+#define INCLUDEGUARD_clientserver_TlsContext_h
+
+#include <string>
+#include <memory>
+
+//
+// Forward declarations
+//
+typedef struct ssl_ctx_st SSL_CTX;
+typedef struct ssl_st SSL;
+
+namespace clientserver
+{
+	/** @brief Thin wrapper around an OpenSSL SSL_CTX, for the in-tree transports that support TLS.
+	 *
+	 * @author Mark Grimes
+	 * @date 19/Oct/2026
+	 */
+	class TlsContext
+	{
+	public:
+		/** @brief Creates a context for the server side, using the same PEM files as communique::Server.
+		 *
+		 * @throw std::runtime_error  If the files can't be loaded or the key doesn't match the certificate.
+		 */
+		static std::shared_ptr<TlsContext> createServer( const std::string& certificateChainFile, const std::string& privateKeyFile );
+
+		/** @brief Creates a context for the client side.
+		 *
+		 * @param verifyFile  PEM file of the certificate authorities to check the server against. If empty,
+		 *                    the system defaults are used. If "verifyPeer" is false nothing is checked at all,
+		 *                    which is only sensible for testing with self signed certificates.
+		 * @throw std::runtime_error  If the context could not be created.
+		 */
+		static std::shared_ptr<TlsContext> createClient( const std::string& verifyFile, bool verifyPeer=true );
+
+		~TlsContext();
+
+		/** @brief Creates a new session for the given socket. The caller owns the result and must SSL_free it.
+		 *
+		 * @param hostname  Client side only. If not empty, sent as the SNI name and checked against the server's certificate.
+		 */
+		SSL* createSession( int socket, bool isServer, const std::string& hostname=std::string() ) const;
+	protected:
+		explicit TlsContext( SSL_CTX* pContext );
+		TlsContext( const TlsContext& other ) = delete;
+		TlsContext& operator=( const TlsContext& other ) = delete;
+		SSL_CTX* pContext_;
+	};
+
+	/** @brief Returns the most recent OpenSSL error as a string, and clears the error queue. */
+	std::string lastTlsError();
+
+} // end of namespace clientserver
+
+#endif // end of "#ifndef INCLUDEGUARD_clientserver_TlsContext_h"
@@ -0,0 +1,131 @@
+#ifndef INCLUDEGUARD_clientserver_WebSocketClient_h
+#define INCLUDEGUARD_clientserver_WebSocketClient_h
+
+#include <string>
+#include <functional>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <cstdint>
+#include "clientserver/WebSocketFramer.h"
+#include "clientserver/MessageEnvelope.h"
+#include "clientserver/PerMessageDeflate.h"
+#include "clientserver/ZstdDictionaryCompressor.h"
+
+namespace clientserver
+{
+	/** @brief Simple blocking client for clientserver::WebSocketServer, used by the tests.
+	 *
+	 * Only plain ws:// connections are supported. Sending blocks until the message has been written
+	 * to the socket, and responses and info messages are handled on an internal receive thread.
+	 * clientserver::Client is the asynchronous one, with TLS and reconnecting, for everything else.
+	 *
+	 * @author Mark Grimes
+	 * @date 19/Oct/2026
+	 */
+	class WebSocketClient
+	{
+	public:
+		WebSocketClient();
+		~WebSocketClient();
+
+		void setDefaultInfoHandler( std::function<void(const std::string&)> infoHandler );
+		/** @brief Offer the permessage-deflate extension when connecting. Takes effect on the next connect(). */
+		void setCompression( const clientserver::PerMessageDeflate::Configuration& configuration );
+		/** @brief Offer these zstd dictionaries when connecting, most preferred first. Takes effect on the next connect().
+		 *
+		 * The server prefers a dictionary it also has over permessage-deflate, if both are offered.
+		 * @param threshold  Messages smaller than this are sent uncompressed.
+		 */
+		void setCompressionDictionaries( std::vector<std::shared_ptr<const clientserver::ZstdDictionary> > dictionaries, size_t threshold=clientserver::ZstdDictionaryCompressor::defaultThreshold );
+
+		/** @brief Connects and does the WebSocket handshake, returning once the connection is ready to use.
+		 *
+		 * @throw std::system_error   If the connection could not be made.
+		 * @throw std::runtime_error  If the server refused the WebSocket upgrade.
+		 */
+		void connect( const std::string& host, size_t port, const std::string& path="/" );
+		void disconnect();
+		bool isConnected();
+		/** @brief Whether the server agreed to compression when the connection was made. */
+		bool isCompressing() const;
+
+		/** @brief Sends a message that does not expect a response.
+		 * @throw std::runtime_error  If not connected.
+		 */
+		void sendInfo( const std::string& message );
+		/** @brief Sends a request, calling responseHandler from the receive thread when the response arrives.
+		 *
+		 * The response is empty if the server was too busy to run the request, see WebSocketServer::setAdmissionController().
+		 * @throw std::runtime_error  If not connected.
+		 */
+		void sendRequest( const std::string& message, std::function<void(const std::string&)> responseHandler );
+		/** @brief Versions that send the message in a binary frame, so it can contain any bytes. The response to a binary request is also binary. */
+		void sendBinaryInfo( const std::string& message );
+		void sendBinaryRequest( const std::string& message, std::function<void(const std::string&)> responseHandler );
+		/** @brief Sends a request that the server replies to in chunks, see clientserver::IResponseStream.
+		 *
+		 * chunkHandler is called for each chunk in order, then endHandler once with an empty string if the reply
+		 * finished successfully or the server's error message if not. Both are called from the receive thread.
+		 * @throw std::runtime_error  If not connected.
+		 */
+		void sendStreamingRequest( const std::string& message, std::function<void(const std::string&)> chunkHandler, std::function<void(const std::string&)> endHandler );
+		void sendBinaryStreamingRequest( const std::string& message, std::function<void(const std::string&)> chunkHandler, std::function<void(const std::string&)> endHandler );
+		/** @brief Sends several requests in one message, see clientserver::BatchEnvelope. The server can run them in parallel.
+		 *
+		 * responsesHandler is called from the receive thread once they have all finished, with the responses in the same
+		 * order as the requests.
+		 * @throw std::runtime_error  If not connected.
+		 */
+		void sendBatch( const std::vector<std::string>& messages, std::function<void(const std::vector<std::string>&)> responsesHandler );
+		/** @brief Sends several requests in one message, with the responses sent back as each one finishes.
+		 *
+		 * responseHandler is called with the index of the request and its response, in whatever order they finish,
+		 * then endHandler the same as for sendStreamingRequest().
+		 * @throw std::runtime_error  If not connected.
+		 */
+		void sendStreamingBatch( const std::vector<std::string>& messages, std::function<void(size_t,const std::string&)> responseHandler, std::function<void(const std::string&)> endHandler );
+		void sendBinaryBatch( const std::vector<std::string>& messages, std::function<void(const std::vector<std::string>&)> responsesHandler );
+		void sendBinaryStreamingBatch( const std::vector<std::string>& messages, std::function<void(size_t,const std::string&)> responseHandler, std::function<void(const std::string&)> endHandler );
+	protected:
+		WebSocketClient( const WebSocketClient& other ) = delete;
+		WebSocketClient& operator=( const WebSocketClient& other ) = delete;
+		void sendInfo( clientserver::WebSocketFramer::Opcode opcode, const std::string& message );
+		void sendRequest( clientserver::WebSocketFramer::Opcode opcode, const std::string& message, std::function<void(const std::string&)> responseHandler );
+		void sendStreamingRequest( clientserver::WebSocketFramer::Opcode opcode, const std::string& message, std::function<void(const std::string&)> chunkHandler, std::function<void(const std::string&)> endHandler );
+		void sendBatch( clientserver::WebSocketFramer::Opcode opcode, const std::vector<std::string>& messages, std::function<void(const std::vector<std::string>&)> responsesHandler );
+		void sendStreamingBatch( clientserver::WebSocketFramer::Opcode opcode, const std::vector<std::string>& messages, std::function<void(size_t,const std::string&)> responseHandler, std::function<void(const std::string&)> endHandler );
+		/** @brief Puts the envelope and the messages, with their indices as the sub-request ids, into one payload. */
+		static std::string encodeBatch( clientserver::MessageEnvelope::MessageType type, uint32_t id, const std::vector<std::string>& messages );
+		/** @brief Masks and writes one frame. Requires sendMutex_ to be locked. */
+		void sendFrame( clientserver::WebSocketFramer::Opcode opcode, const std::string& payload );
+		void receiveLoop( std::string initialData );
+
+		int socket_;
+		std::atomic<bool> connected_;
+		std::atomic<uint32_t> nextRequestId_;
+		std::function<void(const std::string&)> infoHandler_;
+		bool compressionEnabled_;
+		clientserver::PerMessageDeflate::Configuration compressionConfiguration_;
+		std::vector<std::shared_ptr<const clientserver::ZstdDictionary> > compressionDictionaries_;
+		size_t dictionaryThreshold_;
+		/** @brief Compresses while sendMutex_ is locked, and decompresses on the receive thread. There's no pool, so the two are independent. */
+		std::unique_ptr<clientserver::IMessageCompressor> pCompressor_;
+		std::mutex sendMutex_;
+		std::mt19937 maskGenerator_; ///< Protected by sendMutex_
+		std::string sendBuffer_;     ///< Protected by sendMutex_
+		std::string compressBuffer_; ///< Protected by sendMutex_
+		std::mutex responseHandlersMutex_;
+		std::unordered_map<uint32_t,std::function<void(const std::string&)> > responseHandlers_;
+		/** @brief The chunk and end handlers for each streaming request. Protected by responseHandlersMutex_. */
+		std::unordered_map<uint32_t,std::pair<std::function<void(const std::string&)>,std::function<void(const std::string&)> > > streamHandlers_;
+		std::thread receiveThread_;
+	};
+
+} // end of namespace clientserver
+
+#endif // end of "#ifndef INCLUDEGUARD_clientserver_WebSocketClient_h"
@@ -0,0 +1,99 @@
+#ifndef INCLUDEGUARD_clientserver_WebSocketFramer_h
+#define INCLUDEGUARD_clientserver_WebSocketFramer_h
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#include "clientserver/WebSocketKernels.h"
+
+//
+// Forward declarations
+//
+namespace clientserver
+{
+	class IMessageCompressor;
+}
+
+namespace clientserver
+{
+	/** @brief Encodes and decodes WebSocket frames (RFC 6455) for the in-tree WebSocket engine.
+	 *
+	 * Decoding works the same way as clientserver::BinaryFramer. Bytes are added as they arrive with
+	 * append() or reserve() and commit(), and complete messages are taken out with next(). Fragmented
+	 * messages are reassembled, so next() only ever gives complete text or binary messages, or single
+	 * control frames. Payloads are unmasked in place in the receive buffer, and text messages are
+	 * checked to be valid UTF-8, both using the vectorised kernels from WebSocketKernels.h.
+	 *
+	 * The only extensions supported are ones that compress messages, e.g. permessage-deflate. If
+	 * setCompressor() has been called, messages whose first frame has the RSV1 bit set are
+	 * decompressed before next() gives them out (and before the UTF-8 check). Any other reserved bits
+	 * are rejected.
+	 *
+	 * The receive buffer can be handed in and taken back out so that it can come from a pool, and
+	 * keep its capacity between connections.
+	 *
+	 * @author Mark Grimes
+	 * @date 19/Oct/2026
+	 */
+	class WebSocketFramer
+	{
+	public:
+		enum class Opcode : uint8_t { continuation=0x0, text=0x1, binary=0x2, close=0x8, ping=0x9, pong=0xa };
+		/** @brief Servers require every received frame to be masked, clients require that none are. */
+		enum class Role { server, client };
+
+		/** @brief Appends an encoded single frame message to the end of output.
+		 *
+		 * @param pMask  If not null the payload is masked with these 4 bytes, which clients have to do.
+		 */
+		static void encode( Opcode opcode, const char* pData, size_t size, std::string& output, const uint8_t* pMask=nullptr );
+		static void encode( Opcode opcode, const std::string& payload, std::string& output, const uint8_t* pMask=nullptr );
+		/** @brief Appends just the header of a single frame message, so that the payload can be appended in pieces.
+		 *
+		 * If pMask is given the payload appended afterwards has to be masked by the caller.
+		 * @param isCompressed  Sets the RSV1 bit, to say the payload has been compressed with permessage-deflate.
+		 */
+		static void encodeHeader( Opcode opcode, size_t payloadSize, std::string& output, const uint8_t* pMask=nullptr, bool isCompressed=false );
+		/** @brief Appends a close frame with the given status code (RFC 6455 section 7.4). */
+		static void encodeClose( uint16_t statusCode, std::string& output, const uint8_t* pMask=nullptr );
+
+		explicit WebSocketFramer( Role role, std::string buffer=std::string() );
+		/** @brief Messages larger than this, after reassembly, cause next() to throw. Default is 64MiB. */
+		void setMaximumMessageSize( size_t size );
+		/** @brief Accept compressed messages, decompressing them with this. Ownership is not taken, and null turns it off again. */
+		void setCompressor( clientserver::IMessageCompressor* pCompressor );
+
+		void append( const char* pData, size_t size );
+		/** @brief Returns a pointer to at least size bytes that can be written to, which must then be committed. */
+		char* reserve( size_t size );
+		/** @brief Marks size bytes from the last reserve() as received. */
+		void commit( size_t size );
+
+		/** @brief Takes the next complete message or control frame out of the buffer, or returns false if there isn't one yet.
+		 *
+		 * @throw std::length_error  If the message is larger than the maximum, before or after decompression. The connection should be closed with status 1009.
+		 * @throw std::runtime_error If the peer broke the protocol or sent invalid compressed data. The connection should be closed with status 1002.
+		 * @throw std::invalid_argument If a text message or close reason is not valid UTF-8. The connection should be closed with status 1007.
+		 */
+		bool next( Opcode& opcode, std::string& payload );
+
+		/** @brief The number of bytes received that haven't been taken out yet. */
+		size_t bufferedSize() const;
+		/** @brief Gives up the receive buffer, e.g. to return it to a pool. The framer should not be used afterwards. */
+		std::string releaseBuffer();
+	protected:
+		Role role_;
+		std::string buffer_;
+		size_t readPosition_;  ///< Start of the first byte not yet taken out by next()
+		size_t writePosition_; ///< End of the received data. buffer_ can be larger than this.
+		size_t maximumMessageSize_;
+		clientserver::IMessageCompressor* pCompressor_;
+		bool inFragmentedMessage_;
+		Opcode fragmentedOpcode_;
+		bool fragmentedIsCompressed_;
+		std::string fragmentedMessage_; ///< The fragments of a message received so far
+	};
+
+} // end of namespace clientserver
+
+#endif // end of "#ifndef INCLUDEGUARD_clientserver_WebSocketFramer_h"
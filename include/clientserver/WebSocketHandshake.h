@@ -0,0 +1,64 @@
+#ifndef INCLUDEGUARD_clientserver_WebSocketHandshake_h
+#define INCLUDEGUARD_clientserver_WebSocketHandshake_h
+
+#include <string>
+#include <functional>
+#include <vector>
+#include <utility>
+#include <cstddef>
+
+namespace clientserver
+{
+	/** @brief The HTTP upgrade that starts a WebSocket connection (RFC 6455 section 4), for both sides.
+	 *
+	 * @author Mark Grimes
+	 * @date 19/Oct/2026
+	 */
+	class WebSocketHandshake
+	{
+	public:
+		enum class Result { incomplete, upgrade, invalid };
+		/** @brief One entry of a Sec-WebSocket-Extensions header, with the names in lower case and any quotes taken off the values. */
+		struct Extension
+		{
+			std::string name;
+			std::vector<std::pair<std::string,std::string> > parameters;
+		};
+		/** @brief Requests larger than this are rejected, so that a client can't make the server buffer forever. */
+		static const size_t maximumRequestSize=8192;
+
+		/** @brief The value of the Sec-WebSocket-Accept header the server replies with for the given Sec-WebSocket-Key. */
+		static std::string acceptKey( const std::string& clientKey );
+		/** @brief Splits a Sec-WebSocket-Extensions header, e.g. "permessage-deflate; client_max_window_bits, x-other" (RFC 6455 section 9.1). */
+		static std::vector<Extension> parseExtensions( const std::string& header );
+
+		/** @brief Server side. Parses the client's HTTP request and creates the reply.
+		 *
+		 * @param requestSize  Set to the size of the request if it is complete. Anything after that is WebSocket data.
+		 * @param response     Set to what to send back. Either "101 Switching Protocols", or an HTTP error if
+		 *                     the result is "invalid", after which the connection should be closed.
+		 * @param negotiateExtensions  If set, called with the client's Sec-WebSocket-Extensions header (which can
+		 *                     be empty) to return the extensions that were agreed, for the reply.
+		 * @param pTarget      If not null, set to the path and query that were asked for, e.g. "/?session=", if the result
+		 *                     is "upgrade" or if the request was a plain GET. The latter is "invalid" with a 400 response,
+		 *                     which the caller can replace if it serves plain HTTP. Left untouched otherwise.
+		 */
+		static Result parseRequest( const char* pData, size_t size, size_t& requestSize, std::string& response,
+				const std::function<std::string(const std::string&)>& negotiateExtensions=nullptr, std::string* pTarget=nullptr );
+
+		/** @brief Client side. Creates the HTTP request, and sets "key" to the random Sec-WebSocket-Key used.
+		 *
+		 * @param extensions  If not empty, sent as the Sec-WebSocket-Extensions header.
+		 */
+		static std::string createRequest( const std::string& host, const std::string& path, std::string& key, const std::string& extensions=std::string() );
+		/** @brief Client side. Parses the server's reply to createRequest().
+		 *
+		 * @param responseSize  Set to the size of the response if it is complete. Anything after that is WebSocket data.
+		 * @param pExtensions   If not null, set to the Sec-WebSocket-Extensions header the server replied with.
+		 */
+		static Result parseResponse( const char* pData, size_t size, const std::string& key, size_t& responseSize, std::string* pExtensions=nullptr );
+	};
+
+} // end of namespace clientserver
+
+#endif // end of "#ifndef INCLUDEGUARD_clientserver_WebSocketHandshake_h"
@@ -0,0 +1,38 @@
+#ifndef INCLUDEGUARD_clientserver_WebSocketKernels_h
+#define INCLUDEGUARD_clientserver_WebSocketKernels_h
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace clientserver
+{
+	/** @brief The different implementations of the WebSocket payload kernels.
+	 *
+	 * The SSE2 and AVX2 versions are compiled in regardless of the compiler flags, and the best one
+	 * the CPU supports is picked the first time a kernel is called.
+	 */
+	enum class InstructionSet { generic, sse2, avx2 };
+
+	/** @brief The instruction sets that can be used on this CPU, always starting with "generic" and ending with the fastest. */
+	std::vector<InstructionSet> supportedInstructionSets();
+	const char* instructionSetName( InstructionSet instructionSet );
+
+	/** @brief XORs the data with the 4 byte WebSocket masking key, as described in RFC 6455 section 5.3.
+	 *
+	 * @param maskOffset  How far through the mask the first byte is, for when a payload is unmasked in pieces.
+	 */
+	void applyWebSocketMask( char* pData, size_t size, const uint8_t mask[4], size_t maskOffset=0 );
+	/** @brief Checks the data is valid UTF-8 (RFC 3629), i.e. no overlong encodings, surrogates or code points above U+10FFFF. */
+	bool isValidUtf8( const char* pData, size_t size );
+
+	/** @brief Versions that use a specific implementation, for tests and benchmarks.
+	 *
+	 * @throw std::invalid_argument  If the instruction set is not supported by this CPU.
+	 */
+	void applyWebSocketMask( InstructionSet instructionSet, char* pData, size_t size, const uint8_t mask[4], size_t maskOffset=0 );
+	bool isValidUtf8( InstructionSet instructionSet, const char* pData, size_t size );
+
+} // end of namespace clientserver
+
+#endif // end of "#ifndef INCLUDEGUARD_clientserver_WebSocketKernels_h"
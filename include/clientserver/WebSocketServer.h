@@ -0,0 +1,289 @@
+#ifndef INCLUDEGUARD_clientserver_WebSocketServer_h
+#define INCLUDEGUARD_clientserver_WebSocketServer_h
+
+#include <string>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <chrono>
+#include "clientserver/IConnection.h"
+#include "clientserver/IResponseStream.h"
+#include "clientserver/PerMessageDeflate.h"
+#include "clientserver/ZstdDictionaryCompressor.h"
+
+//
+// Forward declarations
+//
+namespace clientserver
+{
+	class TlsContext;
+	class HandlerPool;
+	class ConnectionRegistry;
+	class RateLimiter;
+	class AdmissionController;
+}
+
+namespace clientserver
+{
+	/** @brief In-tree WebSocket server, as an alternative to communique::Server that can be tuned.
+	 *
+	 * Runs one edge triggered epoll loop per thread, by default one per core. All of the loops wait on
+	 * the one listening socket (with EPOLLEXCLUSIVE so that only one wakes up for each connection) and
+	 * each connection then stays on the loop that accepted it. Handlers are called on that loop's
+	 * thread, so they can be called concurrently for different connections. Connection buffers come
+	 * from a pool for each loop so that connecting clients don't have to allocate.
+	 *
+	 * The interface mirrors communique::Server so that the same handlers can be used. Inside each
+	 * WebSocket message the request id is carried as described in clientserver::MessageEnvelope.
+	 * Plain HTTP requests are only served if setFileServeRoot() has been called.
+	 *
+	 * If setCompression() is called, clients that offer permessage-deflate (which all browsers do) get
+	 * messages at or above the threshold compressed. Each loop has a pool of zlib streams, so that
+	 * connections without context takeover only hold one while a message is being processed. Native
+	 * clients can instead use a zstd dictionary trained on the application's traffic, see
+	 * setCompressionDictionaries().
+	 *
+	 * Requests whose replies are too large to build in one go can be sent as streaming requests, which
+	 * go to the handler set with setDefaultStreamingRequestHandler(). That writes the reply in chunks
+	 * to a clientserver::IResponseStream, which is flow controlled so that a slow client can't make
+	 * the server buffer the whole result.
+	 *
+	 * Clients can also send many requests in one batch message (see clientserver::BatchEnvelope), which
+	 * saves the framing, system calls and round trips of sending them one by one. The sub-requests go
+	 * to the normal request handlers, but run in parallel on a pool of handler threads rather than on
+	 * the event loop, so the handlers have to be thread safe. The responses come back either all
+	 * together or streamed as each one finishes.
+	 *
+	 * Normally the requests from each connection are handled one at a time, in order, on its event
+	 * loop. With setConcurrentRequests() they go to the same pool as batches, so that a slow request
+	 * doesn't hold up the ones that the client has pipelined behind it. The responses then go back
+	 * as each one finishes, and clients match them to the requests with the request id.
+	 *
+	 * Clients can open logical channels on one connection, each with a priority and a window of
+	 * credit (see clientserver::MessageEnvelope), rather than opening more connections to stop bulk
+	 * transfers holding up interactive commands. Replies to messages sent on a channel go back on it,
+	 * cut into fragments by a clientserver::ChannelScheduler, and only one fragment at a time goes into
+	 * the output buffer. The highest priority channel with credit goes next, and messages that aren't
+	 * on a channel go before all of them. Once a client opens a channel TCP_NOTSENT_LOWAT is set on its
+	 * socket, so that there isn't a socket buffer full of one channel in the way of the others either.
+	 *
+	 * With setSessionResumption() clients that drop and reconnect can carry on where they left off,
+	 * rather than losing everything in flight and having to resynchronise. See clientserver::Client.
+	 *
+	 * On machines with more than one NUMA node, setNumaPlacement() or setCpuAffinity() keep each event
+	 * loop on one CPU, with a pool of batch threads on the same node. Connection buffers come from
+	 * the loop's own pool and are first touched on its thread, so they're allocated on its node and
+	 * requests don't cross between nodes while they're handled. See clientserver::CpuTopology.
+	 *
+	 * @author Mark Grimes
+	 * @date 19/Oct/2026
+	 */
+	class WebSocketServer
+	{
+	public:
+		WebSocketServer();
+		~WebSocketServer();
+
+		void setCertificateChainFile( const std::string& filename );
+		void setPrivateKeyFile( const std::string& filename );
+		/** @brief The number of event loops to run. Must be called before listen(). Zero, the default, means one for each core. */
+		void setNumberOfThreads( size_t numberOfThreads );
+		void setDefaultRequestHandler( std::function<std::string(const std::string&,std::weak_ptr<clientserver::IConnection>)> requestHandler );
+		void setDefaultInfoHandler( std::function<void(const std::string&,std::weak_ptr<clientserver::IConnection>)> infoHandler );
+		/** @brief Handlers for messages that arrive in binary frames, e.g. serialised protobuf. Responses are sent back as binary frames.
+		 *
+		 * Text messages have to be checked for valid UTF-8 as they arrive, but binary ones skip that and
+		 * can carry any bytes. If these aren't set, binary messages go to the default handlers.
+		 */
+		void setDefaultBinaryRequestHandler( std::function<std::string(const std::string&,std::weak_ptr<clientserver::IConnection>)> requestHandler );
+		void setDefaultBinaryInfoHandler( std::function<void(const std::string&,std::weak_ptr<clientserver::IConnection>)> infoHandler );
+		/** @brief Handler for streaming requests, in both text and binary frames. Chunks are sent in the same type of frame as the request.
+		 *
+		 * The handler can return before the reply has finished, and carry on writing from the stream's
+		 * writable handler or another thread. If the handler throws before finishing, the exception
+		 * message is sent as the error. Without this handler streaming requests fail straight away.
+		 */
+		void setDefaultStreamingRequestHandler( std::function<void(const std::string&,std::shared_ptr<clientserver::IResponseStream>,std::weak_ptr<clientserver::IConnection>)> streamingRequestHandler );
+		/** @brief How much unsent data a connection can have before IResponseStream::write() returns false. Default is 256KiB. */
+		void setStreamBufferSize( size_t streamBufferSize );
+		/** @brief The number of threads that run the sub-requests of batches. Must be called before listen(). Zero, the default, means one for each core. */
+		void setNumberOfBatchThreads( size_t numberOfBatchThreads );
+		/** @brief Run requests on the batch threads instead of the event loop, so that they can finish out of order. Must be called before listen().
+		 *
+		 * The request handlers have to be thread safe. Responses sent from the batch threads are never
+		 * compressed, for the same reason as IConnection::sendInfo() from other threads. Info messages
+		 * and streaming requests are still handled on the event loop.
+		 */
+		void setConcurrentRequests( bool concurrentRequests );
+		/** @brief Accept the permessage-deflate extension (RFC 7692) from clients that offer it. Must be called before listen().
+		 *
+		 * Context takeover can also be turned off for each connection by the client's offer. Messages sent
+		 * with IConnection::sendInfo() from threads other than the connection's loop are never compressed,
+		 * because the compressor can only be used from the loop's thread.
+		 */
+		void setCompression( const clientserver::PerMessageDeflate::Configuration& configuration );
+		/** @brief Accept clients that offer one of these dictionaries, see clientserver::ZstdDictionaryCompressor. Must be called before listen().
+		 *
+		 * If a client offers both, a matching dictionary is used in preference to permessage-deflate.
+		 * @param threshold  Messages smaller than this are sent uncompressed.
+		 */
+		void setCompressionDictionaries( std::vector<std::shared_ptr<const clientserver::ZstdDictionary> > dictionaries, size_t threshold=clientserver::ZstdDictionaryCompressor::defaultThreshold );
+		/** @brief Give clients that ask for one a session, which they can resume if the connection drops. Must be called before listen().
+		 *
+		 * A client asks for a session with "session=" in the query of the url it connects to, and is sent a
+		 * token for it straight after the upgrade (see clientserver::MessageEnvelope). Messages are counted
+		 * in both directions, and each side keeps what it has sent until the other acknowledges it. If the
+		 * client reconnects with "session=<token>&received=<count>" within lingerTime, the server replays
+		 * the messages the client missed and tells it how many of its own arrived, so that it can send the
+		 * rest again. Handlers, streams and batches that still hold the old connection carry on over the
+		 * new one. If the session has gone, or more than replayBufferSize messages were waiting to be
+		 * acknowledged, the client gets a new session instead and has to start again.
+		 *
+		 * @param replayBufferSize  The most unacknowledged messages kept for each client. Zero, the default, turns sessions off.
+		 */
+		void setSessionResumption( size_t replayBufferSize, std::chrono::milliseconds lingerTime=std::chrono::seconds(30) );
+		/** @brief Serves plain HTTP GET requests with the files in the directory, the same as communique::Server. Nothing is served by default.
+		 *
+		 * Meant for the client code rather than as a general web server: each file is read whole on the
+		 * event loop and the connection is closed after it has been sent. The Content-Type comes from the
+		 * file extension, so that WebAssembly gets "application/wasm" and browsers can compile it while
+		 * it downloads. Paths with ".." in are refused.
+		 */
+		void setFileServeRoot( const std::string& directory );
+		/** @brief Let other sockets listen on the same port, so that several processes can share it. Must be called before listen().
+		 *
+		 * Sets SO_REUSEPORT, so the kernel spreads new connections over all the sockets listening on the
+		 * port. The sockets have to belong to the same user, and each one needs this set. Sessions are
+		 * only known to the process that made them, so a client can't resume on a different one.
+		 */
+		void setReusePort( bool reusePort );
+		/** @brief Spreads the event loops over the NUMA nodes, each with batch threads on the same node. Must be called before listen(). Off by default.
+		 *
+		 * Each event loop is pinned to a CPU, and each node with event loops gets its own pool of batch
+		 * threads which those loops post to. The batch threads are shared out between the pools. See
+		 * clientserver::CpuTopology::placeByNode().
+		 */
+		void setNumaPlacement( bool numaPlacement );
+		/** @brief Pins the event loops and batch threads to the given CPUs instead, e.g. from CpuTopology::parseCpuList(). Must be called before listen().
+		 *
+		 * Event loops take the eventLoopCpus in turn, one each. Batch threads on the same node share a
+		 * pool pinned to the handlerCpus on that node, and event loops post to the pool on their own node
+		 * if there is one. Either list can be empty to leave those threads unpinned. Overrides
+		 * setNumaPlacement(), and listen() throws std::invalid_argument if this process can't use the CPUs.
+		 */
+		void setCpuAffinity( const std::vector<int>& eventLoopCpus, const std::vector<int>& handlerCpus );
+		/** @brief Adds connections to this registry instead of the server's own, e.g. to share one between servers. Must be called before listen(). */
+		void setConnectionRegistry( std::shared_ptr<clientserver::ConnectionRegistry> pConnectionRegistry );
+		/** @brief Every connection that has finished its handshake and not yet closed, see clientserver::ConnectionRegistry.
+		 *
+		 * Can be enumerated from any thread without holding up the event loops, e.g. to broadcast with
+		 * ConnectionRegistry::broadcastInfo().
+		 */
+		const std::shared_ptr<clientserver::ConnectionRegistry>& connectionRegistry() const;
+		/** @brief Checks every message against the limiter before it goes to a handler, see clientserver::RateLimiter. Must be called before listen(). None by default.
+		 *
+		 * The same limiter can be given to other servers, so that the per address limits cover all of them.
+		 */
+		void setRateLimiter( std::shared_ptr<clientserver::RateLimiter> pRateLimiter );
+		/** @brief Sheds work that has waited too long for a batch thread, see clientserver::AdmissionController. Must be called before listen(). None by default.
+		 *
+		 * Only covers what goes to the batch threads, i.e. batches and, with setConcurrentRequests(),
+		 * plain requests. Batches are low priority, so new ones are turned away as soon as the queue is
+		 * overloaded. Requests and batches that are shed get an x<id>: reply with how long to wait
+		 * before trying again (see clientserver::MessageEnvelope), and streamed batches end with an
+		 * error saying the same.
+		 */
+		void setAdmissionController( std::shared_ptr<clientserver::AdmissionController> pAdmissionController );
+
+		/** @brief Starts accepting connections on the given port, and returns straight away.
+		 *
+		 * @param port  If zero, the operating system picks a free port which can be found with port().
+		 * @throw std::system_error   If the socket or event loops could not be created.
+		 * @throw std::runtime_error  If TLS was requested but the certificate or key could not be loaded.
+		 */
+		void listen( size_t port );
+		/** @brief Starts accepting connections on a socket that is already listening, and returns straight away.
+		 *
+		 * For a socket handed over from another process with clientserver::SocketHandover, so that there's
+		 * no moment when the port is closed. Takes ownership of the socket, even if this throws.
+		 * @throw std::invalid_argument  If the socket isn't a listening IPv6 TCP socket, as listen() would make.
+		 * @throw std::system_error      If the socket can't be used or the event loops could not be created.
+		 * @throw std::runtime_error     If TLS was requested but the certificate or key could not be loaded.
+		 */
+		void listenOnSocket( int socket );
+		/** @brief The listening socket, e.g. to hand over to another process. Still owned by this server, and -1 if not listening. */
+		int listenSocket() const;
+		/** @brief The port being listened on. */
+		size_t port() const;
+		/** @brief Stops accepting new connections but carries on serving the existing ones, e.g. after handing the socket over.
+		 *
+		 * The socket stays open until stop(), but this process no longer takes connections from it.
+		 */
+		void stopAccepting();
+		/** @brief Stops accepting, and closes each connection once it has nothing left to do. Returns straight away.
+		 *
+		 * Every client is sent a go away message ("g0:") first, after which clients send new requests over
+		 * a new connection, i.e. to whichever process is now accepting. Requests still being handled carry
+		 * on, and each connection is closed with status 1001 once all of its responses have been written.
+		 * Wait for currentConnections() to drop to zero, up to whatever deadline, before calling stop().
+		 */
+		void drain();
+
+		/** @brief Closes all connections and stops listening. Blocks until all threads have finished. */
+		void stop();
+
+		/** @brief The number of clients currently connected, over all of the event loops. */
+		size_t currentConnections() const;
+	protected:
+		class Connection;
+		class EventLoop;
+		class ResponseStream;
+		class Batch;
+		class ResumableSession;
+		WebSocketServer( const WebSocketServer& other ) = delete;
+		WebSocketServer& operator=( const WebSocketServer& other ) = delete;
+		/** @brief Moves the session with the given token to the connection, or starts a new session if it can't be resumed. From any loop thread. */
+		std::shared_ptr<ResumableSession> attachSession( const std::string& token, uint32_t clientReceived, const std::shared_ptr<Connection>& pConnection );
+		/** @brief Creates and starts the event loops once listenSocket_ is set, closing it again if that fails. */
+		void startEventLoops();
+
+		std::string certificateChainFile_;
+		std::string privateKeyFile_;
+		size_t numberOfThreads_;
+		std::shared_ptr<clientserver::TlsContext> pTlsContext_;
+		int listenSocket_;
+		size_t port_;
+		std::function<std::string(const std::string&,std::weak_ptr<clientserver::IConnection>)> requestHandler_;
+		std::function<void(const std::string&,std::weak_ptr<clientserver::IConnection>)> infoHandler_;
+		std::function<std::string(const std::string&,std::weak_ptr<clientserver::IConnection>)> binaryRequestHandler_;
+		std::function<void(const std::string&,std::weak_ptr<clientserver::IConnection>)> binaryInfoHandler_;
+		std::function<void(const std::string&,std::shared_ptr<clientserver::IResponseStream>,std::weak_ptr<clientserver::IConnection>)> streamingRequestHandler_;
+		size_t streamBufferSize_;
+		size_t numberOfBatchThreads_;
+		bool concurrentRequests_;
+		bool numaPlacement_;
+		std::vector<int> eventLoopCpus_;
+		std::vector<int> handlerCpus_;
+		std::vector<std::unique_ptr<clientserver::HandlerPool> > handlerPools_; ///< Usually one, unless the threads are placed on NUMA nodes
+		bool compressionEnabled_;
+		clientserver::PerMessageDeflate::Configuration compressionConfiguration_;
+		std::vector<std::shared_ptr<const clientserver::ZstdDictionary> > compressionDictionaries_;
+		size_t dictionaryThreshold_;
+		size_t sessionReplayBufferSize_;
+		std::chrono::milliseconds sessionLingerTime_;
+		std::string fileServeRoot_;
+		bool reusePort_;
+		std::shared_ptr<clientserver::ConnectionRegistry> pConnectionRegistry_;
+		std::shared_ptr<clientserver::RateLimiter> pRateLimiter_; ///< Null if messages aren't limited
+		std::shared_ptr<clientserver::AdmissionController> pAdmissionController_; ///< Null if nothing is shed
+		std::mutex sessionsMutex_;
+		std::unordered_map<std::string,std::shared_ptr<ResumableSession> > sessions_; ///< Protected by sessionsMutex_
+		std::chrono::steady_clock::time_point lastSessionSweep_; ///< When expired sessions were last removed, protected by sessionsMutex_
+		std::vector<std::unique_ptr<EventLoop> > eventLoops_;
+	};
+
+} // end of namespace clientserver
+
+#endif // end of "#ifndef INCLUDEGUARD_clientserver_WebSocketServer_h"
@@ -0,0 +1,77 @@
+#ifndef INCLUDEGUARD_clientserver_ZstdDictionary_h
+#define INCLUDEGUARD_clientserver_ZstdDictionary_h
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <iosfwd>
+#include <cstddef>
+#include <cstdint>
+
+//
+// Forward declarations
+//
+struct ZSTD_CDict_s;
+struct ZSTD_DDict_s;
+
+namespace clientserver
+{
+	/** @brief A zstd dictionary trained on captured messages, ready to compress and decompress with.
+	 *
+	 * Small messages don't have enough in them for a compressor to find repeats, so on their own they
+	 * barely compress. A dictionary holds the strings that turn up in typical messages, so that even a
+	 * 100 byte message can refer to them. Dictionaries are trained offline with train() (or the
+	 * "traindict" command) from a capture of real traffic, and both ends have to load the same one.
+	 * The dictionary id is what is agreed when a connection opens, see ZstdDictionaryCompressor.
+	 *
+	 * The digested versions for compressing and decompressing are made once when the dictionary is
+	 * loaded, and can be used from any number of threads at once.
+	 *
+	 * @author Mark Grimes
+	 * @date 19/Oct/2026
+	 */
+	class ZstdDictionary
+	{
+	public:
+		/** @brief
+		 * @param contents  A dictionary in the zstd format, as made by train().
+		 * @param level     The zstd compression level to compress with. Default 3, higher is slower.
+		 * @throw std::runtime_error  If the contents are not a zstd dictionary with an id.
+		 */
+		explicit ZstdDictionary( std::string contents, int level=3 );
+		~ZstdDictionary();
+		/** @brief Reads a dictionary from a file. @throw std::runtime_error  If the file can't be read or isn't a dictionary. */
+		static std::shared_ptr<ZstdDictionary> load( const std::string& filename, int level=3 );
+
+		/** @brief The id stored in the dictionary, which is random unless set when training. */
+		uint32_t id() const;
+		const std::string& contents() const;
+		int level() const;
+		ZSTD_CDict_s* compressionDictionary() const;
+		ZSTD_DDict_s* decompressionDictionary() const;
+
+		/** @brief Trains a dictionary from example messages, returning its contents.
+		 *
+		 * zstd suggests there should be about 100 times as much sample data as the dictionary size.
+		 * @throw std::runtime_error  If training failed, e.g. because there weren't enough samples.
+		 */
+		static std::string train( const std::vector<std::string>& samples, size_t maximumSize );
+
+		/** @brief Appends a message to a capture file, which is each message with a 4 byte big endian length in front. */
+		static void writeSample( std::ostream& output, const std::string& sample );
+		/** @brief Reads all of the messages from a capture file. @throw std::runtime_error  If the file is truncated. */
+		static std::vector<std::string> readSamples( std::istream& input );
+	protected:
+		ZstdDictionary( const ZstdDictionary& other ) = delete;
+		ZstdDictionary& operator=( const ZstdDictionary& other ) = delete;
+
+		std::string contents_;
+		int level_;
+		uint32_t id_;
+		ZSTD_CDict_s* pCompressionDictionary_;
+		ZSTD_DDict_s* pDecompressionDictionary_;
+	};
+
+} // end of namespace clientserver
+
+#endif // end of "#ifndef INCLUDEGUARD_clientserver_ZstdDictionary_h"
@@ -0,0 +1,76 @@
+#ifndef INCLUDEGUARD_clientserver_ZstdDictionaryCompressor_h
+#define INCLUDEGUARD_clientserver_ZstdDictionaryCompressor_h
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include "clientserver/IMessageCompressor.h"
+
+//
+// Forward declarations
+//
+namespace clientserver
+{
+	class ZstdDictionary;
+}
+
+namespace clientserver
+{
+	/** @brief Compresses each WebSocket message on its own with zstd and a pre-trained dictionary.
+	 *
+	 * Used as an alternative to permessage-deflate for native clients that have been given the same
+	 * dictionary file as the server. The client offers the dictionaries it has in the upgrade request,
+	 * as one "x-clientserver-zstd; dictionary_id=<id>" entry in Sec-WebSocket-Extensions for each,
+	 * and the server replies with the first one it also has. Compressed messages are single zstd
+	 * frames in frames with the RSV1 bit set, the same as permessage-deflate, but with the dictionary
+	 * id and checksum left out since both ends already know them.
+	 *
+	 * There's no state kept between messages, and the zstd contexts belong to the thread, so an idle
+	 * connection costs nothing beyond this object. Browsers can't add WebSocket extensions, so this is
+	 * only used by the native clients.
+	 *
+	 * @author Mark Grimes
+	 * @date 19/Oct/2026
+	 */
+	class ZstdDictionaryCompressor : public clientserver::IMessageCompressor
+	{
+	public:
+		/** @brief The token used in the Sec-WebSocket-Extensions header. */
+		static const char* const extensionName;
+		/** @brief Messages smaller than this aren't worth the 6 or so bytes of zstd frame header. */
+		static const size_t defaultThreshold=32;
+
+		/** @brief Client side, the value for the Sec-WebSocket-Extensions header offering these dictionaries, most preferred first. */
+		static std::string createOffer( const std::vector<std::shared_ptr<const clientserver::ZstdDictionary> >& dictionaries );
+		/** @brief Server side, finds the first dictionary offered by the client that the server also has.
+		 *
+		 * @param response  Set to the value for the Sec-WebSocket-Extensions header of the reply.
+		 * @return          The dictionary, or null if the client didn't offer any that the server has.
+		 */
+		static std::shared_ptr<const clientserver::ZstdDictionary> acceptOffer( const std::string& offers,
+				const std::vector<std::shared_ptr<const clientserver::ZstdDictionary> >& dictionaries, std::string& response );
+		/** @brief Client side, checks the server's Sec-WebSocket-Extensions header.
+		 *
+		 * @return  The dictionary the server picked, or null if the server didn't agree to this extension.
+		 * @throw std::runtime_error  If the server picked a dictionary that wasn't offered. The connection should be failed.
+		 */
+		static std::shared_ptr<const clientserver::ZstdDictionary> acceptResponse( const std::string& response,
+				const std::vector<std::shared_ptr<const clientserver::ZstdDictionary> >& dictionaries );
+
+		ZstdDictionaryCompressor( std::shared_ptr<const clientserver::ZstdDictionary> pDictionary, size_t threshold=defaultThreshold );
+
+		virtual bool shouldCompress( size_t size ) const override;
+		/** @brief All the parts of one message have to be given one after the other from the same thread. */
+		virtual void compress( const char* pData, size_t size, std::string& output, bool isLastPart=true ) override;
+		virtual void decompress( const char* pData, size_t size, std::string& output, size_t maximumSize ) override;
+
+		const clientserver::ZstdDictionary& dictionary() const;
+	protected:
+		std::shared_ptr<const clientserver::ZstdDictionary> pDictionary_;
+		size_t threshold_;
+	};
+
+} // end of namespace clientserver
+
+#endif // end of "#ifndef INCLUDEGUARD_clientserver_ZstdDictionaryCompressor_h"
@@ -42,6 +42,16 @@ namespace tools
 	};
 } // end of the tools namespace
 
+namespace tools
+{
+	/** @brief Converts the last argument given for the option to a non-negative integer.
+	 *
+	 * Saves every command having to do its own conversion and error checking for numeric options.
+	 * @throw std::runtime_error     If the argument is not a non-negative integer, with a message suitable for the user.
+	 */
+	size_t parseSizeOption( const tools::CommandLineParser& commandLineParser, const std::string& optionName );
+}
+
 //
 // Functions/structs required to get automatic conversion of CommandLineParser::error
 // to std::error_code. For more information on this see
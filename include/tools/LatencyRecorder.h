@@ -0,0 +1,35 @@
+#ifndef INCLUDEGUARD_tools_LatencyRecorder_h
+#define INCLUDEGUARD_tools_LatencyRecorder_h
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace tools
+{
+	/** @brief Simple class to collect latency measurements for the benchmarking commands and report percentiles.
+	 *
+	 * Every measurement is stored, so this is only intended for benchmarks where the number of
+	 * samples is known to be reasonable (a few million is fine). Not thread safe.
+	 *
+	 * @author Mark Grimes
+	 * @date 19/Oct/2026
+	 */
+	class LatencyRecorder
+	{
+	public:
+		void reserve( size_t numberOfSamples );
+		void record( uint64_t nanoseconds );
+		size_t count() const;
+		uint64_t mean() const;
+		uint64_t maximum() const;
+		/** @brief The value below which the given fraction of samples lie, e.g. percentile(0.99) for p99. Returns zero if there are no samples. */
+		uint64_t percentile( double fraction ) const;
+	protected:
+		mutable std::vector<uint64_t> samples_;
+		mutable bool sorted_=true;
+	};
+
+} // end of namespace tools
+
+#endif // end of "#ifndef INCLUDEGUARD_tools_LatencyRecorder_h"
@@ -0,0 +1,98 @@
+#include "clientserver/AdmissionController.h"
+
+#include <stdexcept>
+#include <limits>
+
+namespace // Unnamed namespace for things only used in this file
+{
+	/** @brief Lowers the value to the delay if it's smaller, even if other threads are doing the same. */
+	void lowerTo( std::atomic<int64_t>& value, int64_t delay )
+	{
+		int64_t current=value.load( std::memory_order_relaxed );
+		while( delay<current && !value.compare_exchange_weak( current, delay, std::memory_order_relaxed ) ) {}
+	}
+} // end of the unnamed namespace
+
+const size_t clientserver::AdmissionController::numberOfPriorities;
+
+clientserver::AdmissionController::AdmissionController()
+	: AdmissionController( Configuration{ std::chrono::milliseconds(5), std::chrono::milliseconds(100) } )
+{
+	// No operation besides the initialiser list
+}
+
+clientserver::AdmissionController::AdmissionController( const Configuration& configuration )
+	: configuration_(configuration),
+	  target_( std::chrono::duration_cast<std::chrono::nanoseconds>(configuration.target).count() ),
+	  interval_( std::chrono::duration_cast<std::chrono::nanoseconds>(configuration.interval).count() ),
+	  intervalEnd_(0), minimumDelay_( std::numeric_limits<int64_t>::max() ), overloaded_(false)
+{
+	if( target_<=0 ) throw std::invalid_argument( "AdmissionController needs a target delay greater than zero" );
+	if( interval_<target_ ) throw std::invalid_argument( "AdmissionController needs an interval at least as long as the target delay" );
+	for( auto& shed : shed_ ) shed=0;
+}
+
+int64_t clientserver::AdmissionController::now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+bool clientserver::AdmissionController::admit( Priority priority )
+{
+	if( priority==Priority::low && isOverloaded( now() ) ) return reject( priority );
+	return true;
+}
+
+bool clientserver::AdmissionController::start( int64_t queuedAt, Priority priority )
+{
+	const int64_t currentTime=now();
+	const int64_t delay=( currentTime>queuedAt ? currentTime-queuedAt : 0 );
+
+	int64_t intervalEnd=intervalEnd_.load( std::memory_order_acquire );
+	if( currentTime>=intervalEnd && intervalEnd_.compare_exchange_strong( intervalEnd, currentTime+interval_, std::memory_order_acq_rel ) )
+	{
+		// Only the thread that moved the interval on gets here, and this task is the first of the new one
+		const int64_t minimumDelay=minimumDelay_.exchange( delay, std::memory_order_relaxed );
+		// If nothing came off the queue for a whole interval it must have been empty, however long the last task waited
+		overloaded_.store( intervalEnd!=0 && currentTime<intervalEnd+interval_ && minimumDelay>target_, std::memory_order_release );
+	}
+	else ::lowerTo( minimumDelay_, delay );
+
+	if( !overloaded_.load( std::memory_order_acquire ) ) return true;
+	// Low priority work gives way first, but anything that has waited this long is already late
+	if( delay<=( priority==Priority::low ? target_ : 2*target_ ) ) return true;
+	return reject( priority );
+}
+
+bool clientserver::AdmissionController::isOverloaded() const
+{
+	return isOverloaded( now() );
+}
+
+uint64_t clientserver::AdmissionController::shed( Priority priority ) const
+{
+	return shed_[static_cast<size_t>(priority)].load( std::memory_order_relaxed );
+}
+
+std::chrono::milliseconds clientserver::AdmissionController::retryAfter() const
+{
+	// Rounded up, so that a client doesn't retry straight away with a sub millisecond interval
+	return std::chrono::milliseconds( (interval_+999999)/1000000 );
+}
+
+const clientserver::AdmissionController::Configuration& clientserver::AdmissionController::configuration() const
+{
+	return configuration_;
+}
+
+bool clientserver::AdmissionController::isOverloaded( int64_t now ) const
+{
+	// Stale once the interval has finished without another task coming off the queue to start the next one
+	return overloaded_.load( std::memory_order_acquire ) && now<intervalEnd_.load( std::memory_order_acquire );
+}
+
+bool clientserver::AdmissionController::reject( Priority priority )
+{
+	shed_[static_cast<size_t>(priority)].fetch_add( 1, std::memory_order_relaxed );
+	return false;
+}
@@ -0,0 +1,100 @@
+#include "clientserver/ArenaBlockPool.h"
+
+#include <new>
+
+namespace
+{
+	void* allocateFromThreadPool( size_t size )
+	{
+		return clientserver::ArenaBlockPool::threadPool().allocate( size );
+	}
+
+	void deallocateToThreadPool( void* pBlock, size_t size )
+	{
+		clientserver::ArenaBlockPool::threadPool().deallocate( pBlock, size );
+	}
+} // end of the unnamed namespace
+
+clientserver::ArenaBlockPool::ArenaBlockPool( size_t maximumPooledBytes )
+	: maximumPooledBytes_(maximumPooledBytes), pooledBytes_(0), allocations_(0), systemAllocations_(0)
+{
+	// No operation besides the initialiser list
+}
+
+clientserver::ArenaBlockPool::~ArenaBlockPool()
+{
+	for( auto& blocks : freeBlocks_ )
+	{
+		for( void* pBlock : blocks ) ::operator delete( pBlock );
+	}
+}
+
+size_t clientserver::ArenaBlockPool::sizeShift( size_t size )
+{
+	size_t shift=minimumSizeShift;
+	while( shift<=maximumSizeShift && (size_t(1)<<shift)<size ) ++shift;
+	return shift;
+}
+
+void* clientserver::ArenaBlockPool::allocate( size_t size )
+{
+	++allocations_;
+	const size_t shift=sizeShift( size );
+	if( shift<=maximumSizeShift )
+	{
+		std::vector<void*>& blocks=freeBlocks_[shift-minimumSizeShift];
+		if( !blocks.empty() )
+		{
+			void* pBlock=blocks.back();
+			blocks.pop_back();
+			pooledBytes_-=size_t(1)<<shift;
+			return pBlock;
+		}
+		// Always allocate the whole size class, so the block can be reused for anything in the same class
+		size=size_t(1)<<shift;
+	}
+	++systemAllocations_;
+	return ::operator new( size );
+}
+
+void clientserver::ArenaBlockPool::deallocate( void* pBlock, size_t size )
+{
+	const size_t shift=sizeShift( size );
+	if( shift<=maximumSizeShift && pooledBytes_+(size_t(1)<<shift)<=maximumPooledBytes_ )
+	{
+		freeBlocks_[shift-minimumSizeShift].push_back( pBlock );
+		pooledBytes_+=size_t(1)<<shift;
+	}
+	else ::operator delete( pBlock );
+}
+
+size_t clientserver::ArenaBlockPool::pooledBytes() const
+{
+	return pooledBytes_;
+}
+
+size_t clientserver::ArenaBlockPool::allocations() const
+{
+	return allocations_;
+}
+
+size_t clientserver::ArenaBlockPool::systemAllocations() const
+{
+	return systemAllocations_;
+}
+
+clientserver::ArenaBlockPool& clientserver::ArenaBlockPool::threadPool()
+{
+	static thread_local ArenaBlockPool pool( 4*1024*1024 );
+	return pool;
+}
+
+google::protobuf::ArenaOptions clientserver::ArenaBlockPool::arenaOptions()
+{
+	google::protobuf::ArenaOptions options;
+	options.start_block_size=size_t(1)<<minimumSizeShift;
+	options.max_block_size=size_t(1)<<16;
+	options.block_alloc=&::allocateFromThreadPool;
+	options.block_dealloc=&::deallocateToThreadPool;
+	return options;
+}
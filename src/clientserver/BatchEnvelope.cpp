@@ -0,0 +1,42 @@
+#include "clientserver/BatchEnvelope.h"
+
+#include <stdexcept>
+
+namespace
+{
+	/** @brief Reads a decimal number ending in a colon, and moves position past the colon. Parsed by hand for the same reasons as MessageEnvelope. */
+	uint64_t readNumber( const std::string& batch, size_t& position )
+	{
+		uint64_t value=0;
+		const size_t start=position;
+		for( ; position<batch.size() && batch[position]>='0' && batch[position]<='9' && position-start<10; ++position )
+		{
+			value=value*10+(batch[position]-'0');
+		}
+		if( position==start || position>=batch.size() || batch[position]!=':' || value>0xffffffff ) throw std::runtime_error( "BatchEnvelope received an invalid entry header" );
+		++position;
+		return value;
+	}
+} // end of the unnamed namespace
+
+void clientserver::BatchEnvelope::encode( uint32_t id, const std::string& payload, std::string& output )
+{
+	output+=std::to_string(id);
+	output+=':';
+	output+=std::to_string(payload.size());
+	output+=':';
+	output+=payload;
+}
+
+void clientserver::BatchEnvelope::decode( const std::string& batch, std::vector<Entry>& entries )
+{
+	size_t position=0;
+	while( position<batch.size() )
+	{
+		const uint32_t id=static_cast<uint32_t>( ::readNumber( batch, position ) );
+		const uint64_t length=::readNumber( batch, position );
+		if( length>batch.size()-position ) throw std::runtime_error( "BatchEnvelope received an entry longer than the batch" );
+		entries.push_back( Entry{ id, batch.substr( position, length ) } );
+		position+=length;
+	}
+}
@@ -0,0 +1,100 @@
+#include "clientserver/BinaryFramer.h"
+
+#include <stdexcept>
+#include <cstring>
+
+namespace
+{
+	void writeUint32( char* pOutput, uint32_t value )
+	{
+		pOutput[0]=static_cast<char>( (value>>24) & 0xff );
+		pOutput[1]=static_cast<char>( (value>>16) & 0xff );
+		pOutput[2]=static_cast<char>( (value>>8) & 0xff );
+		pOutput[3]=static_cast<char>( value & 0xff );
+	}
+
+	uint32_t readUint32( const char* pInput )
+	{
+		const unsigned char* pBytes=reinterpret_cast<const unsigned char*>(pInput);
+		return (uint32_t(pBytes[0])<<24) | (uint32_t(pBytes[1])<<16) | (uint32_t(pBytes[2])<<8) | uint32_t(pBytes[3]);
+	}
+} // end of the unnamed namespace
+
+const size_t clientserver::BinaryFramer::headerSize;
+
+void clientserver::BinaryFramer::encode( MessageType type, uint32_t id, const std::string& payload, std::string& output )
+{
+	if( payload.size()>0xffffffff ) throw std::length_error( "BinaryFramer payload is too large to encode" );
+
+	char header[headerSize];
+	::writeUint32( header, static_cast<uint32_t>(payload.size()) );
+	header[4]=static_cast<char>(type);
+	::writeUint32( header+5, id );
+
+	output.reserve( output.size()+headerSize+payload.size() );
+	output.append( header, headerSize );
+	output.append( payload );
+}
+
+clientserver::BinaryFramer::BinaryFramer()
+	: readPosition_(0), writePosition_(0), maximumPayloadSize_(64*1024*1024)
+{
+	// No operation besides the initialiser list
+}
+
+void clientserver::BinaryFramer::setMaximumPayloadSize( size_t size )
+{
+	maximumPayloadSize_=size;
+}
+
+void clientserver::BinaryFramer::append( const char* pData, size_t size )
+{
+	std::memcpy( reserve(size), pData, size );
+	commit( size );
+}
+
+char* clientserver::BinaryFramer::reserve( size_t size )
+{
+	// If everything received so far has been consumed, start from the beginning again. Otherwise
+	// only move the unconsumed data down when it would save growing the buffer.
+	if( readPosition_==writePosition_ ) readPosition_=writePosition_=0;
+	else if( buffer_.size()-writePosition_<size && readPosition_>0 )
+	{
+		std::memmove( &buffer_[0], &buffer_[readPosition_], writePosition_-readPosition_ );
+		writePosition_-=readPosition_;
+		readPosition_=0;
+	}
+
+	if( buffer_.size()-writePosition_<size ) buffer_.resize( writePosition_+size );
+	return &buffer_[writePosition_];
+}
+
+void clientserver::BinaryFramer::commit( size_t size )
+{
+	if( writePosition_+size>buffer_.size() ) throw std::logic_error( "BinaryFramer::commit called with more bytes than were reserved" );
+	writePosition_+=size;
+}
+
+bool clientserver::BinaryFramer::next( MessageType& type, uint32_t& id, std::string& payload )
+{
+	if( bufferedSize()<headerSize ) return false;
+
+	const char* pHeader=&buffer_[readPosition_];
+	const uint32_t payloadSize=::readUint32( pHeader );
+	if( payloadSize>maximumPayloadSize_ ) throw std::length_error( "BinaryFramer received a frame of "+std::to_string(payloadSize)+" bytes, which is larger than the maximum of "+std::to_string(maximumPayloadSize_) );
+	const uint8_t typeValue=static_cast<uint8_t>(pHeader[4]);
+	if( typeValue<static_cast<uint8_t>(MessageType::request) || typeValue>static_cast<uint8_t>(MessageType::streamingBatchRequest) ) throw std::runtime_error( "BinaryFramer received an invalid message type ("+std::to_string(typeValue)+")" );
+
+	if( bufferedSize()<headerSize+payloadSize ) return false;
+
+	type=static_cast<MessageType>(typeValue);
+	id=::readUint32( pHeader+5 );
+	payload.assign( pHeader+headerSize, payloadSize );
+	readPosition_+=headerSize+payloadSize;
+	return true;
+}
+
+size_t clientserver::BinaryFramer::bufferedSize() const
+{
+	return writePosition_-readPosition_;
+}
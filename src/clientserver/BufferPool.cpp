@@ -0,0 +1,31 @@
+#include "clientserver/BufferPool.h"
+
+clientserver::BufferPool::BufferPool( size_t initialCapacity, size_t maximumCapacity, size_t maximumPooled )
+	: initialCapacity_(initialCapacity), maximumCapacity_(maximumCapacity), maximumPooled_(maximumPooled)
+{
+	// No operation besides the initialiser list
+}
+
+std::string clientserver::BufferPool::acquire()
+{
+	std::string buffer;
+	if( !buffers_.empty() )
+	{
+		buffer.swap( buffers_.back() );
+		buffers_.pop_back();
+	}
+	else buffer.reserve( initialCapacity_ );
+	return buffer;
+}
+
+void clientserver::BufferPool::release( std::string&& buffer )
+{
+	if( buffers_.size()>=maximumPooled_ || buffer.capacity()>maximumCapacity_ || buffer.capacity()<initialCapacity_ ) return;
+	buffer.clear();
+	buffers_.push_back( std::move(buffer) );
+}
+
+size_t clientserver::BufferPool::pooledBuffers() const
+{
+	return buffers_.size();
+}
@@ -0,0 +1,106 @@
+#include "clientserver/ChannelScheduler.h"
+
+#include <stdexcept>
+#include <algorithm>
+
+const size_t clientserver::ChannelScheduler::defaultFragmentSize;
+
+clientserver::ChannelScheduler::ChannelScheduler( size_t fragmentSize )
+	: fragmentSize_(std::max<size_t>(fragmentSize,4)), turns_(0), queuedBytes_(0)
+{
+	// No operation besides the initialiser list
+}
+
+void clientserver::ChannelScheduler::open( uint32_t channel, uint32_t priority, uint32_t credit )
+{
+	auto iChannel=channels_.find( channel );
+	if( iChannel==channels_.end() ) channels_.emplace( channel, Channel{ priority, credit, 0, std::deque<Message>() } );
+	else
+	{
+		iChannel->second.priority=priority;
+		iChannel->second.credit+=credit;
+	}
+}
+
+bool clientserver::ChannelScheduler::isOpen( uint32_t channel ) const
+{
+	return channels_.find( channel )!=channels_.end();
+}
+
+size_t clientserver::ChannelScheduler::numberOfChannels() const
+{
+	return channels_.size();
+}
+
+bool clientserver::ChannelScheduler::addCredit( uint32_t channel, uint32_t credit )
+{
+	auto iChannel=channels_.find( channel );
+	if( iChannel==channels_.end() ) return false;
+	iChannel->second.credit+=credit;
+	return true;
+}
+
+void clientserver::ChannelScheduler::push( uint32_t channel, clientserver::WebSocketFramer::Opcode opcode, std::string message )
+{
+	auto iChannel=channels_.find( channel );
+	if( iChannel==channels_.end() ) throw std::invalid_argument( "ChannelScheduler was given a message for channel "+std::to_string(channel)+" which isn't open" );
+	queuedBytes_+=message.size();
+	iChannel->second.messages.push_back( Message{ opcode, std::move(message), 0 } );
+}
+
+bool clientserver::ChannelScheduler::next( uint32_t& channel, clientserver::WebSocketFramer::Opcode& opcode, std::string& fragment, bool& isLast )
+{
+	// Few enough channels are open at once that looking at them all is quicker than keeping them sorted
+	auto iBest=channels_.end();
+	size_t bestSize=0;
+	for( auto iChannel=channels_.begin(); iChannel!=channels_.end(); ++iChannel )
+	{
+		const Channel& candidate=iChannel->second;
+		if( candidate.messages.empty() ) continue;
+		const size_t size=nextFragmentSize( candidate );
+		const Message& message=candidate.messages.front();
+		if( size==0 && message.position<message.data.size() ) continue;
+		if( iBest!=channels_.end() )
+		{
+			const Channel& best=iBest->second;
+			if( candidate.priority<best.priority ) continue;
+			if( candidate.priority==best.priority && candidate.lastTurn>=best.lastTurn ) continue;
+		}
+		iBest=iChannel;
+		bestSize=size;
+	}
+	if( iBest==channels_.end() ) return false;
+
+	Channel& best=iBest->second;
+	Message& message=best.messages.front();
+	channel=iBest->first;
+	opcode=message.opcode;
+	isLast=( message.position+bestSize==message.data.size() );
+	// Messages that fit in one fragment are handed over whole rather than copied
+	if( message.position==0 && isLast ) fragment.swap( message.data );
+	else fragment.assign( message.data, message.position, bestSize );
+	message.position+=bestSize;
+	best.credit-=bestSize;
+	best.lastTurn=++turns_;
+	queuedBytes_-=bestSize;
+	if( isLast ) best.messages.pop_front();
+	return true;
+}
+
+size_t clientserver::ChannelScheduler::queuedBytes() const
+{
+	return queuedBytes_;
+}
+
+size_t clientserver::ChannelScheduler::nextFragmentSize( const Channel& channel ) const
+{
+	const Message& message=channel.messages.front();
+	const size_t remaining=message.data.size()-message.position;
+	size_t size=static_cast<size_t>( std::min<uint64_t>( std::min(fragmentSize_,remaining), channel.credit ) );
+	// Back off to the start of a character, which can't be more than 3 bytes back
+	if( message.opcode==clientserver::WebSocketFramer::Opcode::text && size<remaining )
+	{
+		while( size>0 && (static_cast<unsigned char>(message.data[message.position+size])&0xc0)==0x80 ) --size;
+	}
+	return size;
+}
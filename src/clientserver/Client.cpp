@@ -0,0 +1,553 @@
+#include "clientserver/Client.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <unordered_set>
+#include <cstdlib>
+#include "clientserver/BatchEnvelope.h"
+
+namespace // Unnamed namespace for things only used in this file
+{
+	/** @brief How many messages of a session are received before acknowledging them, so that the server can stop keeping them. */
+	const uint32_t acknowledgementInterval=16;
+} // end of the unnamed namespace
+
+clientserver::Client::Client()
+	: Client( clientserver::createClientTransport() )
+{
+	// No operation besides the initialiser list
+}
+
+clientserver::Client::Client( std::unique_ptr<clientserver::IClientTransport> pTransport )
+	: isConnecting_(false), isConnected_(false), isGoingAway_(false), attempt_(0), reconnect_(false), initialReconnectDelay_(100), maximumReconnectDelay_(30000),
+	  reconnectDelay_(100), randomGenerator_(std::random_device()()), nextRequestId_(0), requestWindow_(64), outstandingRequests_(0),
+	  resumeSessions_(false), replayBufferSize_(1024), messagesSent_(0), messagesReceived_(0), receivedSinceAcknowledgement_(0),
+	  pTransport_(std::move(pTransport))
+{
+	// No operation besides the initialiser list
+}
+
+clientserver::Client::~Client()
+{
+	// The transport's handlers use everything else, so it has to go first
+	pTransport_.reset();
+}
+
+void clientserver::Client::setDefaultInfoHandler( std::function<void(const std::string&)> infoHandler )
+{
+	std::lock_guard<std::mutex> lock( mutex_ );
+	infoHandler_=infoHandler;
+}
+
+void clientserver::Client::setConnectionHandler( std::function<void(bool)> connectionHandler )
+{
+	std::lock_guard<std::mutex> lock( mutex_ );
+	connectionHandler_=connectionHandler;
+}
+
+void clientserver::Client::setOverloadHandler( std::function<void(std::chrono::milliseconds)> overloadHandler )
+{
+	std::lock_guard<std::mutex> lock( mutex_ );
+	overloadHandler_=overloadHandler;
+}
+
+void clientserver::Client::setReconnect( bool reconnect, std::chrono::milliseconds initialDelay, std::chrono::milliseconds maximumDelay )
+{
+	if( reconnect && (initialDelay.count()<=0 || maximumDelay<initialDelay) ) throw std::invalid_argument( "Client reconnect delays have to be positive, and the maximum no less than the initial" );
+	std::lock_guard<std::mutex> lock( mutex_ );
+	reconnect_=reconnect;
+	initialReconnectDelay_=initialDelay;
+	maximumReconnectDelay_=maximumDelay;
+	reconnectDelay_=initialDelay;
+}
+
+void clientserver::Client::setSessionResumption( bool resume, size_t replayBufferSize )
+{
+	if( resume && replayBufferSize==0 ) throw std::invalid_argument( "Client replay buffer has to hold at least one message" );
+	std::lock_guard<std::mutex> lock( mutex_ );
+	resumeSessions_=resume;
+	replayBufferSize_=replayBufferSize;
+}
+
+void clientserver::Client::setRequestWindow( size_t requestWindow )
+{
+	if( requestWindow==0 ) throw std::invalid_argument( "Client request window has to be at least one" );
+	std::lock_guard<std::mutex> lock( mutex_ );
+	requestWindow_=requestWindow;
+	sendQueued();
+}
+
+size_t clientserver::Client::outstandingRequests()
+{
+	std::lock_guard<std::mutex> lock( mutex_ );
+	return outstandingRequests_;
+}
+
+size_t clientserver::Client::queuedRequests()
+{
+	std::lock_guard<std::mutex> lock( mutex_ );
+	return static_cast<size_t>( std::count_if( queue_.begin(), queue_.end(), []( const OutgoingMessage& message ){ return message.isRequest; } ) );
+}
+
+void clientserver::Client::connect( const std::string& url )
+{
+	std::vector<MessageHandler> endHandlers;
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		url_=url;
+		isConnecting_=true;
+		isConnected_=false;
+		++attempt_;
+		reconnectDelay_=initialReconnectDelay_;
+		endHandlers=dropOutstanding();
+		forgetSession();
+		try
+		{
+			openTransport();
+		}
+		catch( ... )
+		{
+			isConnecting_=false;
+			queue_.clear();
+			throw;
+		}
+	}
+	for( auto& endHandler : endHandlers ) endHandler( "The client connected somewhere else" );
+}
+
+#ifndef __EMSCRIPTEN__
+bool clientserver::Client::waitUntilConnected( std::chrono::milliseconds timeout )
+{
+	std::unique_lock<std::mutex> lock( mutex_ );
+	connectionChanged_.wait_for( lock, timeout, [this](){ return isConnected_ || !isConnecting_; } );
+	return isConnected_;
+}
+#endif
+
+void clientserver::Client::disconnect()
+{
+	std::vector<MessageHandler> endHandlers;
+	std::function<void(bool)> connectionHandler;
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		if( !isConnecting_ ) return;
+		++attempt_;
+		isConnecting_=false;
+		if( isConnected_ ) connectionHandler=connectionHandler_;
+		isConnected_=false;
+		queue_.clear();
+		endHandlers=dropOutstanding();
+		forgetSession();
+		pTransport_->close();
+		connectionChanged_.notify_all();
+	}
+	for( auto& endHandler : endHandlers ) endHandler( "The client disconnected" );
+	if( connectionHandler ) connectionHandler( false );
+}
+
+bool clientserver::Client::isConnected()
+{
+	std::lock_guard<std::mutex> lock( mutex_ );
+	return isConnected_;
+}
+
+void clientserver::Client::sendInfo( const std::string& message )
+{
+	sendInfo( false, message );
+}
+
+void clientserver::Client::sendRequest( const std::string& message, std::function<void(const std::string&)> responseHandler )
+{
+	sendRequest( false, message, responseHandler );
+}
+
+void clientserver::Client::sendBinaryInfo( const std::string& message )
+{
+	sendInfo( true, message );
+}
+
+void clientserver::Client::sendBinaryRequest( const std::string& message, std::function<void(const std::string&)> responseHandler )
+{
+	sendRequest( true, message, responseHandler );
+}
+
+void clientserver::Client::sendStreamingRequest( const std::string& message, std::function<void(const std::string&)> chunkHandler, std::function<void(const std::string&)> endHandler )
+{
+	sendStreamingRequest( false, message, chunkHandler, endHandler );
+}
+
+void clientserver::Client::sendBinaryStreamingRequest( const std::string& message, std::function<void(const std::string&)> chunkHandler, std::function<void(const std::string&)> endHandler )
+{
+	sendStreamingRequest( true, message, chunkHandler, endHandler );
+}
+
+void clientserver::Client::sendBatch( const std::vector<std::string>& messages, std::function<void(const std::vector<std::string>&)> responsesHandler )
+{
+	sendBatch( false, messages, responsesHandler );
+}
+
+void clientserver::Client::sendStreamingBatch( const std::vector<std::string>& messages, std::function<void(size_t,const std::string&)> responseHandler, std::function<void(const std::string&)> endHandler )
+{
+	sendStreamingBatch( false, messages, responseHandler, endHandler );
+}
+
+void clientserver::Client::sendBinaryBatch( const std::vector<std::string>& messages, std::function<void(const std::vector<std::string>&)> responsesHandler )
+{
+	sendBatch( true, messages, responsesHandler );
+}
+
+void clientserver::Client::sendBinaryStreamingBatch( const std::vector<std::string>& messages, std::function<void(size_t,const std::string&)> responseHandler, std::function<void(const std::string&)> endHandler )
+{
+	sendStreamingBatch( true, messages, responseHandler, endHandler );
+}
+
+void clientserver::Client::sendInfo( bool isBinary, const std::string& message )
+{
+	OutgoingMessage outgoing{ isBinary, false, 0, std::string() };
+	clientserver::MessageEnvelope::encode( clientserver::MessageEnvelope::MessageType::info, 0, message, outgoing.envelope );
+
+	std::lock_guard<std::mutex> lock( mutex_ );
+	checkConnecting();
+	sendOrQueue( std::move(outgoing) );
+}
+
+void clientserver::Client::sendRequest( bool isBinary, const std::string& message, MessageHandler responseHandler )
+{
+	std::lock_guard<std::mutex> lock( mutex_ );
+	checkConnecting();
+	OutgoingMessage outgoing{ isBinary, true, nextRequestId_++, std::string() };
+	clientserver::MessageEnvelope::encode( clientserver::MessageEnvelope::MessageType::request, outgoing.id, message, outgoing.envelope );
+	responseHandlers_[outgoing.id]=responseHandler;
+	sendOrQueue( std::move(outgoing) );
+}
+
+void clientserver::Client::sendStreamingRequest( bool isBinary, const std::string& message, MessageHandler chunkHandler, MessageHandler endHandler )
+{
+	std::lock_guard<std::mutex> lock( mutex_ );
+	checkConnecting();
+	OutgoingMessage outgoing{ isBinary, true, nextRequestId_++, std::string() };
+	clientserver::MessageEnvelope::encode( clientserver::MessageEnvelope::MessageType::streamRequest, outgoing.id, message, outgoing.envelope );
+	streamHandlers_[outgoing.id]=std::make_pair( chunkHandler, endHandler );
+	sendOrQueue( std::move(outgoing) );
+}
+
+void clientserver::Client::sendBatch( bool isBinary, const std::vector<std::string>& messages, std::function<void(const std::vector<std::string>&)> responsesHandler )
+{
+	const size_t numberOfMessages=messages.size();
+	auto responseHandler=[numberOfMessages,responsesHandler]( const std::string& response )
+		{
+			// The responses are in the order they finished, so put them back in the order of the requests
+			std::vector<clientserver::BatchEnvelope::Entry> entries;
+			clientserver::BatchEnvelope::decode( response, entries );
+			std::vector<std::string> responses( numberOfMessages );
+			for( auto& entry : entries )
+			{
+				if( entry.id<numberOfMessages ) responses[entry.id].swap( entry.payload );
+			}
+			if( responsesHandler ) responsesHandler( responses );
+		};
+
+	std::lock_guard<std::mutex> lock( mutex_ );
+	checkConnecting();
+	OutgoingMessage outgoing{ isBinary, true, nextRequestId_++, std::string() };
+	outgoing.envelope=encodeBatch( clientserver::MessageEnvelope::MessageType::batchRequest, outgoing.id, messages );
+	responseHandlers_[outgoing.id]=responseHandler;
+	sendOrQueue( std::move(outgoing) );
+}
+
+void clientserver::Client::sendStreamingBatch( bool isBinary, const std::vector<std::string>& messages, std::function<void(size_t,const std::string&)> responseHandler, MessageHandler endHandler )
+{
+	auto chunkHandler=[responseHandler]( const std::string& chunk )
+		{
+			std::vector<clientserver::BatchEnvelope::Entry> entries;
+			clientserver::BatchEnvelope::decode( chunk, entries );
+			for( const auto& entry : entries )
+			{
+				if( responseHandler ) responseHandler( entry.id, entry.payload );
+			}
+		};
+
+	std::lock_guard<std::mutex> lock( mutex_ );
+	checkConnecting();
+	OutgoingMessage outgoing{ isBinary, true, nextRequestId_++, std::string() };
+	outgoing.envelope=encodeBatch( clientserver::MessageEnvelope::MessageType::streamingBatchRequest, outgoing.id, messages );
+	streamHandlers_[outgoing.id]=std::make_pair( chunkHandler, endHandler );
+	sendOrQueue( std::move(outgoing) );
+}
+
+std::string clientserver::Client::encodeBatch( clientserver::MessageEnvelope::MessageType type, uint32_t id, const std::vector<std::string>& messages )
+{
+	std::string envelope=clientserver::MessageEnvelope::header( type, id );
+	for( size_t index=0; index<messages.size(); ++index ) clientserver::BatchEnvelope::encode( static_cast<uint32_t>(index), messages[index], envelope );
+	return envelope;
+}
+
+void clientserver::Client::checkConnecting()
+{
+	if( !isConnecting_ ) throw std::runtime_error( "Client is not connected" );
+}
+
+void clientserver::Client::sendOrQueue( OutgoingMessage message )
+{
+	// Nothing can overtake what's already queued, or info messages could arrive before requests sent earlier
+	if( isConnected_ && !isGoingAway_ && queue_.empty() && (!message.isRequest || outstandingRequests_<requestWindow_) )
+	{
+		if( message.isRequest ) ++outstandingRequests_;
+		transmit( std::move(message) );
+	}
+	else queue_.push_back( std::move(message) );
+}
+
+void clientserver::Client::sendQueued()
+{
+	while( isConnected_ && !isGoingAway_ && !queue_.empty() && (!queue_.front().isRequest || outstandingRequests_<requestWindow_) )
+	{
+		if( queue_.front().isRequest ) ++outstandingRequests_;
+		transmit( std::move(queue_.front()) );
+		queue_.pop_front();
+	}
+}
+
+void clientserver::Client::transmit( OutgoingMessage message )
+{
+	pTransport_->send( message.isBinary, message.envelope );
+	if( sessionToken_.empty() ) return;
+	++messagesSent_;
+	unacknowledged_.push_back( std::move(message) );
+	// If the server hasn't received the oldest one by the time the client reconnects, the session can't be resumed
+	if( unacknowledged_.size()>replayBufferSize_ ) unacknowledged_.pop_front();
+}
+
+void clientserver::Client::forgetSession()
+{
+	sessionToken_.clear();
+	messagesSent_=0;
+	messagesReceived_=0;
+	receivedSinceAcknowledgement_=0;
+	unacknowledged_.clear();
+}
+
+void clientserver::Client::openTransport()
+{
+	const uint64_t attempt=attempt_;
+	clientserver::IClientTransport::Handlers handlers;
+	handlers.open=[this,attempt](){ handleOpen( attempt ); };
+	handlers.message=[this,attempt]( bool, std::string& message ){ handleMessage( attempt, message ); };
+	handlers.close=[this,attempt]( const std::string& reason ){ handleClose( attempt, reason ); };
+	std::string url=url_;
+	if( resumeSessions_ )
+	{
+		// An empty token asks for a new session. The server's reply to either is the first message.
+		url+=(url.find( '?' )==std::string::npos ? "?session=" : "&session=")+sessionToken_;
+		if( !sessionToken_.empty() ) url+="&received="+std::to_string(messagesReceived_);
+	}
+	pTransport_->open( url, std::move(handlers) );
+}
+
+void clientserver::Client::handleOpen( uint64_t attempt )
+{
+	std::function<void(bool)> connectionHandler;
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		if( attempt!=attempt_ ) return;
+		// With sessions nothing can be sent until the server says whether it resumed
+		if( resumeSessions_ ) return;
+		isConnected_=true;
+		isGoingAway_=false;
+		reconnectDelay_=initialReconnectDelay_;
+		sendQueued();
+		connectionHandler=connectionHandler_;
+		connectionChanged_.notify_all();
+	}
+	if( connectionHandler ) connectionHandler( true );
+}
+
+void clientserver::Client::handleMessage( uint64_t attempt, std::string& message )
+{
+	typedef clientserver::MessageEnvelope::MessageType MessageType;
+	MessageType type;
+	uint32_t id;
+	clientserver::MessageEnvelope::decode( message, type, id );
+	if( type==MessageType::session ) return handleSession( attempt, id, message );
+
+	MessageHandler handler;
+	std::function<void(std::chrono::milliseconds)> overloadHandler;
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		if( attempt!=attempt_ ) return;
+		if( type==MessageType::acknowledgement )
+		{
+			// Anything outside what's kept is an old or invalid acknowledgement, and can be ignored
+			const uint32_t unacknowledged=messagesSent_-id;
+			if( unacknowledged<unacknowledged_.size() ) unacknowledged_.erase( unacknowledged_.begin(), unacknowledged_.end()-unacknowledged );
+			return;
+		}
+		if( type==MessageType::goAway )
+		{
+			// Not counted in the session. The server closes the connection once it has replied to everything.
+			isGoingAway_=true;
+			return;
+		}
+		if( !sessionToken_.empty() )
+		{
+			++messagesReceived_;
+			if( ++receivedSinceAcknowledgement_>=::acknowledgementInterval )
+			{
+				receivedSinceAcknowledgement_=0;
+				pTransport_->send( false, clientserver::MessageEnvelope::header( MessageType::acknowledgement, messagesReceived_ ) );
+			}
+		}
+
+		if( type==MessageType::response )
+		{
+			auto iFindResult=responseHandlers_.find( id );
+			if( iFindResult==responseHandlers_.end() ) return;
+			handler.swap( iFindResult->second );
+			responseHandlers_.erase( iFindResult );
+			--outstandingRequests_;
+			sendQueued();
+		}
+		else if( type==MessageType::streamChunk || type==MessageType::streamEnd )
+		{
+			auto iFindResult=streamHandlers_.find( id );
+			if( iFindResult==streamHandlers_.end() ) return;
+			if( type==MessageType::streamChunk ) handler=iFindResult->second.first;
+			else
+			{
+				handler.swap( iFindResult->second.second );
+				streamHandlers_.erase( iFindResult );
+				--outstandingRequests_;
+				sendQueued();
+			}
+		}
+		else if( type==MessageType::overloaded )
+		{
+			// Takes the place of the response, so the request is finished without its handler being called
+			auto iFindResult=responseHandlers_.find( id );
+			if( iFindResult==responseHandlers_.end() ) return;
+			responseHandlers_.erase( iFindResult );
+			--outstandingRequests_;
+			sendQueued();
+			overloadHandler=overloadHandler_;
+		}
+		else if( type==MessageType::info ) handler=infoHandler_;
+	}
+	if( overloadHandler ) overloadHandler( std::chrono::milliseconds( std::strtoull( message.c_str(), nullptr, 10 ) ) );
+	if( handler ) handler( message );
+}
+
+void clientserver::Client::handleSession( uint64_t attempt, uint32_t serverReceived, const std::string& token )
+{
+	std::vector<MessageHandler> endHandlers;
+	std::function<void(bool)> connectionHandler;
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		if( attempt!=attempt_ || isConnected_ ) return;
+		if( !token.empty() && token==sessionToken_ )
+		{
+			// Unsigned arithmetic, so that it still works once the counts wrap around
+			const uint32_t missed=messagesSent_-serverReceived;
+			if( missed>unacknowledged_.size() )
+			{
+				// The server resumed but some of what it missed has been dropped here, so start again with a new session
+				sessionToken_.clear();
+				pTransport_->close();
+				openTransport();
+				return;
+			}
+			// Everything before what the server received has arrived, and the rest goes again before anything new
+			unacknowledged_.erase( unacknowledged_.begin(), unacknowledged_.end()-missed );
+			for( const auto& message : unacknowledged_ ) pTransport_->send( message.isBinary, message.envelope );
+		}
+		else
+		{
+			// Either a new session or none at all, so whatever the server was doing has been lost
+			endHandlers=dropOutstanding();
+			forgetSession();
+			sessionToken_=token;
+		}
+		isConnected_=true;
+		isGoingAway_=false;
+		reconnectDelay_=initialReconnectDelay_;
+		sendQueued();
+		connectionHandler=connectionHandler_;
+		connectionChanged_.notify_all();
+	}
+	for( auto& endHandler : endHandlers ) endHandler( "The connection dropped and the session could not be resumed" );
+	if( connectionHandler ) connectionHandler( true );
+}
+
+void clientserver::Client::handleClose( uint64_t attempt, const std::string& reason )
+{
+	std::vector<MessageHandler> endHandlers;
+	std::function<void(bool)> connectionHandler;
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		if( attempt!=attempt_ ) return;
+		if( isConnected_ ) connectionHandler=connectionHandler_;
+		isConnected_=false;
+		// A session keeps everything outstanding, to carry on with if it can be resumed
+		if( !reconnect_ || sessionToken_.empty() ) endHandlers=dropOutstanding();
+
+		if( reconnect_ )
+		{
+			std::uniform_real_distribution<double> jitter( 0.5, 1.0 );
+			const std::chrono::milliseconds delay( static_cast<std::chrono::milliseconds::rep>( reconnectDelay_.count()*jitter(randomGenerator_) ) );
+			reconnectDelay_=std::min( reconnectDelay_*2, maximumReconnectDelay_ );
+			pTransport_->schedule( delay, [this,attempt]()
+				{
+					std::lock_guard<std::mutex> lock( mutex_ );
+					if( attempt!=attempt_ || !isConnecting_ || isConnected_ ) return;
+					try
+					{
+						openTransport();
+					}
+					catch( ... )
+					{
+						// Only possible if the TLS settings can't be loaded, which won't fix itself
+						isConnecting_=false;
+						queue_.clear();
+						connectionChanged_.notify_all();
+						throw;
+					}
+				} );
+		}
+		else
+		{
+			isConnecting_=false;
+			queue_.clear();
+			forgetSession();
+		}
+		connectionChanged_.notify_all();
+	}
+	for( auto& endHandler : endHandlers ) endHandler( reason );
+	if( connectionHandler ) connectionHandler( false );
+}
+
+std::vector<clientserver::Client::MessageHandler> clientserver::Client::dropOutstanding()
+{
+	// Requests still in the queue haven't been sent, so they keep their handlers and go on the next connection
+	std::unordered_set<uint32_t> queuedIds;
+	for( const auto& message : queue_ )
+	{
+		if( message.isRequest ) queuedIds.insert( message.id );
+	}
+
+	std::vector<MessageHandler> endHandlers;
+	for( auto iHandlers=streamHandlers_.begin(); iHandlers!=streamHandlers_.end(); )
+	{
+		if( queuedIds.count( iHandlers->first ) ) ++iHandlers;
+		else
+		{
+			if( iHandlers->second.second ) endHandlers.push_back( std::move(iHandlers->second.second) );
+			iHandlers=streamHandlers_.erase( iHandlers );
+		}
+	}
+	for( auto iHandler=responseHandlers_.begin(); iHandler!=responseHandlers_.end(); )
+	{
+		if( queuedIds.count( iHandler->first ) ) ++iHandler;
+		else iHandler=responseHandlers_.erase( iHandler );
+	}
+	outstandingRequests_=0;
+	return endHandlers;
+}
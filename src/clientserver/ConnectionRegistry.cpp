@@ -0,0 +1,204 @@
+#include "clientserver/ConnectionRegistry.h"
+
+#include <stdexcept>
+
+/** @brief What a slot points to, which is never changed once it's been put there. */
+struct clientserver::ConnectionRegistry::Entry
+{
+	uint64_t id;
+	std::weak_ptr<clientserver::IConnection> pConnection;
+};
+
+/** @brief The epoch one reader started in. Claimed by one reader at a time, and put back afterwards for the next. */
+struct clientserver::ConnectionRegistry::Reader
+{
+	std::atomic<bool> isActive;
+	std::atomic<uint64_t> epoch;
+	Reader* pNext; ///< Set before the record is added to the list, and then never changed
+};
+
+/** @brief Claims a Reader record and announces the current epoch in it, for as long as this exists.
+ *
+ * Entries can't be freed while this exists if they were in a slot at any point since it was made.
+ *
+ * @author Mark Grimes
+ * @date 19/Oct/2026
+ */
+class clientserver::ConnectionRegistry::ReadGuard
+{
+public:
+	ReadGuard( const ConnectionRegistry& registry )
+		: pReader_(nullptr)
+	{
+		for( Reader* pReader=registry.pReaders_.load(); pReader!=nullptr && pReader_==nullptr; pReader=pReader->pNext )
+		{
+			bool isActive=false;
+			if( !pReader->isActive && pReader->isActive.compare_exchange_strong( isActive, true ) ) pReader_=pReader;
+		}
+		if( pReader_==nullptr )
+		{
+			// More readers at once than ever before, so add another record. These are only freed with the registry.
+			pReader_=new Reader;
+			pReader_->isActive=true;
+			pReader_->epoch=registry.epoch_.load();
+			pReader_->pNext=registry.pReaders_.load();
+			while( !registry.pReaders_.compare_exchange_weak( pReader_->pNext, pReader_ ) );
+		}
+
+		// The writer might have moved the epoch on between reading it and announcing it, in which case
+		// it could have missed this reader, so go again until it's the same.
+		uint64_t epoch;
+		do
+		{
+			epoch=registry.epoch_.load();
+			pReader_->epoch.store( epoch );
+		} while( registry.epoch_.load()!=epoch );
+	}
+	~ReadGuard()
+	{
+		pReader_->isActive.store( false );
+	}
+protected:
+	ReadGuard( const ReadGuard& other ) = delete;
+	ReadGuard& operator=( const ReadGuard& other ) = delete;
+	Reader* pReader_;
+};
+
+clientserver::ConnectionRegistry::ConnectionRegistry()
+	: numberOfChunks_(0), size_(0), epoch_(0), pReaders_(nullptr)
+{
+	for( auto& chunk : chunks_ ) chunk.store( nullptr );
+}
+
+clientserver::ConnectionRegistry::~ConnectionRegistry()
+{
+	for( size_t chunkIndex=0; chunkIndex<numberOfChunks_; ++chunkIndex )
+	{
+		std::atomic<Entry*>* pChunk=chunks_[chunkIndex].load();
+		for( size_t slot=0; slot<slotsPerChunk; ++slot ) delete pChunk[slot].load();
+		delete[] pChunk;
+	}
+	for( const auto& retired : retired_ ) delete retired.second;
+	Reader* pReader=pReaders_.load();
+	while( pReader!=nullptr )
+	{
+		Reader* pNext=pReader->pNext;
+		delete pReader;
+		pReader=pNext;
+	}
+}
+
+uint64_t clientserver::ConnectionRegistry::add( std::weak_ptr<clientserver::IConnection> pConnection )
+{
+	std::lock_guard<std::mutex> lock( writeMutex_ );
+
+	uint32_t slot;
+	if( !freeSlots_.empty() )
+	{
+		slot=freeSlots_.back();
+		freeSlots_.pop_back();
+	}
+	else
+	{
+		slot=generations_.size();
+		if( slot%slotsPerChunk==0 )
+		{
+			const size_t chunkIndex=slot/slotsPerChunk;
+			if( chunkIndex>=maximumChunks ) throw std::length_error( "ConnectionRegistry is full" );
+			std::atomic<Entry*>* pChunk=new std::atomic<Entry*>[slotsPerChunk];
+			for( size_t index=0; index<slotsPerChunk; ++index ) pChunk[index].store( nullptr );
+			chunks_[chunkIndex].store( pChunk );
+			numberOfChunks_.store( chunkIndex+1 );
+		}
+		generations_.push_back( 0 );
+	}
+
+	// Starting the generations at one means that zero is never an id
+	const uint64_t id=( static_cast<uint64_t>(++generations_[slot]) << 32 ) | slot;
+	Entry* pEntry=new Entry{ id, std::move(pConnection) };
+	chunks_[slot/slotsPerChunk].load()[slot%slotsPerChunk].store( pEntry );
+	++size_;
+	return id;
+}
+
+void clientserver::ConnectionRegistry::remove( uint64_t id )
+{
+	const uint32_t slot=static_cast<uint32_t>( id );
+	std::lock_guard<std::mutex> lock( writeMutex_ );
+	if( slot>=generations_.size() || generations_[slot]!=(id >> 32) ) return;
+
+	std::atomic<Entry*>& slotEntry=chunks_[slot/slotsPerChunk].load()[slot%slotsPerChunk];
+	Entry* pEntry=slotEntry.load();
+	if( pEntry==nullptr || pEntry->id!=id ) return;
+	slotEntry.store( nullptr );
+	--size_;
+
+	// Readers can still have the entry, but the slot can be used again straight away since the id won't match
+	retired_.emplace_back( epoch_.load(), pEntry );
+	freeSlots_.push_back( slot );
+	reclaim();
+}
+
+std::shared_ptr<clientserver::IConnection> clientserver::ConnectionRegistry::find( uint64_t id ) const
+{
+	const uint32_t slot=static_cast<uint32_t>( id );
+	if( slot/slotsPerChunk>=numberOfChunks_.load() ) return nullptr;
+
+	ReadGuard guard( *this );
+	const Entry* pEntry=chunks_[slot/slotsPerChunk].load()[slot%slotsPerChunk].load();
+	if( pEntry==nullptr || pEntry->id!=id ) return nullptr;
+	return pEntry->pConnection.lock();
+}
+
+size_t clientserver::ConnectionRegistry::forEach( const std::function<void(uint64_t,const std::shared_ptr<clientserver::IConnection>&)>& function ) const
+{
+	size_t count=0;
+	ReadGuard guard( *this );
+	const size_t numberOfChunks=numberOfChunks_.load();
+	for( size_t chunkIndex=0; chunkIndex<numberOfChunks; ++chunkIndex )
+	{
+		const std::atomic<Entry*>* pChunk=chunks_[chunkIndex].load();
+		for( size_t slot=0; slot<slotsPerChunk; ++slot )
+		{
+			const Entry* pEntry=pChunk[slot].load();
+			if( pEntry==nullptr ) continue;
+			if( std::shared_ptr<clientserver::IConnection> pConnection=pEntry->pConnection.lock() )
+			{
+				function( pEntry->id, pConnection );
+				++count;
+			}
+		}
+	}
+	return count;
+}
+
+size_t clientserver::ConnectionRegistry::broadcastInfo( const std::string& message ) const
+{
+	return forEach( [&message]( uint64_t, const std::shared_ptr<clientserver::IConnection>& pConnection ){ pConnection->sendInfo( message ); } );
+}
+
+size_t clientserver::ConnectionRegistry::size() const
+{
+	return size_;
+}
+
+void clientserver::ConnectionRegistry::reclaim()
+{
+	const uint64_t epoch=epoch_.load();
+	bool readersHaveCaughtUp=true;
+	for( Reader* pReader=pReaders_.load(); pReader!=nullptr && readersHaveCaughtUp; pReader=pReader->pNext )
+	{
+		if( pReader->isActive.load() && pReader->epoch.load()!=epoch ) readersHaveCaughtUp=false;
+	}
+	if( readersHaveCaughtUp ) epoch_.store( epoch+1 );
+
+	// A reader that could have seen an entry started in the epoch it was removed in or earlier, and
+	// stops the epoch moving on more than once past that until it has finished.
+	size_t numberFreed=0;
+	while( numberFreed<retired_.size() && retired_[numberFreed].first+2<=epoch_.load() )
+	{
+		delete retired_[numberFreed].second;
+		++numberFreed;
+	}
+	retired_.erase( retired_.begin(), retired_.begin()+numberFreed );
+}
@@ -0,0 +1,260 @@
+#include "clientserver/CpuTopology.h"
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include <thread>
+#include <cstring>
+#include <cctype>
+#include <dirent.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+namespace // Unnamed namespace for things only used in this file
+{
+	/** @brief MPOL_PREFERRED from <numaif.h>, which would otherwise need libnuma installed. */
+	const int preferredNodePolicy=1;
+	/** @brief The most nodes a memory policy can be set for. */
+	const size_t maximumNodes=1024;
+	const size_t bitsPerWord=8*sizeof(unsigned long);
+
+	/** @brief The CPUs this process is allowed to run on, or all of them if that can't be found. */
+	std::vector<int> allowedCpus()
+	{
+		std::vector<int> cpus;
+		cpu_set_t allowed;
+		CPU_ZERO( &allowed );
+		if( ::sched_getaffinity( 0, sizeof(allowed), &allowed )==0 )
+		{
+			for( int cpu=0; cpu<CPU_SETSIZE; ++cpu ) if( CPU_ISSET(cpu,&allowed) ) cpus.push_back( cpu );
+		}
+		if( cpus.empty() )
+		{
+			for( int cpu=0; cpu<static_cast<int>(std::max(1u,std::thread::hardware_concurrency())); ++cpu ) cpus.push_back( cpu );
+		}
+		return cpus;
+	}
+} // end of the unnamed namespace
+
+clientserver::CpuTopology::CpuTopology( std::vector<std::vector<int> > nodeCpus )
+	: nodeCpus_(std::move(nodeCpus))
+{
+	for( size_t node=0; node<nodeCpus_.size(); ++node )
+	{
+		std::sort( nodeCpus_[node].begin(), nodeCpus_[node].end() );
+		if( !nodeCpus_[node].empty() ) nodes_.push_back( static_cast<int>(node) );
+	}
+	if( nodes_.empty() ) throw std::invalid_argument( "CpuTopology was given no CPUs" );
+}
+
+clientserver::CpuTopology clientserver::CpuTopology::detect()
+{
+	const std::vector<int> allowed=::allowedCpus();
+	std::vector<std::vector<int> > nodeCpus;
+
+	DIR* pDirectory=::opendir( "/sys/devices/system/node" );
+	if( pDirectory!=nullptr )
+	{
+		while( dirent* pEntry=::readdir(pDirectory) )
+		{
+			// Everything else in there, e.g. "online" and "possible", is about all the nodes at once
+			const char* pName=pEntry->d_name;
+			if( std::strncmp( pName, "node", 4 )!=0 || pName[4]<'0' || pName[4]>'9' ) continue;
+			const size_t node=std::stoul( pName+4 );
+			std::ifstream cpuListFile( std::string("/sys/devices/system/node/")+pName+"/cpulist" );
+			std::string cpuList;
+			// Nodes with only memory have an empty list
+			if( !std::getline( cpuListFile, cpuList ) || cpuList.find_first_of("0123456789")==std::string::npos ) continue;
+
+			std::vector<int> cpus;
+			try
+			{
+				for( const int cpu : parseCpuList(cpuList) ) if( std::binary_search( allowed.begin(), allowed.end(), cpu ) ) cpus.push_back( cpu );
+			}
+			catch( std::invalid_argument& error )
+			{
+				continue;
+			}
+			if( node>=nodeCpus.size() ) nodeCpus.resize( node+1 );
+			nodeCpus[node]=std::move( cpus );
+		}
+		::closedir( pDirectory );
+	}
+
+	const bool hasCpus=std::any_of( nodeCpus.begin(), nodeCpus.end(), []( const std::vector<int>& cpus ){ return !cpus.empty(); } );
+	if( !hasCpus ) nodeCpus.assign( 1, allowed );
+	return CpuTopology( std::move(nodeCpus) );
+}
+
+std::vector<int> clientserver::CpuTopology::parseCpuList( const std::string& list )
+{
+	std::vector<int> cpus;
+	std::istringstream stream( list );
+	std::string range;
+	while( std::getline( stream, range, ',' ) )
+	{
+		// The sysfs files end with a newline
+		range.erase( std::remove_if( range.begin(), range.end(), ::isspace ), range.end() );
+		if( range.empty() ) continue;
+		size_t position;
+		int first, last;
+		try
+		{
+			first=std::stoi( range, &position );
+			last=first;
+			if( position<range.size() && range[position]=='-' )
+			{
+				const std::string end=range.substr( position+1 );
+				last=std::stoi( end, &position );
+				if( position!=end.size() ) throw std::invalid_argument( "trailing characters" );
+			}
+			else if( position!=range.size() ) throw std::invalid_argument( "trailing characters" );
+		}
+		catch( std::exception& error )
+		{
+			throw std::invalid_argument( "Couldn't parse \""+range+"\" in the CPU list \""+list+"\"" );
+		}
+		if( first<0 || last<first || last>=CPU_SETSIZE ) throw std::invalid_argument( "The CPU range \""+range+"\" in \""+list+"\" is invalid" );
+		for( int cpu=first; cpu<=last; ++cpu ) cpus.push_back( cpu );
+	}
+	if( cpus.empty() ) throw std::invalid_argument( "The CPU list \""+list+"\" is empty" );
+	std::sort( cpus.begin(), cpus.end() );
+	cpus.erase( std::unique( cpus.begin(), cpus.end() ), cpus.end() );
+	return cpus;
+}
+
+const std::vector<int>& clientserver::CpuTopology::nodes() const
+{
+	return nodes_;
+}
+
+const std::vector<int>& clientserver::CpuTopology::cpusOnNode( int node ) const
+{
+	return nodeCpus_.at( node );
+}
+
+int clientserver::CpuTopology::nodeOfCpu( int cpu ) const
+{
+	for( const int node : nodes_ )
+	{
+		if( std::binary_search( nodeCpus_[node].begin(), nodeCpus_[node].end(), cpu ) ) return node;
+	}
+	return -1;
+}
+
+clientserver::CpuTopology::Placement clientserver::CpuTopology::placeByNode( size_t numberOfEventLoops, size_t numberOfHandlerThreads ) const
+{
+	Placement placement;
+	// Nodes without event loops have nothing to handle
+	const size_t numberOfPools=std::min( nodes_.size(), std::max<size_t>(numberOfEventLoops,1) );
+	for( size_t index=0; index<numberOfEventLoops; ++index )
+	{
+		const int node=nodes_[index%numberOfPools];
+		const std::vector<int>& cpus=nodeCpus_[node];
+		placement.eventLoops.push_back( Affinity{ { cpus[(index/numberOfPools)%cpus.size()] }, node } );
+		placement.eventLoopPools.push_back( index%numberOfPools );
+	}
+	for( size_t pool=0; pool<numberOfPools; ++pool )
+	{
+		const int node=nodes_[pool];
+		placement.handlerPools.push_back( Affinity{ nodeCpus_[node], node } );
+		const size_t numberOfThreads=numberOfHandlerThreads/numberOfPools+( pool<numberOfHandlerThreads%numberOfPools ? 1 : 0 );
+		placement.handlerPoolSizes.push_back( std::max<size_t>( numberOfThreads, 1 ) );
+	}
+	return placement;
+}
+
+clientserver::CpuTopology::Placement clientserver::CpuTopology::placeOnCpus( size_t numberOfEventLoops, const std::vector<int>& eventLoopCpus, size_t numberOfHandlerThreads, const std::vector<int>& handlerCpus ) const
+{
+	for( const auto& cpus : { eventLoopCpus, handlerCpus } )
+	{
+		for( const int cpu : cpus )
+		{
+			if( nodeOfCpu(cpu)<0 ) throw std::invalid_argument( "CPU "+std::to_string(cpu)+" doesn't exist or this process isn't allowed to run on it" );
+		}
+	}
+
+	Placement placement;
+	if( handlerCpus.empty() )
+	{
+		placement.handlerPools.push_back( Affinity{ {}, -1 } );
+		placement.handlerPoolSizes.push_back( numberOfHandlerThreads );
+	}
+	else
+	{
+		// One pool for each node, in the order they first appear
+		for( const int cpu : handlerCpus )
+		{
+			const int node=nodeOfCpu( cpu );
+			auto iPool=std::find_if( placement.handlerPools.begin(), placement.handlerPools.end(), [node]( const Affinity& pool ){ return pool.node==node; } );
+			if( iPool==placement.handlerPools.end() )
+			{
+				placement.handlerPools.push_back( Affinity{ {}, node } );
+				placement.handlerPoolSizes.push_back( 0 );
+				iPool=placement.handlerPools.end()-1;
+			}
+			iPool->cpus.push_back( cpu );
+		}
+		for( size_t index=0; index<numberOfHandlerThreads; ++index )
+		{
+			const int node=nodeOfCpu( handlerCpus[index%handlerCpus.size()] );
+			for( size_t pool=0; pool<placement.handlerPools.size(); ++pool )
+			{
+				if( placement.handlerPools[pool].node==node ) ++placement.handlerPoolSizes[pool];
+			}
+		}
+		for( auto& numberOfThreads : placement.handlerPoolSizes ) numberOfThreads=std::max<size_t>( numberOfThreads, 1 );
+	}
+
+	for( size_t index=0; index<numberOfEventLoops; ++index )
+	{
+		size_t pool=index%placement.handlerPools.size();
+		if( eventLoopCpus.empty() ) placement.eventLoops.push_back( Affinity{ {}, -1 } );
+		else
+		{
+			const int cpu=eventLoopCpus[index%eventLoopCpus.size()];
+			const int node=nodeOfCpu( cpu );
+			placement.eventLoops.push_back( Affinity{ { cpu }, node } );
+			for( size_t otherPool=0; otherPool<placement.handlerPools.size(); ++otherPool )
+			{
+				if( placement.handlerPools[otherPool].node==node ) pool=otherPool;
+			}
+		}
+		placement.eventLoopPools.push_back( pool );
+	}
+	return placement;
+}
+
+clientserver::CpuTopology::Placement clientserver::CpuTopology::unplaced( size_t numberOfEventLoops, size_t numberOfHandlerThreads )
+{
+	Placement placement;
+	placement.eventLoops.assign( numberOfEventLoops, Affinity{ {}, -1 } );
+	placement.eventLoopPools.assign( numberOfEventLoops, 0 );
+	placement.handlerPools.push_back( Affinity{ {}, -1 } );
+	placement.handlerPoolSizes.push_back( numberOfHandlerThreads );
+	return placement;
+}
+
+bool clientserver::CpuTopology::apply( const Affinity& affinity )
+{
+	bool succeeded=true;
+	if( !affinity.cpus.empty() )
+	{
+		cpu_set_t cpus;
+		CPU_ZERO( &cpus );
+		for( const int cpu : affinity.cpus ) CPU_SET( cpu, &cpus );
+		// Zero is the calling thread rather than the whole process
+		succeeded=( ::sched_setaffinity( 0, sizeof(cpus), &cpus )==0 );
+	}
+	if( affinity.node>=0 )
+	{
+		if( static_cast<size_t>(affinity.node)>=::maximumNodes ) return false;
+		unsigned long nodeMask[::maximumNodes/::bitsPerWord]={ 0 };
+		nodeMask[affinity.node/::bitsPerWord]=1ul << (affinity.node % ::bitsPerWord);
+		// Called directly because glibc doesn't wrap it
+		if( ::syscall( SYS_set_mempolicy, ::preferredNodePolicy, nodeMask, ::maximumNodes )!=0 ) succeeded=false;
+	}
+	return succeeded;
+}
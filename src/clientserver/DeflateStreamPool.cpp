@@ -0,0 +1,114 @@
+#include "clientserver/DeflateStreamPool.h"
+
+#include <stdexcept>
+#include <iterator>
+#include <zlib.h>
+
+clientserver::DeflateStreamPool::DeflateStreamPool( size_t maximumPooled )
+	: maximumPooled_(maximumPooled), createdStreams_(0)
+{
+	// No operation besides the initialiser list
+}
+
+clientserver::DeflateStreamPool::~DeflateStreamPool()
+{
+	for( auto& pooledStream : compressors_ ) destroyCompressor( pooledStream.pStream );
+	for( auto& pooledStream : decompressors_ ) destroyDecompressor( pooledStream.pStream );
+}
+
+z_stream_s* clientserver::DeflateStreamPool::acquireCompressor( int level, int windowBits, int memoryLevel )
+{
+	for( auto iStream=compressors_.rbegin(); iStream!=compressors_.rend(); ++iStream )
+	{
+		if( iStream->level==level && iStream->windowBits==windowBits && iStream->memoryLevel==memoryLevel )
+		{
+			z_stream_s* pStream=iStream->pStream;
+			compressors_.erase( std::next(iStream).base() );
+			return pStream;
+		}
+	}
+	++createdStreams_;
+	return createCompressor( level, windowBits, memoryLevel );
+}
+
+void clientserver::DeflateStreamPool::releaseCompressor( z_stream_s* pStream, int level, int windowBits, int memoryLevel )
+{
+	if( compressors_.size()>=maximumPooled_ || ::deflateReset( pStream )!=Z_OK ) destroyCompressor( pStream );
+	else compressors_.push_back( PooledStream{ pStream, level, windowBits, memoryLevel } );
+}
+
+z_stream_s* clientserver::DeflateStreamPool::acquireDecompressor( int windowBits )
+{
+	for( auto iStream=decompressors_.rbegin(); iStream!=decompressors_.rend(); ++iStream )
+	{
+		if( iStream->windowBits==windowBits )
+		{
+			z_stream_s* pStream=iStream->pStream;
+			decompressors_.erase( std::next(iStream).base() );
+			return pStream;
+		}
+	}
+	++createdStreams_;
+	return createDecompressor( windowBits );
+}
+
+void clientserver::DeflateStreamPool::releaseDecompressor( z_stream_s* pStream, int windowBits )
+{
+	if( decompressors_.size()>=maximumPooled_ || ::inflateReset( pStream )!=Z_OK ) destroyDecompressor( pStream );
+	else decompressors_.push_back( PooledStream{ pStream, 0, windowBits, 0 } );
+}
+
+size_t clientserver::DeflateStreamPool::pooledStreams() const
+{
+	return compressors_.size()+decompressors_.size();
+}
+
+size_t clientserver::DeflateStreamPool::createdStreams() const
+{
+	return createdStreams_;
+}
+
+z_stream_s* clientserver::DeflateStreamPool::createCompressor( int level, int windowBits, int memoryLevel )
+{
+	z_stream* pStream=new z_stream;
+	pStream->zalloc=Z_NULL;
+	pStream->zfree=Z_NULL;
+	pStream->opaque=Z_NULL;
+	// Negative window bits for raw deflate, permessage-deflate doesn't have the zlib header
+	const int result=::deflateInit2( pStream, level, Z_DEFLATED, -windowBits, memoryLevel, Z_DEFAULT_STRATEGY );
+	if( result!=Z_OK )
+	{
+		delete pStream;
+		throw std::runtime_error( "Couldn't create a zlib deflate stream with level "+std::to_string(level)+", window bits "+std::to_string(windowBits)+" and memory level "+std::to_string(memoryLevel) );
+	}
+	return pStream;
+}
+
+z_stream_s* clientserver::DeflateStreamPool::createDecompressor( int windowBits )
+{
+	z_stream* pStream=new z_stream;
+	pStream->zalloc=Z_NULL;
+	pStream->zfree=Z_NULL;
+	pStream->opaque=Z_NULL;
+	pStream->next_in=Z_NULL;
+	pStream->avail_in=0;
+	const int result=::inflateInit2( pStream, -windowBits );
+	if( result!=Z_OK )
+	{
+		delete pStream;
+		throw std::runtime_error( "Couldn't create a zlib inflate stream with window bits "+std::to_string(windowBits) );
+	}
+	return pStream;
+}
+
+void clientserver::DeflateStreamPool::destroyCompressor( z_stream_s* pStream )
+{
+	::deflateEnd( pStream );
+	delete pStream;
+}
+
+void clientserver::DeflateStreamPool::destroyDecompressor( z_stream_s* pStream )
+{
+	::inflateEnd( pStream );
+	delete pStream;
+}
@@ -0,0 +1,86 @@
+#include "clientserver/DeltaApplier.h"
+
+#include <stdexcept>
+#include <google/protobuf/message.h>
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/io/coded_stream.h>
+#include "clientserver/StateDelta.h"
+
+clientserver::DeltaApplier::Subscription::Subscription()
+	: isAwaitingSnapshot(false)
+{
+	// No operation besides the initialiser list
+}
+
+clientserver::DeltaApplier::DeltaApplier( size_t maximumStates )
+	: maximumStates_(maximumStates)
+{
+	if( maximumStates_==0 ) throw std::invalid_argument( "DeltaApplier has to be able to keep at least one state" );
+}
+
+clientserver::DeltaApplier::~DeltaApplier()
+{
+	// No operation. Only here so that google::protobuf::Message is complete when the members are destroyed
+}
+
+void clientserver::DeltaApplier::addSubscription( const std::string& subscription, const google::protobuf::Message& prototype )
+{
+	Subscription& entry=subscriptions_[subscription];
+	entry.pPrototype.reset( prototype.New() );
+	entry.states.clear();
+	entry.isAwaitingSnapshot=false;
+}
+
+const google::protobuf::Message* clientserver::DeltaApplier::apply( const char* pData, size_t size, std::string& subscription, std::string& acknowledgement )
+{
+	clientserver::StateDelta::Header header;
+	const size_t payloadStart=clientserver::StateDelta::decodeHeader( pData, size, header );
+	subscription=header.subscription;
+	acknowledgement.clear();
+	auto iSubscription=subscriptions_.find( header.subscription );
+	if( iSubscription==subscriptions_.end() ) throw std::runtime_error( "DeltaApplier received an update for the unknown subscription \""+header.subscription+"\"" );
+	Subscription& entry=iSubscription->second;
+	auto& states=entry.states;
+
+	// Anything older than the latest state is out of date already, so doesn't need acknowledging
+	if( !states.empty() && header.sequence<=states.rbegin()->first ) return states.rbegin()->second.get();
+
+	std::unique_ptr<google::protobuf::Message> pState;
+	if( header.type==clientserver::StateDelta::UpdateType::snapshot )
+	{
+		pState.reset( entry.pPrototype->New() );
+		entry.isAwaitingSnapshot=false;
+		google::protobuf::io::CodedInputStream input( reinterpret_cast<const uint8_t*>(pData+payloadStart), static_cast<int>(size-payloadStart) );
+		if( !pState->MergePartialFromCodedStream( &input ) || !input.ConsumedEntireMessage() ) throw std::runtime_error( "DeltaApplier couldn't parse the snapshot for \""+header.subscription+"\"" );
+	}
+	else
+	{
+		auto iBase=states.find( header.baseSequence );
+		if( iBase==states.end() )
+		{
+			// Other deltas from states that have gone could already be on the way, so only ask once
+			states.clear();
+			if( !entry.isAwaitingSnapshot ) clientserver::StateDelta::encodeAcknowledgement( header.subscription, 0, acknowledgement );
+			entry.isAwaitingSnapshot=true;
+			return nullptr;
+		}
+		pState.reset( iBase->second->New() );
+		pState->CopyFrom( *iBase->second );
+		clientserver::StateDelta::apply( header.changedFields, pData+payloadStart, size-payloadStart, *pState );
+		// The server has seen the acknowledgement for the base, so will never use anything older
+		states.erase( states.begin(), iBase );
+	}
+
+	const google::protobuf::Message* pResult=pState.get();
+	states[header.sequence]=std::move( pState );
+	while( states.size()>maximumStates_ ) states.erase( states.begin() );
+	clientserver::StateDelta::encodeAcknowledgement( header.subscription, header.sequence, acknowledgement );
+	return pResult;
+}
+
+const google::protobuf::Message* clientserver::DeltaApplier::state( const std::string& subscription ) const
+{
+	auto iSubscription=subscriptions_.find( subscription );
+	if( iSubscription==subscriptions_.end() || iSubscription->second.states.empty() ) return nullptr;
+	return iSubscription->second.states.rbegin()->second.get();
+}
@@ -0,0 +1,142 @@
+#include "clientserver/DeltaPublisher.h"
+
+#include <stdexcept>
+#include <google/protobuf/message.h>
+#include "clientserver/StateDelta.h"
+
+clientserver::DeltaPublisher::Subscription::Subscription()
+	: nextSequence(1), acknowledgedSequence(0), updatesSinceSnapshot(0)
+{
+	// No operation besides the initialiser list
+}
+
+clientserver::DeltaPublisher::DeltaPublisher( size_t snapshotInterval, size_t maximumUnacknowledged )
+	: snapshotInterval_(snapshotInterval), maximumUnacknowledged_(maximumUnacknowledged), connectionsAfterLastPrune_(0), snapshotsSent_(0), deltasSent_(0)
+{
+	if( snapshotInterval_==0 ) throw std::invalid_argument( "DeltaPublisher needs a snapshot interval of at least one" );
+	if( maximumUnacknowledged_==0 ) throw std::invalid_argument( "DeltaPublisher has to be able to keep at least one unacknowledged state" );
+}
+
+clientserver::DeltaPublisher::~DeltaPublisher()
+{
+	// No operation. Only here so that google::protobuf::Message is complete when the members are destroyed
+}
+
+void clientserver::DeltaPublisher::encodeUpdate( const std::weak_ptr<clientserver::IConnection>& pConnection, const std::string& subscriptionName,
+		const google::protobuf::Message& state, std::string& output )
+{
+	std::shared_ptr<Connection> pConnectionState=findConnection( pConnection, true );
+	std::lock_guard<std::mutex> lock( pConnectionState->mutex );
+	Subscription& subscription=pConnectionState->subscriptions[subscriptionName];
+	if( subscription.pAcknowledged && subscription.pAcknowledged->GetDescriptor()!=state.GetDescriptor() ) throw std::invalid_argument( "DeltaPublisher was given a "+state.GetDescriptor()->full_name()+" for subscription \""+subscriptionName+"\", which was a "+subscription.pAcknowledged->GetDescriptor()->full_name() );
+
+	const uint64_t sequence=subscription.nextSequence++;
+	const size_t outputStart=output.size();
+	bool isSnapshot=(subscription.pAcknowledged==nullptr || subscription.updatesSinceSnapshot+1>=snapshotInterval_);
+	if( !isSnapshot )
+	{
+		std::vector<clientserver::StateDelta::FieldPath> changedFields;
+		std::unique_ptr<google::protobuf::Message> pChanges( state.New() );
+		clientserver::StateDelta::diff( *subscription.pAcknowledged, state, changedFields, *pChanges );
+		clientserver::StateDelta::encodeDelta( subscriptionName, sequence, subscription.acknowledgedSequence, changedFields, *pChanges, output );
+		// If nearly everything changed the field paths make the delta bigger than the state
+		if( output.size()-outputStart>=state.ByteSizeLong()+subscriptionName.size()+4 )
+		{
+			output.resize( outputStart );
+			isSnapshot=true;
+		}
+	}
+	if( isSnapshot )
+	{
+		clientserver::StateDelta::encodeSnapshot( subscriptionName, sequence, state, output );
+		subscription.updatesSinceSnapshot=0;
+		++snapshotsSent_;
+	}
+	else
+	{
+		++subscription.updatesSinceSnapshot;
+		++deltasSent_;
+	}
+
+	std::unique_ptr<google::protobuf::Message> pCopy( state.New() );
+	pCopy->CopyFrom( state );
+	subscription.unacknowledged.emplace_back( sequence, std::move(pCopy) );
+	if( subscription.unacknowledged.size()>maximumUnacknowledged_ ) subscription.unacknowledged.pop_front();
+}
+
+void clientserver::DeltaPublisher::acknowledge( const std::weak_ptr<clientserver::IConnection>& pConnection, const char* pData, size_t size )
+{
+	std::string subscriptionName;
+	uint64_t sequence;
+	clientserver::StateDelta::decodeAcknowledgement( pData, size, subscriptionName, sequence );
+
+	std::shared_ptr<Connection> pConnectionState=findConnection( pConnection, false );
+	if( !pConnectionState ) return;
+	std::lock_guard<std::mutex> lock( pConnectionState->mutex );
+	auto iSubscription=pConnectionState->subscriptions.find( subscriptionName );
+	if( iSubscription==pConnectionState->subscriptions.end() ) return;
+	Subscription& subscription=iSubscription->second;
+
+	if( sequence==0 )
+	{
+		// The client lost track, so start again with a snapshot
+		subscription.pAcknowledged.reset();
+		subscription.acknowledgedSequence=0;
+		subscription.unacknowledged.clear();
+		return;
+	}
+	// Acknowledgements can be for states that have already been dropped, or arrive out of order on some transports
+	while( !subscription.unacknowledged.empty() && subscription.unacknowledged.front().first<=sequence )
+	{
+		if( subscription.unacknowledged.front().first==sequence )
+		{
+			subscription.pAcknowledged=std::move( subscription.unacknowledged.front().second );
+			subscription.acknowledgedSequence=sequence;
+		}
+		subscription.unacknowledged.pop_front();
+	}
+}
+
+void clientserver::DeltaPublisher::removeConnection( const std::weak_ptr<clientserver::IConnection>& pConnection )
+{
+	std::lock_guard<std::mutex> lock( connectionsMutex_ );
+	connections_.erase( pConnection );
+}
+
+size_t clientserver::DeltaPublisher::numberOfConnections() const
+{
+	std::lock_guard<std::mutex> lock( connectionsMutex_ );
+	return connections_.size();
+}
+
+uint64_t clientserver::DeltaPublisher::snapshotsSent() const
+{
+	return snapshotsSent_;
+}
+
+uint64_t clientserver::DeltaPublisher::deltasSent() const
+{
+	return deltasSent_;
+}
+
+std::shared_ptr<clientserver::DeltaPublisher::Connection> clientserver::DeltaPublisher::findConnection( const std::weak_ptr<clientserver::IConnection>& pConnection, bool create )
+{
+	std::lock_guard<std::mutex> lock( connectionsMutex_ );
+	auto iConnection=connections_.find( pConnection );
+	if( iConnection!=connections_.end() ) return iConnection->second;
+	if( !create ) return nullptr;
+
+	// Closed connections are removed whenever the number doubles, so that the cost is spread over the new ones
+	if( connections_.size()>=64 && connections_.size()>=2*connectionsAfterLastPrune_ )
+	{
+		for( auto iPrune=connections_.begin(); iPrune!=connections_.end(); )
+		{
+			if( iPrune->first.expired() ) iPrune=connections_.erase( iPrune );
+			else ++iPrune;
+		}
+		connectionsAfterLastPrune_=connections_.size();
+	}
+	std::shared_ptr<Connection> pConnectionState=std::make_shared<Connection>();
+	connections_.insert( std::make_pair( pConnection, pConnectionState ) );
+	return pConnectionState;
+}
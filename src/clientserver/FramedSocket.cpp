@@ -0,0 +1,287 @@
+#include "clientserver/FramedSocket.h"
+
+#include <iostream>
+#include <system_error>
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <openssl/ssl.h>
+#include "clientserver/TlsContext.h"
+
+namespace
+{
+	/** @brief The FramedSocket whose I/O loop is running on this thread, so that send() knows if it needs to wake the loop. */
+	thread_local const clientserver::FramedSocket* pCurrentLoop=nullptr;
+
+	/** @brief How much to try and read from the socket in one go. */
+	const size_t readSize=64*1024;
+} // end of the unnamed namespace
+
+const size_t clientserver::FramedSocket::defaultOutputLimit;
+
+clientserver::FramedSocket::FramedSocket( int socket, SSL* pSession )
+	: socket_(socket), pSession_(pSession), wakeEventFd_(-1), connected_(true), closeRequested_(false), sessionWantsWrite_(false), outputPosition_(0),
+	  outputLimit_(defaultOutputLimit), readPaused_(false)
+{
+	wakeEventFd_=::eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+	if( wakeEventFd_<0 )
+	{
+		int savedErrno=errno;
+		if( pSession_ ) SSL_free( pSession_ );
+		::close( socket_ );
+		throw std::system_error( savedErrno, std::system_category(), "Couldn't create an eventfd" );
+	}
+
+	::fcntl( socket_, F_SETFL, ::fcntl( socket_, F_GETFL )|O_NONBLOCK );
+	// The output buffer can be reallocated between retries of a write that would have blocked
+	if( pSession_ ) SSL_set_mode( pSession_, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER );
+}
+
+clientserver::FramedSocket::~FramedSocket()
+{
+	if( pSession_ ) SSL_free( pSession_ );
+	::close( socket_ );
+	::close( wakeEventFd_ );
+}
+
+void clientserver::FramedSocket::setOutputLimit( size_t outputLimit )
+{
+	outputLimit_=outputLimit;
+}
+
+size_t clientserver::FramedSocket::outputLimit() const
+{
+	return outputLimit_;
+}
+
+void clientserver::FramedSocket::send( MessageType type, uint32_t id, const std::string& payload )
+{
+	std::lock_guard<std::mutex> lock( queueMutex_ );
+	const bool wasEmpty=queuedOutput_.empty();
+	clientserver::BinaryFramer::encode( type, id, payload, queuedOutput_ );
+	// If the queue already had something in it the loop has already been woken, and if this is
+	// the loop's own thread it will check the queue before it next sleeps anyway.
+	if( wasEmpty && ::pCurrentLoop!=this )
+	{
+		uint64_t value=1;
+		while( ::write( wakeEventFd_, &value, sizeof(value) )<0 && errno==EINTR );
+	}
+}
+
+void clientserver::FramedSocket::close()
+{
+	closeRequested_=true;
+	uint64_t value=1;
+	while( ::write( wakeEventFd_, &value, sizeof(value) )<0 && errno==EINTR );
+}
+
+bool clientserver::FramedSocket::isConnected() const
+{
+	return connected_;
+}
+
+void clientserver::FramedSocket::run( FrameHandler frameHandler, int stopFd )
+{
+	::pCurrentLoop=this;
+
+	pollfd descriptors[3];
+	descriptors[0].fd=socket_;
+	descriptors[1].fd=wakeEventFd_;
+	descriptors[1].events=POLLIN;
+	descriptors[2].fd=stopFd; // poll ignores negative descriptors
+	descriptors[2].events=POLLIN;
+
+	bool handshakeComplete=(pSession_==nullptr);
+	bool tryRead=true; // There might already be data waiting, so try before the first poll
+	while( !closeRequested_ )
+	{
+		if( !handshakeComplete )
+		{
+			IoResult result=handshake();
+			if( result==IoResult::closed ) break;
+			handshakeComplete=(result==IoResult::ok);
+		}
+		if( handshakeComplete )
+		{
+			if( tryRead && readAndDispatch( frameHandler )==IoResult::closed ) break;
+			collectQueuedOutput();
+			if( flush()==IoResult::closed ) break;
+			// Frames could be waiting in the framer or in OpenSSL, which poll wouldn't see, so don't wait before carrying on
+			if( readPaused_ && !isOutputFull() )
+			{
+				tryRead=true;
+				continue;
+			}
+		}
+
+		// While the output is full only wait for it to drain, so that the peer is made to wait instead
+		descriptors[0].events=( readPaused_ ? 0 : POLLIN );
+		if( sessionWantsWrite_ || outputPosition_<outputBuffer_.size() ) descriptors[0].events|=POLLOUT;
+		if( ::poll( descriptors, 3, -1 )<0 )
+		{
+			if( errno==EINTR ) continue;
+			break;
+		}
+		if( descriptors[2].revents!=0 ) break;
+		if( descriptors[1].revents!=0 )
+		{
+			uint64_t value;
+			while( ::read( wakeEventFd_, &value, sizeof(value) )<0 && errno==EINTR );
+		}
+		// Errors and hangups are picked up by trying to read. OpenSSL might also be waiting to be
+		// able to write before it can carry on reading.
+		tryRead=readPaused_ || (descriptors[0].revents & (POLLIN | POLLERR | POLLHUP))!=0 || (sessionWantsWrite_ && (descriptors[0].revents & POLLOUT));
+	}
+
+	connected_=false;
+	::shutdown( socket_, SHUT_RDWR );
+	::pCurrentLoop=nullptr;
+}
+
+clientserver::FramedSocket::IoResult clientserver::FramedSocket::handshake()
+{
+	sessionWantsWrite_=false;
+	int result=SSL_do_handshake( pSession_ );
+	if( result==1 ) return IoResult::ok;
+
+	switch( SSL_get_error( pSession_, result ) )
+	{
+		case SSL_ERROR_WANT_READ :
+			return IoResult::wouldBlock;
+		case SSL_ERROR_WANT_WRITE :
+			sessionWantsWrite_=true;
+			return IoResult::wouldBlock;
+		default :
+			std::cerr << "TLS handshake failed: " << clientserver::lastTlsError() << std::endl;
+			return IoResult::closed;
+	}
+}
+
+clientserver::FramedSocket::IoResult clientserver::FramedSocket::readAndDispatch( FrameHandler& frameHandler )
+{
+	MessageType type;
+	uint32_t id;
+	std::string payload;
+	bool isFinished=false;
+	readPaused_=false;
+
+	while( true )
+	{
+		try
+		{
+			while( !isOutputFull() && framer_.next( type, id, payload ) ) frameHandler( type, id, payload );
+		}
+		catch( std::exception& error )
+		{
+			// Only decoding errors should get here, the handler is expected to deal with its own
+			std::cerr << "Closing connection because of an invalid frame: " << error.what() << std::endl;
+			return IoResult::closed;
+		}
+		// Anything left stays in the framer until enough of the output has gone
+		if( isOutputFull() )
+		{
+			readPaused_=true;
+			return IoResult::wouldBlock;
+		}
+		if( isFinished ) return IoResult::wouldBlock;
+
+		char* pBuffer=framer_.reserve( readSize );
+		ssize_t bytesRead;
+		if( pSession_ )
+		{
+			sessionWantsWrite_=false;
+			bytesRead=SSL_read( pSession_, pBuffer, readSize );
+			if( bytesRead<=0 )
+			{
+				const int error=SSL_get_error( pSession_, static_cast<int>(bytesRead) );
+				if( error==SSL_ERROR_WANT_READ ) return IoResult::wouldBlock;
+				if( error==SSL_ERROR_WANT_WRITE )
+				{
+					sessionWantsWrite_=true;
+					return IoResult::wouldBlock;
+				}
+				return IoResult::closed;
+			}
+		}
+		else
+		{
+			bytesRead=::recv( socket_, pBuffer, readSize, 0 );
+			if( bytesRead<0 )
+			{
+				if( errno==EINTR ) continue;
+				if( errno==EAGAIN || errno==EWOULDBLOCK ) return IoResult::wouldBlock;
+				return IoResult::closed;
+			}
+			if( bytesRead==0 ) return IoResult::closed;
+		}
+		framer_.commit( bytesRead );
+
+		// A short read from a plain socket means everything has been read. There's no way to tell
+		// with TLS because OpenSSL buffers internally, so for that carry on until it says to stop.
+		isFinished=( !pSession_ && static_cast<size_t>(bytesRead)<readSize );
+	}
+}
+
+bool clientserver::FramedSocket::isOutputFull()
+{
+	std::lock_guard<std::mutex> lock( queueMutex_ );
+	return outputBuffer_.size()-outputPosition_+queuedOutput_.size()>outputLimit_;
+}
+
+void clientserver::FramedSocket::collectQueuedOutput()
+{
+	std::lock_guard<std::mutex> lock( queueMutex_ );
+	if( queuedOutput_.empty() ) return;
+
+	if( outputPosition_==outputBuffer_.size() )
+	{
+		// Swap rather than copy. Clearing keeps the capacity, so neither buffer has to keep reallocating.
+		outputBuffer_.swap( queuedOutput_ );
+		queuedOutput_.clear();
+		outputPosition_=0;
+	}
+	else
+	{
+		outputBuffer_.append( queuedOutput_ );
+		queuedOutput_.clear();
+	}
+}
+
+clientserver::FramedSocket::IoResult clientserver::FramedSocket::flush()
+{
+	while( outputPosition_<outputBuffer_.size() )
+	{
+		const char* pData=outputBuffer_.data()+outputPosition_;
+		const size_t size=outputBuffer_.size()-outputPosition_;
+		ssize_t bytesWritten;
+		if( pSession_ )
+		{
+			bytesWritten=SSL_write( pSession_, pData, static_cast<int>(std::min<size_t>(size,0x7fffffff)) );
+			if( bytesWritten<=0 )
+			{
+				const int error=SSL_get_error( pSession_, static_cast<int>(bytesWritten) );
+				if( error==SSL_ERROR_WANT_READ || error==SSL_ERROR_WANT_WRITE ) return IoResult::wouldBlock;
+				return IoResult::closed;
+			}
+		}
+		else
+		{
+			bytesWritten=::send( socket_, pData, size, MSG_NOSIGNAL );
+			if( bytesWritten<0 )
+			{
+				if( errno==EINTR ) continue;
+				if( errno==EAGAIN || errno==EWOULDBLOCK ) return IoResult::wouldBlock;
+				return IoResult::closed;
+			}
+		}
+		outputPosition_+=bytesWritten;
+	}
+
+	outputBuffer_.clear();
+	outputPosition_=0;
+	return IoResult::ok;
+}
@@ -0,0 +1,70 @@
+#include "clientserver/HandlerPool.h"
+
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+
+clientserver::HandlerPool::HandlerPool( size_t numberOfThreads )
+	: HandlerPool( numberOfThreads, clientserver::CpuTopology::Affinity{ {}, -1 } )
+{
+	// No operation besides the initialiser list
+}
+
+clientserver::HandlerPool::HandlerPool( size_t numberOfThreads, const clientserver::CpuTopology::Affinity& affinity )
+	: affinity_(affinity), stopping_(false)
+{
+	if( numberOfThreads==0 ) numberOfThreads=std::max( 1u, std::thread::hardware_concurrency() );
+	for( size_t index=0; index<numberOfThreads; ++index ) threads_.emplace_back( &HandlerPool::run, this );
+}
+
+clientserver::HandlerPool::~HandlerPool()
+{
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		stopping_=true;
+	}
+	condition_.notify_all();
+	for( auto& thread : threads_ ) thread.join();
+}
+
+void clientserver::HandlerPool::post( std::function<void()> task )
+{
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		tasks_.push_back( std::move(task) );
+	}
+	condition_.notify_one();
+}
+
+size_t clientserver::HandlerPool::numberOfThreads() const
+{
+	return threads_.size();
+}
+
+void clientserver::HandlerPool::run()
+{
+	if( !clientserver::CpuTopology::apply( affinity_ ) ) std::cerr << "HandlerPool couldn't move a thread to its CPUs or NUMA node" << std::endl;
+
+	std::function<void()> task;
+	while( true )
+	{
+		{
+			std::unique_lock<std::mutex> lock( mutex_ );
+			condition_.wait( lock, [this]{ return stopping_ || !tasks_.empty(); } );
+			// Carry on until the queue is empty, so that nothing already posted is dropped
+			if( tasks_.empty() ) return;
+			task=std::move( tasks_.front() );
+			tasks_.pop_front();
+		}
+
+		try
+		{
+			task();
+		}
+		catch( std::exception& error )
+		{
+			std::cerr << "HandlerPool task threw an exception: " << error.what() << std::endl;
+		}
+		task=nullptr;
+	}
+}
@@ -0,0 +1,74 @@
+#include "clientserver/MessageEnvelope.h"
+
+#include <stdexcept>
+
+void clientserver::MessageEnvelope::encode( MessageType type, uint32_t id, const std::string& payload, std::string& output )
+{
+	output+=header( type, id );
+	output+=payload;
+}
+
+std::string clientserver::MessageEnvelope::header( MessageType type, uint32_t id )
+{
+	switch( type )
+	{
+		case MessageType::request : return "q"+std::to_string(id)+":";
+		case MessageType::response : return "r"+std::to_string(id)+":";
+		case MessageType::info : return "i";
+		case MessageType::streamRequest : return "s"+std::to_string(id)+":";
+		case MessageType::streamChunk : return "c"+std::to_string(id)+":";
+		case MessageType::streamEnd : return "e"+std::to_string(id)+":";
+		case MessageType::batchRequest : return "b"+std::to_string(id)+":";
+		case MessageType::streamingBatchRequest : return "p"+std::to_string(id)+":";
+		case MessageType::session : return "t"+std::to_string(id)+":";
+		case MessageType::acknowledgement : return "a"+std::to_string(id)+":";
+		case MessageType::channelOpen : return "o"+std::to_string(id)+":";
+		case MessageType::channelCredit : return "w"+std::to_string(id)+":";
+		case MessageType::channelMessage : return "m"+std::to_string(id)+":";
+		case MessageType::channelFragment : return "f"+std::to_string(id)+":";
+		case MessageType::goAway : return "g"+std::to_string(id)+":";
+		case MessageType::overloaded : return "x"+std::to_string(id)+":";
+	}
+	throw std::invalid_argument( "MessageEnvelope::header was given an invalid message type" );
+}
+
+void clientserver::MessageEnvelope::decode( std::string& message, MessageType& type, uint32_t& id )
+{
+	if( message.empty() ) throw std::runtime_error( "MessageEnvelope received an empty message" );
+
+	if( message[0]=='i' )
+	{
+		type=MessageType::info;
+		id=0;
+		message.erase( 0, 1 );
+		return;
+	}
+	else if( message[0]=='q' ) type=MessageType::request;
+	else if( message[0]=='r' ) type=MessageType::response;
+	else if( message[0]=='s' ) type=MessageType::streamRequest;
+	else if( message[0]=='c' ) type=MessageType::streamChunk;
+	else if( message[0]=='e' ) type=MessageType::streamEnd;
+	else if( message[0]=='b' ) type=MessageType::batchRequest;
+	else if( message[0]=='p' ) type=MessageType::streamingBatchRequest;
+	else if( message[0]=='t' ) type=MessageType::session;
+	else if( message[0]=='a' ) type=MessageType::acknowledgement;
+	else if( message[0]=='o' ) type=MessageType::channelOpen;
+	else if( message[0]=='w' ) type=MessageType::channelCredit;
+	else if( message[0]=='m' ) type=MessageType::channelMessage;
+	else if( message[0]=='f' ) type=MessageType::channelFragment;
+	else if( message[0]=='g' ) type=MessageType::goAway;
+	else if( message[0]=='x' ) type=MessageType::overloaded;
+	else throw std::runtime_error( "MessageEnvelope received an invalid message type" );
+
+	// Parse by hand rather than with std::stoul, which would accept signs and spaces and allocate
+	uint64_t value=0;
+	size_t position=1;
+	for( ; position<message.size() && message[position]>='0' && message[position]<='9' && position<=10; ++position )
+	{
+		value=value*10+(message[position]-'0');
+	}
+	if( position==1 || position>=message.size() || message[position]!=':' || value>0xffffffff ) throw std::runtime_error( "MessageEnvelope received an invalid request id" );
+
+	id=static_cast<uint32_t>(value);
+	message.erase( 0, position+1 );
+}
@@ -0,0 +1,663 @@
+#include "clientserver/NativeClientTransport.h"
+
+#include <iostream>
+#include <system_error>
+#include <stdexcept>
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <openssl/ssl.h>
+#include "clientserver/TlsContext.h"
+#include "clientserver/TcpClient.h"
+#include "clientserver/WebSocketHandshake.h"
+
+namespace
+{
+	/** @brief How much to try and read from the socket in one go. */
+	const size_t readSize=64*1024;
+
+	/** @brief The most time the handshakes, and the final flush when closing, are allowed to take. */
+	const int handshakeTimeoutSeconds=10;
+	const int closeTimeoutMilliseconds=1000;
+
+	struct Url
+	{
+		bool isSecure;
+		std::string authority; ///< The host and port as given, for the Host header
+		std::string host;
+		size_t port;
+		std::string path;
+	};
+
+	/** @throw std::invalid_argument  If the url isn't a ws:// or wss:// url. */
+	Url parseUrl( const std::string& url )
+	{
+		Url result;
+		size_t hostStart;
+		if( url.compare( 0, 5, "ws://" )==0 )
+		{
+			result.isSecure=false;
+			result.port=80;
+			hostStart=5;
+		}
+		else if( url.compare( 0, 6, "wss://" )==0 )
+		{
+			result.isSecure=true;
+			result.port=443;
+			hostStart=6;
+		}
+		else throw std::invalid_argument( "Only ws:// and wss:// urls are supported, not \""+url+"\"" );
+
+		// The path can be left out even if there's a query, e.g. "ws://localhost:9002?session="
+		size_t pathStart=url.find_first_of( "/?", hostStart );
+		if( pathStart==std::string::npos ) pathStart=url.size();
+		result.path=(pathStart<url.size() ? url.substr( pathStart ) : std::string("/"));
+		if( result.path[0]=='?' ) result.path.insert( 0, 1, '/' );
+		result.authority=url.substr( hostStart, pathStart-hostStart );
+		result.host=result.authority;
+
+		// IPv6 addresses are in square brackets, and have colons of their own
+		const size_t portStart=result.host.rfind( ':' );
+		const size_t bracket=result.host.rfind( ']' );
+		if( portStart!=std::string::npos && (bracket==std::string::npos || portStart>bracket) )
+		{
+			const std::string port=result.host.substr( portStart+1 );
+			if( port.empty() || port.size()>5 || port.find_first_not_of( "0123456789" )!=std::string::npos ) throw std::invalid_argument( "The url \""+url+"\" has an invalid port" );
+			result.port=std::stoul( port );
+			result.host.resize( portStart );
+		}
+		if( result.host.size()>=2 && result.host.front()=='[' && result.host.back()==']' ) result.host=result.host.substr( 1, result.host.size()-2 );
+		if( result.host.empty() ) throw std::invalid_argument( "The url \""+url+"\" has no host" );
+		return result;
+	}
+
+	/** @brief Blocking write used during the handshake. */
+	void writeAll( int socket, SSL* pSession, const std::string& data )
+	{
+		size_t position=0;
+		while( position<data.size() )
+		{
+			if( pSession )
+			{
+				int bytesWritten=SSL_write( pSession, data.data()+position, static_cast<int>(data.size()-position) );
+				if( bytesWritten<=0 ) throw std::runtime_error( "Couldn't write the WebSocket handshake: "+clientserver::lastTlsError() );
+				position+=bytesWritten;
+			}
+			else
+			{
+				ssize_t bytesWritten=::send( socket, data.data()+position, data.size()-position, MSG_NOSIGNAL );
+				if( bytesWritten<0 )
+				{
+					if( errno==EINTR ) continue;
+					throw std::system_error( errno, std::system_category(), "Couldn't write the WebSocket handshake" );
+				}
+				position+=bytesWritten;
+			}
+		}
+	}
+
+	/** @brief Blocking read used during the handshake. Never returns zero, it throws instead. */
+	size_t readSome( int socket, SSL* pSession, char* pBuffer, size_t size )
+	{
+		while( true )
+		{
+			if( pSession )
+			{
+				int bytesRead=SSL_read( pSession, pBuffer, static_cast<int>(size) );
+				if( bytesRead>0 ) return bytesRead;
+				if( SSL_get_error( pSession, bytesRead )==SSL_ERROR_ZERO_RETURN ) break;
+				throw std::runtime_error( "Couldn't read the WebSocket handshake: "+clientserver::lastTlsError() );
+			}
+			else
+			{
+				ssize_t bytesRead=::recv( socket, pBuffer, size, 0 );
+				if( bytesRead>0 ) return bytesRead;
+				if( bytesRead==0 ) break;
+				if( errno==EINTR ) continue;
+				throw std::system_error( errno, std::system_category(), "Couldn't read the WebSocket handshake" );
+			}
+		}
+		throw std::runtime_error( "The server closed the connection during the WebSocket handshake" );
+	}
+} // end of the unnamed namespace
+
+std::unique_ptr<clientserver::IClientTransport> clientserver::createClientTransport()
+{
+	return std::unique_ptr<clientserver::IClientTransport>( new clientserver::NativeClientTransport );
+}
+
+clientserver::NativeClientTransport::NativeClientTransport()
+	: wakeEventFd_(-1), verifyPeer_(true), compressionEnabled_(false), dictionaryThreshold_(clientserver::ZstdDictionaryCompressor::defaultThreshold),
+	  stopRequested_(false), generation_(0), openRequested_(false), closeRequested_(false), isOpen_(false), maskGenerator_(std::random_device()()),
+	  connectingSocket_(-1), connectionGeneration_(0), socket_(-1), pSession_(nullptr), sessionWantsWrite_(false), outputPosition_(0)
+{
+	wakeEventFd_=::eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+	if( wakeEventFd_<0 ) throw std::system_error( errno, std::system_category(), "Couldn't create an eventfd" );
+	ioThread_=std::thread( &NativeClientTransport::run, this );
+}
+
+clientserver::NativeClientTransport::~NativeClientTransport()
+{
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		stopRequested_=true;
+		++generation_;
+		if( connectingSocket_>=0 ) ::shutdown( connectingSocket_, SHUT_RDWR );
+	}
+	wake();
+	ioThread_.join();
+	::close( wakeEventFd_ );
+}
+
+void clientserver::NativeClientTransport::setTlsVerification( const std::string& verifyFile, bool verifyPeer )
+{
+	std::lock_guard<std::mutex> lock( mutex_ );
+	verifyFile_=verifyFile;
+	verifyPeer_=verifyPeer;
+	pTlsContext_.reset();
+}
+
+void clientserver::NativeClientTransport::setCompression( const clientserver::PerMessageDeflate::Configuration& configuration )
+{
+	std::lock_guard<std::mutex> lock( mutex_ );
+	compressionEnabled_=true;
+	compressionConfiguration_=configuration;
+}
+
+void clientserver::NativeClientTransport::setCompressionDictionaries( std::vector<std::shared_ptr<const clientserver::ZstdDictionary> > dictionaries, size_t threshold )
+{
+	std::lock_guard<std::mutex> lock( mutex_ );
+	compressionDictionaries_=std::move( dictionaries );
+	dictionaryThreshold_=threshold;
+}
+
+bool clientserver::NativeClientTransport::isCompressing()
+{
+	std::lock_guard<std::mutex> lock( mutex_ );
+	return pCompressor_!=nullptr;
+}
+
+void clientserver::NativeClientTransport::open( const std::string& url, Handlers handlers )
+{
+	const ::Url parsedUrl=::parseUrl( url );
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		if( parsedUrl.isSecure && !pTlsContext_ ) pTlsContext_=clientserver::TlsContext::createClient( verifyFile_, verifyPeer_ );
+		++generation_;
+		openRequested_=true;
+		requestedUrl_=url;
+		requestedHandlers_=std::move( handlers );
+		// Anything sent from now on is for the new connection
+		isOpen_=false;
+		if( connectingSocket_>=0 ) ::shutdown( connectingSocket_, SHUT_RDWR );
+	}
+	wake();
+}
+
+void clientserver::NativeClientTransport::send( bool isBinary, const std::string& message )
+{
+	bool wasEmpty;
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		if( !isOpen_ ) return;
+		wasEmpty=queuedOutput_.empty();
+		queueFrame( isBinary ? clientserver::WebSocketFramer::Opcode::binary : clientserver::WebSocketFramer::Opcode::text, message );
+	}
+	// If the queue already had something in it the I/O thread has already been woken
+	if( wasEmpty ) wake();
+}
+
+void clientserver::NativeClientTransport::close()
+{
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		++generation_;
+		openRequested_=false;
+		closeRequested_=true;
+		// Anything already queued still goes out before the close frame
+		isOpen_=false;
+		if( connectingSocket_>=0 ) ::shutdown( connectingSocket_, SHUT_RDWR );
+	}
+	wake();
+}
+
+void clientserver::NativeClientTransport::schedule( std::chrono::milliseconds delay, std::function<void()> function )
+{
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		timers_.insert( std::make_pair( std::chrono::steady_clock::now()+delay, std::move(function) ) );
+	}
+	wake();
+}
+
+void clientserver::NativeClientTransport::run()
+{
+	pollfd descriptors[2];
+	descriptors[1].fd=wakeEventFd_;
+	descriptors[1].events=POLLIN;
+
+	bool tryRead=false;
+	std::string url;
+	std::vector<std::function<void()> > dueTimers;
+	while( true )
+	{
+		bool shouldOpen=false;
+		bool shouldClose=false;
+		int pollTimeout=-1;
+		{
+			std::lock_guard<std::mutex> lock( mutex_ );
+			if( stopRequested_ ) break;
+			if( openRequested_ )
+			{
+				shouldOpen=true;
+				openRequested_=false;
+				url.swap( requestedUrl_ );
+				handlers_=std::move( requestedHandlers_ );
+				connectionGeneration_=generation_;
+			}
+			shouldClose=closeRequested_;
+			closeRequested_=false;
+
+			const auto now=std::chrono::steady_clock::now();
+			while( !timers_.empty() && timers_.begin()->first<=now )
+			{
+				dueTimers.push_back( std::move(timers_.begin()->second) );
+				timers_.erase( timers_.begin() );
+			}
+		}
+
+		if( shouldOpen || shouldClose ) closeGracefully();
+		if( shouldOpen )
+		{
+			try
+			{
+				openConnection( url );
+				tryRead=true; // The handshake response might have had frames after it
+				if( socket_>=0 && handlers_.open ) handlers_.open();
+			}
+			catch( std::exception& error )
+			{
+				if( connectionGeneration_==generation_ && handlers_.close ) handlers_.close( error.what() );
+			}
+		}
+		for( auto& function : dueTimers )
+		{
+			try
+			{
+				function();
+			}
+			catch( std::exception& error )
+			{
+				std::cerr << "NativeClientTransport scheduled function threw an exception: " << error.what() << std::endl;
+			}
+		}
+		dueTimers.clear();
+
+		if( socket_>=0 )
+		{
+			std::string closeReason;
+			if( tryRead && readAndDispatch( closeReason )==IoResult::closed ) closeConnection( closeReason );
+			else
+			{
+				{
+					std::lock_guard<std::mutex> lock( mutex_ );
+					if( outputPosition_==outputBuffer_.size() )
+					{
+						outputBuffer_.swap( queuedOutput_ );
+						queuedOutput_.clear();
+						outputPosition_=0;
+					}
+					else
+					{
+						outputBuffer_.append( queuedOutput_ );
+						queuedOutput_.clear();
+					}
+				}
+				if( flush()==IoResult::closed ) closeConnection( "Couldn't write to the connection" );
+			}
+		}
+
+		{
+			std::lock_guard<std::mutex> lock( mutex_ );
+			if( !timers_.empty() )
+			{
+				const auto untilNext=std::chrono::duration_cast<std::chrono::milliseconds>( timers_.begin()->first-std::chrono::steady_clock::now() ).count();
+				pollTimeout=static_cast<int>( std::max<decltype(untilNext)>( std::min<decltype(untilNext)>( untilNext+1, 60000 ), 0 ) );
+			}
+		}
+		descriptors[0].fd=socket_; // poll ignores negative descriptors
+		descriptors[0].events=POLLIN;
+		if( sessionWantsWrite_ || outputPosition_<outputBuffer_.size() ) descriptors[0].events|=POLLOUT;
+		descriptors[0].revents=0;
+		if( ::poll( descriptors, 2, pollTimeout )<0 )
+		{
+			if( errno==EINTR ) continue;
+			break;
+		}
+		if( descriptors[1].revents!=0 )
+		{
+			uint64_t value;
+			while( ::read( wakeEventFd_, &value, sizeof(value) )<0 && errno==EINTR );
+		}
+		tryRead=(descriptors[0].revents & (POLLIN | POLLERR | POLLHUP))!=0 || (sessionWantsWrite_ && (descriptors[0].revents & POLLOUT));
+	}
+
+	closeGracefully();
+}
+
+void clientserver::NativeClientTransport::wake()
+{
+	uint64_t value=1;
+	while( ::write( wakeEventFd_, &value, sizeof(value) )<0 && errno==EINTR );
+}
+
+void clientserver::NativeClientTransport::openConnection( const std::string& url )
+{
+	const ::Url parsedUrl=::parseUrl( url );
+
+	std::shared_ptr<clientserver::TlsContext> pTlsContext;
+	bool compressionEnabled;
+	clientserver::PerMessageDeflate::Configuration compressionConfiguration;
+	std::vector<std::shared_ptr<const clientserver::ZstdDictionary> > compressionDictionaries;
+	size_t dictionaryThreshold;
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		pTlsContext=pTlsContext_;
+		compressionEnabled=compressionEnabled_;
+		compressionConfiguration=compressionConfiguration_;
+		compressionDictionaries=compressionDictionaries_;
+		dictionaryThreshold=dictionaryThreshold_;
+	}
+	if( parsedUrl.isSecure && !pTlsContext ) throw std::runtime_error( "The TLS settings changed while connecting" );
+
+	int socket=clientserver::connectTcp( parsedUrl.host, parsedUrl.port );
+	int option=1;
+	::setsockopt( socket, IPPROTO_TCP, TCP_NODELAY, &option, sizeof(option) );
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		if( connectionGeneration_!=generation_ )
+		{
+			::close( socket );
+			return;
+		}
+		connectingSocket_=socket;
+	}
+
+	SSL* pSession=nullptr;
+	std::unique_ptr<clientserver::IMessageCompressor> pCompressor;
+	std::string initialData;
+	try
+	{
+		// Don't wait forever if the server never answers
+		timeval timeout{ ::handshakeTimeoutSeconds, 0 };
+		::setsockopt( socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout) );
+		::setsockopt( socket, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout) );
+
+		if( parsedUrl.isSecure )
+		{
+			pSession=pTlsContext->createSession( socket, false, parsedUrl.host );
+			if( SSL_connect( pSession )!=1 ) throw std::runtime_error( "TLS handshake failed: "+clientserver::lastTlsError() );
+		}
+
+		std::string key;
+		std::string offer=clientserver::ZstdDictionaryCompressor::createOffer( compressionDictionaries );
+		if( compressionEnabled ) offer+=(offer.empty() ? "" : ", ")+clientserver::PerMessageDeflate::createOffer( compressionConfiguration );
+		::writeAll( socket, pSession, clientserver::WebSocketHandshake::createRequest( parsedUrl.authority, parsedUrl.path, key, offer ) );
+
+		std::string response;
+		std::string extensions;
+		size_t responseSize;
+		clientserver::WebSocketHandshake::Result result=clientserver::WebSocketHandshake::Result::incomplete;
+		while( result==clientserver::WebSocketHandshake::Result::incomplete )
+		{
+			char buffer[4096];
+			response.append( buffer, ::readSome( socket, pSession, buffer, sizeof(buffer) ) );
+			result=clientserver::WebSocketHandshake::parseResponse( response.data(), response.size(), key, responseSize, &extensions );
+		}
+		if( result!=clientserver::WebSocketHandshake::Result::upgrade ) throw std::runtime_error( "The server refused the WebSocket upgrade: "+response.substr(0,response.find('\r')) );
+		clientserver::PerMessageDeflate::Parameters agreed;
+		if( auto pDictionary=clientserver::ZstdDictionaryCompressor::acceptResponse( extensions, compressionDictionaries ) )
+		{
+			pCompressor.reset( new clientserver::ZstdDictionaryCompressor( pDictionary, dictionaryThreshold ) );
+		}
+		else if( !compressionEnabled && !extensions.empty() ) throw std::runtime_error( "The server agreed to WebSocket extensions that weren't offered: \""+extensions+"\"" );
+		else if( compressionEnabled && clientserver::PerMessageDeflate::acceptResponse( extensions, compressionConfiguration, agreed ) )
+		{
+			pCompressor.reset( new clientserver::PerMessageDeflate( compressionConfiguration, agreed ) );
+		}
+		initialData=response.substr( responseSize );
+	}
+	catch( ... )
+	{
+		{
+			std::lock_guard<std::mutex> lock( mutex_ );
+			connectingSocket_=-1;
+		}
+		if( pSession ) SSL_free( pSession );
+		::close( socket );
+		throw;
+	}
+
+	::fcntl( socket, F_SETFL, ::fcntl( socket, F_GETFL )|O_NONBLOCK );
+	// The output buffer can be reallocated between retries of a write that would have blocked
+	if( pSession ) SSL_set_mode( pSession, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER );
+	socket_=socket;
+	pSession_=pSession;
+	pFramer_.reset( new clientserver::WebSocketFramer( clientserver::WebSocketFramer::Role::client ) );
+	pFramer_->setCompressor( pCompressor.get() );
+	pFramer_->append( initialData.data(), initialData.size() );
+
+	bool isWanted;
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		connectingSocket_=-1;
+		isWanted=(connectionGeneration_==generation_);
+		if( isWanted )
+		{
+			pCompressor_=std::move( pCompressor );
+			queuedOutput_.clear();
+			isOpen_=true;
+		}
+	}
+	// The compressor has to outlive the framer
+	if( !isWanted ) closeConnection( std::string() );
+}
+
+void clientserver::NativeClientTransport::closeConnection( const std::string& reason )
+{
+	if( socket_<0 ) return;
+
+	pFramer_.reset();
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		if( connectionGeneration_==generation_ ) isOpen_=false;
+		pCompressor_.reset();
+		queuedOutput_.clear();
+	}
+	if( pSession_ ) SSL_free( pSession_ );
+	pSession_=nullptr;
+	::close( socket_ );
+	socket_=-1;
+	sessionWantsWrite_=false;
+	outputBuffer_.clear();
+	outputPosition_=0;
+
+	if( !reason.empty() && connectionGeneration_==generation_ && handlers_.close ) handlers_.close( reason );
+}
+
+void clientserver::NativeClientTransport::closeGracefully()
+{
+	if( socket_<0 ) return;
+
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		outputBuffer_.append( queuedOutput_ );
+		queuedOutput_.clear();
+	}
+	const uint8_t mask[4]={ 0, 0, 0, 0 };
+	clientserver::WebSocketFramer::encodeClose( 1000, outputBuffer_, mask );
+
+	const auto deadline=std::chrono::steady_clock::now()+std::chrono::milliseconds(::closeTimeoutMilliseconds);
+	while( flush()==IoResult::wouldBlock && std::chrono::steady_clock::now()<deadline )
+	{
+		pollfd descriptor{ socket_, POLLOUT, 0 };
+		::poll( &descriptor, 1, ::closeTimeoutMilliseconds/10 );
+	}
+	::shutdown( socket_, SHUT_RDWR );
+	closeConnection( std::string() );
+}
+
+void clientserver::NativeClientTransport::queueFrame( clientserver::WebSocketFramer::Opcode opcode, const std::string& payload )
+{
+	const uint32_t randomMask=maskGenerator_();
+	const uint8_t mask[4]={ static_cast<uint8_t>(randomMask), static_cast<uint8_t>(randomMask>>8), static_cast<uint8_t>(randomMask>>16), static_cast<uint8_t>(randomMask>>24) };
+	const bool isDataFrame=(opcode==clientserver::WebSocketFramer::Opcode::text || opcode==clientserver::WebSocketFramer::Opcode::binary);
+	if( isDataFrame && pCompressor_ && pCompressor_->shouldCompress( payload.size() ) )
+	{
+		compressBuffer_.clear();
+		pCompressor_->compress( payload.data(), payload.size(), compressBuffer_, true );
+		clientserver::WebSocketFramer::encodeHeader( opcode, compressBuffer_.size(), queuedOutput_, mask, true );
+		const size_t payloadStart=queuedOutput_.size();
+		queuedOutput_+=compressBuffer_;
+		clientserver::applyWebSocketMask( &queuedOutput_[payloadStart], compressBuffer_.size(), mask );
+	}
+	else clientserver::WebSocketFramer::encode( opcode, payload, queuedOutput_, mask );
+}
+
+clientserver::NativeClientTransport::IoResult clientserver::NativeClientTransport::readAndDispatch( std::string& closeReason )
+{
+	// The handshake response can have had frames after it, which won't wake poll() again
+	if( dispatchFrames( closeReason )==IoResult::closed ) return IoResult::closed;
+
+	while( true )
+	{
+		char* pBuffer=pFramer_->reserve( ::readSize );
+		ssize_t bytesRead;
+		if( pSession_ )
+		{
+			sessionWantsWrite_=false;
+			bytesRead=SSL_read( pSession_, pBuffer, ::readSize );
+			if( bytesRead<=0 )
+			{
+				const int error=SSL_get_error( pSession_, static_cast<int>(bytesRead) );
+				if( error==SSL_ERROR_WANT_READ ) return IoResult::wouldBlock;
+				if( error==SSL_ERROR_WANT_WRITE )
+				{
+					sessionWantsWrite_=true;
+					return IoResult::wouldBlock;
+				}
+				closeReason="The connection was lost";
+				return IoResult::closed;
+			}
+		}
+		else
+		{
+			bytesRead=::recv( socket_, pBuffer, ::readSize, 0 );
+			if( bytesRead<0 )
+			{
+				if( errno==EINTR ) continue;
+				if( errno==EAGAIN || errno==EWOULDBLOCK ) return IoResult::wouldBlock;
+			}
+			if( bytesRead<=0 )
+			{
+				closeReason="The connection was lost";
+				return IoResult::closed;
+			}
+		}
+		pFramer_->commit( bytesRead );
+		if( dispatchFrames( closeReason )==IoResult::closed ) return IoResult::closed;
+
+		// A short read from a plain socket means everything has been read. There's no way to tell
+		// with TLS because OpenSSL buffers internally, so for that carry on until it says to stop.
+		if( !pSession_ && static_cast<size_t>(bytesRead)<::readSize ) return IoResult::wouldBlock;
+	}
+}
+
+clientserver::NativeClientTransport::IoResult clientserver::NativeClientTransport::dispatchFrames( std::string& closeReason )
+{
+	typedef clientserver::WebSocketFramer::Opcode Opcode;
+	Opcode opcode;
+	std::string message;
+
+	try
+	{
+		while( pFramer_->next( opcode, message ) )
+		{
+			if( opcode==Opcode::text || opcode==Opcode::binary )
+			{
+				// Once close() or open() has been called the messages are for nobody
+				if( connectionGeneration_!=generation_ || !handlers_.message ) continue;
+				try
+				{
+					handlers_.message( opcode==Opcode::binary, message );
+				}
+				catch( std::exception& error )
+				{
+					std::cerr << "NativeClientTransport message handler threw an exception: " << error.what() << std::endl;
+				}
+			}
+			else if( opcode==Opcode::ping )
+			{
+				std::lock_guard<std::mutex> lock( mutex_ );
+				queueFrame( Opcode::pong, message );
+			}
+			else if( opcode==Opcode::close )
+			{
+				// Reply in kind, but it doesn't matter if that fails
+				const uint8_t mask[4]={ 0, 0, 0, 0 };
+				clientserver::WebSocketFramer::encodeClose( 1000, outputBuffer_, mask );
+				flush();
+				closeReason="The server closed the connection";
+				return IoResult::closed;
+			}
+		}
+	}
+	catch( std::exception& error )
+	{
+		closeReason=std::string( "Invalid message from the server: " )+error.what();
+		return IoResult::closed;
+	}
+	return IoResult::ok;
+}
+
+clientserver::NativeClientTransport::IoResult clientserver::NativeClientTransport::flush()
+{
+	while( outputPosition_<outputBuffer_.size() )
+	{
+		const char* pData=outputBuffer_.data()+outputPosition_;
+		const size_t size=outputBuffer_.size()-outputPosition_;
+		ssize_t bytesWritten;
+		if( pSession_ )
+		{
+			bytesWritten=SSL_write( pSession_, pData, static_cast<int>(std::min<size_t>(size,0x7fffffff)) );
+			if( bytesWritten<=0 )
+			{
+				const int error=SSL_get_error( pSession_, static_cast<int>(bytesWritten) );
+				if( error==SSL_ERROR_WANT_READ || error==SSL_ERROR_WANT_WRITE ) return IoResult::wouldBlock;
+				return IoResult::closed;
+			}
+		}
+		else
+		{
+			bytesWritten=::send( socket_, pData, size, MSG_NOSIGNAL );
+			if( bytesWritten<0 )
+			{
+				if( errno==EINTR ) continue;
+				if( errno==EAGAIN || errno==EWOULDBLOCK ) return IoResult::wouldBlock;
+				return IoResult::closed;
+			}
+		}
+		outputPosition_+=bytesWritten;
+	}
+
+	outputBuffer_.clear();
+	outputPosition_=0;
+	return IoResult::ok;
+}
@@ -0,0 +1,299 @@
+#include "clientserver/PerMessageDeflate.h"
+
+#include <stdexcept>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <cctype>
+#include <zlib.h>
+#include "clientserver/DeflateStreamPool.h"
+#include "clientserver/WebSocketHandshake.h"
+
+namespace
+{
+	/** @brief What a sync flush ends with. RFC 7692 section 7.2.1 says to leave it off each message, and the receiver adds it back. */
+	const char syncFlushTail[4]={ 0x00, 0x00, static_cast<char>(0xff), static_cast<char>(0xff) };
+	/** @brief zlib can't do raw deflate with an 8 bit window, so offers that need it have to be declined. */
+	const int minimumCompressWindowBits=9;
+
+	/** @brief Parses a window bits value, returning zero if it isn't a number from 8 to 15. */
+	int parseWindowBits( const std::string& value )
+	{
+		if( value.empty() || value.size()>2 || !std::all_of( value.begin(), value.end(), [](unsigned char character){ return std::isdigit(character); } ) ) return 0;
+		const int windowBits=std::stoi( value );
+		return (windowBits>=8 && windowBits<=15) ? windowBits : 0;
+	}
+
+	typedef clientserver::WebSocketHandshake::Extension Extension;
+
+	/** @brief Whether each parameter only appears once, as required by RFC 7692 section 7. */
+	bool hasDuplicates( const Extension& extension )
+	{
+		for( size_t index=0; index<extension.parameters.size(); ++index )
+		{
+			for( size_t other=index+1; other<extension.parameters.size(); ++other )
+			{
+				if( extension.parameters[index].first==extension.parameters[other].first ) return true;
+			}
+		}
+		return false;
+	}
+
+	/** @brief Makes sure there are at least minimumSpace bytes after "used" in output, and points the stream at them. */
+	void prepareOutput( z_stream& stream, std::string& output, size_t used, size_t minimumSpace )
+	{
+		if( output.size()-used<minimumSpace ) output.resize( used+minimumSpace );
+		stream.next_out=reinterpret_cast<Bytef*>(&output[used]);
+		stream.avail_out=static_cast<uInt>( output.size()-used );
+	}
+} // end of the unnamed namespace
+
+clientserver::PerMessageDeflate::Configuration::Configuration()
+	: threshold(256), level(6), memoryLevel(8), windowBits(15), contextTakeover(true), peerContextTakeover(true)
+{
+	// No operation besides the initialiser list
+}
+
+clientserver::PerMessageDeflate::Parameters::Parameters()
+	: compressNoContextTakeover(false), decompressNoContextTakeover(false), compressWindowBits(15), decompressWindowBits(15)
+{
+	// No operation besides the initialiser list
+}
+
+std::string clientserver::PerMessageDeflate::createOffer( const Configuration& configuration )
+{
+	std::string offer="permessage-deflate; client_max_window_bits";
+	if( configuration.windowBits<15 )
+	{
+		offer+="="+std::to_string(configuration.windowBits);
+		offer+="; server_max_window_bits="+std::to_string(configuration.windowBits);
+	}
+	if( !configuration.contextTakeover ) offer+="; client_no_context_takeover";
+	if( !configuration.peerContextTakeover ) offer+="; server_no_context_takeover";
+	return offer;
+}
+
+bool clientserver::PerMessageDeflate::acceptOffer( const std::string& offers, const Configuration& configuration, Parameters& agreed, std::string& response )
+{
+	for( const auto& extension : clientserver::WebSocketHandshake::parseExtensions( offers ) )
+	{
+		if( extension.name!="permessage-deflate" || ::hasDuplicates( extension ) ) continue;
+
+		Parameters parameters;
+		parameters.compressNoContextTakeover=!configuration.contextTakeover;
+		parameters.decompressNoContextTakeover=!configuration.peerContextTakeover;
+		parameters.compressWindowBits=configuration.windowBits;
+		bool clientWindowBitsOffered=false;
+		bool acceptable=true;
+		for( const auto& parameter : extension.parameters )
+		{
+			if( parameter.first=="server_no_context_takeover" && parameter.second.empty() ) parameters.compressNoContextTakeover=true;
+			else if( parameter.first=="client_no_context_takeover" && parameter.second.empty() ) parameters.decompressNoContextTakeover=true;
+			else if( parameter.first=="server_max_window_bits" )
+			{
+				const int windowBits=::parseWindowBits( parameter.second );
+				if( windowBits<::minimumCompressWindowBits ) acceptable=false;
+				else parameters.compressWindowBits=std::min( parameters.compressWindowBits, windowBits );
+			}
+			else if( parameter.first=="client_max_window_bits" )
+			{
+				clientWindowBitsOffered=true;
+				if( !parameter.second.empty() )
+				{
+					const int windowBits=::parseWindowBits( parameter.second );
+					if( windowBits==0 ) acceptable=false;
+					else parameters.decompressWindowBits=windowBits;
+				}
+			}
+			else acceptable=false;
+		}
+		if( !acceptable ) continue;
+
+		// Only ask the client to use a smaller window if it said it can
+		if( clientWindowBitsOffered ) parameters.decompressWindowBits=std::min( parameters.decompressWindowBits, configuration.windowBits );
+
+		response="permessage-deflate";
+		if( parameters.compressNoContextTakeover ) response+="; server_no_context_takeover";
+		if( parameters.decompressNoContextTakeover ) response+="; client_no_context_takeover";
+		if( parameters.compressWindowBits<15 ) response+="; server_max_window_bits="+std::to_string(parameters.compressWindowBits);
+		if( clientWindowBitsOffered && parameters.decompressWindowBits<15 ) response+="; client_max_window_bits="+std::to_string(parameters.decompressWindowBits);
+		agreed=parameters;
+		return true;
+	}
+	return false;
+}
+
+bool clientserver::PerMessageDeflate::acceptResponse( const std::string& response, const Configuration& configuration, Parameters& agreed )
+{
+	const std::vector<Extension> extensions=clientserver::WebSocketHandshake::parseExtensions( response );
+	if( extensions.empty() ) return false;
+	if( extensions.size()!=1 || extensions.front().name!="permessage-deflate" ) throw std::runtime_error( "The server agreed to WebSocket extensions that weren't offered: \""+response+"\"" );
+	if( ::hasDuplicates( extensions.front() ) ) throw std::runtime_error( "The server's permessage-deflate response has duplicate parameters: \""+response+"\"" );
+
+	Parameters parameters;
+	parameters.compressNoContextTakeover=!configuration.contextTakeover;
+	parameters.compressWindowBits=configuration.windowBits;
+	for( const auto& parameter : extensions.front().parameters )
+	{
+		if( parameter.first=="server_no_context_takeover" && parameter.second.empty() ) parameters.decompressNoContextTakeover=true;
+		else if( parameter.first=="client_no_context_takeover" && parameter.second.empty() ) parameters.compressNoContextTakeover=true;
+		else if( parameter.first=="server_max_window_bits" && ::parseWindowBits(parameter.second)!=0 ) parameters.decompressWindowBits=::parseWindowBits( parameter.second );
+		else if( parameter.first=="client_max_window_bits" && ::parseWindowBits(parameter.second)!=0 )
+		{
+			const int windowBits=::parseWindowBits( parameter.second );
+			if( windowBits<::minimumCompressWindowBits ) throw std::runtime_error( "The server asked for a compression window of "+std::to_string(windowBits)+" bits, which zlib doesn't support" );
+			parameters.compressWindowBits=std::min( parameters.compressWindowBits, windowBits );
+		}
+		else throw std::runtime_error( "The server's permessage-deflate response has an invalid parameter \""+parameter.first+"\"" );
+	}
+	agreed=parameters;
+	return true;
+}
+
+clientserver::PerMessageDeflate::PerMessageDeflate( const Configuration& configuration, const Parameters& parameters, clientserver::DeflateStreamPool* pPool )
+	: configuration_(configuration), parameters_(parameters), pPool_(pPool), pCompressor_(nullptr), pDecompressor_(nullptr)
+{
+	// No operation besides the initialiser list
+}
+
+clientserver::PerMessageDeflate::~PerMessageDeflate()
+{
+	releaseCompressor();
+	releaseDecompressor();
+}
+
+bool clientserver::PerMessageDeflate::shouldCompress( size_t size ) const
+{
+	return size>=configuration_.threshold;
+}
+
+void clientserver::PerMessageDeflate::compress( const char* pData, size_t size, std::string& output, bool isLastPart )
+{
+	if( !pCompressor_ )
+	{
+		if( pPool_ ) pCompressor_=pPool_->acquireCompressor( configuration_.level, parameters_.compressWindowBits, configuration_.memoryLevel );
+		else pCompressor_=clientserver::DeflateStreamPool::createCompressor( configuration_.level, parameters_.compressWindowBits, configuration_.memoryLevel );
+	}
+	z_stream& stream=*pCompressor_;
+
+	stream.next_in=reinterpret_cast<Bytef*>(const_cast<char*>(pData));
+	stream.avail_in=static_cast<uInt>( size );
+	size_t used=output.size();
+	// deflateBound() is for a whole stream, but is a good guess for one flush
+	size_t space=::deflateBound( &stream, static_cast<uLong>(size) )+sizeof(::syncFlushTail);
+	do
+	{
+		::prepareOutput( stream, output, used, space );
+		const int result=::deflate( &stream, isLastPart ? Z_SYNC_FLUSH : Z_NO_FLUSH );
+		used=output.size()-stream.avail_out;
+		// Z_BUF_ERROR only means there was nothing left to do
+		if( result!=Z_OK && result!=Z_BUF_ERROR )
+		{
+			output.resize( used );
+			throw std::runtime_error( "zlib failed to compress a WebSocket message ("+std::to_string(result)+")" );
+		}
+		space=std::max<size_t>( space, 1024 );
+	} while( stream.avail_out==0 );
+	output.resize( used );
+
+	if( isLastPart )
+	{
+		if( output.size()>=sizeof(::syncFlushTail) && std::equal( ::syncFlushTail, ::syncFlushTail+sizeof(::syncFlushTail), output.end()-sizeof(::syncFlushTail) ) )
+		{
+			output.resize( output.size()-sizeof(::syncFlushTail) );
+		}
+		finishCompressing();
+	}
+}
+
+void clientserver::PerMessageDeflate::decompress( const char* pData, size_t size, std::string& output, size_t maximumSize )
+{
+	if( !pDecompressor_ )
+	{
+		if( pPool_ ) pDecompressor_=pPool_->acquireDecompressor( parameters_.decompressWindowBits );
+		else pDecompressor_=clientserver::DeflateStreamPool::createDecompressor( parameters_.decompressWindowBits );
+	}
+	z_stream& stream=*pDecompressor_;
+
+	const size_t start=output.size();
+	size_t used=start;
+	// The message, then the tail that the sender removed
+	const std::pair<const char*,size_t> pieces[]={ std::make_pair(pData,size), std::make_pair(::syncFlushTail,sizeof(::syncFlushTail)) };
+	for( const auto& piece : pieces )
+	{
+		stream.next_in=reinterpret_cast<Bytef*>(const_cast<char*>(piece.first));
+		stream.avail_in=static_cast<uInt>( piece.second );
+		bool finished=false;
+		while( !finished )
+		{
+			// Never make room for more than one byte over the maximum, so that a small message can't make us inflate gigabytes
+			const size_t produced=used-start;
+			if( produced>maximumSize )
+			{
+				output.resize( start );
+				releaseDecompressor();
+				throw std::length_error( "WebSocket message is larger than the maximum of "+std::to_string(maximumSize)+" bytes once decompressed" );
+			}
+			::prepareOutput( stream, output, used, std::min( std::max<size_t>(4*piece.second,4096), maximumSize+1-produced ) );
+
+			const int result=::inflate( &stream, Z_SYNC_FLUSH );
+			used=output.size()-stream.avail_out;
+			if( result==Z_STREAM_END )
+			{
+				// The sender set BFINAL, so anything after that is ignored and the next message starts afresh
+				::inflateReset( &stream );
+				finished=true;
+			}
+			else if( result==Z_OK || result==Z_BUF_ERROR ) finished=(stream.avail_in==0 && stream.avail_out!=0);
+			else
+			{
+				output.resize( start );
+				releaseDecompressor();
+				throw std::runtime_error( "Received a WebSocket message with invalid compressed data ("+std::to_string(result)+")" );
+			}
+		}
+	}
+	if( used-start>maximumSize )
+	{
+		output.resize( start );
+		releaseDecompressor();
+		throw std::length_error( "WebSocket message is larger than the maximum of "+std::to_string(maximumSize)+" bytes once decompressed" );
+	}
+	output.resize( used );
+	finishDecompressing();
+}
+
+bool clientserver::PerMessageDeflate::holdsStreams() const
+{
+	return pCompressor_!=nullptr || pDecompressor_!=nullptr;
+}
+
+void clientserver::PerMessageDeflate::finishCompressing()
+{
+	if( !parameters_.compressNoContextTakeover ) return;
+	if( pPool_ ) releaseCompressor();
+	else ::deflateReset( pCompressor_ );
+}
+
+void clientserver::PerMessageDeflate::finishDecompressing()
+{
+	if( !parameters_.decompressNoContextTakeover ) return;
+	if( pPool_ ) releaseDecompressor();
+	else ::inflateReset( pDecompressor_ );
+}
+
+void clientserver::PerMessageDeflate::releaseCompressor()
+{
+	if( !pCompressor_ ) return;
+	if( pPool_ ) pPool_->releaseCompressor( pCompressor_, configuration_.level, parameters_.compressWindowBits, configuration_.memoryLevel );
+	else clientserver::DeflateStreamPool::destroyCompressor( pCompressor_ );
+	pCompressor_=nullptr;
+}
+
+void clientserver::PerMessageDeflate::releaseDecompressor()
+{
+	if( !pDecompressor_ ) return;
+	if( pPool_ ) pPool_->releaseDecompressor( pDecompressor_, parameters_.decompressWindowBits );
+	else clientserver::DeflateStreamPool::destroyDecompressor( pDecompressor_ );
+	pDecompressor_=nullptr;
+}
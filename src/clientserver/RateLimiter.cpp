@@ -0,0 +1,202 @@
+#include "clientserver/RateLimiter.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <chrono>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+namespace // Unnamed namespace for things only used in this file
+{
+	int64_t nowNanoseconds()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+	}
+
+	/** @brief Adds the tokens gained since the bucket was last refilled. */
+	void refill( clientserver::RateLimiter::Bucket& bucket, const clientserver::RateLimiter::Limit& limit, int64_t now )
+	{
+		if( bucket.lastRefill==0 ) bucket.tokens=limit.burst;
+		else bucket.tokens=std::min( limit.burst, bucket.tokens+(now-bucket.lastRefill)*1e-9*limit.perSecond );
+		bucket.lastRefill=now;
+	}
+
+	/** @brief Whether the bucket can take the cost. Costs bigger than the burst get through a full bucket, rather than never. */
+	bool hasRoom( const clientserver::RateLimiter::Bucket& bucket, const clientserver::RateLimiter::Limit& limit, double cost )
+	{
+		return limit.perSecond==0 || bucket.tokens>=std::min( cost, limit.burst );
+	}
+
+	void consume( clientserver::RateLimiter::Bucket& bucket, const clientserver::RateLimiter::Limit& limit, double cost )
+	{
+		if( limit.perSecond!=0 ) bucket.tokens-=cost;
+	}
+
+	/** @brief Whether the bucket would be full by now if it were refilled, in which case it's no different to a new one. */
+	bool wouldBeFull( const clientserver::RateLimiter::Bucket& bucket, const clientserver::RateLimiter::Limit& limit, int64_t now )
+	{
+		return limit.perSecond==0 || bucket.lastRefill==0 || bucket.tokens+(now-bucket.lastRefill)*1e-9*limit.perSecond>=limit.burst;
+	}
+
+	/** @brief Checks the values and fills in the default burst. */
+	clientserver::RateLimiter::Limit resolve( clientserver::RateLimiter::Limit limit )
+	{
+		if( limit.perSecond<0 || limit.burst<0 ) throw std::invalid_argument( "RateLimiter was given a negative rate or burst" );
+		if( limit.burst==0 ) limit.burst=limit.perSecond;
+		return limit;
+	}
+
+	/** @brief The first eight bytes of the address as a big endian number. */
+	uint64_t readUint64( const uint8_t* pBytes )
+	{
+		uint64_t value=0;
+		for( size_t index=0; index<8; ++index ) value=(value << 8) | pBytes[index];
+		return value;
+	}
+} // end of the unnamed namespace
+
+const size_t clientserver::RateLimiter::numberOfLimits;
+const size_t clientserver::RateLimiter::numberOfShards;
+const size_t clientserver::RateLimiter::minimumSweepSize;
+
+clientserver::RateLimiter::ConnectionState::ConnectionState()
+	: messages_{ 0, 0 }, bytes_{ 0, 0 }, hasAddress_(false), address_{ 0, 0 }
+{
+	// No operation besides the initialiser list
+}
+
+clientserver::RateLimiter::ConnectionState::ConnectionState( int socket )
+	: ConnectionState()
+{
+	sockaddr_storage address;
+	socklen_t addressLength=sizeof(address);
+	if( ::getpeername( socket, reinterpret_cast<sockaddr*>(&address), &addressLength )!=0 ) return;
+
+	if( address.ss_family==AF_INET6 )
+	{
+		const uint8_t* pBytes=reinterpret_cast<const sockaddr_in6*>(&address)->sin6_addr.s6_addr;
+		address_.high=::readUint64( pBytes );
+		address_.low=::readUint64( pBytes+8 );
+		// Hosts usually get a whole /64, so the rest of a real IPv6 address can be anything they like
+		if( !IN6_IS_ADDR_V4MAPPED( &reinterpret_cast<const sockaddr_in6*>(&address)->sin6_addr ) ) address_.low=0;
+		hasAddress_=true;
+	}
+	else if( address.ss_family==AF_INET )
+	{
+		// The same as the IPv4 mapped IPv6 address, so that it doesn't matter how the socket was opened
+		const uint8_t* pBytes=reinterpret_cast<const uint8_t*>( &reinterpret_cast<const sockaddr_in*>(&address)->sin_addr.s_addr );
+		address_.high=0;
+		address_.low=0xffff00000000ull | (uint64_t(pBytes[0]) << 24) | (uint64_t(pBytes[1]) << 16) | (uint64_t(pBytes[2]) << 8) | pBytes[3];
+		hasAddress_=true;
+	}
+}
+
+size_t clientserver::RateLimiter::AddressHash::operator()( const Address& address ) const
+{
+	// The finaliser from splitmix64, since the low bits of addresses are often all the same
+	uint64_t hash=address.high*0x9e3779b97f4a7c15ull ^ address.low;
+	hash=(hash ^ (hash >> 30))*0xbf58476d1ce4e5b9ull;
+	hash=(hash ^ (hash >> 27))*0x94d049bb133111ebull;
+	return static_cast<size_t>( hash ^ (hash >> 31) );
+}
+
+clientserver::RateLimiter::RateLimiter( const Configuration& configuration )
+	: configuration_{ ::resolve(configuration.connectionMessages), ::resolve(configuration.connectionBytes), ::resolve(configuration.addressMessages), ::resolve(configuration.addressBytes) },
+	  hasConnectionLimits_( configuration.connectionMessages.perSecond!=0 || configuration.connectionBytes.perSecond!=0 ),
+	  hasAddressLimits_( configuration.addressMessages.perSecond!=0 || configuration.addressBytes.perSecond!=0 )
+{
+	for( auto& rejections : rejections_ ) rejections=0;
+	if( hasAddressLimits_ )
+	{
+		for( size_t index=0; index<numberOfShards; ++index ) shards_.emplace_back( new Shard );
+	}
+}
+
+clientserver::RateLimiter::Verdict clientserver::RateLimiter::admit( ConnectionState& state, size_t messageSize )
+{
+	if( !hasConnectionLimits_ && !(hasAddressLimits_ && state.hasAddress_) ) return Verdict::allowed;
+	const int64_t now=::nowNanoseconds();
+	const double size=static_cast<double>( messageSize );
+
+	if( hasConnectionLimits_ )
+	{
+		::refill( state.messages_, configuration_.connectionMessages, now );
+		::refill( state.bytes_, configuration_.connectionBytes, now );
+		if( !::hasRoom( state.messages_, configuration_.connectionMessages, 1 ) ) return reject( Verdict::connectionMessages );
+		if( !::hasRoom( state.bytes_, configuration_.connectionBytes, size ) ) return reject( Verdict::connectionBytes );
+	}
+
+	if( hasAddressLimits_ && state.hasAddress_ )
+	{
+		Shard& shard=*shards_[ AddressHash()(state.address_)%numberOfShards ];
+		std::lock_guard<std::mutex> lock( shard.mutex );
+		auto iBuckets=shard.buckets.find( state.address_ );
+		if( iBuckets==shard.buckets.end() )
+		{
+			if( shard.buckets.size()>=shard.nextSweepSize ) sweep( shard, now );
+			iBuckets=shard.buckets.emplace( state.address_, AddressBuckets{ { 0, 0 }, { 0, 0 } } ).first;
+		}
+		AddressBuckets& buckets=iBuckets->second;
+		::refill( buckets.messages, configuration_.addressMessages, now );
+		::refill( buckets.bytes, configuration_.addressBytes, now );
+		if( !::hasRoom( buckets.messages, configuration_.addressMessages, 1 ) ) return reject( Verdict::addressMessages );
+		if( !::hasRoom( buckets.bytes, configuration_.addressBytes, size ) ) return reject( Verdict::addressBytes );
+		::consume( buckets.messages, configuration_.addressMessages, 1 );
+		::consume( buckets.bytes, configuration_.addressBytes, size );
+	}
+
+	if( hasConnectionLimits_ )
+	{
+		::consume( state.messages_, configuration_.connectionMessages, 1 );
+		::consume( state.bytes_, configuration_.connectionBytes, size );
+	}
+	return Verdict::allowed;
+}
+
+uint64_t clientserver::RateLimiter::rejections( Verdict limit ) const
+{
+	if( limit==Verdict::allowed ) throw std::invalid_argument( "RateLimiter doesn't count the messages it allows" );
+	return rejections_[static_cast<size_t>(limit)-1];
+}
+
+size_t clientserver::RateLimiter::numberOfAddresses() const
+{
+	size_t total=0;
+	for( const auto& pShard : shards_ )
+	{
+		std::lock_guard<std::mutex> lock( pShard->mutex );
+		total+=pShard->buckets.size();
+	}
+	return total;
+}
+
+const char* clientserver::RateLimiter::name( Verdict verdict )
+{
+	switch( verdict )
+	{
+		case Verdict::allowed : return "allowed";
+		case Verdict::connectionMessages : return "connection messages";
+		case Verdict::connectionBytes : return "connection bytes";
+		case Verdict::addressMessages : return "address messages";
+		case Verdict::addressBytes : return "address bytes";
+	}
+	return "unknown";
+}
+
+void clientserver::RateLimiter::sweep( Shard& shard, int64_t now )
+{
+	for( auto iBuckets=shard.buckets.begin(); iBuckets!=shard.buckets.end(); )
+	{
+		const AddressBuckets& buckets=iBuckets->second;
+		if( ::wouldBeFull( buckets.messages, configuration_.addressMessages, now ) && ::wouldBeFull( buckets.bytes, configuration_.addressBytes, now ) ) iBuckets=shard.buckets.erase( iBuckets );
+		else ++iBuckets;
+	}
+	// Sweeping again straight away would be a waste if most of them are still busy
+	shard.nextSweepSize=std::max( minimumSweepSize, 2*shard.buckets.size() );
+}
+
+clientserver::RateLimiter::Verdict clientserver::RateLimiter::reject( Verdict limit )
+{
+	rejections_[static_cast<size_t>(limit)-1].fetch_add( 1, std::memory_order_relaxed );
+	return limit;
+}
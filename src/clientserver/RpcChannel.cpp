@@ -0,0 +1,7 @@
+#include "clientserver/RpcChannel.h"
+
+clientserver::RpcChannel::RpcChannel( SendRequestFunction sendRequest )
+	: sendRequest_( std::move(sendRequest) )
+{
+	// No operation besides the initialiser list
+}
@@ -0,0 +1,70 @@
+#include "clientserver/RpcCodec.h"
+
+#include <google/protobuf/message_lite.h>
+
+clientserver::RpcError::RpcError( RpcStatus status, const std::string& message )
+	: std::runtime_error(message), status_(status)
+{
+	// No operation besides the initialiser list
+}
+
+clientserver::RpcStatus clientserver::RpcError::status() const
+{
+	return status_;
+}
+
+void clientserver::RpcCodec::encodeRequest( uint32_t methodId, const google::protobuf::MessageLite& request, std::string& output )
+{
+	char header[maximumRequestHeaderSize];
+	size_t headerSize=0;
+	do
+	{
+		header[headerSize]=static_cast<char>( (methodId & 0x7f) | (methodId>0x7f ? 0x80 : 0) );
+		methodId>>=7;
+		++headerSize;
+	} while( methodId!=0 );
+
+	output.reserve( output.size()+headerSize+request.ByteSizeLong() );
+	output.append( header, headerSize );
+	request.AppendToString( &output );
+}
+
+size_t clientserver::RpcCodec::decodeRequestHeader( const char* pData, size_t size, uint32_t& methodId )
+{
+	uint64_t value=0;
+	for( size_t index=0; index<size && index<maximumRequestHeaderSize; ++index )
+	{
+		const uint8_t byte=static_cast<uint8_t>(pData[index]);
+		value|=static_cast<uint64_t>(byte & 0x7f)<<(7*index);
+		if( (byte & 0x80)==0 )
+		{
+			if( value>0xffffffff ) break;
+			methodId=static_cast<uint32_t>(value);
+			return index+1;
+		}
+	}
+	throw std::runtime_error( "RpcCodec received a request without a valid method id" );
+}
+
+void clientserver::RpcCodec::encodeResponse( const google::protobuf::MessageLite& response, std::string& output )
+{
+	output.reserve( output.size()+1+response.ByteSizeLong() );
+	output.push_back( static_cast<char>(RpcStatus::ok) );
+	response.AppendToString( &output );
+}
+
+void clientserver::RpcCodec::encodeError( RpcStatus status, const std::string& message, std::string& output )
+{
+	output.push_back( static_cast<char>(status) );
+	output.append( message );
+}
+
+size_t clientserver::RpcCodec::decodeResponseHeader( const char* pData, size_t size )
+{
+	// An empty response is what the servers send if the handler threw an exception
+	if( size==0 ) throw clientserver::RpcError( RpcStatus::handlerError, "The server sent an empty RPC response" );
+
+	const RpcStatus status=static_cast<RpcStatus>(pData[0]);
+	if( status!=RpcStatus::ok ) throw clientserver::RpcError( status, std::string( pData+1, size-1 ) );
+	return 1;
+}
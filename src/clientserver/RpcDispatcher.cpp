@@ -0,0 +1,68 @@
+#include "clientserver/RpcDispatcher.h"
+
+clientserver::RpcDispatcher::RpcDispatcher()
+	: requestsHandled_(0), useArenas_(true)
+{
+	// No operation besides the initialiser list
+}
+
+void clientserver::RpcDispatcher::setUseArenas( bool useArenas )
+{
+	useArenas_=useArenas;
+}
+
+void clientserver::RpcDispatcher::addMethod( uint32_t methodId, RawHandler handler )
+{
+	if( methodId>maximumMethodId ) throw std::invalid_argument( "RpcDispatcher method id "+std::to_string(methodId)+" is larger than the maximum of "+std::to_string(maximumMethodId) );
+	if( methodId<methods_.size() && methods_[methodId] ) throw std::invalid_argument( "RpcDispatcher already has a method with id "+std::to_string(methodId) );
+	if( !handler ) throw std::invalid_argument( "RpcDispatcher was given an empty handler for method id "+std::to_string(methodId) );
+
+	if( methodId>=methods_.size() ) methods_.resize( methodId+1 );
+	methods_[methodId]=std::move(handler);
+}
+
+std::string clientserver::RpcDispatcher::handleRequest( const std::string& request, std::weak_ptr<clientserver::IConnection> pConnection )
+{
+	requestsHandled_.fetch_add( 1, std::memory_order_relaxed );
+
+	std::string response;
+	uint32_t methodId;
+	size_t headerSize;
+	try
+	{
+		headerSize=clientserver::RpcCodec::decodeRequestHeader( request.data(), request.size(), methodId );
+	}
+	catch( std::runtime_error& error )
+	{
+		clientserver::RpcCodec::encodeError( RpcStatus::invalidRequest, error.what(), response );
+		return response;
+	}
+
+	if( methodId>=methods_.size() || !methods_[methodId] )
+	{
+		clientserver::RpcCodec::encodeError( RpcStatus::unknownMethod, "There is no method with id "+std::to_string(methodId), response );
+		return response;
+	}
+
+	try
+	{
+		// The request is parsed directly from the received message
+		const RpcStatus status=methods_[methodId]( request.data()+headerSize, request.size()-headerSize, response, pConnection );
+		if( status!=RpcStatus::ok )
+		{
+			response.clear();
+			clientserver::RpcCodec::encodeError( status, (status==RpcStatus::invalidRequest ? "Couldn't parse the request for method id " : "Failed to handle method id ")+std::to_string(methodId), response );
+		}
+	}
+	catch( std::exception& error )
+	{
+		response.clear();
+		clientserver::RpcCodec::encodeError( RpcStatus::handlerError, error.what(), response );
+	}
+	return response;
+}
+
+uint64_t clientserver::RpcDispatcher::requestsHandled() const
+{
+	return requestsHandled_.load( std::memory_order_relaxed );
+}
@@ -0,0 +1,340 @@
+#include "clientserver/SharedMemoryChannel.h"
+
+#include <system_error>
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace
+{
+	/** @brief The number of descriptors passed over the socket, i.e. the memfd followed by four eventfds. */
+	const size_t numberOfDescriptors=5;
+
+	/** @brief Seals the server insists on, so that the client can't shrink the memory once it's mapped and make the next access SIGBUS. */
+	const int requiredSeals=F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL;
+
+	void throwSystemError( const std::string& what )
+	{
+		throw std::system_error( errno, std::system_category(), what );
+	}
+
+	void signalEventFd( int fd )
+	{
+		uint64_t value=1;
+		while( ::write( fd, &value, sizeof(value) )<0 && errno==EINTR );
+	}
+
+	void drainEventFd( int fd )
+	{
+		uint64_t value;
+		while( ::read( fd, &value, sizeof(value) )<0 && errno==EINTR );
+	}
+
+	/** @brief Tells the CPU this is a spin loop, so that it can save power and give resources to the other hyperthread. */
+	inline void cpuRelax()
+	{
+#if defined(__x86_64__) || defined(__i386__)
+		__builtin_ia32_pause();
+#endif
+	}
+
+	/** @brief Whether the descriptor is an eventfd, going by what it links to in /proc. */
+	bool isEventFd( int fd )
+	{
+		char target[64];
+		const ssize_t length=::readlink( ("/proc/self/fd/"+std::to_string(fd)).c_str(), target, sizeof(target) );
+		return length>0 && std::string( target, length )=="anon_inode:[eventfd]";
+	}
+
+	sockaddr_un unixSocketAddress( const std::string& socketPath )
+	{
+		sockaddr_un address;
+		std::memset( &address, 0, sizeof(address) );
+		address.sun_family=AF_UNIX;
+		if( socketPath.size()>=sizeof(address.sun_path) ) throw std::invalid_argument( "The socket path \""+socketPath+"\" is too long" );
+		std::strncpy( address.sun_path, socketPath.c_str(), sizeof(address.sun_path)-1 );
+		return address;
+	}
+} // end of the unnamed namespace
+
+std::unique_ptr<clientserver::SharedMemoryChannel> clientserver::SharedMemoryChannel::connect( const std::string& socketPath, size_t ringCapacity )
+{
+	// Create everything first, and make sure it's closed again if anything throws
+	int descriptors[numberOfDescriptors];
+	std::fill( descriptors, descriptors+numberOfDescriptors, -1 );
+	int socket=-1;
+	auto closeAll=[&]()
+		{
+			for( const auto descriptor : descriptors ) if( descriptor>=0 ) ::close( descriptor );
+			if( socket>=0 ) ::close( socket );
+		};
+
+	try
+	{
+		descriptors[0]=::memfd_create( "clientserver", MFD_CLOEXEC | MFD_ALLOW_SEALING );
+		if( descriptors[0]<0 ) throwSystemError( "Couldn't create the shared memory" );
+		if( ::ftruncate( descriptors[0], 2*clientserver::SpscRing::requiredMemory(ringCapacity) )!=0 ) throwSystemError( "Couldn't size the shared memory" );
+		if( ::fcntl( descriptors[0], F_ADD_SEALS, ::requiredSeals )!=0 ) throwSystemError( "Couldn't seal the shared memory" );
+		for( size_t index=1; index<numberOfDescriptors; ++index )
+		{
+			descriptors[index]=::eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+			if( descriptors[index]<0 ) throwSystemError( "Couldn't create an eventfd" );
+		}
+
+		socket=::socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+		if( socket<0 ) throwSystemError( "Couldn't create a Unix socket" );
+		sockaddr_un address=::unixSocketAddress( socketPath );
+		if( ::connect( socket, reinterpret_cast<sockaddr*>(&address), sizeof(address) )!=0 ) throwSystemError( "Couldn't connect to \""+socketPath+"\"" );
+
+		// Constructing the channel initialises the rings, which has to happen before the server sees them
+		std::unique_ptr<SharedMemoryChannel> pChannel( new SharedMemoryChannel( socket, descriptors[0], ringCapacity, &descriptors[1], true ) );
+		// The channel owns the descriptors now, so make sure they're not closed twice
+		std::fill( descriptors, descriptors+numberOfDescriptors, -1 );
+		socket=-1;
+
+		// Send the ring capacity as the data, with all of the descriptors attached
+		uint64_t capacity=ringCapacity;
+		iovec dataVector;
+		dataVector.iov_base=&capacity;
+		dataVector.iov_len=sizeof(capacity);
+		char controlBuffer[CMSG_SPACE(sizeof(int)*numberOfDescriptors)];
+		std::memset( controlBuffer, 0, sizeof(controlBuffer) );
+		msghdr message;
+		std::memset( &message, 0, sizeof(message) );
+		message.msg_iov=&dataVector;
+		message.msg_iovlen=1;
+		message.msg_control=controlBuffer;
+		message.msg_controllen=sizeof(controlBuffer);
+		cmsghdr* pControlMessage=CMSG_FIRSTHDR(&message);
+		pControlMessage->cmsg_level=SOL_SOCKET;
+		pControlMessage->cmsg_type=SCM_RIGHTS;
+		pControlMessage->cmsg_len=CMSG_LEN(sizeof(int)*numberOfDescriptors);
+		int* pDescriptors=reinterpret_cast<int*>(CMSG_DATA(pControlMessage));
+		pDescriptors[0]=pChannel->memoryFd_;
+		for( size_t index=1; index<numberOfDescriptors; ++index ) pDescriptors[index]=pChannel->eventFds_[index-1];
+		if( ::sendmsg( pChannel->socket_, &message, MSG_NOSIGNAL )!=static_cast<ssize_t>(sizeof(capacity)) ) throwSystemError( "Couldn't send the shared memory descriptors" );
+
+		// Wait for the server to acknowledge that it has mapped the memory
+		char acknowledgement;
+		if( ::recv( pChannel->socket_, &acknowledgement, 1, MSG_WAITALL )!=1 ) throwSystemError( "The server did not accept the shared memory connection" );
+
+		return pChannel;
+	}
+	catch( ... )
+	{
+		closeAll();
+		throw;
+	}
+}
+
+std::unique_ptr<clientserver::SharedMemoryChannel> clientserver::SharedMemoryChannel::accept( int socket )
+{
+	uint64_t capacity=0;
+	iovec dataVector;
+	dataVector.iov_base=&capacity;
+	dataVector.iov_len=sizeof(capacity);
+	char controlBuffer[CMSG_SPACE(sizeof(int)*numberOfDescriptors)];
+	msghdr message;
+	std::memset( &message, 0, sizeof(message) );
+	message.msg_iov=&dataVector;
+	message.msg_iovlen=1;
+	message.msg_control=controlBuffer;
+	message.msg_controllen=sizeof(controlBuffer);
+
+	ssize_t bytesReceived=::recvmsg( socket, &message, MSG_WAITALL | MSG_CMSG_CLOEXEC );
+	if( bytesReceived<0 )
+	{
+		int savedErrno=errno;
+		::close( socket );
+		throw std::system_error( savedErrno, std::system_category(), "Couldn't receive the shared memory descriptors" );
+	}
+
+	cmsghdr* pControlMessage=CMSG_FIRSTHDR(&message);
+	if( bytesReceived!=sizeof(capacity) || pControlMessage==nullptr || pControlMessage->cmsg_type!=SCM_RIGHTS
+			|| pControlMessage->cmsg_len!=CMSG_LEN(sizeof(int)*numberOfDescriptors) )
+	{
+		if( pControlMessage!=nullptr && pControlMessage->cmsg_type==SCM_RIGHTS )
+		{
+			const size_t descriptorCount=(pControlMessage->cmsg_len-CMSG_LEN(0))/sizeof(int);
+			const int* pDescriptors=reinterpret_cast<const int*>(CMSG_DATA(pControlMessage));
+			for( size_t index=0; index<descriptorCount; ++index ) ::close( pDescriptors[index] );
+		}
+		::close( socket );
+		throw std::system_error( std::make_error_code(std::errc::protocol_error), "The client sent an invalid shared memory handshake" );
+	}
+
+	int descriptors[numberOfDescriptors];
+	std::memcpy( descriptors, CMSG_DATA(pControlMessage), sizeof(descriptors) );
+
+	std::unique_ptr<SharedMemoryChannel> pChannel;
+	try
+	{
+		struct stat memoryStatus;
+		if( ::fstat( descriptors[0], &memoryStatus )!=0 ) throwSystemError( "Couldn't stat the shared memory" );
+		if( static_cast<uint64_t>(memoryStatus.st_size)!=2*clientserver::SpscRing::requiredMemory(capacity) )
+		{
+			throw std::system_error( std::make_error_code(std::errc::protocol_error), "The shared memory is not the size the client said it would be" );
+		}
+		const int seals=::fcntl( descriptors[0], F_GET_SEALS );
+		if( seals<0 || (seals & ::requiredSeals)!=::requiredSeals )
+		{
+			throw std::system_error( std::make_error_code(std::errc::protocol_error), "The shared memory is not sealed, so the client could still resize it" );
+		}
+		for( size_t index=1; index<numberOfDescriptors; ++index )
+		{
+			// Anything else, e.g. a pipe, could block the connection's thread when it's drained
+			if( !::isEventFd( descriptors[index] ) ) throw std::system_error( std::make_error_code(std::errc::protocol_error), "The client sent a descriptor that is not an eventfd" );
+			if( ::fcntl( descriptors[index], F_SETFL, ::fcntl( descriptors[index], F_GETFL )|O_NONBLOCK )!=0 ) throwSystemError( "Couldn't make an eventfd non-blocking" );
+		}
+		pChannel.reset( new SharedMemoryChannel( socket, descriptors[0], capacity, &descriptors[1], false ) );
+	}
+	catch( ... )
+	{
+		for( const auto descriptor : descriptors ) ::close( descriptor );
+		::close( socket );
+		throw;
+	}
+
+	char acknowledgement=1;
+	if( ::send( socket, &acknowledgement, 1, MSG_NOSIGNAL )!=1 ) throwSystemError( "Couldn't acknowledge the shared memory connection" );
+
+	return pChannel;
+}
+
+clientserver::SharedMemoryChannel::SharedMemoryChannel( int socket, int memoryFd, size_t ringCapacity, const int eventFds[4], bool isClient )
+	: socket_(socket), memoryFd_(memoryFd), pMemory_(MAP_FAILED), memorySize_( 2*clientserver::SpscRing::requiredMemory(ringCapacity) ), busyPollIterations_(0)
+{
+	std::copy( eventFds, eventFds+4, eventFds_ );
+
+	pMemory_=::mmap( nullptr, memorySize_, PROT_READ | PROT_WRITE, MAP_SHARED, memoryFd_, 0 );
+	if( pMemory_==MAP_FAILED ) throwSystemError( "Couldn't map the shared memory" );
+
+	// The client-to-server ring is first, then the server-to-client ring. The client
+	// initialises them both before telling the server about them.
+	char* pClientToServer=static_cast<char*>(pMemory_);
+	char* pServerToClient=pClientToServer+clientserver::SpscRing::requiredMemory(ringCapacity);
+	try
+	{
+		if( isClient )
+		{
+			pOutgoing_.reset( new clientserver::SpscRing( pClientToServer, ringCapacity, true ) );
+			pIncoming_.reset( new clientserver::SpscRing( pServerToClient, ringCapacity, true ) );
+			outgoingDataFd_=eventFds_[0];
+			outgoingSpaceFd_=eventFds_[1];
+			incomingDataFd_=eventFds_[2];
+			incomingSpaceFd_=eventFds_[3];
+		}
+		else
+		{
+			pIncoming_.reset( new clientserver::SpscRing( pClientToServer, ringCapacity, false ) );
+			pOutgoing_.reset( new clientserver::SpscRing( pServerToClient, ringCapacity, false ) );
+			incomingDataFd_=eventFds_[0];
+			incomingSpaceFd_=eventFds_[1];
+			outgoingDataFd_=eventFds_[2];
+			outgoingSpaceFd_=eventFds_[3];
+		}
+	}
+	catch( ... )
+	{
+		::munmap( pMemory_, memorySize_ );
+		throw;
+	}
+}
+
+clientserver::SharedMemoryChannel::~SharedMemoryChannel()
+{
+	pOutgoing_.reset();
+	pIncoming_.reset();
+	if( pMemory_!=MAP_FAILED ) ::munmap( pMemory_, memorySize_ );
+	for( const auto descriptor : eventFds_ ) ::close( descriptor );
+	::close( memoryFd_ );
+	::close( socket_ );
+}
+
+void clientserver::SharedMemoryChannel::setBusyPollIterations( size_t iterations )
+{
+	busyPollIterations_=iterations;
+}
+
+bool clientserver::SharedMemoryChannel::send( MessageType type, uint32_t id, const std::string& payload, int interruptFd )
+{
+	RecordHeader header{ type, id };
+	std::lock_guard<std::mutex> lock( sendMutex_ );
+
+	size_t spinCount=0;
+	while( !pOutgoing_->push( &header, sizeof(header), payload.data(), payload.size() ) )
+	{
+		if( spinCount++ < busyPollIterations_ ) ::cpuRelax();
+		else if( pOutgoing_->prepareProducerWait( sizeof(header)+payload.size() ) )
+		{
+			if( !waitFor( outgoingSpaceFd_, interruptFd ) ) return false;
+		}
+	}
+
+	if( pOutgoing_->consumerNeedsWaking() ) ::signalEventFd( outgoingDataFd_ );
+	return true;
+}
+
+bool clientserver::SharedMemoryChannel::receive( MessageType& type, uint32_t& id, std::string& payload, int interruptFd )
+{
+	RecordHeader header;
+	size_t spinCount=0;
+	while( !pIncoming_->pop( &header, sizeof(header), payload ) )
+	{
+		if( spinCount++ < busyPollIterations_ ) ::cpuRelax();
+		else if( pIncoming_->prepareConsumerWait() )
+		{
+			if( waitFor( incomingDataFd_, interruptFd ) ) continue;
+			// The peer can push a last message and hang up before this wakes, e.g. a server closing a bad connection
+			if( !pIncoming_->pop( &header, sizeof(header), payload ) ) return false;
+			break;
+		}
+	}
+
+	if( pIncoming_->producerNeedsWaking() ) ::signalEventFd( incomingSpaceFd_ );
+	type=header.type;
+	id=header.id;
+	return true;
+}
+
+void clientserver::SharedMemoryChannel::shutdown()
+{
+	::shutdown( socket_, SHUT_RDWR );
+}
+
+bool clientserver::SharedMemoryChannel::waitFor( int fd, int interruptFd )
+{
+	pollfd descriptors[3];
+	descriptors[0].fd=fd;
+	descriptors[0].events=POLLIN;
+	// Nothing is sent on the socket after the handshake, so if it becomes readable it's
+	// because the other side has closed it.
+	descriptors[1].fd=socket_;
+	descriptors[1].events=POLLIN | POLLRDHUP;
+	descriptors[2].fd=interruptFd; // poll ignores negative descriptors
+	descriptors[2].events=POLLIN;
+
+	while( true )
+	{
+		if( ::poll( descriptors, 3, -1 )<0 )
+		{
+			if( errno==EINTR ) continue;
+			throwSystemError( "Couldn't poll the shared memory channel" );
+		}
+		if( descriptors[1].revents!=0 || descriptors[2].revents!=0 ) return false;
+		if( descriptors[0].revents & POLLIN )
+		{
+			::drainEventFd( fd );
+			return true;
+		}
+	}
+}
@@ -0,0 +1,138 @@
+#include "clientserver/SharedMemoryClient.h"
+
+#include <iostream>
+#include <system_error>
+#include <stdexcept>
+#include <cerrno>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include "clientserver/SharedMemoryChannel.h"
+
+clientserver::SharedMemoryClient::SharedMemoryClient()
+	: busyPollIterations_(0), ringCapacity_(1<<20), stopEventFd_(-1), connected_(false), nextRequestId_(0)
+{
+	// No operation besides the initialiser list
+}
+
+clientserver::SharedMemoryClient::~SharedMemoryClient()
+{
+	disconnect();
+}
+
+void clientserver::SharedMemoryClient::setBusyPollIterations( size_t iterations )
+{
+	busyPollIterations_=iterations;
+}
+
+void clientserver::SharedMemoryClient::setRingCapacity( size_t capacity )
+{
+	ringCapacity_=capacity;
+}
+
+void clientserver::SharedMemoryClient::setDefaultInfoHandler( std::function<void(const std::string&)> infoHandler )
+{
+	infoHandler_=infoHandler;
+}
+
+void clientserver::SharedMemoryClient::connect( const std::string& socketPath )
+{
+	disconnect();
+
+	stopEventFd_=::eventfd( 0, EFD_CLOEXEC );
+	if( stopEventFd_<0 ) throw std::system_error( errno, std::system_category(), "Couldn't create an eventfd" );
+	try
+	{
+		pChannel_=clientserver::SharedMemoryChannel::connect( socketPath, ringCapacity_ );
+	}
+	catch( ... )
+	{
+		::close( stopEventFd_ );
+		stopEventFd_=-1;
+		throw;
+	}
+	pChannel_->setBusyPollIterations( busyPollIterations_ );
+
+	connected_=true;
+	receiveThread_=std::thread( &SharedMemoryClient::receiveLoop, this );
+}
+
+void clientserver::SharedMemoryClient::disconnect()
+{
+	if( !pChannel_ ) return;
+
+	uint64_t value=1;
+	while( ::write( stopEventFd_, &value, sizeof(value) )<0 && errno==EINTR );
+	pChannel_->shutdown();
+	receiveThread_.join();
+
+	pChannel_.reset();
+	::close( stopEventFd_ );
+	stopEventFd_=-1;
+
+	std::lock_guard<std::mutex> lock( responseHandlersMutex_ );
+	responseHandlers_.clear();
+}
+
+bool clientserver::SharedMemoryClient::isConnected()
+{
+	return connected_;
+}
+
+void clientserver::SharedMemoryClient::sendInfo( const std::string& message )
+{
+	if( !connected_ ) throw std::runtime_error( "SharedMemoryClient is not connected" );
+	if( !pChannel_->send( clientserver::SharedMemoryChannel::MessageType::info, 0, message, stopEventFd_ ) ) throw std::runtime_error( "SharedMemoryClient lost the connection" );
+}
+
+void clientserver::SharedMemoryClient::sendRequest( const std::string& message, std::function<void(const std::string&)> responseHandler )
+{
+	if( !connected_ ) throw std::runtime_error( "SharedMemoryClient is not connected" );
+
+	const uint32_t id=nextRequestId_++;
+	{
+		std::lock_guard<std::mutex> lock( responseHandlersMutex_ );
+		responseHandlers_[id]=responseHandler;
+	}
+	if( !pChannel_->send( clientserver::SharedMemoryChannel::MessageType::request, id, message, stopEventFd_ ) )
+	{
+		std::lock_guard<std::mutex> lock( responseHandlersMutex_ );
+		responseHandlers_.erase( id );
+		throw std::runtime_error( "SharedMemoryClient lost the connection" );
+	}
+}
+
+void clientserver::SharedMemoryClient::receiveLoop()
+{
+	typedef clientserver::SharedMemoryChannel::MessageType MessageType;
+	MessageType type;
+	uint32_t id;
+	std::string message;
+
+	while( pChannel_->receive( type, id, message, stopEventFd_ ) )
+	{
+		try
+		{
+			if( type==MessageType::response )
+			{
+				std::function<void(const std::string&)> handler;
+				{
+					std::lock_guard<std::mutex> lock( responseHandlersMutex_ );
+					auto iFindResult=responseHandlers_.find( id );
+					if( iFindResult==responseHandlers_.end() ) continue;
+					handler.swap( iFindResult->second );
+					responseHandlers_.erase( iFindResult );
+				}
+				if( handler ) handler( message );
+			}
+			else if( type==MessageType::info )
+			{
+				if( infoHandler_ ) infoHandler_( message );
+			}
+		}
+		catch( std::exception& error )
+		{
+			std::cerr << "SharedMemoryClient handler threw an exception: " << error.what() << std::endl;
+		}
+	}
+	connected_=false;
+}
@@ -0,0 +1,273 @@
+#include "clientserver/SharedMemoryServer.h"
+
+#include <iostream>
+#include <system_error>
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <unistd.h>
+#include "clientserver/SharedMemoryChannel.h"
+#include "clientserver/ConnectionRegistry.h"
+#include "clientserver/RateLimiter.h"
+
+/** @brief Implementation of IConnection for a single shared memory client, with the thread that services it.
+ *
+ * @author Mark Grimes
+ * @date 19/Oct/2026
+ */
+class clientserver::SharedMemoryServer::Connection : public clientserver::IConnection
+{
+public:
+	/** @param pRateLimiter  Checked before each message goes to a handler, or null for no limits. Clients are on the same machine so only the per connection limits apply. */
+	Connection( std::unique_ptr<clientserver::SharedMemoryChannel> pChannel, int stopEventFd, const std::atomic<bool>& stopping, std::shared_ptr<clientserver::RateLimiter> pRateLimiter )
+		: pChannel_( std::move(pChannel) ), stopEventFd_(stopEventFd), stopping_(stopping), connected_(true), connectionId_(0), pRateLimiter_( std::move(pRateLimiter) )
+	{
+		// No operation besides the initialiser list
+	}
+	virtual ~Connection() { join(); }
+	virtual bool isConnected() override { return connected_; }
+	virtual void close() override { pChannel_->shutdown(); }
+	virtual void sendInfo( const std::string& message ) override
+	{
+		pChannel_->send( clientserver::SharedMemoryChannel::MessageType::info, 0, message, stopEventFd_ );
+	}
+	virtual uint64_t connectionId() const override { return connectionId_; }
+
+	/** @brief Adds the connection to the registry and starts its thread, which removes it again once the client has gone. */
+	void start( std::weak_ptr<Connection> pWeakThis, std::shared_ptr<clientserver::ConnectionRegistry> pConnectionRegistry,
+		std::function<std::string(const std::string&,std::weak_ptr<clientserver::IConnection>)> requestHandler,
+		std::function<void(const std::string&,std::weak_ptr<clientserver::IConnection>)> infoHandler )
+	{
+		connectionId_=pConnectionRegistry->add( pWeakThis );
+		pConnectionRegistry_=std::move( pConnectionRegistry );
+		thread_=std::thread( &Connection::run, this, pWeakThis, requestHandler, infoHandler );
+	}
+	void join() { if( thread_.joinable() ) thread_.join(); }
+protected:
+	void run( std::weak_ptr<Connection> pWeakThis,
+		std::function<std::string(const std::string&,std::weak_ptr<clientserver::IConnection>)> requestHandler,
+		std::function<void(const std::string&,std::weak_ptr<clientserver::IConnection>)> infoHandler )
+	{
+		typedef clientserver::SharedMemoryChannel::MessageType MessageType;
+		std::weak_ptr<clientserver::IConnection> pWeakConnection=pWeakThis;
+		MessageType type;
+		uint32_t id;
+		std::string message;
+
+		while( !stopping_ )
+		{
+			try
+			{
+				if( !pChannel_->receive( type, id, message, stopEventFd_ ) ) break;
+			}
+			catch( std::exception& error )
+			{
+				// The client can write anything it likes to the shared memory, so a bad record only closes this connection
+				std::cerr << "SharedMemoryServer closing a connection that sent an invalid record: " << error.what() << std::endl;
+				pChannel_->shutdown();
+				break;
+			}
+			if( pRateLimiter_ && (type==MessageType::request || type==MessageType::info)
+				&& pRateLimiter_->admit( rateLimitState_, message.size() )!=clientserver::RateLimiter::Verdict::allowed )
+			{
+				if( type==MessageType::request && !pChannel_->send( MessageType::response, id, std::string(), stopEventFd_ ) ) break;
+				continue;
+			}
+			try
+			{
+				if( type==MessageType::request )
+				{
+					std::string response;
+					if( requestHandler ) response=requestHandler( message, pWeakConnection );
+					if( !pChannel_->send( MessageType::response, id, response, stopEventFd_ ) ) break;
+				}
+				else if( type==MessageType::info )
+				{
+					if( infoHandler ) infoHandler( message, pWeakConnection );
+				}
+			}
+			catch( std::exception& error )
+			{
+				std::cerr << "SharedMemoryServer handler threw an exception: " << error.what() << std::endl;
+				// Still reply so that the client isn't left waiting forever
+				if( type==MessageType::request ) pChannel_->send( MessageType::response, id, std::string(), stopEventFd_ );
+			}
+		}
+		connected_=false;
+		pConnectionRegistry_->remove( connectionId_ );
+	}
+
+	std::unique_ptr<clientserver::SharedMemoryChannel> pChannel_;
+	int stopEventFd_;
+	const std::atomic<bool>& stopping_;
+	std::atomic<bool> connected_;
+	std::shared_ptr<clientserver::ConnectionRegistry> pConnectionRegistry_;
+	std::atomic<uint64_t> connectionId_;
+	std::shared_ptr<clientserver::RateLimiter> pRateLimiter_;
+	clientserver::RateLimiter::ConnectionState rateLimitState_; ///< Only touched by the connection's thread
+	std::thread thread_;
+};
+
+clientserver::SharedMemoryServer::SharedMemoryServer()
+	: listenSocket_(-1), stopEventFd_(-1), stopping_(false), busyPollIterations_(0), pConnectionRegistry_(std::make_shared<clientserver::ConnectionRegistry>())
+{
+	// No operation besides the initialiser list
+}
+
+clientserver::SharedMemoryServer::~SharedMemoryServer()
+{
+	stop();
+}
+
+void clientserver::SharedMemoryServer::setBusyPollIterations( size_t iterations )
+{
+	busyPollIterations_=iterations;
+}
+
+void clientserver::SharedMemoryServer::setDefaultRequestHandler( std::function<std::string(const std::string&,std::weak_ptr<clientserver::IConnection>)> requestHandler )
+{
+	requestHandler_=requestHandler;
+}
+
+void clientserver::SharedMemoryServer::setDefaultInfoHandler( std::function<void(const std::string&,std::weak_ptr<clientserver::IConnection>)> infoHandler )
+{
+	infoHandler_=infoHandler;
+}
+
+void clientserver::SharedMemoryServer::setConnectionRegistry( std::shared_ptr<clientserver::ConnectionRegistry> pConnectionRegistry )
+{
+	pConnectionRegistry_=std::move( pConnectionRegistry );
+}
+
+const std::shared_ptr<clientserver::ConnectionRegistry>& clientserver::SharedMemoryServer::connectionRegistry() const
+{
+	return pConnectionRegistry_;
+}
+
+void clientserver::SharedMemoryServer::setRateLimiter( std::shared_ptr<clientserver::RateLimiter> pRateLimiter )
+{
+	pRateLimiter_=std::move( pRateLimiter );
+}
+
+void clientserver::SharedMemoryServer::listen( const std::string& socketPath )
+{
+	if( listenSocket_>=0 ) throw std::logic_error( "SharedMemoryServer is already listening" );
+
+	sockaddr_un address;
+	std::memset( &address, 0, sizeof(address) );
+	address.sun_family=AF_UNIX;
+	if( socketPath.size()>=sizeof(address.sun_path) ) throw std::invalid_argument( "The socket path \""+socketPath+"\" is too long" );
+	std::strncpy( address.sun_path, socketPath.c_str(), sizeof(address.sun_path)-1 );
+
+	stopEventFd_=::eventfd( 0, EFD_CLOEXEC );
+	if( stopEventFd_<0 ) throw std::system_error( errno, std::system_category(), "Couldn't create an eventfd" );
+	listenSocket_=::socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+	if( listenSocket_<0 )
+	{
+		int savedErrno=errno;
+		::close( stopEventFd_ );
+		stopEventFd_=-1;
+		throw std::system_error( savedErrno, std::system_category(), "Couldn't create a Unix socket" );
+	}
+
+	::unlink( socketPath.c_str() );
+	if( ::bind( listenSocket_, reinterpret_cast<sockaddr*>(&address), sizeof(address) )!=0 || ::listen( listenSocket_, SOMAXCONN )!=0 )
+	{
+		int savedErrno=errno;
+		::close( listenSocket_ );
+		::close( stopEventFd_ );
+		listenSocket_=stopEventFd_=-1;
+		throw std::system_error( savedErrno, std::system_category(), "Couldn't listen on \""+socketPath+"\"" );
+	}
+
+	socketPath_=socketPath;
+	stopping_=false;
+	acceptThread_=std::thread( &SharedMemoryServer::acceptLoop, this );
+}
+
+void clientserver::SharedMemoryServer::stop()
+{
+	if( listenSocket_<0 ) return;
+
+	stopping_=true;
+	uint64_t value=1;
+	while( ::write( stopEventFd_, &value, sizeof(value) )<0 && errno==EINTR );
+
+	acceptThread_.join();
+	{
+		std::lock_guard<std::mutex> lock( connectionsMutex_ );
+		for( auto& pConnection : connections_ ) pConnection->join();
+		connections_.clear();
+	}
+
+	::close( listenSocket_ );
+	::close( stopEventFd_ );
+	::unlink( socketPath_.c_str() );
+	listenSocket_=stopEventFd_=-1;
+}
+
+void clientserver::SharedMemoryServer::acceptLoop()
+{
+	pollfd descriptors[2];
+	descriptors[0].fd=listenSocket_;
+	descriptors[0].events=POLLIN;
+	descriptors[1].fd=stopEventFd_;
+	descriptors[1].events=POLLIN;
+
+	while( true )
+	{
+		if( ::poll( descriptors, 2, -1 )<0 )
+		{
+			if( errno==EINTR ) continue;
+			std::cerr << "SharedMemoryServer couldn't poll the listening socket: " << std::strerror(errno) << std::endl;
+			return;
+		}
+		if( descriptors[1].revents!=0 ) return;
+		if( (descriptors[0].revents & POLLIN)==0 ) continue;
+
+		int socket=::accept4( listenSocket_, nullptr, nullptr, SOCK_CLOEXEC );
+		if( socket<0 ) continue;
+
+		// The client sends the handshake straight after connecting, so put a timeout on it
+		// to make sure a misbehaving client can't hold up the accept loop.
+		timeval timeout;
+		timeout.tv_sec=1;
+		timeout.tv_usec=0;
+		::setsockopt( socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout) );
+
+		std::unique_ptr<clientserver::SharedMemoryChannel> pChannel;
+		try
+		{
+			pChannel=clientserver::SharedMemoryChannel::accept( socket );
+		}
+		catch( std::exception& error )
+		{
+			std::cerr << "SharedMemoryServer rejected a connection: " << error.what() << std::endl;
+			continue;
+		}
+		pChannel->setBusyPollIterations( busyPollIterations_ );
+
+		std::shared_ptr<Connection> pConnection=std::make_shared<Connection>( std::move(pChannel), stopEventFd_, stopping_, pRateLimiter_ );
+		std::lock_guard<std::mutex> lock( connectionsMutex_ );
+		removeFinishedConnections();
+		connections_.push_back( pConnection );
+		pConnection->start( pConnection, pConnectionRegistry_, requestHandler_, infoHandler_ );
+	}
+}
+
+void clientserver::SharedMemoryServer::removeFinishedConnections()
+{
+	for( auto iConnection=connections_.begin(); iConnection!=connections_.end(); )
+	{
+		if( !(*iConnection)->isConnected() )
+		{
+			(*iConnection)->join();
+			iConnection=connections_.erase( iConnection );
+		}
+		else ++iConnection;
+	}
+}
@@ -0,0 +1,256 @@
+#include "clientserver/SocketHandover.h"
+
+#include <iostream>
+#include <system_error>
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+#include <sys/time.h>
+#include <poll.h>
+#include <unistd.h>
+
+namespace // Unnamed namespace for things only used in this file
+{
+	/** @brief The most sockets that can be handed over at once. */
+	const size_t maximumSockets=16;
+	/** @brief Sent by the new process once it's accepting on the sockets. */
+	const char readyByte='r';
+	/** @brief Sent back by the old process once it has stopped accepting. */
+	const char doneByte='d';
+
+	sockaddr_un unixSocketAddress( const std::string& socketPath )
+	{
+		sockaddr_un address;
+		std::memset( &address, 0, sizeof(address) );
+		address.sun_family=AF_UNIX;
+		if( socketPath.size()>=sizeof(address.sun_path) ) throw std::invalid_argument( "The socket path \""+socketPath+"\" is too long" );
+		std::strncpy( address.sun_path, socketPath.c_str(), sizeof(address.sun_path)-1 );
+		return address;
+	}
+} // end of the unnamed namespace
+
+clientserver::SocketHandover::SocketHandover()
+	: listenSocket_(-1), stopEventFd_(-1), hasHandedOver_(false)
+{
+	// No operation besides the initialiser list
+}
+
+clientserver::SocketHandover::~SocketHandover()
+{
+	stop();
+}
+
+bool clientserver::SocketHandover::take( const std::string& socketPath, std::function<void(std::vector<int>)> startHandler )
+{
+	sockaddr_un address=::unixSocketAddress( socketPath );
+	int connection=::socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+	if( connection<0 ) throw std::system_error( errno, std::system_category(), "Couldn't create a Unix socket" );
+	if( ::connect( connection, reinterpret_cast<sockaddr*>(&address), sizeof(address) )!=0 )
+	{
+		int savedErrno=errno;
+		::close( connection );
+		// Either nothing has ever offered sockets here, or the process that did has gone
+		if( savedErrno==ENOENT || savedErrno==ECONNREFUSED ) return false;
+		throw std::system_error( savedErrno, std::system_category(), "Couldn't connect to \""+socketPath+"\"" );
+	}
+	// Don't wait forever if the other process has hung
+	timeval timeout;
+	timeout.tv_sec=10;
+	timeout.tv_usec=0;
+	::setsockopt( connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout) );
+
+	uint32_t count=0;
+	iovec dataVector;
+	dataVector.iov_base=&count;
+	dataVector.iov_len=sizeof(count);
+	char controlBuffer[CMSG_SPACE(sizeof(int)*::maximumSockets)];
+	msghdr message;
+	std::memset( &message, 0, sizeof(message) );
+	message.msg_iov=&dataVector;
+	message.msg_iovlen=1;
+	message.msg_control=controlBuffer;
+	message.msg_controllen=sizeof(controlBuffer);
+
+	ssize_t bytesReceived=::recvmsg( connection, &message, MSG_WAITALL | MSG_CMSG_CLOEXEC );
+	if( bytesReceived<0 )
+	{
+		int savedErrno=errno;
+		::close( connection );
+		throw std::system_error( savedErrno, std::system_category(), "Couldn't receive the sockets from \""+socketPath+"\"" );
+	}
+
+	std::vector<int> sockets;
+	cmsghdr* pControlMessage=CMSG_FIRSTHDR(&message);
+	if( pControlMessage!=nullptr && pControlMessage->cmsg_level==SOL_SOCKET && pControlMessage->cmsg_type==SCM_RIGHTS )
+	{
+		const int* pDescriptors=reinterpret_cast<const int*>(CMSG_DATA(pControlMessage));
+		sockets.assign( pDescriptors, pDescriptors+(pControlMessage->cmsg_len-CMSG_LEN(0))/sizeof(int) );
+	}
+	if( bytesReceived!=sizeof(count) || (message.msg_flags & MSG_CTRUNC)!=0 || sockets.size()!=count )
+	{
+		for( const auto socket : sockets ) ::close( socket );
+		::close( connection );
+		throw std::system_error( std::make_error_code(std::errc::protocol_error), "Received an invalid socket handover from \""+socketPath+"\"" );
+	}
+
+	// If this throws the other process sees the connection close before it's told anything, and carries on
+	try
+	{
+		startHandler( std::move(sockets) );
+	}
+	catch( ... )
+	{
+		::close( connection );
+		throw;
+	}
+
+	char done=0;
+	if( ::send( connection, &::readyByte, 1, MSG_NOSIGNAL )!=1 || ::recv( connection, &done, 1, MSG_WAITALL )!=1 || done!=::doneByte )
+	{
+		int savedErrno=errno;
+		::close( connection );
+		throw std::system_error( savedErrno, std::system_category(), "The process at \""+socketPath+"\" didn't finish handing over its sockets" );
+	}
+	::close( connection );
+	return true;
+}
+
+void clientserver::SocketHandover::offer( const std::string& socketPath, std::vector<int> sockets, std::function<void()> handedOverHandler )
+{
+	if( offerThread_.joinable() ) throw std::logic_error( "SocketHandover is already offering sockets" );
+	if( sockets.size()>::maximumSockets ) throw std::invalid_argument( "SocketHandover can only hand over "+std::to_string(::maximumSockets)+" sockets" );
+
+	sockaddr_un address=::unixSocketAddress( socketPath );
+	stopEventFd_=::eventfd( 0, EFD_CLOEXEC );
+	if( stopEventFd_<0 ) throw std::system_error( errno, std::system_category(), "Couldn't create an eventfd" );
+	listenSocket_=::socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+	if( listenSocket_<0 )
+	{
+		int savedErrno=errno;
+		::close( stopEventFd_ );
+		stopEventFd_=-1;
+		throw std::system_error( savedErrno, std::system_category(), "Couldn't create a Unix socket" );
+	}
+
+	::unlink( socketPath.c_str() );
+	if( ::bind( listenSocket_, reinterpret_cast<sockaddr*>(&address), sizeof(address) )!=0 || ::listen( listenSocket_, 1 )!=0 )
+	{
+		int savedErrno=errno;
+		::close( listenSocket_ );
+		::close( stopEventFd_ );
+		listenSocket_=stopEventFd_=-1;
+		throw std::system_error( savedErrno, std::system_category(), "Couldn't listen on \""+socketPath+"\"" );
+	}
+
+	socketPath_=socketPath;
+	sockets_=std::move( sockets );
+	handedOverHandler_=handedOverHandler;
+	hasHandedOver_=false;
+	offerThread_=std::thread( &SocketHandover::offerLoop, this );
+}
+
+bool clientserver::SocketHandover::hasHandedOver() const
+{
+	return hasHandedOver_;
+}
+
+void clientserver::SocketHandover::stop()
+{
+	if( !offerThread_.joinable() ) return;
+
+	uint64_t value=1;
+	while( ::write( stopEventFd_, &value, sizeof(value) )<0 && errno==EINTR );
+	offerThread_.join();
+
+	// After a handover the path belongs to the new process
+	if( listenSocket_>=0 )
+	{
+		::close( listenSocket_ );
+		::unlink( socketPath_.c_str() );
+	}
+	::close( stopEventFd_ );
+	listenSocket_=stopEventFd_=-1;
+}
+
+void clientserver::SocketHandover::offerLoop()
+{
+	pollfd descriptors[2];
+	descriptors[0].fd=listenSocket_;
+	descriptors[0].events=POLLIN;
+	descriptors[1].fd=stopEventFd_;
+	descriptors[1].events=POLLIN;
+
+	while( true )
+	{
+		if( ::poll( descriptors, 2, -1 )<0 )
+		{
+			if( errno==EINTR ) continue;
+			std::cerr << "SocketHandover couldn't poll the listening socket: " << std::strerror(errno) << std::endl;
+			return;
+		}
+		if( descriptors[1].revents!=0 ) return;
+		if( (descriptors[0].revents & POLLIN)==0 ) continue;
+
+		int connection=::accept4( listenSocket_, nullptr, nullptr, SOCK_CLOEXEC );
+		if( connection<0 ) continue;
+
+		const bool hasHandedOver=handOver( connection );
+		::close( connection );
+		if( hasHandedOver ) return;
+	}
+}
+
+bool clientserver::SocketHandover::handOver( int connection )
+{
+	// Send the number of sockets as the data, with the sockets attached
+	uint32_t count=sockets_.size();
+	iovec dataVector;
+	dataVector.iov_base=&count;
+	dataVector.iov_len=sizeof(count);
+	char controlBuffer[CMSG_SPACE(sizeof(int)*::maximumSockets)];
+	std::memset( controlBuffer, 0, sizeof(controlBuffer) );
+	msghdr message;
+	std::memset( &message, 0, sizeof(message) );
+	message.msg_iov=&dataVector;
+	message.msg_iovlen=1;
+	if( !sockets_.empty() )
+	{
+		message.msg_control=controlBuffer;
+		message.msg_controllen=CMSG_SPACE(sizeof(int)*sockets_.size());
+		cmsghdr* pControlMessage=CMSG_FIRSTHDR(&message);
+		pControlMessage->cmsg_level=SOL_SOCKET;
+		pControlMessage->cmsg_type=SCM_RIGHTS;
+		pControlMessage->cmsg_len=CMSG_LEN(sizeof(int)*sockets_.size());
+		std::memcpy( CMSG_DATA(pControlMessage), sockets_.data(), sizeof(int)*sockets_.size() );
+	}
+	if( ::sendmsg( connection, &message, MSG_NOSIGNAL )!=static_cast<ssize_t>(sizeof(count)) ) return false;
+
+	// Carry on accepting until the other process says it is too, however long it takes to start
+	pollfd descriptors[2];
+	descriptors[0].fd=connection;
+	descriptors[0].events=POLLIN;
+	descriptors[1].fd=stopEventFd_;
+	descriptors[1].events=POLLIN;
+	while( ::poll( descriptors, 2, -1 )<0 )
+	{
+		if( errno!=EINTR ) return false;
+	}
+	if( descriptors[1].revents!=0 ) return false;
+	char ready=0;
+	if( ::recv( connection, &ready, 1, 0 )!=1 || ready!=::readyByte )
+	{
+		std::cerr << "SocketHandover was asked for the sockets, but the other process went away before it was accepting on them" << std::endl;
+		return false;
+	}
+
+	handedOverHandler_();
+	hasHandedOver_=true;
+	// The other process offers the sockets on the same path next, so this mustn't be listening there or remove it
+	::close( listenSocket_ );
+	listenSocket_=-1;
+	::send( connection, &::doneByte, 1, MSG_NOSIGNAL );
+	return true;
+}
@@ -0,0 +1,165 @@
+#include "clientserver/SpscRing.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+namespace
+{
+	/** @brief Size of the header rounded up to a whole number of cache lines, so that the data starts aligned. */
+	template<class T> constexpr size_t alignedSize() { return (sizeof(T)+63) & ~size_t(63); }
+
+	/** @brief The size of the length field written before every record. */
+	const size_t recordPrefixSize=sizeof(uint32_t);
+} // end of the unnamed namespace
+
+size_t clientserver::SpscRing::requiredMemory( size_t capacity )
+{
+	return ::alignedSize<Header>()+capacity;
+}
+
+clientserver::SpscRing::SpscRing( void* pMemory, size_t capacity, bool initialise )
+	: pHeader_( static_cast<Header*>(pMemory) ),
+	  pData_( static_cast<char*>(pMemory)+::alignedSize<Header>() ),
+	  mask_( capacity-1 )
+{
+	if( capacity<recordPrefixSize*2 || (capacity & (capacity-1))!=0 ) throw std::invalid_argument( "SpscRing capacity must be a power of two" );
+
+	if( initialise )
+	{
+		std::memset( pMemory, 0, ::alignedSize<Header>() );
+		new (pHeader_) Header;
+		pHeader_->head.store( 0 );
+		pHeader_->tail.store( 0 );
+		pHeader_->producerWaiting.store( 0 );
+		pHeader_->consumerWaiting.store( 0 );
+		pHeader_->capacity=capacity;
+	}
+	else if( pHeader_->capacity!=capacity ) throw std::invalid_argument( "SpscRing capacity does not match the capacity it was initialised with" );
+}
+
+size_t clientserver::SpscRing::capacity() const
+{
+	return mask_+1;
+}
+
+size_t clientserver::SpscRing::maximumRecordSize() const
+{
+	return capacity()-recordPrefixSize;
+}
+
+bool clientserver::SpscRing::push( const void* pHead, size_t headSize, const void* pBody, size_t bodySize )
+{
+	const size_t recordSize=headSize+bodySize;
+	if( recordSize>maximumRecordSize() ) throw std::length_error( "SpscRing record of "+std::to_string(recordSize)+" bytes is larger than the maximum of "+std::to_string(maximumRecordSize()) );
+
+	// Only this thread modifies head, so a relaxed load is fine. Tail needs to be acquired
+	// so that the consumer has definitely finished copying out of the space being reused.
+	const uint64_t head=pHeader_->head.load( std::memory_order_relaxed );
+	const uint64_t tail=pHeader_->tail.load( std::memory_order_acquire );
+	if( capacity()-(head-tail) < recordSize+recordPrefixSize ) return false;
+
+	const uint32_t length=static_cast<uint32_t>(recordSize);
+	copyIn( head, &length, recordPrefixSize );
+	copyIn( head+recordPrefixSize, pHead, headSize );
+	copyIn( head+recordPrefixSize+headSize, pBody, bodySize );
+
+	pHeader_->head.store( head+recordPrefixSize+recordSize, std::memory_order_release );
+	return true;
+}
+
+bool clientserver::SpscRing::push( const void* pData, size_t size )
+{
+	return push( pData, size, nullptr, 0 );
+}
+
+bool clientserver::SpscRing::pop( void* pHead, size_t headSize, std::string& body )
+{
+	const uint64_t tail=pHeader_->tail.load( std::memory_order_relaxed );
+	const uint64_t head=pHeader_->head.load( std::memory_order_acquire );
+	if( head==tail ) return false;
+
+	uint32_t length;
+	copyOut( tail, &length, recordPrefixSize );
+	// The other side of the ring could be another process, so don't trust the length to be sane
+	if( length>maximumRecordSize() || recordPrefixSize+length>head-tail ) throw std::length_error( "SpscRing record of "+std::to_string(length)+" bytes is longer than the data in the ring, so the ring is corrupt" );
+	if( length<headSize ) throw std::length_error( "SpscRing record of "+std::to_string(length)+" bytes is shorter than the requested header size" );
+	copyOut( tail+recordPrefixSize, pHead, headSize );
+	body.resize( length-headSize );
+	if( !body.empty() ) copyOut( tail+recordPrefixSize+headSize, &body[0], body.size() );
+
+	pHeader_->tail.store( tail+recordPrefixSize+length, std::memory_order_release );
+	return true;
+}
+
+bool clientserver::SpscRing::pop( std::string& output )
+{
+	return pop( nullptr, 0, output );
+}
+
+bool clientserver::SpscRing::empty() const
+{
+	return pHeader_->head.load( std::memory_order_acquire )==pHeader_->tail.load( std::memory_order_acquire );
+}
+
+bool clientserver::SpscRing::prepareConsumerWait()
+{
+	pHeader_->consumerWaiting.store( 1 );
+	std::atomic_thread_fence( std::memory_order_seq_cst );
+	if( !empty() )
+	{
+		pHeader_->consumerWaiting.store( 0 );
+		return false;
+	}
+	return true;
+}
+
+bool clientserver::SpscRing::consumerNeedsWaking()
+{
+	// Pairs with the fence in prepareConsumerWait, so that either the consumer sees the new
+	// record or this sees the waiting flag. Only write to the flag if it's set so that the
+	// cache line isn't bounced between cores on every push.
+	std::atomic_thread_fence( std::memory_order_seq_cst );
+	if( pHeader_->consumerWaiting.load( std::memory_order_relaxed )==0 ) return false;
+	return pHeader_->consumerWaiting.exchange( 0 )!=0;
+}
+
+bool clientserver::SpscRing::prepareProducerWait( size_t recordSize )
+{
+	pHeader_->producerWaiting.store( 1 );
+	std::atomic_thread_fence( std::memory_order_seq_cst );
+	const uint64_t head=pHeader_->head.load( std::memory_order_relaxed );
+	const uint64_t tail=pHeader_->tail.load( std::memory_order_acquire );
+	if( capacity()-(head-tail) >= recordSize+recordPrefixSize )
+	{
+		pHeader_->producerWaiting.store( 0 );
+		return false;
+	}
+	return true;
+}
+
+bool clientserver::SpscRing::producerNeedsWaking()
+{
+	std::atomic_thread_fence( std::memory_order_seq_cst );
+	if( pHeader_->producerWaiting.load( std::memory_order_relaxed )==0 ) return false;
+	return pHeader_->producerWaiting.exchange( 0 )!=0;
+}
+
+void clientserver::SpscRing::copyIn( uint64_t position, const void* pData, size_t size )
+{
+	if( size==0 ) return;
+	const size_t offset=position & mask_;
+	const size_t firstPart=std::min( size, capacity()-offset );
+	std::memcpy( pData_+offset, pData, firstPart );
+	if( firstPart<size ) std::memcpy( pData_, static_cast<const char*>(pData)+firstPart, size-firstPart );
+}
+
+void clientserver::SpscRing::copyOut( uint64_t position, void* pData, size_t size ) const
+{
+	if( size==0 ) return;
+	const size_t offset=position & mask_;
+	const size_t firstPart=std::min( size, capacity()-offset );
+	std::memcpy( pData, pData_+offset, firstPart );
+	if( firstPart<size ) std::memcpy( static_cast<char*>(pData)+firstPart, pData_, size-firstPart );
+}
@@ -0,0 +1,232 @@
+#include "clientserver/StateDelta.h"
+
+#include <stdexcept>
+#include <google/protobuf/message.h>
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/io/coded_stream.h>
+
+namespace
+{
+	void appendVarint( std::string& output, uint64_t value )
+	{
+		do
+		{
+			output.push_back( static_cast<char>( (value & 0x7f) | (value>0x7f ? 0x80 : 0) ) );
+			value>>=7;
+		} while( value!=0 );
+	}
+
+	/** @brief Reads a varint from pData, moving it past the end. Returns false if it's truncated or too long. */
+	bool readVarint( const char*& pData, const char* pEnd, uint64_t& value )
+	{
+		value=0;
+		for( unsigned shift=0; pData<pEnd && shift<64; shift+=7 )
+		{
+			const uint8_t byte=static_cast<uint8_t>(*pData++);
+			value|=static_cast<uint64_t>(byte & 0x7f)<<shift;
+			if( (byte & 0x80)==0 ) return true;
+		}
+		return false;
+	}
+
+	void readString( const char*& pData, const char* pEnd, std::string& value )
+	{
+		uint64_t size;
+		if( !::readVarint( pData, pEnd, size ) || size>static_cast<uint64_t>(pEnd-pData) ) throw std::runtime_error( "StateDelta received a truncated subscription name" );
+		value.assign( pData, static_cast<size_t>(size) );
+		pData+=size;
+	}
+
+	/** @brief Compares one value of a field, or element "index" of a repeated field. */
+	bool valuesEqual( const google::protobuf::Message& first, const google::protobuf::Message& second, const google::protobuf::FieldDescriptor* pField, int index )
+	{
+		const google::protobuf::Reflection* pFirst=first.GetReflection();
+		const google::protobuf::Reflection* pSecond=second.GetReflection();
+#define CLIENTSERVER_VALUES_EQUAL(TYPE) return index<0 ? pFirst->Get##TYPE(first,pField)==pSecond->Get##TYPE(second,pField) \
+		: pFirst->GetRepeated##TYPE(first,pField,index)==pSecond->GetRepeated##TYPE(second,pField,index)
+		switch( pField->cpp_type() )
+		{
+			case google::protobuf::FieldDescriptor::CPPTYPE_INT32 : CLIENTSERVER_VALUES_EQUAL(Int32);
+			case google::protobuf::FieldDescriptor::CPPTYPE_INT64 : CLIENTSERVER_VALUES_EQUAL(Int64);
+			case google::protobuf::FieldDescriptor::CPPTYPE_UINT32 : CLIENTSERVER_VALUES_EQUAL(UInt32);
+			case google::protobuf::FieldDescriptor::CPPTYPE_UINT64 : CLIENTSERVER_VALUES_EQUAL(UInt64);
+			case google::protobuf::FieldDescriptor::CPPTYPE_DOUBLE : CLIENTSERVER_VALUES_EQUAL(Double);
+			case google::protobuf::FieldDescriptor::CPPTYPE_FLOAT : CLIENTSERVER_VALUES_EQUAL(Float);
+			case google::protobuf::FieldDescriptor::CPPTYPE_BOOL : CLIENTSERVER_VALUES_EQUAL(Bool);
+			case google::protobuf::FieldDescriptor::CPPTYPE_STRING : CLIENTSERVER_VALUES_EQUAL(String);
+			case google::protobuf::FieldDescriptor::CPPTYPE_ENUM :
+				return ( index<0 ? pFirst->GetEnum(first,pField) : pFirst->GetRepeatedEnum(first,pField,index) )->number()
+						==( index<0 ? pSecond->GetEnum(second,pField) : pSecond->GetRepeatedEnum(second,pField,index) )->number();
+			case google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE :
+				// Only sub messages inside repeated fields get here, so there's no need to find which part changed
+				return ( index<0 ? pFirst->GetMessage(first,pField) : pFirst->GetRepeatedMessage(first,pField,index) ).SerializePartialAsString()
+						==( index<0 ? pSecond->GetMessage(second,pField) : pSecond->GetRepeatedMessage(second,pField,index) ).SerializePartialAsString();
+		}
+#undef CLIENTSERVER_VALUES_EQUAL
+		return false;
+	}
+
+	bool fieldsEqual( const google::protobuf::Message& first, const google::protobuf::Message& second, const google::protobuf::FieldDescriptor* pField )
+	{
+		if( pField->is_repeated() )
+		{
+			const int size=first.GetReflection()->FieldSize( first, pField );
+			if( size!=second.GetReflection()->FieldSize( second, pField ) ) return false;
+			for( int index=0; index<size; ++index )
+			{
+				if( !::valuesEqual( first, second, pField, index ) ) return false;
+			}
+			return true;
+		}
+		if( first.GetReflection()->HasField( first, pField )!=second.GetReflection()->HasField( second, pField ) ) return false;
+		return ::valuesEqual( first, second, pField, -1 );
+	}
+
+	/** @brief Clears the fields of changes that are the same in base and current, and records the path of the others. */
+	void diffMessages( const google::protobuf::Message& base, const google::protobuf::Message& current, google::protobuf::Message& changes,
+			clientserver::StateDelta::FieldPath& path, std::vector<clientserver::StateDelta::FieldPath>& changedFields )
+	{
+		// ListFields gives the fields that are set in order of field number, so the two lists can be merged
+		std::vector<const google::protobuf::FieldDescriptor*> baseFields;
+		std::vector<const google::protobuf::FieldDescriptor*> currentFields;
+		base.GetReflection()->ListFields( base, &baseFields );
+		current.GetReflection()->ListFields( current, &currentFields );
+		std::vector<const google::protobuf::FieldDescriptor*> fields;
+		fields.reserve( baseFields.size()+currentFields.size() );
+		auto iBase=baseFields.begin();
+		auto iCurrent=currentFields.begin();
+		while( iBase!=baseFields.end() || iCurrent!=currentFields.end() )
+		{
+			if( iCurrent==currentFields.end() || (iBase!=baseFields.end() && (*iBase)->number()<(*iCurrent)->number()) ) fields.push_back( *iBase++ );
+			else if( iBase==baseFields.end() || (*iCurrent)->number()<(*iBase)->number() ) fields.push_back( *iCurrent++ );
+			else
+			{
+				fields.push_back( *iCurrent++ );
+				++iBase;
+			}
+		}
+
+		const google::protobuf::Reflection* pReflection=changes.GetReflection();
+		for( const google::protobuf::FieldDescriptor* pField : fields )
+		{
+			path.push_back( static_cast<uint32_t>(pField->number()) );
+			if( !pField->is_repeated() && pField->cpp_type()==google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE
+				&& base.GetReflection()->HasField( base, pField ) && current.GetReflection()->HasField( current, pField ) )
+			{
+				const size_t numberOfChanges=changedFields.size();
+				::diffMessages( base.GetReflection()->GetMessage( base, pField ), current.GetReflection()->GetMessage( current, pField ),
+						*pReflection->MutableMessage( &changes, pField ), path, changedFields );
+				if( changedFields.size()==numberOfChanges ) pReflection->ClearField( &changes, pField );
+			}
+			else if( ::fieldsEqual( base, current, pField ) ) pReflection->ClearField( &changes, pField );
+			else changedFields.push_back( path );
+			path.pop_back();
+		}
+	}
+
+	const google::protobuf::FieldDescriptor* findField( const google::protobuf::Message& message, uint32_t number )
+	{
+		const google::protobuf::FieldDescriptor* pField=message.GetDescriptor()->FindFieldByNumber( static_cast<int>(number) );
+		if( pField==nullptr ) pField=message.GetReflection()->FindKnownExtensionByNumber( static_cast<int>(number) );
+		if( pField==nullptr ) throw std::runtime_error( "StateDelta was given a change to field "+std::to_string(number)+", which "+message.GetDescriptor()->full_name()+" doesn't have" );
+		return pField;
+	}
+} // end of the unnamed namespace
+
+void clientserver::StateDelta::diff( const google::protobuf::Message& base, const google::protobuf::Message& current, std::vector<FieldPath>& changedFields, google::protobuf::Message& changes )
+{
+	if( base.GetDescriptor()!=current.GetDescriptor() || changes.GetDescriptor()!=current.GetDescriptor() ) throw std::invalid_argument( "StateDelta::diff was given messages of different types" );
+	changedFields.clear();
+	changes.CopyFrom( current );
+	FieldPath path;
+	::diffMessages( base, current, changes, path, changedFields );
+}
+
+void clientserver::StateDelta::apply( const std::vector<FieldPath>& changedFields, const char* pChanges, size_t changesSize, google::protobuf::Message& state )
+{
+	for( const auto& path : changedFields )
+	{
+		if( path.empty() ) throw std::runtime_error( "StateDelta was given an empty field path" );
+		google::protobuf::Message* pMessage=&state;
+		for( size_t depth=0; depth+1<path.size(); ++depth )
+		{
+			const google::protobuf::FieldDescriptor* pField=::findField( *pMessage, path[depth] );
+			if( pField->is_repeated() || pField->cpp_type()!=google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE ) throw std::runtime_error( "StateDelta was given a path through "+pField->full_name()+", which isn't a singular message" );
+			pMessage=pMessage->GetReflection()->MutableMessage( pMessage, pField );
+		}
+		pMessage->GetReflection()->ClearField( pMessage, ::findField( *pMessage, path.back() ) );
+	}
+
+	google::protobuf::io::CodedInputStream input( reinterpret_cast<const uint8_t*>(pChanges), static_cast<int>(changesSize) );
+	if( !state.MergePartialFromCodedStream( &input ) || !input.ConsumedEntireMessage() ) throw std::runtime_error( "StateDelta couldn't parse the changes to "+state.GetDescriptor()->full_name() );
+}
+
+void clientserver::StateDelta::encodeSnapshot( const std::string& subscription, uint64_t sequence, const google::protobuf::Message& state, std::string& output )
+{
+	output.push_back( static_cast<char>(UpdateType::snapshot) );
+	::appendVarint( output, sequence );
+	::appendVarint( output, subscription.size() );
+	output.append( subscription );
+	state.AppendPartialToString( &output );
+}
+
+void clientserver::StateDelta::encodeDelta( const std::string& subscription, uint64_t sequence, uint64_t baseSequence,
+		const std::vector<FieldPath>& changedFields, const google::protobuf::Message& changes, std::string& output )
+{
+	output.push_back( static_cast<char>(UpdateType::delta) );
+	::appendVarint( output, sequence );
+	::appendVarint( output, subscription.size() );
+	output.append( subscription );
+	::appendVarint( output, baseSequence );
+	::appendVarint( output, changedFields.size() );
+	for( const auto& path : changedFields )
+	{
+		::appendVarint( output, path.size() );
+		for( const uint32_t number : path ) ::appendVarint( output, number );
+	}
+	changes.AppendPartialToString( &output );
+}
+
+size_t clientserver::StateDelta::decodeHeader( const char* pData, size_t size, Header& header )
+{
+	const char* const pStart=pData;
+	const char* const pEnd=pData+size;
+	if( size==0 || (pData[0]!=static_cast<char>(UpdateType::snapshot) && pData[0]!=static_cast<char>(UpdateType::delta)) ) throw std::runtime_error( "StateDelta received an update of an unknown type" );
+	header.type=static_cast<UpdateType>(*pData++);
+	if( !::readVarint( pData, pEnd, header.sequence ) || header.sequence==0 ) throw std::runtime_error( "StateDelta received an update without a valid sequence number" );
+	::readString( pData, pEnd, header.subscription );
+	header.baseSequence=0;
+	header.changedFields.clear();
+	if( header.type==UpdateType::snapshot ) return pData-pStart;
+
+	uint64_t numberOfFields;
+	if( !::readVarint( pData, pEnd, header.baseSequence ) || header.baseSequence==0 || header.baseSequence>=header.sequence
+		|| !::readVarint( pData, pEnd, numberOfFields ) || numberOfFields>static_cast<uint64_t>(pEnd-pData) ) throw std::runtime_error( "StateDelta received a delta with an invalid header" );
+	header.changedFields.resize( static_cast<size_t>(numberOfFields) );
+	for( auto& path : header.changedFields )
+	{
+		uint64_t depth;
+		if( !::readVarint( pData, pEnd, depth ) || depth==0 || depth>static_cast<uint64_t>(pEnd-pData) ) throw std::runtime_error( "StateDelta received a delta with an invalid field path" );
+		path.resize( static_cast<size_t>(depth) );
+		for( auto& number : path )
+		{
+			uint64_t value;
+			if( !::readVarint( pData, pEnd, value ) || value==0 || value>0x1fffffff ) throw std::runtime_error( "StateDelta received a delta with an invalid field number" );
+			number=static_cast<uint32_t>(value);
+		}
+	}
+	return pData-pStart;
+}
+
+void clientserver::StateDelta::encodeAcknowledgement( const std::string& subscription, uint64_t sequence, std::string& output )
+{
+	::appendVarint( output, sequence );
+	output.append( subscription );
+}
+
+void clientserver::StateDelta::decodeAcknowledgement( const char* pData, size_t size, std::string& subscription, uint64_t& sequence )
+{
+	const char* pEnd=pData+size;
+	if( !::readVarint( pData, pEnd, sequence ) ) throw std::runtime_error( "StateDelta received an acknowledgement without a valid sequence number" );
+	subscription.assign( pData, pEnd );
+}
@@ -0,0 +1,156 @@
+#include "clientserver/TcpClient.h"
+
+#include <iostream>
+#include <system_error>
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <unistd.h>
+#include "clientserver/FramedSocket.h"
+#include "clientserver/TlsContext.h"
+
+int clientserver::connectTcp( const std::string& host, size_t port )
+{
+	addrinfo hints;
+	std::memset( &hints, 0, sizeof(hints) );
+	hints.ai_family=AF_UNSPEC;
+	hints.ai_socktype=SOCK_STREAM;
+	addrinfo* pAddresses=nullptr;
+	int result=::getaddrinfo( host.c_str(), std::to_string(port).c_str(), &hints, &pAddresses );
+	if( result!=0 ) throw std::runtime_error( "Couldn't resolve \""+host+"\": "+::gai_strerror(result) );
+
+	// Try each address in turn until one works
+	int socket=-1;
+	int savedErrno=0;
+	for( addrinfo* pAddress=pAddresses; pAddress!=nullptr && socket<0; pAddress=pAddress->ai_next )
+	{
+		socket=::socket( pAddress->ai_family, pAddress->ai_socktype | SOCK_CLOEXEC, pAddress->ai_protocol );
+		if( socket<0 )
+		{
+			savedErrno=errno;
+			continue;
+		}
+		if( ::connect( socket, pAddress->ai_addr, pAddress->ai_addrlen )!=0 )
+		{
+			savedErrno=errno;
+			::close( socket );
+			socket=-1;
+		}
+	}
+	::freeaddrinfo( pAddresses );
+	if( socket<0 ) throw std::system_error( savedErrno, std::system_category(), "Couldn't connect to "+host+":"+std::to_string(port) );
+	return socket;
+}
+
+clientserver::TcpClient::TcpClient()
+	: nextRequestId_(0)
+{
+	// No operation besides the initialiser list
+}
+
+clientserver::TcpClient::~TcpClient()
+{
+	disconnect();
+}
+
+void clientserver::TcpClient::enableTls( const std::string& verifyFile, bool verifyPeer )
+{
+	pTlsContext_=clientserver::TlsContext::createClient( verifyFile, verifyPeer );
+}
+
+void clientserver::TcpClient::setDefaultInfoHandler( std::function<void(const std::string&)> infoHandler )
+{
+	infoHandler_=infoHandler;
+}
+
+void clientserver::TcpClient::connect( const std::string& host, size_t port )
+{
+	disconnect();
+
+	int socket=clientserver::connectTcp( host, port );
+
+	int option=1;
+	::setsockopt( socket, IPPROTO_TCP, TCP_NODELAY, &option, sizeof(option) );
+
+	SSL* pSession=nullptr;
+	try
+	{
+		if( pTlsContext_ ) pSession=pTlsContext_->createSession( socket, false, host );
+	}
+	catch( ... )
+	{
+		::close( socket );
+		throw;
+	}
+	pSocket_.reset( new clientserver::FramedSocket( socket, pSession ) );
+
+	ioThread_=std::thread( [this]()
+		{
+			typedef clientserver::FramedSocket::MessageType MessageType;
+			pSocket_->run( [this]( MessageType type, uint32_t id, std::string& message )
+				{
+					try
+					{
+						if( type==MessageType::response )
+						{
+							std::function<void(const std::string&)> handler;
+							{
+								std::lock_guard<std::mutex> lock( responseHandlersMutex_ );
+								auto iFindResult=responseHandlers_.find( id );
+								if( iFindResult==responseHandlers_.end() ) return;
+								handler.swap( iFindResult->second );
+								responseHandlers_.erase( iFindResult );
+							}
+							if( handler ) handler( message );
+						}
+						else if( type==MessageType::info )
+						{
+							if( infoHandler_ ) infoHandler_( message );
+						}
+					}
+					catch( std::exception& error )
+					{
+						std::cerr << "TcpClient handler threw an exception: " << error.what() << std::endl;
+					}
+				}, -1 );
+		});
+}
+
+void clientserver::TcpClient::disconnect()
+{
+	if( !pSocket_ ) return;
+
+	pSocket_->close();
+	ioThread_.join();
+	pSocket_.reset();
+
+	std::lock_guard<std::mutex> lock( responseHandlersMutex_ );
+	responseHandlers_.clear();
+}
+
+bool clientserver::TcpClient::isConnected()
+{
+	return pSocket_ && pSocket_->isConnected();
+}
+
+void clientserver::TcpClient::sendInfo( const std::string& message )
+{
+	if( !isConnected() ) throw std::runtime_error( "TcpClient is not connected" );
+	pSocket_->send( clientserver::FramedSocket::MessageType::info, 0, message );
+}
+
+void clientserver::TcpClient::sendRequest( const std::string& message, std::function<void(const std::string&)> responseHandler )
+{
+	if( !isConnected() ) throw std::runtime_error( "TcpClient is not connected" );
+
+	const uint32_t id=nextRequestId_++;
+	{
+		std::lock_guard<std::mutex> lock( responseHandlersMutex_ );
+		responseHandlers_[id]=responseHandler;
+	}
+	pSocket_->send( clientserver::FramedSocket::MessageType::request, id, message );
+}
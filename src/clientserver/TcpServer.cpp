@@ -0,0 +1,383 @@
+#include "clientserver/TcpServer.h"
+
+#include <iostream>
+#include <system_error>
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <atomic>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <unistd.h>
+#include "clientserver/FramedSocket.h"
+#include "clientserver/TlsContext.h"
+#include "clientserver/ConnectionRegistry.h"
+#include "clientserver/RateLimiter.h"
+
+/** @brief Implementation of IConnection for a single TCP client, with the thread that services it.
+ *
+ * @author Mark Grimes
+ * @date 19/Oct/2026
+ */
+class clientserver::TcpServer::Connection : public clientserver::IConnection
+{
+public:
+	/** @param pRateLimiter  Checked before each message goes to a handler, or null for no limits.
+	 * @param outputLimit   The unsent bytes at which to stop reading requests, see FramedSocket::setOutputLimit(). */
+	Connection( int socket, SSL* pSession, std::shared_ptr<clientserver::RateLimiter> pRateLimiter, size_t outputLimit )
+		: socket_( socket, pSession ), connectionId_(0), pRateLimiter_( std::move(pRateLimiter) ),
+		  rateLimitState_( pRateLimiter_ ? clientserver::RateLimiter::ConnectionState(socket) : clientserver::RateLimiter::ConnectionState() )
+	{
+		socket_.setOutputLimit( outputLimit );
+	}
+	virtual ~Connection() { join(); }
+	virtual bool isConnected() override { return socket_.isConnected(); }
+	virtual void close() override { socket_.close(); }
+	virtual void sendInfo( const std::string& message ) override
+	{
+		socket_.send( clientserver::FramedSocket::MessageType::info, 0, message );
+	}
+	virtual uint64_t connectionId() const override { return connectionId_; }
+
+	/** @brief Adds the connection to the registry and starts its thread, which removes it again once the client has gone. */
+	void start( std::weak_ptr<Connection> pWeakThis, int stopEventFd, std::shared_ptr<clientserver::ConnectionRegistry> pConnectionRegistry,
+		std::function<std::string(const std::string&,std::weak_ptr<clientserver::IConnection>)> requestHandler,
+		std::function<void(const std::string&,std::weak_ptr<clientserver::IConnection>)> infoHandler )
+	{
+		connectionId_=pConnectionRegistry->add( pWeakThis );
+		pConnectionRegistry_=std::move( pConnectionRegistry );
+		thread_=std::thread( &Connection::run, this, pWeakThis, stopEventFd, requestHandler, infoHandler );
+	}
+	void join() { if( thread_.joinable() ) thread_.join(); }
+protected:
+	void run( std::weak_ptr<Connection> pWeakThis, int stopEventFd,
+		std::function<std::string(const std::string&,std::weak_ptr<clientserver::IConnection>)> requestHandler,
+		std::function<void(const std::string&,std::weak_ptr<clientserver::IConnection>)> infoHandler )
+	{
+		typedef clientserver::FramedSocket::MessageType MessageType;
+		std::weak_ptr<clientserver::IConnection> pWeakConnection=pWeakThis;
+
+		socket_.run( [&]( MessageType type, uint32_t id, std::string& message )
+			{
+				if( pRateLimiter_ && (type==MessageType::request || type==MessageType::info)
+					&& pRateLimiter_->admit( rateLimitState_, message.size() )!=clientserver::RateLimiter::Verdict::allowed )
+				{
+					if( type==MessageType::request ) socket_.send( MessageType::response, id, std::string() );
+					return;
+				}
+				try
+				{
+					if( type==MessageType::request )
+					{
+						std::string response;
+						if( requestHandler ) response=requestHandler( message, pWeakConnection );
+						socket_.send( MessageType::response, id, response );
+					}
+					else if( type==MessageType::info )
+					{
+						if( infoHandler ) infoHandler( message, pWeakConnection );
+					}
+				}
+				catch( std::exception& error )
+				{
+					std::cerr << "TcpServer handler threw an exception: " << error.what() << std::endl;
+					// Still reply so that the client isn't left waiting forever
+					if( type==MessageType::request ) socket_.send( MessageType::response, id, std::string() );
+				}
+			}, stopEventFd );
+		pConnectionRegistry_->remove( connectionId_ );
+	}
+
+	clientserver::FramedSocket socket_;
+	std::shared_ptr<clientserver::ConnectionRegistry> pConnectionRegistry_;
+	std::atomic<uint64_t> connectionId_;
+	std::shared_ptr<clientserver::RateLimiter> pRateLimiter_;
+	clientserver::RateLimiter::ConnectionState rateLimitState_; ///< Only touched by the connection's thread
+	std::thread thread_;
+};
+
+clientserver::TcpServer::TcpServer()
+	: listenSocket_(-1), port_(0), reusePort_(false), outputBufferSize_(clientserver::FramedSocket::defaultOutputLimit), pConnectionRegistry_(std::make_shared<clientserver::ConnectionRegistry>()), stopEventFd_(-1), stopAcceptingEventFd_(-1)
+{
+	// No operation besides the initialiser list
+}
+
+clientserver::TcpServer::~TcpServer()
+{
+	stop();
+}
+
+void clientserver::TcpServer::setCertificateChainFile( const std::string& filename )
+{
+	certificateChainFile_=filename;
+}
+
+void clientserver::TcpServer::setPrivateKeyFile( const std::string& filename )
+{
+	privateKeyFile_=filename;
+}
+
+void clientserver::TcpServer::setDefaultRequestHandler( std::function<std::string(const std::string&,std::weak_ptr<clientserver::IConnection>)> requestHandler )
+{
+	requestHandler_=requestHandler;
+}
+
+void clientserver::TcpServer::setDefaultInfoHandler( std::function<void(const std::string&,std::weak_ptr<clientserver::IConnection>)> infoHandler )
+{
+	infoHandler_=infoHandler;
+}
+
+void clientserver::TcpServer::setReusePort( bool reusePort )
+{
+	reusePort_=reusePort;
+}
+
+void clientserver::TcpServer::setOutputBufferSize( size_t outputBufferSize )
+{
+	outputBufferSize_=outputBufferSize;
+}
+
+void clientserver::TcpServer::setConnectionRegistry( std::shared_ptr<clientserver::ConnectionRegistry> pConnectionRegistry )
+{
+	pConnectionRegistry_=std::move( pConnectionRegistry );
+}
+
+const std::shared_ptr<clientserver::ConnectionRegistry>& clientserver::TcpServer::connectionRegistry() const
+{
+	return pConnectionRegistry_;
+}
+
+void clientserver::TcpServer::setRateLimiter( std::shared_ptr<clientserver::RateLimiter> pRateLimiter )
+{
+	pRateLimiter_=std::move( pRateLimiter );
+}
+
+void clientserver::TcpServer::listen( size_t port )
+{
+	if( listenSocket_>=0 ) throw std::logic_error( "TcpServer is already listening" );
+
+	// Only use TLS if a certificate has been set, the same as communique::Server
+	if( !certificateChainFile_.empty() || !privateKeyFile_.empty() ) pTlsContext_=clientserver::TlsContext::createServer( certificateChainFile_, privateKeyFile_ );
+	else pTlsContext_.reset();
+
+	// Non blocking so that the accept thread can't get stuck if another process shares the socket and takes the connection first
+	listenSocket_=::socket( AF_INET6, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+	if( listenSocket_<0 ) throw std::system_error( errno, std::system_category(), "Couldn't create a TCP socket" );
+
+	// Accept both IPv4 and IPv6 on the one socket
+	int option=0;
+	::setsockopt( listenSocket_, IPPROTO_IPV6, IPV6_V6ONLY, &option, sizeof(option) );
+	option=1;
+	::setsockopt( listenSocket_, SOL_SOCKET, SO_REUSEADDR, &option, sizeof(option) );
+	if( reusePort_ && ::setsockopt( listenSocket_, SOL_SOCKET, SO_REUSEPORT, &option, sizeof(option) )!=0 )
+	{
+		int savedErrno=errno;
+		::close( listenSocket_ );
+		listenSocket_=-1;
+		throw std::system_error( savedErrno, std::system_category(), "Couldn't set SO_REUSEPORT" );
+	}
+
+	sockaddr_in6 address;
+	std::memset( &address, 0, sizeof(address) );
+	address.sin6_family=AF_INET6;
+	address.sin6_addr=in6addr_any;
+	address.sin6_port=htons( static_cast<uint16_t>(port) );
+	socklen_t addressLength=sizeof(address);
+	if( ::bind( listenSocket_, reinterpret_cast<sockaddr*>(&address), sizeof(address) )!=0
+			|| ::listen( listenSocket_, SOMAXCONN )!=0
+			|| ::getsockname( listenSocket_, reinterpret_cast<sockaddr*>(&address), &addressLength )!=0 )
+	{
+		int savedErrno=errno;
+		::close( listenSocket_ );
+		listenSocket_=-1;
+		throw std::system_error( savedErrno, std::system_category(), "Couldn't listen on port "+std::to_string(port) );
+	}
+	port_=ntohs( address.sin6_port );
+
+	startAcceptThread();
+}
+
+void clientserver::TcpServer::listenOnSocket( int socket )
+{
+	if( listenSocket_>=0 ) throw std::logic_error( "TcpServer is already listening" );
+
+	int isListening=0;
+	socklen_t optionLength=sizeof(isListening);
+	sockaddr_in6 address;
+	socklen_t addressLength=sizeof(address);
+	const int flags=::fcntl( socket, F_GETFL );
+	if( ::getsockopt( socket, SOL_SOCKET, SO_ACCEPTCONN, &isListening, &optionLength )!=0
+			|| ::getsockname( socket, reinterpret_cast<sockaddr*>(&address), &addressLength )!=0
+			|| flags<0 || ::fcntl( socket, F_SETFL, flags | O_NONBLOCK )!=0 )
+	{
+		int savedErrno=errno;
+		::close( socket );
+		throw std::system_error( savedErrno, std::system_category(), "Couldn't use the socket given to listen on" );
+	}
+	if( !isListening || address.sin6_family!=AF_INET6 )
+	{
+		::close( socket );
+		throw std::invalid_argument( "TcpServer was given a socket to listen on that isn't a listening IPv6 TCP socket" );
+	}
+
+	if( !certificateChainFile_.empty() || !privateKeyFile_.empty() )
+	{
+		try
+		{
+			pTlsContext_=clientserver::TlsContext::createServer( certificateChainFile_, privateKeyFile_ );
+		}
+		catch( ... )
+		{
+			::close( socket );
+			throw;
+		}
+	}
+	else pTlsContext_.reset();
+
+	listenSocket_=socket;
+	port_=ntohs( address.sin6_port );
+	startAcceptThread();
+}
+
+int clientserver::TcpServer::listenSocket() const
+{
+	return listenSocket_;
+}
+
+void clientserver::TcpServer::stopAccepting()
+{
+	if( stopAcceptingEventFd_<0 ) return;
+	uint64_t value=1;
+	while( ::write( stopAcceptingEventFd_, &value, sizeof(value) )<0 && errno==EINTR );
+}
+
+size_t clientserver::TcpServer::currentConnections() const
+{
+	std::lock_guard<std::mutex> lock( connectionsMutex_ );
+	size_t total=0;
+	for( const auto& pConnection : connections_ )
+	{
+		if( pConnection->isConnected() ) ++total;
+	}
+	return total;
+}
+
+void clientserver::TcpServer::startAcceptThread()
+{
+	stopEventFd_=::eventfd( 0, EFD_CLOEXEC );
+	stopAcceptingEventFd_=::eventfd( 0, EFD_CLOEXEC );
+	if( stopEventFd_<0 || stopAcceptingEventFd_<0 )
+	{
+		int savedErrno=errno;
+		if( stopEventFd_>=0 ) ::close( stopEventFd_ );
+		if( stopAcceptingEventFd_>=0 ) ::close( stopAcceptingEventFd_ );
+		::close( listenSocket_ );
+		listenSocket_=stopEventFd_=stopAcceptingEventFd_=-1;
+		throw std::system_error( savedErrno, std::system_category(), "Couldn't create an eventfd" );
+	}
+
+	acceptThread_=std::thread( &TcpServer::acceptLoop, this );
+}
+
+size_t clientserver::TcpServer::port() const
+{
+	return port_;
+}
+
+void clientserver::TcpServer::stop()
+{
+	if( listenSocket_<0 ) return;
+
+	uint64_t value=1;
+	while( ::write( stopEventFd_, &value, sizeof(value) )<0 && errno==EINTR );
+
+	acceptThread_.join();
+	{
+		std::lock_guard<std::mutex> lock( connectionsMutex_ );
+		for( auto& pConnection : connections_ ) pConnection->join();
+		connections_.clear();
+	}
+
+	::close( listenSocket_ );
+	::close( stopEventFd_ );
+	::close( stopAcceptingEventFd_ );
+	listenSocket_=stopEventFd_=stopAcceptingEventFd_=-1;
+}
+
+void clientserver::TcpServer::acceptLoop()
+{
+	pollfd descriptors[3];
+	descriptors[0].fd=listenSocket_;
+	descriptors[0].events=POLLIN;
+	descriptors[1].fd=stopEventFd_;
+	descriptors[1].events=POLLIN;
+	descriptors[2].fd=stopAcceptingEventFd_;
+	descriptors[2].events=POLLIN;
+
+	while( true )
+	{
+		if( ::poll( descriptors, 3, -1 )<0 )
+		{
+			if( errno==EINTR ) continue;
+			std::cerr << "TcpServer couldn't poll the listening socket: " << std::strerror(errno) << std::endl;
+			return;
+		}
+		// The connections have their own threads, so stop() can still close them after this has returned
+		if( descriptors[1].revents!=0 || descriptors[2].revents!=0 ) return;
+		if( (descriptors[0].revents & POLLIN)==0 ) continue;
+
+		int socket=::accept4( listenSocket_, nullptr, nullptr, SOCK_CLOEXEC );
+		if( socket<0 ) continue;
+
+		// Requests and responses are small and latency sensitive, and the FramedSocket already
+		// batches everything it can into each write.
+		int option=1;
+		::setsockopt( socket, IPPROTO_TCP, TCP_NODELAY, &option, sizeof(option) );
+
+		SSL* pSession=nullptr;
+		try
+		{
+			if( pTlsContext_ ) pSession=pTlsContext_->createSession( socket, true );
+		}
+		catch( std::exception& error )
+		{
+			std::cerr << "TcpServer couldn't set up TLS for a connection: " << error.what() << std::endl;
+			::close( socket );
+			continue;
+		}
+
+		std::shared_ptr<Connection> pConnection;
+		try
+		{
+			// Takes ownership of the socket and session, even if it throws
+			pConnection=std::make_shared<Connection>( socket, pSession, pRateLimiter_, outputBufferSize_ );
+		}
+		catch( std::exception& error )
+		{
+			std::cerr << "TcpServer couldn't set up a connection: " << error.what() << std::endl;
+			continue;
+		}
+
+		std::lock_guard<std::mutex> lock( connectionsMutex_ );
+		removeFinishedConnections();
+		connections_.push_back( pConnection );
+		pConnection->start( pConnection, stopEventFd_, pConnectionRegistry_, requestHandler_, infoHandler_ );
+	}
+}
+
+void clientserver::TcpServer::removeFinishedConnections()
+{
+	for( auto iConnection=connections_.begin(); iConnection!=connections_.end(); )
+	{
+		if( !(*iConnection)->isConnected() )
+		{
+			(*iConnection)->join();
+			iConnection=connections_.erase( iConnection );
+		}
+		else ++iConnection;
+	}
+}
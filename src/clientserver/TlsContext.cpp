@@ -0,0 +1,89 @@
+#include "clientserver/TlsContext.h"
+
+#include <stdexcept>
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+
+std::string clientserver::lastTlsError()
+{
+	unsigned long errorCode=ERR_get_error();
+	ERR_clear_error();
+	if( errorCode==0 ) return "unknown TLS error";
+	char buffer[256];
+	ERR_error_string_n( errorCode, buffer, sizeof(buffer) );
+	return buffer;
+}
+
+std::shared_ptr<clientserver::TlsContext> clientserver::TlsContext::createServer( const std::string& certificateChainFile, const std::string& privateKeyFile )
+{
+	SSL_CTX* pContext=SSL_CTX_new( TLS_server_method() );
+	if( pContext==nullptr ) throw std::runtime_error( "Couldn't create the TLS context: "+clientserver::lastTlsError() );
+	std::shared_ptr<TlsContext> pReturnValue( new TlsContext(pContext) );
+
+	SSL_CTX_set_min_proto_version( pContext, TLS1_2_VERSION );
+	if( SSL_CTX_use_certificate_chain_file( pContext, certificateChainFile.c_str() )!=1 )
+	{
+		throw std::runtime_error( "Couldn't load the certificate chain \""+certificateChainFile+"\": "+clientserver::lastTlsError() );
+	}
+	if( SSL_CTX_use_PrivateKey_file( pContext, privateKeyFile.c_str(), SSL_FILETYPE_PEM )!=1 )
+	{
+		throw std::runtime_error( "Couldn't load the private key \""+privateKeyFile+"\": "+clientserver::lastTlsError() );
+	}
+	if( SSL_CTX_check_private_key( pContext )!=1 ) throw std::runtime_error( "The private key does not match the certificate: "+clientserver::lastTlsError() );
+
+	return pReturnValue;
+}
+
+std::shared_ptr<clientserver::TlsContext> clientserver::TlsContext::createClient( const std::string& verifyFile, bool verifyPeer )
+{
+	SSL_CTX* pContext=SSL_CTX_new( TLS_client_method() );
+	if( pContext==nullptr ) throw std::runtime_error( "Couldn't create the TLS context: "+clientserver::lastTlsError() );
+	std::shared_ptr<TlsContext> pReturnValue( new TlsContext(pContext) );
+
+	SSL_CTX_set_min_proto_version( pContext, TLS1_2_VERSION );
+	if( verifyPeer )
+	{
+		SSL_CTX_set_verify( pContext, SSL_VERIFY_PEER, nullptr );
+		if( verifyFile.empty() ) SSL_CTX_set_default_verify_paths( pContext );
+		else if( SSL_CTX_load_verify_locations( pContext, verifyFile.c_str(), nullptr )!=1 )
+		{
+			throw std::runtime_error( "Couldn't load the verify file \""+verifyFile+"\": "+clientserver::lastTlsError() );
+		}
+	}
+	else SSL_CTX_set_verify( pContext, SSL_VERIFY_NONE, nullptr );
+
+	return pReturnValue;
+}
+
+clientserver::TlsContext::TlsContext( SSL_CTX* pContext )
+	: pContext_(pContext)
+{
+	// No operation besides the initialiser list
+}
+
+clientserver::TlsContext::~TlsContext()
+{
+	SSL_CTX_free( pContext_ );
+}
+
+SSL* clientserver::TlsContext::createSession( int socket, bool isServer, const std::string& hostname ) const
+{
+	SSL* pSession=SSL_new( pContext_ );
+	if( pSession==nullptr ) throw std::runtime_error( "Couldn't create a TLS session: "+clientserver::lastTlsError() );
+	if( SSL_set_fd( pSession, socket )!=1 )
+	{
+		SSL_free( pSession );
+		throw std::runtime_error( "Couldn't attach the TLS session to the socket: "+clientserver::lastTlsError() );
+	}
+	if( isServer ) SSL_set_accept_state( pSession );
+	else
+	{
+		if( !hostname.empty() && (SSL_set_tlsext_host_name( pSession, hostname.c_str() )!=1 || SSL_set1_host( pSession, hostname.c_str() )!=1) )
+		{
+			SSL_free( pSession );
+			throw std::runtime_error( "Couldn't set the TLS host name: "+clientserver::lastTlsError() );
+		}
+		SSL_set_connect_state( pSession );
+	}
+	return pSession;
+}
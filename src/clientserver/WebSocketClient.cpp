@@ -0,0 +1,417 @@
+#include "clientserver/WebSocketClient.h"
+
+#include <iostream>
+#include <system_error>
+#include <stdexcept>
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#include "clientserver/TcpClient.h"
+#include "clientserver/WebSocketHandshake.h"
+#include "clientserver/MessageEnvelope.h"
+#include "clientserver/BatchEnvelope.h"
+
+namespace
+{
+	/** @brief How much to try and read from the socket in one go. */
+	const size_t readSize=64*1024;
+
+	void sendAll( int socket, const char* pData, size_t size )
+	{
+		while( size>0 )
+		{
+			ssize_t bytesWritten=::send( socket, pData, size, MSG_NOSIGNAL );
+			if( bytesWritten<0 )
+			{
+				if( errno==EINTR ) continue;
+				throw std::system_error( errno, std::system_category(), "Couldn't write to the WebSocket" );
+			}
+			pData+=bytesWritten;
+			size-=bytesWritten;
+		}
+	}
+} // end of the unnamed namespace
+
+clientserver::WebSocketClient::WebSocketClient()
+	: socket_(-1), connected_(false), nextRequestId_(0), compressionEnabled_(false), dictionaryThreshold_(clientserver::ZstdDictionaryCompressor::defaultThreshold), maskGenerator_(std::random_device()())
+{
+	// No operation besides the initialiser list
+}
+
+clientserver::WebSocketClient::~WebSocketClient()
+{
+	disconnect();
+}
+
+void clientserver::WebSocketClient::setDefaultInfoHandler( std::function<void(const std::string&)> infoHandler )
+{
+	infoHandler_=infoHandler;
+}
+
+void clientserver::WebSocketClient::setCompression( const clientserver::PerMessageDeflate::Configuration& configuration )
+{
+	compressionEnabled_=true;
+	compressionConfiguration_=configuration;
+}
+
+void clientserver::WebSocketClient::setCompressionDictionaries( std::vector<std::shared_ptr<const clientserver::ZstdDictionary> > dictionaries, size_t threshold )
+{
+	compressionDictionaries_=std::move( dictionaries );
+	dictionaryThreshold_=threshold;
+}
+
+void clientserver::WebSocketClient::connect( const std::string& host, size_t port, const std::string& path )
+{
+	disconnect();
+
+	int socket=clientserver::connectTcp( host, port );
+	int option=1;
+	::setsockopt( socket, IPPROTO_TCP, TCP_NODELAY, &option, sizeof(option) );
+
+	std::string initialData;
+	try
+	{
+		// Don't wait forever if the server never answers the upgrade
+		timeval timeout{ 10, 0 };
+		::setsockopt( socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout) );
+
+		std::string key;
+		std::string offer=clientserver::ZstdDictionaryCompressor::createOffer( compressionDictionaries_ );
+		if( compressionEnabled_ ) offer+=(offer.empty() ? "" : ", ")+clientserver::PerMessageDeflate::createOffer( compressionConfiguration_ );
+		const std::string request=clientserver::WebSocketHandshake::createRequest( host+":"+std::to_string(port), path, key, offer );
+		::sendAll( socket, request.data(), request.size() );
+
+		std::string response;
+		std::string extensions;
+		size_t responseSize;
+		clientserver::WebSocketHandshake::Result result=clientserver::WebSocketHandshake::Result::incomplete;
+		while( result==clientserver::WebSocketHandshake::Result::incomplete )
+		{
+			char buffer[4096];
+			ssize_t bytesRead=::recv( socket, buffer, sizeof(buffer), 0 );
+			if( bytesRead<0 && errno==EINTR ) continue;
+			if( bytesRead<0 ) throw std::system_error( errno, std::system_category(), "Couldn't read the WebSocket handshake" );
+			if( bytesRead==0 ) throw std::runtime_error( "The server closed the connection during the WebSocket handshake" );
+			response.append( buffer, bytesRead );
+			result=clientserver::WebSocketHandshake::parseResponse( response.data(), response.size(), key, responseSize, &extensions );
+		}
+		if( result!=clientserver::WebSocketHandshake::Result::upgrade ) throw std::runtime_error( "The server refused the WebSocket upgrade: "+response.substr(0,response.find('\r')) );
+		clientserver::PerMessageDeflate::Parameters agreed;
+		if( auto pDictionary=clientserver::ZstdDictionaryCompressor::acceptResponse( extensions, compressionDictionaries_ ) )
+		{
+			pCompressor_.reset( new clientserver::ZstdDictionaryCompressor( pDictionary, dictionaryThreshold_ ) );
+		}
+		else if( !compressionEnabled_ && !extensions.empty() ) throw std::runtime_error( "The server agreed to WebSocket extensions that weren't offered: \""+extensions+"\"" );
+		else if( compressionEnabled_ && clientserver::PerMessageDeflate::acceptResponse( extensions, compressionConfiguration_, agreed ) )
+		{
+			pCompressor_.reset( new clientserver::PerMessageDeflate( compressionConfiguration_, agreed ) );
+		}
+		initialData=response.substr( responseSize );
+
+		timeout=timeval{ 0, 0 };
+		::setsockopt( socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout) );
+	}
+	catch( ... )
+	{
+		::close( socket );
+		pCompressor_.reset();
+		throw;
+	}
+
+	socket_=socket;
+	connected_=true;
+	receiveThread_=std::thread( &WebSocketClient::receiveLoop, this, std::move(initialData) );
+}
+
+void clientserver::WebSocketClient::disconnect()
+{
+	if( socket_<0 ) return;
+
+	if( connected_ )
+	{
+		try
+		{
+			std::lock_guard<std::mutex> lock( sendMutex_ );
+			sendBuffer_.clear();
+			const uint8_t mask[4]={ 0, 0, 0, 0 };
+			clientserver::WebSocketFramer::encodeClose( 1000, sendBuffer_, mask );
+			::sendAll( socket_, sendBuffer_.data(), sendBuffer_.size() );
+		}
+		catch( std::exception& error )
+		{
+			// Closing anyway, so doesn't matter
+		}
+	}
+	// Wakes the receive thread up
+	::shutdown( socket_, SHUT_RDWR );
+	receiveThread_.join();
+	::close( socket_ );
+	socket_=-1;
+	connected_=false;
+	pCompressor_.reset();
+
+	std::lock_guard<std::mutex> lock( responseHandlersMutex_ );
+	responseHandlers_.clear();
+	streamHandlers_.clear();
+}
+
+bool clientserver::WebSocketClient::isConnected()
+{
+	return connected_;
+}
+
+bool clientserver::WebSocketClient::isCompressing() const
+{
+	return pCompressor_!=nullptr;
+}
+
+void clientserver::WebSocketClient::sendInfo( const std::string& message )
+{
+	sendInfo( clientserver::WebSocketFramer::Opcode::text, message );
+}
+
+void clientserver::WebSocketClient::sendRequest( const std::string& message, std::function<void(const std::string&)> responseHandler )
+{
+	sendRequest( clientserver::WebSocketFramer::Opcode::text, message, responseHandler );
+}
+
+void clientserver::WebSocketClient::sendBinaryInfo( const std::string& message )
+{
+	sendInfo( clientserver::WebSocketFramer::Opcode::binary, message );
+}
+
+void clientserver::WebSocketClient::sendBinaryRequest( const std::string& message, std::function<void(const std::string&)> responseHandler )
+{
+	sendRequest( clientserver::WebSocketFramer::Opcode::binary, message, responseHandler );
+}
+
+void clientserver::WebSocketClient::sendStreamingRequest( const std::string& message, std::function<void(const std::string&)> chunkHandler, std::function<void(const std::string&)> endHandler )
+{
+	sendStreamingRequest( clientserver::WebSocketFramer::Opcode::text, message, chunkHandler, endHandler );
+}
+
+void clientserver::WebSocketClient::sendBinaryStreamingRequest( const std::string& message, std::function<void(const std::string&)> chunkHandler, std::function<void(const std::string&)> endHandler )
+{
+	sendStreamingRequest( clientserver::WebSocketFramer::Opcode::binary, message, chunkHandler, endHandler );
+}
+
+void clientserver::WebSocketClient::sendBatch( const std::vector<std::string>& messages, std::function<void(const std::vector<std::string>&)> responsesHandler )
+{
+	sendBatch( clientserver::WebSocketFramer::Opcode::text, messages, responsesHandler );
+}
+
+void clientserver::WebSocketClient::sendStreamingBatch( const std::vector<std::string>& messages, std::function<void(size_t,const std::string&)> responseHandler, std::function<void(const std::string&)> endHandler )
+{
+	sendStreamingBatch( clientserver::WebSocketFramer::Opcode::text, messages, responseHandler, endHandler );
+}
+
+void clientserver::WebSocketClient::sendBinaryBatch( const std::vector<std::string>& messages, std::function<void(const std::vector<std::string>&)> responsesHandler )
+{
+	sendBatch( clientserver::WebSocketFramer::Opcode::binary, messages, responsesHandler );
+}
+
+void clientserver::WebSocketClient::sendBinaryStreamingBatch( const std::vector<std::string>& messages, std::function<void(size_t,const std::string&)> responseHandler, std::function<void(const std::string&)> endHandler )
+{
+	sendStreamingBatch( clientserver::WebSocketFramer::Opcode::binary, messages, responseHandler, endHandler );
+}
+
+void clientserver::WebSocketClient::sendInfo( clientserver::WebSocketFramer::Opcode opcode, const std::string& message )
+{
+	if( !isConnected() ) throw std::runtime_error( "WebSocketClient is not connected" );
+
+	std::string envelope;
+	clientserver::MessageEnvelope::encode( clientserver::MessageEnvelope::MessageType::info, 0, message, envelope );
+	std::lock_guard<std::mutex> lock( sendMutex_ );
+	sendFrame( opcode, envelope );
+}
+
+void clientserver::WebSocketClient::sendRequest( clientserver::WebSocketFramer::Opcode opcode, const std::string& message, std::function<void(const std::string&)> responseHandler )
+{
+	if( !isConnected() ) throw std::runtime_error( "WebSocketClient is not connected" );
+
+	const uint32_t id=nextRequestId_++;
+	{
+		std::lock_guard<std::mutex> lock( responseHandlersMutex_ );
+		responseHandlers_[id]=responseHandler;
+	}
+	std::string envelope;
+	clientserver::MessageEnvelope::encode( clientserver::MessageEnvelope::MessageType::request, id, message, envelope );
+	std::lock_guard<std::mutex> lock( sendMutex_ );
+	sendFrame( opcode, envelope );
+}
+
+void clientserver::WebSocketClient::sendStreamingRequest( clientserver::WebSocketFramer::Opcode opcode, const std::string& message, std::function<void(const std::string&)> chunkHandler, std::function<void(const std::string&)> endHandler )
+{
+	if( !isConnected() ) throw std::runtime_error( "WebSocketClient is not connected" );
+
+	const uint32_t id=nextRequestId_++;
+	{
+		std::lock_guard<std::mutex> lock( responseHandlersMutex_ );
+		streamHandlers_[id]=std::make_pair( chunkHandler, endHandler );
+	}
+	std::string envelope;
+	clientserver::MessageEnvelope::encode( clientserver::MessageEnvelope::MessageType::streamRequest, id, message, envelope );
+	std::lock_guard<std::mutex> lock( sendMutex_ );
+	sendFrame( opcode, envelope );
+}
+
+void clientserver::WebSocketClient::sendBatch( clientserver::WebSocketFramer::Opcode opcode, const std::vector<std::string>& messages, std::function<void(const std::vector<std::string>&)> responsesHandler )
+{
+	if( !isConnected() ) throw std::runtime_error( "WebSocketClient is not connected" );
+
+	const uint32_t id=nextRequestId_++;
+	const size_t numberOfMessages=messages.size();
+	{
+		std::lock_guard<std::mutex> lock( responseHandlersMutex_ );
+		responseHandlers_[id]=[numberOfMessages,responsesHandler]( const std::string& response )
+			{
+				// The responses are in the order they finished, so put them back in the order of the requests
+				std::vector<clientserver::BatchEnvelope::Entry> entries;
+				clientserver::BatchEnvelope::decode( response, entries );
+				std::vector<std::string> responses( numberOfMessages );
+				for( auto& entry : entries )
+				{
+					if( entry.id<numberOfMessages ) responses[entry.id].swap( entry.payload );
+				}
+				if( responsesHandler ) responsesHandler( responses );
+			};
+	}
+	const std::string envelope=encodeBatch( clientserver::MessageEnvelope::MessageType::batchRequest, id, messages );
+	std::lock_guard<std::mutex> lock( sendMutex_ );
+	sendFrame( opcode, envelope );
+}
+
+void clientserver::WebSocketClient::sendStreamingBatch( clientserver::WebSocketFramer::Opcode opcode, const std::vector<std::string>& messages, std::function<void(size_t,const std::string&)> responseHandler, std::function<void(const std::string&)> endHandler )
+{
+	if( !isConnected() ) throw std::runtime_error( "WebSocketClient is not connected" );
+
+	const uint32_t id=nextRequestId_++;
+	auto chunkHandler=[responseHandler]( const std::string& chunk )
+		{
+			std::vector<clientserver::BatchEnvelope::Entry> entries;
+			clientserver::BatchEnvelope::decode( chunk, entries );
+			for( const auto& entry : entries )
+			{
+				if( responseHandler ) responseHandler( entry.id, entry.payload );
+			}
+		};
+	{
+		std::lock_guard<std::mutex> lock( responseHandlersMutex_ );
+		streamHandlers_[id]=std::make_pair( chunkHandler, endHandler );
+	}
+	const std::string envelope=encodeBatch( clientserver::MessageEnvelope::MessageType::streamingBatchRequest, id, messages );
+	std::lock_guard<std::mutex> lock( sendMutex_ );
+	sendFrame( opcode, envelope );
+}
+
+std::string clientserver::WebSocketClient::encodeBatch( clientserver::MessageEnvelope::MessageType type, uint32_t id, const std::vector<std::string>& messages )
+{
+	std::string envelope=clientserver::MessageEnvelope::header( type, id );
+	for( size_t index=0; index<messages.size(); ++index ) clientserver::BatchEnvelope::encode( static_cast<uint32_t>(index), messages[index], envelope );
+	return envelope;
+}
+
+void clientserver::WebSocketClient::sendFrame( clientserver::WebSocketFramer::Opcode opcode, const std::string& payload )
+{
+	const uint32_t randomMask=maskGenerator_();
+	const uint8_t mask[4]={ static_cast<uint8_t>(randomMask), static_cast<uint8_t>(randomMask>>8), static_cast<uint8_t>(randomMask>>16), static_cast<uint8_t>(randomMask>>24) };
+	sendBuffer_.clear();
+	const bool isDataFrame=(opcode==clientserver::WebSocketFramer::Opcode::text || opcode==clientserver::WebSocketFramer::Opcode::binary);
+	if( isDataFrame && pCompressor_ && pCompressor_->shouldCompress( payload.size() ) )
+	{
+		compressBuffer_.clear();
+		pCompressor_->compress( payload.data(), payload.size(), compressBuffer_, true );
+		clientserver::WebSocketFramer::encodeHeader( opcode, compressBuffer_.size(), sendBuffer_, mask, true );
+		const size_t payloadStart=sendBuffer_.size();
+		sendBuffer_+=compressBuffer_;
+		clientserver::applyWebSocketMask( &sendBuffer_[payloadStart], compressBuffer_.size(), mask );
+	}
+	else clientserver::WebSocketFramer::encode( opcode, payload, sendBuffer_, mask );
+	::sendAll( socket_, sendBuffer_.data(), sendBuffer_.size() );
+}
+
+void clientserver::WebSocketClient::receiveLoop( std::string initialData )
+{
+	typedef clientserver::WebSocketFramer::Opcode Opcode;
+	typedef clientserver::MessageEnvelope::MessageType MessageType;
+
+	clientserver::WebSocketFramer framer( clientserver::WebSocketFramer::Role::client );
+	framer.setCompressor( pCompressor_.get() );
+	framer.append( initialData.data(), initialData.size() );
+
+	Opcode opcode;
+	std::string message;
+	MessageType type;
+	uint32_t id;
+	bool keepGoing=true;
+	while( keepGoing )
+	{
+		try
+		{
+			while( keepGoing && framer.next( opcode, message ) )
+			{
+				if( opcode==Opcode::text || opcode==Opcode::binary )
+				{
+					clientserver::MessageEnvelope::decode( message, type, id );
+					if( type==MessageType::overloaded )
+					{
+						// Nothing was run, which this client treats the same as a handler failing
+						type=MessageType::response;
+						message.clear();
+					}
+					if( type==MessageType::response )
+					{
+						std::function<void(const std::string&)> handler;
+						{
+							std::lock_guard<std::mutex> lock( responseHandlersMutex_ );
+							auto iFindResult=responseHandlers_.find( id );
+							if( iFindResult==responseHandlers_.end() ) continue;
+							handler.swap( iFindResult->second );
+							responseHandlers_.erase( iFindResult );
+						}
+						if( handler ) handler( message );
+					}
+					else if( type==MessageType::streamChunk || type==MessageType::streamEnd )
+					{
+						std::function<void(const std::string&)> handler;
+						{
+							std::lock_guard<std::mutex> lock( responseHandlersMutex_ );
+							auto iFindResult=streamHandlers_.find( id );
+							if( iFindResult==streamHandlers_.end() ) continue;
+							if( type==MessageType::streamChunk ) handler=iFindResult->second.first;
+							else
+							{
+								handler.swap( iFindResult->second.second );
+								streamHandlers_.erase( iFindResult );
+							}
+						}
+						if( handler ) handler( message );
+					}
+					else if( type==MessageType::info && infoHandler_ ) infoHandler_( message );
+				}
+				else if( opcode==Opcode::ping )
+				{
+					std::lock_guard<std::mutex> lock( sendMutex_ );
+					sendFrame( Opcode::pong, message );
+				}
+				else if( opcode==Opcode::close ) keepGoing=false;
+			}
+		}
+		catch( std::exception& error )
+		{
+			std::cerr << "WebSocketClient closing the connection: " << error.what() << std::endl;
+			break;
+		}
+		if( !keepGoing ) break;
+
+		ssize_t bytesRead=::recv( socket_, framer.reserve(::readSize), ::readSize, 0 );
+		if( bytesRead<0 && errno==EINTR ) continue;
+		if( bytesRead<=0 ) break;
+		framer.commit( bytesRead );
+	}
+
+	connected_=false;
+}
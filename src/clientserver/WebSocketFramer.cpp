@@ -0,0 +1,234 @@
+#include "clientserver/WebSocketFramer.h"
+
+#include <stdexcept>
+#include <cstring>
+#include "clientserver/IMessageCompressor.h"
+
+namespace
+{
+	/** @brief The largest header possible: 2 bytes, 8 bytes of extended length and the 4 byte mask. */
+	const size_t maximumHeaderSize=14;
+
+	bool isControlFrame( clientserver::WebSocketFramer::Opcode opcode )
+	{
+		return (static_cast<uint8_t>(opcode) & 0x8)!=0;
+	}
+
+	bool isValidOpcode( uint8_t opcode )
+	{
+		return opcode<=0x2 || (opcode>=0x8 && opcode<=0xa);
+	}
+} // end of the unnamed namespace
+
+void clientserver::WebSocketFramer::encodeHeader( Opcode opcode, size_t payloadSize, std::string& output, const uint8_t* pMask, bool isCompressed )
+{
+	char header[maximumHeaderSize];
+	size_t headerSize=2;
+	header[0]=static_cast<char>( 0x80 | (isCompressed ? 0x40 : 0) | static_cast<uint8_t>(opcode) ); // Always a single final frame
+	const uint8_t maskBit=(pMask ? 0x80 : 0);
+	if( payloadSize<126 ) header[1]=static_cast<char>( maskBit | payloadSize );
+	else if( payloadSize<=0xffff )
+	{
+		header[1]=static_cast<char>( maskBit | 126 );
+		header[2]=static_cast<char>( (payloadSize>>8) & 0xff );
+		header[3]=static_cast<char>( payloadSize & 0xff );
+		headerSize=4;
+	}
+	else
+	{
+		header[1]=static_cast<char>( maskBit | 127 );
+		for( size_t index=0; index<8; ++index ) header[2+index]=static_cast<char>( (static_cast<uint64_t>(payloadSize)>>(56-8*index)) & 0xff );
+		headerSize=10;
+	}
+	if( pMask )
+	{
+		std::memcpy( header+headerSize, pMask, 4 );
+		headerSize+=4;
+	}
+
+	output.reserve( output.size()+headerSize+payloadSize );
+	output.append( header, headerSize );
+}
+
+void clientserver::WebSocketFramer::encode( Opcode opcode, const char* pData, size_t size, std::string& output, const uint8_t* pMask )
+{
+	encodeHeader( opcode, size, output, pMask );
+	const size_t payloadStart=output.size();
+	output.append( pData, size );
+	if( pMask ) clientserver::applyWebSocketMask( &output[payloadStart], size, pMask );
+}
+
+void clientserver::WebSocketFramer::encode( Opcode opcode, const std::string& payload, std::string& output, const uint8_t* pMask )
+{
+	encode( opcode, payload.data(), payload.size(), output, pMask );
+}
+
+void clientserver::WebSocketFramer::encodeClose( uint16_t statusCode, std::string& output, const uint8_t* pMask )
+{
+	const char payload[2]={ static_cast<char>(statusCode>>8), static_cast<char>(statusCode & 0xff) };
+	encode( Opcode::close, payload, sizeof(payload), output, pMask );
+}
+
+clientserver::WebSocketFramer::WebSocketFramer( Role role, std::string buffer )
+	: role_(role), buffer_(std::move(buffer)), readPosition_(0), writePosition_(0), maximumMessageSize_(64*1024*1024),
+	  pCompressor_(nullptr), inFragmentedMessage_(false), fragmentedOpcode_(Opcode::text), fragmentedIsCompressed_(false)
+{
+	buffer_.resize( buffer_.capacity() );
+}
+
+void clientserver::WebSocketFramer::setMaximumMessageSize( size_t size )
+{
+	maximumMessageSize_=size;
+}
+
+void clientserver::WebSocketFramer::setCompressor( clientserver::IMessageCompressor* pCompressor )
+{
+	pCompressor_=pCompressor;
+}
+
+void clientserver::WebSocketFramer::append( const char* pData, size_t size )
+{
+	std::memcpy( reserve(size), pData, size );
+	commit( size );
+}
+
+char* clientserver::WebSocketFramer::reserve( size_t size )
+{
+	// Same strategy as BinaryFramer, only move unconsumed data down when it saves growing the buffer
+	if( readPosition_==writePosition_ ) readPosition_=writePosition_=0;
+	else if( buffer_.size()-writePosition_<size && readPosition_>0 )
+	{
+		std::memmove( &buffer_[0], &buffer_[readPosition_], writePosition_-readPosition_ );
+		writePosition_-=readPosition_;
+		readPosition_=0;
+	}
+
+	if( buffer_.size()-writePosition_<size ) buffer_.resize( writePosition_+size );
+	return &buffer_[writePosition_];
+}
+
+void clientserver::WebSocketFramer::commit( size_t size )
+{
+	if( writePosition_+size>buffer_.size() ) throw std::logic_error( "WebSocketFramer::commit called with more bytes than were reserved" );
+	writePosition_+=size;
+}
+
+bool clientserver::WebSocketFramer::next( Opcode& opcode, std::string& payload )
+{
+	while( bufferedSize()>=2 )
+	{
+		const unsigned char* pHeader=reinterpret_cast<const unsigned char*>(&buffer_[readPosition_]);
+		const bool isFinal=(pHeader[0] & 0x80)!=0;
+		const bool isCompressed=(pHeader[0] & 0x40)!=0;
+		if( (pHeader[0] & 0x30)!=0 ) throw std::runtime_error( "WebSocketFramer received a frame with reserved bits set" );
+		if( !::isValidOpcode(pHeader[0] & 0x0f) ) throw std::runtime_error( "WebSocketFramer received an invalid opcode ("+std::to_string(pHeader[0] & 0x0f)+")" );
+		const Opcode frameOpcode=static_cast<Opcode>(pHeader[0] & 0x0f);
+		// RSV1 marks a compressed message, so is only allowed on the first frame of one (as RFC 7692 section 6 says for permessage-deflate)
+		if( isCompressed && (!pCompressor_ || ::isControlFrame(frameOpcode) || frameOpcode==Opcode::continuation) ) throw std::runtime_error( "WebSocketFramer received a frame with reserved bits set" );
+		const bool isMasked=(pHeader[1] & 0x80)!=0;
+		if( isMasked!=(role_==Role::server) ) throw std::runtime_error( isMasked ? "WebSocketFramer received a masked frame from the server" : "WebSocketFramer received an unmasked frame from a client" );
+
+		size_t headerSize=2;
+		uint64_t payloadSize=pHeader[1] & 0x7f;
+		if( payloadSize==126 )
+		{
+			headerSize=4;
+			if( bufferedSize()<headerSize ) return false;
+			payloadSize=(uint64_t(pHeader[2])<<8) | pHeader[3];
+		}
+		else if( payloadSize==127 )
+		{
+			headerSize=10;
+			if( bufferedSize()<headerSize ) return false;
+			payloadSize=0;
+			for( size_t index=0; index<8; ++index ) payloadSize=(payloadSize<<8) | pHeader[2+index];
+			if( payloadSize>>63 ) throw std::runtime_error( "WebSocketFramer received a frame with the most significant bit of the length set" );
+		}
+		const unsigned char* pMask=pHeader+headerSize;
+		if( isMasked ) headerSize+=4;
+
+		if( ::isControlFrame(frameOpcode) )
+		{
+			if( !isFinal || payloadSize>125 ) throw std::runtime_error( "WebSocketFramer received a fragmented or oversized control frame" );
+		}
+		else
+		{
+			// Check the size before waiting for the payload to arrive, so that a huge length can't make us buffer forever
+			const uint64_t messageSize=payloadSize+(inFragmentedMessage_ ? fragmentedMessage_.size() : 0);
+			if( payloadSize>maximumMessageSize_ || messageSize>maximumMessageSize_ ) throw std::length_error( "WebSocketFramer received a message of at least "+std::to_string(messageSize)+" bytes, which is larger than the maximum of "+std::to_string(maximumMessageSize_) );
+			if( frameOpcode==Opcode::continuation && !inFragmentedMessage_ ) throw std::runtime_error( "WebSocketFramer received a continuation frame without a message to continue" );
+			if( frameOpcode!=Opcode::continuation && inFragmentedMessage_ ) throw std::runtime_error( "WebSocketFramer received a new message before the previous fragmented one finished" );
+		}
+
+		if( bufferedSize()<headerSize+payloadSize ) return false;
+
+		char* pPayload=&buffer_[readPosition_+headerSize];
+		if( isMasked )
+		{
+			uint8_t mask[4];
+			std::memcpy( mask, pMask, sizeof(mask) );
+			clientserver::applyWebSocketMask( pPayload, payloadSize, mask );
+		}
+		readPosition_+=headerSize+payloadSize;
+
+		if( ::isControlFrame(frameOpcode) || (frameOpcode!=Opcode::continuation && isFinal) )
+		{
+			// The common case of a message in a single frame goes straight from the receive buffer
+			if( isCompressed )
+			{
+				payload.clear();
+				pCompressor_->decompress( pPayload, payloadSize, payload, maximumMessageSize_ );
+				if( frameOpcode==Opcode::text && !clientserver::isValidUtf8( payload.data(), payload.size() ) ) throw std::invalid_argument( "WebSocketFramer received a text message that is not valid UTF-8" );
+				opcode=frameOpcode;
+				return true;
+			}
+			if( frameOpcode==Opcode::text && !clientserver::isValidUtf8( pPayload, payloadSize ) ) throw std::invalid_argument( "WebSocketFramer received a text message that is not valid UTF-8" );
+			// Close frames can have a reason after the status code, which has to be UTF-8 too
+			if( frameOpcode==Opcode::close && payloadSize>2 && !clientserver::isValidUtf8( pPayload+2, payloadSize-2 ) ) throw std::invalid_argument( "WebSocketFramer received a close reason that is not valid UTF-8" );
+			opcode=frameOpcode;
+			payload.assign( pPayload, payloadSize );
+			return true;
+		}
+
+		if( frameOpcode!=Opcode::continuation )
+		{
+			inFragmentedMessage_=true;
+			fragmentedOpcode_=frameOpcode;
+			fragmentedIsCompressed_=isCompressed;
+			fragmentedMessage_.clear();
+		}
+		fragmentedMessage_.append( pPayload, payloadSize );
+		if( isFinal )
+		{
+			if( fragmentedIsCompressed_ )
+			{
+				std::string compressed;
+				compressed.swap( fragmentedMessage_ );
+				pCompressor_->decompress( compressed.data(), compressed.size(), fragmentedMessage_, maximumMessageSize_ );
+			}
+			// Code points can be split across fragments, so only the whole message can be checked
+			if( fragmentedOpcode_==Opcode::text && !clientserver::isValidUtf8( fragmentedMessage_.data(), fragmentedMessage_.size() ) ) throw std::invalid_argument( "WebSocketFramer received a text message that is not valid UTF-8" );
+			inFragmentedMessage_=false;
+			opcode=fragmentedOpcode_;
+			payload.swap( fragmentedMessage_ );
+			fragmentedMessage_.clear();
+			return true;
+		}
+	}
+
+	return false;
+}
+
+size_t clientserver::WebSocketFramer::bufferedSize() const
+{
+	return writePosition_-readPosition_;
+}
+
+std::string clientserver::WebSocketFramer::releaseBuffer()
+{
+	readPosition_=writePosition_=0;
+	std::string buffer;
+	buffer.swap( buffer_ );
+	buffer.clear();
+	return buffer;
+}
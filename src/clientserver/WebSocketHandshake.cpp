@@ -0,0 +1,239 @@
+#include "clientserver/WebSocketHandshake.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cctype>
+#include <random>
+#include <vector>
+#include <utility>
+#include <openssl/sha.h>
+#include <openssl/evp.h>
+
+namespace
+{
+	const char* const headerTerminator="\r\n\r\n";
+
+	std::string toLower( std::string text )
+	{
+		std::transform( text.begin(), text.end(), text.begin(), [](unsigned char character){ return std::tolower(character); } );
+		return text;
+	}
+
+	std::string trim( const std::string& text )
+	{
+		const size_t start=text.find_first_not_of( " \t" );
+		if( start==std::string::npos ) return std::string();
+		return text.substr( start, text.find_last_not_of( " \t" )-start+1 );
+	}
+
+	/** @brief Finds the end of the HTTP header, returning the size including the blank line or zero if it's not all there yet. */
+	size_t headerSize( const char* pData, size_t size )
+	{
+		const char* pEnd=std::search( pData, pData+size, headerTerminator, headerTerminator+4 );
+		if( pEnd==pData+size ) return 0;
+		return pEnd-pData+4;
+	}
+
+	/** @brief Splits the header into the first line, and the header fields with lower case names. */
+	void parseHeader( const std::string& header, std::string& firstLine, std::vector<std::pair<std::string,std::string> >& fields )
+	{
+		size_t lineStart=0;
+		size_t lineEnd=header.find( "\r\n" );
+		firstLine=header.substr( 0, lineEnd );
+		while( lineEnd!=std::string::npos && lineEnd+2<header.size() )
+		{
+			lineStart=lineEnd+2;
+			lineEnd=header.find( "\r\n", lineStart );
+			const std::string line=header.substr( lineStart, lineEnd-lineStart );
+			const size_t colonPosition=line.find( ':' );
+			if( colonPosition==std::string::npos ) continue;
+			fields.emplace_back( ::toLower(::trim(line.substr(0,colonPosition))), ::trim(line.substr(colonPosition+1)) );
+		}
+	}
+
+	std::string findField( const std::vector<std::pair<std::string,std::string> >& fields, const std::string& name )
+	{
+		for( const auto& field : fields )
+		{
+			if( field.first==name ) return field.second;
+		}
+		return std::string();
+	}
+
+	/** @brief For fields that can be split over several lines, e.g. Sec-WebSocket-Extensions, which are then the same as one comma separated list. */
+	std::string joinFields( const std::vector<std::pair<std::string,std::string> >& fields, const std::string& name )
+	{
+		std::string result;
+		for( const auto& field : fields )
+		{
+			if( field.first!=name ) continue;
+			if( !result.empty() ) result+=", ";
+			result+=field.second;
+		}
+		return result;
+	}
+
+	/** @brief Whether a comma separated header value, e.g. "keep-alive, Upgrade", contains the token. Case insensitive. */
+	bool containsToken( const std::string& value, const std::string& token )
+	{
+		size_t start=0;
+		while( start<=value.size() )
+		{
+			size_t end=value.find( ',', start );
+			if( end==std::string::npos ) end=value.size();
+			if( ::toLower(::trim(value.substr(start,end-start)))==token ) return true;
+			start=end+1;
+		}
+		return false;
+	}
+
+	std::vector<std::string> split( const std::string& text, char separator )
+	{
+		std::vector<std::string> result;
+		size_t start=0;
+		while( start<=text.size() )
+		{
+			size_t end=text.find( separator, start );
+			if( end==std::string::npos ) end=text.size();
+			result.push_back( ::trim(text.substr(start,end-start)) );
+			start=end+1;
+		}
+		return result;
+	}
+
+	std::string base64( const unsigned char* pData, size_t size )
+	{
+		std::string result( 4*((size+2)/3), '\0' );
+		EVP_EncodeBlock( reinterpret_cast<unsigned char*>(&result[0]), pData, static_cast<int>(size) );
+		return result;
+	}
+
+	/** @brief The path and query from the first line of a request, e.g. "/?session=" from "GET /?session= HTTP/1.1". */
+	std::string requestTarget( const std::string& firstLine )
+	{
+		const size_t targetEnd=firstLine.find( ' ', 4 );
+		return firstLine.substr( 4, targetEnd==std::string::npos ? std::string::npos : targetEnd-4 );
+	}
+
+	std::string badRequest( const std::string& reason )
+	{
+		return "HTTP/1.1 400 Bad Request\r\nContent-Type: text/plain\r\nContent-Length: "+std::to_string(reason.size())+"\r\nConnection: close\r\n\r\n"+reason;
+	}
+} // end of the unnamed namespace
+
+const size_t clientserver::WebSocketHandshake::maximumRequestSize;
+
+std::string clientserver::WebSocketHandshake::acceptKey( const std::string& clientKey )
+{
+	const std::string input=clientKey+"258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+	unsigned char digest[SHA_DIGEST_LENGTH];
+	SHA1( reinterpret_cast<const unsigned char*>(input.data()), input.size(), digest );
+	return ::base64( digest, sizeof(digest) );
+}
+
+std::vector<clientserver::WebSocketHandshake::Extension> clientserver::WebSocketHandshake::parseExtensions( const std::string& header )
+{
+	std::vector<Extension> extensions;
+	for( const auto& extensionText : ::split( header, ',' ) )
+	{
+		if( extensionText.empty() ) continue;
+		std::vector<std::string> tokens=::split( extensionText, ';' );
+		Extension extension;
+		extension.name=::toLower( tokens.front() );
+		for( size_t index=1; index<tokens.size(); ++index )
+		{
+			const size_t equalsPosition=tokens[index].find( '=' );
+			std::string value;
+			if( equalsPosition!=std::string::npos )
+			{
+				value=::trim( tokens[index].substr(equalsPosition+1) );
+				// Values can be quoted strings
+				if( value.size()>=2 && value.front()=='"' && value.back()=='"' ) value=value.substr( 1, value.size()-2 );
+			}
+			extension.parameters.emplace_back( ::toLower(::trim(tokens[index].substr(0,equalsPosition))), value );
+		}
+		extensions.push_back( std::move(extension) );
+	}
+	return extensions;
+}
+
+clientserver::WebSocketHandshake::Result clientserver::WebSocketHandshake::parseRequest( const char* pData, size_t size, size_t& requestSize, std::string& response,
+		const std::function<std::string(const std::string&)>& negotiateExtensions, std::string* pTarget )
+{
+	requestSize=::headerSize( pData, std::min(size,maximumRequestSize) );
+	if( requestSize==0 )
+	{
+		if( size<maximumRequestSize ) return Result::incomplete;
+		response="HTTP/1.1 431 Request Header Fields Too Large\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+		return Result::invalid;
+	}
+
+	std::string firstLine;
+	std::vector<std::pair<std::string,std::string> > fields;
+	::parseHeader( std::string(pData,requestSize), firstLine, fields );
+
+	if( firstLine.compare( 0, 4, "GET " )!=0 )
+	{
+		response="HTTP/1.1 405 Method Not Allowed\r\nAllow: GET\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+		return Result::invalid;
+	}
+	if( ::toLower(::findField(fields,"upgrade"))!="websocket" || !::containsToken(::findField(fields,"connection"),"upgrade") )
+	{
+		// The caller can serve plain HTTP requests itself, otherwise they're refused
+		if( pTarget ) *pTarget=::requestTarget( firstLine );
+		response=::badRequest( "Only WebSocket connections are accepted\n" );
+		return Result::invalid;
+	}
+	if( ::findField(fields,"sec-websocket-version")!="13" )
+	{
+		response="HTTP/1.1 426 Upgrade Required\r\nSec-WebSocket-Version: 13\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+		return Result::invalid;
+	}
+	const std::string key=::findField( fields, "sec-websocket-key" );
+	if( key.empty() )
+	{
+		response=::badRequest( "Missing Sec-WebSocket-Key\n" );
+		return Result::invalid;
+	}
+
+	response="HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: "+acceptKey(key)+"\r\n";
+	if( negotiateExtensions )
+	{
+		const std::string extensions=negotiateExtensions( ::joinFields(fields,"sec-websocket-extensions") );
+		if( !extensions.empty() ) response+="Sec-WebSocket-Extensions: "+extensions+"\r\n";
+	}
+	response+="\r\n";
+	if( pTarget ) *pTarget=::requestTarget( firstLine );
+	return Result::upgrade;
+}
+
+std::string clientserver::WebSocketHandshake::createRequest( const std::string& host, const std::string& path, std::string& key, const std::string& extensions )
+{
+	std::random_device randomDevice;
+	unsigned char nonce[16];
+	for( auto& byte : nonce ) byte=static_cast<unsigned char>( randomDevice() );
+	key=::base64( nonce, sizeof(nonce) );
+
+	return "GET "+(path.empty() ? std::string("/") : path)+" HTTP/1.1\r\n"
+		"Host: "+host+"\r\n"
+		"Upgrade: websocket\r\n"
+		"Connection: Upgrade\r\n"
+		"Sec-WebSocket-Key: "+key+"\r\n"
+		+(extensions.empty() ? std::string() : "Sec-WebSocket-Extensions: "+extensions+"\r\n")+
+		"Sec-WebSocket-Version: 13\r\n\r\n";
+}
+
+clientserver::WebSocketHandshake::Result clientserver::WebSocketHandshake::parseResponse( const char* pData, size_t size, const std::string& key, size_t& responseSize, std::string* pExtensions )
+{
+	responseSize=::headerSize( pData, std::min(size,maximumRequestSize) );
+	if( responseSize==0 ) return size<maximumRequestSize ? Result::incomplete : Result::invalid;
+
+	std::string firstLine;
+	std::vector<std::pair<std::string,std::string> > fields;
+	::parseHeader( std::string(pData,responseSize), firstLine, fields );
+
+	if( firstLine.compare( 0, 12, "HTTP/1.1 101" )!=0 ) return Result::invalid;
+	if( ::findField(fields,"sec-websocket-accept")!=acceptKey(key) ) return Result::invalid;
+	if( pExtensions ) *pExtensions=::joinFields( fields, "sec-websocket-extensions" );
+	return Result::upgrade;
+}
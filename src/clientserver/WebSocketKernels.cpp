@@ -0,0 +1,424 @@
+#include "clientserver/WebSocketKernels.h"
+
+#include <stdexcept>
+#include <string>
+#include <cstring>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CLIENTSERVER_X86_KERNELS
+#include <immintrin.h>
+// Compiling the functions for a specific target rather than the whole file means no special
+// compiler flags are needed, and nothing outside these functions can accidentally use AVX2.
+#define CLIENTSERVER_TARGET_SSE2 __attribute__((target("sse2")))
+#define CLIENTSERVER_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace
+{
+	typedef void (*MaskFunction)( char* pData, size_t size, const uint8_t mask[4], size_t maskOffset );
+	typedef bool (*Utf8Function)( const char* pData, size_t size );
+
+	//
+	// Generic versions, that work anywhere and deal with the ends that don't fill a whole vector
+	//
+
+	/** @brief The mask as a 32 bit word, rotated so that the first byte lines up with the first byte of the data. */
+	inline uint32_t rotatedMask( const uint8_t mask[4], size_t maskOffset )
+	{
+		const uint8_t rotated[4]={ mask[maskOffset&3], mask[(maskOffset+1)&3], mask[(maskOffset+2)&3], mask[(maskOffset+3)&3] };
+		uint32_t word;
+		std::memcpy( &word, rotated, sizeof(word) );
+		return word;
+	}
+
+	void genericMask( char* pData, size_t size, const uint8_t mask[4], size_t maskOffset )
+	{
+		// memcpy is used for all the loads and stores so that alignment doesn't matter, and compiles
+		// down to plain moves.
+		const uint64_t wideMask=::rotatedMask( mask, maskOffset )*0x0000000100000001ULL;
+
+		size_t index=0;
+		for( ; index+sizeof(uint64_t)<=size; index+=sizeof(uint64_t) )
+		{
+			uint64_t word;
+			std::memcpy( &word, pData+index, sizeof(word) );
+			word^=wideMask;
+			std::memcpy( pData+index, &word, sizeof(word) );
+		}
+		uint8_t repeatedMask[8];
+		std::memcpy( repeatedMask, &wideMask, sizeof(repeatedMask) );
+		for( ; index<size; ++index ) pData[index]^=repeatedMask[index&7];
+	}
+
+	/** @brief Returns the length of the valid UTF-8 sequence at the start of pData, or zero if it's not valid. */
+	inline size_t validSequenceLength( const unsigned char* pData, size_t size )
+	{
+		const unsigned char lead=pData[0];
+		if( lead<0x80 ) return 1;
+		if( lead<0xc2 ) return 0; // A continuation byte, or a two byte overlong encoding
+		if( lead<0xe0 )
+		{
+			return ( size>=2 && (pData[1] & 0xc0)==0x80 ) ? 2 : 0;
+		}
+		if( lead<0xf0 )
+		{
+			// Excluding overlong encodings and UTF-16 surrogates
+			const unsigned char lower=(lead==0xe0 ? 0xa0 : 0x80);
+			const unsigned char upper=(lead==0xed ? 0x9f : 0xbf);
+			return ( size>=3 && pData[1]>=lower && pData[1]<=upper && (pData[2] & 0xc0)==0x80 ) ? 3 : 0;
+		}
+		if( lead<0xf5 )
+		{
+			// Excluding overlong encodings and anything above U+10FFFF
+			const unsigned char lower=(lead==0xf0 ? 0x90 : 0x80);
+			const unsigned char upper=(lead==0xf4 ? 0x8f : 0xbf);
+			return ( size>=4 && pData[1]>=lower && pData[1]<=upper && (pData[2] & 0xc0)==0x80 && (pData[3] & 0xc0)==0x80 ) ? 4 : 0;
+		}
+		return 0;
+	}
+
+	/** @brief Validates from "index" to the end. */
+	bool genericUtf8From( const unsigned char* pData, size_t size, size_t index )
+	{
+		while( index<size )
+		{
+			// Skip over ASCII a word at a time
+			uint64_t word;
+			while( index+sizeof(word)<=size )
+			{
+				std::memcpy( &word, pData+index, sizeof(word) );
+				if( word & 0x8080808080808080ULL ) break;
+				index+=sizeof(word);
+			}
+			if( index>=size ) break;
+
+			const size_t length=::validSequenceLength( pData+index, size-index );
+			if( length==0 ) return false;
+			index+=length;
+		}
+		return true;
+	}
+
+	bool genericUtf8( const char* pData, size_t size )
+	{
+		return ::genericUtf8From( reinterpret_cast<const unsigned char*>(pData), size, 0 );
+	}
+
+#ifdef CLIENTSERVER_X86_KERNELS
+	//
+	// SSE2 versions. SSE2 has no byte shuffle, so UTF-8 validation only skips ASCII 16 bytes at a time.
+	//
+
+	CLIENTSERVER_TARGET_SSE2 void sse2Mask( char* pData, size_t size, const uint8_t mask[4], size_t maskOffset )
+	{
+		const __m128i wideMask=_mm_set1_epi32( static_cast<int>(::rotatedMask(mask,maskOffset)) );
+
+		size_t index=0;
+		for( ; index+sizeof(__m128i)<=size; index+=sizeof(__m128i) )
+		{
+			__m128i* pBlock=reinterpret_cast<__m128i*>(pData+index);
+			_mm_storeu_si128( pBlock, _mm_xor_si128( _mm_loadu_si128(pBlock), wideMask ) );
+		}
+		// index is a multiple of 4, so the mask offset for the rest is unchanged
+		::genericMask( pData+index, size-index, mask, maskOffset );
+	}
+
+	CLIENTSERVER_TARGET_SSE2 bool sse2Utf8( const char* pData, size_t size )
+	{
+		const unsigned char* pBytes=reinterpret_cast<const unsigned char*>(pData);
+		size_t index=0;
+		while( index+sizeof(__m128i)<=size )
+		{
+			const int highBits=_mm_movemask_epi8( _mm_loadu_si128( reinterpret_cast<const __m128i*>(pBytes+index) ) );
+			if( highBits==0 )
+			{
+				index+=sizeof(__m128i);
+				continue;
+			}
+			// Jump straight to the first non ASCII byte, then check sequences until past this block
+			const size_t blockEnd=index+sizeof(__m128i);
+			index+=__builtin_ctz( highBits );
+			while( index<blockEnd )
+			{
+				const size_t length=::validSequenceLength( pBytes+index, size-index );
+				if( length==0 ) return false;
+				index+=length;
+			}
+		}
+		return ::genericUtf8From( pBytes, size, index );
+	}
+
+	//
+	// AVX2 versions. UTF-8 validation uses the lookup algorithm from J. Keiser and D. Lemire,
+	// "Validating UTF-8 in less than one instruction per byte" (2021). Each byte is classified by
+	// looking up the nibbles of it and the byte before it in three tables, with each bit of the
+	// result meaning a different type of error. Checking that the 2nd to 4th bytes of long sequences
+	// are continuations needs the bytes 2 and 3 back as well.
+	//
+
+	CLIENTSERVER_TARGET_AVX2 void avx2Mask( char* pData, size_t size, const uint8_t mask[4], size_t maskOffset )
+	{
+		const __m256i wideMask=_mm256_set1_epi32( static_cast<int>(::rotatedMask(mask,maskOffset)) );
+
+		size_t index=0;
+		// Two vectors at a time to keep both load ports busy
+		for( ; index+2*sizeof(__m256i)<=size; index+=2*sizeof(__m256i) )
+		{
+			__m256i* pBlock=reinterpret_cast<__m256i*>(pData+index);
+			const __m256i first=_mm256_xor_si256( _mm256_loadu_si256(pBlock), wideMask );
+			const __m256i second=_mm256_xor_si256( _mm256_loadu_si256(pBlock+1), wideMask );
+			_mm256_storeu_si256( pBlock, first );
+			_mm256_storeu_si256( pBlock+1, second );
+		}
+		for( ; index+sizeof(__m256i)<=size; index+=sizeof(__m256i) )
+		{
+			__m256i* pBlock=reinterpret_cast<__m256i*>(pData+index);
+			_mm256_storeu_si256( pBlock, _mm256_xor_si256( _mm256_loadu_si256(pBlock), wideMask ) );
+		}
+		::genericMask( pData+index, size-index, mask, maskOffset );
+	}
+
+	// The error bits for the lookup tables
+	const uint8_t tooShort=1<<0;   // 11______ 0_______ or 11______ 11______
+	const uint8_t tooLong=1<<1;    // 0_______ 10______
+	const uint8_t overlong3=1<<2;  // 11100000 100_____
+	const uint8_t tooLarge=1<<3;   // 11110100 1001____ and above
+	const uint8_t surrogate=1<<4;  // 11101101 101_____
+	const uint8_t overlong2=1<<5;  // 1100000_ 10______
+	const uint8_t tooLarge1000=1<<6; // 11110101 1000____ and above
+	const uint8_t overlong4=1<<6;  // 11110000 1000____
+	const uint8_t twoContinuations=1<<7; // 10______ 10______
+	const uint8_t carry=tooShort | tooLong | twoContinuations; // Errors that only depend on the high nibble of the first byte
+
+	/** @brief Each table is repeated for both 128 bit lanes, because the AVX2 shuffle only works within lanes. */
+	alignas(32) const uint8_t byte1HighTable[32]={
+		// 0_______ ASCII
+		tooLong, tooLong, tooLong, tooLong, tooLong, tooLong, tooLong, tooLong,
+		// 10______ continuation
+		twoContinuations, twoContinuations, twoContinuations, twoContinuations,
+		// 1100____ two byte lead, 1101____ two byte lead, 1110____ three byte lead, 1111____ four byte lead
+		tooShort | overlong2, tooShort, tooShort | overlong3 | surrogate, tooShort | tooLarge | tooLarge1000 | overlong4,
+
+		tooLong, tooLong, tooLong, tooLong, tooLong, tooLong, tooLong, tooLong,
+		twoContinuations, twoContinuations, twoContinuations, twoContinuations,
+		tooShort | overlong2, tooShort, tooShort | overlong3 | surrogate, tooShort | tooLarge | tooLarge1000 | overlong4
+	};
+	alignas(32) const uint8_t byte1LowTable[32]={
+		carry | overlong3 | overlong2 | overlong4, // ____0000
+		carry | overlong2, // ____0001
+		carry, carry, // ____001_
+		carry | tooLarge, // ____0100
+		carry | tooLarge | tooLarge1000, carry | tooLarge | tooLarge1000, carry | tooLarge | tooLarge1000, // ____0101 to ____0111
+		carry | tooLarge | tooLarge1000, carry | tooLarge | tooLarge1000, carry | tooLarge | tooLarge1000, carry | tooLarge | tooLarge1000, carry | tooLarge | tooLarge1000, // ____1000 to ____1100
+		carry | tooLarge | tooLarge1000 | surrogate, // ____1101
+		carry | tooLarge | tooLarge1000, carry | tooLarge | tooLarge1000, // ____111_
+
+		carry | overlong3 | overlong2 | overlong4,
+		carry | overlong2,
+		carry, carry,
+		carry | tooLarge,
+		carry | tooLarge | tooLarge1000, carry | tooLarge | tooLarge1000, carry | tooLarge | tooLarge1000,
+		carry | tooLarge | tooLarge1000, carry | tooLarge | tooLarge1000, carry | tooLarge | tooLarge1000, carry | tooLarge | tooLarge1000, carry | tooLarge | tooLarge1000,
+		carry | tooLarge | tooLarge1000 | surrogate,
+		carry | tooLarge | tooLarge1000, carry | tooLarge | tooLarge1000
+	};
+	alignas(32) const uint8_t byte2HighTable[32]={
+		// ________ 0_______ ASCII
+		tooShort, tooShort, tooShort, tooShort, tooShort, tooShort, tooShort, tooShort,
+		// ________ 1000____
+		tooLong | overlong2 | twoContinuations | overlong3 | tooLarge1000 | overlong4,
+		// ________ 1001____
+		tooLong | overlong2 | twoContinuations | overlong3 | tooLarge,
+		// ________ 101_____
+		tooLong | overlong2 | twoContinuations | surrogate | tooLarge, tooLong | overlong2 | twoContinuations | surrogate | tooLarge,
+		// ________ 11______
+		tooShort, tooShort, tooShort, tooShort,
+
+		tooShort, tooShort, tooShort, tooShort, tooShort, tooShort, tooShort, tooShort,
+		tooLong | overlong2 | twoContinuations | overlong3 | tooLarge1000 | overlong4,
+		tooLong | overlong2 | twoContinuations | overlong3 | tooLarge,
+		tooLong | overlong2 | twoContinuations | surrogate | tooLarge, tooLong | overlong2 | twoContinuations | surrogate | tooLarge,
+		tooShort, tooShort, tooShort, tooShort
+	};
+	/** @brief Any of the last three bytes of a block being above these means a sequence carries on into the next block. */
+	alignas(32) const uint8_t incompleteTable[32]={
+		0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+		0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xf0-1, 0xe0-1, 0xc0-1
+	};
+
+	/** @brief Returns input shifted along by N bytes, with the last N bytes of previous shifted in. */
+	template<int N>
+	CLIENTSERVER_TARGET_AVX2 inline __m256i avx2PreviousBytes( __m256i input, __m256i previous )
+	{
+		return _mm256_alignr_epi8( input, _mm256_permute2x128_si256(previous,input,0x21), 16-N );
+	}
+
+	CLIENTSERVER_TARGET_AVX2 inline __m256i avx2Lookup( const uint8_t* pTable, __m256i nibbles )
+	{
+		return _mm256_shuffle_epi8( _mm256_load_si256( reinterpret_cast<const __m256i*>(pTable) ), nibbles );
+	}
+
+	/** @brief Returns non zero bytes where there are errors in input, given the block before. */
+	CLIENTSERVER_TARGET_AVX2 inline __m256i avx2Utf8Errors( __m256i input, __m256i previous )
+	{
+		const __m256i nibbleMask=_mm256_set1_epi8( 0x0f );
+		const __m256i previous1=::avx2PreviousBytes<1>( input, previous );
+		const __m256i specialCases=_mm256_and_si256(
+			_mm256_and_si256( ::avx2Lookup( byte1HighTable, _mm256_and_si256(_mm256_srli_epi16(previous1,4),nibbleMask) ),
+			                  ::avx2Lookup( byte1LowTable, _mm256_and_si256(previous1,nibbleMask) ) ),
+			::avx2Lookup( byte2HighTable, _mm256_and_si256(_mm256_srli_epi16(input,4),nibbleMask) ) );
+
+		// Bytes that are 2 after a three or four byte lead, or 3 after a four byte lead, have to be
+		// continuations. Subtracting with saturation leaves the high bit set only for those.
+		const __m256i isThirdByte=_mm256_subs_epu8( ::avx2PreviousBytes<2>(input,previous), _mm256_set1_epi8(static_cast<char>(0xe0-0x80)) );
+		const __m256i isFourthByte=_mm256_subs_epu8( ::avx2PreviousBytes<3>(input,previous), _mm256_set1_epi8(static_cast<char>(0xf0-0x80)) );
+		const __m256i mustBeContinuation=_mm256_and_si256( _mm256_or_si256(isThirdByte,isFourthByte), _mm256_set1_epi8(static_cast<char>(0x80)) );
+		// The twoContinuations bit is set for every continuation after a continuation, so the two have to match exactly
+		return _mm256_xor_si256( mustBeContinuation, specialCases );
+	}
+
+	/** @brief What has to be carried from one block to the next. */
+	struct Avx2Utf8State
+	{
+		__m256i errors;
+		__m256i previous;
+		__m256i previousIncomplete;
+	};
+
+	CLIENTSERVER_TARGET_AVX2 inline void avx2CheckBlock( Avx2Utf8State& state, __m256i input )
+	{
+		if( _mm256_movemask_epi8(input)==0 )
+		{
+			// All ASCII, so the only possible error is a sequence left unfinished by the previous block
+			state.errors=_mm256_or_si256( state.errors, state.previousIncomplete );
+			state.previousIncomplete=_mm256_setzero_si256();
+		}
+		else
+		{
+			state.errors=_mm256_or_si256( state.errors, ::avx2Utf8Errors( input, state.previous ) );
+			state.previousIncomplete=_mm256_subs_epu8( input, _mm256_load_si256( reinterpret_cast<const __m256i*>(incompleteTable) ) );
+		}
+		state.previous=input;
+	}
+
+	CLIENTSERVER_TARGET_AVX2 bool avx2Utf8( const char* pData, size_t size )
+	{
+		Avx2Utf8State state;
+		state.errors=_mm256_setzero_si256();
+		state.previous=_mm256_setzero_si256();
+		state.previousIncomplete=_mm256_setzero_si256();
+
+		size_t index=0;
+		for( ; index+sizeof(__m256i)<=size; index+=sizeof(__m256i) )
+		{
+			::avx2CheckBlock( state, _mm256_loadu_si256( reinterpret_cast<const __m256i*>(pData+index) ) );
+			// Stop early on long invalid input rather than checking everything
+			if( (index & 1023)==0 && !_mm256_testz_si256(state.errors,state.errors) ) return false;
+		}
+		if( index<size )
+		{
+			// Pad the end with zeros, which are ASCII so can't hide or cause any errors
+			alignas(32) uint8_t lastBlock[32]={ 0 };
+			std::memcpy( lastBlock, pData+index, size-index );
+			::avx2CheckBlock( state, _mm256_load_si256( reinterpret_cast<const __m256i*>(lastBlock) ) );
+		}
+		state.errors=_mm256_or_si256( state.errors, state.previousIncomplete );
+		return _mm256_testz_si256( state.errors, state.errors );
+	}
+#endif // end of "#ifdef CLIENTSERVER_X86_KERNELS"
+
+	bool isSupported( clientserver::InstructionSet instructionSet )
+	{
+		switch( instructionSet )
+		{
+			case clientserver::InstructionSet::generic : return true;
+#ifdef CLIENTSERVER_X86_KERNELS
+			case clientserver::InstructionSet::sse2 :
+				__builtin_cpu_init();
+				return __builtin_cpu_supports( "sse2" );
+			case clientserver::InstructionSet::avx2 :
+				__builtin_cpu_init();
+				return __builtin_cpu_supports( "avx2" );
+#endif
+			default : return false;
+		}
+	}
+
+	void checkSupported( clientserver::InstructionSet instructionSet )
+	{
+		// Cached so that benchmarks of small payloads measure the kernel rather than the CPU detection
+		static const std::vector<clientserver::InstructionSet> supported=clientserver::supportedInstructionSets();
+		if( std::find( supported.begin(), supported.end(), instructionSet )==supported.end() ) throw std::invalid_argument( std::string("The ")+clientserver::instructionSetName(instructionSet)+" instruction set is not supported by this CPU" );
+	}
+
+	MaskFunction maskFunction( clientserver::InstructionSet instructionSet )
+	{
+		switch( instructionSet )
+		{
+#ifdef CLIENTSERVER_X86_KERNELS
+			case clientserver::InstructionSet::sse2 : return &::sse2Mask;
+			case clientserver::InstructionSet::avx2 : return &::avx2Mask;
+#endif
+			default : return &::genericMask;
+		}
+	}
+
+	Utf8Function utf8Function( clientserver::InstructionSet instructionSet )
+	{
+		switch( instructionSet )
+		{
+#ifdef CLIENTSERVER_X86_KERNELS
+			case clientserver::InstructionSet::sse2 : return &::sse2Utf8;
+			case clientserver::InstructionSet::avx2 : return &::avx2Utf8;
+#endif
+			default : return &::genericUtf8;
+		}
+	}
+} // end of the unnamed namespace
+
+std::vector<clientserver::InstructionSet> clientserver::supportedInstructionSets()
+{
+	std::vector<clientserver::InstructionSet> result;
+	for( const auto instructionSet : { InstructionSet::generic, InstructionSet::sse2, InstructionSet::avx2 } )
+	{
+		if( ::isSupported(instructionSet) ) result.push_back( instructionSet );
+	}
+	return result;
+}
+
+const char* clientserver::instructionSetName( InstructionSet instructionSet )
+{
+	switch( instructionSet )
+	{
+		case InstructionSet::generic : return "generic";
+		case InstructionSet::sse2 : return "sse2";
+		case InstructionSet::avx2 : return "avx2";
+	}
+	return "unknown";
+}
+
+void clientserver::applyWebSocketMask( char* pData, size_t size, const uint8_t mask[4], size_t maskOffset )
+{
+	// Picked once, the first time it's called. Static initialisation is thread safe.
+	static const MaskFunction function=::maskFunction( supportedInstructionSets().back() );
+	function( pData, size, mask, maskOffset );
+}
+
+bool clientserver::isValidUtf8( const char* pData, size_t size )
+{
+	static const Utf8Function function=::utf8Function( supportedInstructionSets().back() );
+	return function( pData, size );
+}
+
+void clientserver::applyWebSocketMask( InstructionSet instructionSet, char* pData, size_t size, const uint8_t mask[4], size_t maskOffset )
+{
+	::checkSupported( instructionSet );
+	::maskFunction( instructionSet )( pData, size, mask, maskOffset );
+}
+
+bool clientserver::isValidUtf8( InstructionSet instructionSet, const char* pData, size_t size )
+{
+	::checkSupported( instructionSet );
+	return ::utf8Function( instructionSet )( pData, size );
+}
@@ -0,0 +1,2083 @@
+#include "clientserver/WebSocketServer.h"
+
+#include <iostream>
+#include <system_error>
+#include <stdexcept>
+#include <unordered_map>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <fstream>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#include <openssl/ssl.h>
+#include <openssl/rand.h>
+#include "clientserver/TlsContext.h"
+#include "clientserver/WebSocketFramer.h"
+#include "clientserver/WebSocketHandshake.h"
+#include "clientserver/MessageEnvelope.h"
+#include "clientserver/BatchEnvelope.h"
+#include "clientserver/HandlerPool.h"
+#include "clientserver/CpuTopology.h"
+#include "clientserver/ConnectionRegistry.h"
+#include "clientserver/RateLimiter.h"
+#include "clientserver/AdmissionController.h"
+#include "clientserver/BufferPool.h"
+#include "clientserver/DeflateStreamPool.h"
+#include "clientserver/ZstdDictionary.h"
+#include "clientserver/ChannelScheduler.h"
+
+namespace
+{
+	/** @brief How much to try and read from a socket in one go. Also the size of the pooled receive buffers. */
+	const size_t readSize=64*1024;
+	/** @brief Buffers larger than this aren't returned to the pool. */
+	const size_t maximumPooledCapacity=1024*1024;
+	/** @brief The most buffers each event loop keeps in its pool. */
+	const size_t maximumPooledBuffers=256;
+	/** @brief The most zlib streams of each kind each event loop keeps. A loop only compresses one message at a time, so this is plenty. */
+	const size_t maximumPooledDeflateStreams=4;
+	/** @brief The most events handled for each call to epoll_wait. */
+	const int maximumEvents=256;
+	/** @brief The most connections accepted in one go, so that one loop doesn't take them all when many arrive at once. */
+	const size_t maximumAcceptsPerWake=64;
+	/** @brief Reading from a connection stops while this many of its requests are waiting for the handler pool, so that a client can't queue unlimited work. */
+	const size_t maximumRequestsInFlight=1024;
+	/** @brief How many messages a session receives before acknowledging them, so that the client can stop keeping them. */
+	const uint32_t acknowledgementInterval=16;
+	/** @brief How often sessions that have expired are looked for. */
+	const std::chrono::seconds sessionSweepInterval( 1 );
+
+	/** @brief How a streamed batch that was shed ends, since streams can only end with an error message rather than an x<id>: reply. */
+	std::string overloadedError( std::chrono::milliseconds retryAfter )
+	{
+		return "The server is overloaded, try again in "+std::to_string(retryAfter.count())+"ms";
+	}
+
+	/** @brief Finds "name=value" in the query of a request target, e.g. "/?session=abc&received=3". Values aren't percent decoded. */
+	bool queryParameter( const std::string& target, const std::string& name, std::string& value )
+	{
+		size_t position=target.find( '?' );
+		while( position!=std::string::npos )
+		{
+			++position;
+			const size_t end=target.find( '&', position );
+			const size_t equals=target.find( '=', position );
+			if( target.compare( position, name.size(), name )==0 && equals==position+name.size() && equals<end )
+			{
+				value=target.substr( equals+1, end==std::string::npos ? std::string::npos : end-equals-1 );
+				return true;
+			}
+			position=end;
+		}
+		return false;
+	}
+
+	/** @brief The Content-Type to serve a file with, from its extension. */
+	const char* contentType( const std::string& path )
+	{
+		static const std::pair<const char*,const char*> types[]={
+			{ ".html", "text/html; charset=utf-8" },
+			{ ".js", "application/javascript" },
+			// Browsers only compile WebAssembly while it streams in if it has the right type
+			{ ".wasm", "application/wasm" },
+			{ ".css", "text/css" },
+			{ ".json", "application/json" },
+			{ ".txt", "text/plain; charset=utf-8" },
+			{ ".svg", "image/svg+xml" },
+			{ ".png", "image/png" },
+			{ ".ico", "image/x-icon" } };
+		for( const auto& type : types )
+		{
+			const size_t length=std::strlen( type.first );
+			if( path.size()>length && path.compare( path.size()-length, length, type.first )==0 ) return type.second;
+		}
+		return "application/octet-stream";
+	}
+
+	/** @brief The complete HTTP response for a GET of target, with the file from under root or a 404. */
+	std::string fileResponse( const std::string& root, const std::string& target )
+	{
+		static const std::string notFound="HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+		std::string path=target.substr( 0, target.find_first_of("?#") );
+		// Percent encoding isn't decoded, so it's refused rather than risk it hiding a ".."
+		if( path.empty() || path[0]!='/' || path.find_first_of("%\\")!=std::string::npos ) return notFound;
+		for( size_t position=path.find(".."); position!=std::string::npos; position=path.find("..",position+2) )
+		{
+			if( path[position-1]=='/' && (position+2==path.size() || path[position+2]=='/') ) return notFound;
+		}
+		if( path.back()=='/' ) path+="index.html";
+		path=root+path;
+
+		struct stat fileStatus;
+		if( ::stat( path.c_str(), &fileStatus )!=0 || !S_ISREG(fileStatus.st_mode) ) return notFound;
+		std::ifstream file( path, std::ios::binary );
+		if( !file.is_open() ) return notFound;
+		std::string body( static_cast<size_t>(fileStatus.st_size), '\0' );
+		if( !file.read( &body[0], body.size() ) ) return notFound;
+		return "HTTP/1.1 200 OK\r\nContent-Type: "+std::string(::contentType(path))+"\r\nContent-Length: "+std::to_string(body.size())
+			+"\r\nConnection: close\r\n\r\n"+body;
+	}
+
+	/** @brief The most logical channels each client can open. */
+	const size_t maximumChannels=256;
+
+	/** @brief Parses a whole decimal uint32, without the signs and spaces std::stoul would allow. */
+	bool parseUint32( const std::string& text, uint32_t& value )
+	{
+		if( text.empty() || text.size()>10 || text.find_first_not_of("0123456789")!=std::string::npos ) return false;
+		const unsigned long long result=std::strtoull( text.c_str(), nullptr, 10 );
+		if( result>0xffffffff ) return false;
+		value=static_cast<uint32_t>(result);
+		return true;
+	}
+
+	/** @brief Tags to tell the listening socket and the wakeup eventfd apart from connections in epoll_event::data. */
+	char listenSocketTag;
+	char wakeEventTag;
+
+	enum class IoResult { ok, wouldBlock, closed };
+} // end of the unnamed namespace
+
+/** @brief One edge triggered epoll loop, with its own thread, buffer pool and set of connections.
+ *
+ * @author Mark Grimes
+ * @date 19/Oct/2026
+ */
+class clientserver::WebSocketServer::EventLoop
+{
+public:
+	/** @brief
+	 * @param affinity     Applied to the loop's thread before it does anything else, so that its memory is on the right node.
+	 * @param handlerPool  Where the loop's connections run concurrent requests and batches.
+	 */
+	EventLoop( clientserver::WebSocketServer& server, const clientserver::CpuTopology::Affinity& affinity, clientserver::HandlerPool& handlerPool );
+	~EventLoop();
+	void start();
+	/** @brief Tells the loop to stop and waits for it to finish. All of its connections are closed. */
+	void stop();
+	/** @brief Asks the loop to flush or close a connection. Can be called from any thread. */
+	void schedule( std::shared_ptr<Connection> pConnection );
+	/** @brief Takes the listening socket out of epoll, so that no more connections are accepted. Can be called from any thread. */
+	void stopAccepting();
+	/** @brief Tells all of the loop's connections to close once they have nothing left to do. Can be called from any thread. */
+	void drain();
+	bool isDraining() const { return draining_; }
+	size_t numberOfConnections() const { return numberOfConnections_; }
+
+	clientserver::WebSocketServer& server_;
+	clientserver::HandlerPool& handlerPool_;
+	clientserver::BufferPool bufferPool_;
+	clientserver::DeflateStreamPool deflateStreamPool_;
+	std::string compressBuffer_; ///< Somewhere for connections to compress messages into, so they don't each need a buffer
+protected:
+	void run();
+	void acceptConnections();
+	void closeConnection( Connection& connection );
+	/** @brief Gives every connection the chance to start draining, since idle ones wouldn't otherwise be handled. */
+	void drainConnections();
+
+	const clientserver::CpuTopology::Affinity affinity_;
+	int epollFd_;
+	int wakeEventFd_;
+	std::atomic<bool> stopping_;
+	std::atomic<bool> draining_;
+	bool hasDrainedConnections_; ///< Only touched by the loop's thread
+	std::thread thread_;
+	std::unordered_map<Connection*,std::shared_ptr<Connection> > connections_; ///< Only touched by the loop's thread
+	std::atomic<size_t> numberOfConnections_;
+	std::mutex scheduledMutex_;
+	std::vector<std::shared_ptr<Connection> > scheduled_; ///< Protected by scheduledMutex_
+	bool scheduledWakePending_; ///< Protected by scheduledMutex_
+};
+
+/** @brief Implementation of IConnection for one WebSocket client. Everything apart from the IConnection
+ * methods is only called from the thread of the event loop that owns it.
+ *
+ * @author Mark Grimes
+ * @date 19/Oct/2026
+ */
+class clientserver::WebSocketServer::Connection : public clientserver::IConnection, public std::enable_shared_from_this<Connection>
+{
+public:
+	Connection( EventLoop& eventLoop, int socket, SSL* pSession );
+	virtual ~Connection();
+	virtual bool isConnected() override { return connected_; }
+	virtual void close() override;
+	virtual void sendInfo( const std::string& message ) override;
+	virtual uint64_t connectionId() const override { return connectionId_; }
+
+	int socket() const { return socket_; }
+	/** @brief Does all the reading and writing that is possible without blocking. Returns false if the connection should be closed. */
+	bool handleEvents();
+	/** @brief Called by the loop to release resources once the connection has been taken out of epoll. */
+	void shutdown();
+	/** @brief Sends a message from any thread. If the connection has a session it goes through that, otherwise it's transmitted here.
+	 * @param channel  The logical channel the message is on, or zero for none.
+	 */
+	void send( clientserver::WebSocketFramer::Opcode opcode, clientserver::MessageEnvelope::MessageType type, uint32_t id, const std::string& payload, uint32_t channel=0 );
+	/** @brief Sends a message on this connection only, straight into the output buffer if on the loop's thread or queued if not.
+	 * Messages for an open channel are queued in the scheduler instead.
+	 */
+	void transmit( clientserver::WebSocketFramer::Opcode opcode, clientserver::MessageEnvelope::MessageType type, uint32_t id, const std::string& payload, uint32_t channel=0 );
+	/** @brief Null unless the client asked for a session. Set during the handshake and then never changed. */
+	const std::shared_ptr<ResumableSession>& resumableSession() const { return pResumableSession_; }
+	bool isOnLoopThread() const;
+	/** @brief Bytes that have been sent but not yet written to the socket, from any thread. */
+	size_t unsentBytes() const { return unsentBytes_; }
+	size_t streamBufferSize() const;
+	/** @brief Asks for the streams to be told once the unsent bytes drop below half of streamBufferSize(). */
+	void setWriteBlocked() { writeBlocked_=true; }
+	void addStream( const std::shared_ptr<ResponseStream>& pStream );
+	/** @brief Counts a request that will be replied to from another thread, so that draining waits for it. From any thread. */
+	void startRequest() { ++requestsInFlight_; }
+	/** @brief Called from any thread once the last of the reply to a counted request has been sent. */
+	void finishRequest();
+protected:
+	enum class State { tlsHandshake, httpHandshake, open };
+	/** @brief Queues a message from any thread. These are never compressed, since that has to be done in order on the loop's thread. */
+	void queue( clientserver::WebSocketFramer::Opcode opcode, clientserver::MessageEnvelope::MessageType type, uint32_t id, const std::string& payload );
+	/** @brief Appends a message straight to the output buffer, only from the loop's thread. */
+	void appendMessage( clientserver::WebSocketFramer::Opcode opcode, clientserver::MessageEnvelope::MessageType type, uint32_t id, const std::string& payload );
+	/** @brief Wraps the message for the channel, and queues it in the scheduler if the channel is open on this connection. From any thread. */
+	void transmitOnChannel( clientserver::WebSocketFramer::Opcode opcode, clientserver::MessageEnvelope::MessageType type, uint32_t id, const std::string& payload, uint32_t channel );
+	/** @brief Handles the client opening a channel or giving it more credit. Returns false if the message was invalid. */
+	bool controlChannel( clientserver::MessageEnvelope::MessageType type, uint32_t channel, const std::string& message );
+	/** @brief Puts the next thing to go out into the output buffer, returning false if there's nothing. Only from the loop's thread.
+	 *
+	 * Anything queued from other threads goes first, then the next fragment from the channel scheduler.
+	 */
+	bool appendNextFragment();
+	IoResult tlsHandshake();
+	IoResult readSome( char* pBuffer, size_t size, size_t& bytesRead );
+	/** @brief Reads and handles messages until there's nothing left to read, or the client isn't keeping up with the replies. */
+	IoResult readAndDispatch();
+	/** @brief Whether the client has more replies waiting, or requests queued, than it should before any more of its messages are read. */
+	bool isBackedUp();
+	void processHandshake();
+	/** @brief Gives the connection a session, resuming the one with the token if possible, from the query in the request target. */
+	void startSession( const std::string& target );
+	void dispatchMessages();
+	/** @brief Replies while handling a message on the loop's thread. Only goes through send() if there is a session, since that costs more. */
+	void reply( clientserver::WebSocketFramer::Opcode opcode, clientserver::MessageEnvelope::MessageType type, uint32_t id, const std::string& payload, uint32_t channel );
+	/** @brief Runs a request on the handler pool, sending the response from there when it finishes. */
+	void dispatchConcurrently( clientserver::WebSocketFramer::Opcode opcode, uint32_t id, uint32_t channel, std::string& message,
+			const std::function<std::string(const std::string&,std::weak_ptr<clientserver::IConnection>)>& requestHandler );
+	/** @brief Starts the sub-requests of a batch on the handler pool. If pStream is null the responses are sent together in one message. */
+	void dispatchBatch( clientserver::WebSocketFramer::Opcode opcode, uint32_t id, uint32_t channel, const std::string& batch,
+			const std::function<std::string(const std::string&,std::weak_ptr<clientserver::IConnection>)>& requestHandler, const std::shared_ptr<ResponseStream>& pStream );
+	void startClosing( uint16_t statusCode );
+	/** @brief Sends the go away message if it hasn't been already, then starts closing if nothing is left to send. */
+	void drain();
+	void collectQueuedOutput();
+	IoResult flush();
+	/** @brief Calls the writable handlers of the streams that haven't finished. If the connection is closing they're then forgotten. */
+	void notifyStreams( bool isClosing );
+
+	EventLoop& eventLoop_;
+	int socket_;
+	SSL* pSession_;
+	State state_;
+	std::atomic<bool> connected_;
+	std::atomic<bool> closeRequested_;
+	bool closing_; ///< Nothing more is read, and the connection is closed once the output has been written
+	std::string handshakeBuffer_;
+	clientserver::WebSocketFramer framer_;
+	std::string outputBuffer_; ///< Only touched by the loop's thread
+	size_t outputPosition_;
+	std::mutex queueMutex_;
+	std::string queuedOutput_; ///< Messages sent from other threads, protected by queueMutex_
+	std::unique_ptr<clientserver::IMessageCompressor> pCompressor_; ///< Null unless the client agreed to compression
+	std::atomic<size_t> unsentBytes_; ///< Only changed with queueMutex_ locked, or on the loop's thread for messages that don't go through the queue
+	std::atomic<bool> writeBlocked_;
+	std::mutex streamsMutex_;
+	std::vector<std::weak_ptr<ResponseStream> > streams_; ///< Protected by streamsMutex_
+	std::shared_ptr<ResumableSession> pResumableSession_;
+	std::atomic<bool> hasChannels_; ///< Set once the client opens its first channel, so that connections without any don't need to lock
+	std::mutex channelsMutex_;
+	clientserver::ChannelScheduler channels_; ///< Protected by channelsMutex_
+	std::atomic<size_t> requestsInFlight_;
+	std::atomic<bool> readPaused_; ///< Reading stopped because the connection was backed up, rather than because there was nothing to read
+	bool hasSentGoAway_;
+	std::atomic<uint64_t> connectionId_; ///< Zero until the handshake has finished and the connection is in the registry
+	clientserver::RateLimiter::ConnectionState rateLimitState_; ///< Without an address unless the server has a rate limiter
+};
+
+/** @brief Implementation of IResponseStream for one streaming request on a WebSocketServer::Connection.
+ *
+ * @author Mark Grimes
+ * @date 19/Oct/2026
+ */
+class clientserver::WebSocketServer::ResponseStream : public clientserver::IResponseStream
+{
+public:
+	ResponseStream( const std::shared_ptr<Connection>& pConnection, clientserver::WebSocketFramer::Opcode opcode, uint32_t id, uint32_t channel );
+	virtual ~ResponseStream();
+	virtual bool write( const std::string& chunk ) override;
+	virtual void finish( const std::string& error ) override;
+	virtual bool isOpen() override;
+	virtual void setWritableHandler( std::function<void()> writableHandler ) override;
+	virtual bool waitUntilWritable() override;
+
+	bool isFinished() const { return finished_; }
+	/** @brief Called by the connection on the loop's thread. If the connection is closing the handler is called for the last time. */
+	void notifyWritable( bool isClosing );
+protected:
+	ResponseStream( const ResponseStream& other ) = delete;
+	ResponseStream& operator=( const ResponseStream& other ) = delete;
+
+	std::weak_ptr<Connection> pConnection_;
+	/** @brief If the connection had one, so that what's written still reaches the client after the connection has gone. */
+	const std::shared_ptr<ResumableSession> pResumableSession_;
+	const clientserver::WebSocketFramer::Opcode opcode_;
+	const uint32_t id_;
+	const uint32_t channel_;
+	std::atomic<bool> finished_;
+	std::mutex mutex_; ///< Held while sending so that chunks from different threads can't end up after the end
+	std::condition_variable writableCondition_;
+	std::function<void()> writableHandler_; ///< Protected by mutex_
+	uint64_t notifications_; ///< The number of times notifyWritable() has been called, protected by mutex_
+};
+
+/** @brief Collects the responses to the sub-requests of one batch as they finish on the handler pool.
+ *
+ * @author Mark Grimes
+ * @date 19/Oct/2026
+ */
+class clientserver::WebSocketServer::Batch : public std::enable_shared_from_this<Batch>
+{
+public:
+	Batch( const std::shared_ptr<Connection>& pConnection, clientserver::WebSocketFramer::Opcode opcode, uint32_t id, uint32_t channel, size_t numberOfEntries,
+			const std::shared_ptr<ResponseStream>& pStream, clientserver::HandlerPool& handlerPool );
+	/** @brief Called on a pool thread to run a sub-request, unless the streamed responses are backed up in which case it's held back until they drain. */
+	void run( const std::function<void(Batch&)>& subRequest );
+	/** @brief Called from any thread as each sub-request finishes. With all the responses together, they're sent when the last one does. */
+	void complete( uint32_t subRequestId, const std::string& response );
+	/** @brief Called instead of complete() for a sub-request that wasn't run, in which case the whole batch is replied to as overloaded. */
+	void shed( std::chrono::milliseconds retryAfter );
+	/** @brief Posts the sub-requests that were held back. Called when the stream is writable again, or after a write that didn't block. */
+	void resume();
+protected:
+	Batch( const Batch& other ) = delete;
+	Batch& operator=( const Batch& other ) = delete;
+	/** @brief Sends the responses, or says that the batch was shed, once every sub-request has finished. */
+	void finish();
+
+	std::weak_ptr<Connection> pConnection_;
+	const std::shared_ptr<ResumableSession> pResumableSession_; ///< Same as for ResponseStream
+	const clientserver::WebSocketFramer::Opcode opcode_;
+	const uint32_t id_;
+	const uint32_t channel_;
+	std::shared_ptr<ResponseStream> pStream_; ///< Null unless the responses are streamed
+	std::atomic<size_t> remaining_;
+	std::mutex mutex_;
+	std::string responses_; ///< Protected by mutex_
+	bool isShed_; ///< Protected by mutex_
+	std::chrono::milliseconds retryAfter_; ///< Protected by mutex_
+	clientserver::HandlerPool& handlerPool_;
+	bool isWriteBlocked_; ///< Protected by mutex_
+	std::vector<std::function<void(Batch&)> > heldBack_; ///< Protected by mutex_
+};
+
+/** @brief What the server remembers about a client between connections, so that a dropped client can resume.
+ *
+ * Everything sent for the session goes through here, is counted, and is kept until the client
+ * acknowledges it before going on to whichever connection currently has the session. Handlers and
+ * streams that still hold an old connection therefore carry on over the new one. Messages from the
+ * client are counted as they're dispatched, so that it knows what to send again when it resumes.
+ *
+ * @author Mark Grimes
+ * @date 19/Oct/2026
+ */
+class clientserver::WebSocketServer::ResumableSession
+{
+public:
+	ResumableSession( const std::string& token, size_t replayBufferSize );
+	const std::string& token() const { return token_; }
+	/** @brief Keeps the message to replay and transmits it on the current connection, if there is one. From any thread. */
+	void send( clientserver::WebSocketFramer::Opcode opcode, clientserver::MessageEnvelope::MessageType type, uint32_t id, const std::string& payload, uint32_t channel=0 );
+	/** @brief Makes pConnection the current connection, as long as everything after the first clientReceived messages is still kept.
+	 *
+	 * The session envelope is sent to the new connection, then the messages the client missed. Any previous
+	 * connection is closed. Called on the new connection's loop thread during the handshake.
+	 */
+	bool attach( const std::shared_ptr<Connection>& pConnection, uint32_t clientReceived );
+	/** @brief Called when a connection shuts down. If it was the current one the session expires after lingerTime. */
+	void detach( const Connection* pConnection, std::chrono::milliseconds lingerTime );
+	/** @brief Counts a message from the client. Returns true, with the count so far, if it's time to acknowledge them. */
+	bool countReceived( uint32_t& received );
+	/** @brief The client has received the first clientReceived messages, so they don't need keeping any more. */
+	void acknowledge( uint32_t clientReceived );
+	bool hasExpired( std::chrono::steady_clock::time_point now );
+protected:
+	struct SentMessage
+	{
+		clientserver::WebSocketFramer::Opcode opcode;
+		clientserver::MessageEnvelope::MessageType type;
+		uint32_t id;
+		std::string payload;
+		uint32_t channel;
+	};
+	ResumableSession( const ResumableSession& other ) = delete;
+	ResumableSession& operator=( const ResumableSession& other ) = delete;
+
+	const std::string token_;
+	const size_t replayBufferSize_;
+	std::mutex mutex_;
+	// Everything below is protected by mutex_
+	std::weak_ptr<Connection> pConnection_;
+	bool isAttached_;
+	std::chrono::steady_clock::time_point expiry_; ///< Only meaningful when not attached, and never before the first attach
+	uint32_t sent_;     ///< Messages sent to the client, which wraps around the same as at the client
+	uint32_t received_; ///< Messages received from the client
+	uint32_t receivedSinceAcknowledgement_;
+	std::deque<SentMessage> unacknowledged_; ///< The last unacknowledged_.size() messages sent, up to replayBufferSize_ of them
+};
+
+namespace
+{
+	/** @brief The event loop running on this thread, so that connections know when they don't need to lock or wake anything. */
+	thread_local const void* pCurrentLoop=nullptr;
+} // end of the unnamed namespace
+
+//
+// Connection
+//
+
+clientserver::WebSocketServer::Connection::Connection( EventLoop& eventLoop, int socket, SSL* pSession )
+	: eventLoop_(eventLoop), socket_(socket), pSession_(pSession), state_(pSession ? State::tlsHandshake : State::httpHandshake),
+	  connected_(true), closeRequested_(false), closing_(false),
+	  framer_(clientserver::WebSocketFramer::Role::server, eventLoop.bufferPool_.acquire()),
+	  outputBuffer_(eventLoop.bufferPool_.acquire()), outputPosition_(0), unsentBytes_(0), writeBlocked_(false), hasChannels_(false),
+	  requestsInFlight_(0), readPaused_(false), hasSentGoAway_(false), connectionId_(0),
+	  rateLimitState_( eventLoop.server_.pRateLimiter_ ? clientserver::RateLimiter::ConnectionState(socket) : clientserver::RateLimiter::ConnectionState() )
+{
+	// The output buffer can be reallocated between retries of a write that would have blocked
+	if( pSession_ ) SSL_set_mode( pSession_, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER );
+}
+
+clientserver::WebSocketServer::Connection::~Connection()
+{
+	shutdown();
+}
+
+void clientserver::WebSocketServer::Connection::close()
+{
+	if( !connected_ ) return;
+	closeRequested_=true;
+	eventLoop_.schedule( shared_from_this() );
+}
+
+void clientserver::WebSocketServer::Connection::finishRequest()
+{
+	// The reply has already been queued, so once the loop collects it the connection can close
+	const size_t remaining=--requestsInFlight_;
+	if( remaining==0 && eventLoop_.isDraining() ) eventLoop_.schedule( shared_from_this() );
+	// The edge that would have started reading again has already gone, so the loop has to be told
+	else if( remaining==::maximumRequestsInFlight/2 && readPaused_ ) eventLoop_.schedule( shared_from_this() );
+}
+
+void clientserver::WebSocketServer::Connection::sendInfo( const std::string& message )
+{
+	// From a handler on the loop's thread the message can go straight into the output buffer, which
+	// means it can be compressed. The connection still needs scheduling in case it's not the one
+	// currently being handled.
+	send( clientserver::WebSocketFramer::Opcode::text, clientserver::MessageEnvelope::MessageType::info, 0, message );
+}
+
+void clientserver::WebSocketServer::Connection::send( clientserver::WebSocketFramer::Opcode opcode, clientserver::MessageEnvelope::MessageType type, uint32_t id, const std::string& payload, uint32_t channel )
+{
+	if( pResumableSession_ ) pResumableSession_->send( opcode, type, id, payload, channel );
+	else transmit( opcode, type, id, payload, channel );
+}
+
+void clientserver::WebSocketServer::Connection::transmit( clientserver::WebSocketFramer::Opcode opcode, clientserver::MessageEnvelope::MessageType type, uint32_t id, const std::string& payload, uint32_t channel )
+{
+	if( channel!=0 ) transmitOnChannel( opcode, type, id, payload, channel );
+	else if( isOnLoopThread() )
+	{
+		if( !connected_ || state_!=State::open || closing_ ) return;
+		// Anything queued from other threads has to go first, since it could be earlier chunks of the same stream
+		collectQueuedOutput();
+		appendMessage( opcode, type, id, payload );
+		eventLoop_.schedule( shared_from_this() );
+	}
+	else queue( opcode, type, id, payload );
+}
+
+bool clientserver::WebSocketServer::Connection::isOnLoopThread() const
+{
+	return ::pCurrentLoop==&eventLoop_;
+}
+
+size_t clientserver::WebSocketServer::Connection::streamBufferSize() const
+{
+	return eventLoop_.server_.streamBufferSize_;
+}
+
+void clientserver::WebSocketServer::Connection::addStream( const std::shared_ptr<ResponseStream>& pStream )
+{
+	std::lock_guard<std::mutex> lock( streamsMutex_ );
+	// Streams that finished without ever being blocked would otherwise build up
+	streams_.erase( std::remove_if( streams_.begin(), streams_.end(), []( const std::weak_ptr<ResponseStream>& pOther )
+		{
+			auto pLockedOther=pOther.lock();
+			return !pLockedOther || pLockedOther->isFinished();
+		}), streams_.end() );
+	streams_.push_back( pStream );
+}
+
+void clientserver::WebSocketServer::Connection::notifyStreams( bool isClosing )
+{
+	std::vector<std::shared_ptr<ResponseStream> > streams;
+	{
+		std::lock_guard<std::mutex> lock( streamsMutex_ );
+		for( auto iStream=streams_.begin(); iStream!=streams_.end(); )
+		{
+			auto pStream=iStream->lock();
+			if( pStream && !pStream->isFinished() )
+			{
+				streams.push_back( std::move(pStream) );
+				++iStream;
+			}
+			else iStream=streams_.erase( iStream );
+		}
+		if( isClosing ) streams_.clear();
+	}
+	// The handlers can write more, so they can't be called with the lock held
+	for( auto& pStream : streams ) pStream->notifyWritable( isClosing );
+}
+
+void clientserver::WebSocketServer::Connection::shutdown()
+{
+	if( socket_<0 ) return;
+
+	connected_=false;
+	if( pSession_ ) SSL_free( pSession_ );
+	pSession_=nullptr;
+	::close( socket_ );
+	socket_=-1;
+
+	// Give the buffers back for the next connection. Connections are only ever destroyed or
+	// shut down on the loop's thread, so the pool doesn't need locking.
+	eventLoop_.bufferPool_.release( framer_.releaseBuffer() );
+	eventLoop_.bufferPool_.release( std::move(outputBuffer_) );
+	outputBuffer_.clear();
+	outputPosition_=0;
+	// Same for the zlib streams, if the connection was holding any
+	framer_.setCompressor( nullptr );
+	pCompressor_.reset();
+	unsentBytes_=0;
+
+	// Streaming handlers waiting for room need to know that they can give up
+	notifyStreams( true );
+	// The session is kept, so that anything still sending through this connection goes to the client if it comes back
+	if( pResumableSession_ ) pResumableSession_->detach( this, eventLoop_.server_.sessionLingerTime_ );
+	if( connectionId_!=0 ) eventLoop_.server_.pConnectionRegistry_->remove( connectionId_ );
+}
+
+void clientserver::WebSocketServer::Connection::queue( clientserver::WebSocketFramer::Opcode opcode, clientserver::MessageEnvelope::MessageType type, uint32_t id, const std::string& payload )
+{
+	if( !connected_ ) return;
+
+	bool wasEmpty;
+	{
+		std::lock_guard<std::mutex> lock( queueMutex_ );
+		wasEmpty=queuedOutput_.empty();
+		const size_t previousSize=queuedOutput_.size();
+		const std::string header=clientserver::MessageEnvelope::header( type, id );
+		clientserver::WebSocketFramer::encodeHeader( opcode, header.size()+payload.size(), queuedOutput_ );
+		queuedOutput_+=header;
+		queuedOutput_+=payload;
+		unsentBytes_+=queuedOutput_.size()-previousSize;
+	}
+	// If the queue wasn't empty the connection is already scheduled
+	if( wasEmpty ) eventLoop_.schedule( shared_from_this() );
+}
+
+void clientserver::WebSocketServer::Connection::transmitOnChannel( clientserver::WebSocketFramer::Opcode opcode, clientserver::MessageEnvelope::MessageType type, uint32_t id, const std::string& payload, uint32_t channel )
+{
+	if( !connected_ ) return;
+	std::string message=clientserver::MessageEnvelope::header( type, id );
+	message+=payload;
+	if( hasChannels_ )
+	{
+		bool isQueued=false;
+		{
+			std::lock_guard<std::mutex> lock( channelsMutex_ );
+			if( channels_.isOpen( channel ) )
+			{
+				// Counted so that streams on the channel are held back while it waits for credit
+				unsentBytes_+=message.size();
+				channels_.push( channel, opcode, std::move(message) );
+				isQueued=true;
+			}
+		}
+		if( isQueued ) return eventLoop_.schedule( shared_from_this() );
+	}
+	// Not open on this connection, e.g. a session replaying it after a reconnect, so it goes out whole
+	transmit( opcode, clientserver::MessageEnvelope::MessageType::channelMessage, channel, message );
+}
+
+bool clientserver::WebSocketServer::Connection::controlChannel( clientserver::MessageEnvelope::MessageType type, uint32_t channel, const std::string& message )
+{
+	uint32_t priority=0;
+	uint32_t credit;
+	const size_t colonPosition=message.find( ':' );
+	if( channel==0 ) return false;
+	if( type==clientserver::MessageEnvelope::MessageType::channelOpen )
+	{
+		if( colonPosition==std::string::npos || !::parseUint32( message.substr(0,colonPosition), priority ) ) return false;
+		if( !::parseUint32( message.substr(colonPosition+1), credit ) ) return false;
+	}
+	else if( colonPosition!=std::string::npos || !::parseUint32( message, credit ) ) return false;
+
+	std::lock_guard<std::mutex> lock( channelsMutex_ );
+	if( type==clientserver::MessageEnvelope::MessageType::channelCredit ) return channels_.addCredit( channel, credit );
+	if( !channels_.isOpen( channel ) && channels_.numberOfChannels()>=::maximumChannels ) return false;
+	channels_.open( channel, priority, credit );
+	if( !hasChannels_.exchange(true) )
+	{
+#ifdef TCP_NOTSENT_LOWAT
+		// Keeps what's waiting in the kernel to about one fragment, otherwise a higher priority message
+		// could still end up behind a socket buffer full of a lower priority one
+		const int lowWater=clientserver::ChannelScheduler::defaultFragmentSize;
+		::setsockopt( socket_, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &lowWater, sizeof(lowWater) );
+#endif
+	}
+	return true;
+}
+
+bool clientserver::WebSocketServer::Connection::appendNextFragment()
+{
+	collectQueuedOutput();
+	if( outputPosition_<outputBuffer_.size() ) return true;
+
+	uint32_t channel;
+	clientserver::WebSocketFramer::Opcode opcode;
+	std::string fragment;
+	bool isLast;
+	{
+		std::lock_guard<std::mutex> lock( channelsMutex_ );
+		if( !channels_.next( channel, opcode, fragment, isLast ) ) return false;
+	}
+	appendMessage( opcode, isLast ? clientserver::MessageEnvelope::MessageType::channelMessage : clientserver::MessageEnvelope::MessageType::channelFragment, channel, fragment );
+	return true;
+}
+
+void clientserver::WebSocketServer::Connection::appendMessage( clientserver::WebSocketFramer::Opcode opcode, clientserver::MessageEnvelope::MessageType type, uint32_t id, const std::string& payload )
+{
+	const size_t previousSize=outputBuffer_.size();
+	const std::string header=clientserver::MessageEnvelope::header( type, id );
+	if( pCompressor_ && pCompressor_->shouldCompress( header.size()+payload.size() ) )
+	{
+		std::string& compressed=eventLoop_.compressBuffer_;
+		compressed.clear();
+		pCompressor_->compress( header.data(), header.size(), compressed, false );
+		pCompressor_->compress( payload.data(), payload.size(), compressed, true );
+		clientserver::WebSocketFramer::encodeHeader( opcode, compressed.size(), outputBuffer_, nullptr, true );
+		outputBuffer_+=compressed;
+	}
+	else
+	{
+		clientserver::WebSocketFramer::encodeHeader( opcode, header.size()+payload.size(), outputBuffer_ );
+		outputBuffer_+=header;
+		outputBuffer_+=payload;
+	}
+	unsentBytes_+=outputBuffer_.size()-previousSize;
+}
+
+bool clientserver::WebSocketServer::Connection::handleEvents()
+{
+	if( socket_<0 ) return false;
+
+	if( state_==State::tlsHandshake )
+	{
+		IoResult result=tlsHandshake();
+		if( result==IoResult::closed ) return false;
+		if( result==IoResult::wouldBlock ) return true;
+		state_=State::httpHandshake;
+	}
+
+	IoResult readResult=IoResult::wouldBlock;
+	if( !closing_ ) readResult=readAndDispatch();
+	if( closeRequested_ && !closing_ ) startClosing( 1000 );
+
+	collectQueuedOutput();
+	IoResult writeResult=flush();
+	size_t channelBytes=0;
+	if( hasChannels_ )
+	{
+		// One fragment at a time, so that anything more important that turns up can go in between
+		while( writeResult==IoResult::ok && state_==State::open && !closing_ && appendNextFragment() ) writeResult=flush();
+		std::lock_guard<std::mutex> lock( channelsMutex_ );
+		channelBytes=channels_.queuedBytes();
+	}
+	if( writeResult==IoResult::ok && state_==State::open && !closing_ && eventLoop_.isDraining() )
+	{
+		// After the channels, so that it's known whether they have anything left
+		drain();
+		writeResult=flush();
+	}
+	size_t outputBytes;
+	{
+		// Recounted rather than adjusted, because handshake responses, pongs and close frames aren't counted as they go in
+		std::lock_guard<std::mutex> lock( queueMutex_ );
+		outputBytes=outputBuffer_.size()-outputPosition_+queuedOutput_.size();
+		unsentBytes_=outputBytes+channelBytes;
+	}
+	if( writeResult==IoResult::closed ) return false;
+	// Streams set writeBlocked_ after checking unsentBytes_, so one of the two always sees the other's change
+	if( unsentBytes_<=streamBufferSize()/2 && writeBlocked_.exchange(false) ) notifyStreams( false );
+	if( readResult==IoResult::closed ) return false;
+	// Epoll is edge triggered, so whatever stopped being read won't cause another event. Half way down, the same as
+	// the streams, so that it isn't stopping and starting for every message. Checked after readPaused_ was set, so
+	// that either this or finishRequest() sees the other's change.
+	if( readPaused_ && !closing_ && outputBytes<=streamBufferSize()/2 && requestsInFlight_<=::maximumRequestsInFlight/2 ) eventLoop_.schedule( shared_from_this() );
+	// Once everything has been written a closing connection can go
+	return !closing_ || outputPosition_<outputBuffer_.size();
+}
+
+IoResult clientserver::WebSocketServer::Connection::tlsHandshake()
+{
+	int result=SSL_do_handshake( pSession_ );
+	if( result==1 ) return IoResult::ok;
+
+	const int error=SSL_get_error( pSession_, result );
+	// The loop is edge triggered and waits for both reading and writing, so either way just wait for the next event
+	if( error==SSL_ERROR_WANT_READ || error==SSL_ERROR_WANT_WRITE ) return IoResult::wouldBlock;
+	std::cerr << "TLS handshake failed: " << clientserver::lastTlsError() << std::endl;
+	return IoResult::closed;
+}
+
+IoResult clientserver::WebSocketServer::Connection::readSome( char* pBuffer, size_t size, size_t& bytesRead )
+{
+	if( pSession_ )
+	{
+		int result=SSL_read( pSession_, pBuffer, static_cast<int>(size) );
+		if( result<=0 )
+		{
+			const int error=SSL_get_error( pSession_, result );
+			if( error==SSL_ERROR_WANT_READ || error==SSL_ERROR_WANT_WRITE ) return IoResult::wouldBlock;
+			return IoResult::closed;
+		}
+		bytesRead=result;
+		return IoResult::ok;
+	}
+
+	while( true )
+	{
+		ssize_t result=::recv( socket_, pBuffer, size, 0 );
+		if( result>0 )
+		{
+			bytesRead=result;
+			return IoResult::ok;
+		}
+		if( result==0 ) return IoResult::closed;
+		if( errno==EINTR ) continue;
+		if( errno==EAGAIN || errno==EWOULDBLOCK ) return IoResult::wouldBlock;
+		return IoResult::closed;
+	}
+}
+
+IoResult clientserver::WebSocketServer::Connection::readAndDispatch()
+{
+	// Edge triggered, so have to keep reading until there's nothing left
+	readPaused_=false;
+	// Anything left in the framer from when reading stopped goes first, since there may be nothing new to read
+	if( state_==State::open ) dispatchMessages();
+	while( !closing_ )
+	{
+		// A client that sends requests without reading the replies would otherwise make the output grow without limit
+		if( isBackedUp() )
+		{
+			readPaused_=true;
+			return IoResult::wouldBlock;
+		}
+
+		size_t bytesRead=0;
+		size_t requested;
+		IoResult result;
+		if( state_==State::httpHandshake )
+		{
+			const size_t previousSize=handshakeBuffer_.size();
+			requested=clientserver::WebSocketHandshake::maximumRequestSize;
+			handshakeBuffer_.resize( previousSize+requested );
+			result=readSome( &handshakeBuffer_[previousSize], requested, bytesRead );
+			handshakeBuffer_.resize( previousSize+bytesRead );
+			if( result==IoResult::ok ) processHandshake();
+		}
+		else
+		{
+			requested=::readSize;
+			result=readSome( framer_.reserve(requested), requested, bytesRead );
+			if( result==IoResult::ok )
+			{
+				framer_.commit( bytesRead );
+				dispatchMessages();
+			}
+		}
+		if( result!=IoResult::ok ) return result;
+
+		// A short read from a plain socket means everything has been read. OpenSSL buffers
+		// internally, so for TLS carry on until it says to stop.
+		if( !pSession_ && bytesRead<requested ) return IoResult::wouldBlock;
+	}
+	return IoResult::ok;
+}
+
+bool clientserver::WebSocketServer::Connection::isBackedUp()
+{
+	if( requestsInFlight_>=::maximumRequestsInFlight ) return true;
+	// Not unsentBytes_, because that includes channel messages waiting for credit, which the client can only give if it's read
+	std::lock_guard<std::mutex> lock( queueMutex_ );
+	return outputBuffer_.size()-outputPosition_+queuedOutput_.size()>streamBufferSize();
+}
+
+void clientserver::WebSocketServer::Connection::processHandshake()
+{
+	const clientserver::WebSocketServer& server=eventLoop_.server_;
+	std::function<std::string(const std::string&)> negotiateExtensions;
+	if( server.compressionEnabled_ || !server.compressionDictionaries_.empty() )
+	{
+		negotiateExtensions=[&]( const std::string& offers )->std::string
+			{
+				std::string response;
+				clientserver::PerMessageDeflate::Parameters agreed;
+				// A dictionary trained on this traffic does much better than deflate on small messages, so gets priority
+				if( auto pDictionary=clientserver::ZstdDictionaryCompressor::acceptOffer( offers, server.compressionDictionaries_, response ) )
+				{
+					pCompressor_.reset( new clientserver::ZstdDictionaryCompressor( pDictionary, server.dictionaryThreshold_ ) );
+				}
+				else if( server.compressionEnabled_ && clientserver::PerMessageDeflate::acceptOffer( offers, server.compressionConfiguration_, agreed, response ) )
+				{
+					pCompressor_.reset( new clientserver::PerMessageDeflate( server.compressionConfiguration_, agreed, &eventLoop_.deflateStreamPool_ ) );
+				}
+				else return std::string();
+				framer_.setCompressor( pCompressor_.get() );
+				return response;
+			};
+	}
+
+	size_t requestSize;
+	std::string response;
+	std::string target;
+	switch( clientserver::WebSocketHandshake::parseRequest( handshakeBuffer_.data(), handshakeBuffer_.size(), requestSize, response, negotiateExtensions, &target ) )
+	{
+		case clientserver::WebSocketHandshake::Result::incomplete :
+			return;
+		case clientserver::WebSocketHandshake::Result::invalid :
+			// Plain GET requests are the only invalid ones that set the target
+			if( !target.empty() && !eventLoop_.server_.fileServeRoot_.empty() ) response=::fileResponse( eventLoop_.server_.fileServeRoot_, target );
+			outputBuffer_+=response;
+			closing_=true;
+			return;
+		case clientserver::WebSocketHandshake::Result::upgrade :
+			outputBuffer_+=response;
+			state_=State::open;
+			startSession( target );
+			// Only once the upgrade response is in the output buffer, so that broadcasts can't get in front of it
+			connectionId_=eventLoop_.server_.pConnectionRegistry_->add( shared_from_this() );
+			// The client may not have waited for the response before sending messages
+			framer_.append( handshakeBuffer_.data()+requestSize, handshakeBuffer_.size()-requestSize );
+			std::string().swap( handshakeBuffer_ );
+			dispatchMessages();
+			return;
+	}
+}
+
+void clientserver::WebSocketServer::Connection::startSession( const std::string& target )
+{
+	std::string token;
+	if( !::queryParameter( target, "session", token ) ) return;
+	// An empty token tells the client that sessions are turned off, rather than leaving it waiting
+	if( eventLoop_.server_.sessionReplayBufferSize_==0 ) return transmit( clientserver::WebSocketFramer::Opcode::text, clientserver::MessageEnvelope::MessageType::session, 0, std::string() );
+
+	std::string receivedString;
+	uint32_t clientReceived=0;
+	if( !token.empty() && ::queryParameter( target, "received", receivedString ) )
+	{
+		char* pEnd;
+		const unsigned long long value=std::strtoull( receivedString.c_str(), &pEnd, 10 );
+		// Anything invalid gets a new session, the same as an unknown token
+		if( receivedString.empty() || *pEnd!=0 || receivedString[0]=='-' || value>0xffffffff ) token.clear();
+		else clientReceived=static_cast<uint32_t>(value);
+	}
+	else token.clear();
+	pResumableSession_=eventLoop_.server_.attachSession( token, clientReceived, shared_from_this() );
+}
+
+void clientserver::WebSocketServer::Connection::reply( clientserver::WebSocketFramer::Opcode opcode, clientserver::MessageEnvelope::MessageType type, uint32_t id, const std::string& payload, uint32_t channel )
+{
+	if( pResumableSession_ ) pResumableSession_->send( opcode, type, id, payload, channel );
+	else if( channel!=0 ) transmitOnChannel( opcode, type, id, payload, channel );
+	else appendMessage( opcode, type, id, payload );
+}
+
+void clientserver::WebSocketServer::Connection::dispatchMessages()
+{
+	typedef clientserver::WebSocketFramer::Opcode Opcode;
+	typedef clientserver::MessageEnvelope::MessageType MessageType;
+	const clientserver::WebSocketServer& server=eventLoop_.server_;
+
+	Opcode opcode;
+	std::string message;
+	MessageType type;
+	uint32_t id;
+	uint32_t channel;
+	while( !closing_ )
+	{
+		// Checked for each message, since one read can hold a lot of small requests. Anything left waits in the framer.
+		if( isBackedUp() )
+		{
+			readPaused_=true;
+			return;
+		}
+		try
+		{
+			if( !framer_.next( opcode, message ) ) return;
+		}
+		catch( std::length_error& error )
+		{
+			std::cerr << "Closing WebSocket connection: " << error.what() << std::endl;
+			startClosing( 1009 );
+			return;
+		}
+		catch( std::invalid_argument& error )
+		{
+			std::cerr << "Closing WebSocket connection: " << error.what() << std::endl;
+			startClosing( 1007 );
+			return;
+		}
+		catch( std::exception& error )
+		{
+			std::cerr << "Closing WebSocket connection because of a protocol error: " << error.what() << std::endl;
+			startClosing( 1002 );
+			return;
+		}
+
+		switch( opcode )
+		{
+			case Opcode::text :
+			case Opcode::binary :
+			{
+				// Binary messages go to the binary handlers if there are any, and get replies in the same type of frame
+				const bool isBinary=(opcode==Opcode::binary);
+				const auto& requestHandler=(isBinary && server.binaryRequestHandler_ ? server.binaryRequestHandler_ : server.requestHandler_);
+				const auto& infoHandler=(isBinary && server.binaryInfoHandler_ ? server.binaryInfoHandler_ : server.infoHandler_);
+				channel=0;
+				try
+				{
+					clientserver::MessageEnvelope::decode( message, type, id );
+					if( type==MessageType::channelMessage )
+					{
+						// The message inside has its own envelope, and its replies go back on the same channel
+						channel=id;
+						clientserver::MessageEnvelope::decode( message, type, id );
+						if( type>=MessageType::session ) throw std::runtime_error( "MessageEnvelope received a channel message that can't go on a channel" );
+					}
+					else if( type==MessageType::channelFragment || type==MessageType::goAway || type==MessageType::overloaded ) throw std::runtime_error( "MessageEnvelope received a message type that only servers send" );
+				}
+				catch( std::exception& error )
+				{
+					std::cerr << "Closing WebSocket connection because of an invalid message: " << error.what() << std::endl;
+					startClosing( 1002 );
+					return;
+				}
+				if( type==MessageType::acknowledgement || type==MessageType::session )
+				{
+					// Clients only ever acknowledge, but either way these aren't counted
+					if( pResumableSession_ && type==MessageType::acknowledgement ) pResumableSession_->acknowledge( id );
+					break;
+				}
+				if( type==MessageType::channelOpen || type==MessageType::channelCredit )
+				{
+					// Also not counted, since they only mean anything for this connection
+					if( controlChannel( type, id, message ) ) break;
+					std::cerr << "Closing WebSocket connection because of an invalid channel message" << std::endl;
+					startClosing( 1002 );
+					return;
+				}
+				uint32_t received;
+				if( pResumableSession_ && pResumableSession_->countReceived( received ) )
+				{
+					appendMessage( Opcode::text, MessageType::acknowledgement, received, std::string() );
+				}
+				// Before anything is done with it, so that a client over its limits costs as little as possible
+				if( server.pRateLimiter_ && server.pRateLimiter_->admit( rateLimitState_, message.size() )!=clientserver::RateLimiter::Verdict::allowed )
+				{
+					if( type==MessageType::request || type==MessageType::batchRequest ) reply( opcode, MessageType::response, id, std::string(), channel );
+					else if( type!=MessageType::info ) reply( opcode, MessageType::streamEnd, id, "Rate limit exceeded", channel );
+					break;
+				}
+
+				std::shared_ptr<ResponseStream> pStream;
+				try
+				{
+					if( type==MessageType::request && server.concurrentRequests_ ) dispatchConcurrently( opcode, id, channel, message, requestHandler );
+					else if( type==MessageType::request )
+					{
+						std::string response;
+						if( requestHandler ) response=requestHandler( message, shared_from_this() );
+						reply( opcode, MessageType::response, id, response, channel );
+					}
+					else if( type==MessageType::info )
+					{
+						if( infoHandler ) infoHandler( message, shared_from_this() );
+					}
+					else if( type==MessageType::streamRequest )
+					{
+						pStream=std::make_shared<ResponseStream>( shared_from_this(), opcode, id, channel );
+						addStream( pStream );
+						if( server.streamingRequestHandler_ ) server.streamingRequestHandler_( message, pStream, shared_from_this() );
+						else pStream->finish( "The server has no handler for streaming requests" );
+					}
+					else if( type==MessageType::batchRequest || type==MessageType::streamingBatchRequest )
+					{
+						if( type==MessageType::streamingBatchRequest )
+						{
+							pStream=std::make_shared<ResponseStream>( shared_from_this(), opcode, id, channel );
+							addStream( pStream );
+						}
+						dispatchBatch( opcode, id, channel, message, requestHandler, pStream );
+					}
+				}
+				catch( std::exception& error )
+				{
+					std::cerr << "WebSocketServer handler threw an exception: " << error.what() << std::endl;
+					// Still reply so that the client isn't left waiting forever
+					if( type==MessageType::request || type==MessageType::batchRequest ) reply( opcode, MessageType::response, id, std::string(), channel );
+					else if( pStream ) pStream->finish( *error.what()==0 ? "The request handler failed" : error.what() );
+				}
+				break;
+			}
+			case Opcode::ping :
+				clientserver::WebSocketFramer::encode( Opcode::pong, message, outputBuffer_ );
+				break;
+			case Opcode::close :
+				// Echo the status code back, as RFC 6455 section 5.5.1 asks
+				clientserver::WebSocketFramer::encode( Opcode::close, message.data(), std::min<size_t>(message.size(),2), outputBuffer_ );
+				closing_=true;
+				return;
+			default :
+				break; // Unsolicited pongs can be ignored
+		}
+	}
+}
+
+void clientserver::WebSocketServer::Connection::dispatchConcurrently( clientserver::WebSocketFramer::Opcode opcode, uint32_t id, uint32_t channel, std::string& message,
+		const std::function<std::string(const std::string&,std::weak_ptr<clientserver::IConnection>)>& requestHandler )
+{
+	// The message buffer gets reused for the next one, so it can be taken rather than copied
+	auto pMessage=std::make_shared<std::string>();
+	pMessage->swap( message );
+	std::weak_ptr<Connection> pConnection=shared_from_this();
+	std::shared_ptr<ResumableSession> pResumableSession=pResumableSession_;
+	// The handler and admission controller belong to the server, which stops the pool before they're destroyed
+	const auto* pRequestHandler=&requestHandler;
+	clientserver::AdmissionController* pAdmissionController=eventLoop_.server_.pAdmissionController_.get();
+	const int64_t queuedAt=( pAdmissionController ? clientserver::AdmissionController::now() : 0 );
+	startRequest();
+	eventLoop_.handlerPool_.post( [opcode,id,channel,pMessage,pConnection,pResumableSession,pRequestHandler,pAdmissionController,queuedAt]()
+		{
+			clientserver::MessageEnvelope::MessageType type=clientserver::MessageEnvelope::MessageType::response;
+			std::string response;
+			if( pAdmissionController && !pAdmissionController->start( queuedAt, clientserver::AdmissionController::Priority::normal ) )
+			{
+				type=clientserver::MessageEnvelope::MessageType::overloaded;
+				response=std::to_string( pAdmissionController->retryAfter().count() );
+			}
+			else
+			{
+				try
+				{
+					if( *pRequestHandler ) response=(*pRequestHandler)( *pMessage, pConnection );
+				}
+				catch( std::exception& error )
+				{
+					std::cerr << "WebSocketServer handler threw an exception: " << error.what() << std::endl;
+				}
+			}
+			// The session outlives the connection, so the response still gets to the client if it resumes
+			if( pResumableSession ) pResumableSession->send( opcode, type, id, response, channel );
+			else if( std::shared_ptr<Connection> pLockedConnection=pConnection.lock() ) pLockedConnection->send( opcode, type, id, response, channel );
+			if( std::shared_ptr<Connection> pLockedConnection=pConnection.lock() ) pLockedConnection->finishRequest();
+		});
+}
+
+void clientserver::WebSocketServer::Connection::dispatchBatch( clientserver::WebSocketFramer::Opcode opcode, uint32_t id, uint32_t channel, const std::string& batch,
+		const std::function<std::string(const std::string&,std::weak_ptr<clientserver::IConnection>)>& requestHandler, const std::shared_ptr<ResponseStream>& pStream )
+{
+	auto pEntries=std::make_shared<std::vector<clientserver::BatchEnvelope::Entry> >();
+	clientserver::BatchEnvelope::decode( batch, *pEntries );
+	if( pEntries->empty() )
+	{
+		if( pStream ) pStream->finish( std::string() );
+		else reply( opcode, clientserver::MessageEnvelope::MessageType::response, id, std::string(), channel );
+		return;
+	}
+
+	// Batches are the bulk work, so they're the first to be turned away when the handlers can't keep up
+	clientserver::AdmissionController* pAdmissionController=eventLoop_.server_.pAdmissionController_.get();
+	if( pAdmissionController && !pAdmissionController->admit( clientserver::AdmissionController::Priority::low ) )
+	{
+		if( pStream ) pStream->finish( ::overloadedError( pAdmissionController->retryAfter() ) );
+		else reply( opcode, clientserver::MessageEnvelope::MessageType::overloaded, id, std::to_string( pAdmissionController->retryAfter().count() ), channel );
+		return;
+	}
+
+	auto pBatch=std::make_shared<Batch>( shared_from_this(), opcode, id, channel, pEntries->size(), pStream, eventLoop_.handlerPool_ );
+	// Keeps the batch alive while its sub-requests are held back. The stream drops the handler when it finishes or the
+	// connection closes, which breaks the cycle.
+	if( pStream ) pStream->setWritableHandler( [pBatch](){ pBatch->resume(); } );
+	std::weak_ptr<clientserver::IConnection> pConnection=shared_from_this();
+	// The handler and admission controller belong to the server, which stops the pool before they're destroyed
+	const auto* pRequestHandler=&requestHandler;
+	const int64_t queuedAt=( pAdmissionController ? clientserver::AdmissionController::now() : 0 );
+	for( size_t index=0; index<pEntries->size(); ++index )
+	{
+		// Takes the batch as an argument rather than holding it, since held back sub-requests are kept by the batch
+		std::function<void(Batch&)> subRequest=[pEntries,index,pRequestHandler,pConnection,pAdmissionController,queuedAt]( Batch& batch )
+			{
+				if( pAdmissionController && !pAdmissionController->start( queuedAt, clientserver::AdmissionController::Priority::low ) ) return batch.shed( pAdmissionController->retryAfter() );
+				const clientserver::BatchEnvelope::Entry& entry=(*pEntries)[index];
+				std::string response;
+				try
+				{
+					if( *pRequestHandler ) response=(*pRequestHandler)( entry.payload, pConnection );
+				}
+				catch( std::exception& error )
+				{
+					// Same as for a single request, the sub-request still gets an empty response
+					std::cerr << "WebSocketServer handler threw an exception: " << error.what() << std::endl;
+				}
+				batch.complete( entry.id, response );
+			};
+		eventLoop_.handlerPool_.post( [pBatch,subRequest](){ pBatch->run( subRequest ); } );
+	}
+}
+
+void clientserver::WebSocketServer::Connection::startClosing( uint16_t statusCode )
+{
+	if( state_==State::open ) clientserver::WebSocketFramer::encodeClose( statusCode, outputBuffer_ );
+	closing_=true;
+}
+
+void clientserver::WebSocketServer::Connection::drain()
+{
+	if( !hasSentGoAway_ )
+	{
+		// Not through the session, since a resumed connection would be going away too
+		appendMessage( clientserver::WebSocketFramer::Opcode::text, clientserver::MessageEnvelope::MessageType::goAway, 0, std::string() );
+		hasSentGoAway_=true;
+	}
+	// Checked in this order because replies are queued before the count goes down
+	if( requestsInFlight_>0 ) return;
+	if( hasChannels_ )
+	{
+		std::lock_guard<std::mutex> lock( channelsMutex_ );
+		if( channels_.queuedBytes()>0 ) return;
+	}
+	{
+		std::lock_guard<std::mutex> lock( queueMutex_ );
+		if( !queuedOutput_.empty() ) return;
+	}
+	startClosing( 1001 );
+}
+
+void clientserver::WebSocketServer::Connection::collectQueuedOutput()
+{
+	std::lock_guard<std::mutex> lock( queueMutex_ );
+	if( queuedOutput_.empty() ) return;
+	// Messages from other threads can't go out until the upgrade response has
+	if( state_!=State::open ) return;
+
+	if( outputPosition_==outputBuffer_.size() )
+	{
+		outputBuffer_.swap( queuedOutput_ );
+		queuedOutput_.clear();
+		outputPosition_=0;
+	}
+	else
+	{
+		outputBuffer_.append( queuedOutput_ );
+		queuedOutput_.clear();
+	}
+}
+
+IoResult clientserver::WebSocketServer::Connection::flush()
+{
+	while( outputPosition_<outputBuffer_.size() )
+	{
+		const char* pData=outputBuffer_.data()+outputPosition_;
+		const size_t size=outputBuffer_.size()-outputPosition_;
+		ssize_t bytesWritten;
+		if( pSession_ )
+		{
+			bytesWritten=SSL_write( pSession_, pData, static_cast<int>(std::min<size_t>(size,0x7fffffff)) );
+			if( bytesWritten<=0 )
+			{
+				const int error=SSL_get_error( pSession_, static_cast<int>(bytesWritten) );
+				if( error==SSL_ERROR_WANT_READ || error==SSL_ERROR_WANT_WRITE ) return IoResult::wouldBlock;
+				return IoResult::closed;
+			}
+		}
+		else
+		{
+			bytesWritten=::send( socket_, pData, size, MSG_NOSIGNAL );
+			if( bytesWritten<0 )
+			{
+				if( errno==EINTR ) continue;
+				if( errno==EAGAIN || errno==EWOULDBLOCK ) return IoResult::wouldBlock;
+				return IoResult::closed;
+			}
+		}
+		outputPosition_+=bytesWritten;
+	}
+
+	outputBuffer_.clear();
+	outputPosition_=0;
+	return IoResult::ok;
+}
+
+//
+// ResponseStream
+//
+
+clientserver::WebSocketServer::ResponseStream::ResponseStream( const std::shared_ptr<Connection>& pConnection, clientserver::WebSocketFramer::Opcode opcode, uint32_t id, uint32_t channel )
+	: pConnection_(pConnection), pResumableSession_(pConnection->resumableSession()), opcode_(opcode), id_(id), channel_(channel), finished_(false), notifications_(0)
+{
+	pConnection->startRequest();
+}
+
+clientserver::WebSocketServer::ResponseStream::~ResponseStream()
+{
+	// Don't leave the client waiting for an end that will never come
+	if( !finished_ ) finish( "The server dropped the response stream without finishing it" );
+}
+
+bool clientserver::WebSocketServer::ResponseStream::write( const std::string& chunk )
+{
+	std::shared_ptr<Connection> pConnection=pConnection_.lock();
+	if( !pConnection && !pResumableSession_ ) return false;
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		if( finished_ ) return false;
+		if( !pConnection || !pConnection->isConnected() )
+		{
+			// The session keeps the chunk in case the client comes back, but the handler should still stop for now
+			if( pResumableSession_ ) pResumableSession_->send( opcode_, clientserver::MessageEnvelope::MessageType::streamChunk, id_, chunk, channel_ );
+			return false;
+		}
+		pConnection->send( opcode_, clientserver::MessageEnvelope::MessageType::streamChunk, id_, chunk, channel_ );
+	}
+
+	const size_t highWater=pConnection->streamBufferSize();
+	if( pConnection->unsentBytes()<=highWater ) return true;
+	pConnection->setWriteBlocked();
+	// The loop might have written everything out just before the flag was set, in which case it won't notify
+	return pConnection->unsentBytes()<=highWater;
+}
+
+void clientserver::WebSocketServer::ResponseStream::finish( const std::string& error )
+{
+	std::function<void()> writableHandler;
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		if( finished_ ) return;
+		finished_=true;
+		std::shared_ptr<Connection> pConnection=pConnection_.lock();
+		if( pResumableSession_ ) pResumableSession_->send( opcode_, clientserver::MessageEnvelope::MessageType::streamEnd, id_, error, channel_ );
+		else if( pConnection ) pConnection->send( opcode_, clientserver::MessageEnvelope::MessageType::streamEnd, id_, error, channel_ );
+		if( pConnection ) pConnection->finishRequest();
+		// The handler often holds the stream, so has to be dropped to break the cycle
+		writableHandler.swap( writableHandler_ );
+	}
+	writableCondition_.notify_all();
+}
+
+bool clientserver::WebSocketServer::ResponseStream::isOpen()
+{
+	if( finished_ ) return false;
+	std::shared_ptr<Connection> pConnection=pConnection_.lock();
+	return pConnection && pConnection->isConnected();
+}
+
+void clientserver::WebSocketServer::ResponseStream::setWritableHandler( std::function<void()> writableHandler )
+{
+	std::lock_guard<std::mutex> lock( mutex_ );
+	if( !finished_ ) writableHandler_=writableHandler;
+}
+
+bool clientserver::WebSocketServer::ResponseStream::waitUntilWritable()
+{
+	std::shared_ptr<Connection> pConnection=pConnection_.lock();
+	if( !pConnection ) return false;
+	if( pConnection->isOnLoopThread() ) throw std::logic_error( "IResponseStream::waitUntilWritable can't be called from the connection's event loop" );
+
+	const size_t lowWater=pConnection->streamBufferSize()/2;
+	std::unique_lock<std::mutex> lock( mutex_ );
+	// Other streams on the connection can fill it up again before this thread wakes, so being
+	// notified is enough. Otherwise streams written from the loop would always get in first.
+	const uint64_t startingNotifications=notifications_;
+	while( !finished_ && pConnection->isConnected() && notifications_==startingNotifications )
+	{
+		// Has to be set again each time, since the loop clears it when it notifies
+		pConnection->setWriteBlocked();
+		if( pConnection->unsentBytes()<=lowWater ) break;
+		writableCondition_.wait( lock );
+	}
+	return !finished_ && pConnection->isConnected();
+}
+
+void clientserver::WebSocketServer::ResponseStream::notifyWritable( bool isClosing )
+{
+	std::function<void()> writableHandler;
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		++notifications_;
+		if( isClosing ) writableHandler.swap( writableHandler_ );
+		else writableHandler=writableHandler_;
+	}
+	writableCondition_.notify_all();
+	if( writableHandler ) writableHandler();
+}
+
+//
+// Batch
+//
+
+clientserver::WebSocketServer::Batch::Batch( const std::shared_ptr<Connection>& pConnection, clientserver::WebSocketFramer::Opcode opcode, uint32_t id, uint32_t channel, size_t numberOfEntries,
+		const std::shared_ptr<ResponseStream>& pStream, clientserver::HandlerPool& handlerPool )
+	: pConnection_(pConnection), pResumableSession_(pConnection->resumableSession()), opcode_(opcode), id_(id), channel_(channel), pStream_(pStream), remaining_(numberOfEntries),
+	  isShed_(false), retryAfter_(0), handlerPool_(handlerPool), isWriteBlocked_(false)
+{
+	// A streamed batch is counted by its stream
+	if( !pStream_ ) pConnection->startRequest();
+}
+
+void clientserver::WebSocketServer::Batch::run( const std::function<void(Batch&)>& subRequest )
+{
+	if( pStream_ )
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		if( isWriteBlocked_ )
+		{
+			heldBack_.push_back( subRequest );
+			return;
+		}
+	}
+	subRequest( *this );
+}
+
+void clientserver::WebSocketServer::Batch::complete( uint32_t subRequestId, const std::string& response )
+{
+	if( pStream_ )
+	{
+		std::string chunk;
+		clientserver::BatchEnvelope::encode( subRequestId, response, chunk );
+		// Responses can be any size and the client might not be reading them, so the sub-requests that
+		// haven't started wait for the stream to drain. Marked as blocked before writing so that the
+		// notification can't come in between the write and setting the flag.
+		{
+			std::lock_guard<std::mutex> lock( mutex_ );
+			isWriteBlocked_=true;
+		}
+		// If the client has gone there'll be no notification, so the rest run and the batch still finishes
+		if( pStream_->write( chunk ) || !pStream_->isOpen() ) resume();
+	}
+	else
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		clientserver::BatchEnvelope::encode( subRequestId, response, responses_ );
+	}
+	// Only counted down once the response is in, so whoever gets to zero knows that all of them are
+	if( --remaining_==0 ) finish();
+}
+
+void clientserver::WebSocketServer::Batch::shed( std::chrono::milliseconds retryAfter )
+{
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		isShed_=true;
+		retryAfter_=retryAfter;
+	}
+	if( --remaining_==0 ) finish();
+}
+
+void clientserver::WebSocketServer::Batch::resume()
+{
+	std::vector<std::function<void(Batch&)> > heldBack;
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		isWriteBlocked_=false;
+		heldBack.swap( heldBack_ );
+	}
+	if( heldBack.empty() ) return;
+	std::shared_ptr<Batch> pThis=shared_from_this();
+	for( const auto& subRequest : heldBack ) handlerPool_.post( [pThis,subRequest](){ pThis->run( subRequest ); } );
+}
+
+void clientserver::WebSocketServer::Batch::finish()
+{
+	typedef clientserver::MessageEnvelope::MessageType MessageType;
+	std::string responses;
+	bool isShed;
+	std::chrono::milliseconds retryAfter;
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		responses.swap( responses_ );
+		isShed=isShed_;
+		retryAfter=retryAfter_;
+	}
+	if( pStream_ )
+	{
+		// The responses that did finish have already been streamed, but the client still needs to know to send the rest again
+		pStream_->finish( isShed ? ::overloadedError( retryAfter ) : std::string() );
+		return;
+	}
+
+	// Partly run batches aren't worth replying to, since the client can't tell which responses are missing
+	const MessageType type=( isShed ? MessageType::overloaded : MessageType::response );
+	if( isShed ) responses=std::to_string( retryAfter.count() );
+	std::shared_ptr<Connection> pConnection=pConnection_.lock();
+	if( pResumableSession_ ) pResumableSession_->send( opcode_, type, id_, responses, channel_ );
+	else if( pConnection ) pConnection->send( opcode_, type, id_, responses, channel_ );
+	if( pConnection ) pConnection->finishRequest();
+}
+
+//
+// ResumableSession
+//
+
+clientserver::WebSocketServer::ResumableSession::ResumableSession( const std::string& token, size_t replayBufferSize )
+	: token_(token), replayBufferSize_(replayBufferSize), isAttached_(false), expiry_(std::chrono::steady_clock::time_point::max()),
+	  sent_(0), received_(0), receivedSinceAcknowledgement_(0)
+{
+	// No operation besides the initialiser list
+}
+
+void clientserver::WebSocketServer::ResumableSession::send( clientserver::WebSocketFramer::Opcode opcode, clientserver::MessageEnvelope::MessageType type, uint32_t id, const std::string& payload, uint32_t channel )
+{
+	// Transmitted with the lock held so that the order on the wire is the order they're counted in
+	std::lock_guard<std::mutex> lock( mutex_ );
+	unacknowledged_.push_back( SentMessage{ opcode, type, id, payload, channel } );
+	++sent_;
+	// If the client hasn't received the oldest one by the time it reconnects, it will get a new session
+	if( unacknowledged_.size()>replayBufferSize_ ) unacknowledged_.pop_front();
+	if( std::shared_ptr<Connection> pConnection=pConnection_.lock() ) pConnection->transmit( opcode, type, id, payload, channel );
+}
+
+bool clientserver::WebSocketServer::ResumableSession::attach( const std::shared_ptr<Connection>& pConnection, uint32_t clientReceived )
+{
+	std::lock_guard<std::mutex> lock( mutex_ );
+	if( !isAttached_ && std::chrono::steady_clock::now()>expiry_ ) return false;
+	// Unsigned arithmetic, so that it still works once the counts wrap around
+	const uint32_t missed=sent_-clientReceived;
+	if( missed>unacknowledged_.size() ) return false;
+
+	// The client's transport may not have noticed the old connection dropping yet
+	std::shared_ptr<Connection> pPrevious=pConnection_.lock();
+	if( pPrevious && pPrevious!=pConnection ) pPrevious->close();
+	pConnection_=pConnection;
+	isAttached_=true;
+	unacknowledged_.erase( unacknowledged_.begin(), unacknowledged_.end()-missed );
+	receivedSinceAcknowledgement_=0;
+
+	pConnection->transmit( clientserver::WebSocketFramer::Opcode::text, clientserver::MessageEnvelope::MessageType::session, received_, token_ );
+	for( const auto& message : unacknowledged_ ) pConnection->transmit( message.opcode, message.type, message.id, message.payload, message.channel );
+	return true;
+}
+
+void clientserver::WebSocketServer::ResumableSession::detach( const Connection* pConnection, std::chrono::milliseconds lingerTime )
+{
+	std::lock_guard<std::mutex> lock( mutex_ );
+	std::shared_ptr<Connection> pCurrent=pConnection_.lock();
+	// Once the loop has let go of the connection the weak pointer can't be locked, so null counts as this one
+	if( pCurrent && pCurrent.get()!=pConnection ) return;
+	isAttached_=false;
+	expiry_=std::chrono::steady_clock::now()+lingerTime;
+}
+
+bool clientserver::WebSocketServer::ResumableSession::countReceived( uint32_t& received )
+{
+	std::lock_guard<std::mutex> lock( mutex_ );
+	++received_;
+	if( ++receivedSinceAcknowledgement_<::acknowledgementInterval ) return false;
+	receivedSinceAcknowledgement_=0;
+	received=received_;
+	return true;
+}
+
+void clientserver::WebSocketServer::ResumableSession::acknowledge( uint32_t clientReceived )
+{
+	std::lock_guard<std::mutex> lock( mutex_ );
+	// Anything outside what's kept is an old or invalid acknowledgement, and can be ignored
+	const uint32_t unacknowledged=sent_-clientReceived;
+	if( unacknowledged<unacknowledged_.size() ) unacknowledged_.erase( unacknowledged_.begin(), unacknowledged_.end()-unacknowledged );
+}
+
+bool clientserver::WebSocketServer::ResumableSession::hasExpired( std::chrono::steady_clock::time_point now )
+{
+	std::lock_guard<std::mutex> lock( mutex_ );
+	return !isAttached_ && now>expiry_;
+}
+
+//
+// EventLoop
+//
+
+clientserver::WebSocketServer::EventLoop::EventLoop( clientserver::WebSocketServer& server, const clientserver::CpuTopology::Affinity& affinity, clientserver::HandlerPool& handlerPool )
+	: server_(server), handlerPool_(handlerPool), bufferPool_(::readSize,::maximumPooledCapacity,::maximumPooledBuffers), deflateStreamPool_(::maximumPooledDeflateStreams),
+	  affinity_(affinity), epollFd_(-1), wakeEventFd_(-1), stopping_(false), draining_(false), hasDrainedConnections_(false), numberOfConnections_(0), scheduledWakePending_(false)
+{
+	epollFd_=::epoll_create1( EPOLL_CLOEXEC );
+	if( epollFd_<0 ) throw std::system_error( errno, std::system_category(), "Couldn't create an epoll instance" );
+	wakeEventFd_=::eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+	if( wakeEventFd_<0 )
+	{
+		int savedErrno=errno;
+		::close( epollFd_ );
+		throw std::system_error( savedErrno, std::system_category(), "Couldn't create an eventfd" );
+	}
+
+	epoll_event event;
+	event.events=EPOLLIN;
+	event.data.ptr=&::wakeEventTag;
+	int result=::epoll_ctl( epollFd_, EPOLL_CTL_ADD, wakeEventFd_, &event );
+	if( result==0 )
+	{
+		// Only wake one of the loops for each new connection
+		event.events=EPOLLIN | EPOLLEXCLUSIVE;
+		event.data.ptr=&::listenSocketTag;
+		result=::epoll_ctl( epollFd_, EPOLL_CTL_ADD, server_.listenSocket_, &event );
+	}
+	if( result!=0 )
+	{
+		int savedErrno=errno;
+		::close( wakeEventFd_ );
+		::close( epollFd_ );
+		throw std::system_error( savedErrno, std::system_category(), "Couldn't add to the epoll instance" );
+	}
+}
+
+clientserver::WebSocketServer::EventLoop::~EventLoop()
+{
+	stop();
+	::close( wakeEventFd_ );
+	::close( epollFd_ );
+}
+
+void clientserver::WebSocketServer::EventLoop::start()
+{
+	thread_=std::thread( &EventLoop::run, this );
+}
+
+void clientserver::WebSocketServer::EventLoop::stopAccepting()
+{
+	::epoll_ctl( epollFd_, EPOLL_CTL_DEL, server_.listenSocket_, nullptr );
+}
+
+void clientserver::WebSocketServer::EventLoop::drain()
+{
+	draining_=true;
+	uint64_t value=1;
+	while( ::write( wakeEventFd_, &value, sizeof(value) )<0 && errno==EINTR );
+}
+
+void clientserver::WebSocketServer::EventLoop::stop()
+{
+	if( !thread_.joinable() ) return;
+
+	stopping_=true;
+	uint64_t value=1;
+	while( ::write( wakeEventFd_, &value, sizeof(value) )<0 && errno==EINTR );
+	thread_.join();
+
+	// The thread has finished so it's safe to touch the connections from here
+	for( auto& connectionEntry : connections_ ) connectionEntry.second->shutdown();
+	connections_.clear();
+	numberOfConnections_=0;
+	std::lock_guard<std::mutex> lock( scheduledMutex_ );
+	scheduled_.clear();
+}
+
+void clientserver::WebSocketServer::EventLoop::schedule( std::shared_ptr<Connection> pConnection )
+{
+	std::lock_guard<std::mutex> lock( scheduledMutex_ );
+	scheduled_.push_back( std::move(pConnection) );
+	// If already on the loop's thread, the scheduled list is checked before it next sleeps
+	if( !scheduledWakePending_ && ::pCurrentLoop!=this )
+	{
+		scheduledWakePending_=true;
+		uint64_t value=1;
+		while( ::write( wakeEventFd_, &value, sizeof(value) )<0 && errno==EINTR );
+	}
+}
+
+void clientserver::WebSocketServer::EventLoop::run()
+{
+	::pCurrentLoop=this;
+	if( !clientserver::CpuTopology::apply( affinity_ ) ) std::cerr << "WebSocketServer couldn't move an event loop to its CPU or NUMA node" << std::endl;
+
+	epoll_event events[::maximumEvents];
+	std::vector<std::shared_ptr<Connection> > scheduled;
+	while( !stopping_ )
+	{
+		int numberOfEvents=::epoll_wait( epollFd_, events, ::maximumEvents, -1 );
+		if( numberOfEvents<0 )
+		{
+			if( errno==EINTR ) continue;
+			std::cerr << "WebSocketServer event loop couldn't wait for events: " << std::strerror(errno) << std::endl;
+			break;
+		}
+
+		for( int index=0; index<numberOfEvents; ++index )
+		{
+			void* pTag=events[index].data.ptr;
+			if( pTag==&::listenSocketTag ) acceptConnections();
+			else if( pTag==&::wakeEventTag )
+			{
+				uint64_t value;
+				while( ::read( wakeEventFd_, &value, sizeof(value) )<0 && errno==EINTR );
+				if( draining_ && !hasDrainedConnections_ ) drainConnections();
+			}
+			else
+			{
+				Connection* pConnection=static_cast<Connection*>(pTag);
+				// Might have been closed by an earlier event in this batch
+				if( connections_.count(pConnection)==0 ) continue;
+				if( !pConnection->handleEvents() ) closeConnection( *pConnection );
+			}
+		}
+
+		// Connections with messages from other threads, or from handlers for other connections. Handling
+		// these can schedule more, e.g. when streams are told there's room to write, so keep going until
+		// there are none left.
+		while( true )
+		{
+			{
+				std::lock_guard<std::mutex> lock( scheduledMutex_ );
+				scheduled.swap( scheduled_ );
+				scheduledWakePending_=false;
+			}
+			if( scheduled.empty() ) break;
+			for( auto& pConnection : scheduled )
+			{
+				if( connections_.count(pConnection.get())==0 ) continue;
+				if( !pConnection->handleEvents() ) closeConnection( *pConnection );
+			}
+			scheduled.clear();
+		}
+	}
+
+	::pCurrentLoop=nullptr;
+}
+
+void clientserver::WebSocketServer::EventLoop::drainConnections()
+{
+	hasDrainedConnections_=true;
+	// Copied because closing a connection takes it out of the map
+	std::vector<std::shared_ptr<Connection> > connections;
+	connections.reserve( connections_.size() );
+	for( auto& connectionEntry : connections_ ) connections.push_back( connectionEntry.second );
+	for( auto& pConnection : connections )
+	{
+		if( !pConnection->handleEvents() ) closeConnection( *pConnection );
+	}
+}
+
+void clientserver::WebSocketServer::EventLoop::acceptConnections()
+{
+	for( size_t count=0; count<::maximumAcceptsPerWake; ++count )
+	{
+		int socket=::accept4( server_.listenSocket_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC );
+		if( socket<0 )
+		{
+			if( errno==EINTR || errno==ECONNABORTED ) continue;
+			return; // EAGAIN, or another loop got there first
+		}
+
+		int option=1;
+		::setsockopt( socket, IPPROTO_TCP, TCP_NODELAY, &option, sizeof(option) );
+
+		SSL* pSession=nullptr;
+		try
+		{
+			if( server_.pTlsContext_ ) pSession=server_.pTlsContext_->createSession( socket, true );
+		}
+		catch( std::exception& error )
+		{
+			std::cerr << "WebSocketServer couldn't set up TLS for a connection: " << error.what() << std::endl;
+			::close( socket );
+			continue;
+		}
+
+		auto pConnection=std::make_shared<Connection>( *this, socket, pSession );
+		epoll_event event;
+		event.events=EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+		event.data.ptr=pConnection.get();
+		if( ::epoll_ctl( epollFd_, EPOLL_CTL_ADD, socket, &event )!=0 )
+		{
+			std::cerr << "WebSocketServer couldn't add a connection to epoll: " << std::strerror(errno) << std::endl;
+			continue; // The connection closes the socket when it's destroyed
+		}
+		connections_.emplace( pConnection.get(), pConnection );
+		++numberOfConnections_;
+	}
+}
+
+void clientserver::WebSocketServer::EventLoop::closeConnection( Connection& connection )
+{
+	::epoll_ctl( epollFd_, EPOLL_CTL_DEL, connection.socket(), nullptr );
+	connection.shutdown();
+	connections_.erase( &connection );
+	--numberOfConnections_;
+}
+
+//
+// WebSocketServer
+//
+
+clientserver::WebSocketServer::WebSocketServer()
+	: numberOfThreads_(0), listenSocket_(-1), port_(0), streamBufferSize_(256*1024), numberOfBatchThreads_(0), concurrentRequests_(false), numaPlacement_(false), compressionEnabled_(false), dictionaryThreshold_(clientserver::ZstdDictionaryCompressor::defaultThreshold),
+	  sessionReplayBufferSize_(0), sessionLingerTime_(30000), reusePort_(false), pConnectionRegistry_(std::make_shared<clientserver::ConnectionRegistry>())
+{
+	// No operation besides the initialiser list
+}
+
+clientserver::WebSocketServer::~WebSocketServer()
+{
+	stop();
+}
+
+void clientserver::WebSocketServer::setCertificateChainFile( const std::string& filename )
+{
+	certificateChainFile_=filename;
+}
+
+void clientserver::WebSocketServer::setPrivateKeyFile( const std::string& filename )
+{
+	privateKeyFile_=filename;
+}
+
+void clientserver::WebSocketServer::setNumberOfThreads( size_t numberOfThreads )
+{
+	numberOfThreads_=numberOfThreads;
+}
+
+void clientserver::WebSocketServer::setDefaultRequestHandler( std::function<std::string(const std::string&,std::weak_ptr<clientserver::IConnection>)> requestHandler )
+{
+	requestHandler_=requestHandler;
+}
+
+void clientserver::WebSocketServer::setDefaultInfoHandler( std::function<void(const std::string&,std::weak_ptr<clientserver::IConnection>)> infoHandler )
+{
+	infoHandler_=infoHandler;
+}
+
+void clientserver::WebSocketServer::setDefaultBinaryRequestHandler( std::function<std::string(const std::string&,std::weak_ptr<clientserver::IConnection>)> requestHandler )
+{
+	binaryRequestHandler_=requestHandler;
+}
+
+void clientserver::WebSocketServer::setDefaultBinaryInfoHandler( std::function<void(const std::string&,std::weak_ptr<clientserver::IConnection>)> infoHandler )
+{
+	binaryInfoHandler_=infoHandler;
+}
+
+void clientserver::WebSocketServer::setDefaultStreamingRequestHandler( std::function<void(const std::string&,std::shared_ptr<clientserver::IResponseStream>,std::weak_ptr<clientserver::IConnection>)> streamingRequestHandler )
+{
+	streamingRequestHandler_=streamingRequestHandler;
+}
+
+void clientserver::WebSocketServer::setStreamBufferSize( size_t streamBufferSize )
+{
+	streamBufferSize_=streamBufferSize;
+}
+
+void clientserver::WebSocketServer::setNumberOfBatchThreads( size_t numberOfBatchThreads )
+{
+	numberOfBatchThreads_=numberOfBatchThreads;
+}
+
+void clientserver::WebSocketServer::setConcurrentRequests( bool concurrentRequests )
+{
+	concurrentRequests_=concurrentRequests;
+}
+
+void clientserver::WebSocketServer::setNumaPlacement( bool numaPlacement )
+{
+	numaPlacement_=numaPlacement;
+}
+
+void clientserver::WebSocketServer::setCpuAffinity( const std::vector<int>& eventLoopCpus, const std::vector<int>& handlerCpus )
+{
+	eventLoopCpus_=eventLoopCpus;
+	handlerCpus_=handlerCpus;
+}
+
+void clientserver::WebSocketServer::setCompression( const clientserver::PerMessageDeflate::Configuration& configuration )
+{
+	compressionEnabled_=true;
+	compressionConfiguration_=configuration;
+}
+
+void clientserver::WebSocketServer::setCompressionDictionaries( std::vector<std::shared_ptr<const clientserver::ZstdDictionary> > dictionaries, size_t threshold )
+{
+	compressionDictionaries_=std::move( dictionaries );
+	dictionaryThreshold_=threshold;
+}
+
+void clientserver::WebSocketServer::setSessionResumption( size_t replayBufferSize, std::chrono::milliseconds lingerTime )
+{
+	sessionReplayBufferSize_=replayBufferSize;
+	sessionLingerTime_=lingerTime;
+}
+
+void clientserver::WebSocketServer::setFileServeRoot( const std::string& directory )
+{
+	fileServeRoot_=directory;
+}
+
+void clientserver::WebSocketServer::setReusePort( bool reusePort )
+{
+	reusePort_=reusePort;
+}
+
+void clientserver::WebSocketServer::setConnectionRegistry( std::shared_ptr<clientserver::ConnectionRegistry> pConnectionRegistry )
+{
+	pConnectionRegistry_=std::move( pConnectionRegistry );
+}
+
+const std::shared_ptr<clientserver::ConnectionRegistry>& clientserver::WebSocketServer::connectionRegistry() const
+{
+	return pConnectionRegistry_;
+}
+
+void clientserver::WebSocketServer::setRateLimiter( std::shared_ptr<clientserver::RateLimiter> pRateLimiter )
+{
+	pRateLimiter_=std::move( pRateLimiter );
+}
+
+void clientserver::WebSocketServer::setAdmissionController( std::shared_ptr<clientserver::AdmissionController> pAdmissionController )
+{
+	pAdmissionController_=std::move( pAdmissionController );
+}
+
+void clientserver::WebSocketServer::listen( size_t port )
+{
+	if( listenSocket_>=0 ) throw std::logic_error( "WebSocketServer is already listening" );
+
+	// Only use TLS if a certificate has been set, the same as communique::Server
+	if( !certificateChainFile_.empty() || !privateKeyFile_.empty() ) pTlsContext_=clientserver::TlsContext::createServer( certificateChainFile_, privateKeyFile_ );
+	else pTlsContext_.reset();
+
+	listenSocket_=::socket( AF_INET6, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+	if( listenSocket_<0 ) throw std::system_error( errno, std::system_category(), "Couldn't create a TCP socket" );
+
+	// Accept both IPv4 and IPv6 on the one socket
+	int option=0;
+	::setsockopt( listenSocket_, IPPROTO_IPV6, IPV6_V6ONLY, &option, sizeof(option) );
+	option=1;
+	::setsockopt( listenSocket_, SOL_SOCKET, SO_REUSEADDR, &option, sizeof(option) );
+	if( reusePort_ && ::setsockopt( listenSocket_, SOL_SOCKET, SO_REUSEPORT, &option, sizeof(option) )!=0 )
+	{
+		int savedErrno=errno;
+		::close( listenSocket_ );
+		listenSocket_=-1;
+		throw std::system_error( savedErrno, std::system_category(), "Couldn't set SO_REUSEPORT" );
+	}
+
+	sockaddr_in6 address;
+	std::memset( &address, 0, sizeof(address) );
+	address.sin6_family=AF_INET6;
+	address.sin6_addr=in6addr_any;
+	address.sin6_port=htons( static_cast<uint16_t>(port) );
+	socklen_t addressLength=sizeof(address);
+	if( ::bind( listenSocket_, reinterpret_cast<sockaddr*>(&address), sizeof(address) )!=0
+			|| ::listen( listenSocket_, SOMAXCONN )!=0
+			|| ::getsockname( listenSocket_, reinterpret_cast<sockaddr*>(&address), &addressLength )!=0 )
+	{
+		int savedErrno=errno;
+		::close( listenSocket_ );
+		listenSocket_=-1;
+		throw std::system_error( savedErrno, std::system_category(), "Couldn't listen on port "+std::to_string(port) );
+	}
+	port_=ntohs( address.sin6_port );
+
+	startEventLoops();
+}
+
+void clientserver::WebSocketServer::listenOnSocket( int socket )
+{
+	if( listenSocket_>=0 ) throw std::logic_error( "WebSocketServer is already listening" );
+
+	int isListening=0;
+	socklen_t optionLength=sizeof(isListening);
+	sockaddr_in6 address;
+	socklen_t addressLength=sizeof(address);
+	const int flags=::fcntl( socket, F_GETFL );
+	// The flags belong to the socket rather than the descriptor, so are shared with any other process that has it
+	if( ::getsockopt( socket, SOL_SOCKET, SO_ACCEPTCONN, &isListening, &optionLength )!=0
+			|| ::getsockname( socket, reinterpret_cast<sockaddr*>(&address), &addressLength )!=0
+			|| flags<0 || ::fcntl( socket, F_SETFL, flags | O_NONBLOCK )!=0 )
+	{
+		int savedErrno=errno;
+		::close( socket );
+		throw std::system_error( savedErrno, std::system_category(), "Couldn't use the socket given to listen on" );
+	}
+	if( !isListening || address.sin6_family!=AF_INET6 )
+	{
+		::close( socket );
+		throw std::invalid_argument( "WebSocketServer was given a socket to listen on that isn't a listening IPv6 TCP socket" );
+	}
+
+	if( !certificateChainFile_.empty() || !privateKeyFile_.empty() )
+	{
+		try
+		{
+			pTlsContext_=clientserver::TlsContext::createServer( certificateChainFile_, privateKeyFile_ );
+		}
+		catch( ... )
+		{
+			::close( socket );
+			throw;
+		}
+	}
+	else pTlsContext_.reset();
+
+	listenSocket_=socket;
+	port_=ntohs( address.sin6_port );
+	startEventLoops();
+}
+
+int clientserver::WebSocketServer::listenSocket() const
+{
+	return listenSocket_;
+}
+
+void clientserver::WebSocketServer::stopAccepting()
+{
+	for( auto& pEventLoop : eventLoops_ ) pEventLoop->stopAccepting();
+}
+
+void clientserver::WebSocketServer::drain()
+{
+	stopAccepting();
+	for( auto& pEventLoop : eventLoops_ ) pEventLoop->drain();
+}
+
+void clientserver::WebSocketServer::startEventLoops()
+{
+	size_t numberOfThreads=numberOfThreads_;
+	if( numberOfThreads==0 ) numberOfThreads=std::max( 1u, std::thread::hardware_concurrency() );
+	size_t numberOfBatchThreads=numberOfBatchThreads_;
+	if( numberOfBatchThreads==0 ) numberOfBatchThreads=std::max( 1u, std::thread::hardware_concurrency() );
+	try
+	{
+		clientserver::CpuTopology::Placement placement;
+		if( !eventLoopCpus_.empty() || !handlerCpus_.empty() ) placement=clientserver::CpuTopology::detect().placeOnCpus( numberOfThreads, eventLoopCpus_, numberOfBatchThreads, handlerCpus_ );
+		else if( numaPlacement_ ) placement=clientserver::CpuTopology::detect().placeByNode( numberOfThreads, numberOfBatchThreads );
+		else placement=clientserver::CpuTopology::unplaced( numberOfThreads, numberOfBatchThreads );
+
+		for( size_t index=0; index<placement.handlerPools.size(); ++index )
+		{
+			handlerPools_.emplace_back( new clientserver::HandlerPool( placement.handlerPoolSizes[index], placement.handlerPools[index] ) );
+		}
+		for( size_t index=0; index<numberOfThreads; ++index )
+		{
+			eventLoops_.emplace_back( new EventLoop( *this, placement.eventLoops[index], *handlerPools_[placement.eventLoopPools[index]] ) );
+		}
+	}
+	catch( ... )
+	{
+		eventLoops_.clear();
+		handlerPools_.clear();
+		::close( listenSocket_ );
+		listenSocket_=-1;
+		throw;
+	}
+	for( auto& pEventLoop : eventLoops_ ) pEventLoop->start();
+}
+
+size_t clientserver::WebSocketServer::port() const
+{
+	return port_;
+}
+
+void clientserver::WebSocketServer::stop()
+{
+	if( listenSocket_<0 ) return;
+
+	for( auto& pEventLoop : eventLoops_ ) pEventLoop->stop();
+	// Has to finish after the loops have stopped, since batches can still arrive until then, but before
+	// they're destroyed because handlers that are still running send through their connections.
+	handlerPools_.clear();
+	eventLoops_.clear();
+	::close( listenSocket_ );
+	listenSocket_=-1;
+	std::lock_guard<std::mutex> lock( sessionsMutex_ );
+	sessions_.clear();
+}
+
+std::shared_ptr<clientserver::WebSocketServer::ResumableSession> clientserver::WebSocketServer::attachSession( const std::string& token, uint32_t clientReceived, const std::shared_ptr<Connection>& pConnection )
+{
+	std::shared_ptr<ResumableSession> pSession;
+	{
+		std::lock_guard<std::mutex> lock( sessionsMutex_ );
+		const auto now=std::chrono::steady_clock::now();
+		if( now-lastSessionSweep_>=::sessionSweepInterval )
+		{
+			lastSessionSweep_=now;
+			for( auto iSession=sessions_.begin(); iSession!=sessions_.end(); )
+			{
+				if( iSession->second->hasExpired( now ) ) iSession=sessions_.erase( iSession );
+				else ++iSession;
+			}
+		}
+		if( !token.empty() )
+		{
+			auto iFindResult=sessions_.find( token );
+			if( iFindResult!=sessions_.end() ) pSession=iFindResult->second;
+		}
+	}
+	// Attaching sends the replayed messages, so is done without holding up other connections
+	if( pSession && pSession->attach( pConnection, clientReceived ) ) return pSession;
+
+	unsigned char random[16];
+	if( RAND_bytes( random, sizeof(random) )!=1 ) throw std::runtime_error( "WebSocketServer couldn't create a session token" );
+	static const char hexDigits[]="0123456789abcdef";
+	std::string newToken;
+	for( const auto byte : random )
+	{
+		newToken+=hexDigits[byte>>4];
+		newToken+=hexDigits[byte&0xf];
+	}
+	auto pNewSession=std::make_shared<ResumableSession>( newToken, sessionReplayBufferSize_ );
+	pNewSession->attach( pConnection, 0 );
+
+	std::lock_guard<std::mutex> lock( sessionsMutex_ );
+	// One that couldn't be resumed is no use to anyone
+	if( pSession ) sessions_.erase( pSession->token() );
+	sessions_.emplace( newToken, pNewSession );
+	return pNewSession;
+}
+
+size_t clientserver::WebSocketServer::currentConnections() const
+{
+	size_t total=0;
+	for( const auto& pEventLoop : eventLoops_ ) total+=pEventLoop->numberOfConnections();
+	return total;
+}
@@ -0,0 +1,106 @@
+#include "clientserver/ZstdDictionary.h"
+
+#include <stdexcept>
+#include <fstream>
+#include <sstream>
+#include <zstd.h>
+#include <zdict.h>
+
+clientserver::ZstdDictionary::ZstdDictionary( std::string contents, int level )
+	: contents_(std::move(contents)), level_(level), id_(0), pCompressionDictionary_(nullptr), pDecompressionDictionary_(nullptr)
+{
+	// Raw content dictionaries have an id of zero, which can't be negotiated
+	id_=::ZSTD_getDictID_fromDict( contents_.data(), contents_.size() );
+	if( id_==0 ) throw std::runtime_error( "ZstdDictionary was given something that isn't a zstd dictionary with an id" );
+
+	pCompressionDictionary_=::ZSTD_createCDict( contents_.data(), contents_.size(), level_ );
+	pDecompressionDictionary_=::ZSTD_createDDict( contents_.data(), contents_.size() );
+	if( !pCompressionDictionary_ || !pDecompressionDictionary_ )
+	{
+		::ZSTD_freeCDict( pCompressionDictionary_ );
+		::ZSTD_freeDDict( pDecompressionDictionary_ );
+		throw std::runtime_error( "ZstdDictionary couldn't digest dictionary "+std::to_string(id_) );
+	}
+}
+
+clientserver::ZstdDictionary::~ZstdDictionary()
+{
+	::ZSTD_freeCDict( pCompressionDictionary_ );
+	::ZSTD_freeDDict( pDecompressionDictionary_ );
+}
+
+std::shared_ptr<clientserver::ZstdDictionary> clientserver::ZstdDictionary::load( const std::string& filename, int level )
+{
+	std::ifstream input( filename, std::ios::binary );
+	if( !input.is_open() ) throw std::runtime_error( "Couldn't open the dictionary file \""+filename+"\"" );
+	std::stringstream contents;
+	contents << input.rdbuf();
+	return std::make_shared<ZstdDictionary>( contents.str(), level );
+}
+
+uint32_t clientserver::ZstdDictionary::id() const
+{
+	return id_;
+}
+
+const std::string& clientserver::ZstdDictionary::contents() const
+{
+	return contents_;
+}
+
+int clientserver::ZstdDictionary::level() const
+{
+	return level_;
+}
+
+ZSTD_CDict_s* clientserver::ZstdDictionary::compressionDictionary() const
+{
+	return pCompressionDictionary_;
+}
+
+ZSTD_DDict_s* clientserver::ZstdDictionary::decompressionDictionary() const
+{
+	return pDecompressionDictionary_;
+}
+
+std::string clientserver::ZstdDictionary::train( const std::vector<std::string>& samples, size_t maximumSize )
+{
+	// The trainer wants all of the samples in one buffer
+	std::string sampleBuffer;
+	std::vector<size_t> sampleSizes;
+	sampleSizes.reserve( samples.size() );
+	for( const auto& sample : samples )
+	{
+		sampleBuffer+=sample;
+		sampleSizes.push_back( sample.size() );
+	}
+
+	std::string dictionary( maximumSize, '\0' );
+	const size_t result=::ZDICT_trainFromBuffer( &dictionary[0], dictionary.size(), sampleBuffer.data(), sampleSizes.data(), static_cast<unsigned>(sampleSizes.size()) );
+	if( ::ZDICT_isError( result ) ) throw std::runtime_error( std::string("Couldn't train a zstd dictionary: ")+::ZDICT_getErrorName( result ) );
+	dictionary.resize( result );
+	return dictionary;
+}
+
+void clientserver::ZstdDictionary::writeSample( std::ostream& output, const std::string& sample )
+{
+	const uint32_t size=static_cast<uint32_t>( sample.size() );
+	const char sizeBytes[4]={ static_cast<char>(size>>24), static_cast<char>(size>>16), static_cast<char>(size>>8), static_cast<char>(size) };
+	output.write( sizeBytes, sizeof(sizeBytes) );
+	output.write( sample.data(), sample.size() );
+}
+
+std::vector<std::string> clientserver::ZstdDictionary::readSamples( std::istream& input )
+{
+	std::vector<std::string> samples;
+	unsigned char sizeBytes[4];
+	while( input.read( reinterpret_cast<char*>(sizeBytes), sizeof(sizeBytes) ) )
+	{
+		const uint32_t size=(uint32_t(sizeBytes[0])<<24) | (uint32_t(sizeBytes[1])<<16) | (uint32_t(sizeBytes[2])<<8) | sizeBytes[3];
+		std::string sample( size, '\0' );
+		if( !input.read( &sample[0], size ) ) throw std::runtime_error( "The capture file is truncated after "+std::to_string(samples.size())+" messages" );
+		samples.push_back( std::move(sample) );
+	}
+	if( input.gcount()!=0 ) throw std::runtime_error( "The capture file is truncated after "+std::to_string(samples.size())+" messages" );
+	return samples;
+}
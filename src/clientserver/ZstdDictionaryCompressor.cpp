@@ -0,0 +1,157 @@
+#include "clientserver/ZstdDictionaryCompressor.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <cctype>
+#include <zstd.h>
+#include "clientserver/ZstdDictionary.h"
+#include "clientserver/WebSocketHandshake.h"
+
+namespace
+{
+	struct CompressionContextDeleter { void operator()( ZSTD_CCtx* pContext ) const { ::ZSTD_freeCCtx( pContext ); } };
+	struct DecompressionContextDeleter { void operator()( ZSTD_DCtx* pContext ) const { ::ZSTD_freeDCtx( pContext ); } };
+
+	/** @brief Contexts hold a few hundred KB of working memory, so there's one per thread rather than one per connection. */
+	ZSTD_CCtx* threadCompressionContext()
+	{
+		static thread_local std::unique_ptr<ZSTD_CCtx,CompressionContextDeleter> pContext( ::ZSTD_createCCtx() );
+		if( !pContext ) throw std::runtime_error( "Couldn't create a zstd compression context" );
+		return pContext.get();
+	}
+
+	ZSTD_DCtx* threadDecompressionContext()
+	{
+		static thread_local std::unique_ptr<ZSTD_DCtx,DecompressionContextDeleter> pContext( ::ZSTD_createDCtx() );
+		if( !pContext ) throw std::runtime_error( "Couldn't create a zstd decompression context" );
+		return pContext.get();
+	}
+
+	/** @brief Where the parts of a message are collected when compress() is called with isLastPart false. */
+	std::string& threadPendingInput()
+	{
+		static thread_local std::string pendingInput;
+		return pendingInput;
+	}
+
+	/** @brief The dictionary id from an offer or response entry, or zero if it isn't a valid one. */
+	uint32_t parseDictionaryId( const clientserver::WebSocketHandshake::Extension& extension )
+	{
+		if( extension.name!=clientserver::ZstdDictionaryCompressor::extensionName ) return 0;
+		if( extension.parameters.size()!=1 || extension.parameters.front().first!="dictionary_id" ) return 0;
+		const std::string& value=extension.parameters.front().second;
+		if( value.empty() || value.size()>10 || !std::all_of( value.begin(), value.end(), [](unsigned char character){ return std::isdigit(character); } ) ) return 0;
+		const unsigned long long id=std::stoull( value );
+		return id<=0xffffffffull ? static_cast<uint32_t>(id) : 0;
+	}
+
+	std::shared_ptr<const clientserver::ZstdDictionary> findDictionary( uint32_t id, const std::vector<std::shared_ptr<const clientserver::ZstdDictionary> >& dictionaries )
+	{
+		for( const auto& pDictionary : dictionaries )
+		{
+			if( pDictionary && id!=0 && pDictionary->id()==id ) return pDictionary;
+		}
+		return nullptr;
+	}
+} // end of the unnamed namespace
+
+const char* const clientserver::ZstdDictionaryCompressor::extensionName="x-clientserver-zstd";
+const size_t clientserver::ZstdDictionaryCompressor::defaultThreshold;
+
+std::string clientserver::ZstdDictionaryCompressor::createOffer( const std::vector<std::shared_ptr<const clientserver::ZstdDictionary> >& dictionaries )
+{
+	std::string offer;
+	for( const auto& pDictionary : dictionaries )
+	{
+		if( !offer.empty() ) offer+=", ";
+		offer+=std::string(extensionName)+"; dictionary_id="+std::to_string(pDictionary->id());
+	}
+	return offer;
+}
+
+std::shared_ptr<const clientserver::ZstdDictionary> clientserver::ZstdDictionaryCompressor::acceptOffer( const std::string& offers,
+		const std::vector<std::shared_ptr<const clientserver::ZstdDictionary> >& dictionaries, std::string& response )
+{
+	for( const auto& extension : clientserver::WebSocketHandshake::parseExtensions( offers ) )
+	{
+		auto pDictionary=::findDictionary( ::parseDictionaryId( extension ), dictionaries );
+		if( !pDictionary ) continue;
+		response=std::string(extensionName)+"; dictionary_id="+std::to_string(pDictionary->id());
+		return pDictionary;
+	}
+	return nullptr;
+}
+
+std::shared_ptr<const clientserver::ZstdDictionary> clientserver::ZstdDictionaryCompressor::acceptResponse( const std::string& response,
+		const std::vector<std::shared_ptr<const clientserver::ZstdDictionary> >& dictionaries )
+{
+	const std::vector<clientserver::WebSocketHandshake::Extension> extensions=clientserver::WebSocketHandshake::parseExtensions( response );
+	if( extensions.empty() || extensions.front().name!=extensionName ) return nullptr;
+
+	auto pDictionary=::findDictionary( ::parseDictionaryId( extensions.front() ), dictionaries );
+	if( extensions.size()!=1 || !pDictionary ) throw std::runtime_error( "The server agreed to a zstd dictionary that wasn't offered: \""+response+"\"" );
+	return pDictionary;
+}
+
+clientserver::ZstdDictionaryCompressor::ZstdDictionaryCompressor( std::shared_ptr<const clientserver::ZstdDictionary> pDictionary, size_t threshold )
+	: pDictionary_(std::move(pDictionary)), threshold_(threshold)
+{
+	if( !pDictionary_ ) throw std::invalid_argument( "ZstdDictionaryCompressor needs a dictionary" );
+}
+
+bool clientserver::ZstdDictionaryCompressor::shouldCompress( size_t size ) const
+{
+	return size>=threshold_;
+}
+
+void clientserver::ZstdDictionaryCompressor::compress( const char* pData, size_t size, std::string& output, bool isLastPart )
+{
+	std::string& pendingInput=::threadPendingInput();
+	if( !isLastPart || !pendingInput.empty() )
+	{
+		pendingInput.append( pData, size );
+		if( !isLastPart ) return;
+		pData=pendingInput.data();
+		size=pendingInput.size();
+	}
+
+	ZSTD_CCtx* pContext=::threadCompressionContext();
+	::ZSTD_CCtx_reset( pContext, ZSTD_reset_session_and_parameters );
+	::ZSTD_CCtx_refCDict( pContext, pDictionary_->compressionDictionary() );
+	// Both ends already agreed on the dictionary, and WebSocket has its own integrity checks
+	::ZSTD_CCtx_setParameter( pContext, ZSTD_c_dictIDFlag, 0 );
+	::ZSTD_CCtx_setParameter( pContext, ZSTD_c_checksumFlag, 0 );
+
+	const size_t used=output.size();
+	output.resize( used+::ZSTD_compressBound( size ) );
+	const size_t result=::ZSTD_compress2( pContext, &output[used], output.size()-used, pData, size );
+	pendingInput.clear();
+	if( ::ZSTD_isError( result ) )
+	{
+		output.resize( used );
+		throw std::runtime_error( std::string("zstd failed to compress a WebSocket message: ")+::ZSTD_getErrorName( result ) );
+	}
+	output.resize( used+result );
+}
+
+void clientserver::ZstdDictionaryCompressor::decompress( const char* pData, size_t size, std::string& output, size_t maximumSize )
+{
+	// ZSTD_compress2 always writes the size in the frame header, so the output can be allocated up front
+	const unsigned long long contentSize=::ZSTD_getFrameContentSize( pData, size );
+	if( contentSize==ZSTD_CONTENTSIZE_ERROR || contentSize==ZSTD_CONTENTSIZE_UNKNOWN ) throw std::runtime_error( "Received a WebSocket message that isn't a zstd frame with the size in it" );
+	if( contentSize>maximumSize ) throw std::length_error( "WebSocket message is larger than the maximum of "+std::to_string(maximumSize)+" bytes once decompressed" );
+
+	const size_t start=output.size();
+	output.resize( start+contentSize );
+	const size_t result=::ZSTD_decompress_usingDDict( ::threadDecompressionContext(), &output[start], contentSize, pData, size, pDictionary_->decompressionDictionary() );
+	if( ::ZSTD_isError( result ) || result!=contentSize )
+	{
+		output.resize( start );
+		throw std::runtime_error( std::string("Received a WebSocket message with invalid zstd data: ")+(::ZSTD_isError(result) ? ::ZSTD_getErrorName(result) : "wrong size") );
+	}
+}
+
+const clientserver::ZstdDictionary& clientserver::ZstdDictionaryCompressor::dictionary() const
+{
+	return *pDictionary_;
+}
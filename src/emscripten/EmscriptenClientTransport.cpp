@@ -0,0 +1,154 @@
+#include "clientserver/IClientTransport.h"
+
+#include <stdexcept>
+#include <emscripten/emscripten.h>
+#include <emscripten/websocket.h>
+
+namespace // Unnamed namespace for things only used in this file
+{
+	/** @brief The clientserver::IClientTransport for the Emscripten client, which is the browser's WebSocket.
+	 *
+	 * The browser does the framing, TLS and compression, so only the envelopes are shared with the native
+	 * code. Everything happens on the browser's event loop.
+	 *
+	 * @author Mark Grimes
+	 * @date 19/Oct/2026
+	 */
+	class EmscriptenClientTransport : public clientserver::IClientTransport
+	{
+	public:
+		EmscriptenClientTransport();
+		virtual ~EmscriptenClientTransport();
+
+		virtual void open( const std::string& url, Handlers handlers ) override;
+		virtual void send( bool isBinary, const std::string& message ) override;
+		virtual void close() override;
+		virtual void schedule( std::chrono::milliseconds delay, std::function<void()> function ) override;
+	protected:
+		/** @brief What a timer needs, which is deleted when it goes off. The function isn't called if the transport has gone. */
+		struct Timer
+		{
+			std::weak_ptr<int> pTransportAlive;
+			std::function<void()> function;
+		};
+
+		EmscriptenClientTransport( const EmscriptenClientTransport& other ) = delete;
+		EmscriptenClientTransport& operator=( const EmscriptenClientTransport& other ) = delete;
+		/** @brief Deletes the socket without calling any handlers. */
+		void deleteSocket();
+
+		static EM_BOOL onOpen( int eventType, const EmscriptenWebSocketOpenEvent* pEvent, void* pUserData );
+		static EM_BOOL onMessage( int eventType, const EmscriptenWebSocketMessageEvent* pEvent, void* pUserData );
+		static EM_BOOL onClose( int eventType, const EmscriptenWebSocketCloseEvent* pEvent, void* pUserData );
+		static void onTimer( void* pUserData );
+
+		EMSCRIPTEN_WEBSOCKET_T socket_;
+		bool isOpen_;
+		Handlers handlers_;
+		std::shared_ptr<int> pAlive_;
+	};
+
+	EmscriptenClientTransport::EmscriptenClientTransport()
+		: socket_(0), isOpen_(false), pAlive_(std::make_shared<int>(0))
+	{
+		// No operation besides the initialiser list
+	}
+
+	EmscriptenClientTransport::~EmscriptenClientTransport()
+	{
+		close();
+	}
+
+	void EmscriptenClientTransport::open( const std::string& url, Handlers handlers )
+	{
+		if( url.compare( 0, 5, "ws://" )!=0 && url.compare( 0, 6, "wss://" )!=0 ) throw std::invalid_argument( "Only ws:// and wss:// urls are supported, not \""+url+"\"" );
+		deleteSocket();
+		handlers_=std::move( handlers );
+
+		EmscriptenWebSocketCreateAttributes attributes;
+		emscripten_websocket_init_create_attributes( &attributes );
+		attributes.url=url.c_str();
+		attributes.protocols=nullptr;
+		socket_=emscripten_websocket_new( &attributes );
+		if( socket_<=0 )
+		{
+			// Handlers are never called from inside open(), so report it later the same as any other failure
+			socket_=0;
+			schedule( std::chrono::milliseconds(0), [this](){ if( handlers_.close ) handlers_.close( "The browser couldn't create the WebSocket" ); } );
+			return;
+		}
+		emscripten_websocket_set_onopen_callback( socket_, this, &EmscriptenClientTransport::onOpen );
+		emscripten_websocket_set_onmessage_callback( socket_, this, &EmscriptenClientTransport::onMessage );
+		// Browsers always follow an error with a close event, so that's all that needs handling
+		emscripten_websocket_set_onclose_callback( socket_, this, &EmscriptenClientTransport::onClose );
+	}
+
+	void EmscriptenClientTransport::send( bool isBinary, const std::string& message )
+	{
+		if( !isOpen_ ) return;
+		if( isBinary ) emscripten_websocket_send_binary( socket_, const_cast<char*>(message.data()), message.size() );
+		else emscripten_websocket_send_utf8_text( socket_, message.c_str() );
+	}
+
+	void EmscriptenClientTransport::close()
+	{
+		if( socket_>0 ) emscripten_websocket_close( socket_, 1000, "" );
+		deleteSocket();
+		handlers_=Handlers();
+	}
+
+	void EmscriptenClientTransport::schedule( std::chrono::milliseconds delay, std::function<void()> function )
+	{
+		Timer* pTimer=new Timer{ pAlive_, std::move(function) };
+		emscripten_async_call( &EmscriptenClientTransport::onTimer, pTimer, static_cast<int>(delay.count()) );
+	}
+
+	void EmscriptenClientTransport::deleteSocket()
+	{
+		if( socket_<=0 ) return;
+		emscripten_websocket_delete( socket_ );
+		socket_=0;
+		isOpen_=false;
+	}
+
+	EM_BOOL EmscriptenClientTransport::onOpen( int eventType, const EmscriptenWebSocketOpenEvent* pEvent, void* pUserData )
+	{
+		EmscriptenClientTransport* pTransport=static_cast<EmscriptenClientTransport*>( pUserData );
+		if( pEvent->socket!=pTransport->socket_ ) return EM_TRUE;
+		pTransport->isOpen_=true;
+		if( pTransport->handlers_.open ) pTransport->handlers_.open();
+		return EM_TRUE;
+	}
+
+	EM_BOOL EmscriptenClientTransport::onMessage( int eventType, const EmscriptenWebSocketMessageEvent* pEvent, void* pUserData )
+	{
+		EmscriptenClientTransport* pTransport=static_cast<EmscriptenClientTransport*>( pUserData );
+		if( pEvent->socket!=pTransport->socket_ || !pTransport->handlers_.message ) return EM_TRUE;
+		// Text messages are given with a null terminator on the end
+		const size_t size=( pEvent->isText && pEvent->numBytes>0 ) ? pEvent->numBytes-1 : pEvent->numBytes;
+		std::string message( reinterpret_cast<const char*>(pEvent->data), size );
+		pTransport->handlers_.message( !pEvent->isText, message );
+		return EM_TRUE;
+	}
+
+	EM_BOOL EmscriptenClientTransport::onClose( int eventType, const EmscriptenWebSocketCloseEvent* pEvent, void* pUserData )
+	{
+		EmscriptenClientTransport* pTransport=static_cast<EmscriptenClientTransport*>( pUserData );
+		if( pEvent->socket!=pTransport->socket_ ) return EM_TRUE;
+		Handlers handlers=pTransport->handlers_;
+		pTransport->deleteSocket();
+		if( handlers.close ) handlers.close( "The connection closed with code "+std::to_string(pEvent->code) );
+		return EM_TRUE;
+	}
+
+	void EmscriptenClientTransport::onTimer( void* pUserData )
+	{
+		std::unique_ptr<Timer> pTimer( static_cast<Timer*>(pUserData) );
+		if( !pTimer->pTransportAlive.expired() && pTimer->function ) pTimer->function();
+	}
+} // end of the unnamed namespace
+
+std::unique_ptr<clientserver::IClientTransport> clientserver::createClientTransport()
+{
+	return std::unique_ptr<clientserver::IClientTransport>( new ::EmscriptenClientTransport );
+}
@@ -0,0 +1,446 @@
+/**
+ * @file Browser client for the native engine of the "listen" command (clientserver::WebSocketServer).
+ *
+ * Speaks the same envelope as clientserver::MessageEnvelope inside each WebSocket message:
+ *
+ *     q<id>:<payload>   a request
+ *     r<id>:<payload>   the response to request <id>
+ *     i<payload>        an info message, which has no response
+ *     s<id>:<payload>   a request that is replied to in chunks
+ *     c<id>:<payload>   one chunk of the reply to streaming request <id>
+ *     e<id>:<error>     the end of the reply to streaming request <id>, where <error> is empty if it succeeded
+ *     b<id>:<batch>     several requests at once, with all of the responses in one r<id>: reply
+ *     p<id>:<batch>     the same but the responses are streamed back as c<id>: chunks as each one finishes, then e<id>:
+ *     o<channel>:<priority>:<credit>  opens a logical channel
+ *     w<channel>:<credit>  lets the server send more on the channel
+ *     m<channel>:<message> a whole message, with its own envelope, on a channel
+ *     f<channel>:<part>    part of a message on a channel, which continues in more f parts and ends with an m one
+ *     g0:               the server is shutting down, see onGoAway
+ *     x<id>:<milliseconds>  the server was too busy to run request or batch <id>, see onOverloaded
+ *
+ * A batch is each request or response one after the other as "<index>:<length>:<payload>", where
+ * <length> is in bytes (see clientserver::BatchEnvelope).
+ *
+ * Text messages are sent as text frames and their responses arrive as strings. Binary messages
+ * (an ArrayBuffer or typed array) are sent as binary frames with the same envelope in front, and
+ * their responses arrive as Uint8Arrays. Binary frames skip the UTF-8 checks at both ends, and
+ * avoid the 33% size increase of base64 encoding serialised protobuf.
+ *
+ * Requests don't wait for the previous response before being sent, so a slow link is kept busy
+ * rather than managing one request per round trip. The number in flight is limited by a window
+ * (see setRequestWindow) and anything over that is queued here until responses come back. If the
+ * server runs requests concurrently the responses can arrive in any order, and are matched to
+ * their requests by id.
+ *
+ * openChannel() gives a logical channel over the same connection, with the same send methods as the
+ * client. The server splits what it sends on channels into small parts and sends the next part
+ * from the highest priority channel that has something waiting, so a large transfer on a low
+ * priority channel only holds up a command for one part. Anything sent on the client itself goes
+ * before all channels. Each channel has a window: the server stops sending on it once that many
+ * bytes haven't been handled here yet, so a slow handler only holds up its own channel.
+ *
+ * Usage:
+ *
+ *     var client=new ClientServer();
+ *     client.onInfo=function( message ) { console.log( message ); };
+ *     client.connect( "ws://localhost:9002" ).then( function() {
+ *         client.sendBinaryRequest( new Uint8Array([1,2,3]), function( response ) { ... } );
+ *         var bulk=client.openChannel( 0 );
+ *         bulk.sendRequest( "everything", function( response ) { ... } );
+ *     } );
+ *
+ * @author Mark Grimes
+ * @date 19/Oct/2026
+ */
+( function( root ) {
+	"use strict";
+
+	var COLON=58; // ':' in ASCII
+
+	/** The number of bytes text takes up in UTF-8, which is how the server counts channel credit */
+	function utf8Length( text ) {
+		var length=0;
+		for( var index=0; index<text.length; ++index ) {
+			var code=text.charCodeAt( index );
+			if( code<0x80 ) length+=1;
+			else if( code<0x800 ) length+=2;
+			else if( code>=0xd800 && code<0xdc00 && index+1<text.length ) {
+				// A surrogate pair is one 4 byte character
+				length+=4;
+				++index;
+			}
+			else length+=3;
+		}
+		return length;
+	}
+
+	function ClientServer() {
+		this.socket_=null;
+		this.nextRequestId_=0;
+		this.responseHandlers_={};
+		this.streamHandlers_={};
+		this.requestWindow_=64;
+		this.outstandingRequests_=0;
+		this.queuedRequests_=[];
+		this.encoder_=new TextEncoder();
+		this.decoder_=new TextDecoder();
+		// The send methods are shared with Channel, which has a different prefix for each frame
+		this.client_=this;
+		this.prefix_="";
+		this.nextChannel_=1;
+		this.channels_={};
+		/** Called with each info message from the server, a string or a Uint8Array depending on the frame type */
+		this.onInfo=null;
+		/** Called when the connection closes, with the CloseEvent */
+		this.onClose=null;
+		/** Called when the server is shutting down. Requests already sent still get their responses, then the server
+		 * closes the connection with code 1001, so new requests should go over a new connection. Requests still
+		 * queued for the window are held back from now on. */
+		this.onGoAway=null;
+		/** Called with the number of milliseconds the server asked for before trying again, when it was too busy to run
+		 * a request or batch. That request's handler is never called, and since nothing was run it can be sent again. */
+		this.onOverloaded=null;
+		this.isGoingAway_=false;
+	}
+
+	/** Opens the connection, returning a Promise that resolves once it is ready to use */
+	ClientServer.prototype.connect=function( url ) {
+		var self=this;
+		return new Promise( function( resolve, reject ) {
+			var socket=new WebSocket( url );
+			socket.binaryType="arraybuffer";
+			socket.onopen=function() {
+				self.socket_=socket;
+				self.isGoingAway_=false;
+				resolve();
+			};
+			socket.onerror=function( event ) {
+				if( self.socket_===null ) reject( new Error( "Couldn't connect to "+url ) );
+			};
+			socket.onclose=function( event ) {
+				self.socket_=null;
+				self.responseHandlers_={};
+				self.streamHandlers_={};
+				self.outstandingRequests_=0;
+				self.queuedRequests_=[];
+				self.channels_={};
+				if( self.onClose ) self.onClose( event );
+			};
+			socket.onmessage=function( event ) { self.handleMessage_( event.data ); };
+		} );
+	};
+
+	ClientServer.prototype.disconnect=function() {
+		if( this.socket_ ) this.socket_.close( 1000 );
+	};
+
+	ClientServer.prototype.isConnected=function() {
+		return this.socket_!==null && this.socket_.readyState===WebSocket.OPEN;
+	};
+
+	/** The most requests of any kind that can be waiting for their final response at once. Default 64, and can be Infinity. */
+	ClientServer.prototype.setRequestWindow=function( requestWindow ) {
+		if( !( requestWindow>=1 ) ) throw new Error( "ClientServer request window has to be at least one" );
+		this.requestWindow_=requestWindow;
+		this.sendQueuedRequests_();
+	};
+
+	/** The number of requests sent that haven't finished yet */
+	ClientServer.prototype.outstandingRequests=function() {
+		return this.outstandingRequests_;
+	};
+
+	/** The number of requests waiting for room in the window before they're sent */
+	ClientServer.prototype.queuedRequests=function() {
+		return this.queuedRequests_.length;
+	};
+
+	ClientServer.prototype.sendInfo=function( message ) {
+		var client=this.client_;
+		client.checkConnected_();
+		client.socket_.send( this.prefix_+"i"+message );
+	};
+
+	ClientServer.prototype.sendRequest=function( message, responseHandler ) {
+		var client=this.client_;
+		client.checkConnected_();
+		var id=client.addResponseHandler_( responseHandler );
+		client.sendRequestFrame_( this.prefix_+"q"+id+":"+message );
+	};
+
+	/** Sends an ArrayBuffer or typed array in a binary frame */
+	ClientServer.prototype.sendBinaryInfo=function( message ) {
+		var client=this.client_;
+		client.checkConnected_();
+		client.socket_.send( client.binaryEnvelope_( this.prefix_+"i", message ) );
+	};
+
+	/** Sends an ArrayBuffer or typed array in a binary frame. The response is given to responseHandler as a Uint8Array. */
+	ClientServer.prototype.sendBinaryRequest=function( message, responseHandler ) {
+		var client=this.client_;
+		client.checkConnected_();
+		var id=client.addResponseHandler_( responseHandler );
+		client.sendRequestFrame_( client.binaryEnvelope_( this.prefix_+"q"+id+":", message ) );
+	};
+
+	/** Sends a request that the server replies to in chunks. chunkHandler is called with each chunk in order, then
+	 * endHandler once with an empty string if the reply succeeded or the server's error message if not. */
+	ClientServer.prototype.sendStreamingRequest=function( message, chunkHandler, endHandler ) {
+		var client=this.client_;
+		client.checkConnected_();
+		var id=client.addStreamHandlers_( chunkHandler, endHandler );
+		client.sendRequestFrame_( this.prefix_+"s"+id+":"+message );
+	};
+
+	/** Binary version of sendStreamingRequest. Chunks are given to chunkHandler as Uint8Arrays, but errors are still strings. */
+	ClientServer.prototype.sendBinaryStreamingRequest=function( message, chunkHandler, endHandler ) {
+		var client=this.client_;
+		client.checkConnected_();
+		var id=client.addStreamHandlers_( chunkHandler, endHandler );
+		client.sendRequestFrame_( client.binaryEnvelope_( this.prefix_+"s"+id+":", message ) );
+	};
+
+	/** Sends an array of requests in one message, which the server can run in parallel. responsesHandler is called
+	 * once they have all finished, with an array of the responses in the same order as the requests. */
+	ClientServer.prototype.sendBatch=function( messages, responsesHandler ) {
+		var client=this.client_;
+		client.checkConnected_();
+		var id=client.addResponseHandler_( function( payload ) {
+			var responses=new Array( messages.length );
+			client.decodeBatch_( payload ).forEach( function( entry ) { responses[entry.id]=entry.payload; } );
+			if( responsesHandler ) responsesHandler( responses );
+		} );
+		client.sendRequestFrame_( client.encodeBatch_( this.prefix_+"b"+id+":", messages ) );
+	};
+
+	/** Sends an array of requests in one message. responseHandler is called with the index of the request and its
+	 * response as each one finishes, then endHandler the same as for sendStreamingRequest. */
+	ClientServer.prototype.sendStreamingBatch=function( messages, responseHandler, endHandler ) {
+		var client=this.client_;
+		client.checkConnected_();
+		var id=client.addStreamHandlers_( function( payload ) {
+			client.decodeBatch_( payload ).forEach( function( entry ) { if( responseHandler ) responseHandler( entry.id, entry.payload ); } );
+		}, endHandler );
+		client.sendRequestFrame_( client.encodeBatch_( this.prefix_+"p"+id+":", messages ) );
+	};
+
+	/** Opens a logical channel on the connection, returning a Channel with the same send methods as the client.
+	 *
+	 * The server sends what's waiting on higher priority channels first, and takes turns between channels of the same
+	 * priority. window is the most bytes the server can send on the channel before they've been handled here, default
+	 * 1MiB. Channels last as long as the connection.
+	 */
+	ClientServer.prototype.openChannel=function( priority, window ) {
+		this.checkConnected_();
+		var id=this.nextChannel_;
+		this.nextChannel_=( this.nextChannel_+1 )>>>0 || 1;
+		window=window || 1024*1024;
+		this.channels_[id]={ parts: [], consumed: 0, window: window };
+		this.socket_.send( "o"+id+":"+( priority || 0 )+":"+window );
+		return new Channel( this, id );
+	};
+
+	/** A logical channel from ClientServer.openChannel. Responses to what's sent on it come back on it. */
+	function Channel( client, id ) {
+		this.client_=client;
+		this.prefix_="m"+id+":";
+		this.id_=id;
+	}
+	[ "sendInfo", "sendRequest", "sendBinaryInfo", "sendBinaryRequest", "sendStreamingRequest", "sendBinaryStreamingRequest",
+		"sendBatch", "sendStreamingBatch" ].forEach( function( name ) { Channel.prototype[name]=ClientServer.prototype[name]; } );
+
+	/** Changes the channel's priority, for what the server sends from now on */
+	Channel.prototype.setPriority=function( priority ) {
+		this.client_.checkConnected_();
+		this.client_.socket_.send( "o"+this.id_+":"+priority+":0" );
+	};
+
+	ClientServer.prototype.checkConnected_=function() {
+		if( !this.isConnected() ) throw new Error( "ClientServer is not connected" );
+	};
+
+	ClientServer.prototype.sendRequestFrame_=function( frame ) {
+		if( this.outstandingRequests_<this.requestWindow_ && !this.isGoingAway_ ) {
+			++this.outstandingRequests_;
+			this.socket_.send( frame );
+		}
+		else this.queuedRequests_.push( frame );
+	};
+
+	/** Called when a request has had its final response, to let the next queued one go */
+	ClientServer.prototype.requestFinished_=function() {
+		--this.outstandingRequests_;
+		this.sendQueuedRequests_();
+	};
+
+	ClientServer.prototype.sendQueuedRequests_=function() {
+		while( this.queuedRequests_.length>0 && this.outstandingRequests_<this.requestWindow_ && this.isConnected() && !this.isGoingAway_ ) {
+			++this.outstandingRequests_;
+			this.socket_.send( this.queuedRequests_.shift() );
+		}
+	};
+
+	ClientServer.prototype.addResponseHandler_=function( responseHandler ) {
+		// Ids are uint32 on the server
+		var id=this.nextRequestId_;
+		this.nextRequestId_=( this.nextRequestId_+1 )>>>0;
+		this.responseHandlers_[id]=responseHandler;
+		return id;
+	};
+
+	ClientServer.prototype.addStreamHandlers_=function( chunkHandler, endHandler ) {
+		// Shares the id sequence with normal requests
+		var id=this.addResponseHandler_( null );
+		delete this.responseHandlers_[id];
+		this.streamHandlers_[id]={ chunk: chunkHandler, end: endHandler };
+		return id;
+	};
+
+	/** Puts the header in front of the payload in one buffer, so that it goes in a single frame */
+	ClientServer.prototype.binaryEnvelope_=function( header, message ) {
+		var payload=( message instanceof ArrayBuffer ) ? new Uint8Array( message ) : new Uint8Array( message.buffer, message.byteOffset, message.byteLength );
+		var headerBytes=this.encoder_.encode( header );
+		var envelope=new Uint8Array( headerBytes.length+payload.length );
+		envelope.set( headerBytes, 0 );
+		envelope.set( payload, headerBytes.length );
+		return envelope;
+	};
+
+	/** Strings go in a text frame, anything else in a binary frame with the responses as Uint8Arrays */
+	ClientServer.prototype.encodeBatch_=function( header, messages ) {
+		var self=this;
+		var isText=messages.every( function( message ) { return typeof message==="string"; } );
+		var parts=messages.map( function( message ) { return isText ? self.encoder_.encode( message ) : self.binaryEnvelope_( "", message ); } );
+		if( isText ) {
+			return header+messages.map( function( message, index ) { return index+":"+parts[index].length+":"+message; } ).join( "" );
+		}
+		var entryHeaders=parts.map( function( part, index ) { return self.encoder_.encode( index+":"+part.length+":" ); } );
+		var headerBytes=this.encoder_.encode( header );
+		var size=headerBytes.length;
+		parts.forEach( function( part, index ) { size+=entryHeaders[index].length+part.length; } );
+		var envelope=new Uint8Array( size );
+		envelope.set( headerBytes, 0 );
+		var position=headerBytes.length;
+		parts.forEach( function( part, index ) {
+			envelope.set( entryHeaders[index], position );
+			position+=entryHeaders[index].length;
+			envelope.set( part, position );
+			position+=part.length;
+		} );
+		return envelope;
+	};
+
+	/** Splits a batch into an array of { id, payload }, where each payload is the same type as the batch */
+	ClientServer.prototype.decodeBatch_=function( batch ) {
+		var isText=( typeof batch==="string" );
+		var bytes=isText ? this.encoder_.encode( batch ) : batch;
+		var entries=[];
+		var index=0;
+		var readNumber=function() {
+			var value=0;
+			while( index<bytes.length && bytes[index]!==COLON ) value=value*10+( bytes[index++]-48 );
+			++index;
+			return value;
+		};
+		while( index<bytes.length ) {
+			var id=readNumber();
+			var length=readNumber();
+			var payload=bytes.subarray( index, index+length );
+			entries.push( { id: id, payload: isText ? this.decoder_.decode( payload ) : payload } );
+			index+=length;
+		}
+		return entries;
+	};
+
+	/** Puts the parts of a channel message back together, handles it, and gives the server more credit if it's time */
+	ClientServer.prototype.handleChannelMessage_=function( type, id, payload ) {
+		var channel=this.channels_[id];
+		// Messages on channels that aren't open here, e.g. from before a reconnect, are never split
+		if( !channel ) {
+			if( type==="m" ) this.handleMessage_( payload );
+			return;
+		}
+		channel.parts.push( payload );
+		channel.consumed+=( typeof payload==="string" ) ? utf8Length( payload ) : payload.length;
+		if( type==="m" ) {
+			var parts=channel.parts;
+			channel.parts=[];
+			if( parts.length===1 ) this.handleMessage_( payload );
+			else if( typeof payload==="string" ) this.handleMessage_( parts.join( "" ) );
+			else {
+				var size=0;
+				parts.forEach( function( part ) { size+=part.length; } );
+				var message=new Uint8Array( size );
+				var position=0;
+				parts.forEach( function( part ) {
+					message.set( part, position );
+					position+=part.length;
+				} );
+				this.handleMessage_( message );
+			}
+		}
+		// Handlers can close the connection, and in batches so that each part doesn't need a message back
+		if( channel.consumed>=channel.window/2 && this.isConnected() ) {
+			this.socket_.send( "w"+id+":"+channel.consumed );
+			channel.consumed=0;
+		}
+	};
+
+	ClientServer.prototype.handleMessage_=function( data ) {
+		var type, id=0, payload;
+		if( typeof data==="string" ) {
+			type=data.charAt( 0 );
+			var payloadStart=1;
+			if( type!=="i" ) {
+				payloadStart=data.indexOf( ":" )+1;
+				id=parseInt( data.substring( 1, payloadStart-1 ), 10 );
+			}
+			payload=data.substring( payloadStart );
+		}
+		else {
+			// Only the envelope is decoded, the payload is a view onto the received buffer rather than a copy
+			var bytes=( data instanceof ArrayBuffer ) ? new Uint8Array( data ) : data;
+			type=String.fromCharCode( bytes[0] );
+			var index=1;
+			if( type!=="i" ) {
+				while( index<bytes.length && bytes[index]!==COLON ) id=id*10+( bytes[index++]-48 );
+				++index;
+			}
+			payload=bytes.subarray( index );
+		}
+
+		if( type==="m" || type==="f" ) this.handleChannelMessage_( type, id, payload );
+		else if( type==="r" ) {
+			if( !( id in this.responseHandlers_ ) ) return;
+			var handler=this.responseHandlers_[id];
+			delete this.responseHandlers_[id];
+			this.requestFinished_();
+			if( handler ) handler( payload );
+		}
+		else if( type==="c" ) {
+			var streamHandlers=this.streamHandlers_[id];
+			if( streamHandlers && streamHandlers.chunk ) streamHandlers.chunk( payload );
+		}
+		else if( type==="e" ) {
+			if( !( id in this.streamHandlers_ ) ) return;
+			var endHandlers=this.streamHandlers_[id];
+			delete this.streamHandlers_[id];
+			this.requestFinished_();
+			if( endHandlers && endHandlers.end ) endHandlers.end( typeof payload==="string" ? payload : this.decoder_.decode( payload ) );
+		}
+		else if( type==="x" ) {
+			if( !( id in this.responseHandlers_ ) ) return;
+			delete this.responseHandlers_[id];
+			this.requestFinished_();
+			if( this.onOverloaded ) this.onOverloaded( parseInt( typeof payload==="string" ? payload : this.decoder_.decode( payload ), 10 ) );
+		}
+		else if( type==="i" && this.onInfo ) this.onInfo( payload );
+		else if( type==="g" ) {
+			this.isGoingAway_=true;
+			if( this.onGoAway ) this.onGoAway();
+		}
+	};
+
+	if( typeof module!=="undefined" && module.exports ) module.exports=ClientServer;
+	else root.ClientServer=ClientServer;
+} )( this );
@@ -0,0 +1,323 @@
+/**
+ * @file Runs a ClientServer in a Web Worker, so that receiving and decoding messages doesn't hold up the page.
+ *
+ * The same file is both halves. Loaded in a page it defines WorkerClientServer, which has the same
+ * interface as ClientServer. That starts this file again as a Worker, which loads ClientServer.js
+ * from the same directory and owns the WebSocket. Everything the server sends is handled in the
+ * worker, then passed through an optional decoder, and the results are handed to the page.
+ *
+ * The decoder is a script given to connect(), loaded into the worker with importScripts(), that
+ * defines a global decodeMessage( payload ) function. It is called with each response, chunk and
+ * info message (a string or Uint8Array, the same as ClientServer gives), and whatever it returns
+ * is what the page's handlers get. That's where the protobuf decoding goes, e.g. by loading the
+ * Emscripten ClientCode.js in the decoder script. The worker only has one thread so the build's
+ * GOOGLE_PROTOBUF_NO_THREAD_SAFETY is still fine.
+ *
+ * Results are sent to the page in batches, at most one per animation frame, and any ArrayBuffers
+ * in them (including those behind typed arrays, in arrays or plain objects) are transferred rather
+ * than copied. A burst of messages from the server therefore costs the page one task per frame,
+ * however many there are. Handlers are called from requestAnimationFrame, so they don't run while
+ * the page is hidden; the results wait in the worker until it is visible again.
+ *
+ * Messages sent from the page are copied to the worker, so their buffers can be reused.
+ *
+ * Usage:
+ *
+ *     var client=new WorkerClientServer();
+ *     client.onInfo=function( message ) { console.log( message ); };
+ *     client.connect( "ws://localhost:9002", "Decoder.js" ).then( function() {
+ *         client.sendBinaryRequest( new Uint8Array([1,2,3]), function( decodedResponse ) { ... } );
+ *     } );
+ *
+ * @author Mark Grimes
+ * @date 19/Oct/2026
+ */
+( function( root ) {
+	"use strict";
+
+	/** Adds each ArrayBuffer in value to buffers, once each, so they can be transferred rather than copied */
+	function collectBuffers( value, buffers ) {
+		if( value===null || typeof value!=="object" ) return;
+		var buffer=null;
+		if( value instanceof ArrayBuffer ) buffer=value;
+		else if( ArrayBuffer.isView( value ) ) buffer=value.buffer;
+		if( buffer!==null ) {
+			// Several payloads can be views onto the same received message, and a buffer can only be listed once
+			if( buffers.indexOf( buffer )===-1 ) buffers.push( buffer );
+			return;
+		}
+		if( Array.isArray( value ) ) value.forEach( function( element ) { collectBuffers( element, buffers ); } );
+		else if( Object.getPrototypeOf( value )===Object.prototype ) {
+			Object.keys( value ).forEach( function( key ) { collectBuffers( value[key], buffers ); } );
+		}
+	}
+
+	/** The worker half, which owns the ClientServer and sends results to the page when it's ready for them */
+	function runWorker( scope ) {
+		scope.importScripts( "ClientServer.js" );
+		var client=new scope.ClientServer();
+		var channels={};
+		var decode=function( payload ) { return payload; };
+		var results=[];
+		var buffers=[];
+		// The page asks for the next batch once it has handled the last one
+		var pageIsWaiting=true;
+
+		var flush=function() {
+			if( !pageIsWaiting || results.length===0 ) return;
+			pageIsWaiting=false;
+			scope.postMessage( { results: results, outstanding: client.outstandingRequests(), queued: client.queuedRequests() }, buffers );
+			results=[];
+			buffers=[];
+		};
+		var deliver=function( result ) {
+			results.push( result );
+			collectBuffers( result.payload, buffers );
+			flush();
+		};
+
+		client.onInfo=function( message ) { deliver( { type: "info", payload: decode( message ) } ); };
+		client.onClose=function( event ) {
+			// CloseEvents can't be posted, so only what's useful is sent
+			deliver( { type: "close", payload: { code: event.code, reason: event.reason, wasClean: event.wasClean } } );
+		};
+		client.onGoAway=function() { deliver( { type: "goAway" } ); };
+		client.onOverloaded=function( retryAfter ) { deliver( { type: "overloaded", payload: retryAfter } ); };
+
+		scope.onmessage=function( event ) {
+			var command=event.data;
+			var id=command.id;
+			try {
+				if( command.type==="frame" ) {
+					pageIsWaiting=true;
+					flush();
+				}
+				else if( command.type==="connect" ) {
+					if( command.decoderUrl ) {
+						scope.importScripts( command.decoderUrl );
+						if( typeof scope.decodeMessage!=="function" ) throw new Error( "\""+command.decoderUrl+"\" doesn't define decodeMessage" );
+						decode=scope.decodeMessage;
+					}
+					client.connect( command.url ).then(
+						function() { deliver( { type: "open" } ); },
+						function( error ) { deliver( { type: "connectFailed", payload: error.message } ); } );
+				}
+				else if( command.type==="disconnect" ) client.disconnect();
+				else if( command.type==="openChannel" ) channels[command.channel]=client.openChannel( command.priority, command.window );
+				else if( command.type==="setRequestWindow" ) client.setRequestWindow( command.requestWindow );
+				// Anything for a channel that didn't open, e.g. because it was opened before connecting, throws here
+				var target=command.channel ? channels[command.channel] : client;
+				if( command.type==="info" ) target[command.method]( command.message );
+				else if( command.type==="request" ) {
+					target[command.method]( command.message, function( response ) {
+						deliver( { type: "response", id: id, payload: decode( response ) } );
+					} );
+				}
+				else if( command.type==="batch" ) {
+					target[command.method]( command.message, function( responses ) {
+						deliver( { type: "response", id: id, payload: responses.map( function( response ) { return decode( response ); } ) } );
+					} );
+				}
+				else if( command.type==="stream" ) {
+					target[command.method]( command.message,
+						function( chunk ) { deliver( { type: "chunk", id: id, payload: decode( chunk ) } ); },
+						function( error ) { deliver( { type: "end", id: id, payload: error } ); } );
+				}
+				else if( command.type==="streamingBatch" ) {
+					target[command.method]( command.message,
+						function( index, response ) { deliver( { type: "chunk", id: id, index: index, payload: decode( response ) } ); },
+						function( error ) { deliver( { type: "end", id: id, payload: error } ); } );
+				}
+			}
+			catch( error ) {
+				// Streams are always told how they ended. Anything else is dropped, the same as if the connection had gone.
+				if( command.type==="stream" || command.type==="streamingBatch" ) deliver( { type: "end", id: id, payload: error.message } );
+				else if( command.type==="connect" ) deliver( { type: "connectFailed", payload: error.message } );
+			}
+		};
+	}
+
+	/** The page half, with the same interface as ClientServer */
+	function WorkerClientServer( workerUrl ) {
+		var self=this;
+		this.worker_=new Worker( workerUrl || "ClientServerWorker.js" );
+		this.isConnected_=false;
+		this.connecting_=null;
+		// The send methods are shared with WorkerChannel, the same as ClientServer and its Channel
+		this.client_=this;
+		this.channel_=0;
+		this.nextChannel_=1;
+		this.nextId_=0;
+		this.handlers_={};
+		this.results_=[];
+		this.frameRequested_=false;
+		this.outstandingRequests_=0;
+		this.queuedRequests_=0;
+		/** Called with each info message from the server, after it has been through the decoder */
+		this.onInfo=null;
+		/** Called when the connection closes, with an object holding the CloseEvent's code, reason and wasClean */
+		this.onClose=null;
+		/** Called when the server is shutting down, the same as ClientServer.onGoAway */
+		this.onGoAway=null;
+		/** Called when the server was too busy to run a request, the same as ClientServer.onOverloaded */
+		this.onOverloaded=null;
+		this.worker_.onmessage=function( event ) { self.receive_( event.data ); };
+		this.worker_.onerror=function( event ) {
+			if( self.connecting_ ) self.connecting_.reject( new Error( "ClientServer worker failed: "+event.message ) );
+			self.connecting_=null;
+		};
+	}
+
+	/** Opens the connection, returning a Promise that resolves once it is ready to use.
+	 * decoderUrl is optional, and is the script that defines decodeMessage() in the worker. */
+	WorkerClientServer.prototype.connect=function( url, decoderUrl ) {
+		var self=this;
+		return new Promise( function( resolve, reject ) {
+			self.connecting_={ resolve: resolve, reject: reject };
+			self.worker_.postMessage( { type: "connect", url: url, decoderUrl: decoderUrl } );
+		} );
+	};
+
+	WorkerClientServer.prototype.disconnect=function() {
+		this.worker_.postMessage( { type: "disconnect" } );
+	};
+
+	/** Whether the connection was open as of the last results from the worker */
+	WorkerClientServer.prototype.isConnected=function() {
+		return this.isConnected_;
+	};
+
+	WorkerClientServer.prototype.setRequestWindow=function( requestWindow ) {
+		if( !( requestWindow>=1 ) ) throw new Error( "ClientServer request window has to be at least one" );
+		this.worker_.postMessage( { type: "setRequestWindow", requestWindow: requestWindow } );
+	};
+
+	/** The number of requests sent that hadn't finished, as of the last results from the worker */
+	WorkerClientServer.prototype.outstandingRequests=function() {
+		return this.outstandingRequests_;
+	};
+
+	/** The number of requests waiting for room in the window, as of the last results from the worker */
+	WorkerClientServer.prototype.queuedRequests=function() {
+		return this.queuedRequests_;
+	};
+
+	/** Opens a logical channel, see ClientServer.openChannel */
+	WorkerClientServer.prototype.openChannel=function( priority, window ) {
+		if( !this.isConnected_ ) throw new Error( "ClientServer is not connected" );
+		var channel=this.nextChannel_++;
+		this.worker_.postMessage( { type: "openChannel", channel: channel, priority: priority, window: window } );
+		return new WorkerChannel( this, channel );
+	};
+
+	WorkerClientServer.prototype.sendInfo=function( message ) {
+		this.post_( "info", "sendInfo", message, null );
+	};
+
+	WorkerClientServer.prototype.sendRequest=function( message, responseHandler ) {
+		this.post_( "request", "sendRequest", message, { response: responseHandler } );
+	};
+
+	WorkerClientServer.prototype.sendBinaryInfo=function( message ) {
+		this.post_( "info", "sendBinaryInfo", message, null );
+	};
+
+	WorkerClientServer.prototype.sendBinaryRequest=function( message, responseHandler ) {
+		this.post_( "request", "sendBinaryRequest", message, { response: responseHandler } );
+	};
+
+	WorkerClientServer.prototype.sendStreamingRequest=function( message, chunkHandler, endHandler ) {
+		this.post_( "stream", "sendStreamingRequest", message, { chunk: chunkHandler, end: endHandler } );
+	};
+
+	WorkerClientServer.prototype.sendBinaryStreamingRequest=function( message, chunkHandler, endHandler ) {
+		this.post_( "stream", "sendBinaryStreamingRequest", message, { chunk: chunkHandler, end: endHandler } );
+	};
+
+	WorkerClientServer.prototype.sendBatch=function( messages, responsesHandler ) {
+		this.post_( "batch", "sendBatch", messages, { response: responsesHandler } );
+	};
+
+	WorkerClientServer.prototype.sendStreamingBatch=function( messages, responseHandler, endHandler ) {
+		this.post_( "streamingBatch", "sendStreamingBatch", messages, { chunk: responseHandler, end: endHandler } );
+	};
+
+	WorkerClientServer.prototype.post_=function( type, method, message, handlers ) {
+		var client=this.client_;
+		if( !client.isConnected_ ) throw new Error( "ClientServer is not connected" );
+		var id=client.nextId_++;
+		if( handlers ) client.handlers_[id]=handlers;
+		client.worker_.postMessage( { type: type, method: method, id: id, message: message, channel: this.channel_ } );
+	};
+
+	/** A logical channel from WorkerClientServer.openChannel, with the same send methods */
+	function WorkerChannel( client, channel ) {
+		this.client_=client;
+		this.channel_=channel;
+	}
+	[ "sendInfo", "sendRequest", "sendBinaryInfo", "sendBinaryRequest", "sendStreamingRequest", "sendBinaryStreamingRequest",
+		"sendBatch", "sendStreamingBatch", "post_" ].forEach( function( name ) { WorkerChannel.prototype[name]=WorkerClientServer.prototype[name]; } );
+
+	/** Keeps the batch from the worker until the next animation frame */
+	WorkerClientServer.prototype.receive_=function( batch ) {
+		var self=this;
+		Array.prototype.push.apply( this.results_, batch.results );
+		this.outstandingRequests_=batch.outstanding;
+		this.queuedRequests_=batch.queued;
+		if( this.frameRequested_ ) return;
+		this.frameRequested_=true;
+		requestAnimationFrame( function() { self.dispatch_(); } );
+	};
+
+	/** Calls the handlers for everything received since the last frame, then asks the worker for more */
+	WorkerClientServer.prototype.dispatch_=function() {
+		var results=this.results_;
+		this.results_=[];
+		this.frameRequested_=false;
+		for( var index=0; index<results.length; ++index ) {
+			var result=results[index];
+			var handlers=this.handlers_[result.id];
+			if( result.type==="response" ) {
+				delete this.handlers_[result.id];
+				if( handlers && handlers.response ) handlers.response( result.payload );
+			}
+			else if( result.type==="chunk" ) {
+				if( !handlers || !handlers.chunk ) continue;
+				if( "index" in result ) handlers.chunk( result.index, result.payload );
+				else handlers.chunk( result.payload );
+			}
+			else if( result.type==="end" ) {
+				delete this.handlers_[result.id];
+				if( handlers && handlers.end ) handlers.end( result.payload );
+			}
+			else if( result.type==="info" ) {
+				if( this.onInfo ) this.onInfo( result.payload );
+			}
+			else if( result.type==="open" ) {
+				this.isConnected_=true;
+				if( this.connecting_ ) this.connecting_.resolve();
+				this.connecting_=null;
+			}
+			else if( result.type==="connectFailed" ) {
+				if( this.connecting_ ) this.connecting_.reject( new Error( result.payload ) );
+				this.connecting_=null;
+			}
+			else if( result.type==="close" ) {
+				this.isConnected_=false;
+				this.handlers_={};
+				if( this.onClose ) this.onClose( result.payload );
+			}
+			else if( result.type==="goAway" ) {
+				if( this.onGoAway ) this.onGoAway();
+			}
+			else if( result.type==="overloaded" ) {
+				if( this.onOverloaded ) this.onOverloaded( result.payload );
+			}
+		}
+		this.worker_.postMessage( { type: "frame" } );
+	};
+
+	if( typeof WorkerGlobalScope!=="undefined" && root instanceof WorkerGlobalScope ) runWorker( root );
+	else if( typeof module!=="undefined" && module.exports ) module.exports=WorkerClientServer;
+	else root.WorkerClientServer=WorkerClientServer;
+} )( this );
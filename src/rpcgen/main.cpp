@@ -0,0 +1,258 @@
+/** @file
+ * @brief Generates the server and client stubs for the services in .proto files.
+ *
+ * protoc already generates the message classes, but not anything for services (unless using
+ * gRPC). This reads the FileDescriptorSet that "protoc --descriptor_set_out --include_imports"
+ * writes, and for each requested .proto file writes "<name>.rpc.h" and "<name>.rpc.cc" containing,
+ * for every service:
+ *
+ *     <Service>        an abstract class to implement on the server, with addMethodsTo() to add
+ *                      every method to a clientserver::RpcDispatcher
+ *     <Service>Client  a class with a method for each RPC, sending it over a clientserver::RpcChannel
+ *
+ * Reading the descriptor set means only libprotobuf is needed, not the protoc plugin library.
+ *
+ * @author Mark Grimes
+ * @date 19/Oct/2026
+ */
+#include "clientserver/RpcOptions.pb.h"
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/descriptor.pb.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <set>
+#include <stdexcept>
+
+namespace // Unnamed namespace for things only used in this file
+{
+	std::string replaceAll( std::string text, const std::string& from, const std::string& to )
+	{
+		for( size_t position=text.find(from); position!=std::string::npos; position=text.find(from,position+to.size()) )
+		{
+			text.replace( position, from.size(), to );
+		}
+		return text;
+	}
+
+	/** @brief The fully qualified name of the class protoc generates for the message, e.g. "::package::Outer_Inner". */
+	std::string cppClassName( const google::protobuf::Descriptor* pMessage )
+	{
+		const std::string& package=pMessage->file()->package();
+		std::string name=pMessage->full_name();
+		if( !package.empty() ) name=name.substr( package.size()+1 );
+		return "::"+(package.empty() ? "" : ::replaceAll(package,".","::")+"::")+::replaceAll(name,".","_");
+	}
+
+	/** @brief The file name without the ".proto" extension. */
+	std::string baseName( const std::string& protoFilename )
+	{
+		const std::string extension=".proto";
+		if( protoFilename.size()<=extension.size() || protoFilename.compare(protoFilename.size()-extension.size(),extension.size(),extension)!=0 )
+		{
+			throw std::runtime_error( "\""+protoFilename+"\" doesn't end with \""+extension+"\"" );
+		}
+		return protoFilename.substr( 0, protoFilename.size()-extension.size() );
+	}
+
+	void checkServices( const google::protobuf::FileDescriptor* pFile )
+	{
+		std::set<uint32_t> methodIds;
+		for( int serviceIndex=0; serviceIndex<pFile->service_count(); ++serviceIndex )
+		{
+			const google::protobuf::ServiceDescriptor* pService=pFile->service(serviceIndex);
+			for( int methodIndex=0; methodIndex<pService->method_count(); ++methodIndex )
+			{
+				const google::protobuf::MethodDescriptor* pMethod=pService->method(methodIndex);
+				if( pMethod->client_streaming() || pMethod->server_streaming() ) throw std::runtime_error( pMethod->full_name()+" is streaming, which isn't supported" );
+				if( !pMethod->options().HasExtension(clientserver::method_id) ) throw std::runtime_error( pMethod->full_name()+" doesn't have the (clientserver.method_id) option set" );
+				const uint32_t methodId=pMethod->options().GetExtension(clientserver::method_id);
+				if( methodId>0xffff ) throw std::runtime_error( pMethod->full_name()+" has a method_id larger than 65535" );
+				if( !methodIds.insert(methodId).second ) throw std::runtime_error( pMethod->full_name()+" has the same method_id ("+std::to_string(methodId)+") as another method" );
+			}
+		}
+	}
+
+	void writeHeader( const google::protobuf::FileDescriptor* pFile, std::ostream& output )
+	{
+		const std::string base=::baseName( pFile->name() );
+		const std::string includeGuard="INCLUDEGUARD_"+::replaceAll(::replaceAll(base,"/","_"),".","_")+"_rpc_h";
+
+		output << "// Generated by rpcgen from " << pFile->name() << ". Do not edit.\n"
+		       << "#ifndef " << includeGuard << "\n"
+		       << "#define " << includeGuard << "\n"
+		       << "\n"
+		       << "#include <memory>\n"
+		       << "#include <functional>\n"
+		       << "#include \"" << base << ".pb.h\"\n"
+		       << "#include \"clientserver/RpcDispatcher.h\"\n"
+		       << "#include \"clientserver/RpcChannel.h\"\n"
+		       << "\n";
+
+		std::vector<std::string> namespaces;
+		std::istringstream packageStream( pFile->package() );
+		for( std::string name; std::getline(packageStream,name,'.'); ) namespaces.push_back( name );
+		for( const auto& name : namespaces ) output << "namespace " << name << " {\n";
+
+		for( int serviceIndex=0; serviceIndex<pFile->service_count(); ++serviceIndex )
+		{
+			const google::protobuf::ServiceDescriptor* pService=pFile->service(serviceIndex);
+
+			output << "\n"
+			       << "\t/** @brief Server side of " << pService->full_name() << ". Implement the methods, then call addMethodsTo on a dispatcher. */\n"
+			       << "\tclass " << pService->name() << "\n"
+			       << "\t{\n"
+			       << "\tpublic:\n"
+			       << "\t\tenum MethodId : uint32_t\n"
+			       << "\t\t{\n";
+			for( int methodIndex=0; methodIndex<pService->method_count(); ++methodIndex )
+			{
+				const google::protobuf::MethodDescriptor* pMethod=pService->method(methodIndex);
+				output << "\t\t\t" << pMethod->name() << "MethodId=" << pMethod->options().GetExtension(clientserver::method_id) << (methodIndex+1<pService->method_count() ? "," : "") << "\n";
+			}
+			output << "\t\t};\n"
+			       << "\n"
+			       << "\t\tvirtual ~" << pService->name() << "() {}\n";
+			for( int methodIndex=0; methodIndex<pService->method_count(); ++methodIndex )
+			{
+				const google::protobuf::MethodDescriptor* pMethod=pService->method(methodIndex);
+				output << "\t\tvirtual void " << pMethod->name() << "( const " << ::cppClassName(pMethod->input_type()) << "& request, "
+				       << ::cppClassName(pMethod->output_type()) << "& response, std::weak_ptr<::clientserver::IConnection> pConnection ) = 0;\n";
+			}
+			output << "\n"
+			       << "\t\t/** @brief Adds every method to the dispatcher, to be called on this object, which has to outlive the dispatcher. */\n"
+			       << "\t\tvoid addMethodsTo( ::clientserver::RpcDispatcher& dispatcher );\n"
+			       << "\t};\n"
+			       << "\n"
+			       << "\t/** @brief Client side of " << pService->full_name() << ". Each method can either be asynchronous, or block until the response arrives. */\n"
+			       << "\tclass " << pService->name() << "Client\n"
+			       << "\t{\n"
+			       << "\tpublic:\n"
+			       << "\t\texplicit " << pService->name() << "Client( ::clientserver::RpcChannel& channel );\n";
+			for( int methodIndex=0; methodIndex<pService->method_count(); ++methodIndex )
+			{
+				const google::protobuf::MethodDescriptor* pMethod=pService->method(methodIndex);
+				const std::string requestClass=::cppClassName(pMethod->input_type());
+				const std::string responseClass=::cppClassName(pMethod->output_type());
+				output << "\t\tvoid " << pMethod->name() << "( const " << requestClass << "& request, std::function<void(const " << responseClass << "&)> responseHandler, ::clientserver::RpcChannel::ErrorHandler errorHandler=nullptr );\n"
+				       << "\t\t" << responseClass << " " << pMethod->name() << "( const " << requestClass << "& request );\n";
+			}
+			output << "\tprotected:\n"
+			       << "\t\t::clientserver::RpcChannel& channel_;\n"
+			       << "\t};\n";
+		}
+
+		output << "\n";
+		for( auto iName=namespaces.rbegin(); iName!=namespaces.rend(); ++iName ) output << "} // end of namespace " << *iName << "\n";
+		output << "\n"
+		       << "#endif // end of \"#ifndef " << includeGuard << "\"\n";
+	}
+
+	void writeSource( const google::protobuf::FileDescriptor* pFile, std::ostream& output )
+	{
+		const std::string base=::baseName( pFile->name() );
+		const std::string scope=(pFile->package().empty() ? "" : ::replaceAll(pFile->package(),".","::")+"::");
+
+		output << "// Generated by rpcgen from " << pFile->name() << ". Do not edit.\n"
+		       << "#include \"" << base << ".rpc.h\"\n";
+
+		for( int serviceIndex=0; serviceIndex<pFile->service_count(); ++serviceIndex )
+		{
+			const google::protobuf::ServiceDescriptor* pService=pFile->service(serviceIndex);
+			const std::string serverClass=scope+pService->name();
+			const std::string clientClass=serverClass+"Client";
+
+			output << "\n"
+			       << "void " << serverClass << "::addMethodsTo( ::clientserver::RpcDispatcher& dispatcher )\n"
+			       << "{\n";
+			for( int methodIndex=0; methodIndex<pService->method_count(); ++methodIndex )
+			{
+				const google::protobuf::MethodDescriptor* pMethod=pService->method(methodIndex);
+				const std::string requestClass=::cppClassName(pMethod->input_type());
+				const std::string responseClass=::cppClassName(pMethod->output_type());
+				output << "\tdispatcher.addMethod<" << requestClass << "," << responseClass << ">( " << pMethod->name() << "MethodId, [this](const " << requestClass << "& request," << responseClass << "& response,std::weak_ptr<::clientserver::IConnection> pConnection)\n"
+				       << "\t\t{\n"
+				       << "\t\t\t" << pMethod->name() << "( request, response, pConnection );\n"
+				       << "\t\t} );\n";
+			}
+			output << "}\n"
+			       << "\n"
+			       << clientClass << "::" << pService->name() << "Client( ::clientserver::RpcChannel& channel )\n"
+			       << "\t: channel_(channel)\n"
+			       << "{\n"
+			       << "}\n";
+			for( int methodIndex=0; methodIndex<pService->method_count(); ++methodIndex )
+			{
+				const google::protobuf::MethodDescriptor* pMethod=pService->method(methodIndex);
+				const std::string requestClass=::cppClassName(pMethod->input_type());
+				const std::string responseClass=::cppClassName(pMethod->output_type());
+				const std::string methodId=serverClass+"::"+pMethod->name()+"MethodId";
+				output << "\n"
+				       << "void " << clientClass << "::" << pMethod->name() << "( const " << requestClass << "& request, std::function<void(const " << responseClass << "&)> responseHandler, ::clientserver::RpcChannel::ErrorHandler errorHandler )\n"
+				       << "{\n"
+				       << "\tchannel_.call<" << responseClass << ">( " << methodId << ", request, responseHandler, errorHandler );\n"
+				       << "}\n"
+				       << "\n"
+				       << responseClass << " " << clientClass << "::" << pMethod->name() << "( const " << requestClass << "& request )\n"
+				       << "{\n"
+				       << "\treturn channel_.call<" << responseClass << ">( " << methodId << ", request );\n"
+				       << "}\n";
+			}
+		}
+	}
+
+	void writeFile( const std::string& filename, std::function<void(std::ostream&)> writeFunction )
+	{
+		std::ofstream output( filename );
+		if( !output.is_open() ) throw std::runtime_error( "Couldn't open \""+filename+"\" for writing" );
+		writeFunction( output );
+		if( !output.good() ) throw std::runtime_error( "Couldn't write to \""+filename+"\"" );
+	}
+} // end of the unnamed namespace
+
+int main( int argc, char* argv[] )
+{
+	if( argc<4 )
+	{
+		std::cerr << "Usage:" << "\n"
+		          << "  " << argv[0] << " <descriptor set> <output directory> <proto file>..." << "\n"
+		          << "\n"
+		          << "The descriptor set is the output of \"protoc --descriptor_set_out=<file> --include_imports\", and the" << "\n"
+		          << "proto files are given relative to the protoc import path, i.e. as they appear in the descriptor set." << std::endl;
+		return -1;
+	}
+
+	try
+	{
+		google::protobuf::FileDescriptorSet descriptorSet;
+		std::ifstream input( argv[1], std::ios::binary );
+		if( !input.is_open() ) throw std::runtime_error( "Couldn't open \""+std::string(argv[1])+"\"" );
+		if( !descriptorSet.ParseFromIstream(&input) ) throw std::runtime_error( "Couldn't parse \""+std::string(argv[1])+"\" as a FileDescriptorSet" );
+
+		// protoc puts dependencies before the files that import them, so they can be built in order
+		google::protobuf::DescriptorPool pool;
+		for( const auto& fileProto : descriptorSet.file() )
+		{
+			if( pool.BuildFile(fileProto)==nullptr ) throw std::runtime_error( "Couldn't build the descriptor for \""+fileProto.name()+"\"" );
+		}
+
+		const std::string outputDirectory=argv[2];
+		for( int index=3; index<argc; ++index )
+		{
+			const google::protobuf::FileDescriptor* pFile=pool.FindFileByName( argv[index] );
+			if( pFile==nullptr ) throw std::runtime_error( "\""+std::string(argv[index])+"\" is not in the descriptor set" );
+
+			::checkServices( pFile );
+			const std::string outputBase=outputDirectory+"/"+::baseName( pFile->name() );
+			::writeFile( outputBase+".rpc.h", [pFile](std::ostream& output){ ::writeHeader( pFile, output ); } );
+			::writeFile( outputBase+".rpc.cc", [pFile](std::ostream& output){ ::writeSource( pFile, output ); } );
+		}
+	}
+	catch( std::exception& error )
+	{
+		std::cerr << argv[0] << ": " << error.what() << std::endl;
+		return -1;
+	}
+
+	return 0;
+}
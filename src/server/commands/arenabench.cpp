@@ -0,0 +1,187 @@
+#include "tools/ISubExecutable.h"
+
+class ArenaBenchmarkSubExe : public tools::ISubExecutable
+{
+public:
+	virtual int run( int argc, char* argv[] );
+};
+
+#include "tools/SubExecutableRegister.h"
+#include "tools/CommandLineParser.h"
+#include "tools/LatencyRecorder.h"
+#include "clientserver/BenchmarkService.rpc.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+
+REGISTER_MODULE( ArenaBenchmarkSubExe, "arenabench" );
+
+namespace // Unnamed namespace for things only used in this file
+{
+	// Set while a request is being timed, so that only the allocations made handling it are counted
+	thread_local bool countAllocations=false;
+	thread_local size_t numberOfAllocations=0;
+} // end of the unnamed namespace
+
+// Replacements for the global allocation functions that behave the same as the default ones, but
+// can count calls. There's no portable malloc hook, and everything protobuf and std::string allocate
+// comes through here (or ArenaBlockPool, which also uses operator new).
+void* operator new( size_t size )
+{
+	if( countAllocations ) ++numberOfAllocations;
+	void* pMemory=std::malloc( size==0 ? 1 : size );
+	if( pMemory==nullptr ) throw std::bad_alloc();
+	return pMemory;
+}
+
+void operator delete( void* pMemory ) noexcept
+{
+	std::free( pMemory );
+}
+
+namespace // Unnamed namespace for things only used in this file
+{
+	class BenchmarkServiceImplementation : public clientserver::BenchmarkService
+	{
+	public:
+		virtual void Summarise( const clientserver::Document& request, clientserver::DocumentSummary& response, std::weak_ptr<clientserver::IConnection> pConnection ) override
+		{
+			uint32_t totalWords=0;
+			for( const auto& section : request.sections() )
+			{
+				clientserver::SectionSummary* pSummary=response.add_sections();
+				pSummary->set_title( section.title() );
+				pSummary->set_number_of_words( numberOfWords(section) );
+				totalWords+=pSummary->number_of_words();
+			}
+			response.set_name( request.name() );
+			response.set_number_of_words( totalWords );
+		}
+	protected:
+		static uint32_t numberOfWords( const clientserver::Section& section )
+		{
+			uint32_t result=0;
+			for( const auto& paragraph : section.paragraphs() ) result+=paragraph.words_size();
+			for( const auto& subsection : section.subsections() ) result+=numberOfWords( subsection );
+			return result;
+		}
+	};
+
+	/** @brief A document with the given number of everything, with words long enough not to fit in the small string buffer. */
+	clientserver::Document createDocument( size_t numberOfSections, size_t numberOfSubsections, size_t numberOfParagraphs, size_t numberOfWords )
+	{
+		clientserver::Document document;
+		document.set_name( "Benchmark document" );
+		uint32_t paragraphId=0;
+		auto fillSection=[&](clientserver::Section* pSection,const std::string& title)
+			{
+				pSection->set_title( title );
+				for( size_t paragraph=0; paragraph<numberOfParagraphs; ++paragraph )
+				{
+					clientserver::Paragraph* pParagraph=pSection->add_paragraphs();
+					pParagraph->set_id( ++paragraphId );
+					for( size_t word=0; word<numberOfWords; ++word ) pParagraph->add_words( "antidisestablishmentarianism"+std::to_string(word) );
+				}
+			};
+		for( size_t section=0; section<numberOfSections; ++section )
+		{
+			clientserver::Section* pSection=document.add_sections();
+			fillSection( pSection, "The title of section number "+std::to_string(section) );
+			for( size_t subsection=0; subsection<numberOfSubsections; ++subsection )
+			{
+				fillSection( pSection->add_subsections(), "The title of subsection number "+std::to_string(subsection) );
+			}
+		}
+		return document;
+	}
+} // end of the unnamed namespace
+
+int ArenaBenchmarkSubExe::run( int argc, char* argv[] )
+{
+	size_t numberOfRequests=100000;
+
+	//
+	// Try and parse the command line arguments
+	//
+	try
+	{
+		tools::CommandLineParser commandLineParser;
+		commandLineParser.addOption( "help", tools::CommandLineParser::NoArgument );
+		commandLineParser.addOption( "count", tools::CommandLineParser::RequiredArgument );
+
+		commandLineParser.parse( argc, argv );
+
+		if( commandLineParser.optionHasBeenSet("help") )
+		{
+			std::cout << "Usage:" << "\n"
+					  << "  " << commandLineParser.executableName() << " [command options]" << "\n"
+					  << "\n"
+					  << "Calls a protobuf RPC method with nested messages directly through the dispatcher, with and without" << "\n"
+					  << "per request arenas, and reports the heap allocations and latency for each request." << "\n"
+					  << "\n"
+					  << "Available options:" << "\n"
+					  << "  --help      Display this help message and exit" << "\n"
+					  << "  --count     The number of requests for each test. Default is " << numberOfRequests << "." << "\n"
+					  << std::endl;
+			return 0;
+		}
+
+		if( commandLineParser.optionHasBeenSet("count") ) numberOfRequests=tools::parseSizeOption( commandLineParser, "count" );
+		if( numberOfRequests==0 ) throw std::runtime_error( "The count must be at least one" );
+	} // end of parsing arguments try block
+	catch( std::exception& error )
+	{
+		std::cerr << "The following error was encountered while parsing the command line:" << "\n"
+		          << "     " << error.what() << "\n"
+				  << "Try \"--help\" for usage instructions." << std::endl;
+		return -1;
+	}
+
+	struct DocumentShape { const char* name; size_t sections; size_t subsections; size_t paragraphs; size_t words; };
+	const DocumentShape shapes[]={ { "small", 1, 0, 2, 4 }, { "medium", 4, 2, 4, 8 }, { "large", 16, 4, 8, 16 } };
+
+	::BenchmarkServiceImplementation service;
+	std::cout << "Requests per test: " << numberOfRequests << "\n"
+	          << "document  arenas   bytes  allocs/req   mean us    p50 us    p99 us  p99.9 us" << std::endl;
+
+	for( const auto& shape : shapes )
+	{
+		std::string request;
+		clientserver::RpcCodec::encodeRequest( clientserver::BenchmarkService::SummariseMethodId, ::createDocument( shape.sections, shape.subsections, shape.paragraphs, shape.words ), request );
+
+		for( const bool useArenas : { false, true } )
+		{
+			clientserver::RpcDispatcher dispatcher;
+			dispatcher.setUseArenas( useArenas );
+			service.addMethodsTo( dispatcher );
+
+			// Warm up, which also fills the arena block pool
+			for( size_t index=0; index<1000; ++index ) dispatcher.handleRequest( request, std::weak_ptr<clientserver::IConnection>() );
+
+			tools::LatencyRecorder latencies;
+			latencies.reserve( numberOfRequests );
+			numberOfAllocations=0;
+			for( size_t index=0; index<numberOfRequests; ++index )
+			{
+				const auto startTime=std::chrono::steady_clock::now();
+				countAllocations=true;
+				const std::string response=dispatcher.handleRequest( request, std::weak_ptr<clientserver::IConnection>() );
+				countAllocations=false;
+				latencies.record( std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now()-startTime).count() );
+				if( response.empty() || response[0]!=static_cast<char>(clientserver::RpcStatus::ok) ) throw std::logic_error( "The benchmark request failed" );
+			}
+
+			std::cout << std::left << std::setw(10) << shape.name << std::setw(6) << (useArenas ? "on" : "off") << std::right
+			          << std::setw(8) << request.size()
+			          << std::setw(12) << std::fixed << std::setprecision(1) << static_cast<double>(numberOfAllocations)/numberOfRequests
+			          << std::setw(10) << std::setprecision(2) << latencies.mean()/1e3
+			          << std::setw(10) << latencies.percentile(0.5)/1e3
+			          << std::setw(10) << latencies.percentile(0.99)/1e3
+			          << std::setw(10) << latencies.percentile(0.999)/1e3 << std::endl;
+		}
+	}
+
+	return 0;
+}
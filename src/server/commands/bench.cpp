@@ -0,0 +1,307 @@
+#include "tools/ISubExecutable.h"
+
+class BenchmarkSubExe : public tools::ISubExecutable
+{
+public:
+	virtual int run( int argc, char* argv[] );
+};
+
+#include "tools/SubExecutableRegister.h"
+#include "tools/CommandLineParser.h"
+#include "tools/LatencyRecorder.h"
+#include "clientserver/SharedMemoryServer.h"
+#include "clientserver/SharedMemoryClient.h"
+#include "clientserver/TcpServer.h"
+#include "clientserver/TcpClient.h"
+#include "clientserver/WebSocketServer.h"
+#include "clientserver/Client.h"
+#include "clientserver/NativeClientTransport.h"
+#include <communique/Server.h>
+#include <communique/Client.h>
+#include <iostream>
+#include <iomanip>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <unistd.h>
+
+REGISTER_MODULE( BenchmarkSubExe, "bench" );
+
+namespace // Unnamed namespace for things only used in this file
+{
+	/** @brief Common signature of the sendRequest methods of all the clients, so that one loop can drive any of them. */
+	typedef std::function<void(const std::string&,std::function<void(const std::string&)>)> SendRequestFunction;
+
+	/** @brief Sends numberOfMessages requests keeping at most "window" in flight, and prints the throughput and latency. */
+	void runBenchmark( SendRequestFunction sendRequest, const std::string& transportName, size_t numberOfMessages, size_t messageSize, size_t window )
+	{
+		const std::string payload( messageSize, 'x' );
+		std::vector<std::chrono::steady_clock::time_point> sendTimes( numberOfMessages );
+		tools::LatencyRecorder latencies;
+		latencies.reserve( numberOfMessages );
+		std::atomic<size_t> numberCompleted(0);
+		size_t numberWrong=0;
+
+		const auto startTime=std::chrono::steady_clock::now();
+		for( size_t index=0; index<numberOfMessages; ++index )
+		{
+			while( index-numberCompleted.load(std::memory_order_acquire)>=window ) std::this_thread::yield();
+
+			sendTimes[index]=std::chrono::steady_clock::now();
+			sendRequest( payload, [&,index](const std::string& response)
+				{
+					// All the clients call handlers from a single receive thread, so no locking needed for the recorder
+					latencies.record( std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now()-sendTimes[index]).count() );
+					// A round trip that doesn't bring the payload back would make the numbers meaningless
+					if( response.size()!=messageSize ) ++numberWrong;
+					numberCompleted.fetch_add( 1, std::memory_order_release );
+				});
+		}
+		while( numberCompleted.load(std::memory_order_acquire)<numberOfMessages ) std::this_thread::yield();
+		const double elapsedSeconds=std::chrono::duration<double>(std::chrono::steady_clock::now()-startTime).count();
+
+		std::cout << std::left << std::setw(11) << transportName << std::right
+		          << std::setw(9) << messageSize
+		          << std::setw(12) << static_cast<size_t>(numberOfMessages/elapsedSeconds)
+		          << std::setw(11) << std::fixed << std::setprecision(1) << numberOfMessages*messageSize/elapsedSeconds/1e6
+		          << std::setw(10) << latencies.mean()/1e3
+		          << std::setw(10) << latencies.percentile(0.5)/1e3
+		          << std::setw(10) << latencies.percentile(0.99)/1e3
+		          << std::setw(10) << latencies.percentile(0.999)/1e3
+		          << std::setw(10) << latencies.maximum()/1e3 << std::endl;
+		if( numberWrong!=0 ) std::cerr << numberWrong << " of the " << transportName << " responses were not the same size as the request, so the server is probably not echoing" << std::endl;
+	}
+} // end of the unnamed namespace
+
+int BenchmarkSubExe::run( int argc, char* argv[] )
+{
+	std::vector<std::string> transports={ "shm", "tcp", "websocket" };
+	std::vector<size_t> messageSizes={ 64, 65536 };
+	std::string host;
+	size_t tcpPort=0;
+	size_t webSocketPort=9003;
+	std::string socketPath;
+	std::string keyFilename;
+	std::string certificateFilename;
+	bool useTls=false;
+	size_t numberOfMessages=100000;
+	size_t window=64;
+	size_t busyPollIterations=0;
+	std::string engine="communique";
+	size_t numberOfThreads=0;
+
+	//
+	// Try and parse the command line arguments
+	//
+	try
+	{
+		tools::CommandLineParser commandLineParser;
+		commandLineParser.addOption( "help", tools::CommandLineParser::NoArgument );
+		commandLineParser.addOption( "transport", tools::CommandLineParser::RequiredArgument );
+		commandLineParser.addOption( "host", tools::CommandLineParser::RequiredArgument );
+		commandLineParser.addOption( "tcpport", tools::CommandLineParser::RequiredArgument );
+		commandLineParser.addOption( "port", tools::CommandLineParser::RequiredArgument );
+		commandLineParser.addOption( "socket", tools::CommandLineParser::RequiredArgument );
+		commandLineParser.addOption( "tls", tools::CommandLineParser::NoArgument );
+		commandLineParser.addOption( "cert", tools::CommandLineParser::RequiredArgument );
+		commandLineParser.addOption( "key", tools::CommandLineParser::RequiredArgument );
+		commandLineParser.addOption( "count", tools::CommandLineParser::RequiredArgument );
+		commandLineParser.addOption( "size", tools::CommandLineParser::RequiredArgument );
+		commandLineParser.addOption( "window", tools::CommandLineParser::RequiredArgument );
+		commandLineParser.addOption( "busypoll", tools::CommandLineParser::RequiredArgument );
+		commandLineParser.addOption( "engine", tools::CommandLineParser::RequiredArgument );
+		commandLineParser.addOption( "threads", tools::CommandLineParser::RequiredArgument );
+
+		commandLineParser.parse( argc, argv );
+
+		if( commandLineParser.optionHasBeenSet("help") )
+		{
+			std::cout << "Usage:" << "\n"
+					  << "  " << commandLineParser.executableName() << " [command options]" << "\n"
+					  << "\n"
+					  << "Sends echo requests as fast as possible over each transport and reports the throughput and round trip latency." << "\n"
+					  << "Unless --host or --socket are given, echo servers are started in this process." << "\n"
+					  << "\n"
+					  << "Available options:" << "\n"
+					  << "  --help      Display this help message and exit" << "\n"
+					  << "  --transport One of \"shm\", \"tcp\" or \"websocket\". Can be given more than once. Default is all of them." << "\n"
+					  << "  --host      The host of a server started with \"listen\" to use for the tcp and websocket transports." << "\n"
+					  << "  --tcpport   The port for the tcp transport, i.e. the \"--tcpport\" given to listen. Required with --host." << "\n"
+					  << "  --port      The port for the websocket transport. Default is " << webSocketPort << "." << "\n"
+					  << "  --socket    The Unix socket of a server started with \"listen --shm\" to use for the shm transport." << "\n"
+					  << "  --tls       Use TLS for the tcp and websocket transports. The server's certificate is not verified." << "\n"
+					  << "  --cert      Certificate for the local servers to use with --tls." << "\n"
+					  << "  --key       Key for the local servers to use with --tls." << "\n"
+					  << "  --count     The number of requests to send for each test. Default is " << numberOfMessages << "." << "\n"
+					  << "  --size      The size of each request in bytes. Can be given more than once. Default is 64 and 65536." << "\n"
+					  << "  --window    The maximum number of requests in flight at once. Default is " << window << "." << "\n"
+					  << "  --busypoll  The number of times shm connections check for messages before sleeping. Default is " << busyPollIterations << "." << "\n"
+					  << "  --engine    The WebSocket implementation for the websocket transport, either \"communique\" or \"native\". Default is " << engine << "." << "\n"
+					  << "              With \"native\" the in-tree client library is used." << "\n"
+					  << "  --threads   The number of event loops for a local native engine. Default is one for each core." << "\n"
+					  << std::endl;
+			return 0;
+		}
+
+		if( commandLineParser.optionHasBeenSet("transport") )
+		{
+			transports=commandLineParser.optionArguments("transport");
+			for( const auto& transport : transports )
+			{
+				if( transport!="shm" && transport!="tcp" && transport!="websocket" ) throw std::runtime_error( "Unknown transport \""+transport+"\"" );
+			}
+		}
+		if( commandLineParser.optionHasBeenSet("size") )
+		{
+			messageSizes.clear();
+			for( const auto& sizeAsString : commandLineParser.optionArguments("size") )
+			{
+				size_t pos;
+				messageSizes.push_back( std::stoull(sizeAsString,&pos) );
+				if( pos!=sizeAsString.size() ) throw std::runtime_error( "Couldn't convert the argument for --size (\""+sizeAsString+"\") to an integer" );
+			}
+		}
+		if( commandLineParser.optionHasBeenSet("host") ) host=commandLineParser.optionArguments("host").back();
+		if( commandLineParser.optionHasBeenSet("tcpport") ) tcpPort=tools::parseSizeOption( commandLineParser, "tcpport" );
+		if( commandLineParser.optionHasBeenSet("port") ) webSocketPort=tools::parseSizeOption( commandLineParser, "port" );
+		if( commandLineParser.optionHasBeenSet("socket") ) socketPath=commandLineParser.optionArguments("socket").back();
+		if( commandLineParser.optionHasBeenSet("key") ) keyFilename=commandLineParser.optionArguments("key").back();
+		if( commandLineParser.optionHasBeenSet("cert") ) certificateFilename=commandLineParser.optionArguments("cert").back();
+		useTls=commandLineParser.optionHasBeenSet("tls");
+		if( commandLineParser.optionHasBeenSet("count") ) numberOfMessages=tools::parseSizeOption( commandLineParser, "count" );
+		if( commandLineParser.optionHasBeenSet("window") ) window=tools::parseSizeOption( commandLineParser, "window" );
+		if( commandLineParser.optionHasBeenSet("busypoll") ) busyPollIterations=tools::parseSizeOption( commandLineParser, "busypoll" );
+		if( commandLineParser.optionHasBeenSet("engine") ) engine=commandLineParser.optionArguments("engine").back();
+		if( commandLineParser.optionHasBeenSet("threads") ) numberOfThreads=tools::parseSizeOption( commandLineParser, "threads" );
+		if( engine!="communique" && engine!="native" ) throw std::runtime_error( "Unknown engine \""+engine+"\"" );
+		if( window==0 ) throw std::runtime_error( "The window must be at least one" );
+		if( !host.empty() && tcpPort==0 && std::find(transports.begin(),transports.end(),"tcp")!=transports.end() ) throw std::runtime_error( "--tcpport is required with --host" );
+		if( host.empty() && useTls && (keyFilename.empty() || certificateFilename.empty()) ) throw std::runtime_error( "--cert and --key are required for the local servers to use TLS" );
+	} // end of parsing arguments try block
+	catch( std::exception& error )
+	{
+		std::cerr << "The following error was encountered while parsing the command line:" << "\n"
+		          << "     " << error.what() << "\n"
+				  << "Try \"--help\" for usage instructions." << std::endl;
+		return -1;
+	}
+
+	auto echoRequest=[](const std::string& message)->std::string{ return message; };
+
+	std::cout << "Requests per test: " << numberOfMessages << ", window " << window << (useTls ? ", TLS" : "") << "\n"
+	          << "transport       size  requests/s       MB/s   mean us    p50 us    p99 us  p99.9 us    max us" << std::endl;
+
+	for( const auto& transport : transports )
+	{
+		if( transport=="shm" )
+		{
+			clientserver::SharedMemoryServer localServer;
+			std::string path=socketPath;
+			if( path.empty() )
+			{
+				path="/tmp/clientserver-bench-"+std::to_string(::getpid())+".sock";
+				localServer.setBusyPollIterations( busyPollIterations );
+				localServer.setDefaultRequestHandler( [&](const std::string& message,std::weak_ptr<clientserver::IConnection> pConnection){ return echoRequest(message); } );
+				localServer.listen( path );
+			}
+
+			clientserver::SharedMemoryClient client;
+			client.setBusyPollIterations( busyPollIterations );
+			client.connect( path );
+			for( const auto messageSize : messageSizes )
+			{
+				runBenchmark( [&](const std::string& message,std::function<void(const std::string&)> handler){ client.sendRequest(message,handler); },
+					transport, numberOfMessages, messageSize, window );
+			}
+		}
+		else if( transport=="tcp" )
+		{
+			clientserver::TcpServer localServer;
+			std::string serverHost=host;
+			size_t port=tcpPort;
+			if( serverHost.empty() )
+			{
+				serverHost="localhost";
+				if( useTls )
+				{
+					localServer.setCertificateChainFile( certificateFilename );
+					localServer.setPrivateKeyFile( keyFilename );
+				}
+				localServer.setDefaultRequestHandler( [&](const std::string& message,std::weak_ptr<clientserver::IConnection> pConnection){ return echoRequest(message); } );
+				localServer.listen( tcpPort );
+				port=localServer.port();
+			}
+
+			clientserver::TcpClient client;
+			if( useTls ) client.enableTls( std::string(), false );
+			client.connect( serverHost, port );
+			for( const auto messageSize : messageSizes )
+			{
+				runBenchmark( [&](const std::string& message,std::function<void(const std::string&)> handler){ client.sendRequest(message,handler); },
+					transport, numberOfMessages, messageSize, window );
+			}
+		}
+		else if( transport=="websocket" && engine=="native" )
+		{
+			clientserver::WebSocketServer localServer;
+			std::string serverHost=host;
+			size_t port=webSocketPort;
+			if( serverHost.empty() )
+			{
+				serverHost="localhost";
+				if( useTls )
+				{
+					localServer.setCertificateChainFile( certificateFilename );
+					localServer.setPrivateKeyFile( keyFilename );
+				}
+				localServer.setNumberOfThreads( numberOfThreads );
+				localServer.setDefaultRequestHandler( [&](const std::string& message,std::weak_ptr<clientserver::IConnection> pConnection){ return echoRequest(message); } );
+				localServer.listen( webSocketPort );
+				port=localServer.port();
+			}
+
+			std::unique_ptr<clientserver::NativeClientTransport> pTransport( new clientserver::NativeClientTransport );
+			pTransport->setTlsVerification( std::string(), false );
+			clientserver::Client client( std::move(pTransport) );
+			// The benchmark keeps its own window, so the client's mustn't be the limit
+			client.setRequestWindow( window );
+			client.connect( (useTls ? "wss://" : "ws://")+serverHost+":"+std::to_string(port) );
+			if( !client.waitUntilConnected( std::chrono::seconds(10) ) ) throw std::runtime_error( "Couldn't connect to the native WebSocket server" );
+			for( const auto messageSize : messageSizes )
+			{
+				runBenchmark( [&](const std::string& message,std::function<void(const std::string&)> handler){ client.sendRequest(message,handler); },
+					"native-ws", numberOfMessages, messageSize, window );
+			}
+		}
+		else if( transport=="websocket" )
+		{
+			communique::Server localServer;
+			std::string serverHost=host;
+			if( serverHost.empty() )
+			{
+				serverHost="localhost";
+				if( useTls )
+				{
+					localServer.setCertificateChainFile( certificateFilename );
+					localServer.setPrivateKeyFile( keyFilename );
+				}
+				localServer.setDefaultRequestHandler( [&](const std::string& message,std::weak_ptr<communique::IConnection> pConnection){ return echoRequest(message); } );
+				localServer.listen( webSocketPort );
+			}
+
+			communique::Client client;
+			client.connect( (useTls ? "wss://" : "ws://")+serverHost+":"+std::to_string(webSocketPort) );
+			for( const auto messageSize : messageSizes )
+			{
+				runBenchmark( [&](const std::string& message,std::function<void(const std::string&)> handler){ client.sendRequest(message,handler); },
+					transport, numberOfMessages, messageSize, window );
+			}
+			client.disconnect();
+			if( host.empty() ) localServer.stop();
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,154 @@
+#include "tools/ISubExecutable.h"
+
+class KernelBenchmarkSubExe : public tools::ISubExecutable
+{
+public:
+	virtual int run( int argc, char* argv[] );
+};
+
+#include "tools/SubExecutableRegister.h"
+#include "tools/CommandLineParser.h"
+#include "clientserver/WebSocketKernels.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <functional>
+#include <random>
+#include <vector>
+
+REGISTER_MODULE( KernelBenchmarkSubExe, "kernelbench" );
+
+namespace // Unnamed namespace for things only used in this file
+{
+	/** @brief Calls the kernel repeatedly for at least the given time, and returns the throughput in GB/s. */
+	double measureThroughput( std::function<void()> kernel, size_t bytesPerCall, double minimumSeconds )
+	{
+		kernel(); // Warm up the caches
+		size_t numberOfCalls=0;
+		size_t callsPerCheck=1;
+		const auto startTime=std::chrono::steady_clock::now();
+		double elapsedSeconds=0;
+		do
+		{
+			for( size_t index=0; index<callsPerCheck; ++index ) kernel();
+			numberOfCalls+=callsPerCheck;
+			// Check the time less often as the calls get quicker, so that the clock isn't what's measured
+			if( callsPerCheck<1024 ) callsPerCheck*=2;
+			elapsedSeconds=std::chrono::duration<double>(std::chrono::steady_clock::now()-startTime).count();
+		} while( elapsedSeconds<minimumSeconds );
+
+		return numberOfCalls*bytesPerCall/elapsedSeconds/1e9;
+	}
+
+	/** @brief Text with a mixture of one to four byte UTF-8 sequences, to exercise the slow paths. */
+	std::string createMixedText( size_t size )
+	{
+		const std::string sample="Hello wörld, ¿qué tal? Привет мир. 你好世界 😀✓ ";
+		std::string text;
+		text.reserve( size+sample.size() );
+		while( text.size()<size ) text+=sample;
+		// Chop back to the last complete code point at or before the requested size
+		size_t end=size;
+		while( end>0 && end<text.size() && (static_cast<unsigned char>(text[end]) & 0xc0)==0x80 ) --end;
+		text.resize( end );
+		return text;
+	}
+} // end of the unnamed namespace
+
+int KernelBenchmarkSubExe::run( int argc, char* argv[] )
+{
+	std::vector<size_t> sizes={ 16, 64, 256, 1024, 4096, 65536, 1048576, 16777216 };
+	double minimumSeconds=0.2;
+
+	//
+	// Try and parse the command line arguments
+	//
+	try
+	{
+		tools::CommandLineParser commandLineParser;
+		commandLineParser.addOption( "help", tools::CommandLineParser::NoArgument );
+		commandLineParser.addOption( "size", tools::CommandLineParser::RequiredArgument );
+		commandLineParser.addOption( "time", tools::CommandLineParser::RequiredArgument );
+
+		commandLineParser.parse( argc, argv );
+
+		if( commandLineParser.optionHasBeenSet("help") )
+		{
+			std::cout << "Usage:" << "\n"
+					  << "  " << commandLineParser.executableName() << " [command options]" << "\n"
+					  << "\n"
+					  << "Measures the throughput of the WebSocket unmasking and UTF-8 validation kernels for every" << "\n"
+					  << "instruction set this CPU supports." << "\n"
+					  << "\n"
+					  << "Available options:" << "\n"
+					  << "  --help      Display this help message and exit" << "\n"
+					  << "  --size      The payload size in bytes. Can be given more than once. Default is 16 bytes to 16MiB." << "\n"
+					  << "  --time      The minimum time in milliseconds to run each test for. Default is " << minimumSeconds*1000 << "." << "\n"
+					  << std::endl;
+			return 0;
+		}
+
+		if( commandLineParser.optionHasBeenSet("size") )
+		{
+			sizes.clear();
+			for( const auto& sizeAsString : commandLineParser.optionArguments("size") )
+			{
+				size_t pos;
+				sizes.push_back( std::stoull(sizeAsString,&pos) );
+				if( pos!=sizeAsString.size() || sizes.back()==0 ) throw std::runtime_error( "Couldn't convert the argument for --size (\""+sizeAsString+"\") to a positive integer" );
+			}
+		}
+		if( commandLineParser.optionHasBeenSet("time") ) minimumSeconds=tools::parseSizeOption( commandLineParser, "time" )/1000.0;
+	} // end of parsing arguments try block
+	catch( std::exception& error )
+	{
+		std::cerr << "The following error was encountered while parsing the command line:" << "\n"
+		          << "     " << error.what() << "\n"
+				  << "Try \"--help\" for usage instructions." << std::endl;
+		return -1;
+	}
+
+	const auto instructionSets=clientserver::supportedInstructionSets();
+	const uint8_t mask[4]={ 0x37, 0xfa, 0x21, 0x3d };
+	std::mt19937 generator( 42 );
+
+	std::cout << "Throughput in GB/s" << "\n"
+	          << "kernel          size";
+	for( const auto instructionSet : instructionSets ) std::cout << std::setw(10) << clientserver::instructionSetName(instructionSet);
+	std::cout << std::endl;
+
+	for( const std::string kernelName : { "mask", "utf8-ascii", "utf8-mixed" } )
+	{
+		for( const auto size : sizes )
+		{
+			std::string data;
+			if( kernelName=="mask" )
+			{
+				data.resize( size );
+				for( auto& character : data ) character=static_cast<char>( generator() );
+			}
+			else if( kernelName=="utf8-ascii" ) data.assign( size, 'x' );
+			else data=::createMixedText( size );
+
+			std::cout << std::left << std::setw(12) << kernelName << std::right << std::setw(8) << data.size() << std::flush;
+			for( const auto instructionSet : instructionSets )
+			{
+				double gigabytesPerSecond;
+				if( kernelName=="mask" )
+				{
+					gigabytesPerSecond=::measureThroughput( [&]{ clientserver::applyWebSocketMask( instructionSet, &data[0], data.size(), mask ); }, data.size(), minimumSeconds );
+				}
+				else
+				{
+					bool isValid=true;
+					gigabytesPerSecond=::measureThroughput( [&]{ isValid&=clientserver::isValidUtf8( instructionSet, data.data(), data.size() ); }, data.size(), minimumSeconds );
+					if( !isValid ) throw std::logic_error( "The benchmark text was not valid UTF-8" );
+				}
+				std::cout << std::setw(10) << std::fixed << std::setprecision(2) << gigabytesPerSecond << std::flush;
+			}
+			std::cout << std::endl;
+		}
+	}
+
+	return 0;
+}
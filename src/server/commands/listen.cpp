@@ -8,19 +8,334 @@ public:
 
 #include "tools/SubExecutableRegister.h"
 #include "tools/CommandLineParser.h"
+#include "clientserver/SharedMemoryServer.h"
+#include "clientserver/TcpServer.h"
+#include "clientserver/WebSocketServer.h"
+#include "clientserver/SocketHandover.h"
+#include "clientserver/CpuTopology.h"
+#include "clientserver/ConnectionRegistry.h"
+#include "clientserver/RateLimiter.h"
+#include "clientserver/AdmissionController.h"
+#include "clientserver/ZstdDictionary.h"
+#include "clientserver/ListenService.rpc.h"
 #include <communique/Server.h>
 #include <iostream>
+#include <fstream>
+#include <sstream>
 #include <mutex>
-#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <system_error>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <sys/signalfd.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
 
 REGISTER_MODULE( ListenSubExe, "listen" );
 
+namespace // Unnamed namespace for things only used in this file
+{
+	/** @brief The RPC version of the default echo handler, plus some statistics. */
+	class ListenServiceImplementation : public clientserver::ListenService
+	{
+	public:
+		ListenServiceImplementation( const clientserver::RpcDispatcher& dispatcher )
+			: startTime_(std::chrono::steady_clock::now()), dispatcher_(dispatcher)
+		{
+			// No operation besides the initialiser list
+		}
+		virtual void Echo( const clientserver::EchoRequest& request, clientserver::EchoResponse& response, std::weak_ptr<clientserver::IConnection> pConnection ) override
+		{
+			response.set_payload( request.payload() );
+		}
+		virtual void Status( const clientserver::StatusRequest& request, clientserver::StatusResponse& response, std::weak_ptr<clientserver::IConnection> pConnection ) override
+		{
+			response.set_uptime_milliseconds( std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now()-startTime_).count() );
+			response.set_requests_handled( dispatcher_.requestsHandled() );
+		}
+	protected:
+		std::chrono::steady_clock::time_point startTime_;
+		const clientserver::RpcDispatcher& dispatcher_;
+	};
+
+	/** @brief Example streaming handler, where a request of "<count> <text>" gets the text back as count chunks.
+	 *
+	 * Chunks are only written as fast as the client takes them, carrying on from the writable handler
+	 * whenever write() says the client has fallen behind.
+	 */
+	void startRepeating( const std::string& request, std::shared_ptr<clientserver::IResponseStream> pStream )
+	{
+		size_t position;
+		const unsigned long count=std::stoul( request, &position );
+		if( position>=request.size() || request[position]!=' ' ) throw std::invalid_argument( "Streaming requests should be \"<count> <text>\"" );
+
+		auto pRemaining=std::make_shared<unsigned long>( count );
+		const std::string text=request.substr( position+1 );
+		auto writeChunks=[pStream,pRemaining,text]()
+			{
+				while( *pRemaining>0 )
+				{
+					--*pRemaining;
+					if( !pStream->write( text ) ) return;
+				}
+				pStream->finish();
+			};
+		pStream->setWritableHandler( writeChunks );
+		writeChunks();
+	}
+
+	/** @brief Prints how many messages each limit has rejected, if any more have been since the last time. */
+	void printRateLimits( const clientserver::RateLimiter& rateLimiter, uint64_t& lastRejections )
+	{
+		typedef clientserver::RateLimiter::Verdict Verdict;
+		const Verdict limits[]={ Verdict::connectionMessages, Verdict::connectionBytes, Verdict::addressMessages, Verdict::addressBytes };
+		uint64_t totalRejections=0;
+		for( const auto limit : limits ) totalRejections+=rateLimiter.rejections( limit );
+		if( totalRejections==lastRejections ) return;
+		lastRejections=totalRejections;
+
+		std::cout << "Rate limited " << totalRejections << " messages:";
+		for( const auto limit : limits ) std::cout << " " << rateLimiter.rejections( limit ) << " by " << clientserver::RateLimiter::name( limit ) << ",";
+		std::cout << " " << rateLimiter.numberOfAddresses() << " addresses tracked" << std::endl;
+	}
+
+	/** @brief Prints how much work has been shed, if any more has been since the last time. */
+	void printShedding( const clientserver::AdmissionController& admissionController, uint64_t& lastShed )
+	{
+		typedef clientserver::AdmissionController::Priority Priority;
+		const uint64_t totalShed=admissionController.shed( Priority::normal )+admissionController.shed( Priority::low );
+		if( totalShed==lastShed ) return;
+		lastShed=totalShed;
+
+		std::cout << "Overloaded, shed " << admissionController.shed( Priority::normal ) << " requests and "
+		          << admissionController.shed( Priority::low ) << " batch requests" << (admissionController.isOverloaded() ? "" : ", now recovered") << std::endl;
+	}
+
+	/** @brief Exit status of a worker that couldn't start listening, which the supervisor stops for rather than restarting it. */
+	const int workerStartFailure=3;
+
+	/** @brief What the supervisor knows about one of the worker processes. */
+	struct Worker
+	{
+		pid_t pid; ///< Zero if the worker isn't running
+		std::chrono::steady_clock::time_point startTime; ///< When it was started, or when it should be restarted if it isn't running
+		uint64_t requests; ///< The last numbers the worker reported
+		uint64_t connections;
+	};
+
+	/** @brief Forks numberOfWorkers copies of this process each pinned to a core, and restarts any that crash.
+	 *
+	 * The workers carry on from where this returns, with workerIndex set and metricsFd open to write
+	 * "<index> <requests> <connections>" lines to. Lines that short are written to a pipe in one
+	 * piece, so all of the workers can share it. The supervisor stays in here adding up what they
+	 * report, and only returns once a worker exits cleanly (i.e. was told to quit) or couldn't start,
+	 * or a signal arrives on signalFd, after stopping all of the others. They're stopped with
+	 * SIGTERM, so they drain their connections first.
+	 *
+	 * @return  True in the workers, false in the supervisor once everything has stopped.
+	 */
+	bool superviseWorkers( size_t numberOfWorkers, int signalFd, size_t& workerIndex, int& metricsFd, int& exitCode )
+	{
+		int metricsPipe[2];
+		if( ::pipe2( metricsPipe, O_CLOEXEC )!=0 ) throw std::system_error( errno, std::system_category(), "Couldn't create a pipe for the workers" );
+
+		// Only use the cores this process is allowed on, e.g. if started under taskset
+		std::vector<int> cores;
+		cpu_set_t allowedCores;
+		CPU_ZERO( &allowedCores );
+		if( ::sched_getaffinity( 0, sizeof(allowedCores), &allowedCores )==0 )
+		{
+			for( int core=0; core<CPU_SETSIZE; ++core ) if( CPU_ISSET(core,&allowedCores) ) cores.push_back( core );
+		}
+
+		const pid_t supervisorPid=::getpid();
+		std::vector<::Worker> workers( numberOfWorkers, ::Worker{ 0, std::chrono::steady_clock::now(), 0, 0 } );
+		uint64_t retiredRequests=0; // Requests handled by workers that have since exited
+		auto startWorker=[&]( size_t index )->bool
+			{
+				// Anything still buffered would be written by both processes
+				std::cout.flush();
+				std::cerr.flush();
+				const pid_t pid=::fork();
+				if( pid<0 ) throw std::system_error( errno, std::system_category(), "Couldn't fork a worker" );
+				if( pid==0 )
+				{
+					// Don't outlive the supervisor, including if it died before this was set
+					::prctl( PR_SET_PDEATHSIG, SIGTERM );
+					if( ::getppid()!=supervisorPid ) ::_exit( 0 );
+					::close( metricsPipe[0] );
+					if( !cores.empty() )
+					{
+						cpu_set_t core;
+						CPU_ZERO( &core );
+						CPU_SET( cores[index%cores.size()], &core );
+						::sched_setaffinity( 0, sizeof(core), &core );
+					}
+					workerIndex=index;
+					metricsFd=metricsPipe[1];
+					return true;
+				}
+				std::cout << "Started worker " << index << " with pid " << pid;
+				if( !cores.empty() ) std::cout << " on core " << cores[index%cores.size()];
+				std::cout << std::endl;
+				workers[index]=::Worker{ pid, std::chrono::steady_clock::now(), 0, 0 };
+				return false;
+			};
+		for( size_t index=0; index<numberOfWorkers; ++index )
+		{
+			if( startWorker(index) ) return true;
+		}
+		// The supervisor keeps the write end open too, so that the pipe never reads as closed
+
+		const std::chrono::seconds statisticsInterval(10);
+		auto lastStatisticsTime=std::chrono::steady_clock::now();
+		uint64_t lastTotalRequests=0;
+		uint64_t lastTotalConnections=0;
+		std::string unreadMetrics;
+		bool isStopping=false;
+		while( !isStopping )
+		{
+			pollfd descriptors[2]={ { metricsPipe[0], POLLIN, 0 }, { signalFd, POLLIN, 0 } };
+			if( ::poll( descriptors, 2, 1000 )>0 && descriptors[1].revents!=0 )
+			{
+				signalfd_siginfo signal;
+				if( ::read( signalFd, &signal, sizeof(signal) )==sizeof(signal) ) std::cout << "Got signal " << signal.ssi_signo << ", stopping the workers" << std::endl;
+				exitCode=0;
+				break;
+			}
+			if( descriptors[0].revents!=0 )
+			{
+				char buffer[4096];
+				const ssize_t bytesRead=::read( metricsPipe[0], buffer, sizeof(buffer) );
+				if( bytesRead>0 ) unreadMetrics.append( buffer, bytesRead );
+				size_t lineEnd;
+				while( (lineEnd=unreadMetrics.find('\n'))!=std::string::npos )
+				{
+					std::istringstream line( unreadMetrics.substr(0,lineEnd) );
+					unreadMetrics.erase( 0, lineEnd+1 );
+					size_t index;
+					uint64_t requests, connections;
+					if( line >> index >> requests >> connections && index<workers.size() && workers[index].pid!=0 )
+					{
+						workers[index].requests=requests;
+						workers[index].connections=connections;
+					}
+				}
+			}
+
+			int status;
+			pid_t pid;
+			const auto now=std::chrono::steady_clock::now();
+			while( (pid=::waitpid( -1, &status, WNOHANG ))>0 )
+			{
+				for( size_t index=0; index<workers.size(); ++index )
+				{
+					::Worker& worker=workers[index];
+					if( worker.pid!=pid ) continue;
+					retiredRequests+=worker.requests;
+					worker=::Worker{ 0, now, 0, 0 };
+					if( WIFEXITED(status) && WEXITSTATUS(status)==0 )
+					{
+						std::cout << "Worker " << index << " has quit, stopping the others" << std::endl;
+						isStopping=true;
+						exitCode=0;
+					}
+					else if( WIFEXITED(status) && WEXITSTATUS(status)==::workerStartFailure )
+					{
+						std::cerr << "Worker " << index << " couldn't start, stopping the others" << std::endl;
+						isStopping=true;
+						exitCode=-1;
+					}
+					else
+					{
+						if( WIFSIGNALED(status) ) std::cerr << "Worker " << index << " was killed by signal " << WTERMSIG(status) << ", restarting it" << std::endl;
+						else std::cerr << "Worker " << index << " exited with status " << WEXITSTATUS(status) << ", restarting it" << std::endl;
+						// Don't restart workers that crash straight away in a tight loop
+						if( now-worker.startTime<std::chrono::seconds(1) ) worker.startTime=now+std::chrono::seconds(1);
+					}
+				}
+			}
+			if( isStopping ) break;
+
+			for( size_t index=0; index<workers.size(); ++index )
+			{
+				if( workers[index].pid==0 && now>=workers[index].startTime && startWorker(index) ) return true;
+			}
+
+			if( now-lastStatisticsTime>=statisticsInterval )
+			{
+				size_t running=0;
+				uint64_t totalRequests=retiredRequests;
+				uint64_t totalConnections=0;
+				for( const auto& worker : workers )
+				{
+					if( worker.pid!=0 ) ++running;
+					totalRequests+=worker.requests;
+					totalConnections+=worker.connections;
+				}
+				if( totalRequests!=lastTotalRequests || totalConnections!=lastTotalConnections || running!=workers.size() )
+				{
+					const double seconds=std::chrono::duration<double>(now-lastStatisticsTime).count();
+					std::cout << "Workers: " << running << " of " << workers.size() << " running, " << totalConnections << " connections, "
+							  << totalRequests << " requests handled (" << static_cast<uint64_t>((totalRequests-lastTotalRequests)/seconds) << " per second)" << std::endl;
+				}
+				lastStatisticsTime=now;
+				lastTotalRequests=totalRequests;
+				lastTotalConnections=totalConnections;
+			}
+		}
+
+		for( const auto& worker : workers )
+		{
+			if( worker.pid!=0 ) ::kill( worker.pid, SIGTERM );
+		}
+		for( const auto& worker : workers )
+		{
+			if( worker.pid!=0 ) ::waitpid( worker.pid, nullptr, 0 );
+		}
+		::close( metricsPipe[0] );
+		::close( metricsPipe[1] );
+		return false;
+	}
+} // end of the unnamed namespace
+
 int ListenSubExe::run( int argc, char* argv[] )
 {
 	size_t portNumber=9002;
+	size_t tcpPortNumber=0;
 	std::string directoryToServe;
 	std::string keyFilename;
 	std::string certificateFilename;
+	std::string sharedMemorySocket;
+	size_t busyPollIterations=0;
+	std::string engine="communique";
+	size_t numberOfThreads=0;
+	size_t numberOfBatchThreads=0;
+	bool concurrentRequests=false;
+	size_t sessionReplayBufferSize=0;
+	bool useRpc=false;
+	bool useCompression=false;
+	clientserver::PerMessageDeflate::Configuration compressionConfiguration;
+	std::vector<std::string> dictionaryFilenames;
+	size_t dictionaryThreshold=clientserver::ZstdDictionaryCompressor::defaultThreshold;
+	std::string captureFilename;
+	size_t numberOfWorkers=0;
+	std::string handoverSocket;
+	size_t drainSeconds=30;
+	bool numaPlacement=false;
+	std::vector<int> eventLoopCpus;
+	std::vector<int> handlerCpus;
+	clientserver::RateLimiter::Configuration rateLimits{ { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 } };
+	size_t shedTarget=0;
+	size_t shedInterval=100;
 
 	//
 	// Try and parse the command line arguments
@@ -34,6 +349,32 @@ int ListenSubExe::run( int argc, char* argv[] )
 		commandLineParser.addOption( "httpserve", tools::CommandLineParser::RequiredArgument );
 		commandLineParser.addOption( "cert", tools::CommandLineParser::RequiredArgument );
 		commandLineParser.addOption( "key", tools::CommandLineParser::RequiredArgument );
+		commandLineParser.addOption( "tcpport", tools::CommandLineParser::RequiredArgument );
+		commandLineParser.addOption( "shm", tools::CommandLineParser::RequiredArgument );
+		commandLineParser.addOption( "busypoll", tools::CommandLineParser::RequiredArgument );
+		commandLineParser.addOption( "engine", tools::CommandLineParser::RequiredArgument );
+		commandLineParser.addOption( "threads", tools::CommandLineParser::RequiredArgument );
+		commandLineParser.addOption( "batchthreads", tools::CommandLineParser::RequiredArgument );
+		commandLineParser.addOption( "concurrent", tools::CommandLineParser::NoArgument );
+		commandLineParser.addOption( "sessions", tools::CommandLineParser::RequiredArgument );
+		commandLineParser.addOption( "rpc", tools::CommandLineParser::NoArgument );
+		commandLineParser.addOption( "compress", tools::CommandLineParser::NoArgument );
+		commandLineParser.addOption( "compressthreshold", tools::CommandLineParser::RequiredArgument );
+		commandLineParser.addOption( "nocontexttakeover", tools::CommandLineParser::NoArgument );
+		commandLineParser.addOption( "dictionary", tools::CommandLineParser::RequiredArgument );
+		commandLineParser.addOption( "capture", tools::CommandLineParser::RequiredArgument );
+		commandLineParser.addOption( "workers", tools::CommandLineParser::RequiredArgument );
+		commandLineParser.addOption( "handover", tools::CommandLineParser::RequiredArgument );
+		commandLineParser.addOption( "draintime", tools::CommandLineParser::RequiredArgument );
+		commandLineParser.addOption( "numa", tools::CommandLineParser::NoArgument );
+		commandLineParser.addOption( "loopcpus", tools::CommandLineParser::RequiredArgument );
+		commandLineParser.addOption( "handlercpus", tools::CommandLineParser::RequiredArgument );
+		commandLineParser.addOption( "ratelimit", tools::CommandLineParser::RequiredArgument );
+		commandLineParser.addOption( "bytelimit", tools::CommandLineParser::RequiredArgument );
+		commandLineParser.addOption( "ipratelimit", tools::CommandLineParser::RequiredArgument );
+		commandLineParser.addOption( "ipbytelimit", tools::CommandLineParser::RequiredArgument );
+		commandLineParser.addOption( "shed", tools::CommandLineParser::RequiredArgument );
+		commandLineParser.addOption( "shedinterval", tools::CommandLineParser::RequiredArgument );
 
 		commandLineParser.parse( argc, argv );
 
@@ -42,12 +383,76 @@ int ListenSubExe::run( int argc, char* argv[] )
 			std::cout << "Usage:" << "\n"
 					  << "  " << commandLineParser.executableName() << " [command options]" << "\n"
 					  << "\n"
+					  << "Requests are echoed back. An info message of \"quit\" stops the server, and \"broadcast <text>\" sends the" << "\n"
+					  << "text as an info message to every client of the native engine, --tcpport and --shm." << "\n"
+					  << "\n"
 					  << "Available options:" << "\n"
 					  << "  --help      Display this help message and exit" << "\n"
 					  << "  --port      The port number for the server to listen on. Default is " << portNumber << "." << "\n"
 					  << "  --httpserve A directory name to serve files from if HTTP requests are recieved. If not set no files are served." << "\n"
 					  << "  --cert      An x509 certificate (i.e. TLS certificate) in PEM format for the server to use to identify itself." << "\n"
 					  << "  --key       The key in PEM format for the certificate." << "\n"
+					  << "  --tcpport   Also accept native clients on this port, using length prefixed binary frames directly over TCP. Uses TLS if --cert and --key are set." << "\n"
+					  << "  --shm       Also accept clients on the same machine over shared memory, using this path for the Unix socket they connect to." << "\n"
+					  << "  --busypoll  The number of times shared memory connections check for messages before sleeping. Default is " << busyPollIterations << "." << "\n"
+					  << "  --engine    Which WebSocket implementation to use, either \"communique\" or \"native\" for the in-tree epoll engine. Default is " << engine << "." << "\n"
+					  << "  --threads   The number of event loops for the native engine. Default is one for each core." << "\n"
+					  << "              Streaming requests to the native engine of \"<count> <text>\" get the text back as count chunks." << "\n"
+					  << "  --batchthreads" << "\n"
+					  << "              The number of threads that run the requests in batches for the native engine. Default is one for each core." << "\n"
+					  << "  --concurrent" << "\n"
+					  << "              Run every request on the batch threads, so that the responses to pipelined requests can come back" << "\n"
+					  << "              out of order rather than waiting for slower ones sent earlier. Native engine only." << "\n"
+					  << "  --sessions  Give clients that ask for one a session that they can resume after reconnecting, keeping up to this" << "\n"
+					  << "              many unacknowledged messages for each. Native engine only." << "\n"
+					  << "  --rpc       Treat requests as protobuf RPC calls to the ListenService in proto/clientserver/ListenService.proto," << "\n"
+					  << "              instead of echoing them as strings. The calls are binary, so need the tcp or shm transports, or" << "\n"
+					  << "              binary frames with the native engine." << "\n"
+					  << "  --compress  Compress WebSocket messages with permessage-deflate if the client offers it. Native engine only." << "\n"
+					  << "  --compressthreshold" << "\n"
+					  << "              Messages smaller than this many bytes are sent uncompressed. Default is " << compressionConfiguration.threshold << ", or " << dictionaryThreshold << " with a dictionary." << "\n"
+					  << "  --nocontexttakeover" << "\n"
+					  << "              Compress each message on its own, and ask clients to do the same. Compresses less, but idle" << "\n"
+					  << "              connections then don't each hold around 300KB of zlib state." << "\n"
+					  << "  --dictionary" << "\n"
+					  << "              A zstd dictionary made with the \"traindict\" command. Native clients that offer the same dictionary" << "\n"
+					  << "              have their messages compressed with it instead of deflate. Can be given more than once. Native engine only." << "\n"
+					  << "  --capture   Append every message received to this file, in the format the \"traindict\" command reads." << "\n"
+					  << "  --workers   Fork this many worker processes, each pinned to a core and listening on the same ports with SO_REUSEPORT" << "\n"
+					  << "              so that the kernel shares out the connections. Crashed workers are restarted, and the totals of" << "\n"
+					  << "              their statistics printed every 10 seconds. Each worker runs one event loop and one batch thread" << "\n"
+					  << "              unless --threads or --batchthreads are set. Sessions can only be resumed on the worker that" << "\n"
+					  << "              made them. Native engine only, and not with --shm." << "\n"
+					  << "  --handover  A Unix socket path for restarting without refusing connections. If another listen process is" << "\n"
+					  << "              running with the same path its listening sockets are taken over, after which it stops accepting" << "\n"
+					  << "              and exits once its connections have finished. This process then offers its sockets on the path" << "\n"
+					  << "              for the next one. Native engine only, and not with --workers or --shm." << "\n"
+					  << "  --draintime On SIGTERM, SIGINT, a \"quit\" info message or handing over, native engine clients are told to" << "\n"
+					  << "              reconnect elsewhere and any requests in progress are finished. This is the most seconds to wait" << "\n"
+					  << "              for that before exiting anyway. Default is " << drainSeconds << "." << "\n"
+					  << "  --numa      Pin each event loop to a CPU, spread over the NUMA nodes, and give the loops on each node their" << "\n"
+					  << "              own batch threads on that node so that connection buffers stay in local memory. The \"numabench\"" << "\n"
+					  << "              command measures what that is worth. Native engine only, and not with --workers." << "\n"
+					  << "  --loopcpus  Pin the event loops to these CPUs instead, in turn, given as a list like \"0-3,8\"." << "\n"
+					  << "              Native engine only, and not with --workers." << "\n"
+					  << "  --handlercpus" << "\n"
+					  << "              Pin the batch threads to these CPUs instead, in turn. Event loops use the batch threads on" << "\n"
+					  << "              their own node where there are any. Native engine only, and not with --workers." << "\n"
+					  << "  --ratelimit The most messages each connection can send per second, with bursts of up to a second's worth." << "\n"
+					  << "              Requests over the limit get an empty response and info messages are dropped. The number" << "\n"
+					  << "              rejected by each limit is printed every second while it's going up. Not for the communique engine." << "\n"
+					  << "  --bytelimit The most bytes each connection can send per second, in the same way." << "\n"
+					  << "  --ipratelimit" << "\n"
+					  << "              The most messages per second from each client address, over all of its connections. IPv6" << "\n"
+					  << "              clients are counted by their /64 prefix, and shared memory clients aren't limited by address." << "\n"
+					  << "  --ipbytelimit" << "\n"
+					  << "              The most bytes per second from each client address." << "\n"
+					  << "  --shed      Shed work for the batch threads once it has been waiting longer than this many milliseconds for" << "\n"
+					  << "              a whole interval, the way CoDel does, rather than letting the queue grow. Batches are turned away" << "\n"
+					  << "              first, then requests that have waited twice as long, and clients are told to try again later." << "\n"
+					  << "              Only covers batches, and requests with --concurrent. Native engine only." << "\n"
+					  << "  --shedinterval" << "\n"
+					  << "              The interval for --shed in milliseconds, roughly the longest round trip to a client. Default is " << shedInterval << "." << "\n"
 					  << std::endl;
 			return 0;
 		}
@@ -84,6 +489,57 @@ int ListenSubExe::run( int argc, char* argv[] )
 		if( commandLineParser.optionHasBeenSet("httpserve") ) directoryToServe=commandLineParser.optionArguments("httpserve").back();
 		if( commandLineParser.optionHasBeenSet("key") ) keyFilename=commandLineParser.optionArguments("key").back();
 		if( commandLineParser.optionHasBeenSet("cert") ) certificateFilename=commandLineParser.optionArguments("cert").back();
+		if( commandLineParser.optionHasBeenSet("tcpport") ) tcpPortNumber=tools::parseSizeOption( commandLineParser, "tcpport" );
+		if( commandLineParser.optionHasBeenSet("shm") ) sharedMemorySocket=commandLineParser.optionArguments("shm").back();
+		if( commandLineParser.optionHasBeenSet("busypoll") ) busyPollIterations=tools::parseSizeOption( commandLineParser, "busypoll" );
+		if( commandLineParser.optionHasBeenSet("engine") ) engine=commandLineParser.optionArguments("engine").back();
+		if( commandLineParser.optionHasBeenSet("threads") ) numberOfThreads=tools::parseSizeOption( commandLineParser, "threads" );
+		if( commandLineParser.optionHasBeenSet("batchthreads") ) numberOfBatchThreads=tools::parseSizeOption( commandLineParser, "batchthreads" );
+		concurrentRequests=commandLineParser.optionHasBeenSet("concurrent");
+		if( commandLineParser.optionHasBeenSet("sessions") ) sessionReplayBufferSize=tools::parseSizeOption( commandLineParser, "sessions" );
+		useRpc=commandLineParser.optionHasBeenSet("rpc");
+		useCompression=commandLineParser.optionHasBeenSet("compress");
+		if( commandLineParser.optionHasBeenSet("compressthreshold") )
+		{
+			compressionConfiguration.threshold=tools::parseSizeOption( commandLineParser, "compressthreshold" );
+			dictionaryThreshold=compressionConfiguration.threshold;
+		}
+		if( commandLineParser.optionHasBeenSet("nocontexttakeover") )
+		{
+			compressionConfiguration.contextTakeover=false;
+			compressionConfiguration.peerContextTakeover=false;
+		}
+		if( commandLineParser.optionHasBeenSet("dictionary") ) dictionaryFilenames=commandLineParser.optionArguments("dictionary");
+		if( commandLineParser.optionHasBeenSet("capture") ) captureFilename=commandLineParser.optionArguments("capture").back();
+		if( commandLineParser.optionHasBeenSet("workers") )
+		{
+			numberOfWorkers=tools::parseSizeOption( commandLineParser, "workers" );
+			// Each worker is pinned to a single core, so more threads than that would just compete
+			if( !commandLineParser.optionHasBeenSet("threads") ) numberOfThreads=1;
+			if( !commandLineParser.optionHasBeenSet("batchthreads") ) numberOfBatchThreads=1;
+		}
+		if( concurrentRequests && engine!="native" ) throw std::runtime_error( "--concurrent is only supported by the native engine" );
+		if( sessionReplayBufferSize>0 && engine!="native" ) throw std::runtime_error( "--sessions is only supported by the native engine" );
+		if( useCompression && engine!="native" ) throw std::runtime_error( "--compress is only supported by the native engine" );
+		if( !dictionaryFilenames.empty() && engine!="native" ) throw std::runtime_error( "--dictionary is only supported by the native engine" );
+		if( commandLineParser.optionHasBeenSet("handover") ) handoverSocket=commandLineParser.optionArguments("handover").back();
+		if( commandLineParser.optionHasBeenSet("draintime") ) drainSeconds=tools::parseSizeOption( commandLineParser, "draintime" );
+		if( !handoverSocket.empty() && (engine!="native" || numberOfWorkers>0 || !sharedMemorySocket.empty()) ) throw std::runtime_error( "--handover is only supported by the native engine, without --workers or --shm" );
+		if( numberOfWorkers>0 && engine!="native" ) throw std::runtime_error( "--workers is only supported by the native engine" );
+		if( numberOfWorkers>0 && !sharedMemorySocket.empty() ) throw std::runtime_error( "--workers can't be used with --shm, because the workers can't share the socket path" );
+		if( commandLineParser.optionHasBeenSet("ratelimit") ) rateLimits.connectionMessages.perSecond=tools::parseSizeOption( commandLineParser, "ratelimit" );
+		if( commandLineParser.optionHasBeenSet("bytelimit") ) rateLimits.connectionBytes.perSecond=tools::parseSizeOption( commandLineParser, "bytelimit" );
+		if( commandLineParser.optionHasBeenSet("ipratelimit") ) rateLimits.addressMessages.perSecond=tools::parseSizeOption( commandLineParser, "ipratelimit" );
+		if( commandLineParser.optionHasBeenSet("ipbytelimit") ) rateLimits.addressBytes.perSecond=tools::parseSizeOption( commandLineParser, "ipbytelimit" );
+		if( commandLineParser.optionHasBeenSet("shed") ) shedTarget=tools::parseSizeOption( commandLineParser, "shed" );
+		if( commandLineParser.optionHasBeenSet("shedinterval") ) shedInterval=tools::parseSizeOption( commandLineParser, "shedinterval" );
+		if( shedTarget>0 && engine!="native" ) throw std::runtime_error( "--shed is only supported by the native engine" );
+		if( shedTarget>shedInterval ) throw std::runtime_error( "--shedinterval can't be shorter than --shed" );
+		numaPlacement=commandLineParser.optionHasBeenSet("numa");
+		if( commandLineParser.optionHasBeenSet("loopcpus") ) eventLoopCpus=clientserver::CpuTopology::parseCpuList( commandLineParser.optionArguments("loopcpus").back() );
+		if( commandLineParser.optionHasBeenSet("handlercpus") ) handlerCpus=clientserver::CpuTopology::parseCpuList( commandLineParser.optionArguments("handlercpus").back() );
+		if( (numaPlacement || !eventLoopCpus.empty() || !handlerCpus.empty()) && (engine!="native" || numberOfWorkers>0) ) throw std::runtime_error( "--numa, --loopcpus and --handlercpus are only supported by the native engine, without --workers" );
+		if( engine!="communique" && engine!="native" ) throw std::runtime_error( "Unknown engine \""+engine+"\"" );
 	} // end of parsing arguments try block
 	catch( std::exception& error )
 	{
@@ -93,46 +549,313 @@ int ListenSubExe::run( int argc, char* argv[] )
 		return -1;
 	}
 
-	// The synchronisation variables required to decide when to quit
-	bool continueListening=true;
-	std::mutex continueListeningMutex;
-	std::condition_variable continueListeningCondition;
+	// SIGTERM and SIGINT are read from a signalfd, so that the main thread can drain the connections. They
+	// have to be blocked before any threads start, so that none of them are given the signal instead.
+	sigset_t shutdownSignals;
+	sigemptyset( &shutdownSignals );
+	sigaddset( &shutdownSignals, SIGTERM );
+	sigaddset( &shutdownSignals, SIGINT );
+	const int signalFd=( ::sigprocmask( SIG_BLOCK, &shutdownSignals, nullptr )==0 ? ::signalfd( -1, &shutdownSignals, SFD_CLOEXEC ) : -1 );
+	if( signalFd<0 )
+	{
+		std::cerr << "Couldn't create a signalfd: " << std::strerror(errno) << std::endl;
+		return -1;
+	}
+
+	// Has to happen before anything starts any threads, which fork() doesn't copy
+	size_t workerIndex=0;
+	int metricsFd=-1;
+	if( numberOfWorkers>0 )
+	{
+		int exitCode=0;
+		try
+		{
+			if( !::superviseWorkers( numberOfWorkers, signalFd, workerIndex, metricsFd, exitCode ) ) return exitCode;
+		}
+		catch( std::exception& error )
+		{
+			std::cerr << error.what() << std::endl;
+			return -1;
+		}
+	}
+	// Workers that fail before they're listening are stopped rather than restarted by the supervisor
+	const int startFailure=( numberOfWorkers>0 ? ::workerStartFailure : -1 );
+	std::atomic<uint64_t> requestsHandled(0);
+
+	// Written to when the main thread should stop waiting, either for the quit message or once handed over
+	const int quitEventFd=::eventfd( 0, EFD_CLOEXEC );
+	if( quitEventFd<0 )
+	{
+		std::cerr << "Couldn't create an eventfd: " << std::strerror(errno) << std::endl;
+		return startFailure;
+	}
+	auto wakeMainThread=[quitEventFd]()
+		{
+			uint64_t value=1;
+			while( ::write( quitEventFd, &value, sizeof(value) )<0 && errno==EINTR );
+		};
 
 	communique::Server commandServer;
 	if( !directoryToServe.empty() ) commandServer.setFileServeRoot( directoryToServe );
 	if( !keyFilename.empty() ) commandServer.setPrivateKeyFile( keyFilename );
 	if( !certificateFilename.empty() ) commandServer.setCertificateChainFile( certificateFilename );
 
-	// As the default example just echo every command sent
-	commandServer.setDefaultRequestHandler( [](const std::string& message,std::weak_ptr<communique::IConnection> pConnection)->std::string
+	std::vector<std::shared_ptr<const clientserver::ZstdDictionary> > dictionaries;
+	std::ofstream captureFile;
+	std::mutex captureMutex;
+	try
+	{
+		for( const auto& filename : dictionaryFilenames )
+		{
+			dictionaries.push_back( clientserver::ZstdDictionary::load( filename ) );
+			std::cout << "Loaded zstd dictionary " << dictionaries.back()->id() << " from " << filename << std::endl;
+		}
+		if( !captureFilename.empty() )
+		{
+			captureFile.open( captureFilename, std::ios::binary | std::ios::app );
+			if( !captureFile.is_open() ) throw std::runtime_error( "Couldn't open the capture file \""+captureFilename+"\"" );
+		}
+	}
+	catch( std::exception& error )
+	{
+		std::cerr << error.what() << std::endl;
+		return startFailure;
+	}
+	// Messages arrive on several threads, and each one has to be written in one piece
+	auto captureMessage=[&](const std::string& message)
+		{
+			if( !captureFile.is_open() ) return;
+			std::lock_guard<std::mutex> lock(captureMutex);
+			clientserver::ZstdDictionary::writeSample( captureFile, message );
+		};
+
+	clientserver::RpcDispatcher rpcDispatcher;
+	::ListenServiceImplementation listenService( rpcDispatcher );
+	listenService.addMethodsTo( rpcDispatcher );
+
+	// As the default example just echo every command sent, unless told to use RPC
+	auto requestHandler=[&](const std::string& message,std::weak_ptr<clientserver::IConnection> pConnection)->std::string
 		{
+			captureMessage( message );
+			requestsHandled.fetch_add( 1, std::memory_order_relaxed );
+			if( useRpc ) return rpcDispatcher.handleRequest( message, pConnection );
 			std::cout << "Got request " << message << std::endl;
 			return message;
-		});
-	// Just print what the message was and quit if necessary
-	commandServer.setDefaultInfoHandler( [&](const std::string& message,std::weak_ptr<communique::IConnection> pConnection)
+		};
+	// All of the in-tree servers share one registry, so that broadcasts reach every client however it connected
+	auto pConnectionRegistry=std::make_shared<clientserver::ConnectionRegistry>();
+	// Shared for the same reason, so that the address limits count every connection from each client
+	std::shared_ptr<clientserver::RateLimiter> pRateLimiter;
+	const bool hasRateLimits=( rateLimits.connectionMessages.perSecond!=0 || rateLimits.connectionBytes.perSecond!=0
+			|| rateLimits.addressMessages.perSecond!=0 || rateLimits.addressBytes.perSecond!=0 );
+	if( hasRateLimits ) pRateLimiter=std::make_shared<clientserver::RateLimiter>( rateLimits );
+	std::shared_ptr<clientserver::AdmissionController> pAdmissionController;
+	if( shedTarget>0 ) pAdmissionController=std::make_shared<clientserver::AdmissionController>( clientserver::AdmissionController::Configuration{ std::chrono::milliseconds(shedTarget), std::chrono::milliseconds(shedInterval) } );
+	// Just print what the message was, and quit or broadcast it if necessary
+	auto infoHandler=[&](const std::string& message)
 		{
+			captureMessage( message );
 			std::cout << "Got info " << message << std::endl;
-			if( message=="quit" )
+			if( message=="quit" ) wakeMainThread();
+			else if( message.compare( 0, 10, "broadcast " )==0 )
 			{
-				std::unique_lock<std::mutex> lock(continueListeningMutex);
-				continueListening=false;
-				continueListeningCondition.notify_all();
+				std::cout << "Broadcast to " << pConnectionRegistry->broadcastInfo( message.substr(10) ) << " connections" << std::endl;
 			}
+		};
+	commandServer.setDefaultRequestHandler( [&](const std::string& message,std::weak_ptr<communique::IConnection> pConnection)->std::string
+		{
+			// Only connections from the in-tree transports can be given to the RPC handlers
+			return requestHandler( message, std::weak_ptr<clientserver::IConnection>() );
+		});
+	commandServer.setDefaultInfoHandler( [&](const std::string& message,std::weak_ptr<communique::IConnection> pConnection)
+		{
+			infoHandler( message );
+		});
 
+	// The in-tree engine is an alternative to commandServer, so that the two can be compared
+	clientserver::WebSocketServer nativeServer;
+	nativeServer.setNumberOfThreads( numberOfThreads );
+	nativeServer.setNumberOfBatchThreads( numberOfBatchThreads );
+	nativeServer.setNumaPlacement( numaPlacement );
+	if( !eventLoopCpus.empty() || !handlerCpus.empty() ) nativeServer.setCpuAffinity( eventLoopCpus, handlerCpus );
+	nativeServer.setConcurrentRequests( concurrentRequests );
+	nativeServer.setSessionResumption( sessionReplayBufferSize );
+	nativeServer.setReusePort( numberOfWorkers>0 );
+	nativeServer.setConnectionRegistry( pConnectionRegistry );
+	nativeServer.setRateLimiter( pRateLimiter );
+	nativeServer.setAdmissionController( pAdmissionController );
+	if( !directoryToServe.empty() ) nativeServer.setFileServeRoot( directoryToServe );
+	if( useCompression ) nativeServer.setCompression( compressionConfiguration );
+	if( !dictionaries.empty() ) nativeServer.setCompressionDictionaries( dictionaries, dictionaryThreshold );
+	if( !keyFilename.empty() ) nativeServer.setPrivateKeyFile( keyFilename );
+	if( !certificateFilename.empty() ) nativeServer.setCertificateChainFile( certificateFilename );
+	nativeServer.setDefaultRequestHandler( [&](const std::string& message,std::weak_ptr<clientserver::IConnection> pConnection)->std::string
+		{
+			return requestHandler( message, pConnection );
+		});
+	nativeServer.setDefaultInfoHandler( [&](const std::string& message,std::weak_ptr<clientserver::IConnection> pConnection)
+		{
+			infoHandler( message );
+		});
+	// Binary messages could be anything, so don't print them
+	nativeServer.setDefaultBinaryRequestHandler( [&](const std::string& message,std::weak_ptr<clientserver::IConnection> pConnection)->std::string
+		{
+			captureMessage( message );
+			requestsHandled.fetch_add( 1, std::memory_order_relaxed );
+			if( useRpc ) return rpcDispatcher.handleRequest( message, pConnection );
+			return message;
+		});
+	nativeServer.setDefaultBinaryInfoHandler( [&](const std::string& message,std::weak_ptr<clientserver::IConnection> pConnection)
+		{
+			captureMessage( message );
+			std::cout << "Got binary info of " << message.size() << " bytes" << std::endl;
+		});
+	nativeServer.setDefaultStreamingRequestHandler( [&](const std::string& message,std::shared_ptr<clientserver::IResponseStream> pStream,std::weak_ptr<clientserver::IConnection> pConnection)
+		{
+			captureMessage( message );
+			requestsHandled.fetch_add( 1, std::memory_order_relaxed );
+			::startRepeating( message, pStream );
 		});
 
-	// Start listening...
-	std::cout << "Starting to listen on port " << portNumber;
-	if( !directoryToServe.empty() ) std::cout << " and serving HTTP request from directory " << directoryToServe;
-	std::cout << std::endl;
-	commandServer.listen(portNumber);
-	// ...and wait until told to stop
-	std::unique_lock<std::mutex> lock(continueListeningMutex);
-	continueListeningCondition.wait( lock, [&]{ return !continueListening; } );
+	// Native clients don't need the HTTP upgrade or WebSocket framing
+	clientserver::TcpServer tcpServer;
+	tcpServer.setReusePort( numberOfWorkers>0 );
+	tcpServer.setConnectionRegistry( pConnectionRegistry );
+	tcpServer.setRateLimiter( pRateLimiter );
+	if( !keyFilename.empty() ) tcpServer.setPrivateKeyFile( keyFilename );
+	if( !certificateFilename.empty() ) tcpServer.setCertificateChainFile( certificateFilename );
+	tcpServer.setDefaultRequestHandler( [&](const std::string& message,std::weak_ptr<clientserver::IConnection> pConnection)->std::string
+		{
+			return requestHandler( message, pConnection );
+		});
+	tcpServer.setDefaultInfoHandler( [&](const std::string& message,std::weak_ptr<clientserver::IConnection> pConnection)
+		{
+			infoHandler( message );
+		});
+
+	// Co-located clients can skip the network stack entirely
+	clientserver::SharedMemoryServer sharedMemoryServer;
+	sharedMemoryServer.setBusyPollIterations( busyPollIterations );
+	sharedMemoryServer.setConnectionRegistry( pConnectionRegistry );
+	sharedMemoryServer.setRateLimiter( pRateLimiter );
+	sharedMemoryServer.setDefaultRequestHandler( [&](const std::string& message,std::weak_ptr<clientserver::IConnection> pConnection)->std::string
+		{
+			return requestHandler( message, pConnection );
+		});
+	sharedMemoryServer.setDefaultInfoHandler( [&](const std::string& message,std::weak_ptr<clientserver::IConnection> pConnection)
+		{
+			infoHandler( message );
+		});
+
+	// Start listening, on the sockets of the process being replaced if there is one...
+	auto startListening=[&]( std::vector<int> sockets )
+		{
+			// The ports might have changed since the old process started, so only use the sockets that match
+			for( const auto socket : sockets )
+			{
+				sockaddr_in6 address;
+				socklen_t addressLength=sizeof(address);
+				size_t port=0;
+				if( ::getsockname( socket, reinterpret_cast<sockaddr*>(&address), &addressLength )==0 && address.sin6_family==AF_INET6 ) port=ntohs( address.sin6_port );
+				if( port==portNumber && nativeServer.listenSocket()<0 ) nativeServer.listenOnSocket( socket );
+				else if( port==tcpPortNumber && tcpPortNumber!=0 && tcpServer.listenSocket()<0 ) tcpServer.listenOnSocket( socket );
+				else ::close( socket );
+			}
+
+			if( numberOfWorkers>0 ) std::cout << "Worker " << workerIndex << " starting";
+			else std::cout << "Starting";
+			std::cout << " to listen on port " << portNumber;
+			if( !directoryToServe.empty() ) std::cout << " and serving HTTP request from directory " << directoryToServe;
+			if( engine=="native" ) std::cout << " with the native engine";
+			std::cout << std::endl;
+			if( engine!="native" ) commandServer.listen(portNumber);
+			else if( nativeServer.listenSocket()<0 ) nativeServer.listen(portNumber);
+			if( tcpPortNumber!=0 )
+			{
+				std::cout << "Accepting native TCP clients on port " << tcpPortNumber << std::endl;
+				if( tcpServer.listenSocket()<0 ) tcpServer.listen( tcpPortNumber );
+			}
+			if( !sharedMemorySocket.empty() )
+			{
+				std::cout << "Accepting shared memory clients on " << sharedMemorySocket << std::endl;
+				sharedMemoryServer.listen( sharedMemorySocket );
+			}
+		};
+	std::atomic<bool> hasHandedOver(false);
+	clientserver::SocketHandover handover;
+	try
+	{
+		if( handoverSocket.empty() ) startListening( std::vector<int>() );
+		else
+		{
+			if( clientserver::SocketHandover::take( handoverSocket, startListening ) ) std::cout << "Took over the listening sockets from the process at " << handoverSocket << std::endl;
+			else startListening( std::vector<int>() );
+
+			std::vector<int> sockets{ nativeServer.listenSocket() };
+			if( tcpPortNumber!=0 ) sockets.push_back( tcpServer.listenSocket() );
+			handover.offer( handoverSocket, sockets, [&]()
+				{
+					// The new process is already accepting, so nothing is refused while this one stops
+					nativeServer.stopAccepting();
+					tcpServer.stopAccepting();
+					hasHandedOver=true;
+					wakeMainThread();
+				});
+		}
+	}
+	catch( std::exception& error )
+	{
+		std::cerr << error.what() << std::endl;
+		tcpServer.stop();
+		if( engine=="native" ) nativeServer.stop();
+		return startFailure;
+	}
+	// ...and wait until there's a signal, the quit message or a replacement, reporting to the supervisor every second if there is one
+	pollfd descriptors[2]={ { signalFd, POLLIN, 0 }, { quitEventFd, POLLIN, 0 } };
+	uint64_t lastRejections=0;
+	uint64_t lastShed=0;
+	while( true )
+	{
+		const int result=::poll( descriptors, 2, 1000 );
+		if( result>0 || (result<0 && errno!=EINTR) ) break;
+		if( pRateLimiter ) ::printRateLimits( *pRateLimiter, lastRejections );
+		if( pAdmissionController ) ::printShedding( *pAdmissionController, lastShed );
+		if( metricsFd<0 ) continue;
+		const std::string metrics=std::to_string(workerIndex)+" "+std::to_string(requestsHandled.load(std::memory_order_relaxed))+" "+std::to_string(nativeServer.currentConnections())+"\n";
+		if( ::write( metricsFd, metrics.data(), metrics.size() )<0 ) break;
+	}
+	if( descriptors[0].revents!=0 )
+	{
+		signalfd_siginfo signal;
+		if( ::read( signalFd, &signal, sizeof(signal) )==sizeof(signal) ) std::cout << "Got signal " << signal.ssi_signo;
+	}
+	else if( hasHandedOver ) std::cout << "Handed the listening sockets over";
+	else std::cout << "Told to quit";
+	if( descriptors[1].revents!=0 )
+	{
+		uint64_t value;
+		while( ::read( quitEventFd, &value, sizeof(value) )<0 && errno==EINTR );
+	}
+
+	// Clients are told to go elsewhere, but what they've already asked for is finished first. Any more signals are
+	// ignored, since e.g. a supervisor could send SIGTERM after the SIGINT from the terminal, but quitting cuts it short.
+	std::cout << ", waiting up to " << drainSeconds << " seconds for " << nativeServer.currentConnections()+tcpServer.currentConnections() << " connections to finish" << std::endl;
+	if( engine=="native" ) nativeServer.drain();
+	tcpServer.stopAccepting();
+	const auto drainEndTime=std::chrono::steady_clock::now()+std::chrono::seconds(drainSeconds);
+	while( nativeServer.currentConnections()+tcpServer.currentConnections()>0 && std::chrono::steady_clock::now()<drainEndTime )
+	{
+		if( ::poll( &descriptors[1], 1, 100 )>0 ) break;
+	}
 
 	// Shutdown gracefully
-	commandServer.stop();
+	handover.stop();
+	sharedMemoryServer.stop();
+	tcpServer.stop();
+	if( engine=="native" ) nativeServer.stop();
+	else commandServer.stop();
+	::close( quitEventFd );
+	::close( signalFd );
 
 	return 0;
 }
@@ -0,0 +1,184 @@
+#include "tools/ISubExecutable.h"
+
+class NumaBenchmarkSubExe : public tools::ISubExecutable
+{
+public:
+	virtual int run( int argc, char* argv[] );
+};
+
+#include "tools/SubExecutableRegister.h"
+#include "tools/CommandLineParser.h"
+#include "clientserver/CpuTopology.h"
+#include "clientserver/WebSocketKernels.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <vector>
+#include <cstring>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+REGISTER_MODULE( NumaBenchmarkSubExe, "numabench" );
+
+namespace // Unnamed namespace for things only used in this file
+{
+	/** @brief MPOL_F_NODE | MPOL_F_ADDR from <numaif.h>, to ask which node an address is on. */
+	const int nodeOfAddressFlags=1 | 2;
+
+	/** @brief The node that the page holding pAddress is on, or -1 if that can't be found. */
+	int nodeOfAddress( const void* pAddress )
+	{
+		int node=-1;
+		if( ::syscall( SYS_get_mempolicy, &node, nullptr, 0, pAddress, ::nodeOfAddressFlags )!=0 ) return -1;
+		return node;
+	}
+
+	/** @brief Runs the function on a thread pinned to the node, which also allocates its memory there. */
+	void runOnNode( const clientserver::CpuTopology& topology, int node, std::function<void()> function )
+	{
+		std::thread thread( [&]()
+			{
+				if( !clientserver::CpuTopology::apply( clientserver::CpuTopology::Affinity{ topology.cpusOnNode(node), node } ) )
+				{
+					std::cerr << "Couldn't move the benchmark thread to node " << node << std::endl;
+				}
+				function();
+			});
+		thread.join();
+	}
+
+	/** @brief Calls the kernel repeatedly for at least the given time, and returns the throughput in GB/s. */
+	double measureThroughput( std::function<void()> kernel, size_t bytesPerCall, double minimumSeconds )
+	{
+		kernel(); // Warm up the TLB, although the data is too big to stay in the caches
+		size_t numberOfCalls=0;
+		const auto startTime=std::chrono::steady_clock::now();
+		double elapsedSeconds=0;
+		do
+		{
+			kernel();
+			++numberOfCalls;
+			elapsedSeconds=std::chrono::duration<double>(std::chrono::steady_clock::now()-startTime).count();
+		} while( elapsedSeconds<minimumSeconds );
+
+		return numberOfCalls*bytesPerCall/elapsedSeconds/1e9;
+	}
+} // end of the unnamed namespace
+
+int NumaBenchmarkSubExe::run( int argc, char* argv[] )
+{
+	size_t totalSize=256*1024*1024;
+	size_t bufferSize=16*1024;
+	double minimumSeconds=0.5;
+
+	//
+	// Try and parse the command line arguments
+	//
+	try
+	{
+		tools::CommandLineParser commandLineParser;
+		commandLineParser.addOption( "help", tools::CommandLineParser::NoArgument );
+		commandLineParser.addOption( "size", tools::CommandLineParser::RequiredArgument );
+		commandLineParser.addOption( "buffersize", tools::CommandLineParser::RequiredArgument );
+		commandLineParser.addOption( "time", tools::CommandLineParser::RequiredArgument );
+
+		commandLineParser.parse( argc, argv );
+
+		if( commandLineParser.optionHasBeenSet("help") )
+		{
+			std::cout << "Usage:" << "\n"
+					  << "  " << commandLineParser.executableName() << " [command options]" << "\n"
+					  << "\n"
+					  << "Measures what it costs an event loop to work on connection buffers allocated on another NUMA node," << "\n"
+					  << "which is what happens when threads aren't kept on their node (see \"listen --numa\"). Buffers are" << "\n"
+					  << "allocated on each node in turn, then unmasked in place and copied out from a thread on each node." << "\n"
+					  << "\n"
+					  << "Available options:" << "\n"
+					  << "  --help       Display this help message and exit" << "\n"
+					  << "  --size       The total size of the buffers in bytes, which should be much larger than the caches. Default is " << totalSize << "." << "\n"
+					  << "  --buffersize The size of each buffer in bytes, as for one connection. Default is " << bufferSize << "." << "\n"
+					  << "  --time       The minimum time in milliseconds to run each test for. Default is " << minimumSeconds*1000 << "." << "\n"
+					  << std::endl;
+			return 0;
+		}
+
+		if( commandLineParser.optionHasBeenSet("size") ) totalSize=tools::parseSizeOption( commandLineParser, "size" );
+		if( commandLineParser.optionHasBeenSet("buffersize") ) bufferSize=tools::parseSizeOption( commandLineParser, "buffersize" );
+		if( commandLineParser.optionHasBeenSet("time") ) minimumSeconds=tools::parseSizeOption( commandLineParser, "time" )/1000.0;
+		if( bufferSize==0 || totalSize<bufferSize ) throw std::runtime_error( "--size has to be at least --buffersize, which can't be zero" );
+	} // end of parsing arguments try block
+	catch( std::exception& error )
+	{
+		std::cerr << "The following error was encountered while parsing the command line:" << "\n"
+		          << "     " << error.what() << "\n"
+				  << "Try \"--help\" for usage instructions." << std::endl;
+		return -1;
+	}
+
+	const clientserver::CpuTopology topology=clientserver::CpuTopology::detect();
+	const std::vector<int>& nodes=topology.nodes();
+	const uint8_t mask[4]={ 0x37, 0xfa, 0x21, 0x3d };
+	const size_t numberOfBuffers=totalSize/bufferSize;
+
+	std::cout << nodes.size() << " NUMA node" << (nodes.size()==1 ? "" : "s") << " with CPUs this process can use" << "\n";
+	for( const int node : nodes ) std::cout << "  node " << node << ": " << topology.cpusOnNode(node).size() << " CPUs" << "\n";
+	std::cout << "Throughput in GB/s over " << numberOfBuffers << " buffers of " << bufferSize << " bytes" << "\n"
+	          << "kernel   cpu node";
+	for( const int node : nodes ) std::cout << "   memory " << std::setw(2) << node;
+	std::cout << std::endl;
+
+	// Indexed by kernel, then CPU node, then memory node
+	std::vector<std::vector<std::vector<double> > > results( 2, std::vector<std::vector<double> >( nodes.size(), std::vector<double>(nodes.size()) ) );
+	for( size_t memoryIndex=0; memoryIndex<nodes.size(); ++memoryIndex )
+	{
+		// Touched as they're allocated, so that the pages are on the node
+		std::vector<std::string> buffers;
+		buffers.reserve( numberOfBuffers );
+		::runOnNode( topology, nodes[memoryIndex], [&](){ for( size_t index=0; index<numberOfBuffers; ++index ) buffers.emplace_back( bufferSize, 'x' ); } );
+		const int actualNode=::nodeOfAddress( buffers.front().data() );
+		if( actualNode>=0 && actualNode!=nodes[memoryIndex] ) std::cerr << "The buffers for node " << nodes[memoryIndex] << " ended up on node " << actualNode << std::endl;
+
+		for( size_t cpuIndex=0; cpuIndex<nodes.size(); ++cpuIndex )
+		{
+			::runOnNode( topology, nodes[cpuIndex], [&]()
+				{
+					results[0][cpuIndex][memoryIndex]=::measureThroughput( [&]{ for( auto& buffer : buffers ) clientserver::applyWebSocketMask( &buffer[0], buffer.size(), mask ); }, totalSize, minimumSeconds );
+					// Copied into a buffer on the CPU's own node, like building a response from a request
+					std::string output( bufferSize, ' ' );
+					results[1][cpuIndex][memoryIndex]=::measureThroughput( [&]{ for( const auto& buffer : buffers ) std::memcpy( &output[0], buffer.data(), buffer.size() ); }, totalSize, minimumSeconds );
+				});
+		}
+	}
+
+	const char* kernelNames[]={ "mask", "copy" };
+	for( size_t kernel=0; kernel<2; ++kernel )
+	{
+		for( size_t cpuIndex=0; cpuIndex<nodes.size(); ++cpuIndex )
+		{
+			std::cout << std::left << std::setw(9) << kernelNames[kernel] << std::right << std::setw(8) << nodes[cpuIndex];
+			for( size_t memoryIndex=0; memoryIndex<nodes.size(); ++memoryIndex ) std::cout << std::setw(12) << std::fixed << std::setprecision(2) << results[kernel][cpuIndex][memoryIndex];
+			std::cout << "\n";
+		}
+	}
+
+	if( nodes.size()==1 )
+	{
+		std::cout << "Only one node, so there's no traffic between nodes to measure" << std::endl;
+		return 0;
+	}
+	for( size_t kernel=0; kernel<2; ++kernel )
+	{
+		double local=0, remote=0;
+		for( size_t cpuIndex=0; cpuIndex<nodes.size(); ++cpuIndex )
+		{
+			for( size_t memoryIndex=0; memoryIndex<nodes.size(); ++memoryIndex ) (cpuIndex==memoryIndex ? local : remote)+=results[kernel][cpuIndex][memoryIndex];
+		}
+		local/=nodes.size();
+		remote/=nodes.size()*(nodes.size()-1);
+		std::cout << kernelNames[kernel] << ": memory on another node is " << std::fixed << std::setprecision(0) << 100*(1-remote/local) << "% slower on average" << "\n";
+	}
+	std::cout << std::flush;
+	return 0;
+}
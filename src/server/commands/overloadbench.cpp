@@ -0,0 +1,227 @@
+#include "tools/ISubExecutable.h"
+
+class OverloadBenchmarkSubExe : public tools::ISubExecutable
+{
+public:
+	virtual int run( int argc, char* argv[] );
+};
+
+#include "tools/SubExecutableRegister.h"
+#include "tools/CommandLineParser.h"
+#include "tools/LatencyRecorder.h"
+#include "clientserver/WebSocketServer.h"
+#include "clientserver/AdmissionController.h"
+#include "clientserver/Client.h"
+#include <iostream>
+#include <iomanip>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+REGISTER_MODULE( OverloadBenchmarkSubExe, "overloadbench" );
+
+namespace // Unnamed namespace for things only used in this file
+{
+	/** @brief What happened to the requests sent in one open loop run. */
+	struct Result
+	{
+		size_t sent;
+		std::atomic<size_t> admitted;
+		std::atomic<size_t> shed;
+		tools::LatencyRecorder latencies;              ///< Of the admitted requests
+		std::vector<tools::LatencyRecorder> bySecond;  ///< The same, split by the second the request was due to be sent in
+		double seconds; ///< From the first request being sent to the last reply
+	};
+
+	/** @brief Starts a native server on any free port whose handler sleeps for the given time, on the batch threads. */
+	void startServer( clientserver::WebSocketServer& server, size_t numberOfThreads, std::chrono::microseconds work, std::shared_ptr<clientserver::AdmissionController> pAdmissionController )
+	{
+		server.setNumberOfThreads( 1 );
+		server.setNumberOfBatchThreads( numberOfThreads );
+		server.setConcurrentRequests( true );
+		server.setAdmissionController( pAdmissionController );
+		server.setDefaultRequestHandler( [work](const std::string& message,std::weak_ptr<clientserver::IConnection> pConnection)
+			{
+				std::this_thread::sleep_for( work );
+				return message;
+			});
+		server.listen( 0 );
+	}
+
+	void connect( clientserver::Client& client, size_t port )
+	{
+		client.connect( "ws://localhost:"+std::to_string(port) );
+		if( !client.waitUntilConnected( std::chrono::seconds(10) ) ) throw std::runtime_error( "Couldn't connect to the native WebSocket server" );
+	}
+
+	/** @brief Keeps window requests in flight for the given time, and returns how many were answered per second. */
+	double measureCapacity( size_t port, size_t window, std::chrono::milliseconds duration )
+	{
+		clientserver::Client client;
+		client.setRequestWindow( window );
+		::connect( client, port );
+
+		std::atomic<size_t> numberCompleted( 0 );
+		size_t numberSent=0;
+		const auto startTime=std::chrono::steady_clock::now();
+		while( std::chrono::steady_clock::now()-startTime<duration )
+		{
+			// Sleeps rather than spinning, so that it doesn't take a core away from the server
+			if( numberSent-numberCompleted.load()>=window ) std::this_thread::sleep_for( std::chrono::microseconds(50) );
+			else
+			{
+				client.sendRequest( "x", [&](const std::string& response){ ++numberCompleted; } );
+				++numberSent;
+			}
+		}
+		const size_t answered=numberCompleted.load();
+		const double elapsedSeconds=std::chrono::duration<double>(std::chrono::steady_clock::now()-startTime).count();
+		while( numberCompleted.load()<numberSent ) std::this_thread::sleep_for( std::chrono::milliseconds(1) );
+		return answered/elapsedSeconds;
+	}
+
+	/** @brief Sends requests at a fixed rate however fast the replies come back, the way independent users would.
+	 *
+	 * Latency is measured from when each request was due to be sent rather than when it was, so that the
+	 * sender falling behind doesn't hide any of it.
+	 */
+	void runOpenLoop( size_t port, double rate, std::chrono::milliseconds duration, Result& result )
+	{
+		result.sent=std::max<size_t>( 1, static_cast<size_t>( rate*duration.count()/1000 ) );
+		result.admitted=0;
+		result.shed=0;
+		result.latencies.reserve( result.sent );
+		result.bySecond.resize( (duration.count()+999)/1000 );
+
+		clientserver::Client client;
+		// Nothing should wait in the client, since the point is to see what the server does with the queue
+		client.setRequestWindow( result.sent );
+		// Not retried, since that would change the offered rate that's being measured
+		client.setOverloadHandler( [&](std::chrono::milliseconds){ ++result.shed; } );
+		::connect( client, port );
+
+		const auto startTime=std::chrono::steady_clock::now();
+		auto dueTime=[startTime,rate]( size_t index ){ return startTime+std::chrono::nanoseconds( static_cast<int64_t>(index*1e9/rate) ); };
+		for( size_t index=0; index<result.sent; ++index )
+		{
+			std::this_thread::sleep_until( dueTime(index) );
+			client.sendRequest( "x", [&result,dueTime,rate,index](const std::string& response)
+				{
+					// The client calls handlers from a single thread, so no locking needed for the recorders
+					const uint64_t latency=std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now()-dueTime(index)).count();
+					result.latencies.record( latency );
+					result.bySecond[ std::min( static_cast<size_t>(index/rate), result.bySecond.size()-1 ) ].record( latency );
+					++result.admitted;
+				});
+		}
+		while( result.admitted.load()+result.shed.load()<result.sent ) std::this_thread::sleep_for( std::chrono::milliseconds(1) );
+		result.seconds=std::chrono::duration<double>(std::chrono::steady_clock::now()-startTime).count();
+	}
+} // end of the unnamed namespace
+
+int OverloadBenchmarkSubExe::run( int argc, char* argv[] )
+{
+	size_t numberOfThreads=4;
+	size_t workMicroseconds=1000;
+	size_t loadPercent=200;
+	size_t durationMilliseconds=3000;
+	size_t targetMilliseconds=5;
+	size_t intervalMilliseconds=100;
+
+	//
+	// Try and parse the command line arguments
+	//
+	try
+	{
+		tools::CommandLineParser commandLineParser;
+		commandLineParser.addOption( "help", tools::CommandLineParser::NoArgument );
+		commandLineParser.addOption( "threads", tools::CommandLineParser::RequiredArgument );
+		commandLineParser.addOption( "work", tools::CommandLineParser::RequiredArgument );
+		commandLineParser.addOption( "load", tools::CommandLineParser::RequiredArgument );
+		commandLineParser.addOption( "time", tools::CommandLineParser::RequiredArgument );
+		commandLineParser.addOption( "target", tools::CommandLineParser::RequiredArgument );
+		commandLineParser.addOption( "interval", tools::CommandLineParser::RequiredArgument );
+
+		commandLineParser.parse( argc, argv );
+
+		if( commandLineParser.optionHasBeenSet("help") )
+		{
+			std::cout << "Overloads a local native WebSocket server, first as it is and then shedding with an AdmissionController" << "\n"
+					  << "(see \"listen --shed\"), and prints the latency of the requests that were run. Requests are sent at a" << "\n"
+					  << "fixed rate rather than waiting for replies, and the handler sleeps rather than using the CPU, like one" << "\n"
+					  << "waiting on a database, so the capacity doesn't depend on the number of cores. Without shedding the" << "\n"
+					  << "backlog, and so the latency, grows for as long as the overload lasts. With shedding it still rises for" << "\n"
+					  << "the first interval or two while the backlog is detected, but should then stay flat." << "\n"
+					  << "\n"
+					  << "Available options:" << "\n"
+					  << "  --help      Display this help message and exit" << "\n"
+					  << "  --threads   The number of batch threads that run the requests. Default is " << numberOfThreads << "." << "\n"
+					  << "  --work      How long each request takes in microseconds. Default is " << workMicroseconds << "." << "\n"
+					  << "  --load      The rate to send at, as a percentage of the capacity measured first. Default is " << loadPercent << "." << "\n"
+					  << "  --time      How long to send for in milliseconds. Default is " << durationMilliseconds << "." << "\n"
+					  << "  --target    The target queueing delay for shedding in milliseconds. Default is " << targetMilliseconds << "." << "\n"
+					  << "  --interval  The interval for shedding in milliseconds. Default is " << intervalMilliseconds << "." << "\n"
+					  << std::endl;
+			return 0;
+		}
+
+		if( commandLineParser.optionHasBeenSet("threads") ) numberOfThreads=tools::parseSizeOption( commandLineParser, "threads" );
+		if( commandLineParser.optionHasBeenSet("work") ) workMicroseconds=tools::parseSizeOption( commandLineParser, "work" );
+		if( commandLineParser.optionHasBeenSet("load") ) loadPercent=tools::parseSizeOption( commandLineParser, "load" );
+		if( commandLineParser.optionHasBeenSet("time") ) durationMilliseconds=tools::parseSizeOption( commandLineParser, "time" );
+		if( commandLineParser.optionHasBeenSet("target") ) targetMilliseconds=tools::parseSizeOption( commandLineParser, "target" );
+		if( commandLineParser.optionHasBeenSet("interval") ) intervalMilliseconds=tools::parseSizeOption( commandLineParser, "interval" );
+		if( numberOfThreads==0 || loadPercent==0 || durationMilliseconds==0 ) throw std::runtime_error( "--threads, --load and --time have to be more than zero" );
+		if( targetMilliseconds==0 || intervalMilliseconds<targetMilliseconds ) throw std::runtime_error( "--target has to be more than zero, and no more than --interval" );
+	} // end of parsing arguments try block
+	catch( std::exception& error )
+	{
+		std::cerr << "The following error was encountered while parsing the command line:" << "\n"
+		          << "     " << error.what() << "\n"
+				  << "Try \"--help\" for usage instructions." << std::endl;
+		return -1;
+	}
+
+	const std::chrono::microseconds work( workMicroseconds );
+	const std::chrono::milliseconds duration( durationMilliseconds );
+
+	double capacity;
+	{
+		clientserver::WebSocketServer server;
+		::startServer( server, numberOfThreads, work, nullptr );
+		// Enough in flight to keep every thread busy, but not so many that it matters how long they queue
+		capacity=::measureCapacity( server.port(), 2*numberOfThreads, std::chrono::milliseconds(1000) );
+		server.stop();
+	}
+	const double rate=capacity*loadPercent/100;
+	std::cout << "Capacity with " << numberOfThreads << " threads and " << workMicroseconds << "us of work is " << static_cast<size_t>(capacity) << " requests/s" << "\n"
+	          << "Sending " << static_cast<size_t>(rate) << " requests/s (" << loadPercent << "% of capacity) for " << durationMilliseconds << "ms" << "\n"
+	          << "shedding   run/s     shed   p50 ms   p99 ms p99.9 ms   max ms   p99 ms for each second" << std::endl;
+
+	for( const bool isShedding : { false, true } )
+	{
+		std::shared_ptr<clientserver::AdmissionController> pAdmissionController;
+		if( isShedding ) pAdmissionController=std::make_shared<clientserver::AdmissionController>( clientserver::AdmissionController::Configuration{ std::chrono::milliseconds(targetMilliseconds), std::chrono::milliseconds(intervalMilliseconds) } );
+		clientserver::WebSocketServer server;
+		::startServer( server, numberOfThreads, work, pAdmissionController );
+		::Result result;
+		::runOpenLoop( server.port(), rate, duration, result );
+		server.stop();
+
+		std::cout << std::left << std::setw(8) << (isShedding ? "on" : "off") << std::right
+		          << std::setw(8) << static_cast<size_t>(result.admitted/result.seconds)
+		          << std::setw(9) << result.shed
+		          << std::fixed << std::setprecision(1)
+		          << std::setw(9) << result.latencies.percentile(0.5)/1e6
+		          << std::setw(9) << result.latencies.percentile(0.99)/1e6
+		          << std::setw(9) << result.latencies.percentile(0.999)/1e6
+		          << std::setw(9) << result.latencies.maximum()/1e6 << "  ";
+		for( const auto& latencies : result.bySecond ) std::cout << std::setw(9) << latencies.percentile(0.99)/1e6;
+		std::cout << std::endl;
+	}
+
+	return 0;
+}
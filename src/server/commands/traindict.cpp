@@ -0,0 +1,193 @@
+#include "tools/ISubExecutable.h"
+
+class TrainDictionarySubExe : public tools::ISubExecutable
+{
+public:
+	virtual int run( int argc, char* argv[] );
+};
+
+#include "tools/SubExecutableRegister.h"
+#include "tools/CommandLineParser.h"
+#include "clientserver/ZstdDictionary.h"
+#include "clientserver/ZstdDictionaryCompressor.h"
+#include "clientserver/PerMessageDeflate.h"
+#include <zstd.h>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <chrono>
+#include <functional>
+
+REGISTER_MODULE( TrainDictionarySubExe, "traindict" );
+
+namespace // Unnamed namespace for things only used in this file
+{
+	/** @brief Compresses and decompresses every message, checking they come back the same, and prints the total size and time. */
+	void measure( const std::string& name, const std::vector<std::string>& messages, size_t repeats,
+			const std::function<void(const std::string&,std::string&)>& compress,
+			const std::function<void(const std::string&,std::string&)>& decompress )
+	{
+		size_t originalBytes=0;
+		size_t compressedBytes=0;
+		std::chrono::steady_clock::duration compressTime{0};
+		std::chrono::steady_clock::duration decompressTime{0};
+		std::string compressed;
+		std::string decompressed;
+		for( size_t repeat=0; repeat<repeats; ++repeat )
+		{
+			for( const auto& message : messages )
+			{
+				compressed.clear();
+				decompressed.clear();
+				const auto startTime=std::chrono::steady_clock::now();
+				compress( message, compressed );
+				const auto middleTime=std::chrono::steady_clock::now();
+				decompress( compressed, decompressed );
+				decompressTime+=std::chrono::steady_clock::now()-middleTime;
+				compressTime+=middleTime-startTime;
+				if( decompressed!=message ) throw std::logic_error( name+" didn't give back the original message" );
+				if( repeat==0 )
+				{
+					originalBytes+=message.size();
+					compressedBytes+=compressed.size();
+				}
+			}
+		}
+		const double numberOfCalls=static_cast<double>( messages.size()*repeats );
+		std::cout << std::left << std::setw(22) << name << std::right
+		          << std::setw(12) << compressedBytes
+		          << std::setw(8) << std::fixed << std::setprecision(2) << static_cast<double>(originalBytes)/compressedBytes
+		          << std::setw(14) << std::chrono::duration<double,std::micro>(compressTime).count()/numberOfCalls
+		          << std::setw(14) << std::chrono::duration<double,std::micro>(decompressTime).count()/numberOfCalls << std::endl;
+	}
+} // end of the unnamed namespace
+
+int TrainDictionarySubExe::run( int argc, char* argv[] )
+{
+	std::string inputFilename;
+	std::string outputFilename;
+	size_t dictionarySize=16384;
+	size_t holdoutPercent=10;
+	size_t level=3;
+
+	//
+	// Try and parse the command line arguments
+	//
+	try
+	{
+		tools::CommandLineParser commandLineParser;
+		commandLineParser.addOption( "help", tools::CommandLineParser::NoArgument );
+		commandLineParser.addOption( "input", tools::CommandLineParser::RequiredArgument );
+		commandLineParser.addOption( "output", tools::CommandLineParser::RequiredArgument );
+		commandLineParser.addOption( "size", tools::CommandLineParser::RequiredArgument );
+		commandLineParser.addOption( "holdout", tools::CommandLineParser::RequiredArgument );
+		commandLineParser.addOption( "level", tools::CommandLineParser::RequiredArgument );
+
+		commandLineParser.parse( argc, argv );
+
+		if( commandLineParser.optionHasBeenSet("help") )
+		{
+			std::cout << "Usage:" << "\n"
+					  << "  " << commandLineParser.executableName() << " --input <capture file> --output <dictionary file> [command options]" << "\n"
+					  << "\n"
+					  << "Trains a zstd dictionary from messages captured with \"listen --capture\", for use with \"listen --dictionary\"." << "\n"
+					  << "Some of the messages are kept back from training, and used to compare the dictionary with the other" << "\n"
+					  << "ways of compressing each message." << "\n"
+					  << "\n"
+					  << "Available options:" << "\n"
+					  << "  --help      Display this help message and exit" << "\n"
+					  << "  --input     The capture file to train from." << "\n"
+					  << "  --output    Where to write the dictionary." << "\n"
+					  << "  --size      The largest the dictionary can be, in bytes. Default is " << dictionarySize << "." << "\n"
+					  << "  --holdout   The percentage of messages to test with rather than train with. Default is " << holdoutPercent << "." << "\n"
+					  << "  --level     The zstd compression level for the comparison. Default is " << level << "." << "\n"
+					  << std::endl;
+			return 0;
+		}
+
+		if( commandLineParser.optionHasBeenSet("input") ) inputFilename=commandLineParser.optionArguments("input").back();
+		if( commandLineParser.optionHasBeenSet("output") ) outputFilename=commandLineParser.optionArguments("output").back();
+		if( commandLineParser.optionHasBeenSet("size") ) dictionarySize=tools::parseSizeOption( commandLineParser, "size" );
+		if( commandLineParser.optionHasBeenSet("holdout") ) holdoutPercent=tools::parseSizeOption( commandLineParser, "holdout" );
+		if( commandLineParser.optionHasBeenSet("level") ) level=tools::parseSizeOption( commandLineParser, "level" );
+		if( inputFilename.empty() || outputFilename.empty() ) throw std::runtime_error( "Both --input and --output have to be given" );
+		if( holdoutPercent>=100 ) throw std::runtime_error( "The holdout percentage must be less than 100" );
+		if( level<1 || static_cast<int>(level)>::ZSTD_maxCLevel() ) throw std::runtime_error( "The level must be between 1 and "+std::to_string(::ZSTD_maxCLevel()) );
+	} // end of parsing arguments try block
+	catch( std::exception& error )
+	{
+		std::cerr << "The following error was encountered while parsing the command line:" << "\n"
+		          << "     " << error.what() << "\n"
+				  << "Try \"--help\" for usage instructions." << std::endl;
+		return -1;
+	}
+
+	try
+	{
+		std::ifstream inputFile( inputFilename, std::ios::binary );
+		if( !inputFile.is_open() ) throw std::runtime_error( "Couldn't open the capture file \""+inputFilename+"\"" );
+		std::vector<std::string> trainingMessages;
+		std::vector<std::string> testMessages;
+		const std::vector<std::string> messages=clientserver::ZstdDictionary::readSamples( inputFile );
+		// Spread the test messages evenly through the capture, in case the traffic changes over time
+		for( size_t index=0; index<messages.size(); ++index )
+		{
+			if( (index*holdoutPercent)/100!=((index+1)*holdoutPercent)/100 ) testMessages.push_back( messages[index] );
+			else trainingMessages.push_back( messages[index] );
+		}
+		std::cout << "Read " << messages.size() << " messages, training with " << trainingMessages.size() << " and testing with " << testMessages.size() << std::endl;
+
+		auto pDictionary=std::make_shared<clientserver::ZstdDictionary>( clientserver::ZstdDictionary::train( trainingMessages, dictionarySize ), static_cast<int>(level) );
+		std::ofstream outputFile( outputFilename, std::ios::binary | std::ios::trunc );
+		if( !outputFile.write( pDictionary->contents().data(), pDictionary->contents().size() ) ) throw std::runtime_error( "Couldn't write the dictionary to \""+outputFilename+"\"" );
+		std::cout << "Wrote dictionary " << pDictionary->id() << " of " << pDictionary->contents().size() << " bytes to " << outputFilename << std::endl;
+		if( testMessages.empty() ) return 0;
+
+		// Each method is timed on at least 100,000 messages so that the timings mean something
+		const size_t repeats=(100000+testMessages.size()-1)/testMessages.size();
+		std::cout << "\n"
+		          << "method                       bytes   ratio  compress us  decompress us" << std::endl;
+		measure( "none", testMessages, repeats,
+			[]( const std::string& message, std::string& output ){ output=message; },
+			[]( const std::string& message, std::string& output ){ output=message; } );
+
+		// What browsers get, both on its own and with the window kept from one message to the next
+		for( const bool contextTakeover : { false, true } )
+		{
+			clientserver::PerMessageDeflate::Configuration configuration;
+			configuration.contextTakeover=contextTakeover;
+			clientserver::PerMessageDeflate::Parameters parameters;
+			parameters.compressNoContextTakeover=!contextTakeover;
+			parameters.decompressNoContextTakeover=!contextTakeover;
+			clientserver::PerMessageDeflate sender( configuration, parameters );
+			clientserver::PerMessageDeflate receiver( configuration, parameters );
+			measure( contextTakeover ? "deflate (takeover)" : "deflate", testMessages, repeats,
+				[&]( const std::string& message, std::string& output ){ sender.compress( message.data(), message.size(), output, true ); },
+				[&]( const std::string& message, std::string& output ){ receiver.decompress( message.data(), message.size(), output, 1<<30 ); } );
+		}
+
+		measure( "zstd", testMessages, repeats,
+			[&]( const std::string& message, std::string& output )
+			{
+				output.resize( ::ZSTD_compressBound( message.size() ) );
+				output.resize( ::ZSTD_compress( &output[0], output.size(), message.data(), message.size(), static_cast<int>(level) ) );
+			},
+			[]( const std::string& message, std::string& output )
+			{
+				output.resize( ::ZSTD_getFrameContentSize( message.data(), message.size() ) );
+				::ZSTD_decompress( &output[0], output.size(), message.data(), message.size() );
+			} );
+
+		clientserver::ZstdDictionaryCompressor compressor( pDictionary, 0 );
+		measure( "zstd dictionary", testMessages, repeats,
+			[&]( const std::string& message, std::string& output ){ compressor.compress( message.data(), message.size(), output, true ); },
+			[&]( const std::string& message, std::string& output ){ compressor.decompress( message.data(), message.size(), output, 1<<30 ); } );
+	}
+	catch( std::exception& error )
+	{
+		std::cerr << "Error: " << error.what() << std::endl;
+		return -1;
+	}
+
+	return 0;
+}
@@ -170,3 +170,23 @@ const std::string& tools::CommandLineParser::executableName() const
 {
 	return executableName_;
 }
+
+size_t tools::parseSizeOption( const tools::CommandLineParser& commandLineParser, const std::string& optionName )
+{
+	const std::vector<std::string>& arguments=commandLineParser.optionArguments(optionName);
+	if( arguments.empty() ) throw std::runtime_error( "No argument was given for --"+optionName );
+
+	const std::string& numberAsString=arguments.back();
+	size_t pos=0;
+	long long numberAsInt;
+	try
+	{
+		numberAsInt=std::stoll(numberAsString,&pos);
+	}
+	catch( std::exception& error )
+	{
+		throw std::runtime_error( "Couldn't convert the argument for --"+optionName+" (\""+numberAsString+"\") to an integer" );
+	}
+	if( pos!=numberAsString.size() || numberAsInt<0 ) throw std::runtime_error( "The argument for --"+optionName+" (\""+numberAsString+"\") must be a positive integer" );
+	return static_cast<size_t>(numberAsInt);
+}
@@ -0,0 +1,47 @@
+#include "tools/LatencyRecorder.h"
+
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+
+void tools::LatencyRecorder::reserve( size_t numberOfSamples )
+{
+	samples_.reserve( numberOfSamples );
+}
+
+void tools::LatencyRecorder::record( uint64_t nanoseconds )
+{
+	samples_.push_back( nanoseconds );
+	sorted_=false;
+}
+
+size_t tools::LatencyRecorder::count() const
+{
+	return samples_.size();
+}
+
+uint64_t tools::LatencyRecorder::mean() const
+{
+	if( samples_.empty() ) return 0;
+	return std::accumulate( samples_.begin(), samples_.end(), uint64_t(0) )/samples_.size();
+}
+
+uint64_t tools::LatencyRecorder::maximum() const
+{
+	if( samples_.empty() ) return 0;
+	return *std::max_element( samples_.begin(), samples_.end() );
+}
+
+uint64_t tools::LatencyRecorder::percentile( double fraction ) const
+{
+	if( samples_.empty() ) return 0;
+	if( !sorted_ )
+	{
+		std::sort( samples_.begin(), samples_.end() );
+		sorted_=true;
+	}
+	// Nearest rank method, i.e. the smallest sample with at least "fraction" of samples at or below it
+	size_t rank=static_cast<size_t>( std::ceil( fraction*samples_.size() ) );
+	if( rank>0 ) --rank;
+	return samples_[ std::min( rank, samples_.size()-1 ) ];
+}
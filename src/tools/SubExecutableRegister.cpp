@@ -1,6 +1,8 @@
 #include "tools/SubExecutableRegister.h"
 #include "tools/ISubExecutable.h"
 
+#include <stdexcept>
+
 tools::SubExecutableRegister& tools::SubExecutableRegister::instance()
 {
 	static tools::SubExecutableRegister onlyInstance;
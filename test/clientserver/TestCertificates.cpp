@@ -0,0 +1,36 @@
+#include "clientserver/TestCertificates.h"
+
+#include <cstdio>
+#include <openssl/evp.h>
+#include <openssl/rsa.h>
+#include <openssl/x509.h>
+#include <openssl/pem.h>
+
+bool clientserver::test::createSelfSignedCertificate( const std::string& certificateFilename, const std::string& keyFilename )
+{
+	EVP_PKEY* pKey=EVP_RSA_gen( 2048 );
+	if( pKey==nullptr ) return false;
+	X509* pCertificate=X509_new();
+	ASN1_INTEGER_set( X509_get_serialNumber(pCertificate), 1 );
+	X509_gmtime_adj( X509_getm_notBefore(pCertificate), 0 );
+	X509_gmtime_adj( X509_getm_notAfter(pCertificate), 3600 );
+	X509_set_pubkey( pCertificate, pKey );
+	X509_NAME* pName=X509_get_subject_name( pCertificate );
+	X509_NAME_add_entry_by_txt( pName, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char*>("localhost"), -1, -1, 0 );
+	X509_set_issuer_name( pCertificate, pName );
+	X509_sign( pCertificate, pKey, EVP_sha256() );
+
+	bool success=false;
+	FILE* pCertificateFile=std::fopen( certificateFilename.c_str(), "w" );
+	FILE* pKeyFile=std::fopen( keyFilename.c_str(), "w" );
+	if( pCertificateFile && pKeyFile )
+	{
+		success=PEM_write_X509( pCertificateFile, pCertificate )==1
+			&& PEM_write_PrivateKey( pKeyFile, pKey, nullptr, nullptr, 0, nullptr, nullptr )==1;
+	}
+	if( pCertificateFile ) std::fclose( pCertificateFile );
+	if( pKeyFile ) std::fclose( pKeyFile );
+	X509_free( pCertificate );
+	EVP_PKEY_free( pKey );
+	return success;
+}
@@ -0,0 +1,23 @@
+#ifndef INCLUDEGUARD_clientserver_TestCertificates_h
+#define INCLUDEGUARD_clientserver_TestCertificates_h
+
+#include <string>
+
+namespace clientserver
+{
+	namespace test
+	{
+		/** @brief Writes a self signed certificate for "localhost" and its key to the given files, so that the TLS paths can be tested.
+		 *
+		 * The certificate is valid for an hour, and can be used as its own authority.
+		 *
+		 * @return False if the key couldn't be generated or either file couldn't be written.
+		 * @author Mark Grimes
+		 * @date 19/Oct/2026
+		 */
+		bool createSelfSignedCertificate( const std::string& certificateFilename, const std::string& keyFilename );
+
+	} // end of namespace test
+} // end of namespace clientserver
+
+#endif // end of "#ifndef INCLUDEGUARD_clientserver_TestCertificates_h"
@@ -0,0 +1,178 @@
+#include "catch.hpp"
+#include "clientserver/AdmissionController.h"
+#include "clientserver/WebSocketServer.h"
+#include "clientserver/WebSocketClient.h"
+#include "clientserver/Client.h"
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <vector>
+
+namespace // Unnamed namespace for things only used in this file
+{
+	/** @brief What AdmissionController::now() was the given number of milliseconds ago. */
+	int64_t millisecondsAgo( int64_t milliseconds )
+	{
+		return clientserver::AdmissionController::now()-milliseconds*1000000;
+	}
+
+	/** @brief Waits for the condition to become true, for up to five seconds. */
+	bool waitFor( std::function<bool()> condition )
+	{
+		const auto endTime=std::chrono::steady_clock::now()+std::chrono::seconds(5);
+		while( !condition() && std::chrono::steady_clock::now()<endTime ) std::this_thread::sleep_for( std::chrono::milliseconds(5) );
+		return condition();
+	}
+} // end of the unnamed namespace
+
+SCENARIO( "Test that AdmissionController sheds work once the queue has a standing backlog", "[clientserver]" )
+{
+	typedef clientserver::AdmissionController::Priority Priority;
+
+	GIVEN( "A controller with a target of 2ms and an interval of 20ms" )
+	{
+		clientserver::AdmissionController controller( clientserver::AdmissionController::Configuration{ std::chrono::milliseconds(2), std::chrono::milliseconds(20) } );
+		CHECK( controller.retryAfter()==std::chrono::milliseconds(20) );
+		CHECK( !controller.isOverloaded() );
+		CHECK( controller.admit( Priority::low ) );
+
+		WHEN( "Tasks wait longer than the target, but not for a whole interval" )
+		{
+			CHECK( controller.start( ::millisecondsAgo(50), Priority::normal ) );
+			CHECK( controller.start( ::millisecondsAgo(50), Priority::low ) );
+			CHECK( !controller.isOverloaded() );
+		}
+		WHEN( "Every task waits longer than the target for more than an interval" )
+		{
+			const auto endTime=std::chrono::steady_clock::now()+std::chrono::milliseconds(50);
+			while( std::chrono::steady_clock::now()<endTime )
+			{
+				// Short enough that none of them are shed
+				controller.start( ::millisecondsAgo(3), Priority::normal );
+				std::this_thread::sleep_for( std::chrono::milliseconds(1) );
+			}
+			REQUIRE( controller.isOverloaded() );
+			CHECK( controller.shed( Priority::normal )==0 );
+
+			// Low priority work is turned away before being queued, and shed sooner
+			CHECK( !controller.admit( Priority::low ) );
+			CHECK( !controller.start( ::millisecondsAgo(3), Priority::low ) );
+			CHECK( controller.start( ::millisecondsAgo(1), Priority::low ) );
+			// Normal priority work is only shed once it has waited twice the target
+			CHECK( controller.start( ::millisecondsAgo(3), Priority::normal ) );
+			CHECK( !controller.start( ::millisecondsAgo(10), Priority::normal ) );
+			CHECK( controller.shed( Priority::low )==2 );
+			CHECK( controller.shed( Priority::normal )==1 );
+
+			AND_WHEN( "The delay drops back under the target for an interval" )
+			{
+				const auto recoveryTime=std::chrono::steady_clock::now()+std::chrono::milliseconds(50);
+				while( std::chrono::steady_clock::now()<recoveryTime )
+				{
+					controller.start( clientserver::AdmissionController::now(), Priority::normal );
+					std::this_thread::sleep_for( std::chrono::milliseconds(1) );
+				}
+				CHECK( !controller.isOverloaded() );
+				CHECK( controller.admit( Priority::low ) );
+				CHECK( controller.start( ::millisecondsAgo(10), Priority::normal ) );
+			}
+			AND_WHEN( "Nothing comes off the queue for an interval" )
+			{
+				std::this_thread::sleep_for( std::chrono::milliseconds(30) );
+				CHECK( !controller.isOverloaded() );
+				CHECK( controller.admit( Priority::low ) );
+			}
+		}
+	}
+	GIVEN( "Invalid configurations" )
+	{
+		CHECK_THROWS( clientserver::AdmissionController( clientserver::AdmissionController::Configuration{ std::chrono::milliseconds(0), std::chrono::milliseconds(100) } ) );
+		CHECK_THROWS( clientserver::AdmissionController( clientserver::AdmissionController::Configuration{ std::chrono::milliseconds(10), std::chrono::milliseconds(5) } ) );
+	}
+}
+
+SCENARIO( "Test that WebSocketServer sheds requests that wait too long for a batch thread", "[clientserver]" )
+{
+	GIVEN( "A server with one batch thread, slow requests and a target of 1ms" )
+	{
+		auto pController=std::make_shared<clientserver::AdmissionController>( clientserver::AdmissionController::Configuration{ std::chrono::milliseconds(1), std::chrono::milliseconds(10) } );
+		std::atomic<size_t> requestsRun( 0 );
+
+		clientserver::WebSocketServer server;
+		server.setNumberOfThreads( 1 );
+		server.setNumberOfBatchThreads( 1 );
+		server.setConcurrentRequests( true );
+		server.setAdmissionController( pController );
+		server.setDefaultRequestHandler( [&](const std::string& message,std::weak_ptr<clientserver::IConnection> pConnection)
+			{
+				++requestsRun;
+				std::this_thread::sleep_for( std::chrono::milliseconds(2) );
+				return "echo "+message;
+			});
+		REQUIRE_NOTHROW( server.listen( 0 ) );
+
+		WHEN( "Sending far more requests than the thread can keep up with, then a batch" )
+		{
+			const size_t numberOfRequests=200;
+			clientserver::WebSocketClient client;
+			REQUIRE_NOTHROW( client.connect( "localhost", server.port() ) );
+
+			std::mutex mutex;
+			size_t echoes=0;
+			size_t emptyResponses=0;
+			std::vector<std::string> batchResponses;
+			bool hasBatchResponse=false;
+			for( size_t index=0; index<numberOfRequests; ++index )
+			{
+				client.sendRequest( std::to_string(index), [&](const std::string& response)
+					{
+						std::lock_guard<std::mutex> lock( mutex );
+						if( response.empty() ) ++emptyResponses;
+						else ++echoes;
+					});
+			}
+			client.sendBatch( { "one", "two" }, [&](const std::vector<std::string>& responses)
+				{
+					std::lock_guard<std::mutex> lock( mutex );
+					batchResponses=responses;
+					hasBatchResponse=true;
+				});
+
+			// Without shedding these would take 400ms, so five seconds is plenty either way
+			REQUIRE( ::waitFor( [&]{ std::lock_guard<std::mutex> lock( mutex ); return echoes+emptyResponses==numberOfRequests && hasBatchResponse; } ) );
+			std::lock_guard<std::mutex> lock( mutex );
+			CHECK( echoes==requestsRun );
+			// Shed requests are replied to as overloaded, which this client gives as an empty response
+			CHECK( emptyResponses==pController->shed( clientserver::AdmissionController::Priority::normal ) );
+			CHECK( emptyResponses>numberOfRequests/2 );
+			// The batch was queued behind everything else, so has waited long enough to be shed as well
+			CHECK( pController->shed( clientserver::AdmissionController::Priority::low )>0 );
+			CHECK( batchResponses==std::vector<std::string>( { "", "" } ) );
+
+			client.disconnect();
+		}
+		WHEN( "A Client is told that its requests were shed" )
+		{
+			std::atomic<size_t> responses( 0 );
+			std::atomic<size_t> overloads( 0 );
+			std::atomic<int64_t> retryAfter( 0 );
+			clientserver::Client client;
+			client.setRequestWindow( 100 );
+			client.setOverloadHandler( [&](std::chrono::milliseconds delay){ retryAfter=delay.count(); ++overloads; } );
+			client.connect( "ws://localhost:"+std::to_string(server.port()) );
+			REQUIRE( client.waitUntilConnected( std::chrono::seconds(5) ) );
+
+			for( size_t index=0; index<100; ++index ) client.sendRequest( std::to_string(index), [&](const std::string& response){ ++responses; } );
+			REQUIRE( ::waitFor( [&]{ return responses+overloads==100; } ) );
+			CHECK( overloads>0 );
+			CHECK( retryAfter==10 );
+			// The shed requests don't hold on to their place in the window
+			CHECK( client.outstandingRequests()==0 );
+
+			client.disconnect();
+		}
+
+		server.stop();
+	}
+}
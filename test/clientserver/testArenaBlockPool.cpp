@@ -0,0 +1,65 @@
+#include "catch.hpp"
+#include "clientserver/ArenaBlockPool.h"
+#include "clientserver/BenchmarkService.rpc.h"
+#include <cstring>
+
+SCENARIO( "Test that ArenaBlockPool reuses blocks", "[clientserver]" )
+{
+	GIVEN( "A pool that can hold 64KiB" )
+	{
+		clientserver::ArenaBlockPool pool( 64*1024 );
+
+		WHEN( "Allocating and freeing blocks of the same size class" )
+		{
+			void* pFirst=pool.allocate( 3000 );
+			std::memset( pFirst, 0xab, 4096 ); // Should have been rounded up to the whole class
+			pool.deallocate( pFirst, 3000 );
+			CHECK( pool.pooledBytes()==4096 );
+
+			void* pSecond=pool.allocate( 4096 );
+			CHECK( pSecond==pFirst );
+			CHECK( pool.pooledBytes()==0 );
+			pool.deallocate( pSecond, 4096 );
+
+			CHECK( pool.allocations()==2 );
+			CHECK( pool.systemAllocations()==1 );
+		}
+		WHEN( "Freeing more than the pool can hold" )
+		{
+			std::vector<void*> blocks;
+			for( size_t index=0; index<20; ++index ) blocks.push_back( pool.allocate( 8192 ) );
+			for( void* pBlock : blocks ) pool.deallocate( pBlock, 8192 );
+			CHECK( pool.pooledBytes()==64*1024 );
+		}
+		WHEN( "Allocating blocks too large to pool" )
+		{
+			void* pBlock=pool.allocate( 2*1024*1024 );
+			pool.deallocate( pBlock, 2*1024*1024 );
+			CHECK( pool.pooledBytes()==0 );
+		}
+	}
+	GIVEN( "Arenas using the pool of this thread" )
+	{
+		clientserver::ArenaBlockPool& pool=clientserver::ArenaBlockPool::threadPool();
+		auto createDocument=[](google::protobuf::Arena& arena)
+			{
+				clientserver::Document* pDocument=google::protobuf::Arena::CreateMessage<clientserver::Document>( &arena );
+				for( size_t index=0; index<100; ++index ) pDocument->add_sections()->add_paragraphs()->set_id( index );
+				return pDocument->sections_size();
+			};
+
+		// The first arena might need blocks from the system, but after that they should all be reused
+		{
+			google::protobuf::Arena arena( clientserver::ArenaBlockPool::arenaOptions() );
+			CHECK( createDocument( arena )==100 );
+		}
+		const size_t systemAllocations=pool.systemAllocations();
+		for( size_t index=0; index<10; ++index )
+		{
+			google::protobuf::Arena arena( clientserver::ArenaBlockPool::arenaOptions() );
+			CHECK( createDocument( arena )==100 );
+		}
+		CHECK( pool.systemAllocations()==systemAllocations );
+		CHECK( pool.pooledBytes()>0 );
+	}
+}
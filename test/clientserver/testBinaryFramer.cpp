@@ -0,0 +1,81 @@
+#include "catch.hpp"
+#include "clientserver/BinaryFramer.h"
+
+SCENARIO( "Test that BinaryFramer encodes and decodes frames correctly", "[clientserver]" )
+{
+	typedef clientserver::BinaryFramer::MessageType MessageType;
+
+	GIVEN( "A BinaryFramer and some encoded frames" )
+	{
+		clientserver::BinaryFramer framer;
+		std::string encoded;
+		clientserver::BinaryFramer::encode( MessageType::request, 7, "Hello", encoded );
+		clientserver::BinaryFramer::encode( MessageType::info, 0, "", encoded );
+		clientserver::BinaryFramer::encode( MessageType::response, 0x01020304, std::string(1000,'z'), encoded );
+
+		MessageType type;
+		uint32_t id;
+		std::string payload;
+
+		WHEN( "Checking the encoded format" )
+		{
+			CHECK( encoded.size()==3*clientserver::BinaryFramer::headerSize+5+1000 );
+			// Length and id are big endian
+			CHECK( encoded.substr(0,9)==std::string("\x00\x00\x00\x05\x01\x00\x00\x00\x07",9) );
+			CHECK( encoded.substr(9,5)=="Hello" );
+		}
+		WHEN( "Decoding all of the frames in one go" )
+		{
+			framer.append( encoded.data(), encoded.size() );
+			REQUIRE( framer.next( type, id, payload ) );
+			CHECK( type==MessageType::request );
+			CHECK( id==7 );
+			CHECK( payload=="Hello" );
+			REQUIRE( framer.next( type, id, payload ) );
+			CHECK( type==MessageType::info );
+			CHECK( payload.empty() );
+			REQUIRE( framer.next( type, id, payload ) );
+			CHECK( type==MessageType::response );
+			CHECK( id==0x01020304 );
+			CHECK( payload==std::string(1000,'z') );
+			CHECK( framer.next( type, id, payload )==false );
+			CHECK( framer.bufferedSize()==0 );
+		}
+		WHEN( "Decoding one byte at a time" )
+		{
+			size_t numberOfFrames=0;
+			for( const char byte : encoded )
+			{
+				// Use reserve and commit for this one, to check that path works too
+				*framer.reserve( 1 )=byte;
+				framer.commit( 1 );
+				while( framer.next( type, id, payload ) ) ++numberOfFrames;
+			}
+			CHECK( numberOfFrames==3 );
+			CHECK( payload==std::string(1000,'z') );
+		}
+	}
+	GIVEN( "Invalid input" )
+	{
+		clientserver::BinaryFramer framer;
+		MessageType type;
+		uint32_t id;
+		std::string payload;
+
+		WHEN( "A frame is larger than the maximum" )
+		{
+			framer.setMaximumPayloadSize( 10 );
+			std::string encoded;
+			clientserver::BinaryFramer::encode( MessageType::request, 1, std::string(11,'a'), encoded );
+			// Should throw as soon as the header is there, not wait for the whole payload
+			framer.append( encoded.data(), clientserver::BinaryFramer::headerSize );
+			CHECK_THROWS_AS( framer.next( type, id, payload ), std::length_error& );
+		}
+		WHEN( "The message type is invalid" )
+		{
+			const std::string encoded( "\x00\x00\x00\x00\x09\x00\x00\x00\x00", 9 );
+			framer.append( encoded.data(), encoded.size() );
+			CHECK_THROWS_AS( framer.next( type, id, payload ), std::runtime_error& );
+		}
+	}
+}
@@ -0,0 +1,120 @@
+#include "catch.hpp"
+#include "clientserver/ChannelScheduler.h"
+#include <vector>
+
+namespace // Unnamed namespace for things only used in this file
+{
+	/** @brief What came out of one call to ChannelScheduler::next(). */
+	struct Fragment
+	{
+		uint32_t channel;
+		std::string data;
+		bool isLast;
+	};
+
+	/** @brief Takes everything the scheduler will give out at the moment. */
+	std::vector<Fragment> drain( clientserver::ChannelScheduler& scheduler )
+	{
+		std::vector<Fragment> fragments;
+		Fragment fragment;
+		clientserver::WebSocketFramer::Opcode opcode;
+		while( scheduler.next( fragment.channel, opcode, fragment.data, fragment.isLast ) ) fragments.push_back( fragment );
+		return fragments;
+	}
+} // end of the unnamed namespace
+
+SCENARIO( "Test that ChannelScheduler interleaves channels by priority and credit", "[clientserver]" )
+{
+	GIVEN( "A scheduler with 4 byte fragments" )
+	{
+		typedef clientserver::WebSocketFramer::Opcode Opcode;
+		clientserver::ChannelScheduler scheduler( 4 );
+		uint32_t channel;
+		Opcode opcode;
+		std::string fragment;
+		bool isLast;
+
+		WHEN( "Nothing has been queued" )
+		{
+			CHECK( !scheduler.next( channel, opcode, fragment, isLast ) );
+			CHECK( !scheduler.isOpen( 1 ) );
+			CHECK( !scheduler.addCredit( 1, 100 ) );
+			CHECK_THROWS( scheduler.push( 1, Opcode::binary, "abc" ) );
+		}
+		WHEN( "A large low priority message is queued before a small high priority one" )
+		{
+			scheduler.open( 1, 0, 1000 );
+			scheduler.open( 2, 5, 1000 );
+			scheduler.push( 1, Opcode::binary, "aaaabbbbcccc" );
+			REQUIRE( scheduler.next( channel, opcode, fragment, isLast ) );
+			CHECK( channel==1 );
+			CHECK( fragment=="aaaa" );
+			CHECK( !isLast );
+			CHECK( scheduler.queuedBytes()==8 );
+
+			// The high priority message gets in before the rest of the large one
+			scheduler.push( 2, Opcode::binary, "xy" );
+			std::vector<Fragment> fragments=::drain( scheduler );
+			REQUIRE( fragments.size()==3 );
+			CHECK( fragments[0].channel==2 );
+			CHECK( fragments[0].data=="xy" );
+			CHECK( fragments[0].isLast );
+			CHECK( fragments[1].channel==1 );
+			CHECK( fragments[1].data=="bbbb" );
+			CHECK( fragments[2].data=="cccc" );
+			CHECK( fragments[2].isLast );
+			CHECK( scheduler.queuedBytes()==0 );
+		}
+		WHEN( "Channels have the same priority" )
+		{
+			scheduler.open( 1, 3, 1000 );
+			scheduler.open( 2, 3, 1000 );
+			scheduler.push( 1, Opcode::binary, "11111111" );
+			scheduler.push( 2, Opcode::binary, "22222222" );
+			std::vector<Fragment> fragments=::drain( scheduler );
+			REQUIRE( fragments.size()==4 );
+			// They take turns
+			CHECK( fragments[0].channel!=fragments[1].channel );
+			CHECK( fragments[1].channel!=fragments[2].channel );
+			CHECK( fragments[2].channel!=fragments[3].channel );
+		}
+		WHEN( "A channel runs out of credit" )
+		{
+			scheduler.open( 1, 0, 6 );
+			scheduler.push( 1, Opcode::binary, "aaaabbbbcccc" );
+			std::vector<Fragment> fragments=::drain( scheduler );
+			REQUIRE( fragments.size()==2 );
+			CHECK( fragments[0].data=="aaaa" );
+			CHECK( fragments[1].data=="bb" );
+			CHECK( scheduler.queuedBytes()==6 );
+
+			// Opening it again changes the priority and adds to the credit
+			CHECK( scheduler.addCredit( 1, 3 ) );
+			scheduler.open( 1, 7, 3 );
+			fragments=::drain( scheduler );
+			REQUIRE( fragments.size()==2 );
+			CHECK( fragments[0].data=="bbcc" );
+			CHECK( fragments[1].data=="cc" );
+			CHECK( fragments[1].isLast );
+		}
+		WHEN( "Text messages have multibyte characters across fragment boundaries" )
+		{
+			scheduler.open( 1, 0, 1000 );
+			// "a" then three 3 byte characters, so the first fragment can only take "a" and one of them
+			const std::string text="a\xe2\x82\xac\xe2\x82\xac\xe2\x82\xac";
+			scheduler.push( 1, Opcode::text, text );
+			std::vector<Fragment> fragments=::drain( scheduler );
+			REQUIRE( fragments.size()==3 );
+			CHECK( fragments[0].data=="a\xe2\x82\xac" );
+			CHECK( fragments[1].data=="\xe2\x82\xac" );
+			CHECK( fragments[2].data=="\xe2\x82\xac" );
+			CHECK( fragments[2].isLast );
+
+			// Binary messages are cut anywhere
+			scheduler.push( 1, Opcode::binary, text );
+			fragments=::drain( scheduler );
+			REQUIRE( fragments.size()==3 );
+			CHECK( fragments[0].data.size()==4 );
+		}
+	}
+}
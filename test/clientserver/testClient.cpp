@@ -0,0 +1,306 @@
+#include "catch.hpp"
+#include "clientserver/Client.h"
+#include "clientserver/NativeClientTransport.h"
+#include "clientserver/WebSocketServer.h"
+#include "clientserver/TestCertificates.h"
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <unistd.h>
+
+namespace // Unnamed namespace for things only used in this file
+{
+	/** @brief Sends lots of requests, an info message and a batch straight after connecting, and checks everything comes back. */
+	void checkEchoes( clientserver::Client& client, const std::string& url )
+	{
+		std::mutex mutex;
+		std::condition_variable condition;
+		std::vector<std::string> infoMessages;
+		client.setDefaultInfoHandler( [&](const std::string& message)
+			{
+				std::lock_guard<std::mutex> lock( mutex );
+				infoMessages.push_back( message );
+				condition.notify_all();
+			});
+
+		const size_t numberOfRequests=1000;
+		const size_t requestWindow=8;
+		std::vector<std::string> responses( numberOfRequests );
+		size_t numberOfResponses=0;
+		size_t mostOutstanding=0;
+		std::vector<std::string> batchResponses;
+		client.setRequestWindow( requestWindow );
+		// Nothing has to wait for the connection to open, it's all queued until then
+		client.connect( url );
+		for( size_t index=0; index<numberOfRequests; ++index )
+		{
+			const std::string message=(index%100==0 ? std::string(100000,'a') : "request ")+std::to_string(index);
+			client.sendRequest( message, [&,index](const std::string& response)
+				{
+					const size_t outstanding=client.outstandingRequests();
+					std::lock_guard<std::mutex> lock( mutex );
+					mostOutstanding=std::max( mostOutstanding, outstanding );
+					responses[index]=response;
+					++numberOfResponses;
+					condition.notify_all();
+				});
+		}
+		client.sendInfo( "hello" );
+		client.sendBatch( { "first", "second" }, [&](const std::vector<std::string>& responses)
+			{
+				std::lock_guard<std::mutex> lock( mutex );
+				batchResponses=responses;
+				condition.notify_all();
+			});
+		CHECK( client.queuedRequests()>0 );
+
+		std::unique_lock<std::mutex> lock( mutex );
+		CHECK( condition.wait_for( lock, std::chrono::seconds(20), [&]{ return numberOfResponses==numberOfRequests && !infoMessages.empty() && !batchResponses.empty(); } ) );
+
+		size_t numberOfErrors=0;
+		for( size_t index=0; index<numberOfRequests; ++index )
+		{
+			const std::string message=(index%100==0 ? std::string(100000,'a') : "request ")+std::to_string(index);
+			if( responses[index]!="Response to "+message ) ++numberOfErrors;
+		}
+		CHECK( numberOfErrors==0 );
+		CHECK( mostOutstanding<=requestWindow );
+		REQUIRE( infoMessages.size()==1 );
+		CHECK( infoMessages.front()=="Info reply to hello" );
+		CHECK( batchResponses==std::vector<std::string>( { "Response to first", "Response to second" } ) );
+		CHECK( client.isConnected() );
+	}
+} // end of the unnamed namespace
+
+SCENARIO( "Test that Client pipelines requests to WebSocketServer and reconnects", "[clientserver]" )
+{
+	GIVEN( "A server with echo handlers" )
+	{
+		clientserver::WebSocketServer server;
+		server.setNumberOfThreads( 1 );
+		server.setDefaultRequestHandler( [](const std::string& message,std::weak_ptr<clientserver::IConnection> pConnection)->std::string
+			{
+				return "Response to "+message;
+			});
+		server.setDefaultInfoHandler( [&](const std::string& message,std::weak_ptr<clientserver::IConnection> pConnection)
+			{
+				auto pLockedConnection=pConnection.lock();
+				if( !pLockedConnection ) return;
+				if( message=="close me" ) pLockedConnection->close();
+				else pLockedConnection->sendInfo( "Info reply to "+message );
+			});
+
+		WHEN( "Connecting without TLS" )
+		{
+			REQUIRE_NOTHROW( server.listen( 0 ) );
+			clientserver::Client client;
+			checkEchoes( client, "ws://localhost:"+std::to_string(server.port())+"/" );
+			client.disconnect();
+			CHECK( !client.isConnected() );
+			CHECK_THROWS_AS( client.sendInfo( "too late" ), std::runtime_error& );
+		}
+		WHEN( "Connecting with TLS" )
+		{
+			const std::string certificateFilename="/tmp/clientserver-client-test-"+std::to_string(::getpid())+".crt";
+			const std::string keyFilename="/tmp/clientserver-client-test-"+std::to_string(::getpid())+".key";
+			REQUIRE( clientserver::test::createSelfSignedCertificate( certificateFilename, keyFilename ) );
+			server.setCertificateChainFile( certificateFilename );
+			server.setPrivateKeyFile( keyFilename );
+			REQUIRE_NOTHROW( server.listen( 0 ) );
+
+			std::unique_ptr<clientserver::NativeClientTransport> pTransport( new clientserver::NativeClientTransport );
+			pTransport->setTlsVerification( certificateFilename ); // the self signed certificate is its own authority
+			clientserver::Client client( std::move(pTransport) );
+			checkEchoes( client, "wss://localhost:"+std::to_string(server.port()) );
+
+			std::remove( certificateFilename.c_str() );
+			std::remove( keyFilename.c_str() );
+		}
+		WHEN( "The server drops the connection" )
+		{
+			// Streams are kept open, so that the connection drops while the client is waiting for the end
+			std::shared_ptr<clientserver::IResponseStream> pOpenStream;
+			server.setDefaultStreamingRequestHandler( [&](const std::string& message,std::shared_ptr<clientserver::IResponseStream> pStream,std::weak_ptr<clientserver::IConnection> pConnection)
+				{
+					pOpenStream=pStream;
+				});
+			REQUIRE_NOTHROW( server.listen( 0 ) );
+			std::mutex mutex;
+			std::condition_variable condition;
+			std::vector<bool> connectionEvents;
+			std::string streamError;
+			std::string response;
+
+			clientserver::Client client;
+			client.setReconnect( true, std::chrono::milliseconds(10), std::chrono::milliseconds(50) );
+			// The server has sessions turned off, so this shouldn't make any difference
+			client.setSessionResumption( true );
+			client.setConnectionHandler( [&](bool isConnected)
+				{
+					std::lock_guard<std::mutex> lock( mutex );
+					connectionEvents.push_back( isConnected );
+					condition.notify_all();
+				});
+			client.connect( "ws://localhost:"+std::to_string(server.port()) );
+			REQUIRE( client.waitUntilConnected( std::chrono::seconds(5) ) );
+
+			client.sendStreamingRequest( "never finishes", nullptr, [&](const std::string& error)
+				{
+					std::lock_guard<std::mutex> lock( mutex );
+					streamError=error;
+					condition.notify_all();
+				});
+			client.sendInfo( "close me" );
+			{
+				std::unique_lock<std::mutex> lock( mutex );
+				CHECK( condition.wait_for( lock, std::chrono::seconds(5), [&]{ return connectionEvents.size()>=3; } ) );
+				CHECK( connectionEvents==std::vector<bool>( { true, false, true } ) );
+				CHECK( !streamError.empty() );
+			}
+
+			client.sendRequest( "after reconnecting", [&](const std::string& message)
+				{
+					std::lock_guard<std::mutex> lock( mutex );
+					response=message;
+					condition.notify_all();
+				});
+			std::unique_lock<std::mutex> lock( mutex );
+			CHECK( condition.wait_for( lock, std::chrono::seconds(5), [&]{ return !response.empty(); } ) );
+			CHECK( response=="Response to after reconnecting" );
+		}
+		WHEN( "The server drops a connection that has a session" )
+		{
+			std::mutex mutex;
+			std::condition_variable condition;
+			std::shared_ptr<clientserver::IResponseStream> pOpenStream;
+			server.setSessionResumption( 256 );
+			server.setDefaultStreamingRequestHandler( [&](const std::string& message,std::shared_ptr<clientserver::IResponseStream> pStream,std::weak_ptr<clientserver::IConnection> pConnection)
+				{
+					std::lock_guard<std::mutex> lock( mutex );
+					pOpenStream=pStream;
+					condition.notify_all();
+				});
+			REQUIRE_NOTHROW( server.listen( 0 ) );
+			std::vector<bool> connectionEvents;
+			std::vector<std::string> chunks;
+			bool streamEnded=false;
+			std::string streamError;
+			const size_t numberOfRequests=100;
+			std::vector<size_t> responseCounts( numberOfRequests, 0 );
+			size_t numberOfResponses=0;
+
+			clientserver::Client client;
+			// Long enough that the stream can be written to while the client is disconnected
+			client.setReconnect( true, std::chrono::milliseconds(200), std::chrono::milliseconds(200) );
+			client.setSessionResumption( true );
+			client.setConnectionHandler( [&](bool isConnected)
+				{
+					std::lock_guard<std::mutex> lock( mutex );
+					connectionEvents.push_back( isConnected );
+					// The client has stopped reading the old connection, so this can only arrive by being replayed
+					if( !isConnected && pOpenStream ) pOpenStream->write( "while disconnected" );
+					condition.notify_all();
+				});
+			client.connect( "ws://localhost:"+std::to_string(server.port()) );
+			REQUIRE( client.waitUntilConnected( std::chrono::seconds(5) ) );
+
+			client.sendStreamingRequest( "kept open", [&](const std::string& chunk)
+				{
+					std::lock_guard<std::mutex> lock( mutex );
+					chunks.push_back( chunk );
+				}, [&](const std::string& error)
+				{
+					std::lock_guard<std::mutex> lock( mutex );
+					streamEnded=true;
+					streamError=error;
+					condition.notify_all();
+				});
+			{
+				std::unique_lock<std::mutex> lock( mutex );
+				REQUIRE( condition.wait_for( lock, std::chrono::seconds(5), [&]{ return pOpenStream!=nullptr; } ) );
+			}
+			// Whatever the server doesn't read before closing has to be sent again after resuming
+			client.sendInfo( "close me" );
+			for( size_t index=0; index<numberOfRequests; ++index )
+			{
+				client.sendRequest( "request "+std::to_string(index), [&,index](const std::string& response)
+					{
+						std::lock_guard<std::mutex> lock( mutex );
+						if( response=="Response to request "+std::to_string(index) ) ++responseCounts[index];
+						++numberOfResponses;
+						condition.notify_all();
+					});
+			}
+
+			std::unique_lock<std::mutex> lock( mutex );
+			CHECK( condition.wait_for( lock, std::chrono::seconds(5), [&]{ return connectionEvents.size()>=3 && numberOfResponses>=numberOfRequests; } ) );
+			CHECK( connectionEvents==std::vector<bool>( { true, false, true } ) );
+			CHECK( numberOfResponses==numberOfRequests );
+			CHECK( std::count( responseCounts.begin(), responseCounts.end(), 1 )==static_cast<long>(numberOfRequests) );
+			CHECK( !streamEnded );
+
+			// The stream still holds the old connection, but carries on over the new one
+			pOpenStream->write( "after resuming" );
+			pOpenStream->finish( std::string() );
+			CHECK( condition.wait_for( lock, std::chrono::seconds(5), [&]{ return streamEnded; } ) );
+			CHECK( streamError.empty() );
+			CHECK( chunks==std::vector<std::string>( { "while disconnected", "after resuming" } ) );
+		}
+		WHEN( "The session has expired by the time the client reconnects" )
+		{
+			std::mutex mutex;
+			std::condition_variable condition;
+			std::shared_ptr<clientserver::IResponseStream> pOpenStream;
+			server.setSessionResumption( 256, std::chrono::milliseconds(0) );
+			server.setDefaultStreamingRequestHandler( [&](const std::string& message,std::shared_ptr<clientserver::IResponseStream> pStream,std::weak_ptr<clientserver::IConnection> pConnection)
+				{
+					std::lock_guard<std::mutex> lock( mutex );
+					pOpenStream=pStream;
+				});
+			REQUIRE_NOTHROW( server.listen( 0 ) );
+			std::vector<bool> connectionEvents;
+			std::string streamError;
+
+			clientserver::Client client;
+			client.setReconnect( true, std::chrono::milliseconds(10), std::chrono::milliseconds(50) );
+			client.setSessionResumption( true );
+			client.setConnectionHandler( [&](bool isConnected)
+				{
+					std::lock_guard<std::mutex> lock( mutex );
+					connectionEvents.push_back( isConnected );
+					condition.notify_all();
+				});
+			client.connect( "ws://localhost:"+std::to_string(server.port()) );
+			REQUIRE( client.waitUntilConnected( std::chrono::seconds(5) ) );
+			client.sendStreamingRequest( "never finishes", nullptr, [&](const std::string& error)
+				{
+					std::lock_guard<std::mutex> lock( mutex );
+					streamError=error;
+					condition.notify_all();
+				});
+			client.sendInfo( "close me" );
+
+			std::unique_lock<std::mutex> lock( mutex );
+			CHECK( condition.wait_for( lock, std::chrono::seconds(5), [&]{ return connectionEvents.size()>=3 && !streamError.empty(); } ) );
+			CHECK( connectionEvents==std::vector<bool>( { true, false, true } ) );
+			CHECK( streamError=="The connection dropped and the session could not be resumed" );
+			CHECK( client.outstandingRequests()==0 );
+		}
+		WHEN( "Nothing is listening" )
+		{
+			REQUIRE_NOTHROW( server.listen( 0 ) );
+			const size_t unusedPort=server.port();
+			server.stop();
+
+			clientserver::Client client;
+			CHECK_THROWS_AS( client.connect( "http://localhost:"+std::to_string(unusedPort) ), std::invalid_argument& );
+			CHECK_THROWS_AS( client.sendInfo( "not connected" ), std::runtime_error& );
+			client.connect( "ws://localhost:"+std::to_string(unusedPort) );
+			CHECK( !client.waitUntilConnected( std::chrono::seconds(5) ) );
+			CHECK_THROWS_AS( client.sendInfo( "not connected" ), std::runtime_error& );
+		}
+		server.stop();
+	}
+}
@@ -0,0 +1,205 @@
+#include "catch.hpp"
+#include "clientserver/ConnectionRegistry.h"
+#include "clientserver/WebSocketServer.h"
+#include "clientserver/WebSocketClient.h"
+#include "clientserver/TcpServer.h"
+#include "clientserver/TcpClient.h"
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <vector>
+
+namespace // Unnamed namespace for things only used in this file
+{
+	/** @brief Just records what was sent to it. */
+	class MockConnection : public clientserver::IConnection
+	{
+	public:
+		MockConnection() : connectionId_(0), infoCount_(0) {}
+		virtual bool isConnected() override { return true; }
+		virtual void close() override {}
+		virtual void sendInfo( const std::string& message ) override { ++infoCount_; }
+		virtual uint64_t connectionId() const override { return connectionId_; }
+		uint64_t connectionId_;
+		std::atomic<size_t> infoCount_;
+	};
+
+	/** @brief Waits for the condition to become true, for up to five seconds. */
+	bool waitFor( std::function<bool()> condition )
+	{
+		const auto endTime=std::chrono::steady_clock::now()+std::chrono::seconds(5);
+		while( !condition() && std::chrono::steady_clock::now()<endTime ) std::this_thread::sleep_for( std::chrono::milliseconds(5) );
+		return condition();
+	}
+} // end of the unnamed namespace
+
+SCENARIO( "Test that ConnectionRegistry finds connections by id", "[clientserver]" )
+{
+	GIVEN( "A registry with a few connections" )
+	{
+		clientserver::ConnectionRegistry registry;
+		std::vector<std::shared_ptr<::MockConnection> > connections;
+		for( size_t index=0; index<5; ++index )
+		{
+			connections.push_back( std::make_shared<::MockConnection>() );
+			connections.back()->connectionId_=registry.add( connections.back() );
+			CHECK( connections.back()->connectionId_!=0 );
+		}
+		CHECK( registry.size()==5 );
+
+		WHEN( "Looking them up" )
+		{
+			for( const auto& pConnection : connections ) CHECK( registry.find( pConnection->connectionId_ )==pConnection );
+			CHECK( registry.find( 0 )==nullptr );
+			CHECK( registry.find( 12345678901234ull )==nullptr );
+			CHECK( registry.forEach( []( uint64_t id, const std::shared_ptr<clientserver::IConnection>& pConnection ){ CHECK( pConnection->connectionId()==id ); } )==5 );
+		}
+		WHEN( "One is removed and its slot is used again" )
+		{
+			const uint64_t removedId=connections[2]->connectionId_;
+			registry.remove( removedId );
+			CHECK( registry.size()==4 );
+			CHECK( registry.find( removedId )==nullptr );
+			registry.remove( removedId ); // Should do nothing the second time
+			CHECK( registry.size()==4 );
+
+			auto pNewConnection=std::make_shared<::MockConnection>();
+			pNewConnection->connectionId_=registry.add( pNewConnection );
+			// The old id must not find the new connection, even if it's in the same slot
+			CHECK( pNewConnection->connectionId_!=removedId );
+			CHECK( registry.find( removedId )==nullptr );
+			CHECK( registry.find( pNewConnection->connectionId_ )==pNewConnection );
+			CHECK( registry.size()==5 );
+		}
+		WHEN( "A connection is destroyed without being removed" )
+		{
+			const uint64_t id=connections[0]->connectionId_;
+			connections.erase( connections.begin() );
+			CHECK( registry.find( id )==nullptr );
+			CHECK( registry.forEach( []( uint64_t id, const std::shared_ptr<clientserver::IConnection>& pConnection ){} )==4 );
+		}
+		WHEN( "Broadcasting" )
+		{
+			CHECK( registry.broadcastInfo( "hello" )==5 );
+			for( const auto& pConnection : connections ) CHECK( pConnection->infoCount_==1 );
+		}
+	}
+	GIVEN( "Readers enumerating while connections come and go" )
+	{
+		clientserver::ConnectionRegistry registry;
+		std::vector<std::shared_ptr<::MockConnection> > permanent;
+		for( size_t index=0; index<100; ++index )
+		{
+			permanent.push_back( std::make_shared<::MockConnection>() );
+			permanent.back()->connectionId_=registry.add( permanent.back() );
+		}
+
+		std::atomic<bool> stopping( false );
+		std::atomic<size_t> badReads( 0 );
+		std::vector<std::thread> readers;
+		for( size_t index=0; index<3; ++index )
+		{
+			readers.emplace_back( [&]()
+				{
+					while( !stopping )
+					{
+						size_t permanentSeen=0;
+						registry.forEach( [&]( uint64_t id, const std::shared_ptr<clientserver::IConnection>& pConnection )
+							{
+								if( pConnection->connectionId()!=id && pConnection->connectionId()!=0 ) ++badReads;
+								if( static_cast<uint32_t>(id)<100 ) ++permanentSeen;
+							});
+						// The first hundred slots are never removed, so every pass has to see all of them
+						if( permanentSeen!=100 ) ++badReads;
+						if( registry.find( permanent[17]->connectionId_ )!=permanent[17] ) ++badReads;
+					}
+				});
+		}
+
+		// Enough to go over more than one chunk of slots, and to make entries be reclaimed while being read
+		for( size_t round=0; round<20; ++round )
+		{
+			std::vector<std::shared_ptr<::MockConnection> > temporary;
+			for( size_t index=0; index<5000; ++index )
+			{
+				temporary.push_back( std::make_shared<::MockConnection>() );
+				temporary.back()->connectionId_=registry.add( temporary.back() );
+			}
+			for( const auto& pConnection : temporary ) registry.remove( pConnection->connectionId_ );
+		}
+		stopping=true;
+		for( auto& reader : readers ) reader.join();
+
+		CHECK( badReads==0 );
+		CHECK( registry.size()==100 );
+	}
+}
+
+SCENARIO( "Test that the servers keep their connections in the registry", "[clientserver]" )
+{
+	GIVEN( "A WebSocketServer and TcpServer sharing a registry" )
+	{
+		auto pRegistry=std::make_shared<clientserver::ConnectionRegistry>();
+		std::mutex mutex;
+		std::vector<uint64_t> handlerIds;
+		auto handler=[&]( const std::string& message, std::weak_ptr<clientserver::IConnection> pConnection )->std::string
+			{
+				std::lock_guard<std::mutex> lock( mutex );
+				if( auto pLockedConnection=pConnection.lock() ) handlerIds.push_back( pLockedConnection->connectionId() );
+				return message;
+			};
+
+		clientserver::WebSocketServer server;
+		server.setNumberOfThreads( 1 );
+		server.setConnectionRegistry( pRegistry );
+		server.setDefaultRequestHandler( handler );
+		clientserver::TcpServer tcpServer;
+		tcpServer.setConnectionRegistry( pRegistry );
+		tcpServer.setDefaultRequestHandler( handler );
+		CHECK( server.connectionRegistry()==pRegistry );
+		REQUIRE_NOTHROW( server.listen( 0 ) );
+		REQUIRE_NOTHROW( tcpServer.listen( 0 ) );
+
+		std::mutex infoMutex;
+		std::vector<std::string> infos;
+		auto infoHandler=[&]( const std::string& message ){ std::lock_guard<std::mutex> lock( infoMutex ); infos.push_back( message ); };
+		clientserver::WebSocketClient client;
+		clientserver::TcpClient tcpClient;
+		client.setDefaultInfoHandler( infoHandler );
+		tcpClient.setDefaultInfoHandler( infoHandler );
+		REQUIRE_NOTHROW( client.connect( "localhost", server.port() ) );
+		REQUIRE_NOTHROW( tcpClient.connect( "localhost", tcpServer.port() ) );
+
+		WHEN( "Both clients send a request and a broadcast is made" )
+		{
+			std::atomic<size_t> responses( 0 );
+			client.sendRequest( "one", [&]( const std::string& response ){ ++responses; } );
+			tcpClient.sendRequest( "two", [&]( const std::string& response ){ ++responses; } );
+			REQUIRE( ::waitFor( [&]{ return responses==2; } ) );
+
+			CHECK( pRegistry->size()==2 );
+			{
+				std::lock_guard<std::mutex> lock( mutex );
+				REQUIRE( handlerIds.size()==2 );
+				CHECK( handlerIds[0]!=handlerIds[1] );
+				for( const auto id : handlerIds ) CHECK( pRegistry->find( id )!=nullptr );
+			}
+			CHECK( pRegistry->broadcastInfo( "everyone" )==2 );
+			CHECK( ::waitFor( [&]{ std::lock_guard<std::mutex> lock( infoMutex ); return infos.size()==2; } ) );
+		}
+		WHEN( "The clients disconnect" )
+		{
+			REQUIRE( ::waitFor( [&]{ return pRegistry->size()==2; } ) );
+			client.disconnect();
+			tcpClient.disconnect();
+			CHECK( ::waitFor( [&]{ return pRegistry->size()==0; } ) );
+		}
+
+		client.disconnect();
+		tcpClient.disconnect();
+		tcpServer.stop();
+		server.stop();
+		CHECK( pRegistry->size()==0 );
+	}
+}
@@ -0,0 +1,102 @@
+#include "catch.hpp"
+#include "clientserver/CpuTopology.h"
+#include <thread>
+#include <stdexcept>
+#include <sched.h>
+
+SCENARIO( "Test that CpuTopology parses CPU lists and places threads by node", "[clientserver]" )
+{
+	GIVEN( "CPU lists in the kernel's format" )
+	{
+		CHECK( clientserver::CpuTopology::parseCpuList( "0" )==std::vector<int>({ 0 }) );
+		CHECK( clientserver::CpuTopology::parseCpuList( "0-3,8,10-11\n" )==std::vector<int>({ 0, 1, 2, 3, 8, 10, 11 }) );
+		CHECK( clientserver::CpuTopology::parseCpuList( "5,1-2,2" )==std::vector<int>({ 1, 2, 5 }) );
+		CHECK_THROWS( clientserver::CpuTopology::parseCpuList( "" ) );
+		CHECK_THROWS( clientserver::CpuTopology::parseCpuList( "1-" ) );
+		CHECK_THROWS( clientserver::CpuTopology::parseCpuList( "3-1" ) );
+		CHECK_THROWS( clientserver::CpuTopology::parseCpuList( "a,b" ) );
+		CHECK_THROWS( clientserver::CpuTopology::parseCpuList( "-1" ) );
+	}
+	GIVEN( "A machine with two nodes of four CPUs" )
+	{
+		const clientserver::CpuTopology topology( { { 0, 1, 2, 3 }, { 4, 5, 6, 7 } } );
+		CHECK( topology.nodes()==std::vector<int>({ 0, 1 }) );
+		CHECK( topology.nodeOfCpu( 5 )==1 );
+		CHECK( topology.nodeOfCpu( 8 )==-1 );
+
+		WHEN( "Placing four event loops and six handler threads by node" )
+		{
+			const auto placement=topology.placeByNode( 4, 6 );
+			REQUIRE( placement.eventLoops.size()==4 );
+			REQUIRE( placement.handlerPools.size()==2 );
+			// Alternating between the nodes, and on different CPUs within each
+			CHECK( placement.eventLoops[0].cpus==std::vector<int>({ 0 }) );
+			CHECK( placement.eventLoops[1].cpus==std::vector<int>({ 4 }) );
+			CHECK( placement.eventLoops[2].cpus==std::vector<int>({ 1 }) );
+			CHECK( placement.eventLoops[3].cpus==std::vector<int>({ 5 }) );
+			for( size_t index=0; index<placement.eventLoops.size(); ++index )
+			{
+				const size_t pool=placement.eventLoopPools[index];
+				CHECK( placement.handlerPools[pool].node==placement.eventLoops[index].node );
+			}
+			CHECK( placement.handlerPools[1].cpus==std::vector<int>({ 4, 5, 6, 7 }) );
+			CHECK( placement.handlerPoolSizes==std::vector<size_t>({ 3, 3 }) );
+		}
+		WHEN( "Placing one event loop by node" )
+		{
+			// The other node has nothing to handle, so gets no pool
+			const auto placement=topology.placeByNode( 1, 6 );
+			REQUIRE( placement.handlerPools.size()==1 );
+			CHECK( placement.handlerPools[0].node==0 );
+			CHECK( placement.handlerPoolSizes[0]==6 );
+		}
+		WHEN( "Placing on explicit CPUs" )
+		{
+			const auto placement=topology.placeOnCpus( 3, { 4, 0 }, 3, { 1, 6, 7 } );
+			REQUIRE( placement.handlerPools.size()==2 );
+			CHECK( placement.handlerPools[0].node==0 );
+			CHECK( placement.handlerPools[0].cpus==std::vector<int>({ 1 }) );
+			CHECK( placement.handlerPools[1].cpus==std::vector<int>({ 6, 7 }) );
+			CHECK( placement.handlerPoolSizes==std::vector<size_t>({ 1, 2 }) );
+			CHECK( placement.eventLoops[0].cpus==std::vector<int>({ 4 }) );
+			CHECK( placement.eventLoops[2].cpus==std::vector<int>({ 4 }) );
+			CHECK( placement.eventLoopPools==std::vector<size_t>({ 1, 0, 1 }) );
+		}
+		WHEN( "Only the event loops are pinned" )
+		{
+			const auto placement=topology.placeOnCpus( 2, { 0, 5 }, 4, {} );
+			REQUIRE( placement.handlerPools.size()==1 );
+			CHECK( placement.handlerPools[0].cpus.empty() );
+			CHECK( placement.handlerPools[0].node==-1 );
+			CHECK( placement.handlerPoolSizes[0]==4 );
+			CHECK( placement.eventLoopPools==std::vector<size_t>({ 0, 0 }) );
+		}
+		WHEN( "Placing on CPUs that don't exist" )
+		{
+			CHECK_THROWS( topology.placeOnCpus( 1, { 9 }, 1, {} ) );
+			CHECK_THROWS( topology.placeOnCpus( 1, {}, 1, { 0, 12 } ) );
+		}
+	}
+	GIVEN( "This machine" )
+	{
+		const clientserver::CpuTopology topology=clientserver::CpuTopology::detect();
+		REQUIRE( !topology.nodes().empty() );
+		const int node=topology.nodes().front();
+		const int cpu=topology.cpusOnNode( node ).front();
+		CHECK( topology.nodeOfCpu( cpu )==node );
+
+		WHEN( "A thread is moved to the first CPU" )
+		{
+			bool succeeded=false;
+			int runningOn=-1;
+			std::thread thread( [&]()
+				{
+					succeeded=clientserver::CpuTopology::apply( clientserver::CpuTopology::Affinity{ { cpu }, node } );
+					runningOn=::sched_getcpu();
+				});
+			thread.join();
+			CHECK( succeeded );
+			CHECK( runningOn==cpu );
+		}
+	}
+}
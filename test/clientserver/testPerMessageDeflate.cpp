@@ -0,0 +1,265 @@
+#include "catch.hpp"
+#include "clientserver/PerMessageDeflate.h"
+#include "clientserver/DeflateStreamPool.h"
+#include "clientserver/WebSocketFramer.h"
+#include <stdexcept>
+#include <vector>
+#include <memory>
+
+namespace // Unnamed namespace for things only used in this file
+{
+	/** @brief Something that compresses well, but not to almost nothing, a bit like a JSON status message. */
+	std::string exampleMessage( size_t index )
+	{
+		std::string message;
+		for( size_t entry=0; entry<20; ++entry ) message+="{\"name\":\"sensor"+std::to_string(entry)+"\",\"value\":"+std::to_string((index*7919+entry*104729)%1000)+"},";
+		return message;
+	}
+
+	std::string compress( clientserver::PerMessageDeflate& perMessageDeflate, const std::string& message )
+	{
+		std::string output;
+		perMessageDeflate.compress( message.data(), message.size(), output );
+		return output;
+	}
+
+	std::string decompress( clientserver::PerMessageDeflate& perMessageDeflate, const std::string& message, size_t maximumSize=1024*1024 )
+	{
+		std::string output;
+		perMessageDeflate.decompress( message.data(), message.size(), output, maximumSize );
+		return output;
+	}
+} // end of the unnamed namespace
+
+SCENARIO( "Test that PerMessageDeflate negotiates the extension parameters", "[clientserver]" )
+{
+	typedef clientserver::PerMessageDeflate PerMessageDeflate;
+
+	GIVEN( "A server with the default configuration" )
+	{
+		PerMessageDeflate::Configuration configuration;
+		PerMessageDeflate::Parameters agreed;
+		std::string response;
+
+		WHEN( "Given what browsers usually offer" )
+		{
+			REQUIRE( PerMessageDeflate::acceptOffer( "permessage-deflate; client_max_window_bits", configuration, agreed, response ) );
+			CHECK( response=="permessage-deflate" );
+			CHECK( agreed.compressNoContextTakeover==false );
+			CHECK( agreed.decompressNoContextTakeover==false );
+			CHECK( agreed.compressWindowBits==15 );
+			CHECK( agreed.decompressWindowBits==15 );
+		}
+		WHEN( "The client asks for no context takeover and smaller windows" )
+		{
+			REQUIRE( PerMessageDeflate::acceptOffer( "permessage-deflate; server_no_context_takeover; client_no_context_takeover; server_max_window_bits=10; client_max_window_bits=\"12\"", configuration, agreed, response ) );
+			CHECK( response=="permessage-deflate; server_no_context_takeover; client_no_context_takeover; server_max_window_bits=10; client_max_window_bits=12" );
+			CHECK( agreed.compressNoContextTakeover==true );
+			CHECK( agreed.decompressNoContextTakeover==true );
+			CHECK( agreed.compressWindowBits==10 );
+			CHECK( agreed.decompressWindowBits==12 );
+		}
+		WHEN( "The first offer can't be accepted" )
+		{
+			// An 8 bit window can't be done by zlib, and unknown parameters mean the offer has to be declined
+			REQUIRE( PerMessageDeflate::acceptOffer( "permessage-deflate; server_max_window_bits=8, permessage-deflate; unknown, x-webkit-deflate-frame, permessage-deflate; server_no_context_takeover", configuration, agreed, response ) );
+			CHECK( response=="permessage-deflate; server_no_context_takeover" );
+		}
+		WHEN( "Given offers that can't be accepted" )
+		{
+			CHECK_FALSE( PerMessageDeflate::acceptOffer( "", configuration, agreed, response ) );
+			CHECK_FALSE( PerMessageDeflate::acceptOffer( "x-webkit-deflate-frame", configuration, agreed, response ) );
+			CHECK_FALSE( PerMessageDeflate::acceptOffer( "permessage-deflate; server_max_window_bits=16", configuration, agreed, response ) );
+			CHECK_FALSE( PerMessageDeflate::acceptOffer( "permessage-deflate; server_no_context_takeover; server_no_context_takeover", configuration, agreed, response ) );
+		}
+	}
+
+	GIVEN( "A server that wants to save memory" )
+	{
+		PerMessageDeflate::Configuration configuration;
+		configuration.contextTakeover=false;
+		configuration.peerContextTakeover=false;
+		configuration.windowBits=11;
+		PerMessageDeflate::Parameters agreed;
+		std::string response;
+
+		WHEN( "The client can limit its window" )
+		{
+			REQUIRE( PerMessageDeflate::acceptOffer( "permessage-deflate; client_max_window_bits", configuration, agreed, response ) );
+			CHECK( response=="permessage-deflate; server_no_context_takeover; client_no_context_takeover; server_max_window_bits=11; client_max_window_bits=11" );
+			CHECK( agreed.decompressWindowBits==11 );
+		}
+		WHEN( "The client can't limit its window" )
+		{
+			REQUIRE( PerMessageDeflate::acceptOffer( "permessage-deflate", configuration, agreed, response ) );
+			CHECK( response=="permessage-deflate; server_no_context_takeover; client_no_context_takeover; server_max_window_bits=11" );
+			CHECK( agreed.decompressWindowBits==15 );
+		}
+		WHEN( "A client with the same configuration reads the response" )
+		{
+			const std::string offer=PerMessageDeflate::createOffer( configuration );
+			CHECK( offer=="permessage-deflate; client_max_window_bits=11; server_max_window_bits=11; client_no_context_takeover; server_no_context_takeover" );
+			REQUIRE( PerMessageDeflate::acceptOffer( offer, configuration, agreed, response ) );
+
+			PerMessageDeflate::Parameters clientAgreed;
+			REQUIRE( PerMessageDeflate::acceptResponse( response, configuration, clientAgreed ) );
+			CHECK( clientAgreed.compressNoContextTakeover==agreed.decompressNoContextTakeover );
+			CHECK( clientAgreed.decompressNoContextTakeover==agreed.compressNoContextTakeover );
+			CHECK( clientAgreed.compressWindowBits==agreed.decompressWindowBits );
+			CHECK( clientAgreed.decompressWindowBits==agreed.compressWindowBits );
+		}
+	}
+
+	GIVEN( "A client reading the server's response" )
+	{
+		PerMessageDeflate::Configuration configuration;
+		PerMessageDeflate::Parameters agreed;
+		CHECK_FALSE( PerMessageDeflate::acceptResponse( "", configuration, agreed ) );
+		CHECK_THROWS_AS( PerMessageDeflate::acceptResponse( "x-webkit-deflate-frame", configuration, agreed ), std::runtime_error& );
+		CHECK_THROWS_AS( PerMessageDeflate::acceptResponse( "permessage-deflate; unknown", configuration, agreed ), std::runtime_error& );
+		CHECK_THROWS_AS( PerMessageDeflate::acceptResponse( "permessage-deflate, permessage-deflate", configuration, agreed ), std::runtime_error& );
+	}
+}
+
+SCENARIO( "Test that PerMessageDeflate compresses and decompresses messages", "[clientserver]" )
+{
+	typedef clientserver::PerMessageDeflate PerMessageDeflate;
+
+	GIVEN( "Both ends of a connection with context takeover" )
+	{
+		PerMessageDeflate::Configuration configuration;
+		PerMessageDeflate::Parameters parameters;
+		PerMessageDeflate sender( configuration, parameters );
+		PerMessageDeflate receiver( configuration, parameters );
+
+		WHEN( "Sending several similar messages" )
+		{
+			std::vector<size_t> compressedSizes;
+			for( size_t index=0; index<5; ++index )
+			{
+				const std::string message=::exampleMessage( index );
+				const std::string compressed=::compress( sender, message );
+				compressedSizes.push_back( compressed.size() );
+				CHECK( compressed.size()<message.size() );
+				CHECK( ::decompress( receiver, compressed )==message );
+			}
+			// Later messages can refer back to earlier ones
+			CHECK( compressedSizes.back()<compressedSizes.front() );
+			CHECK( sender.holdsStreams() );
+			CHECK( receiver.holdsStreams() );
+		}
+		WHEN( "The message is given in pieces" )
+		{
+			const std::string first="{\"id\":12,\"payload\":";
+			const std::string second=::exampleMessage( 0 );
+			std::string compressed;
+			sender.compress( first.data(), first.size(), compressed, false );
+			sender.compress( second.data(), second.size(), compressed );
+			CHECK( ::decompress( receiver, compressed )==first+second );
+		}
+		WHEN( "Checking the example from RFC 7692 section 7.2.3.1" )
+		{
+			CHECK( ::compress( sender, "Hello" )==std::string( "\xf2\x48\xcd\xc9\xc9\x07\x00", 7 ) );
+			CHECK( ::decompress( receiver, std::string( "\xf2\x48\xcd\xc9\xc9\x07\x00", 7 ) )=="Hello" );
+			// With context takeover the second "Hello" refers back to the first (section 7.2.3.2)
+			CHECK( ::decompress( receiver, std::string( "\xf2\x00\x11\x00\x00", 5 ) )=="Hello" );
+		}
+		WHEN( "Receiving a message that decompresses to more than the maximum" )
+		{
+			const std::string compressed=::compress( sender, std::string( 100000, 'a' ) );
+			REQUIRE( compressed.size()<1000 );
+			CHECK_THROWS_AS( ::decompress( receiver, compressed, 99999 ), std::length_error& );
+		}
+		WHEN( "Receiving invalid compressed data" )
+		{
+			CHECK_THROWS_AS( ::decompress( receiver, std::string( "\xff\xff\xff\xff", 4 ) ), std::runtime_error& );
+		}
+	}
+
+	GIVEN( "Many connections without context takeover sharing a pool" )
+	{
+		PerMessageDeflate::Configuration configuration;
+		PerMessageDeflate::Parameters parameters;
+		parameters.compressNoContextTakeover=true;
+		parameters.decompressNoContextTakeover=true;
+		clientserver::DeflateStreamPool pool( 4 );
+		std::vector<std::unique_ptr<PerMessageDeflate> > connections;
+		for( size_t index=0; index<100; ++index ) connections.emplace_back( new PerMessageDeflate( configuration, parameters, &pool ) );
+		PerMessageDeflate peer( configuration, parameters );
+
+		WHEN( "Each connection sends and receives messages" )
+		{
+			for( size_t index=0; index<connections.size(); ++index )
+			{
+				const std::string message=::exampleMessage( index );
+				CHECK( ::decompress( peer, ::compress( *connections[index], message ) )==message );
+				CHECK( ::decompress( *connections[index], ::compress( peer, message ) )==message );
+			}
+			THEN( "None of the idle connections hold any zlib state, and only one stream of each kind was created" )
+			{
+				for( const auto& pConnection : connections ) CHECK_FALSE( pConnection->holdsStreams() );
+				CHECK( pool.createdStreams()==2 );
+				CHECK( pool.pooledStreams()==2 );
+			}
+		}
+	}
+}
+
+SCENARIO( "Test that WebSocketFramer handles compressed messages", "[clientserver]" )
+{
+	typedef clientserver::WebSocketFramer WebSocketFramer;
+	typedef clientserver::WebSocketFramer::Opcode Opcode;
+
+	GIVEN( "A client framer with permessage-deflate" )
+	{
+		clientserver::PerMessageDeflate::Configuration configuration;
+		clientserver::PerMessageDeflate::Parameters parameters;
+		clientserver::PerMessageDeflate perMessageDeflate( configuration, parameters );
+		WebSocketFramer framer( WebSocketFramer::Role::client );
+		framer.setCompressor( &perMessageDeflate );
+		Opcode opcode;
+		std::string payload;
+
+		WHEN( "Decoding the compressed single frame and fragmented examples from RFC 7692 section 7.2.3" )
+		{
+			framer.append( "\xc1\x07\xf2\x48\xcd\xc9\xc9\x07\x00", 9 );
+			framer.append( "\x41\x03\xf2\x48\xcd" "\x80\x04\xc9\xc9\x07\x00", 11 );
+			REQUIRE( framer.next( opcode, payload ) );
+			CHECK( opcode==Opcode::text );
+			CHECK( payload=="Hello" );
+			// The second message uses the same stream, but doesn't refer back to the first
+			REQUIRE( framer.next( opcode, payload ) );
+			CHECK( opcode==Opcode::text );
+			CHECK( payload=="Hello" );
+		}
+		WHEN( "Decoding a compressed message that is not valid UTF-8" )
+		{
+			std::string compressed;
+			perMessageDeflate.compress( "\xc3\x28", 2, compressed );
+			std::string frame;
+			WebSocketFramer::encodeHeader( Opcode::text, compressed.size(), frame, nullptr, true );
+			framer.append( frame.data(), frame.size() );
+			framer.append( compressed.data(), compressed.size() );
+			CHECK_THROWS_AS( framer.next( opcode, payload ), std::invalid_argument& );
+		}
+		WHEN( "RSV1 is set on a control frame" )
+		{
+			framer.append( "\xc9\x00", 2 );
+			CHECK_THROWS_AS( framer.next( opcode, payload ), std::runtime_error& );
+		}
+		WHEN( "RSV1 is set on a continuation frame" )
+		{
+			framer.append( "\x01\x01" "a" "\xc0\x01" "b", 6 );
+			CHECK_THROWS_AS( framer.next( opcode, payload ), std::runtime_error& );
+		}
+	}
+
+	GIVEN( "A framer without permessage-deflate" )
+	{
+		WebSocketFramer framer( WebSocketFramer::Role::client );
+		Opcode opcode;
+		std::string payload;
+		framer.append( "\xc1\x07\xf2\x48\xcd\xc9\xc9\x07\x00", 9 );
+		CHECK_THROWS_AS( framer.next( opcode, payload ), std::runtime_error& );
+	}
+}
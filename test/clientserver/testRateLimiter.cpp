@@ -0,0 +1,135 @@
+#include "catch.hpp"
+#include "clientserver/RateLimiter.h"
+#include "clientserver/WebSocketServer.h"
+#include "clientserver/WebSocketClient.h"
+#include "clientserver/TcpServer.h"
+#include "clientserver/TcpClient.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+namespace // Unnamed namespace for things only used in this file
+{
+	/** @brief Sends a request with either type of client and waits for the response. */
+	template<class T_Client>
+	std::string request( T_Client& client, const std::string& message )
+	{
+		std::mutex mutex;
+		std::condition_variable condition;
+		std::string response;
+		bool hasResponse=false;
+		client.sendRequest( message, [&](const std::string& reply)
+			{
+				std::lock_guard<std::mutex> lock( mutex );
+				response=reply;
+				hasResponse=true;
+				condition.notify_all();
+			});
+		std::unique_lock<std::mutex> lock( mutex );
+		condition.wait_for( lock, std::chrono::seconds(5), [&]{ return hasResponse; } );
+		return response;
+	}
+} // end of the unnamed namespace
+
+SCENARIO( "Test that RateLimiter lets messages through at the configured rate", "[clientserver]" )
+{
+	typedef clientserver::RateLimiter::Verdict Verdict;
+
+	GIVEN( "A limit of five messages in a burst and 100 bytes for each connection" )
+	{
+		clientserver::RateLimiter rateLimiter( clientserver::RateLimiter::Configuration{ { 20, 5 }, { 100, 0 }, { 0, 0 }, { 0, 0 } } );
+		clientserver::RateLimiter::ConnectionState state;
+
+		WHEN( "Sending more small messages than the burst" )
+		{
+			for( size_t index=0; index<5; ++index ) CHECK( rateLimiter.admit( state, 1 )==Verdict::allowed );
+			CHECK( rateLimiter.admit( state, 1 )==Verdict::connectionMessages );
+			CHECK( rateLimiter.admit( state, 1 )==Verdict::connectionMessages );
+			CHECK( rateLimiter.rejections( Verdict::connectionMessages )==2 );
+			CHECK( rateLimiter.rejections( Verdict::connectionBytes )==0 );
+
+			// Other connections have their own buckets
+			clientserver::RateLimiter::ConnectionState otherState;
+			CHECK( rateLimiter.admit( otherState, 1 )==Verdict::allowed );
+
+			// Refilled at 20 a second
+			std::this_thread::sleep_for( std::chrono::milliseconds(120) );
+			CHECK( rateLimiter.admit( state, 1 )==Verdict::allowed );
+		}
+		WHEN( "Sending more bytes than the burst" )
+		{
+			CHECK( rateLimiter.admit( state, 60 )==Verdict::allowed );
+			CHECK( rateLimiter.admit( state, 60 )==Verdict::connectionBytes );
+			// Rejected messages don't use up the message tokens
+			for( size_t index=0; index<4; ++index ) CHECK( rateLimiter.admit( state, 10 )==Verdict::allowed );
+			CHECK( rateLimiter.rejections( Verdict::connectionBytes )==1 );
+		}
+		WHEN( "Sending a message larger than the burst" )
+		{
+			// Gets through a full bucket, but then has to be paid back
+			CHECK( rateLimiter.admit( state, 250 )==Verdict::allowed );
+			CHECK( rateLimiter.admit( state, 1 )==Verdict::connectionBytes );
+		}
+	}
+	GIVEN( "Only per address limits" )
+	{
+		clientserver::RateLimiter rateLimiter( clientserver::RateLimiter::Configuration{ { 0, 0 }, { 0, 0 }, { 1, 2 }, { 0, 0 } } );
+
+		WHEN( "The connection has no address" )
+		{
+			clientserver::RateLimiter::ConnectionState state;
+			for( size_t index=0; index<10; ++index ) CHECK( rateLimiter.admit( state, 1 )==Verdict::allowed );
+			CHECK( rateLimiter.numberOfAddresses()==0 );
+		}
+	}
+	GIVEN( "Invalid limits" )
+	{
+		CHECK_THROWS( clientserver::RateLimiter( clientserver::RateLimiter::Configuration{ { -1, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 } } ) );
+		CHECK_THROWS( clientserver::RateLimiter( clientserver::RateLimiter::Configuration{ { 0, 0 }, { 0, 0 }, { 0, 0 }, { 1, -5 } } ) );
+	}
+}
+
+SCENARIO( "Test that the servers check messages against a RateLimiter", "[clientserver]" )
+{
+	GIVEN( "A WebSocketServer and TcpServer sharing a limit of three messages for each address" )
+	{
+		auto pRateLimiter=std::make_shared<clientserver::RateLimiter>( clientserver::RateLimiter::Configuration{ { 0, 0 }, { 0, 0 }, { 0.01, 3 }, { 0, 0 } } );
+		auto handler=[](const std::string& message,std::weak_ptr<clientserver::IConnection> pConnection){ return "echo "+message; };
+
+		clientserver::WebSocketServer server;
+		server.setNumberOfThreads( 1 );
+		server.setDefaultRequestHandler( handler );
+		server.setRateLimiter( pRateLimiter );
+		clientserver::TcpServer tcpServer;
+		tcpServer.setDefaultRequestHandler( handler );
+		tcpServer.setRateLimiter( pRateLimiter );
+		REQUIRE_NOTHROW( server.listen( 0 ) );
+		REQUIRE_NOTHROW( tcpServer.listen( 0 ) );
+
+		clientserver::WebSocketClient client;
+		clientserver::WebSocketClient otherClient;
+		clientserver::TcpClient tcpClient;
+		REQUIRE_NOTHROW( client.connect( "localhost", server.port() ) );
+		REQUIRE_NOTHROW( otherClient.connect( "localhost", server.port() ) );
+		REQUIRE_NOTHROW( tcpClient.connect( "localhost", tcpServer.port() ) );
+
+		WHEN( "The clients on the same address go over the limit between them" )
+		{
+			CHECK( ::request( client, "one" )=="echo one" );
+			CHECK( ::request( otherClient, "two" )=="echo two" );
+			CHECK( ::request( tcpClient, "three" )=="echo three" );
+			// Rejected requests still get a response, so the clients aren't left waiting
+			CHECK( ::request( client, "four" )=="" );
+			CHECK( ::request( tcpClient, "five" )=="" );
+			CHECK( pRateLimiter->rejections( clientserver::RateLimiter::Verdict::addressMessages )==2 );
+			CHECK( pRateLimiter->numberOfAddresses()==1 );
+		}
+
+		client.disconnect();
+		otherClient.disconnect();
+		tcpClient.disconnect();
+		tcpServer.stop();
+		server.stop();
+	}
+}
@@ -0,0 +1,190 @@
+#include "catch.hpp"
+#include "clientserver/ListenService.rpc.h"
+#include "clientserver/RpcCodec.h"
+#include "clientserver/TcpServer.h"
+#include "clientserver/TcpClient.h"
+
+namespace // Unnamed namespace for things only used in this file
+{
+	/** @brief Echoes the payload, and fails in various ways depending on what the payload is. */
+	class TestListenService : public clientserver::ListenService
+	{
+	public:
+		virtual void Echo( const clientserver::EchoRequest& request, clientserver::EchoResponse& response, std::weak_ptr<clientserver::IConnection> pConnection ) override
+		{
+			if( request.payload()=="throw" ) throw std::runtime_error( "Asked to throw" );
+			response.set_payload( request.payload() );
+		}
+		virtual void Status( const clientserver::StatusRequest& request, clientserver::StatusResponse& response, std::weak_ptr<clientserver::IConnection> pConnection ) override
+		{
+			response.set_requests_handled( 42 );
+		}
+	};
+
+	/** @brief Gives the request straight to the dispatcher, so that everything but the transport is tested. */
+	clientserver::RpcChannel::SendRequestFunction directTo( clientserver::RpcDispatcher& dispatcher )
+	{
+		return [&dispatcher](const std::string& request,std::function<void(const std::string&)> responseHandler)
+			{
+				responseHandler( dispatcher.handleRequest( request, std::weak_ptr<clientserver::IConnection>() ) );
+			};
+	}
+} // end of the unnamed namespace
+
+SCENARIO( "Test that RpcCodec encodes and decodes method ids", "[clientserver]" )
+{
+	clientserver::EchoRequest request;
+	request.set_payload( std::string("binary\0data",11) );
+
+	GIVEN( "Method ids that need different varint lengths" )
+	{
+		for( const uint32_t methodId : { 0u, 1u, 127u, 128u, 16383u, 16384u, 65535u, 0xffffffffu } )
+		{
+			std::string encoded;
+			clientserver::RpcCodec::encodeRequest( methodId, request, encoded );
+			uint32_t decodedId=0;
+			const size_t headerSize=clientserver::RpcCodec::decodeRequestHeader( encoded.data(), encoded.size(), decodedId );
+			CHECK( decodedId==methodId );
+			CHECK( headerSize==(methodId<128 ? 1 : methodId<16384 ? 2 : methodId<(1u<<21) ? 3 : 5) );
+
+			clientserver::EchoRequest decodedRequest;
+			CHECK( decodedRequest.ParseFromArray( encoded.data()+headerSize, static_cast<int>(encoded.size()-headerSize) ) );
+			CHECK( decodedRequest.payload()==request.payload() );
+		}
+	}
+	GIVEN( "Headers that are not valid" )
+	{
+		uint32_t methodId;
+		CHECK_THROWS_AS( clientserver::RpcCodec::decodeRequestHeader( "", 0, methodId ), std::runtime_error& );
+		CHECK_THROWS_AS( clientserver::RpcCodec::decodeRequestHeader( "\x80\x80", 2, methodId ), std::runtime_error& );
+		// More than 32 bits
+		CHECK_THROWS_AS( clientserver::RpcCodec::decodeRequestHeader( "\xff\xff\xff\xff\x7f", 5, methodId ), std::runtime_error& );
+	}
+	GIVEN( "Responses" )
+	{
+		std::string encoded;
+		clientserver::RpcCodec::encodeError( clientserver::RpcStatus::handlerError, "Went wrong", encoded );
+		try
+		{
+			clientserver::RpcCodec::decodeResponseHeader( encoded.data(), encoded.size() );
+			FAIL( "decodeResponseHeader didn't throw" );
+		}
+		catch( clientserver::RpcError& error )
+		{
+			CHECK( error.status()==clientserver::RpcStatus::handlerError );
+			CHECK( std::string(error.what())=="Went wrong" );
+		}
+		CHECK_THROWS_AS( clientserver::RpcCodec::decodeResponseHeader( "", 0 ), clientserver::RpcError& );
+	}
+}
+
+SCENARIO( "Test that the generated stubs call the service through RpcDispatcher", "[clientserver]" )
+{
+	GIVEN( "A dispatcher with the test service" )
+	{
+		::TestListenService service;
+		clientserver::RpcDispatcher dispatcher;
+		service.addMethodsTo( dispatcher );
+		CHECK_THROWS_AS( service.addMethodsTo( dispatcher ), std::invalid_argument& );
+
+		clientserver::RpcChannel channel( ::directTo(dispatcher) );
+		clientserver::ListenServiceClient client( channel );
+
+		WHEN( "Calling methods that succeed" )
+		{
+			clientserver::EchoRequest request;
+			request.set_payload( std::string("\0\xff\x80 not text",12) );
+			CHECK( client.Echo( request ).payload()==request.payload() );
+			CHECK( client.Status( clientserver::StatusRequest() ).requests_handled()==42 );
+			CHECK( dispatcher.requestsHandled()==2 );
+
+			bool responseReceived=false;
+			client.Echo( request, [&](const clientserver::EchoResponse& response){ responseReceived=(response.payload()==request.payload()); } );
+			CHECK( responseReceived );
+		}
+		WHEN( "Not using arenas" )
+		{
+			dispatcher.setUseArenas( false );
+			clientserver::EchoRequest request;
+			request.set_payload( "Not on an arena" );
+			CHECK( client.Echo( request ).payload()==request.payload() );
+		}
+		WHEN( "The handler throws" )
+		{
+			clientserver::EchoRequest request;
+			request.set_payload( "throw" );
+			try
+			{
+				client.Echo( request );
+				FAIL( "Echo didn't throw" );
+			}
+			catch( clientserver::RpcError& error )
+			{
+				CHECK( error.status()==clientserver::RpcStatus::handlerError );
+				CHECK( std::string(error.what())=="Asked to throw" );
+			}
+
+			clientserver::RpcStatus status=clientserver::RpcStatus::ok;
+			client.Echo( request, [](const clientserver::EchoResponse& response){}, [&](const clientserver::RpcError& error){ status=error.status(); } );
+			CHECK( status==clientserver::RpcStatus::handlerError );
+		}
+		WHEN( "Calling a method that doesn't exist" )
+		{
+			try
+			{
+				channel.call<clientserver::EchoResponse>( 99, clientserver::EchoRequest() );
+				FAIL( "The call didn't throw" );
+			}
+			catch( clientserver::RpcError& error )
+			{
+				CHECK( error.status()==clientserver::RpcStatus::unknownMethod );
+			}
+		}
+		WHEN( "Sending a request that can't be parsed" )
+		{
+			// Method id 1 followed by a field with a truncated length
+			std::string response=dispatcher.handleRequest( std::string("\x01\x0a\x05",3), std::weak_ptr<clientserver::IConnection>() );
+			REQUIRE( !response.empty() );
+			CHECK( static_cast<clientserver::RpcStatus>(response[0])==clientserver::RpcStatus::invalidRequest );
+			// No method id at all
+			response=dispatcher.handleRequest( std::string(), std::weak_ptr<clientserver::IConnection>() );
+			REQUIRE( !response.empty() );
+			CHECK( static_cast<clientserver::RpcStatus>(response[0])==clientserver::RpcStatus::invalidRequest );
+		}
+	}
+}
+
+SCENARIO( "Test that RPC calls work over a real transport", "[clientserver]" )
+{
+	GIVEN( "A TcpServer dispatching to the test service" )
+	{
+		::TestListenService service;
+		clientserver::RpcDispatcher dispatcher;
+		service.addMethodsTo( dispatcher );
+
+		clientserver::TcpServer server;
+		server.setDefaultRequestHandler( std::bind( &clientserver::RpcDispatcher::handleRequest, &dispatcher, std::placeholders::_1, std::placeholders::_2 ) );
+		REQUIRE_NOTHROW( server.listen( 0 ) );
+
+		clientserver::TcpClient tcpClient;
+		REQUIRE_NOTHROW( tcpClient.connect( "localhost", server.port() ) );
+		clientserver::RpcChannel channel( [&](const std::string& request,std::function<void(const std::string&)> handler){ tcpClient.sendRequest(request,handler); } );
+		clientserver::ListenServiceClient client( channel );
+
+		WHEN( "Making lots of calls" )
+		{
+			size_t numberOfErrors=0;
+			for( size_t index=0; index<200; ++index )
+			{
+				clientserver::EchoRequest request;
+				request.set_payload( std::string(index*100,static_cast<char>(index)) );
+				if( client.Echo( request ).payload()!=request.payload() ) ++numberOfErrors;
+			}
+			CHECK( numberOfErrors==0 );
+			CHECK( dispatcher.requestsHandled()==200 );
+		}
+
+		tcpClient.disconnect();
+		server.stop();
+	}
+}
@@ -0,0 +1,293 @@
+#include "catch.hpp"
+#include "clientserver/SharedMemoryServer.h"
+#include "clientserver/SharedMemoryClient.h"
+#include "clientserver/SpscRing.h"
+#include "clientserver/ConnectionRegistry.h"
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <thread>
+#include <chrono>
+#include <cstring>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+
+namespace // Unnamed namespace for things only used in this file
+{
+	/** @brief Does the client side of the handshake by hand, so that tests can give the server things SharedMemoryClient never would.
+	 *
+	 * The rings are laid out the same as SharedMemoryChannel, client to server first, and the wakeups are
+	 * in the same order, so that records can be pushed and popped directly.
+	 */
+	class RawClient
+	{
+	public:
+		/** @param isSealed     Whether to seal the memory against resizing, as SharedMemoryChannel does.
+		 * @param useEventFds  If false a pipe is sent instead of the first eventfd.
+		 */
+		RawClient( size_t capacity, bool isSealed=true, bool useEventFds=true )
+			: capacity_(capacity), socket_(-1), pipeWriteFd_(-1)
+		{
+			memoryFd_=::memfd_create( "clientserver-test", MFD_CLOEXEC | MFD_ALLOW_SEALING );
+			if( memoryFd_<0 || ::ftruncate( memoryFd_, memorySize() )!=0 ) throw std::runtime_error( "RawClient couldn't create the shared memory" );
+			if( isSealed && ::fcntl( memoryFd_, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL )!=0 ) throw std::runtime_error( "RawClient couldn't seal the shared memory" );
+			pMemory_=::mmap( nullptr, memorySize(), PROT_READ | PROT_WRITE, MAP_SHARED, memoryFd_, 0 );
+			if( pMemory_==MAP_FAILED ) throw std::runtime_error( "RawClient couldn't map the shared memory" );
+			pClientToServer_.reset( new clientserver::SpscRing( pMemory_, capacity_, true ) );
+			pServerToClient_.reset( new clientserver::SpscRing( static_cast<char*>(pMemory_)+clientserver::SpscRing::requiredMemory(capacity_), capacity_, true ) );
+			for( auto& descriptor : eventFds_ ) descriptor=::eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+			if( !useEventFds )
+			{
+				int pipeFds[2];
+				if( ::pipe( pipeFds )!=0 ) throw std::runtime_error( "RawClient couldn't create a pipe" );
+				::close( eventFds_[0] );
+				eventFds_[0]=pipeFds[0];
+				pipeWriteFd_=pipeFds[1];
+			}
+		}
+		~RawClient()
+		{
+			pClientToServer_.reset();
+			pServerToClient_.reset();
+			::munmap( pMemory_, memorySize() );
+			for( const auto descriptor : eventFds_ ) ::close( descriptor );
+			::close( pipeWriteFd_ );
+			::close( memoryFd_ );
+			::close( socket_ );
+		}
+		/** @brief Connects and sends the descriptors, returning whether the server accepted them. */
+		bool handshake( const std::string& socketPath )
+		{
+			socket_=::socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+			sockaddr_un address;
+			std::memset( &address, 0, sizeof(address) );
+			address.sun_family=AF_UNIX;
+			std::strncpy( address.sun_path, socketPath.c_str(), sizeof(address.sun_path)-1 );
+			if( ::connect( socket_, reinterpret_cast<sockaddr*>(&address), sizeof(address) )!=0 ) return false;
+
+			uint64_t capacity=capacity_;
+			iovec dataVector{ &capacity, sizeof(capacity) };
+			char controlBuffer[CMSG_SPACE(sizeof(int)*5)];
+			std::memset( controlBuffer, 0, sizeof(controlBuffer) );
+			msghdr message;
+			std::memset( &message, 0, sizeof(message) );
+			message.msg_iov=&dataVector;
+			message.msg_iovlen=1;
+			message.msg_control=controlBuffer;
+			message.msg_controllen=sizeof(controlBuffer);
+			cmsghdr* pControlMessage=CMSG_FIRSTHDR(&message);
+			pControlMessage->cmsg_level=SOL_SOCKET;
+			pControlMessage->cmsg_type=SCM_RIGHTS;
+			pControlMessage->cmsg_len=CMSG_LEN(sizeof(int)*5);
+			int* pDescriptors=reinterpret_cast<int*>(CMSG_DATA(pControlMessage));
+			pDescriptors[0]=memoryFd_;
+			std::copy( eventFds_, eventFds_+4, pDescriptors+1 );
+			if( ::sendmsg( socket_, &message, MSG_NOSIGNAL )!=static_cast<ssize_t>(sizeof(capacity)) ) return false;
+
+			char acknowledgement;
+			return ::recv( socket_, &acknowledgement, 1, MSG_WAITALL )==1;
+		}
+		/** @brief Pushes a record the same way SharedMemoryChannel does, and wakes the server. */
+		bool send( uint32_t type, uint32_t id, const std::string& payload )
+		{
+			const uint32_t header[2]={ type, id };
+			if( !pClientToServer_->push( header, sizeof(header), payload.data(), payload.size() ) ) return false;
+			uint64_t value=1;
+			return ::write( eventFds_[0], &value, sizeof(value) )==sizeof(value);
+		}
+		/** @brief Waits up to five seconds for a record from the server, returning an empty string if none comes. */
+		std::string receive( uint32_t& id )
+		{
+			uint32_t header[2];
+			std::string payload;
+			const auto endTime=std::chrono::steady_clock::now()+std::chrono::seconds(5);
+			while( !pServerToClient_->pop( header, sizeof(header), payload ) )
+			{
+				if( std::chrono::steady_clock::now()>endTime ) return std::string();
+				std::this_thread::sleep_for( std::chrono::milliseconds(1) );
+			}
+			id=header[1];
+			return payload;
+		}
+		/** @brief Whether the server has closed the socket, waiting up to five seconds. */
+		bool waitForHangUp()
+		{
+			pollfd descriptor{ socket_, POLLIN | POLLRDHUP, 0 };
+			return ::poll( &descriptor, 1, 5000 )==1;
+		}
+		clientserver::SpscRing& clientToServer() { return *pClientToServer_; }
+		/** @brief The start of the client to server ring's memory, for writing into it directly. */
+		void* clientToServerMemory() { return pMemory_; }
+	protected:
+		size_t memorySize() const { return 2*clientserver::SpscRing::requiredMemory(capacity_); }
+
+		size_t capacity_;
+		int memoryFd_;
+		int eventFds_[4];
+		int socket_;
+		int pipeWriteFd_;
+		void* pMemory_;
+		std::unique_ptr<clientserver::SpscRing> pClientToServer_;
+		std::unique_ptr<clientserver::SpscRing> pServerToClient_;
+	};
+
+	/** @brief Whether a normal client can still connect to the server and get a response. */
+	bool serverStillWorks( const std::string& socketPath )
+	{
+		clientserver::SharedMemoryClient client;
+		client.connect( socketPath );
+		std::promise<std::string> response;
+		client.sendRequest( "hello", [&](const std::string& message){ response.set_value( message ); } );
+		std::future<std::string> futureResponse=response.get_future();
+		const bool isAnswered=( futureResponse.wait_for( std::chrono::seconds(5) )==std::future_status::ready && futureResponse.get()=="Response to hello" );
+		client.disconnect();
+		return isAnswered;
+	}
+} // end of the unnamed namespace
+
+SCENARIO( "Test that SharedMemoryServer and SharedMemoryClient can talk to each other", "[clientserver]" )
+{
+	GIVEN( "A server with echo handlers listening on a temporary socket" )
+	{
+		const std::string socketPath="/tmp/clientserver-test-"+std::to_string(::getpid())+".sock";
+
+		std::mutex mutex;
+		std::condition_variable condition;
+		std::vector<std::string> infoMessages;
+
+		clientserver::SharedMemoryServer server;
+		server.setDefaultRequestHandler( [](const std::string& message,std::weak_ptr<clientserver::IConnection> pConnection)->std::string
+			{
+				return "Response to "+message;
+			});
+		server.setDefaultInfoHandler( [&](const std::string& message,std::weak_ptr<clientserver::IConnection> pConnection)
+			{
+				// Echo the message back as an info to check the server can initiate messages
+				if( auto pLockedConnection=pConnection.lock() ) pLockedConnection->sendInfo( "Info reply to "+message );
+			});
+		REQUIRE_NOTHROW( server.listen( socketPath ) );
+
+		WHEN( "Connecting a client and sending messages" )
+		{
+			clientserver::SharedMemoryClient client;
+			client.setRingCapacity( 4096 ); // small so that the rings wrap around and fill up
+			client.setDefaultInfoHandler( [&](const std::string& message)
+				{
+					std::lock_guard<std::mutex> lock( mutex );
+					infoMessages.push_back( message );
+					condition.notify_all();
+				});
+			REQUIRE_NOTHROW( client.connect( socketPath ) );
+			CHECK( client.isConnected() );
+
+			const size_t numberOfRequests=10000;
+			std::vector<std::string> responses( numberOfRequests );
+			size_t numberOfResponses=0;
+			for( size_t index=0; index<numberOfRequests; ++index )
+			{
+				client.sendRequest( "request "+std::to_string(index), [&,index](const std::string& response)
+					{
+						std::lock_guard<std::mutex> lock( mutex );
+						responses[index]=response;
+						++numberOfResponses;
+						condition.notify_all();
+					});
+			}
+			client.sendInfo( "hello" );
+
+			std::unique_lock<std::mutex> lock( mutex );
+			CHECK( condition.wait_for( lock, std::chrono::seconds(10), [&]{ return numberOfResponses==numberOfRequests && !infoMessages.empty(); } ) );
+
+			size_t numberOfErrors=0;
+			for( size_t index=0; index<numberOfRequests; ++index )
+			{
+				if( responses[index]!="Response to request "+std::to_string(index) ) ++numberOfErrors;
+			}
+			CHECK( numberOfErrors==0 );
+			REQUIRE( infoMessages.size()==1 );
+			CHECK( infoMessages.front()=="Info reply to hello" );
+		}
+		WHEN( "Connecting to a socket nothing is listening on" )
+		{
+			clientserver::SharedMemoryClient client;
+			CHECK_THROWS_AS( client.connect( socketPath+".missing" ), std::system_error& );
+			CHECK( !client.isConnected() );
+		}
+
+		server.stop();
+	}
+}
+
+SCENARIO( "Test that SharedMemoryServer turns away clients that could bring it down", "[clientserver]" )
+{
+	GIVEN( "A server listening on a temporary socket" )
+	{
+		const std::string socketPath="/tmp/clientserver-test-raw-"+std::to_string(::getpid())+".sock";
+		// Requests for "wait" hold the connection's thread until the test is ready
+		std::promise<void> release;
+		std::shared_future<void> released=release.get_future().share();
+		clientserver::SharedMemoryServer server;
+		server.setDefaultRequestHandler( [released](const std::string& message,std::weak_ptr<clientserver::IConnection> pConnection)->std::string
+			{
+				if( message=="wait" ) released.wait();
+				return "Response to "+message;
+			});
+		REQUIRE_NOTHROW( server.listen( socketPath ) );
+
+		WHEN( "A client does the handshake properly by hand" )
+		{
+			::RawClient client( 4096 );
+			REQUIRE( client.handshake( socketPath ) );
+			REQUIRE( client.send( 1, 7, "raw" ) );
+			uint32_t id=0;
+			CHECK( client.receive( id )=="Response to raw" );
+			CHECK( id==7 );
+		}
+		WHEN( "A client sends memory that isn't sealed, so could be shrunk under the server" )
+		{
+			::RawClient client( 4096, false );
+			CHECK( !client.handshake( socketPath ) );
+			CHECK( ::serverStillWorks( socketPath ) );
+		}
+		WHEN( "A client sends a pipe instead of an eventfd" )
+		{
+			::RawClient client( 4096, true, false );
+			CHECK( !client.handshake( socketPath ) );
+			CHECK( ::serverStillWorks( socketPath ) );
+		}
+		WHEN( "A client writes a record with a huge length into the ring" )
+		{
+			const size_t capacity=4096;
+			::RawClient client( capacity );
+			REQUIRE( client.handshake( socketPath ) );
+			REQUIRE( client.send( 1, 1, "wait" ) );
+
+			// The server can't get past the first request until it's released, so it can't see the second
+			// record until it has been corrupted. The first record is the length, type, id and "wait".
+			const uint32_t header[2]={ 1, 2 };
+			REQUIRE( client.clientToServer().push( header, sizeof(header), "hello", 5 ) );
+			const size_t position=sizeof(uint32_t)*3+4;
+			const uint32_t hugeLength=0x7fffffff;
+			char* pData=static_cast<char*>(client.clientToServerMemory())+clientserver::SpscRing::requiredMemory(capacity)-capacity;
+			std::memcpy( pData+position, &hugeLength, sizeof(hugeLength) );
+			release.set_value();
+
+			// The first request is still answered, then the server hangs up on just this client
+			uint32_t id=0;
+			CHECK( client.receive( id )=="Response to wait" );
+			CHECK( id==1 );
+			CHECK( client.waitForHangUp() );
+			const auto endTime=std::chrono::steady_clock::now()+std::chrono::seconds(5);
+			while( server.connectionRegistry()->size()!=0 && std::chrono::steady_clock::now()<endTime ) std::this_thread::sleep_for( std::chrono::milliseconds(1) );
+			CHECK( server.connectionRegistry()->size()==0 );
+			CHECK( ::serverStillWorks( socketPath ) );
+		}
+
+		server.stop();
+	}
+}
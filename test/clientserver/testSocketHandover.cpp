@@ -0,0 +1,139 @@
+#include "catch.hpp"
+#include "clientserver/SocketHandover.h"
+#include "clientserver/WebSocketServer.h"
+#include "clientserver/WebSocketClient.h"
+#include "clientserver/TcpServer.h"
+#include "clientserver/TcpClient.h"
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace // Unnamed namespace for things only used in this file
+{
+	/** @brief Sends a request with either type of client and waits for the response, which is empty if none arrives. */
+	template<class T_Client>
+	std::string request( T_Client& client, const std::string& message )
+	{
+		std::mutex mutex;
+		std::condition_variable condition;
+		std::string response;
+		bool hasResponse=false;
+		client.sendRequest( message, [&](const std::string& reply)
+			{
+				std::lock_guard<std::mutex> lock( mutex );
+				response=reply;
+				hasResponse=true;
+				condition.notify_all();
+			});
+		std::unique_lock<std::mutex> lock( mutex );
+		condition.wait_for( lock, std::chrono::seconds(5), [&]{ return hasResponse; } );
+		return response;
+	}
+} // end of the unnamed namespace
+
+SCENARIO( "Test that SocketHandover passes listening sockets to a new server", "[clientserver]" )
+{
+	GIVEN( "A WebSocketServer and TcpServer offering their sockets" )
+	{
+		const std::string socketPath="/tmp/clientserver-test-"+std::to_string(::getpid())+"-handover";
+		auto handler=[](const std::string& name)
+			{
+				return [name](const std::string& message,std::weak_ptr<clientserver::IConnection> pConnection)->std::string{ return name+" "+message; };
+			};
+
+		clientserver::WebSocketServer oldServer;
+		clientserver::TcpServer oldTcpServer;
+		oldServer.setNumberOfThreads( 1 );
+		oldServer.setDefaultRequestHandler( handler("old") );
+		oldTcpServer.setDefaultRequestHandler( handler("old") );
+		REQUIRE_NOTHROW( oldServer.listen( 0 ) );
+		REQUIRE_NOTHROW( oldTcpServer.listen( 0 ) );
+		clientserver::SocketHandover oldHandover;
+		REQUIRE_NOTHROW( oldHandover.offer( socketPath, { oldServer.listenSocket(), oldTcpServer.listenSocket() }, [&]()
+			{
+				oldServer.stopAccepting();
+				oldTcpServer.stopAccepting();
+			}) );
+
+		// Connected before the handover, so should carry on being served by the old server
+		clientserver::WebSocketClient existingClient;
+		REQUIRE_NOTHROW( existingClient.connect( "localhost", oldServer.port() ) );
+		CHECK( ::request( existingClient, "hello" )=="old hello" );
+
+		clientserver::WebSocketServer newServer;
+		clientserver::TcpServer newTcpServer;
+		newServer.setNumberOfThreads( 1 );
+		newServer.setDefaultRequestHandler( handler("new") );
+		newTcpServer.setDefaultRequestHandler( handler("new") );
+
+		WHEN( "Nothing is offering sockets on the path" )
+		{
+			bool hasBeenCalled=false;
+			CHECK( !clientserver::SocketHandover::take( socketPath+"-missing", [&](std::vector<int> sockets){ hasBeenCalled=true; } ) );
+			CHECK( !hasBeenCalled );
+		}
+		WHEN( "A new server takes the sockets" )
+		{
+			const size_t port=oldServer.port();
+			const size_t tcpPort=oldTcpServer.port();
+			REQUIRE( clientserver::SocketHandover::take( socketPath, [&](std::vector<int> sockets)
+				{
+					REQUIRE( sockets.size()==2 );
+					newServer.listenOnSocket( sockets[0] );
+					newTcpServer.listenOnSocket( sockets[1] );
+				}) );
+			CHECK( oldHandover.hasHandedOver() );
+			CHECK( newServer.port()==port );
+			CHECK( newTcpServer.port()==tcpPort );
+
+			// The old server stops accepting once it's been handed over, even though its socket is still open
+			clientserver::WebSocketClient newClient;
+			REQUIRE_NOTHROW( newClient.connect( "localhost", port ) );
+			CHECK( ::request( newClient, "hello" )=="new hello" );
+			clientserver::TcpClient newTcpClient;
+			REQUIRE_NOTHROW( newTcpClient.connect( "localhost", tcpPort ) );
+			CHECK( ::request( newTcpClient, "hello" )=="new hello" );
+			CHECK( ::request( existingClient, "again" )=="old again" );
+
+			// The new server can offer them on the same path for the next one
+			clientserver::SocketHandover newHandover;
+			CHECK_NOTHROW( newHandover.offer( socketPath, { newServer.listenSocket(), newTcpServer.listenSocket() }, [](){} ) );
+			oldHandover.stop();
+			CHECK( ::access( socketPath.c_str(), F_OK )==0 );
+			newHandover.stop();
+			CHECK( ::access( socketPath.c_str(), F_OK )!=0 );
+
+			newClient.disconnect();
+			newTcpClient.disconnect();
+		}
+		WHEN( "The new server fails to start" )
+		{
+			CHECK_THROWS( clientserver::SocketHandover::take( socketPath, [&](std::vector<int> sockets)
+				{
+					for( const auto socket : sockets ) ::close( socket );
+					throw std::runtime_error( "Couldn't start" );
+				}) );
+			CHECK( !oldHandover.hasHandedOver() );
+
+			// The old server carries on accepting, and can still be taken over
+			clientserver::WebSocketClient newClient;
+			REQUIRE_NOTHROW( newClient.connect( "localhost", oldServer.port() ) );
+			CHECK( ::request( newClient, "hello" )=="old hello" );
+			CHECK( clientserver::SocketHandover::take( socketPath, [&](std::vector<int> sockets)
+				{
+					newServer.listenOnSocket( sockets[0] );
+					newTcpServer.listenOnSocket( sockets[1] );
+				}) );
+			newClient.disconnect();
+		}
+
+		existingClient.disconnect();
+		oldHandover.stop();
+		newTcpServer.stop();
+		newServer.stop();
+		oldTcpServer.stop();
+		oldServer.stop();
+	}
+}
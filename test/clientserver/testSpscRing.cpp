@@ -0,0 +1,166 @@
+#include "catch.hpp"
+#include "clientserver/SpscRing.h"
+#include <vector>
+#include <thread>
+#include <cstring>
+
+namespace // Unnamed namespace for things only used in this file
+{
+	/** @brief Overwrites the length field of the record at the given position in the ring. */
+	void corruptLength( void* pRingMemory, size_t capacity, uint64_t position, uint32_t length )
+	{
+		// The data starts straight after the ring's own header
+		char* pData=static_cast<char*>(pRingMemory)+clientserver::SpscRing::requiredMemory(capacity)-capacity;
+		std::memcpy( pData+(position & (capacity-1)), &length, sizeof(length) );
+	}
+} // end of the unnamed namespace
+
+SCENARIO( "Test that SpscRing passes records correctly", "[clientserver]" )
+{
+	GIVEN( "A small ring in normal heap memory" )
+	{
+		const size_t capacity=64;
+		std::vector<uint64_t> memory( (clientserver::SpscRing::requiredMemory(capacity)+7)/8 ); // uint64_t so that it's aligned
+		clientserver::SpscRing ring( memory.data(), capacity, true );
+		std::string output;
+
+		WHEN( "Checking the empty ring" )
+		{
+			CHECK( ring.capacity()==capacity );
+			CHECK( ring.maximumRecordSize()==capacity-4 );
+			CHECK( ring.empty() );
+			CHECK( ring.pop(output)==false );
+		}
+		WHEN( "Pushing and popping single records" )
+		{
+			CHECK( ring.push( "Hello", 5 ) );
+			CHECK( !ring.empty() );
+			CHECK( ring.pop(output) );
+			CHECK( output=="Hello" );
+			CHECK( ring.empty() );
+
+			// Zero length records are valid
+			CHECK( ring.push( "", 0 ) );
+			CHECK( ring.pop(output) );
+			CHECK( output.empty() );
+		}
+		WHEN( "Filling the ring" )
+		{
+			// Each record takes 4 bytes for the length plus the data, so 16 byte records take 20 bytes
+			const std::string record( 16, 'a' );
+			CHECK( ring.push( record.data(), record.size() ) );
+			CHECK( ring.push( record.data(), record.size() ) );
+			CHECK( ring.push( record.data(), record.size() ) );
+			CHECK( ring.push( record.data(), record.size() )==false ); // only 4 bytes left
+			CHECK( ring.push( "", 0 ) ); // which is enough for an empty record
+			CHECK( ring.push( "", 0 )==false );
+
+			// The ring is never allowed to take a record that could never fit
+			CHECK_THROWS_AS( ring.push( std::string(capacity,'a').data(), capacity ), std::length_error& );
+		}
+		WHEN( "Records wrap around the end of the buffer" )
+		{
+			// Use an odd size so the records, and the length fields, are split at different places each time
+			for( size_t index=0; index<100; ++index )
+			{
+				const std::string record( 7+index%13, 'a'+index%26 );
+				REQUIRE( ring.push( record.data(), record.size() ) );
+				REQUIRE( ring.pop(output) );
+				CHECK( output==record );
+			}
+		}
+		WHEN( "Pushing with a separate header and body" )
+		{
+			const uint32_t header=0xdeadbeef;
+			CHECK( ring.push( &header, sizeof(header), "body", 4 ) );
+
+			uint32_t headerOut=0;
+			CHECK( ring.pop( &headerOut, sizeof(headerOut), output ) );
+			CHECK( headerOut==header );
+			CHECK( output=="body" );
+
+			// A record shorter than the requested header is an error
+			CHECK( ring.push( "ab", 2 ) );
+			CHECK_THROWS_AS( ring.pop( &headerOut, sizeof(headerOut), output ), std::length_error& );
+		}
+		WHEN( "The length of a record has been corrupted" )
+		{
+			CHECK( ring.push( "abcd", 4 ) );
+			// Far bigger than the ring
+			::corruptLength( memory.data(), capacity, 0, 0xffffffff );
+			CHECK_THROWS( ring.pop(output) );
+			// Small enough to fit in the ring, but more than has been pushed
+			::corruptLength( memory.data(), capacity, 0, 20 );
+			CHECK_THROWS( ring.pop(output) );
+			// Nothing was taken off the ring, so it works again once the length is put back
+			::corruptLength( memory.data(), capacity, 0, 4 );
+			CHECK( ring.pop(output) );
+			CHECK( output=="abcd" );
+			CHECK( ring.empty() );
+		}
+		WHEN( "Checking the waiting flags" )
+		{
+			// Empty ring, so the consumer should go to sleep, and the producer should then wake it up
+			CHECK( ring.prepareConsumerWait() );
+			CHECK( ring.push( "a", 1 ) );
+			CHECK( ring.consumerNeedsWaking() );
+			CHECK( ring.consumerNeedsWaking()==false ); // the flag is cleared once acted on
+			// Not empty now, so the consumer shouldn't go to sleep
+			CHECK( ring.prepareConsumerWait()==false );
+			CHECK( ring.consumerNeedsWaking()==false );
+
+			// Fill the ring so that the producer has to wait
+			while( ring.push( "a", 1 ) );
+			CHECK( ring.prepareProducerWait( 1 ) );
+			CHECK( ring.pop(output) );
+			CHECK( ring.producerNeedsWaking() );
+			CHECK( ring.producerNeedsWaking()==false );
+			CHECK( ring.prepareProducerWait( 1 )==false );
+		}
+		WHEN( "Attaching a second instance to the same memory" )
+		{
+			CHECK( ring.push( "shared", 6 ) );
+			clientserver::SpscRing otherRing( memory.data(), capacity, false );
+			CHECK( otherRing.pop(output) );
+			CHECK( output=="shared" );
+			CHECK( ring.empty() );
+
+			CHECK_THROWS_AS( clientserver::SpscRing( memory.data(), capacity*2, false ), std::invalid_argument& );
+		}
+	}
+	GIVEN( "Invalid capacities" )
+	{
+		std::vector<uint64_t> memory( clientserver::SpscRing::requiredMemory(100) );
+		CHECK_THROWS_AS( clientserver::SpscRing( memory.data(), 100, true ), std::invalid_argument& );
+		CHECK_THROWS_AS( clientserver::SpscRing( memory.data(), 0, true ), std::invalid_argument& );
+	}
+	GIVEN( "A producer and consumer on different threads" )
+	{
+		const size_t capacity=256;
+		std::vector<uint64_t> memory( (clientserver::SpscRing::requiredMemory(capacity)+7)/8 );
+		clientserver::SpscRing ring( memory.data(), capacity, true );
+		const uint32_t numberOfRecords=100000;
+
+		std::thread producer( [&]()
+			{
+				for( uint32_t index=0; index<numberOfRecords; ++index )
+				{
+					const std::string body( index%50, 'x' );
+					while( !ring.push( &index, sizeof(index), body.data(), body.size() ) ) std::this_thread::yield();
+				}
+			});
+
+		uint32_t numberOfErrors=0;
+		std::string body;
+		for( uint32_t index=0; index<numberOfRecords; ++index )
+		{
+			uint32_t receivedIndex;
+			while( !ring.pop( &receivedIndex, sizeof(receivedIndex), body ) ) std::this_thread::yield();
+			if( receivedIndex!=index || body!=std::string(index%50,'x') ) ++numberOfErrors;
+		}
+		producer.join();
+
+		CHECK( numberOfErrors==0 );
+		CHECK( ring.empty() );
+	}
+}
@@ -0,0 +1,239 @@
+#include "catch.hpp"
+#include "clientserver/StateDelta.h"
+#include "clientserver/DeltaPublisher.h"
+#include "clientserver/DeltaApplier.h"
+#include <google/protobuf/descriptor.pb.h>
+#include <stdexcept>
+
+namespace // Unnamed namespace for things only used in this file
+{
+	/** @brief FileDescriptorProto is used as the state because it has every kind of field, and needs no extra .proto file. */
+	typedef google::protobuf::FileDescriptorProto State;
+
+	State exampleState()
+	{
+		State state;
+		state.set_name( "example.proto" );
+		state.set_package( "example" );
+		state.add_dependency( "first.proto" );
+		state.add_dependency( "second.proto" );
+		state.mutable_options()->set_java_package( "com.example" );
+		state.mutable_options()->set_optimize_for( google::protobuf::FileOptions::SPEED );
+		for( int index=0; index<20; ++index )
+		{
+			google::protobuf::DescriptorProto* pMessage=state.add_message_type();
+			pMessage->set_name( "Message"+std::to_string(index) );
+			pMessage->add_field()->set_name( "value" );
+		}
+		return state;
+	}
+
+	void applyTo( State& state, const std::string& update )
+	{
+		clientserver::StateDelta::Header header;
+		const size_t payloadStart=clientserver::StateDelta::decodeHeader( update.data(), update.size(), header );
+		clientserver::StateDelta::apply( header.changedFields, update.data()+payloadStart, update.size()-payloadStart, state );
+	}
+} // end of the unnamed namespace
+
+SCENARIO( "Test that StateDelta finds and applies field level differences", "[clientserver]" )
+{
+	typedef clientserver::StateDelta StateDelta;
+
+	GIVEN( "A state with every kind of field set" )
+	{
+		const State base=::exampleState();
+		std::vector<StateDelta::FieldPath> changedFields;
+		State changes;
+
+		WHEN( "Nothing has changed" )
+		{
+			StateDelta::diff( base, base, changedFields, changes );
+			CHECK( changedFields.empty() );
+			CHECK( changes.ByteSizeLong()==0 );
+		}
+		WHEN( "Fields are changed, cleared and added at different depths" )
+		{
+			State current=base;
+			current.set_package( "changed" );
+			current.clear_dependency();
+			current.mutable_options()->set_java_package( "org.example" );
+			current.mutable_options()->set_cc_enable_arenas( true );
+			current.mutable_source_code_info();
+			current.mutable_message_type( 5 )->set_name( "Renamed" );
+
+			StateDelta::diff( base, current, changedFields, changes );
+			CHECK( changedFields==std::vector<StateDelta::FieldPath>( { {2}, {3}, {4}, {8,1}, {8,31}, {9} } ) );
+			// Repeated fields are sent whole, but fields that are the same are left out
+			CHECK( changes.message_type_size()==20 );
+			CHECK( !changes.has_name() );
+			CHECK( changes.options().has_java_package() );
+			CHECK( !changes.options().has_optimize_for() );
+
+			std::string update;
+			StateDelta::encodeDelta( "files", 5, 3, changedFields, changes, update );
+			StateDelta::Header header;
+			const size_t payloadStart=StateDelta::decodeHeader( update.data(), update.size(), header );
+			CHECK( header.type==StateDelta::UpdateType::delta );
+			CHECK( header.sequence==5 );
+			CHECK( header.baseSequence==3 );
+			CHECK( header.subscription=="files" );
+			CHECK( header.changedFields==changedFields );
+			CHECK( update.size()-payloadStart==changes.ByteSizeLong() );
+
+			State applied=base;
+			::applyTo( applied, update );
+			CHECK( applied.SerializeAsString()==current.SerializeAsString() );
+		}
+		WHEN( "Only a field inside a sub message changes" )
+		{
+			State current=base;
+			current.mutable_options()->set_optimize_for( google::protobuf::FileOptions::LITE_RUNTIME );
+			StateDelta::diff( base, current, changedFields, changes );
+			CHECK( changedFields==std::vector<StateDelta::FieldPath>( { {8,9} } ) );
+			CHECK( changes.ByteSizeLong()<8 );
+
+			std::string update;
+			StateDelta::encodeDelta( "files", 2, 1, changedFields, changes, update );
+			State applied=base;
+			::applyTo( applied, update );
+			CHECK( applied.SerializeAsString()==current.SerializeAsString() );
+		}
+		WHEN( "A sub message is removed" )
+		{
+			State current=base;
+			current.clear_options();
+			StateDelta::diff( base, current, changedFields, changes );
+			CHECK( changedFields==std::vector<StateDelta::FieldPath>( { {8} } ) );
+			std::string update;
+			StateDelta::encodeDelta( "files", 2, 1, changedFields, changes, update );
+			State applied=base;
+			::applyTo( applied, update );
+			CHECK( !applied.has_options() );
+			CHECK( applied.SerializeAsString()==current.SerializeAsString() );
+		}
+		WHEN( "Given invalid updates" )
+		{
+			std::string update;
+			StateDelta::encodeDelta( "files", 2, 1, { {8,9} }, changes, update );
+			StateDelta::Header header;
+			for( size_t size=0; size<update.size(); ++size ) CHECK_THROWS_AS( StateDelta::decodeHeader( update.data(), size, header ), std::runtime_error& );
+			CHECK_THROWS_AS( StateDelta::decodeHeader( "\x02\x01\x00", 3, header ), std::runtime_error& );
+
+			State applied=base;
+			CHECK_THROWS_AS( StateDelta::apply( { {1000} }, nullptr, 0, applied ), std::runtime_error& );
+			CHECK_THROWS_AS( StateDelta::apply( { {1,2} }, nullptr, 0, applied ), std::runtime_error& );
+			CHECK_THROWS_AS( StateDelta::apply( {}, "\xff", 1, applied ), std::runtime_error& );
+			CHECK_THROWS_AS( StateDelta::diff( base, google::protobuf::FileOptions(), changedFields, changes ), std::invalid_argument& );
+		}
+		WHEN( "Encoding acknowledgements" )
+		{
+			std::string acknowledgement;
+			StateDelta::encodeAcknowledgement( "files", 300, acknowledgement );
+			std::string subscription;
+			uint64_t sequence;
+			StateDelta::decodeAcknowledgement( acknowledgement.data(), acknowledgement.size(), subscription, sequence );
+			CHECK( subscription=="files" );
+			CHECK( sequence==300 );
+			CHECK_THROWS_AS( StateDelta::decodeAcknowledgement( "\x80", 1, subscription, sequence ), std::runtime_error& );
+		}
+	}
+}
+
+SCENARIO( "Test that DeltaPublisher and DeltaApplier keep the client's state up to date", "[clientserver]" )
+{
+	GIVEN( "A publisher that sends a snapshot at least every 10 updates" )
+	{
+		clientserver::DeltaPublisher publisher( 10, 4 );
+		clientserver::DeltaApplier applier;
+		applier.addSubscription( "files", State() );
+		std::weak_ptr<clientserver::IConnection> pConnection;
+		State state=::exampleState();
+		std::string subscription;
+		std::string acknowledgement;
+		CHECK( applier.state( "files" )==nullptr );
+
+		WHEN( "Every update is acknowledged straight away" )
+		{
+			size_t updateBytes=0;
+			for( int index=0; index<100; ++index )
+			{
+				state.mutable_options()->set_java_package( "com.example.version"+std::to_string(index) );
+				if( index%25==0 ) state.mutable_message_type( index/25 )->set_name( "Changed"+std::to_string(index) );
+				std::string update;
+				publisher.encodeUpdate( pConnection, "files", state, update );
+				if( index>0 && index%10!=0 ) updateBytes+=update.size();
+				const google::protobuf::Message* pState=applier.apply( update.data(), update.size(), subscription, acknowledgement );
+				REQUIRE( pState!=nullptr );
+				CHECK( subscription=="files" );
+				CHECK( pState->SerializeAsString()==state.SerializeAsString() );
+				REQUIRE( !acknowledgement.empty() );
+				publisher.acknowledge( pConnection, acknowledgement.data(), acknowledgement.size() );
+			}
+			CHECK( publisher.snapshotsSent()==10 );
+			CHECK( publisher.deltasSent()==90 );
+			CHECK( updateBytes<90*state.ByteSizeLong()/10 );
+			CHECK( applier.state( "files" )->SerializeAsString()==state.SerializeAsString() );
+			CHECK( publisher.numberOfConnections()==1 );
+			publisher.removeConnection( pConnection );
+			CHECK( publisher.numberOfConnections()==0 );
+		}
+		WHEN( "Acknowledgements are delayed, and some updates are lost" )
+		{
+			std::vector<std::string> acknowledgements;
+			for( int index=0; index<50; ++index )
+			{
+				state.set_package( "package"+std::to_string(index) );
+				std::string update;
+				publisher.encodeUpdate( pConnection, "files", state, update );
+				if( index%7==3 ) continue;
+				const google::protobuf::Message* pState=applier.apply( update.data(), update.size(), subscription, acknowledgement );
+				REQUIRE( pState!=nullptr );
+				CHECK( pState->SerializeAsString()==state.SerializeAsString() );
+				acknowledgements.push_back( acknowledgement );
+				// Acknowledgements arrive two updates late
+				if( acknowledgements.size()>2 )
+				{
+					publisher.acknowledge( pConnection, acknowledgements.front().data(), acknowledgements.front().size() );
+					acknowledgements.erase( acknowledgements.begin() );
+				}
+			}
+			CHECK( publisher.deltasSent()>30 );
+		}
+		WHEN( "The client loses its copy of the state" )
+		{
+			std::string update;
+			publisher.encodeUpdate( pConnection, "files", state, update );
+			REQUIRE( applier.apply( update.data(), update.size(), subscription, acknowledgement )!=nullptr );
+			publisher.acknowledge( pConnection, acknowledgement.data(), acknowledgement.size() );
+
+			clientserver::DeltaApplier newApplier;
+			newApplier.addSubscription( "files", State() );
+			state.set_package( "changed" );
+			update.clear();
+			publisher.encodeUpdate( pConnection, "files", state, update );
+			CHECK( newApplier.apply( update.data(), update.size(), subscription, acknowledgement )==nullptr );
+			REQUIRE( !acknowledgement.empty() );
+			// A second delta from the same missing state shouldn't ask again
+			std::string secondAcknowledgement;
+			update.clear();
+			publisher.encodeUpdate( pConnection, "files", state, update );
+			CHECK( newApplier.apply( update.data(), update.size(), subscription, secondAcknowledgement )==nullptr );
+			CHECK( secondAcknowledgement.empty() );
+
+			publisher.acknowledge( pConnection, acknowledgement.data(), acknowledgement.size() );
+			update.clear();
+			publisher.encodeUpdate( pConnection, "files", state, update );
+			const google::protobuf::Message* pState=newApplier.apply( update.data(), update.size(), subscription, acknowledgement );
+			REQUIRE( pState!=nullptr );
+			CHECK( pState->SerializeAsString()==state.SerializeAsString() );
+			CHECK( publisher.snapshotsSent()==2 );
+		}
+		WHEN( "An update is for a subscription the client doesn't know" )
+		{
+			std::string update;
+			publisher.encodeUpdate( pConnection, "unknown", state, update );
+			CHECK_THROWS_AS( applier.apply( update.data(), update.size(), subscription, acknowledgement ), std::runtime_error& );
+		}
+	}
+}
@@ -0,0 +1,195 @@
+#include "catch.hpp"
+#include "clientserver/TcpServer.h"
+#include "clientserver/TcpClient.h"
+#include "clientserver/BinaryFramer.h"
+#include "clientserver/TestCertificates.h"
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <cstdio>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+
+namespace // Unnamed namespace for things only used in this file
+{
+	/** @brief Sends lots of requests and an info message, and checks everything comes back correctly. */
+	void checkEchoes( clientserver::TcpClient& client )
+	{
+		std::mutex mutex;
+		std::condition_variable condition;
+		std::vector<std::string> infoMessages;
+		client.setDefaultInfoHandler( [&](const std::string& message)
+			{
+				std::lock_guard<std::mutex> lock( mutex );
+				infoMessages.push_back( message );
+				condition.notify_all();
+			});
+
+		const size_t numberOfRequests=2000;
+		std::vector<std::string> responses( numberOfRequests );
+		size_t numberOfResponses=0;
+		for( size_t index=0; index<numberOfRequests; ++index )
+		{
+			// Make some of them large enough to need several reads
+			const std::string message=(index%100==0 ? std::string(200000,'a') : "request ")+std::to_string(index);
+			client.sendRequest( message, [&,index](const std::string& response)
+				{
+					std::lock_guard<std::mutex> lock( mutex );
+					responses[index]=response;
+					++numberOfResponses;
+					condition.notify_all();
+				});
+		}
+		client.sendInfo( "hello" );
+
+		std::unique_lock<std::mutex> lock( mutex );
+		CHECK( condition.wait_for( lock, std::chrono::seconds(20), [&]{ return numberOfResponses==numberOfRequests && !infoMessages.empty(); } ) );
+
+		size_t numberOfErrors=0;
+		for( size_t index=0; index<numberOfRequests; ++index )
+		{
+			const std::string message=(index%100==0 ? std::string(200000,'a') : "request ")+std::to_string(index);
+			if( responses[index]!="Response to "+message ) ++numberOfErrors;
+		}
+		CHECK( numberOfErrors==0 );
+		REQUIRE( infoMessages.size()==1 );
+		CHECK( infoMessages.front()=="Info reply to hello" );
+	}
+} // end of the unnamed namespace
+
+SCENARIO( "Test that TcpServer and TcpClient can talk to each other", "[clientserver]" )
+{
+	GIVEN( "A server with echo handlers" )
+	{
+		clientserver::TcpServer server;
+		server.setDefaultRequestHandler( [](const std::string& message,std::weak_ptr<clientserver::IConnection> pConnection)->std::string
+			{
+				return "Response to "+message;
+			});
+		server.setDefaultInfoHandler( [&](const std::string& message,std::weak_ptr<clientserver::IConnection> pConnection)
+			{
+				if( auto pLockedConnection=pConnection.lock() ) pLockedConnection->sendInfo( "Info reply to "+message );
+			});
+
+		WHEN( "Connecting without TLS" )
+		{
+			REQUIRE_NOTHROW( server.listen( 0 ) );
+			CHECK( server.port()!=0 );
+
+			clientserver::TcpClient client;
+			REQUIRE_NOTHROW( client.connect( "localhost", server.port() ) );
+			CHECK( client.isConnected() );
+			checkEchoes( client );
+		}
+		WHEN( "Connecting with TLS" )
+		{
+			const std::string certificateFilename="/tmp/clientserver-test-"+std::to_string(::getpid())+".crt";
+			const std::string keyFilename="/tmp/clientserver-test-"+std::to_string(::getpid())+".key";
+			REQUIRE( clientserver::test::createSelfSignedCertificate( certificateFilename, keyFilename ) );
+			server.setCertificateChainFile( certificateFilename );
+			server.setPrivateKeyFile( keyFilename );
+			REQUIRE_NOTHROW( server.listen( 0 ) );
+
+			clientserver::TcpClient client;
+			client.enableTls( certificateFilename ); // the self signed certificate is its own authority
+			REQUIRE_NOTHROW( client.connect( "localhost", server.port() ) );
+			checkEchoes( client );
+
+			std::remove( certificateFilename.c_str() );
+			std::remove( keyFilename.c_str() );
+		}
+		WHEN( "Connecting to a port nothing is listening on" )
+		{
+			REQUIRE_NOTHROW( server.listen( 0 ) );
+			const size_t unusedPort=server.port();
+			server.stop();
+
+			clientserver::TcpClient client;
+			CHECK_THROWS_AS( client.connect( "localhost", unusedPort ), std::system_error& );
+			CHECK( !client.isConnected() );
+		}
+
+		server.stop();
+	}
+}
+
+SCENARIO( "Test that TcpServer stops reading requests from a client that doesn't read the responses", "[clientserver]" )
+{
+	GIVEN( "A server with large responses and a small output limit" )
+	{
+		typedef clientserver::BinaryFramer::MessageType MessageType;
+		std::atomic<size_t> requestsHandled( 0 );
+		const std::string largeResponse( 64*1024, 'x' );
+
+		clientserver::TcpServer server;
+		server.setOutputBufferSize( 128*1024 );
+		server.setDefaultRequestHandler( [&](const std::string& message,std::weak_ptr<clientserver::IConnection> pConnection)->std::string
+			{
+				++requestsHandled;
+				return largeResponse;
+			});
+		REQUIRE_NOTHROW( server.listen( 0 ) );
+
+		WHEN( "A client sends lots of requests without reading anything" )
+		{
+			const size_t numberOfRequests=2000;
+			int socket=::socket( AF_INET, SOCK_STREAM, 0 );
+			REQUIRE( socket>=0 );
+			// Keep what the kernel buffers small, so that it's the server that has to hold back
+			int bufferSize=64*1024;
+			::setsockopt( socket, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof(bufferSize) );
+			timeval timeout{ 10, 0 };
+			::setsockopt( socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout) );
+			sockaddr_in address{};
+			address.sin_family=AF_INET;
+			address.sin_port=htons( server.port() );
+			address.sin_addr.s_addr=htonl( INADDR_LOOPBACK );
+			REQUIRE( ::connect( socket, reinterpret_cast<sockaddr*>(&address), sizeof(address) )==0 );
+
+			std::string requests;
+			for( size_t index=0; index<numberOfRequests; ++index ) clientserver::BinaryFramer::encode( MessageType::request, index, "request", requests );
+			REQUIRE( ::send( socket, requests.data(), requests.size(), MSG_NOSIGNAL )==static_cast<ssize_t>(requests.size()) );
+
+			// Wait until the server has stopped handling requests
+			size_t previousHandled;
+			do
+			{
+				previousHandled=requestsHandled;
+				std::this_thread::sleep_for( std::chrono::milliseconds(200) );
+			} while( requestsHandled!=previousHandled );
+			// Without the limit all of them would be handled, with the responses piling up in the server.
+			// With it there should only be as many as fit in the socket buffers and the limit.
+			CHECK( requestsHandled<numberOfRequests/4 );
+
+			// Once the client starts reading, the rest of the requests are handled
+			clientserver::BinaryFramer framer;
+			MessageType type;
+			uint32_t id;
+			std::string payload;
+			size_t numberOfResponses=0;
+			size_t numberOfErrors=0;
+			while( numberOfResponses<numberOfRequests )
+			{
+				char* pBuffer=framer.reserve( 64*1024 );
+				const ssize_t bytesRead=::recv( socket, pBuffer, 64*1024, 0 );
+				if( bytesRead<=0 ) break;
+				framer.commit( bytesRead );
+				while( framer.next( type, id, payload ) )
+				{
+					if( type!=MessageType::response || id!=numberOfResponses || payload!=largeResponse ) ++numberOfErrors;
+					++numberOfResponses;
+				}
+			}
+			CHECK( numberOfResponses==numberOfRequests );
+			CHECK( numberOfErrors==0 );
+			CHECK( requestsHandled==numberOfRequests );
+			::close( socket );
+		}
+
+		server.stop();
+	}
+}
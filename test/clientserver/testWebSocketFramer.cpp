@@ -0,0 +1,296 @@
+#include "catch.hpp"
+#include "clientserver/WebSocketFramer.h"
+#include "clientserver/WebSocketHandshake.h"
+#include "clientserver/MessageEnvelope.h"
+#include "clientserver/BatchEnvelope.h"
+
+SCENARIO( "Test that WebSocketFramer encodes and decodes frames correctly", "[clientserver]" )
+{
+	typedef clientserver::WebSocketFramer::Opcode Opcode;
+	typedef clientserver::WebSocketFramer::Role Role;
+	Opcode opcode;
+	std::string payload;
+
+	GIVEN( "The examples from RFC 6455 section 5.7" )
+	{
+		WHEN( "Decoding a single frame masked text message" )
+		{
+			clientserver::WebSocketFramer framer( Role::server );
+			const std::string frame( "\x81\x85\x37\xfa\x21\x3d\x7f\x9f\x4d\x51\x58", 11 );
+			framer.append( frame.data(), frame.size() );
+			REQUIRE( framer.next( opcode, payload ) );
+			CHECK( opcode==Opcode::text );
+			CHECK( payload=="Hello" );
+			CHECK( framer.bufferedSize()==0 );
+		}
+		WHEN( "Decoding a fragmented unmasked text message" )
+		{
+			clientserver::WebSocketFramer framer( Role::client );
+			const std::string frames( "\x01\x03\x48\x65\x6c\x80\x02\x6c\x6f", 9 );
+			// Feed it in a byte at a time, the message should only come out at the end
+			for( size_t index=0; index<frames.size(); ++index )
+			{
+				CHECK( framer.next( opcode, payload )==false );
+				framer.append( &frames[index], 1 );
+			}
+			REQUIRE( framer.next( opcode, payload ) );
+			CHECK( opcode==Opcode::text );
+			CHECK( payload=="Hello" );
+		}
+		WHEN( "Encoding an unmasked text message" )
+		{
+			std::string output;
+			clientserver::WebSocketFramer::encode( Opcode::text, "Hello", output );
+			CHECK( output==std::string("\x81\x05\x48\x65\x6c\x6c\x6f",7) );
+		}
+		WHEN( "Encoding a masked text message" )
+		{
+			std::string output;
+			const uint8_t mask[4]={ 0x37, 0xfa, 0x21, 0x3d };
+			clientserver::WebSocketFramer::encode( Opcode::text, "Hello", output, mask );
+			CHECK( output==std::string("\x81\x85\x37\xfa\x21\x3d\x7f\x9f\x4d\x51\x58",11) );
+		}
+	}
+	GIVEN( "Messages of all the different length encodings" )
+	{
+		clientserver::WebSocketFramer framer( Role::server );
+		const uint8_t mask[4]={ 0x01, 0x80, 0x7f, 0xff };
+		std::string encoded;
+		const std::vector<size_t> sizes={ 0, 1, 125, 126, 127, 0xffff, 0x10000, 300000 };
+		for( const auto size : sizes ) clientserver::WebSocketFramer::encode( Opcode::binary, std::string(size,'\xa5'), encoded, mask );
+		clientserver::WebSocketFramer::encode( Opcode::ping, "ping", encoded, mask );
+
+		WHEN( "Decoding them all" )
+		{
+			framer.append( encoded.data(), encoded.size() );
+			for( const auto size : sizes )
+			{
+				REQUIRE( framer.next( opcode, payload ) );
+				CHECK( opcode==Opcode::binary );
+				CHECK( payload==std::string(size,'\xa5') );
+			}
+			REQUIRE( framer.next( opcode, payload ) );
+			CHECK( opcode==Opcode::ping );
+			CHECK( payload=="ping" );
+			CHECK( framer.next( opcode, payload )==false );
+		}
+	}
+	GIVEN( "Text that is not valid UTF-8" )
+	{
+		clientserver::WebSocketFramer framer( Role::client );
+
+		WHEN( "It is in a single frame" )
+		{
+			framer.append( "\x81\x02\xc3\x28", 4 );
+			CHECK_THROWS_AS( framer.next( opcode, payload ), std::invalid_argument& );
+		}
+		WHEN( "A code point is split over two fragments" )
+		{
+			// "é" is 0xc3 0xa9, each half on its own is invalid but together they're fine
+			framer.append( "\x01\x01\xc3\x80\x01\xa9", 6 );
+			REQUIRE( framer.next( opcode, payload ) );
+			CHECK( payload=="\xc3\xa9" );
+		}
+		WHEN( "The same bytes are sent as binary" )
+		{
+			framer.append( "\x82\x02\xc3\x28", 4 );
+			REQUIRE( framer.next( opcode, payload ) );
+			CHECK( opcode==Opcode::binary );
+		}
+	}
+	GIVEN( "Data that breaks the protocol" )
+	{
+		clientserver::WebSocketFramer framer( Role::server );
+
+		WHEN( "A client sends an unmasked frame" )
+		{
+			framer.append( "\x81\x00", 2 );
+			CHECK_THROWS_AS( framer.next( opcode, payload ), std::runtime_error& );
+		}
+		WHEN( "Reserved bits are set" )
+		{
+			framer.append( "\xc1\x80\x00\x00\x00\x00", 6 );
+			CHECK_THROWS_AS( framer.next( opcode, payload ), std::runtime_error& );
+		}
+		WHEN( "The opcode is reserved" )
+		{
+			framer.append( "\x83\x80\x00\x00\x00\x00", 6 );
+			CHECK_THROWS_AS( framer.next( opcode, payload ), std::runtime_error& );
+		}
+		WHEN( "A control frame is fragmented" )
+		{
+			framer.append( "\x09\x80\x00\x00\x00\x00", 6 );
+			CHECK_THROWS_AS( framer.next( opcode, payload ), std::runtime_error& );
+		}
+		WHEN( "A continuation frame arrives without a message to continue" )
+		{
+			framer.append( "\x80\x80\x00\x00\x00\x00", 6 );
+			CHECK_THROWS_AS( framer.next( opcode, payload ), std::runtime_error& );
+		}
+		WHEN( "A message is larger than the maximum" )
+		{
+			framer.setMaximumMessageSize( 1000 );
+			// Only the header, it should throw without waiting for the payload
+			framer.append( "\x82\xfe\x03\xe9\x00\x00\x00\x00", 8 );
+			CHECK_THROWS_AS( framer.next( opcode, payload ), std::length_error& );
+		}
+	}
+}
+
+SCENARIO( "Test the WebSocket handshake", "[clientserver]" )
+{
+	typedef clientserver::WebSocketHandshake::Result Result;
+	size_t requestSize;
+	std::string response;
+
+	GIVEN( "The example key from RFC 6455 section 1.3" )
+	{
+		CHECK( clientserver::WebSocketHandshake::acceptKey("dGhlIHNhbXBsZSBub25jZQ==")=="s3pPLMBiTxaQ9kYGzzhZRbK+xOo=" );
+	}
+	GIVEN( "A request from the client" )
+	{
+		std::string key;
+		const std::string request=clientserver::WebSocketHandshake::createRequest( "localhost:9002", "/", key );
+
+		WHEN( "Only part of it has arrived" )
+		{
+			CHECK( clientserver::WebSocketHandshake::parseRequest( request.data(), request.size()-1, requestSize, response )==Result::incomplete );
+		}
+		WHEN( "It has all arrived, followed by the first frame" )
+		{
+			const std::string data=request+"\x81\x80";
+			REQUIRE( clientserver::WebSocketHandshake::parseRequest( data.data(), data.size(), requestSize, response )==Result::upgrade );
+			CHECK( requestSize==request.size() );
+			CHECK( response.find("101 Switching Protocols")!=std::string::npos );
+
+			THEN( "The client accepts the response" )
+			{
+				size_t responseSize;
+				CHECK( clientserver::WebSocketHandshake::parseResponse( response.data(), response.size(), key, responseSize )==Result::upgrade );
+				CHECK( responseSize==response.size() );
+				CHECK( clientserver::WebSocketHandshake::parseResponse( response.data(), response.size(), "wrongkey", responseSize )==Result::invalid );
+			}
+		}
+		WHEN( "Header names are in a different case and Connection has several tokens" )
+		{
+			const std::string data="GET /chat HTTP/1.1\r\nhost: server.example.com\r\nUPGRADE: WebSocket\r\nconnection: keep-alive, Upgrade\r\n"
+				"sec-websocket-key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version:13\r\n\r\n";
+			std::string target;
+			REQUIRE( clientserver::WebSocketHandshake::parseRequest( data.data(), data.size(), requestSize, response, nullptr, &target )==Result::upgrade );
+			CHECK( response.find("s3pPLMBiTxaQ9kYGzzhZRbK+xOo=")!=std::string::npos );
+			CHECK( target=="/chat" );
+		}
+	}
+	GIVEN( "Requests that aren't WebSocket upgrades" )
+	{
+		WHEN( "It's a plain HTTP request" )
+		{
+			const std::string data="GET /index.html HTTP/1.1\r\nHost: localhost\r\n\r\n";
+			CHECK( clientserver::WebSocketHandshake::parseRequest( data.data(), data.size(), requestSize, response )==Result::invalid );
+			CHECK( response.compare(0,12,"HTTP/1.1 400")==0 );
+		}
+		WHEN( "The request never ends" )
+		{
+			const std::string data( clientserver::WebSocketHandshake::maximumRequestSize, 'a' );
+			CHECK( clientserver::WebSocketHandshake::parseRequest( data.data(), data.size(), requestSize, response )==Result::invalid );
+		}
+	}
+}
+
+SCENARIO( "Test that MessageEnvelope round trips", "[clientserver]" )
+{
+	typedef clientserver::MessageEnvelope::MessageType MessageType;
+	MessageType type;
+	uint32_t id;
+
+	GIVEN( "Each type of message" )
+	{
+		std::string request, response, info;
+		clientserver::MessageEnvelope::encode( MessageType::request, 4294967295u, "a:b", request );
+		clientserver::MessageEnvelope::encode( MessageType::response, 0, "", response );
+		clientserver::MessageEnvelope::encode( MessageType::info, 0, "quit", info );
+		CHECK( request=="q4294967295:a:b" );
+		CHECK( response=="r0:" );
+		CHECK( info=="iquit" );
+
+		clientserver::MessageEnvelope::decode( request, type, id );
+		CHECK( type==MessageType::request );
+		CHECK( id==4294967295u );
+		CHECK( request=="a:b" );
+		clientserver::MessageEnvelope::decode( response, type, id );
+		CHECK( type==MessageType::response );
+		CHECK( id==0 );
+		CHECK( response.empty() );
+		clientserver::MessageEnvelope::decode( info, type, id );
+		CHECK( type==MessageType::info );
+		CHECK( info=="quit" );
+	}
+	GIVEN( "Each type of streaming message" )
+	{
+		for( const auto type : { MessageType::streamRequest, MessageType::streamChunk, MessageType::streamEnd } )
+		{
+			std::string message;
+			clientserver::MessageEnvelope::encode( type, 12, "payload", message );
+			CHECK( message.substr(1)=="12:payload" );
+			MessageType decodedType;
+			clientserver::MessageEnvelope::decode( message, decodedType, id );
+			CHECK( decodedType==type );
+			CHECK( id==12 );
+			CHECK( message=="payload" );
+		}
+	}
+	GIVEN( "The session messages" )
+	{
+		std::string session, acknowledgement;
+		clientserver::MessageEnvelope::encode( MessageType::session, 7, "0123abcd", session );
+		clientserver::MessageEnvelope::encode( MessageType::acknowledgement, 16, "", acknowledgement );
+		CHECK( session=="t7:0123abcd" );
+		CHECK( acknowledgement=="a16:" );
+
+		clientserver::MessageEnvelope::decode( session, type, id );
+		CHECK( type==MessageType::session );
+		CHECK( id==7 );
+		CHECK( session=="0123abcd" );
+		clientserver::MessageEnvelope::decode( acknowledgement, type, id );
+		CHECK( type==MessageType::acknowledgement );
+		CHECK( id==16 );
+	}
+	GIVEN( "Invalid envelopes" )
+	{
+		for( std::string message : { "", "x", "q", "q:", "q12", "q-1:", "q4294967296:", "q12345678901:" } )
+		{
+			CHECK_THROWS_AS( clientserver::MessageEnvelope::decode( message, type, id ), std::runtime_error& );
+		}
+	}
+}
+
+SCENARIO( "Test that BatchEnvelope round trips", "[clientserver]" )
+{
+	typedef clientserver::BatchEnvelope BatchEnvelope;
+	std::vector<BatchEnvelope::Entry> entries;
+
+	GIVEN( "A batch with empty, binary and separator filled entries" )
+	{
+		std::string batch;
+		BatchEnvelope::encode( 0, "first", batch );
+		BatchEnvelope::encode( 4294967295u, "", batch );
+		BatchEnvelope::encode( 7, std::string("1:2:\0\xff",6), batch );
+		CHECK( batch==std::string("0:5:first4294967295:0:7:6:1:2:\0\xff",32) );
+
+		BatchEnvelope::decode( batch, entries );
+		REQUIRE( entries.size()==3 );
+		CHECK( entries[0].id==0 );
+		CHECK( entries[0].payload=="first" );
+		CHECK( entries[1].id==4294967295u );
+		CHECK( entries[1].payload.empty() );
+		CHECK( entries[2].id==7 );
+		CHECK( entries[2].payload==std::string("1:2:\0\xff",6) );
+	}
+	GIVEN( "Invalid batches" )
+	{
+		for( std::string batch : { "x", "1", "1:", "1:5", "1:5:abc", "4294967296:0:", "1:-1:", "0:0:x" } )
+		{
+			CHECK_THROWS_AS( BatchEnvelope::decode( batch, entries ), std::runtime_error& );
+		}
+	}
+}
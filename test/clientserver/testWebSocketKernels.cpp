@@ -0,0 +1,235 @@
+#include "catch.hpp"
+#include "clientserver/WebSocketKernels.h"
+#include <random>
+#include <string>
+
+namespace // Unnamed namespace for things only used in this file
+{
+	/** @brief Straightforward decoding validator to check the optimised ones against. Deliberately written
+	 * differently to the ones being tested, by decoding the code point and checking its range. */
+	bool referenceIsValidUtf8( const unsigned char* pData, size_t size )
+	{
+		for( size_t index=0; index<size; )
+		{
+			const unsigned char lead=pData[index];
+			if( lead<0x80 )
+			{
+				++index;
+				continue;
+			}
+
+			size_t length;
+			uint32_t codePoint;
+			uint32_t minimum;
+			if( (lead & 0xe0)==0xc0 ) { length=2; codePoint=lead & 0x1f; minimum=0x80; }
+			else if( (lead & 0xf0)==0xe0 ) { length=3; codePoint=lead & 0x0f; minimum=0x800; }
+			else if( (lead & 0xf8)==0xf0 ) { length=4; codePoint=lead & 0x07; minimum=0x10000; }
+			else return false;
+
+			if( index+length>size ) return false;
+			for( size_t position=1; position<length; ++position )
+			{
+				if( (pData[index+position] & 0xc0)!=0x80 ) return false;
+				codePoint=(codePoint<<6) | (pData[index+position] & 0x3f);
+			}
+			if( codePoint<minimum || codePoint>0x10ffff || (codePoint>=0xd800 && codePoint<=0xdfff) ) return false;
+			index+=length;
+		}
+		return true;
+	}
+
+	void appendCodePoint( uint32_t codePoint, std::string& output )
+	{
+		if( codePoint<0x80 ) output+=static_cast<char>(codePoint);
+		else if( codePoint<0x800 )
+		{
+			output+=static_cast<char>( 0xc0 | (codePoint>>6) );
+			output+=static_cast<char>( 0x80 | (codePoint & 0x3f) );
+		}
+		else if( codePoint<0x10000 )
+		{
+			output+=static_cast<char>( 0xe0 | (codePoint>>12) );
+			output+=static_cast<char>( 0x80 | ((codePoint>>6) & 0x3f) );
+			output+=static_cast<char>( 0x80 | (codePoint & 0x3f) );
+		}
+		else
+		{
+			output+=static_cast<char>( 0xf0 | (codePoint>>18) );
+			output+=static_cast<char>( 0x80 | ((codePoint>>12) & 0x3f) );
+			output+=static_cast<char>( 0x80 | ((codePoint>>6) & 0x3f) );
+			output+=static_cast<char>( 0x80 | (codePoint & 0x3f) );
+		}
+	}
+
+	/** @brief Counts how many times each instruction set disagrees with the reference about the sequence,
+	 * when it is put inside some ASCII so that it straddles the boundary between two 32 byte blocks. */
+	class SequenceChecker
+	{
+	public:
+		SequenceChecker() : instructionSets_(clientserver::supportedInstructionSets()), buffer_(64,'a'), numberOfErrors_(0) {}
+		void check( const unsigned char* pSequence, size_t size )
+		{
+			const size_t start=31-(size>1 ? 1 : 0);
+			std::copy( pSequence, pSequence+size, buffer_.begin()+start );
+			const bool expected=::referenceIsValidUtf8( pSequence, size );
+			for( const auto instructionSet : instructionSets_ )
+			{
+				if( clientserver::isValidUtf8( instructionSet, buffer_.data(), buffer_.size() )!=expected ) ++numberOfErrors_;
+			}
+			std::fill( buffer_.begin()+start, buffer_.begin()+start+size, 'a' );
+		}
+		size_t numberOfErrors() const { return numberOfErrors_; }
+	protected:
+		std::vector<clientserver::InstructionSet> instructionSets_;
+		std::string buffer_;
+		size_t numberOfErrors_;
+	};
+} // end of the unnamed namespace
+
+SCENARIO( "Test that every implementation of applyWebSocketMask gives the same result as masking byte by byte", "[clientserver]" )
+{
+	const uint8_t mask[4]={ 0x12, 0x34, 0x56, 0x78 };
+	std::string original;
+	for( size_t index=0; index<200; ++index ) original+=static_cast<char>( index*7 );
+
+	for( const auto instructionSet : clientserver::supportedInstructionSets() )
+	{
+		GIVEN( std::string("The ")+clientserver::instructionSetName(instructionSet)+" implementation" )
+		{
+			// Try every combination of start position, size and mask offset, to cover the unaligned ends
+			size_t numberOfErrors=0;
+			for( size_t start=0; start<33; ++start )
+			{
+				for( size_t size=0; start+size<=original.size(); ++size )
+				{
+					for( size_t maskOffset=0; maskOffset<4; ++maskOffset )
+					{
+						std::string data=original;
+						clientserver::applyWebSocketMask( instructionSet, &data[start], size, mask, maskOffset );
+						for( size_t index=0; index<data.size(); ++index )
+						{
+							char expected=original[index];
+							if( index>=start && index<start+size ) expected^=mask[(index-start+maskOffset)%4];
+							if( data[index]!=expected ) ++numberOfErrors;
+						}
+					}
+				}
+			}
+			CHECK( numberOfErrors==0 );
+		}
+	}
+	GIVEN( "The dispatched implementation" )
+	{
+		std::string data=original;
+		clientserver::applyWebSocketMask( &data[0], data.size(), mask );
+		clientserver::applyWebSocketMask( &data[0], data.size(), mask );
+		CHECK( data==original );
+	}
+}
+
+SCENARIO( "Test that every implementation of isValidUtf8 agrees with a reference decoder", "[clientserver]" )
+{
+	CHECK( clientserver::supportedInstructionSets().front()==clientserver::InstructionSet::generic );
+
+	GIVEN( "Every sequence of one and two bytes" )
+	{
+		::SequenceChecker checker;
+		unsigned char sequence[2];
+		for( unsigned first=0; first<256; ++first )
+		{
+			sequence[0]=first;
+			checker.check( sequence, 1 );
+			for( unsigned second=0; second<256; ++second )
+			{
+				sequence[1]=second;
+				checker.check( sequence, 2 );
+			}
+		}
+		CHECK( checker.numberOfErrors()==0 );
+	}
+	GIVEN( "Every sequence of three bytes that doesn't start with ASCII" )
+	{
+		// Ones that start with ASCII are the same as the two byte sequences already tested
+		::SequenceChecker checker;
+		unsigned char sequence[3];
+		for( unsigned first=0x80; first<256; ++first )
+		{
+			sequence[0]=first;
+			for( unsigned second=0; second<256; ++second )
+			{
+				sequence[1]=second;
+				for( unsigned third=0; third<256; ++third )
+				{
+					sequence[2]=third;
+					checker.check( sequence, 3 );
+				}
+			}
+		}
+		CHECK( checker.numberOfErrors()==0 );
+	}
+	GIVEN( "Every four byte lead followed by every two bytes and the edge values for the last" )
+	{
+		::SequenceChecker checker;
+		unsigned char sequence[4];
+		for( unsigned first=0xf0; first<256; ++first )
+		{
+			sequence[0]=first;
+			for( unsigned second=0; second<256; ++second )
+			{
+				sequence[1]=second;
+				for( unsigned third=0; third<256; ++third )
+				{
+					sequence[2]=third;
+					for( const unsigned char fourth : { 0x00, 0x7f, 0x80, 0xbf, 0xc0, 0xff } )
+					{
+						sequence[3]=fourth;
+						checker.check( sequence, 4 );
+					}
+				}
+			}
+		}
+		CHECK( checker.numberOfErrors()==0 );
+	}
+	GIVEN( "Every code point in a long string" )
+	{
+		std::string text;
+		for( uint32_t codePoint=0; codePoint<=0x10ffff; ++codePoint )
+		{
+			if( codePoint<0xd800 || codePoint>0xdfff ) ::appendCodePoint( codePoint, text );
+		}
+
+		for( const auto instructionSet : clientserver::supportedInstructionSets() )
+		{
+			CHECK( clientserver::isValidUtf8( instructionSet, text.data(), text.size() ) );
+			// Chopping the last byte off leaves an unfinished sequence
+			CHECK( !clientserver::isValidUtf8( instructionSet, text.data(), text.size()-1 ) );
+		}
+		CHECK( clientserver::isValidUtf8( text.data(), text.size() ) );
+	}
+	GIVEN( "Random mixtures of code points with random corruptions" )
+	{
+		std::mt19937 generator( 1234 );
+		const uint32_t limits[]={ 0x80, 0x800, 0x10000, 0x110000 };
+		size_t numberOfErrors=0;
+		for( size_t test=0; test<20000; ++test )
+		{
+			std::string text;
+			const size_t numberOfCodePoints=generator()%200;
+			for( size_t index=0; index<numberOfCodePoints; ++index )
+			{
+				// Mostly ASCII, like most real text
+				uint32_t codePoint=(generator()%4==0 ? generator()%limits[generator()%4] : generator()%0x80);
+				if( codePoint>=0xd800 && codePoint<=0xdfff ) codePoint=0;
+				::appendCodePoint( codePoint, text );
+			}
+			if( !text.empty() && test%2==0 ) text[generator()%text.size()]=static_cast<char>( generator() );
+
+			const bool expected=::referenceIsValidUtf8( reinterpret_cast<const unsigned char*>(text.data()), text.size() );
+			for( const auto instructionSet : clientserver::supportedInstructionSets() )
+			{
+				if( clientserver::isValidUtf8( instructionSet, text.data(), text.size() )!=expected ) ++numberOfErrors;
+			}
+		}
+		CHECK( numberOfErrors==0 );
+	}
+}
@@ -0,0 +1,1166 @@
+#include "catch.hpp"
+#include "clientserver/WebSocketServer.h"
+#include "clientserver/WebSocketClient.h"
+#include "clientserver/WebSocketFramer.h"
+#include "clientserver/WebSocketHandshake.h"
+#include "clientserver/TcpClient.h"
+#include "clientserver/PerMessageDeflate.h"
+#include "clientserver/ZstdDictionary.h"
+#include "clientserver/MessageEnvelope.h"
+#include "clientserver/BatchEnvelope.h"
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <chrono>
+#include <thread>
+#include <fstream>
+#include <set>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <netinet/in.h>
+
+namespace // Unnamed namespace for things only used in this file
+{
+	/** @brief Reads from a blocking socket until the predicate is true for what has been read, or the socket closes. */
+	template<class T_Predicate>
+	std::string readUntil( int socket, T_Predicate predicate )
+	{
+		timeval timeout{ 5, 0 };
+		::setsockopt( socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout) );
+		std::string data;
+		while( !predicate(data) )
+		{
+			char buffer[4096];
+			ssize_t bytesRead=::recv( socket, buffer, sizeof(buffer), 0 );
+			if( bytesRead<=0 ) break;
+			data.append( buffer, bytesRead );
+		}
+		return data;
+	}
+
+	/** @brief The chunks the streaming handler in the tests writes, which say where they should be in the reply. */
+	std::string streamChunk( size_t index )
+	{
+		return std::to_string(index)+":"+std::string(16*1024,'x');
+	}
+
+	/** @brief Collects the reply to a streaming request, and can hold up the client's receive thread after the first chunk. */
+	class StreamCollector
+	{
+	public:
+		StreamCollector( bool holdAfterFirstChunk=false )
+			: isHeld_(holdAfterFirstChunk), chunksReceived_(0), chunksOutOfOrder_(0), hasEnded_(false)
+		{
+			// No operation besides the initialiser list
+		}
+		void send( clientserver::WebSocketClient& client, const std::string& request, bool isBinary=false )
+		{
+			auto chunkHandler=[this](const std::string& chunk)
+				{
+					std::unique_lock<std::mutex> lock( mutex_ );
+					if( chunk!=::streamChunk(chunksReceived_) ) ++chunksOutOfOrder_;
+					++chunksReceived_;
+					condition_.notify_all();
+					condition_.wait( lock, [this]{ return !isHeld_; } );
+				};
+			auto endHandler=[this](const std::string& error)
+				{
+					std::lock_guard<std::mutex> lock( mutex_ );
+					hasEnded_=true;
+					error_=error;
+					condition_.notify_all();
+				};
+			if( isBinary ) client.sendBinaryStreamingRequest( request, chunkHandler, endHandler );
+			else client.sendStreamingRequest( request, chunkHandler, endHandler );
+		}
+		bool waitForFirstChunk()
+		{
+			std::unique_lock<std::mutex> lock( mutex_ );
+			return condition_.wait_for( lock, std::chrono::seconds(5), [this]{ return chunksReceived_>0; } );
+		}
+		bool waitForEnd()
+		{
+			std::unique_lock<std::mutex> lock( mutex_ );
+			return condition_.wait_for( lock, std::chrono::seconds(20), [this]{ return hasEnded_; } );
+		}
+		void release()
+		{
+			std::lock_guard<std::mutex> lock( mutex_ );
+			isHeld_=false;
+			condition_.notify_all();
+		}
+		size_t chunksReceived() { std::lock_guard<std::mutex> lock( mutex_ ); return chunksReceived_; }
+		size_t chunksOutOfOrder() { std::lock_guard<std::mutex> lock( mutex_ ); return chunksOutOfOrder_; }
+		std::string error() { std::lock_guard<std::mutex> lock( mutex_ ); return error_; }
+	protected:
+		std::mutex mutex_;
+		std::condition_variable condition_;
+		bool isHeld_;
+		size_t chunksReceived_;
+		size_t chunksOutOfOrder_;
+		bool hasEnded_;
+		std::string error_;
+	};
+
+	/** @brief Speaks the protocol directly with a small receive buffer, to see what order the server sends things in. */
+	class RawClient
+	{
+	public:
+		RawClient( size_t port )
+			: socket_(::socket( AF_INET, SOCK_STREAM, 0 )), framer_(clientserver::WebSocketFramer::Role::client)
+		{
+			// Has to be set before connecting to limit the window
+			const int receiveBufferSize=32*1024;
+			::setsockopt( socket_, SOL_SOCKET, SO_RCVBUF, &receiveBufferSize, sizeof(receiveBufferSize) );
+			timeval timeout{ 5, 0 };
+			::setsockopt( socket_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout) );
+			sockaddr_in address{};
+			address.sin_family=AF_INET;
+			address.sin_port=htons( static_cast<uint16_t>(port) );
+			address.sin_addr.s_addr=htonl( INADDR_LOOPBACK );
+			if( ::connect( socket_, reinterpret_cast<sockaddr*>(&address), sizeof(address) )!=0 ) throw std::runtime_error( "RawClient couldn't connect" );
+
+			std::string key;
+			const std::string request=clientserver::WebSocketHandshake::createRequest( "localhost", "/", key );
+			::send( socket_, request.data(), request.size(), 0 );
+			std::string response=::readUntil( socket_, [](const std::string& data){ return data.find("\r\n\r\n")!=std::string::npos; } );
+			size_t responseSize;
+			if( clientserver::WebSocketHandshake::parseResponse( response.data(), response.size(), key, responseSize )!=clientserver::WebSocketHandshake::Result::upgrade ) throw std::runtime_error( "RawClient wasn't upgraded" );
+			framer_.append( response.data()+responseSize, response.size()-responseSize );
+		}
+		~RawClient() { ::close( socket_ ); }
+		void send( const std::string& message )
+		{
+			std::string frame;
+			const uint8_t mask[4]={ 1, 2, 3, 4 };
+			clientserver::WebSocketFramer::encode( clientserver::WebSocketFramer::Opcode::text, message, frame, mask );
+			::send( socket_, frame.data(), frame.size(), 0 );
+		}
+		/** @brief The next text message, or the close frame's status code as "close <code>". Empty if nothing arrives before the timeout. */
+		std::string receive( std::chrono::milliseconds timeout=std::chrono::seconds(5) )
+		{
+			timeval socketTimeout{ static_cast<time_t>(timeout.count()/1000), static_cast<suseconds_t>((timeout.count()%1000)*1000) };
+			::setsockopt( socket_, SOL_SOCKET, SO_RCVTIMEO, &socketTimeout, sizeof(socketTimeout) );
+			clientserver::WebSocketFramer::Opcode opcode;
+			std::string message;
+			while( !framer_.next( opcode, message ) )
+			{
+				char buffer[4096];
+				const ssize_t bytesRead=::recv( socket_, buffer, sizeof(buffer), 0 );
+				if( bytesRead<=0 ) return std::string();
+				framer_.append( buffer, bytesRead );
+			}
+			if( opcode==clientserver::WebSocketFramer::Opcode::close ) return "close "+std::to_string( (static_cast<uint8_t>(message[0])<<8) | static_cast<uint8_t>(message[1]) );
+			return message;
+		}
+	protected:
+		int socket_;
+		clientserver::WebSocketFramer framer_;
+	};
+} // end of the unnamed namespace
+
+SCENARIO( "Test that the native WebSocketServer engine works with WebSocketClient", "[clientserver]" )
+{
+	GIVEN( "A server with echo handlers running two event loops" )
+	{
+		clientserver::WebSocketServer server;
+		server.setNumberOfThreads( 2 );
+		server.setDefaultRequestHandler( [](const std::string& message,std::weak_ptr<clientserver::IConnection> pConnection)->std::string
+			{
+				return "Response to "+message;
+			});
+		server.setDefaultInfoHandler( [&](const std::string& message,std::weak_ptr<clientserver::IConnection> pConnection)
+			{
+				auto pLockedConnection=pConnection.lock();
+				if( !pLockedConnection ) return;
+				if( message=="close me" ) pLockedConnection->close();
+				else pLockedConnection->sendInfo( "Info reply to "+message );
+			});
+		REQUIRE_NOTHROW( server.listen( 0 ) );
+		REQUIRE( server.port()!=0 );
+
+		WHEN( "Several clients send lots of requests at once" )
+		{
+			const size_t numberOfClients=4;
+			const size_t numberOfRequests=1000;
+			std::mutex mutex;
+			std::condition_variable condition;
+			size_t numberOfResponses=0;
+			size_t numberOfErrors=0;
+			std::vector<std::string> infoMessages;
+
+			std::vector<std::unique_ptr<clientserver::WebSocketClient> > clients;
+			for( size_t clientIndex=0; clientIndex<numberOfClients; ++clientIndex )
+			{
+				clients.emplace_back( new clientserver::WebSocketClient );
+				clients.back()->setDefaultInfoHandler( [&](const std::string& message)
+					{
+						std::lock_guard<std::mutex> lock( mutex );
+						infoMessages.push_back( message );
+						condition.notify_all();
+					});
+				REQUIRE_NOTHROW( clients.back()->connect( "localhost", server.port() ) );
+			}
+			CHECK( server.currentConnections()==numberOfClients );
+
+			std::vector<std::thread> threads;
+			for( size_t clientIndex=0; clientIndex<numberOfClients; ++clientIndex )
+			{
+				threads.emplace_back( [&,clientIndex]()
+					{
+						for( size_t index=0; index<numberOfRequests; ++index )
+						{
+							// Make some of them large enough to need several reads
+							const std::string message=(index%100==0 ? std::string(200000,'a') : "request ")+std::to_string(clientIndex)+"/"+std::to_string(index);
+							clients[clientIndex]->sendRequest( message, [&,message](const std::string& response)
+								{
+									std::lock_guard<std::mutex> lock( mutex );
+									if( response!="Response to "+message ) ++numberOfErrors;
+									++numberOfResponses;
+									condition.notify_all();
+								});
+						}
+						clients[clientIndex]->sendInfo( "hello" );
+					});
+			}
+			for( auto& thread : threads ) thread.join();
+
+			std::unique_lock<std::mutex> lock( mutex );
+			CHECK( condition.wait_for( lock, std::chrono::seconds(20), [&]{ return numberOfResponses==numberOfClients*numberOfRequests && infoMessages.size()==numberOfClients; } ) );
+			CHECK( numberOfErrors==0 );
+			for( const auto& message : infoMessages ) CHECK( message=="Info reply to hello" );
+		}
+		WHEN( "A handler closes the connection" )
+		{
+			clientserver::WebSocketClient client;
+			REQUIRE_NOTHROW( client.connect( "localhost", server.port() ) );
+			client.sendInfo( "close me" );
+			for( size_t tries=0; tries<500 && client.isConnected(); ++tries ) std::this_thread::sleep_for( std::chrono::milliseconds(10) );
+			CHECK( !client.isConnected() );
+		}
+		WHEN( "A client speaks the protocol directly" )
+		{
+			int socket=clientserver::connectTcp( "localhost", server.port() );
+			std::string key;
+			const std::string request=clientserver::WebSocketHandshake::createRequest( "localhost", "/", key );
+			// Send the handshake and a ping in the same packet
+			std::string data=request;
+			const uint8_t mask[4]={ 1, 2, 3, 4 };
+			clientserver::WebSocketFramer::encode( clientserver::WebSocketFramer::Opcode::ping, "are you there", data, mask );
+			REQUIRE( ::send( socket, data.data(), data.size(), 0 )==static_cast<ssize_t>(data.size()) );
+
+			std::string expectedPong;
+			clientserver::WebSocketFramer::encode( clientserver::WebSocketFramer::Opcode::pong, "are you there", expectedPong );
+			const std::string received=::readUntil( socket, [&](const std::string& data){ return data.find(expectedPong)!=std::string::npos; } );
+			size_t responseSize;
+			CHECK( clientserver::WebSocketHandshake::parseResponse( received.data(), received.size(), key, responseSize )==clientserver::WebSocketHandshake::Result::upgrade );
+			CHECK( received.substr(responseSize)==expectedPong );
+
+			// An unmasked frame is a protocol error, so should get a close frame with status 1002 back
+			REQUIRE( ::send( socket, "\x81\x00", 2, 0 )==2 );
+			const std::string closeFrame=::readUntil( socket, [](const std::string& data){ return data.size()>=4; } );
+			CHECK( closeFrame==std::string("\x88\x02\x03\xea",4) );
+			::close( socket );
+		}
+		WHEN( "Binary messages are sent without any binary handlers set" )
+		{
+			clientserver::WebSocketClient client;
+			REQUIRE_NOTHROW( client.connect( "localhost", server.port() ) );
+			std::mutex mutex;
+			std::condition_variable condition;
+			std::string response;
+			// Not valid UTF-8, so couldn't be sent in a text frame
+			const std::string message( "\xff\x00\xc3\x28", 4 );
+			client.sendBinaryRequest( message, [&](const std::string& binaryResponse)
+				{
+					std::lock_guard<std::mutex> lock( mutex );
+					response=binaryResponse;
+					condition.notify_all();
+				});
+			std::unique_lock<std::mutex> lock( mutex );
+			CHECK( condition.wait_for( lock, std::chrono::seconds(5), [&]{ return !response.empty(); } ) );
+			CHECK( response=="Response to "+message );
+		}
+		WHEN( "A text message is not valid UTF-8" )
+		{
+			int socket=clientserver::connectTcp( "localhost", server.port() );
+			std::string key;
+			std::string data=clientserver::WebSocketHandshake::createRequest( "localhost", "/", key );
+			const uint8_t mask[4]={ 1, 2, 3, 4 };
+			clientserver::WebSocketFramer::encode( clientserver::WebSocketFramer::Opcode::text, "q1:\xc3\x28", data, mask );
+			REQUIRE( ::send( socket, data.data(), data.size(), 0 )==static_cast<ssize_t>(data.size()) );
+
+			// Should get the handshake response and then a close frame with status 1007
+			const std::string closeFrame( "\x88\x02\x03\xef", 4 );
+			const std::string received=::readUntil( socket, [&](const std::string& data){ return data.find(closeFrame)!=std::string::npos; } );
+			CHECK( received.find(closeFrame)!=std::string::npos );
+			::close( socket );
+		}
+		WHEN( "A plain HTTP request is made" )
+		{
+			int socket=clientserver::connectTcp( "localhost", server.port() );
+			const std::string request="GET /index.html HTTP/1.1\r\nHost: localhost\r\n\r\n";
+			REQUIRE( ::send( socket, request.data(), request.size(), 0 )==static_cast<ssize_t>(request.size()) );
+			// The server should answer and then close the connection
+			const std::string received=::readUntil( socket, [](const std::string&){ return false; } );
+			CHECK( received.compare(0,12,"HTTP/1.1 400")==0 );
+			::close( socket );
+		}
+
+		server.stop();
+		CHECK( server.currentConnections()==0 );
+	}
+}
+
+SCENARIO( "Test that WebSocketServer serves files for plain HTTP requests", "[clientserver]" )
+{
+	GIVEN( "A server with a directory of client code to serve" )
+	{
+		const std::string directory="/tmp/clientserver-test-"+std::to_string(::getpid())+"-www";
+		REQUIRE( ::mkdir( directory.c_str(), 0700 )==0 );
+		const std::string wasmContents( "\0asm\x01\0\0\0", 8 );
+		std::ofstream( directory+"/ClientCode.wasm", std::ios::binary ) << wasmContents;
+		std::ofstream( directory+"/index.html" ) << "<html></html>";
+
+		clientserver::WebSocketServer server;
+		server.setFileServeRoot( directory );
+		server.setDefaultRequestHandler( [](const std::string& message,std::weak_ptr<clientserver::IConnection> pConnection)->std::string
+			{
+				return "Response to "+message;
+			});
+		REQUIRE_NOTHROW( server.listen( 0 ) );
+
+		auto get=[&]( const std::string& target )
+			{
+				int socket=clientserver::connectTcp( "localhost", server.port() );
+				const std::string request="GET "+target+" HTTP/1.1\r\nHost: localhost\r\n\r\n";
+				::send( socket, request.data(), request.size(), 0 );
+				// The server closes the connection after each file
+				const std::string received=::readUntil( socket, [](const std::string&){ return false; } );
+				::close( socket );
+				return received;
+			};
+
+		WHEN( "Files are asked for" )
+		{
+			std::string received=get( "/ClientCode.wasm" );
+			CHECK( received.compare(0,12,"HTTP/1.1 200")==0 );
+			CHECK( received.find("Content-Type: application/wasm\r\n")!=std::string::npos );
+			CHECK( received.find("Content-Length: 8\r\n")!=std::string::npos );
+			CHECK( received.substr(received.size()-wasmContents.size())==wasmContents );
+
+			received=get( "/?cacheBuster=1" );
+			CHECK( received.compare(0,12,"HTTP/1.1 200")==0 );
+			CHECK( received.find("Content-Type: text/html")!=std::string::npos );
+		}
+		WHEN( "Files that aren't there or are outside the directory are asked for" )
+		{
+			CHECK( get( "/missing.js" ).compare(0,12,"HTTP/1.1 404")==0 );
+			CHECK( get( "/../"+directory.substr(5)+"/index.html" ).compare(0,12,"HTTP/1.1 404")==0 );
+			CHECK( get( "/%2e%2e/index.html" ).compare(0,12,"HTTP/1.1 404")==0 );
+		}
+		WHEN( "A WebSocket client connects to the same port" )
+		{
+			clientserver::WebSocketClient client;
+			REQUIRE_NOTHROW( client.connect( "localhost", server.port() ) );
+			std::mutex mutex;
+			std::condition_variable condition;
+			std::string response;
+			client.sendRequest( "hello", [&](const std::string& message)
+				{
+					std::lock_guard<std::mutex> lock( mutex );
+					response=message;
+					condition.notify_all();
+				});
+			std::unique_lock<std::mutex> lock( mutex );
+			CHECK( condition.wait_for( lock, std::chrono::seconds(5), [&]{ return !response.empty(); } ) );
+			CHECK( response=="Response to hello" );
+			lock.unlock();
+			client.disconnect();
+		}
+
+		server.stop();
+		::unlink( (directory+"/ClientCode.wasm").c_str() );
+		::unlink( (directory+"/index.html").c_str() );
+		::rmdir( directory.c_str() );
+	}
+}
+
+SCENARIO( "Test that WebSocketServers can share a port with setReusePort", "[clientserver]" )
+{
+	GIVEN( "Two servers listening on the same port" )
+	{
+		clientserver::WebSocketServer firstServer;
+		clientserver::WebSocketServer secondServer;
+		firstServer.setReusePort( true );
+		secondServer.setReusePort( true );
+		firstServer.setNumberOfThreads( 1 );
+		secondServer.setNumberOfThreads( 1 );
+		firstServer.setDefaultRequestHandler( [](const std::string& message,std::weak_ptr<clientserver::IConnection> pConnection)->std::string{ return "first"; } );
+		secondServer.setDefaultRequestHandler( [](const std::string& message,std::weak_ptr<clientserver::IConnection> pConnection)->std::string{ return "second"; } );
+		REQUIRE_NOTHROW( firstServer.listen( 0 ) );
+		REQUIRE_NOTHROW( secondServer.listen( firstServer.port() ) );
+		CHECK( secondServer.port()==firstServer.port() );
+
+		WHEN( "Many clients connect" )
+		{
+			// The kernel picks a socket from a hash of the addresses, so a few connections should reach both
+			std::set<std::string> responses;
+			for( size_t index=0; index<32 && responses.size()<2; ++index )
+			{
+				::RawClient client( firstServer.port() );
+				client.send( "q1:hello" );
+				responses.insert( client.receive() );
+			}
+			CHECK( responses==std::set<std::string>({ "r1:first", "r1:second" }) );
+		}
+		WHEN( "A server that hasn't set it tries to listen on the port" )
+		{
+			clientserver::WebSocketServer otherServer;
+			CHECK_THROWS( otherServer.listen( firstServer.port() ) );
+		}
+
+		secondServer.stop();
+		firstServer.stop();
+	}
+}
+
+SCENARIO( "Test that WebSocketServer sends binary messages to the binary handlers", "[clientserver]" )
+{
+	GIVEN( "A server with different text and binary handlers" )
+	{
+		std::mutex mutex;
+		std::condition_variable condition;
+		std::vector<std::string> binaryInfoMessages;
+
+		clientserver::WebSocketServer server;
+		server.setNumberOfThreads( 1 );
+		server.setDefaultRequestHandler( [](const std::string& message,std::weak_ptr<clientserver::IConnection> pConnection)->std::string
+			{
+				return "text "+message;
+			});
+		server.setDefaultBinaryRequestHandler( [](const std::string& message,std::weak_ptr<clientserver::IConnection> pConnection)->std::string
+			{
+				return std::string( message.rbegin(), message.rend() );
+			});
+		server.setDefaultBinaryInfoHandler( [&](const std::string& message,std::weak_ptr<clientserver::IConnection> pConnection)
+			{
+				std::lock_guard<std::mutex> lock( mutex );
+				binaryInfoMessages.push_back( message );
+				condition.notify_all();
+			});
+		REQUIRE_NOTHROW( server.listen( 0 ) );
+
+		clientserver::WebSocketClient client;
+		REQUIRE_NOTHROW( client.connect( "localhost", server.port() ) );
+
+		WHEN( "Sending text and binary requests with the same connection" )
+		{
+			std::vector<std::string> responses;
+			const std::string binaryMessage( "\x01\x00\xfe\xff", 4 );
+			client.sendRequest( "hello", [&](const std::string& response)
+				{
+					std::lock_guard<std::mutex> lock( mutex );
+					responses.push_back( response );
+					condition.notify_all();
+				});
+			client.sendBinaryRequest( binaryMessage, [&](const std::string& response)
+				{
+					std::lock_guard<std::mutex> lock( mutex );
+					responses.push_back( response );
+					condition.notify_all();
+				});
+			client.sendBinaryInfo( binaryMessage );
+
+			std::unique_lock<std::mutex> lock( mutex );
+			CHECK( condition.wait_for( lock, std::chrono::seconds(5), [&]{ return responses.size()==2 && binaryInfoMessages.size()==1; } ) );
+			REQUIRE( responses.size()==2 );
+			CHECK( responses[0]=="text hello" );
+			CHECK( responses[1]==std::string( "\xff\xfe\x00\x01", 4 ) );
+			REQUIRE( binaryInfoMessages.size()==1 );
+			CHECK( binaryInfoMessages.front()==binaryMessage );
+		}
+
+		client.disconnect();
+		server.stop();
+	}
+}
+
+SCENARIO( "Test that WebSocketServer compresses messages with permessage-deflate", "[clientserver]" )
+{
+	GIVEN( "A server that compresses messages of 100 bytes or more" )
+	{
+		clientserver::PerMessageDeflate::Configuration configuration;
+		configuration.threshold=100;
+		clientserver::WebSocketServer server;
+		server.setNumberOfThreads( 1 );
+		server.setCompression( configuration );
+		server.setDefaultRequestHandler( [](const std::string& message,std::weak_ptr<clientserver::IConnection> pConnection)->std::string
+			{
+				return "Response to "+message;
+			});
+		server.setDefaultInfoHandler( [](const std::string& message,std::weak_ptr<clientserver::IConnection> pConnection)
+			{
+				auto pLockedConnection=pConnection.lock();
+				if( pLockedConnection ) pLockedConnection->sendInfo( "Info reply to "+message );
+			});
+		REQUIRE_NOTHROW( server.listen( 0 ) );
+
+		WHEN( "Clients with and without context takeover send large and small messages" )
+		{
+			for( bool contextTakeover : { true, false } )
+			{
+				clientserver::PerMessageDeflate::Configuration clientConfiguration;
+				clientConfiguration.contextTakeover=contextTakeover;
+				clientConfiguration.peerContextTakeover=contextTakeover;
+				clientserver::WebSocketClient client;
+				client.setCompression( clientConfiguration );
+				REQUIRE_NOTHROW( client.connect( "localhost", server.port() ) );
+				CHECK( client.isCompressing() );
+
+				std::mutex mutex;
+				std::condition_variable condition;
+				std::vector<std::string> messages;
+				std::vector<std::string> responses;
+				std::vector<std::string> infoMessages;
+				client.setDefaultInfoHandler( [&](const std::string& message)
+					{
+						std::lock_guard<std::mutex> lock( mutex );
+						infoMessages.push_back( message );
+						condition.notify_all();
+					});
+				for( size_t index=0; index<50; ++index )
+				{
+					messages.push_back( index%2==0 ? "short "+std::to_string(index) : std::string(1000+index,'x')+std::to_string(index) );
+					client.sendRequest( messages.back(), [&](const std::string& response)
+						{
+							std::lock_guard<std::mutex> lock( mutex );
+							responses.push_back( response );
+							condition.notify_all();
+						});
+				}
+				client.sendInfo( std::string(500,'y') );
+
+				std::unique_lock<std::mutex> lock( mutex );
+				CHECK( condition.wait_for( lock, std::chrono::seconds(5), [&]{ return responses.size()==messages.size() && infoMessages.size()==1; } ) );
+				REQUIRE( responses.size()==messages.size() );
+				for( size_t index=0; index<messages.size(); ++index ) CHECK( responses[index]=="Response to "+messages[index] );
+				REQUIRE( infoMessages.size()==1 );
+				CHECK( infoMessages.front()=="Info reply to "+std::string(500,'y') );
+				lock.unlock();
+				client.disconnect();
+			}
+		}
+		WHEN( "A client that doesn't offer compression connects" )
+		{
+			clientserver::WebSocketClient client;
+			REQUIRE_NOTHROW( client.connect( "localhost", server.port() ) );
+			CHECK_FALSE( client.isCompressing() );
+			std::mutex mutex;
+			std::condition_variable condition;
+			std::string response;
+			client.sendRequest( std::string(1000,'z'), [&](const std::string& message)
+				{
+					std::lock_guard<std::mutex> lock( mutex );
+					response=message;
+					condition.notify_all();
+				});
+			std::unique_lock<std::mutex> lock( mutex );
+			CHECK( condition.wait_for( lock, std::chrono::seconds(5), [&]{ return !response.empty(); } ) );
+			CHECK( response=="Response to "+std::string(1000,'z') );
+		}
+		WHEN( "A client speaks the protocol directly" )
+		{
+			int socket=clientserver::connectTcp( "localhost", server.port() );
+			std::string key;
+			std::string data=clientserver::WebSocketHandshake::createRequest( "localhost", "/", key, "permessage-deflate; client_max_window_bits" );
+			REQUIRE( ::send( socket, data.data(), data.size(), 0 )==static_cast<ssize_t>(data.size()) );
+			std::string received=::readUntil( socket, [](const std::string& data){ return data.find("\r\n\r\n")!=std::string::npos; } );
+			size_t responseSize;
+			std::string extensions;
+			REQUIRE( clientserver::WebSocketHandshake::parseResponse( received.data(), received.size(), key, responseSize, &extensions )==clientserver::WebSocketHandshake::Result::upgrade );
+			CHECK( extensions=="permessage-deflate" );
+
+			// A compressed request, to get a compressed response back in a frame with RSV1 set
+			clientserver::PerMessageDeflate::Parameters parameters;
+			clientserver::PerMessageDeflate perMessageDeflate( configuration, parameters );
+			const std::string request="q7:"+std::string(1000,'a');
+			std::string compressed;
+			perMessageDeflate.compress( request.data(), request.size(), compressed );
+			const uint8_t mask[4]={ 1, 2, 3, 4 };
+			data.clear();
+			clientserver::WebSocketFramer::encodeHeader( clientserver::WebSocketFramer::Opcode::text, compressed.size(), data, mask, true );
+			const size_t payloadStart=data.size();
+			data+=compressed;
+			clientserver::applyWebSocketMask( &data[payloadStart], compressed.size(), mask );
+			REQUIRE( ::send( socket, data.data(), data.size(), 0 )==static_cast<ssize_t>(data.size()) );
+
+			clientserver::WebSocketFramer framer( clientserver::WebSocketFramer::Role::client );
+			framer.setCompressor( &perMessageDeflate );
+			received=received.substr( responseSize );
+			// The response is small enough for the length to be in the second byte
+			received+=::readUntil( socket, [&](const std::string& data){ const std::string all=received+data; return all.size()>=2 && all.size()>=2+static_cast<size_t>(all[1] & 0x7f); } );
+			REQUIRE( received.size()>=2 );
+			CHECK( (received[0] & 0x40)!=0 );
+			CHECK( received.size()<100 );
+			framer.append( received.data(), received.size() );
+			clientserver::WebSocketFramer::Opcode opcode;
+			std::string response;
+			REQUIRE( framer.next( opcode, response ) );
+			CHECK( opcode==clientserver::WebSocketFramer::Opcode::text );
+			CHECK( response=="r7:Response to "+std::string(1000,'a') );
+			::close( socket );
+		}
+
+		server.stop();
+	}
+}
+
+SCENARIO( "Test that WebSocketServer compresses messages with a zstd dictionary", "[clientserver]" )
+{
+	GIVEN( "A server with a dictionary that also does permessage-deflate" )
+	{
+		std::vector<std::string> samples;
+		for( size_t index=0; index<2000; ++index ) samples.push_back( "{\"command\":\"setParameter\",\"requestId\":"+std::to_string(index*7919%100000)+",\"channel\":"+std::to_string(index%64)+",\"value\":"+std::to_string(index*104729%5000)+"}" );
+		std::shared_ptr<const clientserver::ZstdDictionary> pDictionary=std::make_shared<clientserver::ZstdDictionary>( clientserver::ZstdDictionary::train( samples, 4096 ) );
+		std::shared_ptr<const clientserver::ZstdDictionary> pOtherDictionary=std::make_shared<clientserver::ZstdDictionary>( clientserver::ZstdDictionary::train( std::vector<std::string>( samples.begin(), samples.begin()+1000 ), 2048 ) );
+		REQUIRE( pDictionary->id()!=pOtherDictionary->id() );
+
+		clientserver::WebSocketServer server;
+		server.setNumberOfThreads( 1 );
+		server.setCompression( clientserver::PerMessageDeflate::Configuration() );
+		server.setCompressionDictionaries( { pDictionary } );
+		server.setDefaultRequestHandler( [](const std::string& message,std::weak_ptr<clientserver::IConnection> pConnection)->std::string
+			{
+				return "Response to "+message;
+			});
+		REQUIRE_NOTHROW( server.listen( 0 ) );
+
+		WHEN( "Clients offer different combinations" )
+		{
+			struct Offer { std::string extensions; std::string expectedResponse; };
+			const std::string zstdOffer="x-clientserver-zstd; dictionary_id="+std::to_string(pDictionary->id());
+			const std::string otherZstdOffer="x-clientserver-zstd; dictionary_id="+std::to_string(pOtherDictionary->id());
+			for( const auto& offer : { Offer{ zstdOffer+", permessage-deflate", zstdOffer },
+			                           Offer{ "permessage-deflate, "+otherZstdOffer+", "+zstdOffer, zstdOffer },
+			                           Offer{ otherZstdOffer+", permessage-deflate", "permessage-deflate" },
+			                           Offer{ otherZstdOffer, "" } } )
+			{
+				int socket=clientserver::connectTcp( "localhost", server.port() );
+				std::string key;
+				const std::string request=clientserver::WebSocketHandshake::createRequest( "localhost", "/", key, offer.extensions );
+				REQUIRE( ::send( socket, request.data(), request.size(), 0 )==static_cast<ssize_t>(request.size()) );
+				const std::string received=::readUntil( socket, [](const std::string& data){ return data.find("\r\n\r\n")!=std::string::npos; } );
+				size_t responseSize;
+				std::string extensions;
+				CHECK( clientserver::WebSocketHandshake::parseResponse( received.data(), received.size(), key, responseSize, &extensions )==clientserver::WebSocketHandshake::Result::upgrade );
+				CHECK( extensions==offer.expectedResponse );
+				::close( socket );
+			}
+		}
+		WHEN( "WebSocketClients with and without the dictionary send requests" )
+		{
+			for( const auto& dictionaries : { std::vector<std::shared_ptr<const clientserver::ZstdDictionary> >{ pOtherDictionary, pDictionary },
+			                                  std::vector<std::shared_ptr<const clientserver::ZstdDictionary> >{ pOtherDictionary } } )
+			{
+				clientserver::WebSocketClient client;
+				client.setCompressionDictionaries( dictionaries );
+				REQUIRE_NOTHROW( client.connect( "localhost", server.port() ) );
+				CHECK( client.isCompressing()==(dictionaries.size()==2) );
+
+				std::mutex mutex;
+				std::condition_variable condition;
+				std::vector<std::string> responses;
+				for( size_t index=0; index<20; ++index )
+				{
+					client.sendRequest( samples[index], [&](const std::string& response)
+						{
+							std::lock_guard<std::mutex> lock( mutex );
+							responses.push_back( response );
+							condition.notify_all();
+						});
+				}
+				std::unique_lock<std::mutex> lock( mutex );
+				CHECK( condition.wait_for( lock, std::chrono::seconds(5), [&]{ return responses.size()==20; } ) );
+				REQUIRE( responses.size()==20 );
+				for( size_t index=0; index<responses.size(); ++index ) CHECK( responses[index]=="Response to "+samples[index] );
+				lock.unlock();
+				client.disconnect();
+			}
+		}
+
+		server.stop();
+	}
+}
+
+SCENARIO( "Test that WebSocketServer streams responses with flow control", "[clientserver]" )
+{
+	GIVEN( "A server with a small stream buffer and a handler that writes as many chunks as asked for" )
+	{
+		std::atomic<size_t> chunksWritten(0);
+		std::atomic<bool> wasBlocked(false);
+		std::mutex threadsMutex;
+		std::vector<std::thread> threads;
+
+		clientserver::WebSocketServer server;
+		server.setNumberOfThreads( 1 );
+		server.setStreamBufferSize( 64*1024 );
+		server.setDefaultStreamingRequestHandler( [&](const std::string& message,std::shared_ptr<clientserver::IResponseStream> pStream,std::weak_ptr<clientserver::IConnection> pConnection)
+			{
+				if( message=="throw" ) throw std::runtime_error( "Bad request" );
+				if( message=="drop" ) return;
+
+				// Requests for "thread <count>" are written from another thread that blocks, the rest from the writable handler
+				const bool useThread=(message.compare( 0, 7, "thread " )==0);
+				const size_t count=std::stoul( useThread ? message.substr(7) : message );
+				if( useThread )
+				{
+					std::lock_guard<std::mutex> lock( threadsMutex );
+					threads.emplace_back( [&,pStream,count]()
+						{
+							for( size_t index=0; index<count; ++index )
+							{
+								++chunksWritten;
+								if( pStream->write( ::streamChunk(index) ) ) continue;
+								wasBlocked=true;
+								if( !pStream->waitUntilWritable() ) return;
+							}
+							pStream->finish();
+						});
+					return;
+				}
+				auto pNextIndex=std::make_shared<size_t>( 0 );
+				auto writeChunks=[&,pStream,pNextIndex,count]()
+					{
+						while( *pNextIndex<count )
+						{
+							++chunksWritten;
+							if( !pStream->write( ::streamChunk((*pNextIndex)++) ) )
+							{
+								wasBlocked=true;
+								return;
+							}
+						}
+						pStream->finish();
+					};
+				pStream->setWritableHandler( writeChunks );
+				writeChunks();
+			});
+		REQUIRE_NOTHROW( server.listen( 0 ) );
+		clientserver::WebSocketClient client;
+		REQUIRE_NOTHROW( client.connect( "localhost", server.port() ) );
+
+		WHEN( "The client stops reading part way through a large reply" )
+		{
+			const size_t count=4000; // 64MB, much more than the socket buffers can take
+			::StreamCollector collector( true );
+			collector.send( client, std::to_string(count) );
+			REQUIRE( collector.waitForFirstChunk() );
+			std::this_thread::sleep_for( std::chrono::milliseconds(300) );
+			CHECK( wasBlocked );
+			CHECK( chunksWritten<count/4 );
+
+			collector.release();
+			CHECK( collector.waitForEnd() );
+			CHECK( collector.chunksReceived()==count );
+			CHECK( collector.chunksOutOfOrder()==0 );
+			CHECK( collector.error().empty() );
+		}
+		WHEN( "Several streams are written at once from the event loop and from other threads" )
+		{
+			std::vector<std::unique_ptr<::StreamCollector> > collectors;
+			for( size_t index=0; index<6; ++index )
+			{
+				collectors.emplace_back( new ::StreamCollector );
+				if( index%3==0 ) collectors.back()->send( client, "100" );
+				else if( index%3==1 ) collectors.back()->send( client, "thread 100" );
+				else collectors.back()->send( client, "100", true );
+			}
+			for( auto& pCollector : collectors )
+			{
+				CHECK( pCollector->waitForEnd() );
+				CHECK( pCollector->chunksReceived()==100 );
+				CHECK( pCollector->chunksOutOfOrder()==0 );
+				CHECK( pCollector->error().empty() );
+			}
+		}
+		WHEN( "The handler fails or doesn't finish the stream" )
+		{
+			for( const auto& request : { "throw", "drop", "not a number" } )
+			{
+				::StreamCollector collector;
+				collector.send( client, request );
+				CHECK( collector.waitForEnd() );
+				CHECK( collector.chunksReceived()==0 );
+				CHECK( !collector.error().empty() );
+				if( std::string(request)=="throw" ) CHECK( collector.error()=="Bad request" );
+			}
+		}
+
+		client.disconnect();
+		server.stop();
+		for( auto& thread : threads ) thread.join();
+	}
+}
+
+SCENARIO( "Test that WebSocketServer runs batches and concurrent requests in parallel", "[clientserver]" )
+{
+	GIVEN( "A server with four batch threads, concurrent requests and a slow handler" )
+	{
+		// Requests of "<milliseconds>/<text>" sleep for that long before replying
+		clientserver::WebSocketServer server;
+		server.setNumberOfThreads( 1 );
+		server.setNumberOfBatchThreads( 4 );
+		server.setConcurrentRequests( true );
+		server.setDefaultRequestHandler( [](const std::string& message,std::weak_ptr<clientserver::IConnection> pConnection)->std::string
+			{
+				const size_t separator=message.find( '/' );
+				if( separator==std::string::npos ) throw std::runtime_error( "Bad request" );
+				std::this_thread::sleep_for( std::chrono::milliseconds( std::stoul(message.substr(0,separator)) ) );
+				return "Response to "+message.substr( separator+1 );
+			});
+		REQUIRE_NOTHROW( server.listen( 0 ) );
+		clientserver::WebSocketClient client;
+		REQUIRE_NOTHROW( client.connect( "localhost", server.port() ) );
+		std::mutex mutex;
+		std::condition_variable condition;
+
+		WHEN( "The responses are sent all together" )
+		{
+			std::vector<std::string> requests;
+			for( size_t index=0; index<20; ++index ) requests.push_back( "50/"+std::to_string(index) );
+			requests.push_back( "invalid" );
+			std::vector<std::string> responses;
+			bool hasResponded=false;
+
+			const auto startTime=std::chrono::steady_clock::now();
+			client.sendBatch( requests, [&](const std::vector<std::string>& batchResponses)
+				{
+					std::lock_guard<std::mutex> lock( mutex );
+					responses=batchResponses;
+					hasResponded=true;
+					condition.notify_all();
+				});
+			std::unique_lock<std::mutex> lock( mutex );
+			REQUIRE( condition.wait_for( lock, std::chrono::seconds(5), [&]{ return hasResponded; } ) );
+			// One after the other would take a second
+			CHECK( std::chrono::steady_clock::now()-startTime<std::chrono::milliseconds(750) );
+			REQUIRE( responses.size()==requests.size() );
+			for( size_t index=0; index<20; ++index ) CHECK( responses[index]=="Response to "+std::to_string(index) );
+			CHECK( responses.back().empty() );
+		}
+		WHEN( "The responses are streamed as they finish" )
+		{
+			std::vector<size_t> order;
+			std::vector<std::string> responses( 4 );
+			bool hasEnded=false;
+			std::string error;
+			client.sendBinaryStreamingBatch( { "300/a", "200/b", "100/c", "0/d" }, [&](size_t index,const std::string& response)
+				{
+					std::lock_guard<std::mutex> lock( mutex );
+					order.push_back( index );
+					if( index<responses.size() ) responses[index]=response;
+				},
+				[&](const std::string& endError)
+				{
+					std::lock_guard<std::mutex> lock( mutex );
+					hasEnded=true;
+					error=endError;
+					condition.notify_all();
+				});
+			std::unique_lock<std::mutex> lock( mutex );
+			REQUIRE( condition.wait_for( lock, std::chrono::seconds(5), [&]{ return hasEnded; } ) );
+			CHECK( error.empty() );
+			CHECK( order==std::vector<size_t>( { 3, 2, 1, 0 } ) );
+			CHECK( responses==std::vector<std::string>( { "Response to a", "Response to b", "Response to c", "Response to d" } ) );
+		}
+		WHEN( "Pipelined single requests finish out of order" )
+		{
+			std::vector<std::string> responses;
+			for( const auto& request : { "300/slow", "0/fast", "100/medium" } )
+			{
+				client.sendRequest( request, [&](const std::string& response)
+					{
+						std::lock_guard<std::mutex> lock( mutex );
+						responses.push_back( response );
+						condition.notify_all();
+					});
+			}
+			std::unique_lock<std::mutex> lock( mutex );
+			REQUIRE( condition.wait_for( lock, std::chrono::seconds(5), [&]{ return responses.size()==3; } ) );
+			CHECK( responses==std::vector<std::string>( { "Response to fast", "Response to medium", "Response to slow" } ) );
+		}
+		WHEN( "Empty and invalid batches are sent" )
+		{
+			std::vector<std::string> responses( 1, "not set" );
+			bool hasResponded=false;
+			client.sendBatch( {}, [&](const std::vector<std::string>& batchResponses)
+				{
+					std::lock_guard<std::mutex> lock( mutex );
+					responses=batchResponses;
+					hasResponded=true;
+					condition.notify_all();
+				});
+			std::unique_lock<std::mutex> lock( mutex );
+			REQUIRE( condition.wait_for( lock, std::chrono::seconds(5), [&]{ return hasResponded; } ) );
+			CHECK( responses.empty() );
+			lock.unlock();
+
+			// Not something WebSocketClient can send, so write the frame by hand
+			int socket=clientserver::connectTcp( "localhost", server.port() );
+			std::string key;
+			std::string data=clientserver::WebSocketHandshake::createRequest( "localhost", "/", key );
+			const uint8_t mask[4]={ 1, 2, 3, 4 };
+			clientserver::WebSocketFramer::encode( clientserver::WebSocketFramer::Opcode::text, "p3:0:10:short", data, mask );
+			REQUIRE( ::send( socket, data.data(), data.size(), 0 )==static_cast<ssize_t>(data.size()) );
+			const std::string received=::readUntil( socket, [](const std::string& data){ return data.find("e3:")!=std::string::npos; } );
+			CHECK( received.find("BatchEnvelope")!=std::string::npos );
+			::close( socket );
+		}
+
+		client.disconnect();
+		server.stop();
+	}
+}
+
+SCENARIO( "Test that WebSocketServer schedules logical channels by priority and credit", "[clientserver]" )
+{
+	GIVEN( "A server with a request that has a large response" )
+	{
+		const std::string bigResponse( 4*1024*1024, 'x' );
+		clientserver::WebSocketServer server;
+		server.setDefaultRequestHandler( [&](const std::string& message,std::weak_ptr<clientserver::IConnection> pConnection)->std::string
+			{
+				if( message=="big" ) return bigResponse;
+				return "Response to "+message;
+			});
+		REQUIRE_NOTHROW( server.listen( 0 ) );
+		::RawClient client( server.port() );
+
+		WHEN( "A small request on a high priority channel follows a large one on a low priority channel" )
+		{
+			client.send( "o1:0:1000000000" );
+			client.send( "o2:9:1000000000" );
+			client.send( "m1:q1:big" );
+
+			// Wait until the large response is well under way
+			std::string bulk;
+			std::string message;
+			while( bulk.size()<128*1024 )
+			{
+				message=client.receive();
+				REQUIRE( message.compare(0,3,"f1:")==0 );
+				bulk+=message.substr(3);
+			}
+			client.send( "m2:q2:hello" );
+
+			size_t bulkBeforeResponse=0;
+			bool hasFinished=false;
+			while( !hasFinished )
+			{
+				message=client.receive();
+				REQUIRE( !message.empty() );
+				if( message=="m2:r2:Response to hello" ) bulkBeforeResponse=bulk.size();
+				else if( message.compare(0,3,"f1:")==0 || message.compare(0,3,"m1:")==0 ) bulk+=message.substr(3);
+				else FAIL( "Unexpected message \""+message.substr(0,20)+"\"" );
+				hasFinished=( message.compare(0,3,"m1:")==0 );
+			}
+			CHECK( bulk=="r1:"+bigResponse );
+			// Without the channels the whole of the large response would have been first
+			CHECK( bulkBeforeResponse>0 );
+			CHECK( bulkBeforeResponse<1024*1024 );
+		}
+		WHEN( "A channel runs out of credit" )
+		{
+			client.send( "o3:0:65536" );
+			client.send( "m3:q3:big" );
+			std::string bulk;
+			while( bulk.size()<65536 ) bulk+=client.receive().substr(3);
+			CHECK( bulk.size()==65536 );
+			// Nothing more comes until the client asks, but other messages still do
+			CHECK( client.receive( std::chrono::milliseconds(200) ).empty() );
+			client.send( "q4:hello" );
+			CHECK( client.receive()=="r4:Response to hello" );
+
+			client.send( "w3:100000000" );
+			std::string message;
+			do
+			{
+				message=client.receive();
+				REQUIRE( !message.empty() );
+				bulk+=message.substr(3);
+			} while( message.compare(0,3,"m3:")!=0 );
+			CHECK( bulk=="r3:"+bigResponse );
+		}
+		WHEN( "A message is sent on a channel that hasn't been opened" )
+		{
+			// Goes back on the same channel, just without being scheduled
+			client.send( "m5:q5:hello" );
+			CHECK( client.receive()=="m5:r5:Response to hello" );
+		}
+		WHEN( "Channel zero is opened" )
+		{
+			client.send( "o0:1:1000" );
+			CHECK( client.receive()=="close 1002" );
+		}
+
+		server.stop();
+	}
+}
+
+SCENARIO( "Test that WebSocketServer drains connections before closing them", "[clientserver]" )
+{
+	GIVEN( "A server with concurrent requests and a slow handler" )
+	{
+		// Requests of "<milliseconds>/<text>" sleep for that long before replying
+		clientserver::WebSocketServer server;
+		server.setNumberOfThreads( 1 );
+		server.setNumberOfBatchThreads( 2 );
+		server.setConcurrentRequests( true );
+		server.setDefaultRequestHandler( [](const std::string& message,std::weak_ptr<clientserver::IConnection> pConnection)->std::string
+			{
+				const size_t separator=message.find( '/' );
+				std::this_thread::sleep_for( std::chrono::milliseconds( std::stoul(message.substr(0,separator)) ) );
+				return "Response to "+message.substr( separator+1 );
+			});
+		REQUIRE_NOTHROW( server.listen( 0 ) );
+		::RawClient busyClient( server.port() );
+		::RawClient idleClient( server.port() );
+
+		WHEN( "The server is drained while a request is being handled" )
+		{
+			busyClient.send( "q1:300/slow" );
+			busyClient.send( "q2:0/fast" );
+			CHECK( busyClient.receive()=="r2:Response to fast" );
+			server.drain();
+
+			// Both are told to go away straight away, but the slow request still gets its response before the close
+			CHECK( idleClient.receive()=="g0:" );
+			CHECK( idleClient.receive()=="close 1001" );
+			CHECK( busyClient.receive()=="g0:" );
+			CHECK( busyClient.receive()=="r1:Response to slow" );
+			CHECK( busyClient.receive()=="close 1001" );
+
+			for( size_t attempt=0; attempt<50 && server.currentConnections()>0; ++attempt ) std::this_thread::sleep_for( std::chrono::milliseconds(10) );
+			CHECK( server.currentConnections()==0 );
+		}
+
+		server.stop();
+	}
+}
+
+SCENARIO( "Test that WebSocketServer stops reading from a client that doesn't read the replies", "[clientserver]" )
+{
+	GIVEN( "A server with large responses and a small stream buffer" )
+	{
+		std::atomic<size_t> requestsHandled( 0 );
+		const std::string largeResponse( 64*1024, 'x' );
+		const size_t numberOfRequests=4000;
+
+		clientserver::WebSocketServer server;
+		server.setNumberOfThreads( 1 );
+		server.setStreamBufferSize( 128*1024 );
+		server.setDefaultRequestHandler( [&](const std::string& message,std::weak_ptr<clientserver::IConnection> pConnection)->std::string
+			{
+				++requestsHandled;
+				return largeResponse;
+			});
+
+		// Sends all of the requests without reading, checks the server stops, then reads everything
+		auto checkBounded=[&]()
+			{
+				::RawClient client( server.port() );
+				for( size_t index=0; index<numberOfRequests; ++index ) client.send( "q"+std::to_string(index)+":hello" );
+
+				size_t previousHandled;
+				do
+				{
+					previousHandled=requestsHandled;
+					std::this_thread::sleep_for( std::chrono::milliseconds(200) );
+				} while( requestsHandled!=previousHandled );
+				// Without the limits all of them would be handled, with the replies piling up in the server. With
+				// them there should only be as many as fit in the socket buffers and the stream buffer, or for
+				// concurrent requests as many as are allowed to wait for the handler pool (1024).
+				CHECK( requestsHandled<numberOfRequests/3 );
+
+				// Replies to concurrent requests can be in any order
+				std::set<std::string> ids;
+				size_t numberOfErrors=0;
+				for( size_t index=0; index<numberOfRequests; ++index )
+				{
+					const std::string message=client.receive();
+					const size_t colonPosition=message.find( ':' );
+					if( colonPosition==std::string::npos || message[0]!='r' || message.substr(colonPosition+1)!=largeResponse ) ++numberOfErrors;
+					else ids.insert( message.substr(1,colonPosition-1) );
+				}
+				CHECK( numberOfErrors==0 );
+				CHECK( ids.size()==numberOfRequests );
+				CHECK( requestsHandled==numberOfRequests );
+			};
+
+		WHEN( "Requests are handled on the event loop" )
+		{
+			REQUIRE_NOTHROW( server.listen( 0 ) );
+			checkBounded();
+		}
+		WHEN( "Requests are handled concurrently on the handler pool" )
+		{
+			server.setNumberOfBatchThreads( 2 );
+			server.setConcurrentRequests( true );
+			REQUIRE_NOTHROW( server.listen( 0 ) );
+			checkBounded();
+		}
+		WHEN( "The requests are all in one streamed batch" )
+		{
+			server.setNumberOfBatchThreads( 2 );
+			REQUIRE_NOTHROW( server.listen( 0 ) );
+			const size_t numberOfEntries=500;
+			std::string batch;
+			for( size_t index=0; index<numberOfEntries; ++index ) clientserver::BatchEnvelope::encode( index, "hello", batch );
+			std::string message;
+			clientserver::MessageEnvelope::encode( clientserver::MessageEnvelope::MessageType::streamingBatchRequest, 1, batch, message );
+
+			::RawClient client( server.port() );
+			client.send( message );
+			size_t previousHandled;
+			do
+			{
+				previousHandled=requestsHandled;
+				std::this_thread::sleep_for( std::chrono::milliseconds(200) );
+			} while( requestsHandled!=previousHandled );
+			// The whole batch is one request, so only the stream's flow control can hold the sub-requests back
+			CHECK( requestsHandled<numberOfEntries/3 );
+
+			std::set<uint32_t> ids;
+			size_t numberOfErrors=0;
+			std::string endError="not received";
+			while( endError=="not received" )
+			{
+				std::string reply=client.receive();
+				if( reply.empty() ) break;
+				clientserver::MessageEnvelope::MessageType type;
+				uint32_t id;
+				clientserver::MessageEnvelope::decode( reply, type, id );
+				if( type==clientserver::MessageEnvelope::MessageType::streamEnd ) endError=reply;
+				else
+				{
+					std::vector<clientserver::BatchEnvelope::Entry> entries;
+					clientserver::BatchEnvelope::decode( reply, entries );
+					for( const auto& entry : entries )
+					{
+						if( entry.payload!=largeResponse ) ++numberOfErrors;
+						ids.insert( entry.id );
+					}
+				}
+			}
+			CHECK( endError.empty() );
+			CHECK( numberOfErrors==0 );
+			CHECK( ids.size()==numberOfEntries );
+			CHECK( requestsHandled==numberOfEntries );
+		}
+
+		server.stop();
+	}
+}
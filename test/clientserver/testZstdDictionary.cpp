@@ -0,0 +1,225 @@
+#include "catch.hpp"
+#include "clientserver/ZstdDictionary.h"
+#include "clientserver/ZstdDictionaryCompressor.h"
+#include "clientserver/PerMessageDeflate.h"
+#include "clientserver/WebSocketFramer.h"
+#include <sstream>
+#include <random>
+#include <stdexcept>
+
+namespace // Unnamed namespace for things only used in this file
+{
+	/** @brief Something like a command from a control panel, between 100 and 500 bytes with the same keys in each. */
+	std::string exampleCommand( std::mt19937& generator )
+	{
+		static const char* const commands[]={ "setParameter", "getStatus", "startRun", "stopRun", "subscribe", "configureChannel" };
+		static const char* const units[]={ "V", "mA", "Hz", "degC", "rpm" };
+		std::uniform_int_distribution<int> distribution( 0, 999999 );
+		std::string message="{\"command\":\""+std::string(commands[distribution(generator)%6])+"\",\"requestId\":"+std::to_string(distribution(generator))
+				+",\"timestamp\":\"2026-10-19T"+std::to_string(10+distribution(generator)%10)+":"+std::to_string(10+distribution(generator)%50)+":00Z\",\"channels\":[";
+		const int numberOfChannels=1+distribution(generator)%5;
+		for( int channel=0; channel<numberOfChannels; ++channel )
+		{
+			if( channel!=0 ) message+=",";
+			message+="{\"board\":"+std::to_string(distribution(generator)%16)+",\"channel\":"+std::to_string(distribution(generator)%64)
+					+",\"value\":"+std::to_string(distribution(generator)%5000)+",\"units\":\""+units[distribution(generator)%5]+"\",\"enabled\":true}";
+		}
+		return message+"]}";
+	}
+
+	std::vector<std::string> exampleCommands( size_t number, unsigned seed )
+	{
+		std::mt19937 generator( seed );
+		std::vector<std::string> messages;
+		for( size_t index=0; index<number; ++index ) messages.push_back( exampleCommand(generator) );
+		return messages;
+	}
+
+	std::shared_ptr<const clientserver::ZstdDictionary> trainedDictionary()
+	{
+		static std::shared_ptr<const clientserver::ZstdDictionary> pDictionary=std::make_shared<clientserver::ZstdDictionary>( clientserver::ZstdDictionary::train( ::exampleCommands(5000,1), 16384 ) );
+		return pDictionary;
+	}
+} // end of the unnamed namespace
+
+SCENARIO( "Test that ZstdDictionary trains dictionaries and reads capture files", "[clientserver]" )
+{
+	GIVEN( "Some captured messages" )
+	{
+		const std::vector<std::string> messages={ "first", std::string(), std::string(1000,'\0'), "last" };
+
+		WHEN( "Writing and reading them back" )
+		{
+			std::stringstream captureFile;
+			for( const auto& message : messages ) clientserver::ZstdDictionary::writeSample( captureFile, message );
+			CHECK( captureFile.str().size()==4*4+5+1000+4 );
+			CHECK( clientserver::ZstdDictionary::readSamples( captureFile )==messages );
+		}
+		WHEN( "The file is truncated" )
+		{
+			std::stringstream captureFile;
+			for( const auto& message : messages ) clientserver::ZstdDictionary::writeSample( captureFile, message );
+			for( const size_t cut : { 1, 3, 4 } )
+			{
+				std::stringstream truncated( captureFile.str().substr( 0, captureFile.str().size()-cut ) );
+				CHECK_THROWS_AS( clientserver::ZstdDictionary::readSamples( truncated ), std::runtime_error& );
+			}
+		}
+	}
+	GIVEN( "A dictionary trained on typical commands" )
+	{
+		auto pDictionary=::trainedDictionary();
+		CHECK( pDictionary->id()!=0 );
+		CHECK( pDictionary->contents().size()<=16384 );
+
+		WHEN( "Loading it again from the contents" )
+		{
+			clientserver::ZstdDictionary copy( pDictionary->contents() );
+			CHECK( copy.id()==pDictionary->id() );
+		}
+		WHEN( "Giving something that isn't a dictionary" )
+		{
+			CHECK_THROWS_AS( clientserver::ZstdDictionary( "Not a dictionary" ), std::runtime_error& );
+			CHECK_THROWS_AS( clientserver::ZstdDictionary::load( "/nonexistent/dictionary" ), std::runtime_error& );
+		}
+		WHEN( "There aren't enough samples to train from" )
+		{
+			CHECK_THROWS_AS( clientserver::ZstdDictionary::train( { "a", "b" }, 16384 ), std::runtime_error& );
+		}
+	}
+}
+
+SCENARIO( "Test that ZstdDictionaryCompressor negotiates the dictionary", "[clientserver]" )
+{
+	typedef clientserver::ZstdDictionaryCompressor ZstdDictionaryCompressor;
+	auto pDictionary=::trainedDictionary();
+	auto pOtherDictionary=std::make_shared<clientserver::ZstdDictionary>( clientserver::ZstdDictionary::train( ::exampleCommands(2000,2), 4096 ) );
+	REQUIRE( pDictionary->id()!=pOtherDictionary->id() );
+	const std::string id=std::to_string(pDictionary->id());
+	const std::string otherId=std::to_string(pOtherDictionary->id());
+
+	GIVEN( "A client with two dictionaries" )
+	{
+		const std::string offer=ZstdDictionaryCompressor::createOffer( { pOtherDictionary, pDictionary } );
+		CHECK( offer=="x-clientserver-zstd; dictionary_id="+otherId+", x-clientserver-zstd; dictionary_id="+id );
+		std::string response;
+
+		WHEN( "The server only has the second" )
+		{
+			CHECK( ZstdDictionaryCompressor::acceptOffer( offer, { pDictionary }, response )==pDictionary );
+			CHECK( response=="x-clientserver-zstd; dictionary_id="+id );
+			CHECK( ZstdDictionaryCompressor::acceptResponse( response, { pOtherDictionary, pDictionary } )==pDictionary );
+		}
+		WHEN( "The server has both" )
+		{
+			CHECK( ZstdDictionaryCompressor::acceptOffer( offer, { pDictionary, pOtherDictionary }, response )==pOtherDictionary );
+		}
+		WHEN( "The server has neither" )
+		{
+			CHECK( ZstdDictionaryCompressor::acceptOffer( offer, {}, response )==nullptr );
+			CHECK( ZstdDictionaryCompressor::acceptOffer( "permessage-deflate, x-clientserver-zstd; dictionary_id=0, x-clientserver-zstd; dictionary_id="+id+"0", { pDictionary }, response )==nullptr );
+			CHECK( response.empty() );
+		}
+		WHEN( "The server replies with something else" )
+		{
+			CHECK( ZstdDictionaryCompressor::acceptResponse( "", { pDictionary } )==nullptr );
+			CHECK( ZstdDictionaryCompressor::acceptResponse( "permessage-deflate", { pDictionary } )==nullptr );
+			CHECK_THROWS_AS( ZstdDictionaryCompressor::acceptResponse( "x-clientserver-zstd; dictionary_id="+otherId, { pDictionary } ), std::runtime_error& );
+			CHECK_THROWS_AS( ZstdDictionaryCompressor::acceptResponse( "x-clientserver-zstd", { pDictionary } ), std::runtime_error& );
+		}
+	}
+}
+
+SCENARIO( "Test that ZstdDictionaryCompressor compresses small messages", "[clientserver]" )
+{
+	GIVEN( "A compressor with a dictionary trained on similar messages" )
+	{
+		clientserver::ZstdDictionaryCompressor compressor( ::trainedDictionary() );
+		CHECK( compressor.shouldCompress( 32 ) );
+		CHECK( !compressor.shouldCompress( 31 ) );
+		CHECK_THROWS_AS( clientserver::ZstdDictionaryCompressor( nullptr ), std::invalid_argument& );
+
+		WHEN( "Compressing messages that weren't used to train" )
+		{
+			size_t originalBytes=0;
+			size_t compressedBytes=0;
+			size_t deflateBytes=0;
+			clientserver::PerMessageDeflate::Configuration configuration;
+			clientserver::PerMessageDeflate::Parameters parameters;
+			parameters.compressNoContextTakeover=true;
+			clientserver::PerMessageDeflate perMessageDeflate( configuration, parameters );
+			for( const auto& message : ::exampleCommands(500,3) )
+			{
+				std::string compressed;
+				compressor.compress( message.data(), message.size(), compressed );
+				std::string decompressed;
+				compressor.decompress( compressed.data(), compressed.size(), decompressed, 1024 );
+				CHECK( decompressed==message );
+
+				std::string deflated;
+				perMessageDeflate.compress( message.data(), message.size(), deflated );
+				originalBytes+=message.size();
+				compressedBytes+=compressed.size();
+				deflateBytes+=deflated.size();
+			}
+			CHECK( originalBytes/500>=100 );
+			CHECK( originalBytes/500<=500 );
+			CHECK( originalBytes>=3*compressedBytes );
+			CHECK( deflateBytes>=2*compressedBytes );
+		}
+		WHEN( "Compressing a message in parts" )
+		{
+			const std::string message=::exampleCommands(1,4).front();
+			std::string whole;
+			compressor.compress( message.data(), message.size(), whole );
+			std::string parts="prefix";
+			compressor.compress( message.data(), 10, parts, false );
+			CHECK( parts=="prefix" );
+			compressor.compress( message.data()+10, message.size()-10, parts, true );
+			CHECK( parts=="prefix"+whole );
+		}
+		WHEN( "Decompressing bad data" )
+		{
+			const std::string message=::exampleCommands(1,5).front();
+			std::string compressed;
+			compressor.compress( message.data(), message.size(), compressed );
+			std::string output="unchanged";
+			CHECK_THROWS_AS( compressor.decompress( compressed.data(), compressed.size(), output, message.size()-1 ), std::length_error& );
+			CHECK_THROWS_AS( compressor.decompress( "garbage", 7, output, 1024 ), std::runtime_error& );
+			CHECK( output=="unchanged" );
+		}
+		WHEN( "Decompressing with a different dictionary" )
+		{
+			const std::string message=::exampleCommands(1,6).front();
+			std::string compressed;
+			compressor.compress( message.data(), message.size(), compressed );
+			clientserver::ZstdDictionaryCompressor otherCompressor( std::make_shared<clientserver::ZstdDictionary>( clientserver::ZstdDictionary::train( ::exampleCommands(2000,7), 4096 ) ) );
+			std::string output;
+			try { otherCompressor.decompress( compressed.data(), compressed.size(), output, 1024 ); }
+			catch( std::exception& error ) { /* Either an error or the wrong message is fine */ }
+			CHECK( output!=message );
+		}
+	}
+	GIVEN( "A framer that decompresses with it" )
+	{
+		clientserver::ZstdDictionaryCompressor compressor( ::trainedDictionary() );
+		clientserver::WebSocketFramer framer( clientserver::WebSocketFramer::Role::client );
+		framer.setCompressor( &compressor );
+
+		WHEN( "Receiving a compressed message" )
+		{
+			const std::string message=::exampleCommands(1,8).front();
+			std::string compressed;
+			compressor.compress( message.data(), message.size(), compressed );
+			std::string data;
+			clientserver::WebSocketFramer::encodeHeader( clientserver::WebSocketFramer::Opcode::text, compressed.size(), data, nullptr, true );
+			data+=compressed;
+			framer.append( data.data(), data.size() );
+			clientserver::WebSocketFramer::Opcode opcode;
+			std::string received;
+			REQUIRE( framer.next( opcode, received ) );
+			CHECK( opcode==clientserver::WebSocketFramer::Opcode::text );
+			CHECK( received==message );
+		}
+	}
+}
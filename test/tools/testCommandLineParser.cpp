@@ -141,3 +141,45 @@ SCENARIO( "Test that CommandLineParser parses arguments correctly", "[tools]" )
 		}
 	}
 }
+
+SCENARIO( "Test that parseSizeOption converts option arguments correctly", "[tools]" )
+{
+	GIVEN( "A CommandLineParser instance with a numeric option" )
+	{
+		tools::CommandLineParser optionParser;
+		optionParser.addOption( "count", tools::CommandLineParser::RequiredArgument );
+
+		WHEN( "Parsing a valid number" )
+		{
+			const char* testLine1[]={ "myExe", "--count", "1000" };
+			REQUIRE_NOTHROW( optionParser.parse( sizeof(testLine1)/sizeof(const char*), testLine1 ) );
+			CHECK( tools::parseSizeOption( optionParser, "count" )==1000 );
+		}
+		WHEN( "The option is given more than once" )
+		{
+			const char* testLine1[]={ "myExe", "--count", "1", "--count=2" };
+			REQUIRE_NOTHROW( optionParser.parse( sizeof(testLine1)/sizeof(const char*), testLine1 ) );
+			CHECK( tools::parseSizeOption( optionParser, "count" )==2 );
+		}
+		WHEN( "Parsing invalid numbers" )
+		{
+			const char* testLine1[]={ "myExe", "--count", "ten" };
+			REQUIRE_NOTHROW( optionParser.parse( sizeof(testLine1)/sizeof(const char*), testLine1 ) );
+			CHECK_THROWS( tools::parseSizeOption( optionParser, "count" ) );
+
+			const char* testLine2[]={ "myExe", "--count", "10k" };
+			REQUIRE_NOTHROW( optionParser.parse( sizeof(testLine2)/sizeof(const char*), testLine2 ) );
+			CHECK_THROWS( tools::parseSizeOption( optionParser, "count" ) );
+
+			const char* testLine3[]={ "myExe", "--count=-5" };
+			REQUIRE_NOTHROW( optionParser.parse( sizeof(testLine3)/sizeof(const char*), testLine3 ) );
+			CHECK_THROWS( tools::parseSizeOption( optionParser, "count" ) );
+		}
+		WHEN( "The option was not set" )
+		{
+			const char* testLine1[]={ "myExe" };
+			REQUIRE_NOTHROW( optionParser.parse( sizeof(testLine1)/sizeof(const char*), testLine1 ) );
+			CHECK_THROWS( tools::parseSizeOption( optionParser, "count" ) );
+		}
+	}
+}
@@ -0,0 +1,35 @@
+#include "catch.hpp"
+#include "tools/LatencyRecorder.h"
+
+SCENARIO( "Test that LatencyRecorder calculates statistics correctly", "[tools]" )
+{
+	GIVEN( "An empty LatencyRecorder" )
+	{
+		tools::LatencyRecorder recorder;
+
+		WHEN( "Querying without any samples" )
+		{
+			CHECK( recorder.count()==0 );
+			CHECK( recorder.mean()==0 );
+			CHECK( recorder.maximum()==0 );
+			CHECK( recorder.percentile(0.5)==0 );
+		}
+		WHEN( "Recording the numbers 1 to 100 in reverse order" )
+		{
+			for( uint64_t value=100; value>0; --value ) recorder.record( value );
+
+			CHECK( recorder.count()==100 );
+			CHECK( recorder.mean()==50 ); // 50.5 rounded down
+			CHECK( recorder.maximum()==100 );
+			CHECK( recorder.percentile(0.5)==50 );
+			CHECK( recorder.percentile(0.99)==99 );
+			CHECK( recorder.percentile(1.0)==100 );
+			CHECK( recorder.percentile(0.0)==1 );
+
+			// Adding more samples after a percentile has been calculated should still give the right answer
+			recorder.record( 1000 );
+			CHECK( recorder.maximum()==1000 );
+			CHECK( recorder.percentile(1.0)==1000 );
+		}
+	}
+}